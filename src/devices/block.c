@@ -3,7 +3,21 @@
 #include <string.h>
 #include <stdio.h>
 #include "devices/ide.h"
+#include "devices/timer.h"
+#include "threads/kstat.h"
 #include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/thread.h"
+#include "threads/trace.h"
+#include "threads/vaddr.h"
+
+/* Most sectors the I/O thread merges adjacent requests into. */
+#define MERGE_SECTORS 64
+#define MERGE_PAGES (MERGE_SECTORS * BLOCK_SECTOR_SIZE / PGSIZE)
+
+/* Timer ticks a queued request waits for each level of priority it
+   gains, so that a stream of urgent requests can't starve it. */
+#define AGING_TICKS 2
 
 /* A block device. */
 struct block
@@ -19,6 +33,26 @@ struct block
 
     unsigned long long read_cnt;        /* Number of sectors read. */
     unsigned long long write_cnt;       /* Number of sectors written. */
+
+    struct block *parent;               /* Device this is a part of. */
+    block_sector_t parent_start;        /* First sector within PARENT. */
+
+    /* Asynchronous requests, for devices without a parent. */
+    struct lock queue_lock;             /* Guards the members below. */
+    struct list queue;                  /* Submitted block_requests,
+                                           ordered by dev_sector. */
+    struct condition queue_nonempty;    /* Signaled on submission. */
+    bool has_io_thread;                 /* I/O thread started? */
+    block_sector_t head;                /* Sector after last dispatched. */
+    size_t queue_len;                   /* Requests in QUEUE. */
+
+    /* Queue statistics. */
+    unsigned long long request_cnt;     /* Number of requests submitted. */
+    unsigned long long merge_cnt;       /* Number merged into others. */
+    unsigned long long jump_cnt;        /* Number served out of C-LOOK
+                                           order for their priority. */
+    unsigned long long depth_sum;       /* Sum of queue_len on submission. */
+    size_t max_depth;                   /* Largest queue_len seen. */
   };
 
 /* List of all block devices. */
@@ -28,6 +62,27 @@ static struct list all_blocks = LIST_INITIALIZER (all_blocks);
 static struct block *block_by_role[BLOCK_ROLE_CNT];
 
 static struct block *list_elem_to_block (struct list_elem *);
+static void do_request (struct block_request *);
+static void do_merged_requests (struct list *, size_t cnt, uint8_t *buffer);
+static list_less_func request_less;
+static int request_priority (const struct block_request *, int64_t now);
+static thread_func block_io_thread;
+
+/* Statistics of the file system device. */
+static uint64_t read_fs_read_cnt (void);
+static uint64_t read_fs_write_cnt (void);
+static struct kstat_counter stat_fs_read
+  = KSTAT_GAUGE ("block.filesys.read", read_fs_read_cnt);
+static struct kstat_counter stat_fs_write
+  = KSTAT_GAUGE ("block.filesys.write", read_fs_write_cnt);
+
+/* Statistics of the swap device. */
+static uint64_t read_swap_read_cnt (void);
+static uint64_t read_swap_write_cnt (void);
+static struct kstat_counter stat_swap_read
+  = KSTAT_GAUGE ("block.swap.read", read_swap_read_cnt);
+static struct kstat_counter stat_swap_write
+  = KSTAT_GAUGE ("block.swap.write", read_swap_write_cnt);
 
 /* Returns a human-readable name for the given block device
    TYPE. */
@@ -61,8 +116,76 @@ block_get_role (enum block_type role)
 void
 block_set_role (enum block_type role, struct block *block)
 {
+  static bool fs_registered, swap_registered;
+
   ASSERT (role < BLOCK_ROLE_CNT);
   block_by_role[role] = block;
+  if (role == BLOCK_FILESYS && !fs_registered)
+    {
+      kstat_register (&stat_fs_read);
+      kstat_register (&stat_fs_write);
+      fs_registered = true;
+    }
+  else if (role == BLOCK_SWAP && !swap_registered)
+    {
+      kstat_register (&stat_swap_read);
+      kstat_register (&stat_swap_write);
+      swap_registered = true;
+    }
+}
+
+/* Returns the sectors read from the file system device, for the
+   block.filesys.read statistic. */
+static uint64_t
+read_fs_read_cnt (void)
+{
+  struct block *block = block_by_role[BLOCK_FILESYS];
+  return block != NULL ? block->read_cnt : 0;
+}
+
+/* Returns the sectors written to the file system device, for the
+   block.filesys.write statistic. */
+static uint64_t
+read_fs_write_cnt (void)
+{
+  struct block *block = block_by_role[BLOCK_FILESYS];
+  return block != NULL ? block->write_cnt : 0;
+}
+
+/* Returns true if BLOCK is one of the devices swap may be striped
+   over: the swap device or another swap partition. */
+static bool
+is_swap_device (struct block *block)
+{
+  return block == block_by_role[BLOCK_SWAP] || block->type == BLOCK_SWAP;
+}
+
+/* Returns the sectors read from the swap devices, for the
+   block.swap.read statistic. */
+static uint64_t
+read_swap_read_cnt (void)
+{
+  struct block *block;
+  uint64_t cnt = 0;
+
+  for (block = block_first (); block != NULL; block = block_next (block))
+    if (is_swap_device (block))
+      cnt += block->read_cnt;
+  return cnt;
+}
+
+/* Returns the sectors written to the swap devices, for the
+   block.swap.write statistic. */
+static uint64_t
+read_swap_write_cnt (void)
+{
+  struct block *block;
+  uint64_t cnt = 0;
+
+  for (block = block_first (); block != NULL; block = block_next (block))
+    if (is_swap_device (block))
+      cnt += block->write_cnt;
+  return cnt;
 }
 
 /* Returns the first block device in kernel probe order, or a
@@ -121,6 +244,7 @@ void
 block_read (struct block *block, block_sector_t sector, void *buffer)
 {
   check_sector (block, sector);
+  TRACE (TRACE_BLOCK_READ, sector, 1);
   block->ops->read (block->aux, sector, buffer);
   block->read_cnt++;
 }
@@ -135,10 +259,349 @@ block_write (struct block *block, block_sector_t sector, const void *buffer)
 {
   check_sector (block, sector);
   ASSERT (block->type != BLOCK_FOREIGN);
+  TRACE (TRACE_BLOCK_WRITE, sector, 1);
   block->ops->write (block->aux, sector, buffer);
   block->write_cnt++;
 }
 
+/* Verifies that the CNT sectors starting at SECTOR all lie within
+   BLOCK.  Panics if not. */
+static void
+check_sectors (struct block *block, block_sector_t sector, size_t cnt)
+{
+  ASSERT (cnt > 0);
+  check_sector (block, sector);
+  if (cnt > block->size - sector)
+    PANIC ("Access past end of device %s (sector=%"PRDSNu", cnt=%zu, "
+           "size=%"PRDSNu")\n", block_name (block), sector, cnt,
+           block->size);
+}
+
+/* Reads CNT contiguous sectors starting at SECTOR from BLOCK into
+   BUFFER, which must have room for CNT * BLOCK_SECTOR_SIZE bytes.
+   Drivers that support it transfer up to BLOCK_MAX_MULTIPLE
+   sectors per request, saving a command and its completion per
+   sector.
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_read_multiple (struct block *block, block_sector_t sector, size_t cnt,
+                     void *buffer_)
+{
+  uint8_t *buffer = buffer_;
+
+  check_sectors (block, sector, cnt);
+  TRACE (TRACE_BLOCK_READ, sector, cnt);
+  while (cnt > 0)
+    {
+      size_t chunk = cnt < BLOCK_MAX_MULTIPLE ? cnt : BLOCK_MAX_MULTIPLE;
+      size_t i;
+
+      if (block->ops->read_multiple != NULL)
+        block->ops->read_multiple (block->aux, sector, chunk, buffer);
+      else
+        for (i = 0; i < chunk; i++)
+          block->ops->read (block->aux, sector + i,
+                            buffer + i * BLOCK_SECTOR_SIZE);
+      block->read_cnt += chunk;
+
+      sector += chunk;
+      buffer += chunk * BLOCK_SECTOR_SIZE;
+      cnt -= chunk;
+    }
+}
+
+/* Writes CNT contiguous sectors starting at SECTOR to BLOCK from
+   BUFFER, which must contain CNT * BLOCK_SECTOR_SIZE bytes.
+   Returns after the block device has acknowledged receiving all
+   of the data.
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_write_multiple (struct block *block, block_sector_t sector, size_t cnt,
+                      const void *buffer_)
+{
+  const uint8_t *buffer = buffer_;
+
+  check_sectors (block, sector, cnt);
+  ASSERT (block->type != BLOCK_FOREIGN);
+  TRACE (TRACE_BLOCK_WRITE, sector, cnt);
+  while (cnt > 0)
+    {
+      size_t chunk = cnt < BLOCK_MAX_MULTIPLE ? cnt : BLOCK_MAX_MULTIPLE;
+      size_t i;
+
+      if (block->ops->write_multiple != NULL)
+        block->ops->write_multiple (block->aux, sector, chunk, buffer);
+      else
+        for (i = 0; i < chunk; i++)
+          block->ops->write (block->aux, sector + i,
+                             buffer + i * BLOCK_SECTOR_SIZE);
+      block->write_cnt += chunk;
+
+      sector += chunk;
+      buffer += chunk * BLOCK_SECTOR_SIZE;
+      cnt -= chunk;
+    }
+}
+
+/* Initializes request R to transfer CNT sectors starting at
+   SECTOR between a device and BUFFER, which must have room for
+   CNT * BLOCK_SECTOR_SIZE bytes.  The device is written if
+   IS_WRITE and read otherwise.  On completion, COMPLETE is
+   called with R if it is non-null, otherwise block_wait() on R
+   returns.  AUX is for the submitter's use. */
+void
+block_request_init (struct block_request *r, block_sector_t sector,
+                    size_t cnt, void *buffer, bool is_write,
+                    block_complete_func *complete, void *aux)
+{
+  ASSERT (r != NULL);
+  ASSERT (cnt > 0);
+
+  r->sector = sector;
+  r->cnt = cnt;
+  r->buffer = buffer;
+  r->is_write = is_write;
+  r->complete = complete;
+  r->aux = aux;
+  sema_init (&r->done, 0);
+}
+
+/* Queues request R, initialized with block_request_init(), to be
+   carried out on BLOCK by its I/O thread and returns without
+   waiting for it.  Requests to a partition are queued on the
+   disk that holds it, so each disk has a single queue.
+
+   The I/O thread serves the requests of the highest priority
+   first, each request carrying the effective priority of the
+   thread that submitted it, raised by one for every AGING_TICKS
+   it has waited.  Requests of the same priority are served in
+   C-LOOK order: in ascending order of sector from where the disk
+   head is, then back around from the lowest sector.  Adjacent
+   requests in the same direction are merged into a single
+   transfer.  Thus requests that overlap may be carried out in
+   either order, and it is up to submitters not to have such
+   requests queued at once. */
+void
+block_submit (struct block *block, struct block_request *r)
+{
+  check_sectors (block, r->sector, r->cnt);
+  ASSERT (!r->is_write || block->type != BLOCK_FOREIGN);
+  TRACE (r->is_write ? TRACE_BLOCK_WRITE : TRACE_BLOCK_READ,
+         r->sector, r->cnt);
+
+  r->block = block;
+  r->dev_sector = r->sector;
+  r->priority = thread_get_priority ();
+  r->submitted = timer_ticks ();
+  for (; block->parent != NULL; block = block->parent)
+    r->dev_sector += block->parent_start;
+
+  lock_acquire (&block->queue_lock);
+  if (!block->has_io_thread)
+    {
+      char name[sizeof block->name + 3];
+      snprintf (name, sizeof name, "%s-io", block->name);
+      block->has_io_thread = thread_create (name, PRI_DEFAULT,
+                                            block_io_thread,
+                                            block) != TID_ERROR;
+    }
+  if (!block->has_io_thread)
+    {
+      /* Without an I/O thread, do the work ourselves. */
+      lock_release (&block->queue_lock);
+      do_request (r);
+      return;
+    }
+  list_insert_ordered (&block->queue, &r->elem, request_less, NULL);
+  block->queue_len++;
+  block->request_cnt++;
+  block->depth_sum += block->queue_len;
+  if (block->queue_len > block->max_depth)
+    block->max_depth = block->queue_len;
+  cond_signal (&block->queue_nonempty, &block->queue_lock);
+  lock_release (&block->queue_lock);
+}
+
+/* Waits for request R, which must have been submitted without a
+   completion function, to finish. */
+void
+block_wait (struct block_request *r)
+{
+  ASSERT (r->complete == NULL);
+  sema_down (&r->done);
+}
+
+/* Carries out request R and then signals its completion. */
+static void
+do_request (struct block_request *r)
+{
+  if (r->is_write)
+    block_write_multiple (r->block, r->sector, r->cnt, r->buffer);
+  else
+    block_read_multiple (r->block, r->sector, r->cnt, r->buffer);
+
+  if (r->complete != NULL)
+    r->complete (r);
+  else
+    sema_up (&r->done);
+}
+
+/* Carries out the requests in BATCH, which are adjacent on their
+   device, in the same direction, and CNT sectors long in total,
+   as one transfer through BUFFER.  Then signals the completion of
+   each. */
+static void
+do_merged_requests (struct list *batch, size_t cnt, uint8_t *buffer)
+{
+  struct block_request *first = list_entry (list_front (batch),
+                                            struct block_request, elem);
+  struct list_elem *e;
+  uint8_t *p;
+
+  if (first->is_write)
+    {
+      for (e = list_begin (batch), p = buffer; e != list_end (batch);
+           e = list_next (e))
+        {
+          struct block_request *r = list_entry (e, struct block_request,
+                                                elem);
+          memcpy (p, r->buffer, r->cnt * BLOCK_SECTOR_SIZE);
+          p += r->cnt * BLOCK_SECTOR_SIZE;
+        }
+      block_write_multiple (first->block, first->sector, cnt, buffer);
+    }
+  else
+    block_read_multiple (first->block, first->sector, cnt, buffer);
+
+  p = buffer;
+  while (!list_empty (batch))
+    {
+      struct block_request *r = list_entry (list_pop_front (batch),
+                                            struct block_request, elem);
+      if (!r->is_write)
+        memcpy (r->buffer, p, r->cnt * BLOCK_SECTOR_SIZE);
+      p += r->cnt * BLOCK_SECTOR_SIZE;
+
+      if (r->complete != NULL)
+        r->complete (r);
+      else
+        sema_up (&r->done);
+    }
+}
+
+/* Thread function that carries out the requests submitted to
+   the block device BLOCK_, by priority and then in C-LOOK order. */
+static void
+block_io_thread (void *block_)
+{
+  struct block *block = block_;
+  uint8_t *merge_buffer = palloc_get_multiple (0, MERGE_PAGES);
+
+  for (;;)
+    {
+      struct block_request *r, *last;
+      struct list_elem *e, *start, *best;
+      struct list batch;
+      int best_priority;
+      int64_t now;
+      size_t cnt;
+
+      lock_acquire (&block->queue_lock);
+      while (list_empty (&block->queue))
+        cond_wait (&block->queue_nonempty, &block->queue_lock);
+
+      /* Start from the first request at or past the head, wrapping
+         around to the lowest sector if there is none. */
+      for (start = list_begin (&block->queue);
+           start != list_end (&block->queue); start = list_next (start))
+        if (list_entry (start, struct block_request, elem)->dev_sector
+            >= block->head)
+          break;
+      if (start == list_end (&block->queue))
+        start = list_begin (&block->queue);
+
+      /* Take the first request in C-LOOK order of the highest
+         priority. */
+      now = timer_ticks ();
+      best = e = start;
+      best_priority = request_priority (list_entry (e, struct block_request,
+                                                    elem), now);
+      for (;;)
+        {
+          e = list_next (e);
+          if (e == list_end (&block->queue))
+            e = list_begin (&block->queue);
+          if (e == start)
+            break;
+          int priority = request_priority (list_entry (e,
+                                                       struct block_request,
+                                                       elem), now);
+          if (priority > best_priority)
+            {
+              best = e;
+              best_priority = priority;
+            }
+        }
+      if (best != start)
+        block->jump_cnt++;
+      e = best;
+
+      /* Along with the requests that directly follow it. */
+      list_init (&batch);
+      r = last = list_entry (e, struct block_request, elem);
+      cnt = r->cnt;
+      e = list_remove (e);
+      list_push_back (&batch, &r->elem);
+      while (merge_buffer != NULL && e != list_end (&block->queue))
+        {
+          struct block_request *next = list_entry (e, struct block_request,
+                                                   elem);
+          if (next->dev_sector != last->dev_sector + last->cnt
+              || next->block != r->block
+              || next->is_write != r->is_write
+              || cnt + next->cnt > MERGE_SECTORS)
+            break;
+          cnt += next->cnt;
+          last = next;
+          e = list_remove (e);
+          list_push_back (&batch, &next->elem);
+        }
+      block->queue_len -= list_size (&batch);
+      block->merge_cnt += list_size (&batch) - 1;
+      block->head = last->dev_sector + last->cnt;
+      lock_release (&block->queue_lock);
+
+      if (last == r)
+        {
+          list_pop_front (&batch);
+          do_request (r);
+        }
+      else
+        do_merged_requests (&batch, cnt, merge_buffer);
+    }
+}
+
+/* Returns the priority of R for dispatch at timer tick NOW: that of
+   its submitter, aged by the time it has been queued. */
+static int
+request_priority (const struct block_request *r, int64_t now)
+{
+  return r->priority + (now - r->submitted) / AGING_TICKS;
+}
+
+/* Orders block requests by the sector they start at on the disk
+   they are queued for. */
+static bool
+request_less (const struct list_elem *a_, const struct list_elem *b_,
+              void *aux UNUSED)
+{
+  const struct block_request *a = list_entry (a_, struct block_request, elem);
+  const struct block_request *b = list_entry (b_, struct block_request, elem);
+  return a->dev_sector < b->dev_sector;
+}
+
 /* Returns the number of sectors in BLOCK. */
 block_sector_t
 block_size (struct block *block)
@@ -171,9 +634,20 @@ block_print_stats (void)
       struct block *block = block_by_role[i];
       if (block != NULL)
         {
+          struct block *disk = block;
+
           printf ("%s (%s): %llu reads, %llu writes\n",
                   block->name, block_type_name (block->type),
                   block->read_cnt, block->write_cnt);
+
+          while (disk->parent != NULL)
+            disk = disk->parent;
+          if (disk->request_cnt > 0)
+            printf ("%s queue: %llu requests, %llu merged, "
+                    "%llu by priority, depth %llu avg, %zu max\n",
+                    disk->name, disk->request_cnt, disk->merge_cnt,
+                    disk->jump_cnt, disk->depth_sum / disk->request_cnt,
+                    disk->max_depth);
         }
     }
 }
@@ -200,6 +674,18 @@ block_register (const char *name, enum block_type type,
   block->aux = aux;
   block->read_cnt = 0;
   block->write_cnt = 0;
+  block->parent = NULL;
+  block->parent_start = 0;
+  lock_init (&block->queue_lock);
+  list_init (&block->queue);
+  cond_init (&block->queue_nonempty);
+  block->has_io_thread = false;
+  block->head = 0;
+  block->queue_len = 0;
+  block->request_cnt = 0;
+  block->merge_cnt = 0;
+  block->depth_sum = 0;
+  block->max_depth = 0;
 
   printf ("%s: %'"PRDSNu" sectors (", block->name, block->size);
   print_human_readable_size ((uint64_t) block->size * BLOCK_SECTOR_SIZE);
@@ -211,6 +697,17 @@ block_register (const char *name, enum block_type type,
   return block;
 }
 
+/* Records that BLOCK is a part of PARENT that begins at sector
+   START within PARENT, so that requests submitted to BLOCK are
+   queued with PARENT's. */
+void
+block_set_parent (struct block *block, struct block *parent,
+                  block_sector_t start)
+{
+  block->parent = parent;
+  block->parent_start = start;
+}
+
 /* Returns the block device corresponding to LIST_ELEM, or a null
    pointer if LIST_ELEM is the list end of all_blocks. */
 static struct block *
@@ -3,6 +3,8 @@
 
 #include <stddef.h>
 #include <inttypes.h>
+#include <list.h>
+#include "threads/synch.h"
 
 /* Size of a block device sector in bytes.
    All IDE disks use this sector size, as do most USB and SCSI
@@ -17,6 +19,10 @@ typedef uint32_t block_sector_t;
 /* Format specifier for printf(), e.g.:
    printf ("sector=%"PRDSNu"\n", sector); */
 #define PRDSNu PRIu32
+
+/* Maximum number of sectors transferred by a single call to a
+   driver's read_multiple or write_multiple operation. */
+#define BLOCK_MAX_MULTIPLE 256
 
 /* Higher-level interface for file systems, etc. */
 
@@ -53,9 +59,47 @@ struct block *block_next (struct block *);
 block_sector_t block_size (struct block *);
 void block_read (struct block *, block_sector_t, void *);
 void block_write (struct block *, block_sector_t, const void *);
+void block_read_multiple (struct block *, block_sector_t, size_t cnt, void *);
+void block_write_multiple (struct block *, block_sector_t, size_t cnt,
+                           const void *);
 const char *block_name (struct block *);
 enum block_type block_type (struct block *);
 
+/* Asynchronous requests.
+
+   A request is queued with block_submit() and carried out later
+   by an I/O thread that belongs to the device, so that the
+   submitter can go on working meanwhile.  Once the transfer is
+   done, the I/O thread calls the request's COMPLETE function if
+   it has one and otherwise wakes up block_wait().  The request
+   and its buffer must stay valid until then. */
+struct block_request;
+typedef void block_complete_func (struct block_request *);
+
+struct block_request
+  {
+    struct list_elem elem;              /* Element in a device's queue. */
+    block_sector_t sector;              /* First sector. */
+    size_t cnt;                         /* Number of sectors. */
+    void *buffer;                       /* CNT * BLOCK_SECTOR_SIZE bytes. */
+    bool is_write;                      /* Write to or read from device? */
+    block_complete_func *complete;      /* Completion callback or null. */
+    void *aux;                          /* Owned by the submitter. */
+
+    /* Owned by the block layer. */
+    struct block *block;                /* Device submitted to. */
+    block_sector_t dev_sector;          /* SECTOR on the underlying disk. */
+    int priority;                       /* Submitter's priority then. */
+    int64_t submitted;                  /* Timer ticks at submission. */
+    struct semaphore done;              /* Up'd if COMPLETE is null. */
+  };
+
+void block_request_init (struct block_request *, block_sector_t, size_t cnt,
+                         void *buffer, bool is_write,
+                         block_complete_func *, void *aux);
+void block_submit (struct block *, struct block_request *);
+void block_wait (struct block_request *);
+
 /* Statistics. */
 void block_print_stats (void);
 
@@ -65,10 +109,21 @@ struct block_operations
   {
     void (*read) (void *aux, block_sector_t, void *buffer);
     void (*write) (void *aux, block_sector_t, const void *buffer);
+
+    /* Optional.  Transfer CNT contiguous sectors, where
+       0 < CNT <= BLOCK_MAX_MULTIPLE, as a single request.  If
+       null, block_read_multiple() and block_write_multiple()
+       fall back to one read or write per sector. */
+    void (*read_multiple) (void *aux, block_sector_t, size_t cnt,
+                           void *buffer);
+    void (*write_multiple) (void *aux, block_sector_t, size_t cnt,
+                            const void *buffer);
   };
 
 struct block *block_register (const char *name, enum block_type,
                               const char *extra_info, block_sector_t size,
                               const struct block_operations *, void *aux);
+void block_set_parent (struct block *, struct block *parent,
+                       block_sector_t start);
 
 #endif /* devices/block.h */
@@ -3,15 +3,45 @@
 #include <debug.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "devices/block.h"
 #include "devices/partition.h"
+#include "devices/pci.h"
 #include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
+#include "threads/kstack.h"
+#include "threads/palloc.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "threads/vmalloc.h"
 
 /* The code in this file is an interface to an ATA (IDE)
-   controller.  It attempts to comply to [ATA-3]. */
+   controller.  It attempts to comply to [ATA-3].
+
+   Transfers use PIO by default.  With the "-dma" kernel option,
+   disks that support it transfer data by PCI bus-master DMA
+   through a legacy-mode IDE controller [BMIDE], so that the CPU
+   does not have to copy every word through the data port.
+
+   A thread waiting for its disk normally sleeps until the disk
+   interrupts.  With the "-ide-poll" kernel option, on transfers of
+   up to POLL_SECTORS sectors it first spins for a while waiting for
+   the interrupt, since a disk often answers a short request sooner
+   than it takes to switch threads away and back. */
+
+/* Set by the "-dma" kernel command-line option.  Without a
+   bus-master IDE controller, transfers fall back to PIO. */
+bool ide_use_dma;
+
+/* Longest transfer, in sectors, on which to poll. */
+#define POLL_SECTORS 8
+
+/* Microseconds to poll for each disk, hda through hdd, set by the
+   "-ide-poll" kernel command-line option. */
+static unsigned poll_usecs[4];
 
 /* ATA command block port addresses. */
 #define reg_data(CHANNEL) ((CHANNEL)->reg_base + 0)     /* Data. */
@@ -34,6 +64,7 @@
 #define STA_BSY 0x80            /* Busy. */
 #define STA_DRDY 0x40           /* Device Ready. */
 #define STA_DRQ 0x08            /* Data Request. */
+#define STA_ERR 0x01            /* Error. */
 
 /* Control Register bits. */
 #define CTL_SRST 0x04           /* Software Reset. */
@@ -49,6 +80,32 @@
 #define CMD_IDENTIFY_DEVICE 0xec        /* IDENTIFY DEVICE. */
 #define CMD_READ_SECTOR_RETRY 0x20      /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30     /* WRITE SECTOR with retries. */
+#define CMD_READ_DMA_RETRY 0xc8         /* READ DMA with retries. */
+#define CMD_WRITE_DMA_RETRY 0xca        /* WRITE DMA with retries. */
+
+/* Bus master IDE port addresses. */
+#define reg_bm_command(CHANNEL) ((CHANNEL)->bm_base + 0) /* Command. */
+#define reg_bm_status(CHANNEL) ((CHANNEL)->bm_base + 2)  /* Status. */
+#define reg_bm_prdt(CHANNEL) ((CHANNEL)->bm_base + 4)    /* PRD table. */
+
+/* Bus master Command Register bits. */
+#define BM_CMD_START 0x01       /* Start transfer. */
+#define BM_CMD_READ 0x08        /* Transfer from disk to memory. */
+
+/* Bus master Status Register bits. */
+#define BM_STA_ERROR 0x02       /* Error, write 1 to clear. */
+#define BM_STA_INTR 0x04        /* Interrupt, write 1 to clear. */
+
+/* A physical region descriptor, one entry in a bus master PRD
+   table.  A region may not cross a 64 kB boundary. */
+struct prd
+  {
+    uint32_t addr;              /* Physical address of region. */
+    uint16_t size;              /* Size in bytes, 0 means 64 kB. */
+    uint16_t flags;             /* PRD_EOT on the last entry. */
+  };
+#define PRD_EOT 0x8000          /* End of table. */
+#define PRD_CNT (PGSIZE / sizeof (struct prd))
 
 /* An ATA device. */
 struct ata_disk
@@ -57,6 +114,8 @@ struct ata_disk
     struct channel *channel;    /* Channel that disk is attached to. */
     int dev_no;                 /* Device 0 or 1 for master or slave. */
     bool is_ata;                /* Is device an ATA disk? */
+    bool dma;                   /* Does the disk support DMA? */
+    unsigned poll_usecs;        /* Microseconds to poll, 0 to sleep. */
   };
 
 /* An ATA channel (aka controller).
@@ -72,6 +131,9 @@ struct channel
                                    any interrupt would be spurious. */
     struct semaphore completion_wait;   /* Up'd by interrupt handler. */
 
+    uint16_t bm_base;           /* Bus master base port, 0 if no DMA. */
+    struct prd *prdt;           /* PRD table, one page. */
+
     struct ata_disk devices[2];     /* The devices on this channel. */
   };
 
@@ -81,27 +143,45 @@ static struct channel channels[CHANNEL_CNT];
 
 static struct block_operations ide_operations;
 
+static uint16_t find_bus_master (void);
+static void probe_channel (void *);
 static void reset_channel (struct channel *);
 static bool check_device_type (struct ata_disk *);
 static void identify_ata_device (struct ata_disk *);
 
-static void select_sector (struct ata_disk *, block_sector_t);
+static void select_sectors (struct ata_disk *, block_sector_t, size_t cnt);
 static void issue_pio_command (struct channel *, uint8_t command);
 static void input_sector (struct channel *, void *);
 static void output_sector (struct channel *, const void *);
+static bool can_dma (const struct ata_disk *, const void *buffer);
+static bool dma_transfer (struct ata_disk *, block_sector_t, size_t cnt,
+                          const void *buffer, bool is_read);
 
 static void wait_until_idle (const struct ata_disk *);
 static bool wait_while_busy (const struct ata_disk *);
 static void select_device (const struct ata_disk *);
 static void select_device_wait (const struct ata_disk *);
+static void wait_completion (struct ata_disk *, size_t cnt);
 
 static void interrupt_handler (struct intr_frame *);
 
-/* Initialize the disk subsystem and detect disks. */
+/* Ups once for each channel probed in a thread of its own. */
+static struct semaphore probe_done;
+
+/* Initialize the disk subsystem and detect disks.  Resetting a
+   channel mostly waits on its devices, so the channels are reset at
+   the same time, each but the first in a thread of its own.  Disks
+   are then identified and registered one at a time, in order, so
+   that they keep their names and order whichever finishes its reset
+   first. */
 void
 ide_init (void) 
 {
-  size_t chan_no;
+  uint16_t bm_base = ide_use_dma ? find_bus_master () : 0;
+  size_t chan_no, thread_cnt;
+
+  if (ide_use_dma && bm_base == 0)
+    printf ("ide: no bus master IDE controller, using PIO\n");
 
   for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++)
     {
@@ -126,6 +206,14 @@ ide_init (void)
       lock_init (&c->lock);
       c->expecting_interrupt = false;
       sema_init (&c->completion_wait, 0);
+      c->bm_base = 0;
+      c->prdt = NULL;
+      if (bm_base != 0)
+        {
+          c->prdt = palloc_get_page (0);
+          if (c->prdt != NULL)
+            c->bm_base = bm_base + 8 * chan_no;
+        }
  
       /* Initialize devices. */
       for (dev_no = 0; dev_no < 2; dev_no++)
@@ -136,24 +224,58 @@ ide_init (void)
           d->channel = c;
           d->dev_no = dev_no;
           d->is_ata = false;
+          d->dma = false;
+          d->poll_usecs = poll_usecs[chan_no * 2 + dev_no];
         }
 
       /* Register interrupt handler. */
       intr_register_ext (c->irq, interrupt_handler, c->name);
+    }
 
-      /* Reset hardware. */
-      reset_channel (c);
+  /* Reset hardware. */
+  sema_init (&probe_done, 0);
+  thread_cnt = 0;
+  for (chan_no = 1; chan_no < CHANNEL_CNT; chan_no++)
+    {
+      if (thread_create ("ide-probe", PRI_DEFAULT, probe_channel,
+                         &channels[chan_no]) != TID_ERROR)
+        thread_cnt++;
+      else
+        {
+          probe_channel (&channels[chan_no]);
+          sema_down (&probe_done);
+        }
+    }
+  probe_channel (&channels[0]);
+  while (thread_cnt-- > 0)
+    sema_down (&probe_done);
 
-      /* Distinguish ATA hard disks from other devices. */
-      if (check_device_type (&c->devices[0]))
-        check_device_type (&c->devices[1]);
+  /* Read hard disk identity information. */
+  for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++)
+    {
+      struct channel *c = &channels[chan_no];
+      int dev_no;
 
-      /* Read hard disk identity information. */
       for (dev_no = 0; dev_no < 2; dev_no++)
         if (c->devices[dev_no].is_ata)
           identify_ata_device (&c->devices[dev_no]);
     }
 }
+
+/* Resets channel C_ and distinguishes ATA hard disks on it from
+   other devices.  Ups probe_done when done, unless C_ is channel
+   0, which ide_init() probes itself. */
+static void
+probe_channel (void *c_) 
+{
+  struct channel *c = c_;
+
+  reset_channel (c);
+  if (check_device_type (&c->devices[0]))
+    check_device_type (&c->devices[1]);
+  if (c != &channels[0])
+    sema_up (&probe_done);
+}
 
 /* Disk detection and identification. */
 
@@ -284,10 +406,12 @@ identify_ata_device (struct ata_disk *d)
   /* Calculate capacity.
      Read model name and serial number. */
   capacity = *(uint32_t *) &id[60 * 2];
+  d->dma = c->bm_base != 0 && (*(uint16_t *) &id[49 * 2] & 0x100) != 0;
   model = descramble_ata_string (&id[10 * 2], 20);
   serial = descramble_ata_string (&id[27 * 2], 40);
   snprintf (extra_info, sizeof extra_info,
-            "model \"%s\", serial \"%s\"", model, serial);
+            "model \"%s\", serial \"%s\"%s", model, serial,
+            d->dma ? ", DMA" : "");
 
   /* Disable access to IDE disks over 1 GB, which are likely
      physical IDE disks rather than virtual ones.  If we don't
@@ -337,63 +461,121 @@ descramble_ata_string (char *string, int size)
   return string;
 }
 
-/* Reads sector SEC_NO from disk D into BUFFER, which must have
-   room for BLOCK_SECTOR_SIZE bytes.
+/* Reads CNT sectors starting at SEC_NO from disk D into BUFFER,
+   which must have room for CNT * BLOCK_SECTOR_SIZE bytes.  The
+   whole run is a single READ SECTOR(S) command; the disk raises
+   one interrupt per sector as each one becomes ready.
    Internally synchronizes accesses to disks, so external
    per-disk locking is unneeded. */
 static void
-ide_read (void *d_, block_sector_t sec_no, void *buffer)
+ide_read_multiple (void *d_, block_sector_t sec_no, size_t cnt, void *buffer_)
 {
   struct ata_disk *d = d_;
   struct channel *c = d->channel;
+  uint8_t *buffer = buffer_;
+  size_t i;
+
   lock_acquire (&c->lock);
-  select_sector (d, sec_no);
+  if (can_dma (d, buffer))
+    {
+      if (!dma_transfer (d, sec_no, cnt, buffer, true))
+        PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
+      lock_release (&c->lock);
+      return;
+    }
+  select_sectors (d, sec_no, cnt);
   issue_pio_command (c, CMD_READ_SECTOR_RETRY);
-  sema_down (&c->completion_wait);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
-  input_sector (c, buffer);
+  for (i = 0; i < cnt; i++)
+    {
+      wait_completion (d, cnt);
+      if (!wait_while_busy (d))
+        PANIC ("%s: disk read failed, sector=%"PRDSNu,
+               d->name, sec_no + (block_sector_t) i);
+      input_sector (c, buffer + i * BLOCK_SECTOR_SIZE);
+    }
   lock_release (&c->lock);
 }
 
-/* Write sector SEC_NO to disk D from BUFFER, which must contain
-   BLOCK_SECTOR_SIZE bytes.  Returns after the disk has
-   acknowledged receiving the data.
+/* Writes CNT sectors starting at SEC_NO to disk D from BUFFER,
+   which must contain CNT * BLOCK_SECTOR_SIZE bytes, as a single
+   WRITE SECTOR(S) command.  Returns after the disk has
+   acknowledged receiving all of the data.
    Internally synchronizes accesses to disks, so external
    per-disk locking is unneeded. */
 static void
-ide_write (void *d_, block_sector_t sec_no, const void *buffer)
+ide_write_multiple (void *d_, block_sector_t sec_no, size_t cnt,
+                    const void *buffer_)
 {
   struct ata_disk *d = d_;
   struct channel *c = d->channel;
+  const uint8_t *buffer = buffer_;
+  size_t i;
+
   lock_acquire (&c->lock);
-  select_sector (d, sec_no);
+  if (can_dma (d, buffer))
+    {
+      if (!dma_transfer (d, sec_no, cnt, buffer, false))
+        PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
+      lock_release (&c->lock);
+      return;
+    }
+  select_sectors (d, sec_no, cnt);
   issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
-  output_sector (c, buffer);
-  sema_down (&c->completion_wait);
+  for (i = 0; i < cnt; i++)
+    {
+      if (!wait_while_busy (d))
+        PANIC ("%s: disk write failed, sector=%"PRDSNu,
+               d->name, sec_no + (block_sector_t) i);
+      output_sector (c, buffer + i * BLOCK_SECTOR_SIZE);
+      wait_completion (d, cnt);
+    }
   lock_release (&c->lock);
 }
 
+/* Reads sector SEC_NO from disk D into BUFFER, which must have
+   room for BLOCK_SECTOR_SIZE bytes.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+static void
+ide_read (void *d_, block_sector_t sec_no, void *buffer)
+{
+  ide_read_multiple (d_, sec_no, 1, buffer);
+}
+
+/* Write sector SEC_NO to disk D from BUFFER, which must contain
+   BLOCK_SECTOR_SIZE bytes.  Returns after the disk has
+   acknowledged receiving the data.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+static void
+ide_write (void *d_, block_sector_t sec_no, const void *buffer)
+{
+  ide_write_multiple (d_, sec_no, 1, buffer);
+}
+
 static struct block_operations ide_operations =
   {
     ide_read,
-    ide_write
+    ide_write,
+    ide_read_multiple,
+    ide_write_multiple
   };
-
+
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
+   writes SEC_NO and CNT to the disk's sector selection and
+   sector count registers.  (We use LBA mode.)  A count of
+   BLOCK_MAX_MULTIPLE is encoded as 0, per the ATA standard. */
 static void
-select_sector (struct ata_disk *d, block_sector_t sec_no)
+select_sectors (struct ata_disk *d, block_sector_t sec_no, size_t cnt)
 {
   struct channel *c = d->channel;
 
   ASSERT (sec_no < (1UL << 28));
+  ASSERT (cnt > 0 && cnt <= BLOCK_MAX_MULTIPLE);
+  ASSERT (cnt <= (1UL << 28) - sec_no);
   
   select_device_wait (d);
-  outb (reg_nsect (c), 1);
+  outb (reg_nsect (c), cnt & 0xff);
   outb (reg_lbal (c), sec_no);
   outb (reg_lbam (c), sec_no >> 8);
   outb (reg_lbah (c), (sec_no >> 16));
@@ -430,6 +612,108 @@ output_sector (struct channel *c, const void *sector)
   outsw (reg_data (c), sector, BLOCK_SECTOR_SIZE / 2);
 }
 
+/* Bus master DMA. */
+
+/* Looks on PCI bus 0 for a bus-master capable IDE controller
+   whose two channels sit at the legacy ports we drive, enables
+   bus mastering on it, and returns its bus master base port.
+   Returns 0 if there is no such controller. */
+static uint16_t
+find_bus_master (void)
+{
+  int dev, func;
+
+  for (dev = 0; dev < 32; dev++)
+    for (func = 0; func < 8; func++)
+      {
+        uint32_t class, bar4, command;
+        uint8_t prog_if;
+
+        if ((pci_read_config (0, dev, func, 0x00) & 0xffff) == 0xffff)
+          continue;
+        class = pci_read_config (0, dev, func, 0x08);
+        prog_if = class >> 8;
+        if ((class >> 16) != 0x0101           /* Mass storage, IDE. */
+            || (prog_if & 0x80) == 0          /* Bus master capable. */
+            || (prog_if & 0x05) != 0)         /* Both channels legacy. */
+          continue;
+        bar4 = pci_read_config (0, dev, func, 0x20);
+        if ((bar4 & 1) == 0 || (bar4 & 0xfffc) == 0)
+          continue;
+
+        /* Enable I/O space and bus mastering.  The upper half of
+           the register is write-1-to-clear status, leave it be. */
+        command = pci_read_config (0, dev, func, 0x04);
+        pci_write_config (0, dev, func, 0x04, (command & 0xffff) | 0x05);
+        return bar4 & 0xfffc;
+      }
+  return 0;
+}
+
+/* Returns true if a transfer between disk D and BUFFER can go
+   by DMA.  The controller needs word aligned physical addresses,
+   which only kernel virtual addresses have a direct mapping to,
+   except for those of kernel stacks and of vmalloc() blocks. */
+static bool
+can_dma (const struct ata_disk *d, const void *buffer)
+{
+  return (d->dma && is_kernel_vaddr (buffer) && !kstack_contains (buffer)
+          && !vmalloc_contains (buffer) && ((uintptr_t) buffer & 1) == 0);
+}
+
+/* Transfers CNT sectors starting at SEC_NO between disk D and
+   BUFFER by bus-master DMA, into BUFFER if IS_READ and out of it
+   otherwise.  Returns true if successful, false if the disk or
+   the controller report an error.  The caller must hold D's
+   channel lock. */
+static bool
+dma_transfer (struct ata_disk *d, block_sector_t sec_no, size_t cnt,
+              const void *buffer, bool is_read)
+{
+  struct channel *c = d->channel;
+  uintptr_t paddr = vtop (buffer);
+  size_t left = cnt * BLOCK_SECTOR_SIZE;
+  uint8_t command = is_read ? BM_CMD_READ : 0;
+  uint8_t bm_status;
+  size_t prd_cnt = 0;
+
+  ASSERT (lock_held_by_current_thread (&c->lock));
+
+  /* Describe BUFFER to the controller, splitting it at 64 kB
+     boundaries. */
+  while (left > 0)
+    {
+      size_t boundary_left = 0x10000 - (paddr & 0xffff);
+      size_t size = left < boundary_left ? left : boundary_left;
+
+      ASSERT (prd_cnt < PRD_CNT);
+      c->prdt[prd_cnt].addr = paddr;
+      c->prdt[prd_cnt].size = size & 0xffff;
+      c->prdt[prd_cnt].flags = 0;
+      prd_cnt++;
+
+      paddr += size;
+      left -= size;
+    }
+  c->prdt[prd_cnt - 1].flags = PRD_EOT;
+
+  outl (reg_bm_prdt (c), vtop (c->prdt));
+  outb (reg_bm_command (c), command);
+  outb (reg_bm_status (c), inb (reg_bm_status (c))
+                           | BM_STA_ERROR | BM_STA_INTR);
+
+  select_sectors (d, sec_no, cnt);
+  issue_pio_command (c, is_read ? CMD_READ_DMA_RETRY : CMD_WRITE_DMA_RETRY);
+  outb (reg_bm_command (c), command | BM_CMD_START);
+  wait_completion (d, cnt);
+  outb (reg_bm_command (c), command);
+
+  bm_status = inb (reg_bm_status (c));
+  outb (reg_bm_status (c), bm_status | BM_STA_ERROR | BM_STA_INTR);
+  return ((bm_status & BM_STA_ERROR) == 0
+          && (inb (reg_alt_status (c)) & STA_ERR) == 0);
+}
+
 /* Low-level ATA primitives. */
 
 /* Wait up to 10 seconds for the controller to become idle, that
@@ -502,6 +786,52 @@ select_device_wait (const struct ata_disk *d)
   wait_until_idle (d);
 }
 
+/* Waits for the next interrupt from disk D, which is carrying out
+   a transfer of CNT sectors.  If the transfer is short, first spins
+   for D's polling time, taking the interrupt that way if it comes
+   by then, so that the thread does not sleep only to be woken up
+   right away. */
+static void
+wait_completion (struct ata_disk *d, size_t cnt)
+{
+  struct channel *c = d->channel;
+
+  if (d->poll_usecs > 0 && cnt <= POLL_SECTORS)
+    {
+      int64_t deadline = timer_ns () + (int64_t) d->poll_usecs * 1000;
+      do
+        if (sema_try_down (&c->completion_wait))
+          return;
+      while (timer_ns () < deadline);
+    }
+  sema_down (&c->completion_wait);
+}
+
+/* Sets the polling time for IDE disks from SPEC, which is either a
+   number of microseconds for every disk or DISK:USECS for one disk,
+   such as "hdb:20".  Returns false if SPEC is malformed. */
+bool
+ide_set_poll (const char *spec)
+{
+  const char *colon = strchr (spec, ':');
+  int usecs = atoi (colon != NULL ? colon + 1 : spec);
+  size_t i;
+
+  if (usecs < 0)
+    return false;
+  if (colon == NULL)
+    {
+      for (i = 0; i < sizeof poll_usecs / sizeof *poll_usecs; i++)
+        poll_usecs[i] = usecs;
+      return true;
+    }
+  if (colon - spec != 3 || spec[0] != 'h' || spec[1] != 'd'
+      || spec[2] < 'a' || spec[2] > 'd')
+    return false;
+  poll_usecs[spec[2] - 'a'] = usecs;
+  return true;
+}
+
 /* ATA interrupt handler. */
 static void
 interrupt_handler (struct intr_frame *f) 
@@ -2,15 +2,20 @@
 #include <debug.h>
 #include "devices/intq.h"
 #include "devices/serial.h"
+#include "threads/poll.h"
 
 /* Stores keys from the keyboard and serial port. */
 static struct intq buffer;
 
+/* Threads polling for a key. */
+static struct poll_queue pollers;
+
 /* Initializes the input buffer. */
 void
 input_init (void) 
 {
   intq_init (&buffer);
+  poll_queue_init (&pollers);
 }
 
 /* Adds a key to the input buffer.
@@ -23,6 +28,7 @@ input_putc (uint8_t key)
 
   intq_putc (&buffer, key);
   serial_notify ();
+  poll_wake (&pollers);
 }
 
 /* Retrieves a key from the input buffer.
@@ -50,3 +56,20 @@ input_full (void)
   ASSERT (intr_get_level () == INTR_OFF);
   return intq_full (&buffer);
 }
+
+/* Returns true if a key is waiting in the input buffer, first adding
+   ENTRY for TABLE to the threads polling for a key if TABLE is not
+   null. */
+bool
+input_poll (struct poll_table *table, struct poll_entry *entry)
+{
+  enum intr_level old_level;
+  bool ready;
+
+  old_level = intr_disable ();
+  if (table != NULL)
+    poll_add (table, entry, &pollers);
+  ready = !intq_empty (&buffer);
+  intr_set_level (old_level);
+  return ready;
+}
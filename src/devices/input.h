@@ -4,9 +4,13 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+struct poll_table;
+struct poll_entry;
+
 void input_init (void);
 void input_putc (uint8_t);
 uint8_t input_getc (void);
 bool input_full (void);
+bool input_poll (struct poll_table *, struct poll_entry *);
 
 #endif /* devices/input.h */
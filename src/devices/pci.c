@@ -0,0 +1,22 @@
+#include "devices/pci.h"
+#include "threads/io.h"
+
+/* Reads register REG of PCI function FUNC of device DEV on
+   BUS, through configuration mechanism #1. */
+uint32_t
+pci_read_config (int bus, int dev, int func, int reg)
+{
+  outl (0xcf8, 0x80000000 | (bus << 16) | (dev << 11) | (func << 8)
+               | (reg & 0xfc));
+  return inl (0xcfc);
+}
+
+/* Writes DATA to register REG of PCI function FUNC of device DEV
+   on BUS. */
+void
+pci_write_config (int bus, int dev, int func, int reg, uint32_t data)
+{
+  outl (0xcf8, 0x80000000 | (bus << 16) | (dev << 11) | (func << 8)
+               | (reg & 0xfc));
+  outl (0xcfc, data);
+}
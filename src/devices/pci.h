@@ -0,0 +1,12 @@
+#ifndef DEVICES_PCI_H
+#define DEVICES_PCI_H
+
+#include <stdint.h>
+
+/* PCI configuration space access, for the drivers of PCI
+   devices. */
+
+uint32_t pci_read_config (int bus, int dev, int func, int reg);
+void pci_write_config (int bus, int dev, int func, int reg, uint32_t data);
+
+#endif /* devices/pci.h */
@@ -11,9 +11,6 @@
 #define PIT_PORT_CONTROL          0x43                /* Control port. */
 #define PIT_PORT_COUNTER(CHANNEL) (0x40 + (CHANNEL))  /* Counter port. */
 
-/* PIT cycles per second. */
-#define PIT_HZ 1193180
-
 /* Configure the given CHANNEL in the PIT.  In a PC, the PIT's
    three output channels are hooked up like this:
 
@@ -45,8 +42,7 @@
 void
 pit_configure_channel (int channel, int mode, int frequency)
 {
-  uint16_t count;
-  enum intr_level old_level;
+  unsigned count;
 
   ASSERT (channel == 0 || channel == 2);
   ASSERT (mode == 2 || mode == 3);
@@ -57,10 +53,9 @@ pit_configure_channel (int channel, int mode, int frequency)
   if (frequency < 19)
     {
       /* Frequency is too low: the quotient would overflow the
-         16-bit counter.  Force it to 0, which the PIT treats as
-         65536, the highest possible count.  This yields a 18.2
-         Hz timer, approximately. */
-      count = 0;
+         16-bit counter.  Force it to 65536, the highest possible
+         count.  This yields a 18.2 Hz timer, approximately. */
+      count = 65536;
     }
   else if (frequency > PIT_HZ)
     {
@@ -74,10 +69,44 @@ pit_configure_channel (int channel, int mode, int frequency)
   else
     count = (PIT_HZ + frequency / 2) / frequency;
 
-  /* Configure the PIT mode and load its counters. */
+  pit_load_channel (channel, mode, count);
+}
+
+/* Configures CHANNEL in the PIT like pit_configure_channel(), but
+   with a period of COUNT PIT cycles, from 2 to 65536, instead of a
+   frequency.  The channel starts its first period over. */
+void
+pit_load_channel (int channel, int mode, unsigned count)
+{
+  enum intr_level old_level;
+
+  ASSERT (channel == 0 || channel == 2);
+  ASSERT (mode == 2 || mode == 3);
+  ASSERT (count >= 2 && count <= 65536);
+
+  /* Configure the PIT mode and load its counters.  A count of 65536
+     is written as 0. */
   old_level = intr_disable ();
   outb (PIT_PORT_CONTROL, (channel << 6) | 0x30 | (mode << 1));
   outb (PIT_PORT_COUNTER (channel), count);
   outb (PIT_PORT_COUNTER (channel), count >> 8);
   intr_set_level (old_level);
 }
+
+/* Returns the PIT cycles left in the current period of CHANNEL. */
+unsigned
+pit_read_channel (int channel)
+{
+  enum intr_level old_level;
+  unsigned count;
+
+  ASSERT (channel == 0 || channel == 2);
+
+  /* Latch the counter, then read it low byte first. */
+  old_level = intr_disable ();
+  outb (PIT_PORT_CONTROL, channel << 6);
+  count = inb (PIT_PORT_COUNTER (channel));
+  count |= inb (PIT_PORT_COUNTER (channel)) << 8;
+  intr_set_level (old_level);
+  return count != 0 ? count : 65536;
+}
@@ -3,6 +3,11 @@
 
 #include <stdint.h>
 
+/* PIT cycles per second. */
+#define PIT_HZ 1193180
+
 void pit_configure_channel (int channel, int mode, int frequency);
+void pit_load_channel (int channel, int mode, unsigned count);
+unsigned pit_read_channel (int channel);
 
 #endif /* devices/pit.h */
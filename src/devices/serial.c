@@ -33,6 +33,13 @@
 #define MCR_REG (IO_BASE + 4)   /* MODEM Control Register. */
 #define LSR_REG (IO_BASE + 5)   /* Line Status Register (read-only). */
 
+/* FIFO Control Register bits. */
+#define FCR_ENABLE 0x01         /* Enable the FIFOs. */
+#define FCR_CLEAR 0x06          /* Empty both FIFOs. */
+
+/* Interrupt Identification Register bits. */
+#define IIR_FIFO 0xc0           /* Both set if the FIFOs are enabled. */
+
 /* Interrupt Enable Register bits. */
 #define IER_RECV 0x01           /* Interrupt when data received. */
 #define IER_XMIT 0x02           /* Interrupt when transmit finishes. */
@@ -54,6 +61,10 @@ static enum { UNINIT, POLL, QUEUE } mode;
 /* Data to be transmitted. */
 static struct intq txq;
 
+/* Bytes the transmitter takes at once when empty: 16 for the FIFO
+   of a 16550A, 1 for older UARTs that have none. */
+static int xmit_fifo_size;
+
 static void set_serial (int bps);
 static void putc_poll (uint8_t);
 static void write_ier (void);
@@ -68,7 +79,8 @@ init_poll (void)
 {
   ASSERT (mode == UNINIT);
   outb (IER_REG, 0);                    /* Turn off all interrupts. */
-  outb (FCR_REG, 0);                    /* Disable FIFO. */
+  outb (FCR_REG, FCR_ENABLE | FCR_CLEAR); /* Enable FIFOs, if any. */
+  xmit_fifo_size = (inb (IIR_REG) & IIR_FIFO) == IIR_FIFO ? 16 : 1;
   set_serial (9600);                    /* 9.6 kbps, N-8-1. */
   outb (MCR_REG, MCR_OUT2);             /* Required to enable interrupts. */
   intq_init (&txq);
@@ -97,32 +109,53 @@ serial_init_queue (void)
 /* Sends BYTE to the serial port. */
 void
 serial_putc (uint8_t byte) 
+{
+  serial_putbuf (&byte, 1);
+}
+
+/* Sends the N bytes in BUFFER to the serial port, turning interrupts
+   off and updating the interrupt enable register only once for all of
+   them. */
+void
+serial_putbuf (const uint8_t *buffer, size_t n)
 {
   enum intr_level old_level = intr_disable ();
 
   if (mode != QUEUE)
     {
       /* If we're not set up for interrupt-driven I/O yet,
-         use dumb polling to transmit a byte. */
+         use dumb polling to transmit the bytes. */
       if (mode == UNINIT)
         init_poll ();
-      putc_poll (byte); 
+      while (n-- > 0)
+        putc_poll (*buffer++);
     }
   else 
     {
-      /* Otherwise, queue a byte and update the interrupt enable
+      /* Otherwise, queue the bytes and update the interrupt enable
          register. */
-      if (old_level == INTR_OFF && intq_full (&txq)) 
+      while (n-- > 0)
         {
-          /* Interrupts are off and the transmit queue is full.
-             If we wanted to wait for the queue to empty,
-             we'd have to reenable interrupts.
-             That's impolite, so we'll send a character via
-             polling instead. */
-          putc_poll (intq_getc (&txq)); 
+          if (intq_full (&txq))
+            {
+              if (old_level == INTR_OFF)
+                {
+                  /* Interrupts are off and the transmit queue is
+                     full.  If we wanted to wait for the queue to
+                     empty, we'd have to reenable interrupts.
+                     That's impolite, so we'll send a character via
+                     polling instead. */
+                  putc_poll (intq_getc (&txq));
+                }
+              else
+                {
+                  /* We're about to wait for the queue to drain, so
+                     make sure the transmit interrupt is on. */
+                  write_ier ();
+                }
+            }
+          intq_putc (&txq, *buffer++);
         }
-
-      intq_putc (&txq, byte); 
       write_ier ();
     }
   
@@ -218,10 +251,15 @@ serial_interrupt (struct intr_frame *f UNUSED)
   while (!input_full () && (inb (LSR_REG) & LSR_DR) != 0)
     input_putc (inb (RBR_REG));
 
-  /* As long as we have a byte to transmit, and the hardware is
-     ready to accept a byte for transmission, transmit a byte. */
+  /* As long as we have bytes to transmit, and the hardware is
+     ready to accept bytes for transmission, fill its FIFO. */
   while (!intq_empty (&txq) && (inb (LSR_REG) & LSR_THRE) != 0) 
-    outb (THR_REG, intq_getc (&txq));
+    {
+      int i;
+
+      for (i = 0; i < xmit_fifo_size && !intq_empty (&txq); i++)
+        outb (THR_REG, intq_getc (&txq));
+    }
 
   /* Update interrupt enable register based on queue status. */
   write_ier ();
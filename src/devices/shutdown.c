@@ -5,14 +5,28 @@
 #include "devices/serial.h"
 #include "devices/timer.h"
 #include "threads/io.h"
+#include "threads/kstat.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/profile.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
 #ifdef USERPROG
 #include "userprog/exception.h"
+#include "userprog/syscall.h"
+#ifdef FILESYS
+#include "userprog/prefetch.h"
+#endif
 #endif
 #ifdef FILESYS
 #include "devices/block.h"
 #include "filesys/filesys.h"
 #endif
+#ifdef VM
+#include "vm/swap.h"
+#endif
 
 /* Keyboard control register port. */
 #define CONTROL_REG 0x64
@@ -91,6 +105,9 @@ shutdown_power_off (void)
   const char *p;
 
 #ifdef FILESYS
+#ifdef USERPROG
+  prefetch_done ();
+#endif
   filesys_done ();
 #endif
 
@@ -130,12 +147,23 @@ print_stats (void)
 {
   timer_print_stats ();
   thread_print_stats ();
+  lock_print_stats ();
+  trace_dump ();
+  profile_dump ();
+  slab_print_stats ();
+  malloc_print_stats ();
+  palloc_print_stats ();
 #ifdef FILESYS
   block_print_stats ();
 #endif
+  kstat_print_stats ();
   console_print_stats ();
   kbd_print_stats ();
 #ifdef USERPROG
   exception_print_stats ();
+  syscall_print_stats ();
+#endif
+#ifdef VM
+  swap_print_stats ();
 #endif
 }
@@ -4,7 +4,10 @@
 #include <round.h>
 #include <stdio.h>
 #include "devices/pit.h"
+#include "threads/init.h"
 #include "threads/interrupt.h"
+#include "threads/kstat.h"
+#include "threads/profile.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
   
@@ -24,22 +27,84 @@ static int64_t ticks;
    Initialized by timer_calibrate(). */
 static unsigned loops_per_tick;
 
+/* Time stamp counter cycles per second, or 0 if the CPU has no time
+   stamp counter or it is not calibrated yet, and the count it had at
+   tick 0.  Initialized by timer_calibrate(). */
+#define NS_PER_SEC 1000000000
+#define TSC_CALIBRATE_TICKS (TIMER_FREQ / 10)
+static uint64_t tsc_hz;
+static int64_t tsc_base;
+
+/* Pending kernel timers, in a hierarchical timing wheel, so arming
+   and cancelling take constant time however many are pending.  The
+   root wheel has a slot for each of the next WHEEL_ROOT_SIZE ticks.
+   Each slot of the wheel at level L above it holds the timers of
+   WHEEL_ROOT_SIZE * WHEEL_SIZE^L ticks further out, and is spread
+   over the wheel below as the root wheel comes round to them.
+   Timers further out than the top wheel reaches go in its farthest
+   slot, and are spread from there again. */
+#define WHEEL_ROOT_BITS 8
+#define WHEEL_BITS 6
+#define WHEEL_LEVELS 4
+#define WHEEL_ROOT_SIZE (1 << WHEEL_ROOT_BITS)
+#define WHEEL_SIZE (1 << WHEEL_BITS)
+#define WHEEL_SPAN(LEVEL) ((int64_t) 1 << (WHEEL_ROOT_BITS \
+                                           + (LEVEL) * WHEEL_BITS))
+static struct list wheel_root[WHEEL_ROOT_SIZE];
+static struct list wheel[WHEEL_LEVELS][WHEEL_SIZE];
+static int64_t wheel_ticks;     /* Next tick to run the timers of. */
+static struct spinlock wheel_lock;  /* Guards the wheels. */
+
+/* Tickless idle.  While only the idle thread can run, the PIT is set
+   to interrupt just once for the next few ticks, up to the next one
+   that has timers to run, starts a second, or starts over the root
+   wheel.  SKIP_CNT is the number of ticks the next timer interrupt
+   stands for, or 0 if the PIT is ticking normally. */
+#define PIT_TICK_COUNT ((PIT_HZ + TIMER_FREQ / 2) / TIMER_FREQ)
+#define IDLE_MAX_TICKS (65536 / PIT_TICK_COUNT)
+static unsigned skip_cnt;
+
 static intr_handler_func timer_interrupt;
+static timer_func wake_up;
+static void wheel_insert (struct timer *);
+static void wheel_cascade (struct list *slot);
+static intr_softirq_func wheel_run;
+static unsigned idle_ticks_available (void);
 static bool too_many_loops (unsigned loops);
 static void busy_wait (int64_t loops);
 static void real_time_sleep (int64_t num, int32_t denom);
 static void real_time_delay (int64_t num, int32_t denom);
+static void calibrate_tsc (void);
+static uint64_t read_ticks (void);
+static uint64_t read_ns (void);
+
+/* Statistics, for timing from user programs. */
+static struct kstat_counter stat_ticks = KSTAT_GAUGE ("timer.ticks",
+                                                      read_ticks);
+static struct kstat_counter stat_ns = KSTAT_GAUGE ("timer.ns", read_ns);
 
 /* Sets up the timer to interrupt TIMER_FREQ times per second,
    and registers the corresponding interrupt. */
 void
 timer_init (void) 
 {
+  for (int i = 0; i < WHEEL_ROOT_SIZE; i++)
+    list_init (&wheel_root[i]);
+  for (int level = 0; level < WHEEL_LEVELS; level++)
+    for (int i = 0; i < WHEEL_SIZE; i++)
+      list_init (&wheel[level][i]);
+  wheel_ticks = 0;
+  spinlock_init (&wheel_lock);
+
   pit_configure_channel (0, 2, TIMER_FREQ);
   intr_register_ext (0x20, timer_interrupt, "8254 Timer");
+  intr_register_softirq (INTR_SOFTIRQ_TIMER, wheel_run);
+  kstat_register (&stat_ticks);
+  kstat_register (&stat_ns);
 }
 
-/* Calibrates loops_per_tick, used to implement brief delays. */
+/* Calibrates loops_per_tick, used to implement brief delays when
+   there is no time stamp counter, and the time stamp counter. */
 void
 timer_calibrate (void) 
 {
@@ -63,7 +128,33 @@ timer_calibrate (void)
     if (!too_many_loops (loops_per_tick | test_bit))
       loops_per_tick |= test_bit;
 
-  printf ("%'"PRIu64" loops/s.\n", (uint64_t) loops_per_tick * TIMER_FREQ);
+  printf ("%'"PRIu64" loops/s", (uint64_t) loops_per_tick * TIMER_FREQ);
+  if (cpu_features () & CPUID_TSC)
+    {
+      calibrate_tsc ();
+      printf (", %'"PRIu64" TSC cycles/s", tsc_hz);
+    }
+  printf (".\n");
+}
+
+/* Counts the time stamp counter's cycles over TSC_CALIBRATE_TICKS
+   timer ticks to set tsc_hz, from one tick boundary to another so
+   that only interrupt latency makes it off. */
+static void
+calibrate_tsc (void)
+{
+  int64_t start;
+  uint64_t tsc_start;
+
+  start = ticks;
+  while (ticks == start)
+    barrier ();
+  tsc_start = timer_tsc ();
+  start = ticks;
+  while (ticks - start < TSC_CALIBRATE_TICKS)
+    barrier ();
+  tsc_hz = (timer_tsc () - tsc_start) * TIMER_FREQ / TSC_CALIBRATE_TICKS;
+  tsc_base = tsc_start - start * (int64_t) tsc_hz / TIMER_FREQ;
 }
 
 /* Returns the number of timer ticks since the OS booted. */
@@ -84,21 +175,91 @@ timer_elapsed (int64_t then)
   return timer_ticks () - then;
 }
 
+/* Returns the nanoseconds since the OS booted, as precise as the
+   time stamp counter, or only as timer ticks without one.  Cheap
+   enough for instrumentation, and may be called in interrupt
+   handlers or with interrupts off. */
+int64_t
+timer_ns (void)
+{
+  if (tsc_hz == 0)
+    return timer_ticks () * (NS_PER_SEC / TIMER_FREQ);
+  return timer_cycles_to_ns (timer_tsc () - tsc_base);
+}
+
+/* Converts CYCLES of the time stamp counter into nanoseconds, or
+   returns 0 if there is no time stamp counter. */
+int64_t
+timer_cycles_to_ns (uint64_t cycles)
+{
+  if (tsc_hz == 0)
+    return 0;
+  /* Split the conversion to keep CYCLES * NS_PER_SEC from
+     overflowing. */
+  return (cycles / tsc_hz * NS_PER_SEC
+          + cycles % tsc_hz * NS_PER_SEC / tsc_hz);
+}
+
+/* Returns a reading of the finest clock there is, the time stamp
+   counter or else timer ticks, for differences between readings to
+   be converted by timer_clock_to_ns().  Cheaper than timer_ns(), for
+   accounting on every entry to the kernel. */
+uint64_t
+timer_clock (void)
+{
+  return tsc_hz != 0 ? timer_tsc () : (uint64_t) timer_ticks ();
+}
+
+/* Converts the difference CLOCK between two readings of
+   timer_clock() into nanoseconds. */
+int64_t
+timer_clock_to_ns (uint64_t clock)
+{
+  if (tsc_hz == 0)
+    return clock * (NS_PER_SEC / TIMER_FREQ);
+  return timer_cycles_to_ns (clock);
+}
+
+/* Returns timer_ticks(), for the timer.ticks statistic. */
+static uint64_t
+read_ticks (void)
+{
+  return timer_ticks ();
+}
+
+/* Returns timer_ns(), for the timer.ns statistic. */
+static uint64_t
+read_ns (void)
+{
+  return timer_ns ();
+}
+
 /* Sleeps for approximately TICKS timer ticks.  Interrupts must
    be turned on. */
 void
 timer_sleep (int64_t ticks) 
 {
-  if (ticks <= 0) return;
-  struct semaphore sema;
-  sema_init(&sema, 0);
-  struct thread *cur = thread_current ();
-  cur->wake_tick = timer_ticks () + ticks;
-  cur->sleep_sema = &sema;
-  thread_add_to_slept ();
+  struct timer timer;
+  enum intr_level old_level;
 
+  if (ticks <= 0) return;
   ASSERT (intr_get_level () == INTR_ON);
-  sema_down(&sema);
+
+  timer_setup (&timer, wake_up, thread_current ());
+  old_level = intr_disable ();
+  timer_arm (&timer, ticks);
+  thread_block ();
+  intr_set_level (old_level);
+}
+
+/* Wakes up thread T_, asleep in timer_sleep(). */
+static void
+wake_up (void *t_)
+{
+  struct thread *t = t_;
+
+  thread_unblock (t);
+  thread_yield_for_priority ();
 }
 
 /* Sleeps for approximately MS milliseconds.  Interrupts must be
@@ -171,13 +332,241 @@ timer_print_stats (void)
   printf ("Timer: %"PRId64" ticks\n", timer_ticks ());
 }
 
+/* Initializes TIMER to call FUNC with AUX when it goes off.  The
+   timer is not armed. */
+void
+timer_setup (struct timer *timer, timer_func *func, void *aux)
+{
+  timer->func = func;
+  timer->aux = aux;
+  timer->pending = false;
+}
+
+/* Arms TIMER to go off DELAY timer ticks from now, or at the next
+   tick if DELAY is not positive.  TIMER must not be pending. */
+void
+timer_arm (struct timer *timer, int64_t delay)
+{
+  spinlock_acquire (&wheel_lock);
+  ASSERT (!timer->pending);
+  timer->expires = ticks + (delay > 0 ? delay : 1);
+  timer->pending = true;
+  wheel_insert (timer);
+  spinlock_release (&wheel_lock);
+}
+
+/* Stops TIMER from going off.  Returns true if it was pending, false
+   if it had gone off already or was never armed. */
+bool
+timer_cancel (struct timer *timer)
+{
+  bool pending;
+
+  spinlock_acquire (&wheel_lock);
+  pending = timer->pending;
+  if (pending)
+    {
+      list_remove (&timer->elem);
+      timer->pending = false;
+    }
+  spinlock_release (&wheel_lock);
+  return pending;
+}
+
+/* Puts TIMER in the slot of the wheel that covers its expiry.
+   The caller must hold WHEEL_LOCK. */
+static void
+wheel_insert (struct timer *timer)
+{
+  int64_t expires = timer->expires;
+  int64_t delta = expires - wheel_ticks;
+  struct list *slot;
+  int level;
+
+  if (delta < 0)
+    slot = &wheel_root[wheel_ticks & (WHEEL_ROOT_SIZE - 1)];
+  else if (delta < WHEEL_ROOT_SIZE)
+    slot = &wheel_root[expires & (WHEEL_ROOT_SIZE - 1)];
+  else
+    {
+      if (delta >= WHEEL_SPAN (WHEEL_LEVELS))
+        expires = wheel_ticks + WHEEL_SPAN (WHEEL_LEVELS) - 1;
+      for (level = 0; expires - wheel_ticks >= WHEEL_SPAN (level + 1);
+           level++)
+        continue;
+      slot = &wheel[level][(expires >> (WHEEL_ROOT_BITS + level * WHEEL_BITS))
+                           & (WHEEL_SIZE - 1)];
+    }
+  list_push_back (slot, &timer->elem);
+}
+
+/* Spreads the timers in SLOT over the wheels below it. */
+static void
+wheel_cascade (struct list *slot)
+{
+  struct list timers;
+
+  list_init (&timers);
+  while (!list_empty (slot))
+    list_push_back (&timers, list_pop_front (slot));
+  while (!list_empty (&timers))
+    wheel_insert (list_entry (list_pop_front (&timers), struct timer, elem));
+}
+
+/* Sets off the timers that are due by now.  Runs as the timer's
+   bottom half, calling each timer's function with interrupts off
+   but turning them back on in between. */
+static void
+wheel_run (void)
+{
+  enum intr_level old_level;
+
+  spinlock_acquire (&wheel_lock);
+  while (wheel_ticks <= ticks)
+    {
+      size_t idx = wheel_ticks & (WHEEL_ROOT_SIZE - 1);
+      struct list due;
+
+      /* Coming round to the start of the root wheel, bring in the
+         next slot of the wheel above, and so on up. */
+      if (idx == 0)
+        for (int level = 0; level < WHEEL_LEVELS; level++)
+          {
+            size_t i = ((wheel_ticks >> (WHEEL_ROOT_BITS + level * WHEEL_BITS))
+                        & (WHEEL_SIZE - 1));
+            wheel_cascade (&wheel[level][i]);
+            if (i != 0)
+              break;
+          }
+
+      /* Take the slot's timers first, since one a function arms again
+         may land in the same slot. */
+      list_init (&due);
+      while (!list_empty (&wheel_root[idx]))
+        list_push_back (&due, list_pop_front (&wheel_root[idx]));
+      wheel_ticks++;
+      while (!list_empty (&due))
+        {
+          struct timer *timer = list_entry (list_pop_front (&due),
+                                            struct timer, elem);
+          if (timer->expires >= wheel_ticks)
+            {
+              /* Parked far out, not due yet. */
+              wheel_insert (timer);
+              continue;
+            }
+          timer->pending = false;
+          spinlock_release (&wheel_lock);
+          old_level = intr_disable ();
+          timer->func (timer->aux);
+          intr_set_level (old_level);
+          spinlock_acquire (&wheel_lock);
+        }
+    }
+  spinlock_release (&wheel_lock);
+}
+
+/* Returns how many ticks from now, at most IDLE_MAX_TICKS, may pass
+   with a single timer interrupt: up to the first tick with timers due,
+   at the start of a second, or that runs into the wheels above the
+   root wheel.  Must be called with interrupts off. */
+static unsigned
+idle_ticks_available (void)
+{
+  unsigned n;
+
+  for (n = 1; n < IDLE_MAX_TICKS; n++)
+    {
+      int64_t tick = ticks + n;
+
+      if (!list_empty (&wheel_root[tick & (WHEEL_ROOT_SIZE - 1)])
+          || (tick & (WHEEL_ROOT_SIZE - 1)) == 0
+          || tick % TIMER_FREQ == 0)
+        break;
+    }
+  return n;
+}
+
+/* Called by the idle thread with interrupts off just before it halts.
+   Stretches the PIT period over the ticks until the next one that
+   has work to do, keeping what is left of the current tick. */
+void
+timer_idle_enter (void)
+{
+  unsigned n, left;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  if (skip_cnt != 0 || wheel_ticks != ticks + 1)
+    return;
+  n = idle_ticks_available ();
+  if (n < 2)
+    return;
+  left = pit_read_channel (0);
+  if (intr_is_pending (0x20) || left > PIT_TICK_COUNT)
+    return;
+  pit_load_channel (0, 2, (n - 1) * PIT_TICK_COUNT + left);
+  skip_cnt = n;
+}
+
+/* Called with interrupts off when the idle thread is about to be
+   switched out, which may be long before the timer interrupt it
+   asked for.  Accounts the whole ticks that have gone by, and sets
+   the PIT to interrupt at the next tick boundary, from where it
+   ticks normally again. */
+void
+timer_idle_exit (void)
+{
+  unsigned total, left, whole, rest;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  if (skip_cnt == 0)
+    return;
+
+  /* If the interrupt is being held off, all the ticks went by; its
+     handler accounts for them. */
+  left = pit_read_channel (0);
+  if (intr_is_pending (0x20))
+    return;
+
+  total = skip_cnt * PIT_TICK_COUNT;
+  whole = (total - left) / PIT_TICK_COUNT;
+  rest = left % PIT_TICK_COUNT;
+  ticks += whole;
+  thread_account_idle (whole);
+
+  /* A period under 2 cycles isn't possible, so run on to the tick
+     boundary after. */
+  if (rest == 0)
+    rest = PIT_TICK_COUNT;
+  skip_cnt = 1;
+  if (rest < 2)
+    {
+      rest += PIT_TICK_COUNT;
+      skip_cnt = 2;
+    }
+  pit_load_channel (0, 2, rest);
+}
+
 /* Timer interrupt handler. */
 static void
-timer_interrupt (struct intr_frame *args UNUSED)
+timer_interrupt (struct intr_frame *args)
 {
-  ticks++;
-  thread_tick ();
-  thread_wake_eligible_slept ();
+  unsigned n = 1;
+
+  if (skip_cnt != 0)
+    {
+      n = skip_cnt;
+      skip_cnt = 0;
+      pit_configure_channel (0, 2, TIMER_FREQ);
+    }
+  if (profile_enabled)
+    profile_sample (args);
+  while (n-- > 0)
+    {
+      ticks++;
+      thread_tick ();
+    }
+  intr_raise_softirq (INTR_SOFTIRQ_TIMER);
 }
 
 /* Returns true if LOOPS iterations waits for more than one timer
@@ -226,7 +615,20 @@ real_time_sleep (int64_t num, int32_t denom)
   int64_t ticks = num * TIMER_FREQ / denom;
 
   ASSERT (intr_get_level () == INTR_ON);
-  if (ticks > 0)
+  if (tsc_hz != 0)
+    {
+      /* Sleep through the whole ticks, which ends on a tick boundary
+         before the deadline since the current tick is partly gone
+         already, then busy-wait the rest on the time stamp counter
+         instead of rounding it off. */
+      int64_t deadline = timer_ns () + num * (NS_PER_SEC / denom);
+
+      if (ticks > 0)
+        timer_sleep (ticks);
+      while (timer_ns () < deadline)
+        barrier ();
+    }
+  else if (ticks > 0)
     {
       /* We're waiting for at least one full timer tick.  Use
          timer_sleep() because it will yield the CPU to other
@@ -241,10 +643,19 @@ real_time_sleep (int64_t num, int32_t denom)
     }
 }
 
-/* Busy-wait for approximately NUM/DENOM seconds. */
+/* Busy-wait for approximately NUM/DENOM seconds, timed by the time
+   stamp counter if there is one. */
 static void
 real_time_delay (int64_t num, int32_t denom)
 {
+  if (tsc_hz != 0)
+    {
+      int64_t deadline = timer_ns () + num * (NS_PER_SEC / denom);
+      while (timer_ns () < deadline)
+        barrier ();
+      return;
+    }
+
   /* Scale the numerator and denominator down by 1000 to avoid
      the possibility of overflow. */
   ASSERT (denom % 1000 == 0);
@@ -1,18 +1,50 @@
 #ifndef DEVICES_TIMER_H
 #define DEVICES_TIMER_H
 
+#include <list.h>
 #include <round.h>
+#include <stdbool.h>
 #include <stdint.h>
 
 /* Number of timer interrupts per second. */
 #define TIMER_FREQ 100
 
+/* Called by a kernel timer when it goes off, in the timer interrupt's
+   bottom half with interrupts off, so it must not sleep. */
+typedef void timer_func (void *aux);
+
+/* A one-shot kernel timer. */
+struct timer
+  {
+    struct list_elem elem;      /* Element in a slot of the timer wheel. */
+    int64_t expires;            /* Tick at which to go off. */
+    timer_func *func;           /* Function to call. */
+    void *aux;                  /* Auxiliary data for FUNC. */
+    bool pending;               /* Armed and not gone off yet? */
+  };
+
 void timer_init (void);
 void timer_calibrate (void);
 
 int64_t timer_ticks (void);
 int64_t timer_elapsed (int64_t);
 
+/* High-resolution clock. */
+int64_t timer_ns (void);
+int64_t timer_cycles_to_ns (uint64_t cycles);
+uint64_t timer_clock (void);
+int64_t timer_clock_to_ns (uint64_t);
+
+/* Returns the CPU's time stamp counter, which counts cycles at a
+   constant rate on the CPUs Pintos runs on. */
+static inline uint64_t
+timer_tsc (void)
+{
+  uint64_t tsc;
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
+
 /* Sleep and yield the CPU to other threads. */
 void timer_sleep (int64_t ticks);
 void timer_msleep (int64_t milliseconds);
@@ -24,6 +56,15 @@ void timer_mdelay (int64_t milliseconds);
 void timer_udelay (int64_t microseconds);
 void timer_ndelay (int64_t nanoseconds);
 
+/* Tickless idle, for the idle thread. */
+void timer_idle_enter (void);
+void timer_idle_exit (void);
+
+/* Kernel timers. */
+void timer_setup (struct timer *, timer_func *, void *aux);
+void timer_arm (struct timer *, int64_t delay);
+bool timer_cancel (struct timer *);
+
 void timer_print_stats (void);
 
 #endif /* devices/timer.h */
@@ -14,6 +14,16 @@
 #define COL_CNT 80
 #define ROW_CNT 25
 
+/* Number of rows in the 32 kB of video memory, of which the display
+   shows the ROW_CNT starting at row TOP.  Scrolling moves TOP down
+   through them by setting the CRTC start address, and only wrapping
+   around to the start copies the screen. */
+#define BUF_ROWS (0x8000 / (COL_CNT * 2))
+static size_t top;
+
+/* TOP as last given to the CRTC. */
+static size_t shown_top;
+
 /* Current cursor position.  (0,0) is in the upper left corner of
    the display. */
 static size_t cx, cy;
@@ -22,8 +32,8 @@ static size_t cx, cy;
 #define GRAY_ON_BLACK 0x07
 
 /* Framebuffer.  See [FREEVGA] under "VGA Text Mode Operation".
-   The character at (x,y) is fb[y][x][0].
-   The attribute at (x,y) is fb[y][x][1]. */
+   The character at (x,y) on the display is fb[top + y][x][0].
+   The attribute at (x,y) is fb[top + y][x][1]. */
 static uint8_t (*fb)[COL_CNT][2];
 
 static void clear_row (size_t y);
@@ -31,6 +41,7 @@ static void cls (void);
 static void newline (void);
 static void move_cursor (void);
 static void find_cursor (size_t *x, size_t *y);
+static void put_char (int c, enum intr_level);
 
 /* Initializes the VGA text display. */
 static void
@@ -56,7 +67,32 @@ vga_putc (int c)
   enum intr_level old_level = intr_disable ();
 
   init ();
-  
+  put_char (c, old_level);
+  move_cursor ();
+
+  intr_set_level (old_level);
+}
+
+/* Writes the N characters in BUFFER to the VGA text display like
+   vga_putc(), but moves the hardware cursor only once at the end. */
+void
+vga_putbuf (const char *buffer, size_t n)
+{
+  enum intr_level old_level = intr_disable ();
+
+  init ();
+  while (n-- > 0)
+    put_char (*buffer++, old_level);
+  move_cursor ();
+
+  intr_set_level (old_level);
+}
+
+/* Writes C to the frame buffer, leaving the hardware cursor alone.
+   Interrupts must be off; OLD_LEVEL is the level to beep at. */
+static void
+put_char (int c, enum intr_level old_level)
+{
   switch (c) 
     {
     case '\n':
@@ -89,19 +125,14 @@ vga_putc (int c)
       break;
       
     default:
-      fb[cy][cx][0] = c;
-      fb[cy][cx][1] = GRAY_ON_BLACK;
+      fb[top + cy][cx][0] = c;
+      fb[top + cy][cx][1] = GRAY_ON_BLACK;
       if (++cx >= COL_CNT)
         newline ();
       break;
     }
-
-  /* Update cursor position. */
-  move_cursor ();
-
-  intr_set_level (old_level);
 }
-
+
 /* Clears the screen and moves the cursor to the upper left. */
 static void
 cls (void)
@@ -115,7 +146,7 @@ cls (void)
   move_cursor ();
 }
 
-/* Clears row Y to spaces. */
+/* Clears row Y of the display to spaces. */
 static void
 clear_row (size_t y) 
 {
@@ -123,14 +154,16 @@ clear_row (size_t y)
 
   for (x = 0; x < COL_CNT; x++)
     {
-      fb[y][x][0] = ' ';
-      fb[y][x][1] = GRAY_ON_BLACK;
+      fb[top + y][x][0] = ' ';
+      fb[top + y][x][1] = GRAY_ON_BLACK;
     }
 }
 
 /* Advances the cursor to the first column in the next line on
    the screen.  If the cursor is already on the last line on the
-   screen, scrolls the screen upward one line. */
+   screen, scrolls the screen upward one line, by showing one more
+   row of video memory or, at its end, by copying the screen back to
+   its start. */
 static void
 newline (void)
 {
@@ -139,17 +172,33 @@ newline (void)
   if (cy >= ROW_CNT)
     {
       cy = ROW_CNT - 1;
-      memmove (&fb[0], &fb[1], sizeof fb[0] * (ROW_CNT - 1));
+      if (top + ROW_CNT < BUF_ROWS)
+        top++;
+      else
+        {
+          memmove (&fb[0], &fb[top + 1], sizeof fb[0] * (ROW_CNT - 1));
+          top = 0;
+        }
       clear_row (ROW_CNT - 1);
     }
 }
 
-/* Moves the hardware cursor to (cx,cy). */
+/* Moves the hardware cursor to (cx,cy), first scrolling the display
+   to TOP if it has moved. */
 static void
 move_cursor (void) 
 {
-  /* See [FREEVGA] under "Manipulating the Text-mode Cursor". */
-  uint16_t cp = cx + COL_CNT * cy;
+  /* See [FREEVGA] under "Manipulating the Text-mode Cursor" and
+     "CRTC Registers" for the start address. */
+  uint16_t cp = cx + COL_CNT * (top + cy);
+
+  if (top != shown_top)
+    {
+      uint16_t start = COL_CNT * top;
+      outw (0x3d4, 0x0c | (start & 0xff00));
+      outw (0x3d4, 0x0d | (start << 8));
+      shown_top = top;
+    }
   outw (0x3d4, 0x0e | (cp & 0xff00));
   outw (0x3d4, 0x0f | (cp << 8));
 }
@@ -0,0 +1,459 @@
+#include "devices/virtio-blk.h"
+#include <debug.h>
+#include <list.h>
+#include <round.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/block.h"
+#include "devices/partition.h"
+#include "devices/pci.h"
+#include "threads/interrupt.h"
+#include "threads/io.h"
+#include "threads/kstack.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+#include "threads/vmalloc.h"
+
+/* The code in this file is a driver for virtio block devices
+   [VIRTIO], the paravirtual disks that QEMU attaches with "-drive
+   if=virtio".  It uses the legacy PCI interface, which QEMU offers
+   for virtio devices on the PC machine.
+
+   Each disk has one virtqueue, shared by all the threads that use
+   the disk.  A transfer takes a slot of three chained descriptors,
+   for the request header, the data and the status byte, puts it on
+   the available ring, and sleeps until the interrupt handler finds
+   it on the used ring.  So a transfer of up to BLOCK_MAX_MULTIPLE
+   sectors is a single request, and as many requests as there are
+   slots can be outstanding on a disk at once, unlike on an IDE
+   channel. */
+
+/* PCI identification of a (transitional) virtio block device. */
+#define VIRTIO_VENDOR 0x1af4
+#define VIRTIO_BLK_DEVICE 0x1001
+
+/* Legacy virtio PCI registers, as offsets from I/O BAR 0. */
+#define REG_DEVICE_FEATURES 0x00        /* Device features (32 bits). */
+#define REG_GUEST_FEATURES 0x04         /* Driver features (32 bits). */
+#define REG_QUEUE_PFN 0x08              /* Queue page number (32 bits). */
+#define REG_QUEUE_SIZE 0x0c             /* Queue size (16 bits, r/o). */
+#define REG_QUEUE_SELECT 0x0e           /* Queue select (16 bits). */
+#define REG_QUEUE_NOTIFY 0x10           /* Queue notify (16 bits). */
+#define REG_STATUS 0x12                 /* Device status (8 bits). */
+#define REG_ISR 0x13                    /* ISR status (8 bits, r/o). */
+#define REG_CAPACITY 0x14               /* Size in sectors (64 bits). */
+
+/* Device Status Register bits. */
+#define STATUS_ACKNOWLEDGE 0x01         /* Device noticed. */
+#define STATUS_DRIVER 0x02              /* Driver found. */
+#define STATUS_DRIVER_OK 0x04           /* Driver ready. */
+#define STATUS_FAILED 0x80              /* Driver gave up. */
+
+/* ISR Status Register bits.  Reading the register clears them. */
+#define ISR_QUEUE 0x01                  /* Used ring was updated. */
+
+/* The legacy interface puts the used ring at the first page
+   boundary after the available ring. */
+#define VRING_ALIGN 4096
+
+/* A virtqueue descriptor. */
+struct vring_desc
+  {
+    uint64_t addr;              /* Physical address of buffer. */
+    uint32_t len;               /* Length of buffer in bytes. */
+    uint16_t flags;             /* VRING_DESC_F_* bits. */
+    uint16_t next;              /* Next descriptor, with F_NEXT. */
+  };
+#define VRING_DESC_F_NEXT 1     /* Chain continues at NEXT. */
+#define VRING_DESC_F_WRITE 2    /* Device writes buffer, not reads it. */
+
+/* The available ring, which the driver fills. */
+struct vring_avail
+  {
+    uint16_t flags;
+    uint16_t idx;               /* Free-running index of next entry. */
+    uint16_t ring[];            /* Heads of descriptor chains. */
+  };
+
+/* An entry in the used ring. */
+struct vring_used_elem
+  {
+    uint32_t id;                /* Head of descriptor chain. */
+    uint32_t len;               /* Bytes the device wrote. */
+  };
+
+/* The used ring, which the device fills. */
+struct vring_used
+  {
+    uint16_t flags;
+    uint16_t idx;               /* Free-running index of next entry. */
+    struct vring_used_elem ring[];
+  };
+
+/* Request header. */
+struct blk_header
+  {
+    uint32_t type;              /* BLK_T_*. */
+    uint32_t reserved;
+    uint64_t sector;            /* First sector. */
+  };
+#define BLK_T_IN 0              /* Read from the disk. */
+#define BLK_T_OUT 1             /* Write to the disk. */
+#define BLK_S_OK 0              /* Status of a successful request. */
+
+/* Most requests outstanding on one disk. */
+#define SLOT_MAX 32
+
+/* Room for one outstanding request.  Slot I owns descriptors
+   3 * I through 3 * I + 2 of its disk's queue. */
+struct slot
+  {
+    struct blk_header header;   /* Request header, read by device. */
+    uint8_t status;             /* Request status, written by device. */
+    struct semaphore done;      /* Up'd by interrupt handler. */
+    struct list_elem elem;      /* Element in disk's FREE_SLOTS. */
+  };
+
+/* A virtio disk. */
+struct virtio_disk
+  {
+    char name[8];               /* Name, e.g. "vda". */
+    uint16_t io_base;           /* Base I/O port. */
+    uint8_t irq;                /* Interrupt in use. */
+
+    /* Virtqueue. */
+    uint16_t queue_size;        /* Entries per ring. */
+    struct vring_desc *desc;    /* Descriptor table. */
+    struct vring_avail *avail;  /* Available ring. */
+    struct vring_used *used;    /* Used ring. */
+    uint16_t used_idx;          /* Next used entry, for the handler. */
+
+    struct lock lock;           /* Guards AVAIL and FREE_SLOTS. */
+    struct slot *slots;         /* SLOT_CNT slots. */
+    size_t slot_cnt;
+    struct list free_slots;     /* Slots without a request. */
+    struct semaphore slots_free;        /* Size of FREE_SLOTS. */
+
+    /* Transfers to or from buffers that the device cannot reach
+       through a physical address go through this page. */
+    struct lock bounce_lock;    /* Guards BOUNCE. */
+    uint8_t *bounce;            /* One page. */
+  };
+
+/* Most virtio disks we drive. */
+#define DISK_MAX 8
+static struct virtio_disk disks[DISK_MAX];
+static size_t disk_cnt;
+
+static struct block_operations virtio_operations;
+
+static bool init_disk (struct virtio_disk *, int dev, int func);
+static void transfer (struct virtio_disk *, block_sector_t, size_t cnt,
+                      void *buffer, bool is_write);
+static void interrupt_handler (struct intr_frame *);
+
+/* Finds the virtio disks on PCI bus 0 and registers each with the
+   block device layer, in the order of their PCI slots. */
+void
+virtio_blk_init (void)
+{
+  int dev, func;
+
+  for (dev = 0; dev < 32; dev++)
+    for (func = 0; func < 8; func++)
+      {
+        uint32_t id = pci_read_config (0, dev, func, 0x00);
+        struct virtio_disk *d;
+        char extra_info[32];
+        uint64_t capacity;
+        struct block *block;
+
+        if ((id & 0xffff) != VIRTIO_VENDOR
+            || (id >> 16) != VIRTIO_BLK_DEVICE)
+          continue;
+        if (disk_cnt >= DISK_MAX)
+          {
+            printf ("virtio: ignoring disks past the first %d\n", DISK_MAX);
+            return;
+          }
+
+        d = &disks[disk_cnt];
+        snprintf (d->name, sizeof d->name, "vd%c", (char) ('a' + disk_cnt));
+        if (!init_disk (d, dev, func))
+          continue;
+        disk_cnt++;
+
+        capacity = ((uint64_t) inl (d->io_base + REG_CAPACITY + 4) << 32
+                    | inl (d->io_base + REG_CAPACITY));
+        if (capacity > UINT32_MAX)
+          capacity = UINT32_MAX;
+        snprintf (extra_info, sizeof extra_info, "virtio, %zu requests",
+                  d->slot_cnt);
+        block = block_register (d->name, BLOCK_RAW, extra_info, capacity,
+                                &virtio_operations, d);
+        partition_scan (block);
+      }
+}
+
+/* Sets up disk D, PCI function FUNC of device DEV on bus 0, and
+   its virtqueue, and tells the device the driver is ready.
+   Returns false, leaving the device failed, if that is not
+   possible. */
+static bool
+init_disk (struct virtio_disk *d, int dev, int func)
+{
+  uint32_t bar0 = pci_read_config (0, dev, func, 0x10);
+  uint32_t command = pci_read_config (0, dev, func, 0x04);
+  uint8_t irq = pci_read_config (0, dev, func, 0x3c) & 0xff;
+  size_t avail_ofs, used_ofs, page_cnt, i;
+  uint8_t *queue;
+
+  if ((bar0 & 1) == 0 || irq >= 16)
+    {
+      printf ("%s: no I/O ports or interrupt line, ignoring\n", d->name);
+      return false;
+    }
+  d->io_base = bar0 & 0xfffc;
+  d->irq = irq + 0x20;
+  if (strcmp (intr_name (d->irq), "unknown")
+      && strcmp (intr_name (d->irq), "virtio-blk"))
+    {
+      printf ("%s: interrupt %d is taken by %s, ignoring\n", d->name, irq,
+              intr_name (d->irq));
+      return false;
+    }
+
+  /* Enable I/O space and bus mastering, leaving the write-1-to-clear
+     status half of the register be. */
+  pci_write_config (0, dev, func, 0x04, (command & 0xffff) | 0x05);
+
+  /* Reset the device and announce ourselves.  We use no optional
+     features. */
+  outb (d->io_base + REG_STATUS, 0);
+  outb (d->io_base + REG_STATUS, STATUS_ACKNOWLEDGE);
+  outb (d->io_base + REG_STATUS, STATUS_ACKNOWLEDGE | STATUS_DRIVER);
+  inl (d->io_base + REG_DEVICE_FEATURES);
+  outl (d->io_base + REG_GUEST_FEATURES, 0);
+
+  /* Lay out queue 0: descriptors, then the available ring, then at
+     the next page boundary the used ring. */
+  outw (d->io_base + REG_QUEUE_SELECT, 0);
+  d->queue_size = inw (d->io_base + REG_QUEUE_SIZE);
+  avail_ofs = d->queue_size * sizeof *d->desc;
+  used_ofs = ROUND_UP (avail_ofs + sizeof *d->avail
+                       + (d->queue_size + 1) * sizeof (uint16_t),
+                       VRING_ALIGN);
+  page_cnt = DIV_ROUND_UP (used_ofs + sizeof *d->used
+                           + d->queue_size * sizeof *d->used->ring
+                           + sizeof (uint16_t), PGSIZE);
+  d->slot_cnt = d->queue_size / 3 < SLOT_MAX ? d->queue_size / 3 : SLOT_MAX;
+  queue = d->slot_cnt > 0 ? palloc_get_multiple (PAL_ZERO, page_cnt) : NULL;
+  d->slots = calloc (d->slot_cnt, sizeof *d->slots);
+  d->bounce = palloc_get_page (0);
+  if (queue == NULL || d->slots == NULL || d->bounce == NULL)
+    {
+      printf ("%s: can't set up queue\n", d->name);
+      outb (d->io_base + REG_STATUS, STATUS_FAILED);
+      palloc_free_multiple (queue, page_cnt);
+      free (d->slots);
+      palloc_free_page (d->bounce);
+      return false;
+    }
+  d->desc = (struct vring_desc *) queue;
+  d->avail = (struct vring_avail *) (queue + avail_ofs);
+  d->used = (struct vring_used *) (queue + used_ofs);
+  d->used_idx = 0;
+
+  /* Chain each slot's descriptors, which always point to its header
+     first and to its status last. */
+  lock_init (&d->lock);
+  list_init (&d->free_slots);
+  for (i = 0; i < d->slot_cnt; i++)
+    {
+      struct slot *s = &d->slots[i];
+      struct vring_desc *desc = &d->desc[3 * i];
+
+      desc[0].addr = vtop (&s->header);
+      desc[0].len = sizeof s->header;
+      desc[0].flags = VRING_DESC_F_NEXT;
+      desc[0].next = 3 * i + 1;
+      desc[1].flags = VRING_DESC_F_NEXT;
+      desc[1].next = 3 * i + 2;
+      desc[2].addr = vtop (&s->status);
+      desc[2].len = sizeof s->status;
+      desc[2].flags = VRING_DESC_F_WRITE;
+      sema_init (&s->done, 0);
+      list_push_back (&d->free_slots, &s->elem);
+    }
+  sema_init (&d->slots_free, d->slot_cnt);
+  lock_init (&d->bounce_lock);
+
+  if (!strcmp (intr_name (d->irq), "unknown"))
+    intr_register_ext (d->irq, interrupt_handler, "virtio-blk");
+  outl (d->io_base + REG_QUEUE_PFN, vtop (queue) / PGSIZE);
+  outb (d->io_base + REG_STATUS,
+        STATUS_ACKNOWLEDGE | STATUS_DRIVER | STATUS_DRIVER_OK);
+  return true;
+}
+
+/* Returns true if the device can reach BUFFER through its physical
+   address.  Only kernel virtual addresses outside kernel stacks
+   and vmalloc() blocks map directly to physical memory. */
+static bool
+is_direct (const void *buffer)
+{
+  return (is_kernel_vaddr (buffer) && !kstack_contains (buffer)
+          && !vmalloc_contains (buffer));
+}
+
+/* Transfers CNT sectors starting at SEC_NO between disk D and
+   BUFFER, which must have a direct physical mapping, as one
+   request, writing to the disk if IS_WRITE and reading from it
+   otherwise.  Panics if the disk reports an error. */
+static void
+transfer (struct virtio_disk *d, block_sector_t sec_no, size_t cnt,
+          void *buffer, bool is_write)
+{
+  struct vring_desc *desc;
+  struct slot *s;
+  size_t idx;
+
+  ASSERT (is_direct (buffer));
+
+  sema_down (&d->slots_free);
+  lock_acquire (&d->lock);
+  s = list_entry (list_pop_front (&d->free_slots), struct slot, elem);
+  idx = s - d->slots;
+  s->header.type = is_write ? BLK_T_OUT : BLK_T_IN;
+  s->header.reserved = 0;
+  s->header.sector = sec_no;
+  s->status = 0xff;
+  desc = &d->desc[3 * idx];
+  desc[1].addr = vtop (buffer);
+  desc[1].len = cnt * BLOCK_SECTOR_SIZE;
+  desc[1].flags = VRING_DESC_F_NEXT | (is_write ? 0 : VRING_DESC_F_WRITE);
+
+  /* The device may look at the ring as soon as the index moves, so
+     the entry has to be there first. */
+  d->avail->ring[d->avail->idx % d->queue_size] = 3 * idx;
+  barrier ();
+  d->avail->idx++;
+  barrier ();
+  outw (d->io_base + REG_QUEUE_NOTIFY, 0);
+  lock_release (&d->lock);
+
+  sema_down (&s->done);
+  if (s->status != BLK_S_OK)
+    PANIC ("%s: disk %s failed, sector=%"PRDSNu, d->name,
+           is_write ? "write" : "read", sec_no);
+
+  lock_acquire (&d->lock);
+  list_push_back (&d->free_slots, &s->elem);
+  lock_release (&d->lock);
+  sema_up (&d->slots_free);
+}
+
+/* Transfers CNT sectors starting at SEC_NO between disk D and
+   BUFFER as transfer() does, going through D's bounce page a page
+   at a time if the device cannot reach BUFFER itself. */
+static void
+bounce_transfer (struct virtio_disk *d, block_sector_t sec_no, size_t cnt,
+                 void *buffer_, bool is_write)
+{
+  uint8_t *buffer = buffer_;
+
+  if (is_direct (buffer))
+    {
+      transfer (d, sec_no, cnt, buffer, is_write);
+      return;
+    }
+
+  lock_acquire (&d->bounce_lock);
+  while (cnt > 0)
+    {
+      size_t chunk = cnt < PGSIZE / BLOCK_SECTOR_SIZE
+                     ? cnt : PGSIZE / BLOCK_SECTOR_SIZE;
+      size_t size = chunk * BLOCK_SECTOR_SIZE;
+
+      if (is_write)
+        memcpy (d->bounce, buffer, size);
+      transfer (d, sec_no, chunk, d->bounce, is_write);
+      if (!is_write)
+        memcpy (buffer, d->bounce, size);
+
+      sec_no += chunk;
+      buffer += size;
+      cnt -= chunk;
+    }
+  lock_release (&d->bounce_lock);
+}
+
+/* Reads CNT sectors starting at SEC_NO from disk D into BUFFER.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+static void
+virtio_read_multiple (void *d, block_sector_t sec_no, size_t cnt,
+                      void *buffer)
+{
+  bounce_transfer (d, sec_no, cnt, buffer, false);
+}
+
+/* Writes CNT sectors starting at SEC_NO to disk D from BUFFER.
+   Returns after the disk has acknowledged the data.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+static void
+virtio_write_multiple (void *d, block_sector_t sec_no, size_t cnt,
+                       const void *buffer)
+{
+  bounce_transfer (d, sec_no, cnt, (void *) buffer, true);
+}
+
+/* Reads sector SEC_NO from disk D into BUFFER. */
+static void
+virtio_read (void *d, block_sector_t sec_no, void *buffer)
+{
+  virtio_read_multiple (d, sec_no, 1, buffer);
+}
+
+/* Writes sector SEC_NO to disk D from BUFFER. */
+static void
+virtio_write (void *d, block_sector_t sec_no, const void *buffer)
+{
+  virtio_write_multiple (d, sec_no, 1, buffer);
+}
+
+static struct block_operations virtio_operations =
+  {
+    virtio_read,
+    virtio_write,
+    virtio_read_multiple,
+    virtio_write_multiple,
+  };
+
+/* Virtio interrupt handler, shared by the disks on an interrupt
+   line.  Wakes up the requests that each disk has finished. */
+static void
+interrupt_handler (struct intr_frame *f)
+{
+  struct virtio_disk *d;
+
+  for (d = disks; d < disks + disk_cnt; d++)
+    if (f->vec_no == d->irq
+        && (inb (d->io_base + REG_ISR) & ISR_QUEUE) != 0)
+      {
+        barrier ();
+        while (d->used_idx != d->used->idx)
+          {
+            struct vring_used_elem *e
+              = &d->used->ring[d->used_idx % d->queue_size];
+            sema_up (&d->slots[e->id / 3].done);
+            d->used_idx++;
+            barrier ();
+          }
+      }
+}
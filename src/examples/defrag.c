@@ -0,0 +1,33 @@
+/* defrag.c
+
+   Moves the data of each file named on the command line into
+   contiguous sectors. */
+
+#include <stdio.h>
+#include <syscall.h>
+
+int
+main (int argc, char *argv[]) 
+{
+  bool success = true;
+  int i;
+
+  for (i = 1; i < argc; i++)
+    {
+      int fd = open (argv[i]);
+
+      if (fd < 0)
+        {
+          printf ("%s: open failed\n", argv[i]);
+          success = false;
+          continue;
+        }
+      if (!defrag (fd))
+        {
+          printf ("%s: defrag failed\n", argv[i]);
+          success = false;
+        }
+      close (fd);
+    }
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -6,7 +6,8 @@
 
    By default, only the name of each file is printed.  If "-l" is
    given as the first argument, the type, size, and inumber of
-   each file is also printed.  This won't work until project 4. */
+   each file is also printed, all from getdents.  This won't work
+   until project 4. */
 
 #include <syscall.h>
 #include <stdio.h>
@@ -24,39 +25,26 @@ list_dir (const char *dir, bool verbose)
 
   if (isdir (dir_fd))
     {
-      char name[READDIR_MAX_LEN];
+      struct dirent entries[16];
+      int cnt, i;
 
       printf ("%s", dir);
       if (verbose)
         printf (" (inumber %d)", inumber (dir_fd));
       printf (":\n");
 
-      while (readdir (dir_fd, name)) 
-        {
-          printf ("%s", name); 
-          if (verbose) 
-            {
-              char full_name[128];
-              int entry_fd;
+      while ((cnt = getdents (dir_fd, entries, 16)) > 0)
+        for (i = 0; i < cnt; i++)
+          {
+            struct dirent *e = &entries[i];
 
-              snprintf (full_name, sizeof full_name, "%s/%s", dir, name);
-              entry_fd = open (full_name);
-
-              printf (": ");
-              if (entry_fd != -1)
-                {
-                  if (isdir (entry_fd))
-                    printf ("directory");
-                  else
-                    printf ("%d-byte file", filesize (entry_fd));
-                  printf (", inumber %d", inumber (entry_fd));
-                }
-              else
-                printf ("open failed");
-              close (entry_fd);
-            }
-          printf ("\n");
-        }
+            printf ("%s", e->name); 
+            if (verbose && e->isdir)
+              printf (": directory, inumber %d", e->inumber);
+            else if (verbose) 
+              printf (": %u-byte file, inumber %d", e->length, e->inumber);
+            printf ("\n");
+          }
     }
   else 
     printf ("%s: not a directory\n", dir);
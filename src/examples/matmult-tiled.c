@@ -0,0 +1,215 @@
+/* matmult-tiled.c
+
+   Companion to matmult that multiplies the same matrices a block at
+   a time, first in this process and then split across child
+   processes, and reports the timer ticks, CPU time and page faults
+   each run took.
+
+   usage: matmult-tiled [PROCS]
+
+   The first run uses static arrays, as matmult does.  The second
+   keeps the matrices in a shared memory segment, which the PROCS
+   (default 4) forked children share, and each computes its own band
+   of rows of C.  Both check C against what it must come out as.
+
+   Exits with C[DIM - 1][DIM - 1], like matmult, or EXIT_FAILURE if
+   something went wrong. */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+
+/* Size of the matrices, as in matmult, and of the blocks they are
+   multiplied in, BLOCK by BLOCK ints at a time. */
+#define DIM 128
+#define BLOCK 16
+#if DIM % BLOCK != 0
+#error DIM must be a multiple of BLOCK
+#endif
+
+/* Most child processes. */
+#define PROC_MAX 16
+
+/* Most kernel statistics read at once. */
+#define KSTAT_MAX 128
+
+/* Where the shared matrices are mapped. */
+#define SHARED_ADDR ((void *) 0x10000000)
+
+/* The three matrices of a multiplication C = A * B. */
+struct matrices
+  {
+    int a[DIM][DIM];
+    int b[DIM][DIM];
+    int c[DIM][DIM];
+  };
+
+/* The matrices of the first run.  Static to reduce stack usage. */
+static struct matrices local;
+
+/* Fills in A and B, and clears C. */
+static void
+init (struct matrices *m)
+{
+  int i, j;
+
+  for (i = 0; i < DIM; i++)
+    for (j = 0; j < DIM; j++)
+      {
+        m->a[i][j] = i;
+        m->b[i][j] = j;
+        m->c[i][j] = 0;
+      }
+}
+
+/* Adds A * B to rows FIRST up to LAST of C, a block at a time, so that
+   the rows of A and B each block uses stay in the cache while it
+   does. */
+static void
+multiply (struct matrices *m, int first, int last)
+{
+  int ii, jj, kk, i, j, k;
+
+  for (ii = first; ii < last; ii += BLOCK)
+    for (kk = 0; kk < DIM; kk += BLOCK)
+      for (jj = 0; jj < DIM; jj += BLOCK)
+        for (i = ii; i < ii + BLOCK && i < last; i++)
+          for (k = kk; k < kk + BLOCK; k++)
+            {
+              int a = m->a[i][k];
+
+              for (j = jj; j < jj + BLOCK; j++)
+                m->c[i][j] += a * m->b[k][j];
+            }
+}
+
+/* Returns true if C is the product init() set up, whose element at
+   I, J is the sum over K of I * J. */
+static bool
+check (const struct matrices *m)
+{
+  int i, j;
+
+  for (i = 0; i < DIM; i++)
+    for (j = 0; j < DIM; j++)
+      if (m->c[i][j] != DIM * i * j)
+        {
+          printf ("C[%d][%d] is %d, not %d\n", i, j, m->c[i][j],
+                  DIM * i * j);
+          return false;
+        }
+  return true;
+}
+
+/* Returns the kernel's timer tick count. */
+static uint64_t
+ticks (void)
+{
+  static struct kstat stats[KSTAT_MAX];
+  int cnt = kstat (stats, KSTAT_MAX);
+  int i;
+
+  for (i = 0; i < cnt; i++)
+    if (!strcmp (stats[i].name, "timer.ticks"))
+      return stats[i].value;
+  return 0;
+}
+
+/* Returns the page faults counted in ST, of every kind. */
+static uint64_t
+faults (const struct procstat *st)
+{
+  uint64_t sum = 0;
+  int i;
+
+  for (i = 0; i < PROCSTAT_FAULT_CNT; i++)
+    sum += st->faults[i];
+  return sum;
+}
+
+/* Prints how run NAME went, from the ticks and statistics of WHO
+   before it, START and BEFORE, to now. */
+static void
+report (const char *name, int who, uint64_t start,
+        const struct procstat *before)
+{
+  struct procstat after;
+
+  procstat (who, &after);
+  printf ("%s: %"PRIu64" ticks, %"PRIu64" us user, %"PRIu64" us kernel, "
+          "%"PRIu64" faults, %"PRIu64" swapped in, %"PRIu64" swapped out\n",
+          name, ticks () - start,
+          (after.user_ns - before->user_ns) / 1000,
+          (after.kernel_ns - before->kernel_ns) / 1000,
+          faults (&after) - faults (before),
+          after.swap_ins - before->swap_ins,
+          after.swap_outs - before->swap_outs);
+}
+
+int
+main (int argc, char *argv[])
+{
+  pid_t children[PROC_MAX];
+  struct procstat before;
+  struct matrices *shared;
+  int proc_cnt = argc > 1 ? atoi (argv[1]) : 4;
+  uint64_t start;
+  bool ok = true;
+  int fd, i;
+
+  if (argc > 2 || proc_cnt < 1 || proc_cnt > PROC_MAX)
+    {
+      printf ("usage: matmult-tiled [PROCS], with 1 to %d PROCS\n",
+              PROC_MAX);
+      return EXIT_FAILURE;
+    }
+
+  /* One process, static arrays. */
+  procstat (PROCSTAT_SELF, &before);
+  start = ticks ();
+  init (&local);
+  multiply (&local, 0, DIM);
+  report ("tiled", PROCSTAT_SELF, start, &before);
+  if (!check (&local))
+    return EXIT_FAILURE;
+
+  /* PROC_CNT children, shared memory. */
+  fd = shm_create (sizeof *shared);
+  if (fd < 0 || mmap (fd, SHARED_ADDR) == MAP_FAILED)
+    {
+      printf ("matmult-tiled: shared memory not available\n");
+      return EXIT_FAILURE;
+    }
+  shared = SHARED_ADDR;
+  procstat (PROCSTAT_CHILDREN, &before);
+  start = ticks ();
+  init (shared);
+  for (i = 0; i < proc_cnt; i++)
+    {
+      children[i] = fork ();
+      if (children[i] == 0)
+        {
+          multiply (shared, DIM * i / proc_cnt, DIM * (i + 1) / proc_cnt);
+          exit (EXIT_SUCCESS);
+        }
+      else if (children[i] == PID_ERROR)
+        {
+          printf ("matmult-tiled: fork failed\n");
+          proc_cnt = i;
+          ok = false;
+        }
+    }
+  for (i = 0; i < proc_cnt; i++)
+    if (wait (children[i]) != EXIT_SUCCESS)
+      {
+        printf ("matmult-tiled: child %d failed\n", i);
+        ok = false;
+      }
+  report ("tiled-procs", PROCSTAT_CHILDREN, start, &before);
+  if (!ok || !check (shared))
+    return EXIT_FAILURE;
+
+  return shared->c[DIM - 1][DIM - 1];
+}
@@ -0,0 +1,23 @@
+/* mv.c
+
+   Renames the file or directory named by argv[1] to argv[2]. */
+
+#include <stdio.h>
+#include <syscall.h>
+
+int
+main (int argc, char *argv[]) 
+{
+  if (argc != 3) 
+    {
+      printf ("usage: mv OLD NEW\n");
+      return EXIT_FAILURE;
+    }
+
+  if (!rename (argv[1], argv[2]))
+    {
+      printf ("%s: rename to %s failed\n", argv[1], argv[2]);
+      return EXIT_FAILURE;
+    }
+  return EXIT_SUCCESS;
+}
@@ -1,182 +1,580 @@
 #include "cache.h"
+#include <cachestat.h>
 #include <string.h>
+#include <stdlib.h>
+#include <round.h>
 #include "inode.h"
 #include "debug.h"
 #include "filesys.h"
+#include "free-map.h"
+#include "journal.h"
 #include "devices/timer.h"
 #include "threads/thread.h"
 #include "threads/synch.h"
+#include "threads/kstat.h"
 #include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/trace.h"
+#include "threads/vaddr.h"
+#include "threads/vmalloc.h"
+#include "threads/workqueue.h"
 
 #define TIME_BETWEEN_FLUSH 30000
-/*
- * Wrapper struct to add next sectors to list of sectors to read in background. 
- */
-struct async_sector_wrapper 
+/* Percentage of dirty cache sectors that triggers an early flush. */
+#define CACHE_DIRTY_RATIO 25
+
+/* Cache table, an array of cache_num_sectors entries allocated from the
+ * kernel pool by cache_init, and the sector buffers of its entries, in
+ * the same order, in pages of their own. */
+size_t cache_num_sectors = CACHE_DEFAULT_SECTORS;
+static struct cache_sector *cache;
+static uint8_t *cache_buffers;
+static struct lock clock_lock; /* Lock to ensure only one instance of the
+                                  replacement policy runs*/
+
+enum cache_policy cache_policy = CACHE_POLICY_CLOCK;
+bool cache_protect_meta = true;
+
+/* 2Q state, guarded by clock_lock. Sectors missed for the first time go
+ * to the probationary FIFO A1IN. Sectors evicted from it are remembered
+ * by number in the ghost ring A1OUT, and a miss on one of those goes to
+ * the hot queue AM instead, so it takes a real re-reference within a
+ * while to get in. A one pass scan only ever cycles through A1IN. */
+static struct list a1in;         /* Probationary sectors, newest first. */
+static struct list am;           /* Hot sectors, newest first. */
+static size_t a1in_cnt;          /* Number of sectors in A1IN. */
+static size_t a1in_max;          /* A1IN is evicted from while over this. */
+static block_sector_t *a1out;    /* Ghost ring of sector numbers. */
+static size_t a1out_cnt;         /* Capacity of A1OUT. */
+static size_t a1out_next;        /* Where A1OUT records next. */
+static struct spinlock ra_lock;  /* Guards the read-ahead state below. */
+static size_t ra_pending;        /* Read-ahead requests in flight. */
+static size_t ra_window_max;     /* Adaptive cap on read-ahead windows. */
+static struct spinlock dirty_cnt_lock;
+static size_t dirty_cnt;         /* Number of DIRTY cache sectors. */
+
+/* The flush thread sleeps on FLUSH_WAKEUP, upped by FLUSH_TIMER or by
+ * set_dirty() crossing the dirty ratio. */
+static struct work flush_work;
+static size_t clock_hand;
+static bool journaling;          /* Whether metadata is journaled. */
+static uint32_t journal_committed; /* Newest transaction on disk. */
+static struct ihash cache_index; /* Maps disk sectors to cache sectors. */
+static bool warm_list_ok;        /* WARM_SECTOR holds a warm-up list. */
+unsigned cache_quota_pct = 0;
+static size_t quota_sectors;     /* Per-process soft quota, 0 if none. */
+static struct spinlock quota_lock; /* Guards sector users and their
+                                      cache counts. */
+static struct lock cache_index_lock; /* Guards cache_index. */
+
+/* Statistics. */
+static uint64_t read_dirty_cnt (void);
+static struct kstat_counter stat_hit = KSTAT_COUNTER ("cache.hit");
+static struct kstat_counter stat_miss = KSTAT_COUNTER ("cache.miss");
+static struct kstat_counter stat_evict = KSTAT_COUNTER ("cache.evict");
+static struct kstat_counter stat_write_back
+  = KSTAT_COUNTER ("cache.write_back");
+static struct kstat_counter stat_ra = KSTAT_COUNTER ("cache.read_ahead");
+static struct kstat_counter stat_ra_used
+  = KSTAT_COUNTER ("cache.read_ahead.used");
+static struct kstat_counter stat_ra_wasted
+  = KSTAT_COUNTER ("cache.read_ahead.wasted");
+static struct kstat_counter stat_dirty
+  = KSTAT_GAUGE ("cache.dirty", read_dirty_cnt);
+
+/* A transfer by cache_direct_io in flight. */
+struct direct_io
   {
-    block_sector_t sector_idx;
-    struct list_elem elem;
+    struct list_elem elem;        /* Element in direct_ios. */
+    block_sector_t sector_idx;    /* First sector transferred. */
+    size_t cnt;                   /* Number of sectors transferred. */
   };
 
-/* Cache table*/
-static struct cache_sector cache[CACHE_NUM_SECTORS];
-static struct lock clock_lock; /* Lock to ensure only one instance of the clock
-                                  algorithm runs*/
-static struct lock async_read_lock;
-static struct condition async_list_populated;
-static struct list async_read_list; /* List of sectors to be cached in back*/
-static int clock_hand;
+/* Direct transfers in flight, guarded by cache_index_lock. */
+static struct list direct_ios;
+static struct condition direct_io_done; /* Signaled as they finish. */
 
 
 /* Private helper functions declarations and definitions.*/
-static thread_func async_read;
-static thread_func async_flush;
-struct cache_sector *get_sector (block_sector_t sector_idx, bool is_metadata);
-struct cache_sector *sector_lookup (block_sector_t sector_idx);
-struct cache_sector* cache_sector_at (block_sector_t sector_idx, bool is_metadata);
-struct cache_sector* pick_and_evict (void);
-void write_to_disk (struct cache_sector *sect, bool wait);
+static work_func async_flush;
+struct cache_sector *get_sector (block_sector_t sector_idx, bool is_metadata,
+                                 bool exclusive);
+struct cache_sector *sector_lookup (block_sector_t sector_idx, bool exclusive);
+struct cache_sector* cache_sector_at (block_sector_t sector_idx, bool is_metadata,
+                                      bool exclusive);
+struct cache_sector* pick_and_evict (block_sector_t sector_idx,
+                                     bool is_metadata);
+static struct cache_sector *pick_clock (struct thread *user);
+static struct cache_sector *pick_2q (struct thread *user);
+static struct thread *current_user (void);
+static void charge (struct cache_sector *, bool hit);
+static void uncharge (struct cache_sector *);
+static bool is_protected (struct cache_sector *, struct thread *user,
+                          size_t *skipped);
+static void place_2q (struct cache_sector *, block_sector_t, bool);
+static bool is_evictable (struct cache_sector *, size_t *not_ready);
+void write_to_disk (struct cache_sector *sect);
 void read_from_disk (block_sector_t sector_idx, struct cache_sector *sector, 
                      bool is_metadata);
-static void read_ahead (block_sector_t sector_idx);
+static void prepare_read (block_sector_t sector_idx, struct cache_sector *sect,
+                          bool is_metadata);
+static void wait_for_io (struct cache_sector *sect);
+static void pin (struct cache_sector *sect, bool exclusive);
+static bool is_pinned (struct cache_sector *sect);
+static void unpin (struct cache_sector *sect, bool exclusive);
+static void sync_io (struct cache_sector *sect, bool is_write);
+static void write_behind (struct cache_sector *sect);
+static block_complete_func write_behind_done;
+static block_complete_func read_ahead_done;
+static void clear_dirty (struct cache_sector *sect);
+static void read_ahead_feedback (bool hit);
+static void cache_flush (block_sector_t owner, bool wait);
+static void set_dirty (struct cache_sector *sect);
+static bool over_dirty_ratio (void);
+static bool may_write_back (struct cache_sector *sect);
+static int sector_idx_compare (const void *, const void *);
+static void cache_index_insert (struct cache_sector *sect);
+static void cache_index_remove (struct cache_sector *sect);
+static bool direct_io_overlaps (block_sector_t sector_idx, size_t cnt);
 
-/* A thread function that asynchronously reads from  disk sectors added to 
- * async_read_list. */
+/* Work that writes dirty sectors behind, queued every TIME_BETWEEN_FLUSH
+ * ms, or sooner once more than CACHE_DIRTY_RATIO percent of the cache is
+ * dirty. */
 static void
-async_read (void *aux UNUSED)
+async_flush (void *aux UNUSED)
 {
-  struct list side_piece;
-  struct async_sector_wrapper *a;
-  list_init (&side_piece);
+  /* Metadata only goes in place once committed. */
+  journal_commit ();
+  cache_flush (INODE_INVALID_SECTOR, false);
+  if (over_dirty_ratio ())
+    work_queue (&flush_work);
+  else
+    work_queue_delayed (&flush_work,
+                        (int64_t) TIME_BETWEEN_FLUSH * TIMER_FREQ / 1000);
+}
 
-  for (;;)
-    {
-      lock_acquire (&async_read_lock);
-      /* Wait for list to be populated */
-      while (list_empty (&async_read_list))
-        cond_wait (&async_list_populated, &async_read_lock);
+/* Returns true if the share of dirty cache sectors is over the ratio that
+ * should queue the flush work early. */
+static bool
+over_dirty_ratio (void)
+{
+  bool over;
 
-      while (!list_empty (&async_read_list))
-        list_push_front (&side_piece, list_pop_back (&async_read_list));
+  spinlock_acquire (&dirty_cnt_lock);
+  over = dirty_cnt * 100 > cache_num_sectors * CACHE_DIRTY_RATIO;
+  spinlock_release (&dirty_cnt_lock);
+  return over;
+}
 
-      lock_release (&async_read_lock);
+/* Returns true if SECT's buffer may be written in place, which it may
+ * not while it holds metadata changes that aren't committed to the
+ * journal yet. */
+static bool
+may_write_back (struct cache_sector *sect)
+{
+  return !journaling || !sect->is_metadata
+         || sect->journal_seq <= journal_committed;
+}
 
-      while (!list_empty (&side_piece))
-        {
-          struct list_elem *e = list_pop_front (&side_piece);
-          a = list_entry (e, struct async_sector_wrapper, elem);
-          struct cache_sector *s = get_sector (a->sector_idx, false);
-
-          lock_acquire (&s->lock);
-          s->num_accessors--;
-          if (s->num_accessors == 0)
-            cond_broadcast(&s->being_accessed, &s->lock);
-          lock_release (&s->lock);
-          free (a);
-        }
+/* Marks SECT clean, taking it off the dirty ratio.
+ *
+ * NOTE: the caller of this function must hold the lock to SECT */
+static void
+clear_dirty (struct cache_sector *sect)
+{
+  ASSERT (lock_held_by_current_thread (&sect->lock));
+  ASSERT (sect->dirty_bit & DIRTY);
+  sect->dirty_bit &= ~DIRTY;
+  spinlock_acquire (&dirty_cnt_lock);
+  dirty_cnt--;
+  spinlock_release (&dirty_cnt_lock);
+}
+
+/* Marks SECT dirty, counting it towards the dirty ratio.
+ *
+ * NOTE: the caller of this function must hold the lock to SECT */
+static void
+set_dirty (struct cache_sector *sect)
+{
+  bool wake;
+
+  ASSERT (lock_held_by_current_thread (&sect->lock));
+  if (sect->dirty_bit & DIRTY)
+    return;
+  sect->dirty_bit |= DIRTY;
+  spinlock_acquire (&dirty_cnt_lock);
+  dirty_cnt++;
+  wake = dirty_cnt * 100 > cache_num_sectors * CACHE_DIRTY_RATIO
+         && (dirty_cnt - 1) * 100 <= cache_num_sectors * CACHE_DIRTY_RATIO;
+  spinlock_release (&dirty_cnt_lock);
+
+  /* Queueing the work may yield, which can't happen under a spinlock. */
+  if (wake)
+    work_queue (&flush_work);
+}
+
+/* Orders cache sector pointers by the disk sector they hold. */
+static int
+sector_idx_compare (const void *a_, const void *b_)
+{
+  const struct cache_sector *a = *(struct cache_sector * const *) a_;
+  const struct cache_sector *b = *(struct cache_sector * const *) b_;
+  return (a->sector_idx > b->sector_idx) - (a->sector_idx < b->sector_idx);
+}
+
+/* Writes every dirty cache sector last written by inode OWNER, or every
+ * dirty sector if OWNER is INODE_INVALID_SECTOR, back to disk in ascending
+ * sector order, so the disk head sweeps once across the device instead of
+ * seeking back and forth in cache slot order. The writes are queued with
+ * the block layer all at once. If WAIT, also waits for them and for write
+ * backs already in progress to finish. */
+static void
+cache_flush (block_sector_t owner, bool wait)
+{
+  struct cache_sector **dirty;
+  size_t dirty_num = 0;
+  size_t flush_num;
+
+  /* Gather a snapshot of the dirty sectors. A sector may get cleaned or
+   * replaced before we lock it, write_behind rechecks under the lock. */
+  dirty = malloc (cache_num_sectors * sizeof *dirty);
+  if (dirty != NULL)
+    {
+      for (size_t i = 0; i < cache_num_sectors; ++i)
+        if (((cache[i].dirty_bit & DIRTY) || (wait && cache[i].writing))
+            && (owner == INODE_INVALID_SECTOR || cache[i].owner == owner))
+          dirty[dirty_num++] = &cache[i];
+      qsort (dirty, dirty_num, sizeof *dirty, sector_idx_compare);
+    }
+  /* Without memory for the snapshot, fall back to flushing everything in
+   * slot order. */
+  flush_num = dirty != NULL ? dirty_num : cache_num_sectors;
+
+  for (size_t i = 0; i < flush_num; ++i)
+    {
+      struct cache_sector *sect = dirty != NULL ? dirty[i] : &cache[i];
+      lock_acquire (&sect->lock);
+      write_behind (sect);
+      lock_release (&sect->lock);
     }
+
+  if (wait)
+    for (size_t i = 0; i < flush_num; ++i)
+      {
+        struct cache_sector *sect = dirty != NULL ? dirty[i] : &cache[i];
+        lock_acquire (&sect->lock);
+        while (sect->writing)
+          cond_wait (&sect->being_written, &sect->lock);
+        lock_release (&sect->lock);
+      }
+  free (dirty);
 }
 
+/* Queues a snapshot of the contents of SECT to be written back to disk
+ * if it is dirty and ready, without waiting for the write to finish.
+ * Accessors keep using SECT meanwhile, and may dirty it again.
+ *
+ * NOTE: the caller of this function must hold the lock to SECT */
 static void
-async_flush (void *aux UNUSED)
+write_behind (struct cache_sector *sect)
 {
+  uint8_t *snapshot;
+
+  ASSERT (lock_held_by_current_thread (&sect->lock));
+  /* Let a writer finish its change so the snapshot holds all of it, and
+   * an earlier write back land, since the block layer may reorder two
+   * writes of one sector. */
   for (;;)
+    if (sect->writer)
+      cond_wait (&sect->being_accessed, &sect->lock);
+    else if (sect->writing)
+      cond_wait (&sect->being_written, &sect->lock);
+    else
+      break;
+  if (!(sect->dirty_bit & DIRTY) || sect->state != CACHE_READY
+      || !may_write_back (sect))
+    return;
+
+  snapshot = malloc (BLOCK_SECTOR_SIZE);
+  clear_dirty (sect);
+  if (snapshot == NULL)
     {
-      timer_msleep (TIME_BETWEEN_FLUSH);
-      for (int i = 0; i < CACHE_NUM_SECTORS; ++i)
-        {
-          lock_acquire (&cache[i].lock);
-          write_to_disk (&cache[i], false);
-          lock_release (&cache[i].lock);
-        }
+      /* Write the buffer itself instead. Holding the lock keeps writers
+       * from pinning SECT until the write is done. */
+      kstat_inc (&stat_write_back);
+      sync_io (sect, true);
+      return;
     }
+  memcpy (snapshot, sect->buffer, BLOCK_SECTOR_SIZE);
+  kstat_inc (&stat_write_back);
+  sect->writing = true;
+  block_request_init (&sect->io_request, sect->sector_idx, 1, snapshot,
+                      true, write_behind_done, sect);
+  block_submit (fs_device, &sect->io_request);
+}
+
+/* Completion of a write queued by write_behind. Runs in the file system
+ * device's I/O thread. */
+static void
+write_behind_done (struct block_request *r)
+{
+  struct cache_sector *sect = r->aux;
+  void *snapshot = r->buffer;
+
+  lock_acquire (&sect->lock);
+  ASSERT (sect->writing);
+  sect->writing = false;
+  cond_broadcast (&sect->being_written, &sect->lock);
+  lock_release (&sect->lock);
+  free (snapshot);
+}
+
+/* Selects the replacement policy by NAME, "clock" or "2q". Returns false
+ * if there is no such policy. Must be called before cache_init. */
+bool
+cache_set_policy (const char *name)
+{
+  if (name != NULL && !strcmp (name, "clock"))
+    cache_policy = CACHE_POLICY_CLOCK;
+  else if (name != NULL && !strcmp (name, "2q"))
+    cache_policy = CACHE_POLICY_2Q;
+  else
+    return false;
+  return true;
 }
 
-/* This function finds the next eligible cache sector to evict and returns it,
- * claiming it's lock first
+/* This function finds the next eligible cache sector to evict to make room
+ * for SECTOR_IDX and returns it, claiming it's lock first
  *
  * NOTE: The caller of this function is responsible for releasing the lock of 
  * the cache sector returned when it is done using it. */
 struct cache_sector*
-pick_and_evict ()
+pick_and_evict (block_sector_t sector_idx, bool is_metadata)
 {
   /* Critical section so thread A doesn't evict the cache sector thread B wants
    * to evict before thread B is able to set said cache sector's state to evicted. */
   lock_acquire (&clock_lock);
-  int clock_start = (++clock_hand) % CACHE_NUM_SECTORS;
-  struct cache_sector *cand = &cache[clock_start];
+  struct thread *user = current_user ();
+  struct cache_sector *cand;
 
-  while (cand->state != CACHE_READY)
+  if (cache_policy == CACHE_POLICY_2Q)
     {
-      clock_start = (++clock_hand) % CACHE_NUM_SECTORS;
-      if (clock_hand == clock_start)
-        PANIC("No READY cache sector found to evict");
-      cand = &cache[clock_start];
+      cand = pick_2q (user);
+      place_2q (cand, sector_idx, is_metadata);
     }
+  else
+    cand = pick_clock (user);
 
-  do
+  cand->state = CACHE_EVICTED;
+  uncharge (cand);
+  if (cand->sector_idx != INODE_INVALID_SECTOR)
+    kstat_inc (&stat_evict);
+  /* A prefetched sector evicted before anyone read it was wasted I/O. */
+  if (cand->dirty_bit & READ_AHEAD)
+    read_ahead_feedback (false);
+  /* Lookups must no longer find the victim under its old sector. */
+  cache_index_remove (cand);
+  lock_release (&clock_lock);
+  return cand;
+}
+
+/* Returns true if CAND could be evicted now. Otherwise counts it in
+ * *NOT_READY and, once every sector has been found busy in a row, waits
+ * for CAND's I/O to finish or its pins to be dropped. A pinned sector is
+ * never picked, since its pin may be held across cache_get of the very
+ * sector being made room for. Neither is one holding uncommitted
+ * metadata, unless every other sector is busy too.
+ *
+ * NOTE: the caller of this function must hold clock_lock */
+static bool
+is_evictable (struct cache_sector *cand, size_t *not_ready)
+{
+  bool idle = cand->state == CACHE_READY && !cand->writing
+              && !is_pinned (cand);
+
+  if (idle && (!(cand->dirty_bit & DIRTY) || may_write_back (cand)))
+    {
+      *not_ready = 0;
+      return true;
+    }
+  if (++*not_ready == cache_num_sectors)
     {
-      if (cand->state == CACHE_READY)
+      /* Rather than wait for a commit, which may in turn be waiting for
+       * the handle of the very thread evicting, write the metadata in
+       * place ahead of it. */
+      if (idle)
         {
-          if (cand->dirty_bit & ACCESSED)
-            cand->dirty_bit &= ~ACCESSED;
-          else if (cand->dirty_bit & META)
-            cand->dirty_bit &= ~META;
-          else
-            break;
+          *not_ready = 0;
+          return true;
         }
-      cand = &cache[++clock_hand % CACHE_NUM_SECTORS];
+      /* With every sector in flight, wait for this one to land. */
+      lock_acquire (&cand->lock);
+      wait_for_io (cand);
+      while (cand->writing)
+        cond_wait (&cand->being_written, &cand->lock);
+      while (is_pinned (cand))
+        cond_wait (&cand->being_accessed, &cand->lock);
+      lock_release (&cand->lock);
+      *not_ready = 0;
     }
-  while (clock_hand != clock_start);
+  return false;
+}
 
-  ASSERT (cand->state == CACHE_READY);
-  lock_acquire (&cand->lock);
-  cand->state = CACHE_EVICTED;
-  while (cand->num_accessors > 0)
-    cond_wait(&cand->being_accessed, &cand->lock);
-  lock_release (&clock_lock);
-  return cand;
+/* Returns true if CAND should be passed over to keep another process
+ * within its quota: if USER, the process making room, is at or over its
+ * soft quota and CAND is charged to another process that is within its
+ * own. Counts CAND in *SKIPPED if so, and stops protecting anything once
+ * a whole cache's worth has been skipped, so that a miss always finds a
+ * victim.
+ *
+ * NOTE: the caller of this function must hold clock_lock */
+static bool
+is_protected (struct cache_sector *cand, struct thread *user,
+              size_t *skipped)
+{
+  bool protect;
+
+  if (quota_sectors == 0 || user == NULL || *skipped >= cache_num_sectors)
+    return false;
+  spinlock_acquire (&quota_lock);
+  protect = (user->cache_cnt >= quota_sectors && cand->user != NULL
+             && cand->user != user && cand->user->cache_cnt <= quota_sectors);
+  spinlock_release (&quota_lock);
+  if (protect)
+    ++*skipped;
+  return protect;
+}
+
+/* Sweeps the clock hand around the cache, giving accessed sectors and,
+ * if cache_protect_meta, metadata sectors a second chance each, and
+ * passing over those is_protected() keeps for other processes than
+ * USER. Returns the victim locked and ready.
+ *
+ * NOTE: the caller of this function must hold clock_lock */
+static struct cache_sector *
+pick_clock (struct thread *user)
+{
+  struct cache_sector *cand;
+  size_t not_ready = 0;
+  size_t skipped = 0;
+
+  for (;;)
+    {
+      clock_hand = (clock_hand + 1) % cache_num_sectors;
+      cand = &cache[clock_hand];
+      if (!is_evictable (cand, &not_ready)
+          || is_protected (cand, user, &skipped))
+        continue;
+      if (cand->dirty_bit & ACCESSED)
+        cand->dirty_bit &= ~ACCESSED;
+      else if (cache_protect_meta && (cand->dirty_bit & META))
+        cand->dirty_bit &= ~META;
+      else
+        {
+          lock_acquire (&cand->lock);
+          /* A write back may have been queued since we looked. */
+          if (cand->state == CACHE_READY && !cand->writing
+              && !is_pinned (cand))
+            return cand;
+          lock_release (&cand->lock);
+        }
+    }
 }
 
-/* This buffer writes to disk the contents of the buffer of cache sector SECT 
+/* Picks the 2Q victim: the oldest sector of A1IN while it is over its
+ * share, otherwise the least recently used one of AM, which approximates
+ * LRU by giving accessed sectors a second chance. Passes over the sectors
+ * is_protected() keeps for other processes than USER. Returns the victim
+ * locked and ready.
+ *
+ * NOTE: the caller of this function must hold clock_lock */
+static struct cache_sector *
+pick_2q (struct thread *user)
+{
+  struct cache_sector *cand;
+  size_t not_ready = 0;
+  size_t skipped = 0;
+
+  for (;;)
+    {
+      struct list *q = a1in_cnt > a1in_max || list_empty (&am) ? &a1in : &am;
+
+      /* Rotate the tail to the head, unless it gets evicted. */
+      cand = list_entry (list_back (q), struct cache_sector, queue_elem);
+      list_remove (&cand->queue_elem);
+      list_push_front (q, &cand->queue_elem);
+      if (!is_evictable (cand, &not_ready)
+          || is_protected (cand, user, &skipped))
+        continue;
+      if (q == &am && (cand->dirty_bit & ACCESSED))
+        {
+          cand->dirty_bit &= ~ACCESSED;
+          continue;
+        }
+      lock_acquire (&cand->lock);
+      /* A write back may have been queued since we looked. */
+      if (cand->state == CACHE_READY && !cand->writing && !is_pinned (cand))
+        return cand;
+      lock_release (&cand->lock);
+    }
+}
+
+/* Moves victim CAND to the 2Q queue that SECTOR_IDX, which it is about
+ * to hold, belongs in. A sector leaving A1IN is remembered in A1OUT,
+ * unless it was prefetched and never read.
+ *
+ * NOTE: the caller of this function must hold clock_lock */
+static void
+place_2q (struct cache_sector *cand, block_sector_t sector_idx,
+          bool is_metadata)
+{
+  bool hot = is_metadata && cache_protect_meta;
+
+  if (!cand->in_am && cand->sector_idx != INODE_INVALID_SECTOR
+      && !(cand->dirty_bit & READ_AHEAD) && a1out_cnt > 0)
+    {
+      a1out[a1out_next] = cand->sector_idx;
+      a1out_next = (a1out_next + 1) % a1out_cnt;
+    }
+  for (size_t i = 0; i < a1out_cnt; ++i)
+    if (a1out[i] == sector_idx)
+      {
+        a1out[i] = INODE_INVALID_SECTOR;
+        hot = true;
+        break;
+      }
+
+  list_remove (&cand->queue_elem);
+  if (!cand->in_am)
+    a1in_cnt--;
+  cand->in_am = hot;
+  if (hot)
+    list_push_front (&am, &cand->queue_elem);
+  else
+    {
+      list_push_front (&a1in, &cand->queue_elem);
+      a1in_cnt++;
+    }
+}
+
+/* This function writes to disk the contents of the buffer of evicted
+ * cache sector SECT if it is dirty. Nobody can pin SECT meanwhile since
+ * lookups no longer find it.
  *
  * NOTE: the caller of this function must hold the lock to SECT 
  */
 void
-write_to_disk (struct cache_sector *sect, bool wait)
+write_to_disk (struct cache_sector *sect)
 {
-  /* Writing a sector to disk is a critical section, no other thread should 
-   * access this sector while it is being written to disk. */
   ASSERT (lock_held_by_current_thread(&sect->lock));
-  // TODO(kenny): Remove me before submitting
-  ASSERT (sect->state != CACHE_BEING_READ);
+  ASSERT (sect->state == CACHE_EVICTED);
+  ASSERT (!sect->writing);
   if (!(sect->dirty_bit & DIRTY))
     return;
-  if (sect->state == CACHE_READY || sect->state == CACHE_EVICTED)
-    {
-      enum cache_state og_state = sect->state;
-      /* We don't want to write to disk until accessors have finished making
-       * their changes. */
-      sect->state = CACHE_PENDING_WRITE;
-      while (sect->num_accessors > 0)
-        cond_wait(&sect->being_accessed, &sect->lock);
-
-      sect->state = CACHE_BEING_WRITTEN;
-      ASSERT (sect->sector_idx != INODE_INVALID_SECTOR);
-      block_write (fs_device, sect->sector_idx, sect->buffer);
-      
-      sect->dirty_bit &= ~DIRTY;
-      sect->state = og_state;
-      cond_broadcast (&sect->being_written, &sect->lock);
-    }
-  else if (wait)
-    {
-      /*If this cache sector is already being written to disk, it's not our problem,
-       * wait til it's finished then return */
-      while (sect->state == CACHE_BEING_WRITTEN ||
-          sect->state == CACHE_PENDING_WRITE)
-        cond_wait (&sect->being_written, &sect->lock);
-    }
+  ASSERT (sect->sector_idx != INODE_INVALID_SECTOR);
+  kstat_inc (&stat_write_back);
+  sync_io (sect, true);
+  clear_dirty (sect);
 }
 
 /* This function reads the content of the sector at SECTOR_IDX into the 
@@ -189,236 +587,897 @@ read_from_disk (block_sector_t sector_idx, struct cache_sector *sect,
     bool is_metadata)
 {
   ASSERT (sect->state != CACHE_READY)
-  /* We don't want to ovewrite what accessors are reading */
-  while (sect->num_accessors > 0)
-    cond_wait (&sect->being_accessed, &sect->lock);
+  /* Eviction only picks unpinned sectors. */
+  ASSERT (!is_pinned (sect));
 
-  ASSERT (sect->num_accessors == 0);
+  prepare_read (sector_idx, sect, is_metadata);
+  sync_io (sect, false);
+  
+  sect->state = CACHE_READY;
+  cond_broadcast (&sect->being_read, &sect->lock);
+}
+
+/* Readies SECT, which must be clean and have no accessors, to receive
+ * the contents of the sector at SECTOR_IDX. Lookups for the sector wait
+ * until the read completes.
+ *
+ * NOTE: The caller of this function must be holding the lock to SECT */
+static void
+prepare_read (block_sector_t sector_idx, struct cache_sector *sect,
+              bool is_metadata)
+{
+  ASSERT (lock_held_by_current_thread (&sect->lock));
+  ASSERT (!(sect->dirty_bit & DIRTY));
+  ASSERT (sector_idx != INODE_INVALID_SECTOR);
 
   sect->state = CACHE_BEING_READ;
   sect->sector_idx = sector_idx;
   sect->dirty_bit = CLEAN;
   sect->is_metadata = is_metadata;
+  sect->hits = 0;
+  /* Index before reading so concurrent lookups wait for the read instead
+     of caching a second copy of the sector. */
+  cache_index_insert (sect);
+}
 
-  ASSERT (sect->sector_idx != INODE_INVALID_SECTOR);
-  block_read (fs_device, sector_idx, sect->buffer);
-  
-  sect->state = CACHE_READY;
-  cond_broadcast (&sect->being_read, &sect->lock);
+/* Reads or writes SECT's buffer from or to its sector on disk, queueing
+ * the transfer with the rest of the file system device's traffic and
+ * waiting for it.
+ *
+ * NOTE: The caller of this function must be holding the lock to SECT */
+static void
+sync_io (struct cache_sector *sect, bool is_write)
+{
+  block_request_init (&sect->io_request, sect->sector_idx, 1, sect->buffer,
+                      is_write, NULL, NULL);
+  block_submit (fs_device, &sect->io_request);
+  block_wait (&sect->io_request);
+}
+
+/* Waits until SECT has no read in progress. A write back in progress
+ * doesn't matter, it writes from a snapshot.
+ *
+ * NOTE: The caller of this function must be holding the lock to SECT */
+static void
+wait_for_io (struct cache_sector *sect)
+{
+  ASSERT (lock_held_by_current_thread (&sect->lock));
+  while (sect->state == CACHE_BEING_READ)
+    cond_wait (&sect->being_read, &sect->lock);
+}
+
+/* Pins the buffer of SECT, shared for reading it or EXCLUSIVE for
+ * writing it. Shared pins exclude an exclusive one, and eviction waits
+ * for all pins to be dropped.
+ *
+ * NOTE: The caller of this function must be holding the lock to SECT and
+ * have checked that the pin doesn't conflict with others */
+static void
+pin (struct cache_sector *sect, bool exclusive)
+{
+  ASSERT (lock_held_by_current_thread (&sect->lock));
+  ASSERT (!sect->writer && (!exclusive || sect->readers == 0));
+  if (exclusive)
+    sect->writer = true;
+  else
+    sect->readers++;
+}
+
+/* Returns true if SECT is pinned, shared or exclusive. Only reliable
+ * while holding the lock to SECT. */
+static bool
+is_pinned (struct cache_sector *sect)
+{
+  return sect->readers > 0 || sect->writer;
+}
+
+/* Drops a pin taken by pin, waking up whoever waits for SECT to be
+ * unpinned.
+ *
+ * NOTE: The caller of this function must be holding the lock to SECT */
+static void
+unpin (struct cache_sector *sect, bool exclusive)
+{
+  ASSERT (lock_held_by_current_thread (&sect->lock));
+  if (exclusive)
+    {
+      ASSERT (sect->writer);
+      sect->writer = false;
+    }
+  else
+    {
+      ASSERT (sect->readers > 0);
+      sect->readers--;
+    }
+  if (exclusive || sect->readers == 0)
+    cond_broadcast (&sect->being_accessed, &sect->lock);
 }
 
 /* This function caches the sector at SECTOR_IDX, evicting a cache sector if 
- * necessary
+ * necessary, and returns it pinned, EXCLUSIVE or shared
  *
- * NOTE: The caller of this function is responsible for decrementing the
- * NUM_ACCESSORS of the cache sector returned when it is done using it. */
+ * NOTE: The caller of this function is responsible for unpinning the
+ * cache sector returned when it is done using it. */
 struct cache_sector*
-cache_sector_at (block_sector_t sector_idx,  bool is_metadata)
+cache_sector_at (block_sector_t sector_idx,  bool is_metadata, bool exclusive)
 {
-  struct cache_sector *sect = pick_and_evict();
-  write_to_disk (sect, true);
+  struct cache_sector *sect = pick_and_evict (sector_idx, is_metadata);
+  write_to_disk (sect);
 
   // read from disk
   read_from_disk (sector_idx, sect, is_metadata);
-  sect->num_accessors++;
+  pin (sect, exclusive);
   lock_release (&sect->lock);
 
   return sect;
 }
 
 /* This function checks if there exists a ready cache sect associated with
- * the sector at SECTOR_IDX, returns it if it exists, NULL otherwise. 
+ * the sector at SECTOR_IDX, returns it pinned, EXCLUSIVE or shared, if it
+ * exists, NULL otherwise. 
  * 
- * NOTE: The caller of this function is responsible for decrementing the
- * NUM_ACCESSORS of the cache sector returned when it is done using it. */
+ * NOTE: The caller of this function is responsible for unpinning the
+ * cache sector returned when it is done using it. */
 struct cache_sector*
-sector_lookup (block_sector_t sector_idx)
+sector_lookup (block_sector_t sector_idx, bool exclusive)
 {
-  for (int i = 0; i < CACHE_NUM_SECTORS; ++i)
+  struct hash_elem *e;
+  struct cache_sector *cand;
+
+  lock_acquire (&cache_index_lock);
+  e = ihash_find (&cache_index, sector_idx);
+  cand = e != NULL ? hash_entry (e, struct cache_index_entry, hash_elem)->sect
+                   : NULL;
+  lock_release (&cache_index_lock);
+  if (cand == NULL)
+    return NULL;
+
+  /* Critical point so this cache sector isn't evicted before we declare
+   * we're accessing it. */
+  lock_acquire (&cand->lock);
+  for (;;)
     {
-      struct cache_sector *cand = &cache[i];
-      if (cand->sector_idx == sector_idx)
+      /* Let a read in progress finish instead of reading a stale copy. */
+      wait_for_io (cand);
+      if (cand->sector_idx != sector_idx || cand->state != CACHE_READY)
         {
-          /* A cache sector that is not ready or actively being read has been evicted*/
-          if (cand->state != CACHE_READY && cand->state != CACHE_BEING_READ)
-            continue;
-          /* Critical point so this cahce sector's lock isn't 
-           * evicted before we declare we're accessing it*/
-          lock_acquire (&cand->lock);
-          //if (cand->state == CACHE_BEING_READ)
-          //  cond_wait (&cand->being_read, &cand->lock);
-          if (cand->sector_idx == sector_idx)
-            {
-              ASSERT (cand->state == CACHE_READY);
-              cand->num_accessors++;
-              lock_release (&cand->lock);
-              return cand;
-            }
-          else
-            {
-              /* This cache sector was replaced between our finding it and the
-               * acquirance of its lock*/
-              lock_release (&cand->lock);
-              return NULL;
-            }
-
+          /* This cache sector was replaced between our finding it and the
+           * acquirance of its lock*/
+          lock_release (&cand->lock);
+          return NULL;
         }
+      if (!cand->writer && (!exclusive || cand->readers == 0))
+        break;
+      cond_wait (&cand->being_accessed, &cand->lock);
     }
-    return NULL;
+  pin (cand, exclusive);
+  lock_release (&cand->lock);
+  return cand;
+}
+
+/* Adds SECT to the cache index under its current sector_idx. If another
+ * cache sector is already indexed for that sector, SECT is left out.
+ *
+ * NOTE: the caller of this function must hold the lock to SECT */
+static void
+cache_index_insert (struct cache_sector *sect)
+{
+  ASSERT (lock_held_by_current_thread (&sect->lock));
+  ASSERT (sect->index.sector_idx == INODE_INVALID_SECTOR);
+
+  lock_acquire (&cache_index_lock);
+  /* Don't read a sector while a direct transfer of it is in flight. */
+  while (direct_io_overlaps (sect->sector_idx, 1))
+    cond_wait (&direct_io_done, &cache_index_lock);
+  sect->index.sector_idx = sect->sector_idx;
+  if (!ihash_insert (&cache_index, sect->sector_idx, &sect->index.hash_elem))
+    sect->index.sector_idx = INODE_INVALID_SECTOR;
+  lock_release (&cache_index_lock);
+}
+
+/* Removes SECT from the cache index if it is indexed.
+ *
+ * NOTE: the caller of this function must hold the lock to SECT */
+static void
+cache_index_remove (struct cache_sector *sect)
+{
+  ASSERT (lock_held_by_current_thread (&sect->lock));
+
+  lock_acquire (&cache_index_lock);
+  if (sect->index.sector_idx != INODE_INVALID_SECTOR)
+    {
+      ihash_delete (&cache_index, sect->index.sector_idx);
+      sect->index.sector_idx = INODE_INVALID_SECTOR;
+    }
+  lock_release (&cache_index_lock);
 }
 
 /* This function returns a cache sector that holds disk sector at sector_idx
- * If such a sector does not exist, it caches it. */
+ * pinned, EXCLUSIVE or shared. If such a sector does not exist, it caches
+ * it. */
 struct cache_sector*
-get_sector (block_sector_t sector_idx, bool is_metadata)
+get_sector (block_sector_t sector_idx, bool is_metadata, bool exclusive)
 {
-  struct cache_sector *sect = sector_lookup (sector_idx);
-  if (sect == NULL)
-    sect = cache_sector_at (sector_idx, is_metadata);
+  struct cache_sector *sect = sector_lookup (sector_idx, exclusive);
+  bool hit = sect != NULL;
+  if (hit)
+    {
+      TRACE (TRACE_CACHE_HIT, sector_idx, is_metadata);
+      kstat_inc (&stat_hit);
+    }
+  else
+    {
+      TRACE (TRACE_CACHE_MISS, sector_idx, is_metadata);
+      kstat_inc (&stat_miss);
+      sect = cache_sector_at (sector_idx, is_metadata, exclusive);
+    }
+  charge (sect, hit);
 
   lock_acquire (&sect->lock);
+  if (sect->dirty_bit & READ_AHEAD)
+    {
+      sect->dirty_bit &= ~READ_AHEAD;
+      read_ahead_feedback (true);
+    }
   sect->dirty_bit |= ACCESSED;
+  sect->hits++;
   if (is_metadata)
-    sect->dirty_bit |= META;
+    {
+      sect->dirty_bit |= META;
+      sect->is_metadata = true;
+    }
   lock_release (&sect->lock);
   return sect;
 }
 
-/* This function adds sector_idx to the list of sectors to be read in
- * the background. */
+/* Returns the user process the running thread uses the cache for, or
+ * NULL for a kernel thread or a process done with its address space. */
+static struct thread *
+current_user (void)
+{
+  struct thread *p = thread_current ()->process;
+  return p->pagedir != NULL ? p : NULL;
+}
+
+/* Charges SECT to the user process running, if any, as the last one to
+ * look it up, and counts the lookup as a HIT or a miss. Prefetched
+ * sectors are charged to nobody until they are first looked up. */
+static void
+charge (struct cache_sector *sect, bool hit)
+{
+  struct thread *user = current_user ();
+
+  spinlock_acquire (&quota_lock);
+  if (sect->user != user)
+    {
+      if (sect->user != NULL)
+        sect->user->cache_cnt--;
+      if (user != NULL)
+        user->cache_cnt++;
+      sect->user = user;
+    }
+  if (user != NULL && hit)
+    user->cache_hits++;
+  else if (user != NULL)
+    user->cache_misses++;
+  spinlock_release (&quota_lock);
+}
+
+/* Drops the charge for SECT, which is being evicted. */
 static void
-read_ahead (block_sector_t sector_idx)
+uncharge (struct cache_sector *sect)
 {
-  if (sector_idx == INODE_INVALID_SECTOR) return;
+  spinlock_acquire (&quota_lock);
+  if (sect->user != NULL)
+    sect->user->cache_cnt--;
+  sect->user = NULL;
+  spinlock_release (&quota_lock);
+}
+
+/* This function starts reading SECTOR_IDX into the cache in the background
+ * unless it is already cached. Returns false if too many read-ahead
+ * requests are already in flight, in which case the caller should stop
+ * issuing read-ahead for now. */
+bool
+cache_read_ahead (block_sector_t sector_idx)
+{
+  struct cache_sector *sect;
+  bool cached;
+
+  if (sector_idx == INODE_INVALID_SECTOR) return true;
+
+  /* Don't queue sectors that are already cached. */
+  lock_acquire (&cache_index_lock);
+  cached = ihash_find (&cache_index, sector_idx) != NULL;
+  lock_release (&cache_index_lock);
+  if (cached)
+    return true;
 
-  lock_acquire (&async_read_lock);
-  struct async_sector_wrapper *a = malloc (sizeof (struct async_sector_wrapper));
-  if (a != NULL)
+  spinlock_acquire (&ra_lock);
+  /* Throttle: more than two windows in flight means the disk is behind. */
+  if (ra_pending >= 2 * ra_window_max)
     {
-      a->sector_idx = sector_idx;
-      list_push_back (&async_read_list, &a->elem);
-      cond_broadcast (&async_list_populated, &async_read_lock);
+      spinlock_release (&ra_lock);
+      return false;
     }
-  lock_release (&async_read_lock);
+  ra_pending++;
+  spinlock_release (&ra_lock);
+  kstat_inc (&stat_ra);
 
+  /* Prefetched sectors aren't marked ACCESSED, so the clock still evicts
+   * them first if nobody ends up reading them. */
+  sect = pick_and_evict (sector_idx, false);
+  write_to_disk (sect);
+  prepare_read (sector_idx, sect, false);
+  sect->dirty_bit = READ_AHEAD;
+  block_request_init (&sect->io_request, sector_idx, 1, sect->buffer, false,
+                      read_ahead_done, sect);
+  lock_release (&sect->lock);
+  block_submit (fs_device, &sect->io_request);
+  return true;
 }
 
+/* Completion of a read queued by cache_read_ahead. Runs in the file system
+ * device's I/O thread. */
 static void
-cache_direct_io_at (block_sector_t sector_idx, void *buffer,
-                          off_t offset, off_t size, bool is_write)
+read_ahead_done (struct block_request *r)
 {
-  uint8_t *bounce =  malloc (BLOCK_SECTOR_SIZE);
-  if (bounce == NULL) return;
-  if (is_write)
-  {
-    if (offset == 0 && size == BLOCK_SECTOR_SIZE)
+  struct cache_sector *sect = r->aux;
+
+  lock_acquire (&sect->lock);
+  ASSERT (sect->state == CACHE_BEING_READ);
+  sect->state = CACHE_READY;
+  cond_broadcast (&sect->being_read, &sect->lock);
+  lock_release (&sect->lock);
+
+  spinlock_acquire (&ra_lock);
+  ra_pending--;
+  spinlock_release (&ra_lock);
+}
+
+/* Returns the largest read-ahead window, in sectors, a sequential reader
+ * should currently use. Shrinks while prefetched sectors are being evicted
+ * unread and grows back as they get used. */
+size_t
+cache_read_ahead_window (void)
+{
+  size_t window;
+
+  spinlock_acquire (&ra_lock);
+  window = ra_window_max;
+  spinlock_release (&ra_lock);
+  return window;
+}
+
+/* Adjusts the read-ahead window cap after a prefetched sector was either
+ * read (HIT) or evicted unread. */
+static void
+read_ahead_feedback (bool hit)
+{
+  size_t limit = cache_num_sectors / 4 < CACHE_RA_MAX_WINDOW ?
+                 cache_num_sectors / 4 : CACHE_RA_MAX_WINDOW;
+
+  kstat_inc (hit ? &stat_ra_used : &stat_ra_wasted);
+  spinlock_acquire (&ra_lock);
+  if (hit && ra_window_max < limit)
+    ra_window_max++;
+  else if (!hit)
+    ra_window_max = ra_window_max / 2 > CACHE_RA_MIN_WINDOW ?
+                    ra_window_max / 2 : CACHE_RA_MIN_WINDOW;
+  spinlock_release (&ra_lock);
+}
+
+/* Returns the number of dirty cache sectors, for the cache.dirty
+ * statistic. */
+static uint64_t
+read_dirty_cnt (void)
+{
+  size_t cnt;
+
+  spinlock_acquire (&dirty_cnt_lock);
+  cnt = dirty_cnt;
+  spinlock_release (&dirty_cnt_lock);
+  return cnt;
+}
+
+/* Returns true if a direct transfer in flight overlaps the CNT sectors
+ * starting at SECTOR_IDX.
+ *
+ * NOTE: the caller of this function must hold cache_index_lock */
+static bool
+direct_io_overlaps (block_sector_t sector_idx, size_t cnt)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&direct_ios); e != list_end (&direct_ios);
+       e = list_next (e))
     {
-      /* Write full sector directly to disk. */
-      block_write (fs_device, sector_idx, buffer);
+      struct direct_io *d = list_entry (e, struct direct_io, elem);
+      if (sector_idx < d->sector_idx + d->cnt
+          && d->sector_idx < sector_idx + cnt)
+        return true;
     }
-    else 
+  return false;
+}
+
+/* Reads or writes the CNT sectors starting at SECTOR_IDX directly between
+ * the disk and BUFFER, bypassing the cache so that streaming transfers
+ * don't evict everyone else's sectors. CNT must be at most
+ * CACHE_DIRECT_MAX. Returns false without doing anything if any of the
+ * sectors is cached, since the cached copy must be used instead, or if
+ * out of memory.
+ *
+ * Lookups that would cache one of the sectors meanwhile wait until the
+ * transfer is done, so the cache never holds a stale copy. */
+bool
+cache_direct_io (block_sector_t sector_idx, size_t cnt, void *buffer,
+                 bool is_write)
+{
+  struct block_request r;
+  struct direct_io d;
+  uint8_t *bounce = NULL;
+  uint8_t *io_buffer = buffer;
+
+  ASSERT (cnt > 0 && cnt <= CACHE_DIRECT_MAX);
+
+  /* User memory can't be accessed by the I/O thread, so it goes through
+     a kernel page. Kernel memory, such as a frame being paged in, is
+     transferred in place. */
+  if (is_user_vaddr (buffer))
     {
-      block_read (fs_device, sector_idx, bounce);
-      memcpy (bounce + offset , buffer, size);
-      block_write (fs_device, sector_idx, bounce);
+      bounce = io_buffer = palloc_get_page (0);
+      if (bounce == NULL)
+        return false;
     }
-  }
-  else
-  {
-    if (offset == 0 && size == BLOCK_SECTOR_SIZE)
-      {
-        /* Read full sector directly into caller's buffer. */
-        block_read (fs_device, sector_idx, buffer);
-      }
-    else 
-      {
-        /* Read sector into bounce buffer, then partially copy
-           into caller's buffer. */
-        block_read (fs_device, sector_idx, bounce);
-        memcpy (buffer, bounce + offset, size);
-      }
-  }
-  free (bounce);
+
+  lock_acquire (&cache_index_lock);
+  for (size_t i = 0; i < cnt; ++i)
+    {
+      if (ihash_find (&cache_index, sector_idx + i) != NULL)
+        {
+          lock_release (&cache_index_lock);
+          palloc_free_page (bounce);
+          return false;
+        }
+    }
+  /* The block layer may reorder two transfers of the same sector. */
+  while (direct_io_overlaps (sector_idx, cnt))
+    cond_wait (&direct_io_done, &cache_index_lock);
+  d.sector_idx = sector_idx;
+  d.cnt = cnt;
+  list_push_back (&direct_ios, &d.elem);
+  lock_release (&cache_index_lock);
+
+  if (is_write && bounce != NULL)
+    memcpy (bounce, buffer, cnt * BLOCK_SECTOR_SIZE);
+  block_request_init (&r, sector_idx, cnt, io_buffer, is_write, NULL, NULL);
+  block_submit (fs_device, &r);
+  block_wait (&r);
+  if (!is_write && bounce != NULL)
+    memcpy (buffer, bounce, cnt * BLOCK_SECTOR_SIZE);
+
+  lock_acquire (&cache_index_lock);
+  list_remove (&d.elem);
+  cond_broadcast (&direct_io_done, &cache_index_lock);
+  lock_release (&cache_index_lock);
+  palloc_free_page (bounce);
+  return true;
+}
+
+/* Returns the BLOCK_SECTOR_SIZE byte buffer caching the sector at
+ * SECTOR_IDX, caching it first if needed, so the caller can use it in
+ * place. The buffer stays pinned until passed to cache_put. FOR_WRITE
+ * pins it exclusive and marks it dirty on behalf of inode OWNER, so the
+ * caller may modify it; otherwise the caller must only read it and OWNER
+ * is ignored.
+ *
+ * NOTE: A caller holding a pin must not wait for another thread that may
+ * need the same sector pinned in a conflicting way */
+void *
+cache_get (block_sector_t sector_idx, block_sector_t owner, bool is_metadata,
+           bool for_write)
+{
+  struct cache_sector *sect = get_sector (sector_idx, is_metadata, for_write);
+
+  ASSERT (sect->state == CACHE_READY);
+  ASSERT (sect->sector_idx == sector_idx);
+  ASSERT (for_write ? sect->writer : sect->readers > 0);
+
+  if (for_write)
+    {
+      lock_acquire (&sect->lock);
+      set_dirty (sect);
+      sect->owner = owner;
+      sect->journal_seq = CACHE_UNLOGGED;
+      lock_release (&sect->lock);
+    }
+  return sect->buffer;
+}
+
+/* Unpins BUFFER, returned by cache_get with the same FOR_WRITE. */
+void
+cache_put (void *buffer, bool for_write)
+{
+  size_t slot = ((uint8_t *) buffer - cache_buffers) / BLOCK_SECTOR_SIZE;
+  struct cache_sector *sect = &cache[slot];
+
+  ASSERT (slot < cache_num_sectors);
+
+  lock_acquire (&sect->lock);
+  unpin (sect, for_write);
+  lock_release (&sect->lock);
 }
 
 /* Performs IO of SIZE bytes between cache sector for dist sector at SECTOR_IDX 
  * and buffer BUFFER. caches the disk sector if it is not already cached 
- * returns the number of bytes it successfully IOs */
+ * returns the number of bytes it successfully IOs. Writes are done on
+ * behalf of inode OWNER. */
 void
-cache_io_at (block_sector_t sector_idx, void *buffer, 
+cache_io_at (block_sector_t sector_idx, block_sector_t owner, void *buffer,
     bool is_metadata, off_t offset, off_t size, bool is_write)
 {
-  struct cache_sector *sect = get_sector (sector_idx, is_metadata);
+  uint8_t *cached = cache_get (sector_idx, owner, is_metadata, is_write);
 
   ASSERT (offset + size <= BLOCK_SECTOR_SIZE);
-  ASSERT (sect->state == CACHE_READY);
-  ASSERT (sect->sector_idx == sector_idx);
-  ASSERT (sect->num_accessors > 0);
 
   if (!is_write)
-    memcpy (buffer, sect->buffer + offset, size);
+    memcpy (buffer, cached + offset, size);
   else
-    {
-      sect->dirty_bit |= DIRTY;
-      memcpy (sect->buffer + offset, buffer, size);
-    }
+    memcpy (cached + offset, buffer, size);
 
-  lock_acquire (&sect->lock);
-  sect->num_accessors--;
-  if (sect->num_accessors == 0)
-    cond_broadcast(&sect->being_accessed, &sect->lock);
-  lock_release (&sect->lock);
-  return;
+  cache_put (cached, is_write);
+}
+
+/* Returns true if the sector at SECTOR_IDX is cached and its SIZE bytes at
+ * OFFSET are the same as those of BUFFER. Never does I/O, so false may
+ * just mean the sector isn't cached. */
+bool
+cache_matches (block_sector_t sector_idx, const void *buffer, off_t offset,
+               off_t size)
+{
+  struct cache_sector *sect = sector_lookup (sector_idx, false);
+  bool match;
+
+  ASSERT (offset + size <= BLOCK_SECTOR_SIZE);
+
+  if (sect == NULL)
+    return false;
+  match = memcmp (sect->buffer + offset, buffer, size) == 0;
+  cache_put (sect->buffer, false);
+  return match;
 }
 
-/* This function solely serves to ensure backward compatibility with existing code*/
+/* Writes the dirty cache sectors last written by inode OWNER to disk and
+ * waits for them. */
 void
-cache_io_at_ (block_sector_t sector_idx, void *buffer, bool is_metadata,
-              off_t offset, off_t size, bool is_write,
-              block_sector_t sector_next)
+cache_sync (block_sector_t owner)
 {
-  cache_io_at (sector_idx, buffer, is_metadata, offset, size, is_write);
-  //read_ahead (sector_next);
+  ASSERT (owner != INODE_INVALID_SECTOR);
+  cache_flush (owner, true);
 }
+
 /* Writes all dirty cache sectors to disk */
 void
 cache_write_all (void)
 {
-  for (int i = 0; i < CACHE_NUM_SECTORS; ++i)
+  cache_flush (INODE_INVALID_SECTOR, true);
+}
+
+/* Starts holding metadata sectors out of place until the journal has
+ * committed them, COMMITTED_SEQ being the newest transaction already on
+ * disk. */
+void
+cache_journal_start (uint32_t committed_seq)
+{
+  journal_committed = committed_seq;
+  journaling = true;
+}
+
+/* Copies every dirty metadata sector, and every one on its way to disk,
+ * into IMAGES, storing their sector numbers in SECTORS, and records them
+ * as logged by transaction SEQ. Returns how many there were, which must
+ * be at most MAX. The caller must keep metadata from changing
+ * meanwhile. */
+size_t
+cache_journal_snapshot (uint32_t seq, block_sector_t *sectors, void *images,
+                        size_t max)
+{
+  size_t cnt = 0;
+
+  for (size_t i = 0; i < cache_num_sectors; ++i)
     {
-      lock_acquire (&cache[i].lock);
-      write_to_disk (&cache[i], true);
-      lock_release (&cache[i].lock);
+      struct cache_sector *sect = &cache[i];
+
+      lock_acquire (&sect->lock);
+      if (sect->is_metadata && ((sect->dirty_bit & DIRTY) || sect->writing))
+        {
+          ASSERT (cnt < max);
+          ASSERT (!sect->writer);
+          sectors[cnt] = sect->sector_idx;
+          memcpy ((uint8_t *) images + cnt * BLOCK_SECTOR_SIZE, sect->buffer,
+                  BLOCK_SECTOR_SIZE);
+          sect->journal_seq = seq;
+          cnt++;
+        }
+      lock_release (&sect->lock);
     }
+  return cnt;
+}
+
+/* Lets metadata sectors logged by transaction SEQ or earlier be written
+ * in place, now that SEQ is on disk. */
+void
+cache_journal_committed (uint32_t seq)
+{
+  journal_committed = seq;
 }
 
 bool
 cache_init (void)
 {
-  clock_hand = CACHE_NUM_SECTORS - 1;
+  if (cache_num_sectors < CACHE_MIN_SECTORS)
+    cache_num_sectors = CACHE_MIN_SECTORS;
+  cache = vcalloc (cache_num_sectors, sizeof *cache);
+  cache_buffers = palloc_get_multiple (0, DIV_ROUND_UP (cache_num_sectors
+                                                        * BLOCK_SECTOR_SIZE,
+                                                        PGSIZE));
+  if (cache == NULL || cache_buffers == NULL)
+    return false;
+
+  clock_hand = cache_num_sectors - 1;
   lock_init (&clock_lock);
-  lock_init (&async_read_lock);
-  cond_init (&async_list_populated);
-  list_init (&async_read_list);
+  spinlock_init (&ra_lock);
+  ra_pending = 0;
+  ra_window_max = cache_num_sectors / 4 < CACHE_RA_MAX_WINDOW ?
+                  cache_num_sectors / 4 : CACHE_RA_MAX_WINDOW;
+  spinlock_init (&dirty_cnt_lock);
+  dirty_cnt = 0;
+  spinlock_init (&quota_lock);
+  quota_sectors = cache_num_sectors * cache_quota_pct / 100;
+  work_init (&flush_work, async_flush, NULL, WORK_PRI_DEFAULT);
+  lock_init (&cache_index_lock);
+  list_init (&direct_ios);
+  cond_init (&direct_io_done);
+  if (!ihash_init (&cache_index, cache_num_sectors))
+    return false;
+
+  /* 2Q sizes from the paper: A1IN a quarter of the cache, A1OUT
+   * remembering half as many sectors as the cache holds. */
+  list_init (&a1in);
+  list_init (&am);
+  a1in_cnt = 0;
+  a1in_max = cache_num_sectors / 4;
+  a1out_cnt = 0;
+  a1out_next = 0;
+  if (cache_policy == CACHE_POLICY_2Q)
+    {
+      a1out_cnt = cache_num_sectors / 2;
+      a1out = malloc (a1out_cnt * sizeof *a1out);
+      if (a1out == NULL)
+        return false;
+      for (size_t i = 0; i < a1out_cnt; ++i)
+        a1out[i] = INODE_INVALID_SECTOR;
+    }
 
-  for (int i = 0; i < CACHE_NUM_SECTORS; ++i)
+  for (size_t i = 0; i < cache_num_sectors; ++i)
     {
-      cache[i].num_accessors = 0;
+      cache[i].buffer = cache_buffers + i * BLOCK_SECTOR_SIZE;
+      cache[i].readers = 0;
+      cache[i].writer = false;
+      cache[i].writing = false;
       cache[i].sector_idx = INODE_INVALID_SECTOR;
+      cache[i].owner = INODE_INVALID_SECTOR;
       cache[i].is_metadata = false;
+      cache[i].journal_seq = CACHE_UNLOGGED;
       cache[i].dirty_bit = CLEAN;
       cache[i].state = CACHE_READY;
       lock_init(&cache[i].lock);
       cond_init (&cache[i].being_accessed);
       cond_init (&cache[i].being_read);
       cond_init (&cache[i].being_written);
+      cache[i].index.sector_idx = INODE_INVALID_SECTOR;
+      cache[i].index.sect = &cache[i];
+      cache[i].in_am = false;
+      cache[i].hits = 0;
+      cache[i].user = NULL;
+      list_push_back (&a1in, &cache[i].queue_elem);
+      a1in_cnt++;
     }
 
-  if (thread_create ("cache_async_read", PRI_DEFAULT, async_read, NULL)
-      == TID_ERROR) return false;
-
-  if (thread_create ("cache_async_write", PRI_DEFAULT, async_flush, NULL)
-      == TID_ERROR) return false;
+  kstat_register (&stat_hit);
+  kstat_register (&stat_miss);
+  kstat_register (&stat_evict);
+  kstat_register (&stat_write_back);
+  kstat_register (&stat_ra);
+  kstat_register (&stat_ra_used);
+  kstat_register (&stat_ra_wasted);
+  kstat_register (&stat_dirty);
 
+  work_queue_delayed (&flush_work,
+                      (int64_t) TIME_BETWEEN_FLUSH * TIMER_FREQ / 1000);
   return true;
 }
+
+/* Identifies the warm-up list at WARM_SECTOR. */
+#define CACHE_WARM_MAGIC 0x4d524157
+
+/* Most sectors the warm-up list records. */
+#define CACHE_WARM_MAX 126
+
+/* On-disk list of the sectors that were hottest in the cache when the
+ * file system was last shut down, in ascending order.
+ * Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+struct cache_warm_list
+  {
+    uint32_t magic;               /* CACHE_WARM_MAGIC. */
+    uint32_t cnt;                 /* Number of SECTORS in use. */
+    block_sector_t sectors[CACHE_WARM_MAX];
+  };
+
+/* Work prefetching the warm-up list, and the index in it of the next
+ * sector to prefetch. */
+static struct work warm_work;
+static uint32_t warm_next;
+
+/* A cached sector and how often it was looked up. */
+struct hot_sector
+  {
+    block_sector_t sector_idx;
+    unsigned hits;
+  };
+
+/* Orders hot sectors by descending hits. */
+static int
+hotter (const void *a_, const void *b_)
+{
+  const struct hot_sector *a = a_, *b = b_;
+  return a->hits < b->hits ? 1 : a->hits > b->hits ? -1 : 0;
+}
+
+/* Orders sector numbers ascending. */
+static int
+sector_cmp (const void *a_, const void *b_)
+{
+  const block_sector_t *a = a_, *b = b_;
+  return *a < *b ? -1 : *a > *b;
+}
+
+/* Work that prefetches the sectors of warm-up list LIST from WARM_NEXT
+ * on, then frees it. Runs in the background so that booting doesn't
+ * wait for it. */
+static void
+warm_up (void *list_)
+{
+  struct cache_warm_list *list = list_;
+
+  for (; warm_next < list->cnt; warm_next++)
+    {
+      if (list->sectors[warm_next] >= block_size (fs_device))
+        break;
+      /* Let reads in flight drain rather than dropping the rest. */
+      if (!cache_read_ahead (list->sectors[warm_next]))
+        {
+          work_queue_delayed (&warm_work, 1);
+          return;
+        }
+    }
+  free (list);
+}
+
+/* Starts reading the sectors that were hot at the last shutdown back
+ * into the cache in the background, in ascending order so that the
+ * device merges runs of them into single transfers. Does nothing, and
+ * leaves WARM_SECTOR alone at shutdown too, if the file system predates
+ * warm-up lists. */
+void
+cache_warm_up (void)
+{
+  struct cache_warm_list *list;
+
+  ASSERT (sizeof *list == BLOCK_SECTOR_SIZE);
+  list = malloc (sizeof *list);
+  if (list == NULL)
+    return;
+  block_read (fs_device, WARM_SECTOR, list);
+  warm_list_ok = list->magic == CACHE_WARM_MAGIC;
+  if (!warm_list_ok || list->cnt == 0 || list->cnt > CACHE_WARM_MAX)
+    {
+      free (list);
+      return;
+    }
+  /* No more than half the cache, or warming up would evict itself. */
+  if (list->cnt > cache_num_sectors / 2)
+    list->cnt = cache_num_sectors / 2;
+  work_init (&warm_work, warm_up, list, WORK_PRI_LOW);
+  work_queue (&warm_work);
+}
+
+/* Writes an empty warm-up list to WARM_SECTOR, for a newly formatted
+ * file system. */
+void
+cache_create_warm (void)
+{
+  static struct cache_warm_list list;
+
+  list.magic = CACHE_WARM_MAGIC;
+  list.cnt = 0;
+  block_write (fs_device, WARM_SECTOR, &list);
+  warm_list_ok = true;
+}
+
+/* Records the sectors looked up most often since they were read into
+ * the cache, and more than once, in the warm-up list for the next boot
+ * to prefetch, unless the file system has no warm-up list. */
+void
+cache_save_warm (void)
+{
+  struct cache_warm_list *list;
+  struct hot_sector *hot;
+  size_t hot_cnt = 0;
+
+  if (!warm_list_ok)
+    return;
+  list = calloc (1, sizeof *list);
+  hot = malloc (cache_num_sectors * sizeof *hot);
+  if (list == NULL || hot == NULL)
+    goto done;
+
+  for (size_t i = 0; i < cache_num_sectors; i++)
+    {
+      struct cache_sector *sect = &cache[i];
+
+      lock_acquire (&sect->lock);
+      if (sect->state == CACHE_READY && sect->sector_idx != INODE_INVALID_SECTOR
+          && sect->hits > 1)
+        {
+          hot[hot_cnt].sector_idx = sect->sector_idx;
+          hot[hot_cnt].hits = sect->hits;
+          hot_cnt++;
+        }
+      lock_release (&sect->lock);
+    }
+  qsort (hot, hot_cnt, sizeof *hot, hotter);
+
+  list->magic = CACHE_WARM_MAGIC;
+  list->cnt = hot_cnt < CACHE_WARM_MAX ? hot_cnt : CACHE_WARM_MAX;
+  for (uint32_t i = 0; i < list->cnt; i++)
+    list->sectors[i] = hot[i].sector_idx;
+  qsort (list->sectors, list->cnt, sizeof *list->sectors, sector_cmp);
+  block_write (fs_device, WARM_SECTOR, list);
+
+ done:
+  free (hot);
+  free (list);
+}
+
+/* Drops the charges of exiting process P for the cache sectors it was
+ * the last to look up, which stay cached for other processes. P must no
+ * longer use the cache. */
+void
+cache_release_user (struct thread *p)
+{
+  for (size_t i = 0; i < cache_num_sectors && p->cache_cnt > 0; ++i)
+    {
+      spinlock_acquire (&quota_lock);
+      if (cache[i].user == p)
+        {
+          cache[i].user = NULL;
+          p->cache_cnt--;
+        }
+      spinlock_release (&quota_lock);
+    }
+}
+
+/* Stores the cache statistics of the running process into *ST. */
+void
+cache_get_stat (struct cachestat *st)
+{
+  struct thread *p = thread_current ()->process;
+
+  spinlock_acquire (&quota_lock);
+  st->sectors = p->cache_cnt;
+  st->quota = quota_sectors;
+  st->hits = p->cache_hits;
+  st->misses = p->cache_misses;
+  spinlock_release (&quota_lock);
+}
@@ -2,16 +2,50 @@
 #define FILESYS_CACHE_H
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <hash.h>
 #include "devices/block.h"
 #include "threads/synch.h"
 #include "off_t.h"
 
-#define CACHE_NUM_SECTORS 64
+/* Default and minimum number of sectors held by the buffer cache. */
+#define CACHE_DEFAULT_SECTORS 64
+#define CACHE_MIN_SECTORS 16
+
+/* Number of sectors held by the buffer cache.
+   Controlled by kernel command-line option "-cache=SECTORS". */
+extern size_t cache_num_sectors;
+
+/* Which cache sector gets replaced on a miss. */
+enum cache_policy
+  {
+    CACHE_POLICY_CLOCK,         /* Clock with a second chance on access. */
+    CACHE_POLICY_2Q             /* Scan resistant 2Q. */
+  };
+
+/* Replacement policy, and whether it favors keeping metadata sectors.
+   Controlled by kernel command-line options "-cache-policy=POLICY" and
+   "-cache-no-meta". */
+extern enum cache_policy cache_policy;
+extern bool cache_protect_meta;
+
+/* Percentage of the cache each process may keep before its misses only
+   replace its own sectors and those of other processes over theirs, or
+   0 for no quota. Controlled by kernel command-line option
+   "-cache-quota=PCT". */
+extern unsigned cache_quota_pct;
+
+/* Most sectors moved by one cache_direct_io call, a page worth. */
+#define CACHE_DIRECT_MAX 8
+
+/* Bounds of a sequential reader's read-ahead window, in sectors. */
+#define CACHE_RA_MIN_WINDOW 4
+#define CACHE_RA_MAX_WINDOW 64
+
 enum cache_state
   {
     CACHE_READY,
-    CACHE_PENDING_WRITE,
-    CACHE_BEING_WRITTEN,
     CACHE_BEING_READ,
     CACHE_EVICTED
   };
@@ -21,28 +55,79 @@ enum cache_info_bit
     CLEAN = 0x0,
     ACCESSED = 0x01,
     DIRTY = 0x02,
-    META = 0x04
+    META = 0x04,
+    READ_AHEAD = 0x08           /* Prefetched and not yet read. */
   };
 
+/* Journal sequence number of a sector changed since it was logged. */
+#define CACHE_UNLOGGED UINT32_MAX
+
+struct cache_sector;
+struct cachestat;
+struct thread;
+
+/* Entry in the sector number -> cache sector index. Embedded in every
+   cache sector so indexing never allocates. */
+struct cache_index_entry
+  {
+    struct hash_elem hash_elem;   /* Element in the cache index. */
+    block_sector_t sector_idx;    /* Key, INODE_INVALID_SECTOR if unindexed. */
+    struct cache_sector *sect;    /* Cache sector holding SECTOR_IDX. */
+  };
+
+/* A cache slot. The members that eviction and flushing scan across the
+   whole cache come first, so that a scan touches the start of each slot
+   only, and the sector data itself lives apart in a page-aligned array
+   of buffers. */
 struct cache_sector 
   {
-    uint8_t buffer[BLOCK_SECTOR_SIZE];
-    int num_accessors;
     block_sector_t sector_idx;
-    bool is_metadata;
-    struct lock lock;
-    enum cache_info_bit dirty_bit;
+    block_sector_t owner;         /* Inode that last wrote SECTOR_IDX. */
     enum cache_state state;
-    struct condition being_accessed;
+    enum cache_info_bit dirty_bit;
+    int readers;                  /* Number of shared pins on BUFFER. */
+    bool writer;                  /* Whether BUFFER is pinned exclusive. */
+    bool writing;                 /* A snapshot is being written back. */
+    bool is_metadata;             /* Ever accessed as metadata since read. */
+    bool in_am;                   /* In the 2Q hot queue rather than A1in? */
+    unsigned hits;                /* Lookups since SECTOR_IDX was read. */
+    uint8_t *buffer;              /* BLOCK_SECTOR_SIZE bytes of data. */
+
+    uint32_t journal_seq;         /* Transaction logging BUFFER, or
+                                     CACHE_UNLOGGED. */
+    struct lock lock;
+    struct condition being_accessed; /* Signaled as pins are dropped. */
     struct condition being_read;
-    struct condition being_written;
+    struct condition being_written;  /* Signaled when WRITING clears. */
+    struct cache_index_entry index; /* Guarded by the cache index lock. */
+    struct list_elem queue_elem;  /* 2Q queue element, guarded by clock_lock. */
+    struct thread *user;          /* Process that last looked it up, or
+                                     NULL. Guarded by the quota lock. */
+    struct block_request io_request; /* Read-ahead or write back in flight. */
   };
 
 bool cache_init (void);
-void cache_io_at (block_sector_t sector_idx, void *buffer,
-                  bool is_metadata, off_t offset, off_t size, bool is_write);
-void cache_io_at_ (block_sector_t sector_idx, void *buffer, bool is_metadata,
-                  off_t offset, off_t size, bool is_write,
-                  block_sector_t sector_next);
+bool cache_set_policy (const char *name);
+void *cache_get (block_sector_t sector_idx, block_sector_t owner,
+                 bool is_metadata, bool for_write);
+void cache_put (void *buffer, bool for_write);
+bool cache_direct_io (block_sector_t sector_idx, size_t cnt, void *buffer,
+                      bool is_write);
+void cache_io_at (block_sector_t sector_idx, block_sector_t owner,
+                  void *buffer, bool is_metadata, off_t offset, off_t size, bool is_write);
+bool cache_matches (block_sector_t sector_idx, const void *buffer,
+                    off_t offset, off_t size);
+bool cache_read_ahead (block_sector_t sector_idx);
+size_t cache_read_ahead_window (void);
+void cache_sync (block_sector_t owner);
 void cache_write_all (void);
+void cache_journal_start (uint32_t committed_seq);
+size_t cache_journal_snapshot (uint32_t seq, block_sector_t *sectors,
+                               void *images, size_t max);
+void cache_journal_committed (uint32_t seq);
+void cache_create_warm (void);
+void cache_warm_up (void);
+void cache_save_warm (void);
+void cache_release_user (struct thread *);
+void cache_get_stat (struct cachestat *);
 #endif /* filesys/cache.h */
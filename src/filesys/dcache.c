@@ -0,0 +1,199 @@
+#include "filesys/dcache.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <string.h>
+#include "filesys/directory.h"
+#include "threads/synch.h"
+
+/* Cache of directory lookups, mapping a name in the directory whose inode
+   is at sector DIR to the sector of the named inode, or DCACHE_NEGATIVE
+   if the directory has no such entry.
+
+   Entries are filled by lookups and kept up to date by dir_add and
+   dir_remove, which hold the directory's lock exclusive. Lookups fill
+   entries holding it shared, so an entry never goes stale.
+
+   Lookups take no lock: they walk the hash chains under RCU, while
+   changes are made under dcache_lock. An entry taken out of its chain
+   is only reused after a grace period, since lookups may still be
+   looking at it, and its sector is updated in place by a single
+   store. */
+struct dcache_entry
+  {
+    struct dcache_entry *next;          /* Next in its hash chain. */
+    struct list_elem lru_elem;          /* Element in dcache_lru. */
+    bool in_use;                        /* Whether it is in a chain. */
+    bool referenced;                    /* Looked up since last passed
+                                           over for reuse? */
+    block_sector_t dir;                 /* Sector of the directory inode. */
+    char name[NAME_MAX + 1];            /* Null terminated file name. */
+    block_sector_t sector;              /* Named inode or DCACHE_NEGATIVE. */
+  };
+
+/* Number of hash chains, fixed so that lookups never see the index
+   being rehashed. */
+#define DCACHE_BUCKETS 64
+
+static struct dcache_entry dcache_entries[DCACHE_SIZE];
+
+/* Guards changes to all of the following and every entry. */
+static struct lock dcache_lock;
+static struct dcache_entry *dcache_buckets[DCACHE_BUCKETS];
+static struct list dcache_lru;          /* All entries, least recent last,
+                                           but for REFERENCED. */
+
+static struct dcache_entry **bucket (block_sector_t dir, const char *name);
+static struct dcache_entry *find (block_sector_t dir, const char *name);
+static void evict (struct dcache_entry *);
+
+/* Initializes the directory entry cache. Returns false if out of
+   memory. */
+bool
+dcache_init (void)
+{
+  lock_init (&dcache_lock);
+  list_init (&dcache_lru);
+  for (int i = 0; i < DCACHE_SIZE; ++i)
+    {
+      dcache_entries[i].in_use = false;
+      list_push_back (&dcache_lru, &dcache_entries[i].lru_elem);
+    }
+  return true;
+}
+
+/* Looks up NAME in the directory at sector DIR. On a hit, sets *SECTORP
+   to the sector of its inode, or DCACHE_NEGATIVE if there is no such
+   entry, and returns true. Returns false if the cache doesn't know. */
+bool
+dcache_lookup (block_sector_t dir, const char *name, block_sector_t *sectorp)
+{
+  struct dcache_entry *e;
+
+  rcu_read_lock ();
+  e = find (dir, name);
+  if (e != NULL)
+    {
+      *sectorp = e->sector;
+      e->referenced = true;
+    }
+  rcu_read_unlock ();
+  return e != NULL;
+}
+
+/* Records that NAME in the directory at sector DIR is the inode at
+   SECTOR, or is not there if SECTOR is DCACHE_NEGATIVE. The caller must
+   hold the directory's lock. */
+void
+dcache_insert (block_sector_t dir, const char *name, block_sector_t sector)
+{
+  struct dcache_entry **chain, *e;
+
+  if (strlen (name) > NAME_MAX)
+    return;
+
+  lock_acquire (&dcache_lock);
+  e = find (dir, name);
+  if (e == NULL)
+    {
+      /* Reuse the least recently used entry, giving those looked up
+         since they were last passed over a second chance. */
+      for (;;)
+        {
+          e = list_entry (list_back (&dcache_lru), struct dcache_entry,
+                          lru_elem);
+          if (!e->referenced || !e->in_use)
+            break;
+          e->referenced = false;
+          list_remove (&e->lru_elem);
+          list_push_front (&dcache_lru, &e->lru_elem);
+        }
+      evict (e);
+
+      /* Lookups that found it under its old name must be done with it
+         before it changes. */
+      synchronize_rcu ();
+      e->dir = dir;
+      strlcpy (e->name, name, sizeof e->name);
+      e->sector = sector;
+      e->referenced = false;
+      e->in_use = true;
+      chain = bucket (dir, name);
+      e->next = *chain;
+      rcu_assign_pointer (*chain, e);
+    }
+  else
+    e->sector = sector;
+  list_remove (&e->lru_elem);
+  list_push_front (&dcache_lru, &e->lru_elem);
+  lock_release (&dcache_lock);
+}
+
+/* Forgets anything known about NAME in the directory at sector DIR. */
+void
+dcache_invalidate (block_sector_t dir, const char *name)
+{
+  struct dcache_entry *e;
+
+  lock_acquire (&dcache_lock);
+  e = find (dir, name);
+  if (e != NULL)
+    evict (e);
+  lock_release (&dcache_lock);
+}
+
+/* Forgets every entry of the directory at sector DIR, once it is
+   removed and its sector may be reused. */
+void
+dcache_invalidate_dir (block_sector_t dir)
+{
+  lock_acquire (&dcache_lock);
+  for (int i = 0; i < DCACHE_SIZE; ++i)
+    if (dcache_entries[i].in_use && dcache_entries[i].dir == dir)
+      evict (&dcache_entries[i]);
+  lock_release (&dcache_lock);
+}
+
+/* Returns the hash chain for NAME in DIR. */
+static struct dcache_entry **
+bucket (block_sector_t dir, const char *name)
+{
+  return &dcache_buckets[(hash_int (dir) ^ hash_string (name))
+                         % DCACHE_BUCKETS];
+}
+
+/* Returns the in use entry for NAME in DIR, or NULL if none. The
+   caller must hold dcache_lock or be in an RCU read-side critical
+   section. */
+static struct dcache_entry *
+find (block_sector_t dir, const char *name)
+{
+  struct dcache_entry *e;
+
+  if (strlen (name) > NAME_MAX)
+    return NULL;
+  for (e = rcu_dereference (*bucket (dir, name)); e != NULL;
+       e = rcu_dereference (e->next))
+    if (e->dir == dir && !strcmp (e->name, name))
+      return e;
+  return NULL;
+}
+
+/* Takes E out of its hash chain and makes it the next one reused. It
+   keeps pointing along the chain for lookups still walking it. The
+   caller must hold dcache_lock. */
+static void
+evict (struct dcache_entry *e)
+{
+  if (e->in_use)
+    {
+      struct dcache_entry **p = bucket (e->dir, e->name);
+
+      while (*p != e)
+        p = &(*p)->next;
+      rcu_assign_pointer (*p, e->next);
+      e->in_use = false;
+    }
+  list_remove (&e->lru_elem);
+  list_push_back (&dcache_lru, &e->lru_elem);
+}
@@ -0,0 +1,21 @@
+#ifndef FILESYS_DCACHE_H
+#define FILESYS_DCACHE_H
+
+#include <stdbool.h>
+#include "devices/block.h"
+
+/* Number of directory entries the dcache remembers. */
+#define DCACHE_SIZE 128
+
+/* Sector recorded for a name known not to be in its directory. */
+#define DCACHE_NEGATIVE ((block_sector_t) -1)
+
+bool dcache_init (void);
+bool dcache_lookup (block_sector_t dir, const char *name,
+                    block_sector_t *sectorp);
+void dcache_insert (block_sector_t dir, const char *name,
+                    block_sector_t sector);
+void dcache_invalidate (block_sector_t dir, const char *name);
+void dcache_invalidate_dir (block_sector_t dir);
+
+#endif /* filesys/dcache.h */
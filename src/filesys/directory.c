@@ -1,18 +1,31 @@
 #include "filesys/directory.h"
 #include <stdio.h>
 #include <string.h>
+#include <hash.h>
 #include <list.h>
+#include <round.h>
+#include "filesys/dcache.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "filesys/tmpfs.h"
 #include "threads/thread.h"
 #include "threads/synch.h"
 #include "threads/malloc.h"
 
+/* Create new directories in the indexed format.
+   Controlled by kernel command-line option "-dir-index". */
+bool dir_use_index;
+
+/* Serializes renames between directories, so that none can see the tree
+   halfway through another's move and create a cycle. */
+static struct lock rename_lock;
+
 /* A directory. */
 struct dir 
   {
     struct inode *inode;                /* Backing store. */
-    struct lock *lock;                  /* Shared across dirs of inode. */
+    struct rwlock *lock;                /* Shared across dirs of inode. */
+    bool indexed;                       /* Indexed or linear format? */
     off_t pos;                          /* Current position. */
   };
 
@@ -24,12 +37,105 @@ struct dir_entry
     bool in_use;                        /* In use or free? */
   };
 
+/* A linear directory is an array of entries. An indexed directory starts
+   with a header sector whose first entry is a marker, in use with an
+   empty name and DIR_INDEX_MAGIC as its sector, which no linear
+   directory can have since its first entry is always "..". Names hash
+   to one of DIR_INDEX_BUCKETS bucket sectors that follow the header.
+   A full bucket chains to overflow buckets appended past them. Buckets
+   never written are holes and read back as empty. */
+#define DIR_INDEX_MAGIC 0x44494458
+#define DIR_INDEX_BUCKETS 256
+#define DIR_BUCKET_ENTRIES \
+  ((BLOCK_SECTOR_SIZE - sizeof (off_t)) / sizeof (struct dir_entry))
+
+/* A bucket of an indexed directory.
+   Must be at most BLOCK_SECTOR_SIZE bytes long. */
+struct dir_bucket
+  {
+    off_t next;                         /* Overflow bucket offset or 0. */
+    struct dir_entry entries[DIR_BUCKET_ENTRIES];
+  };
+
+/* Number of linear directory entries scanned per inode_read_at. */
+#define DIR_SCAN_ENTRIES (BLOCK_SECTOR_SIZE / sizeof (struct dir_entry))
+
+static bool add_entry (struct dir *, const char *, block_sector_t);
+static bool add_indexed (struct dir *, const char *, block_sector_t);
+static bool lookup (const struct dir *, const char *, struct dir_entry *,
+                    off_t *);
+
+/* Reads up to DIR_SCAN_ENTRIES entries of linear directory INODE
+   starting at offset OFS into ENTRIES. Returns the number of whole
+   entries read, which is 0 only at end of file. */
+static size_t
+read_entries (struct inode *inode, off_t ofs,
+              struct dir_entry entries[DIR_SCAN_ENTRIES])
+{
+  off_t n = inode_read_at (inode, entries,
+                           DIR_SCAN_ENTRIES * sizeof *entries, ofs);
+  return n > 0 ? n / sizeof *entries : 0;
+}
+
+/* Returns the offset of the bucket NAME hashes to. */
+static off_t
+bucket_ofs (const char *name)
+{
+  return (1 + hash_string (name) % DIR_INDEX_BUCKETS) * BLOCK_SECTOR_SIZE;
+}
+
+/* Returns the offset of entry IDX of the bucket at offset BUCKET. */
+static off_t
+bucket_entry_ofs (off_t bucket, size_t idx)
+{
+  return bucket + offsetof (struct dir_bucket, entries)
+         + idx * sizeof (struct dir_entry);
+}
+
+/* Reads the bucket at offset OFS of INODE into B. */
+static void
+read_bucket (struct inode *inode, struct dir_bucket *b, off_t ofs)
+{
+  off_t n = inode_read_at (inode, b, sizeof *b, ofs);
+  if (n < 0)
+    n = 0;
+  memset ((char *) b + n, 0, sizeof *b - n);
+}
+
 /* Creates a directory with space for no entries in the
-   given SECTOR.  Returns true if successful, false on failure. */
+   given SECTOR, in the indexed format if INDEXED.
+   Returns true if successful, false on failure. */
 bool
-dir_create (block_sector_t sector)
+dir_create (block_sector_t sector, bool indexed)
 {
-  return inode_create (sector, 0, true);
+  struct dir_entry marker;
+  struct inode *inode;
+  bool success;
+
+  if (!inode_create (sector, 0, true))
+    return false;
+  if (!indexed)
+    return true;
+
+  inode = inode_open (sector);
+  if (inode == NULL)
+    return false;
+  memset (&marker, 0, sizeof marker);
+  marker.inode_sector = DIR_INDEX_MAGIC;
+  marker.in_use = true;
+  success = inode_write_at (inode, &marker, sizeof marker, 0) == sizeof marker;
+  inode_close (inode);
+  return success;
+}
+
+/* Returns true if the directory at INODE is in the indexed format. */
+static bool
+is_indexed (struct inode *inode)
+{
+  struct dir_entry e;
+  return (inode_read_at (inode, &e, sizeof e, 0) == sizeof e
+          && e.in_use && e.name[0] == '\0'
+          && e.inode_sector == DIR_INDEX_MAGIC);
 }
 
 /* Opens and returns the directory for the given INODE, of which
@@ -42,7 +148,10 @@ dir_open (struct inode *inode)
     {
       dir->inode = inode;
       dir->lock = inode_dir_lock (dir->inode);
-      dir->pos = 2 * sizeof (struct dir_entry); /* Skip . and .. */
+      dir->indexed = is_indexed (inode);
+      /* Skip . and .., which an indexed directory skips by name. */
+      dir->pos = (dir->indexed ? bucket_entry_ofs (BLOCK_SECTOR_SIZE, 0)
+                               : 2 * (off_t) sizeof (struct dir_entry));
       return dir;
     }
   else
@@ -67,6 +176,15 @@ dir_open_root (void)
    arbitrarily many nested directory names. */ 
 struct dir *
 dir_open_dirs (const char *filepath)
+{
+  return dir_open_dirs_at (NULL, filepath);
+}
+
+/* Like dir_open_dirs(), but resolves a relative FILEPATH starting at
+   BASE instead of the current working directory, unless BASE is
+   null. */
+struct dir *
+dir_open_dirs_at (struct dir *base, const char *filepath)
 {
   struct dir *parent_dir;
   struct inode *curr_inode;
@@ -84,7 +202,8 @@ dir_open_dirs (const char *filepath)
     }
   else
     {
-      parent_dir = dir_reopen (thread_current ()->cwd);
+      parent_dir = dir_reopen (base != NULL ? base
+                                            : thread_current ()->process->cwd);
     }
   if (parent_dir == NULL)
     goto fail;
@@ -108,11 +227,9 @@ dir_open_dirs (const char *filepath)
       /* Copy the NULL-terminated current name. */ 
       strlcpy (curr_name, filepath, curr_name_len + 1);
       /* Lookup the current_name in the parent and fail if not found. */
-      lock_acquire (parent_dir->lock);
       if (!dir_lookup (parent_dir, curr_name, &curr_inode))
         goto fail;
       /* Update the state to reflect the current step of path traversal. */
-      lock_release (parent_dir->lock);
       dir_close (parent_dir);
       parent_dir = dir_open (curr_inode);
       if (parent_dir == NULL)
@@ -121,8 +238,6 @@ dir_open_dirs (const char *filepath)
     }
   return parent_dir;
 fail:
-  if (parent_dir != NULL && lock_held_by_current_thread (parent_dir->lock))
-    lock_release (parent_dir->lock);
   dir_close (parent_dir);
   return NULL;
 }
@@ -153,6 +268,32 @@ dir_get_inode (struct dir *dir)
   return dir->inode;
 }
 
+/* Searches the bucket chain of indexed DIR that NAME hashes to.
+   Behaves like lookup. */
+static bool
+lookup_indexed (const struct dir *dir, const char *name,
+                struct dir_entry *ep, off_t *ofsp)
+{
+  struct dir_bucket b;
+  off_t bucket;
+  size_t i;
+
+  for (bucket = bucket_ofs (name); bucket != 0; bucket = b.next)
+    {
+      read_bucket (dir->inode, &b, bucket);
+      for (i = 0; i < DIR_BUCKET_ENTRIES; i++)
+        if (b.entries[i].in_use && !strcmp (name, b.entries[i].name))
+          {
+            if (ep != NULL)
+              *ep = b.entries[i];
+            if (ofsp != NULL)
+              *ofsp = bucket_entry_ofs (bucket, i);
+            return true;
+          }
+    }
+  return false;
+}
+
 /* Searches DIR for a file with the given NAME.
    If successful, returns true, sets *EP to the directory entry
    if EP is non-null, and sets *OFSP to the byte offset of the
@@ -162,40 +303,61 @@ static bool
 lookup (const struct dir *dir, const char *name,
         struct dir_entry *ep, off_t *ofsp) 
 {
-  struct dir_entry e;
-  size_t ofs;
+  struct dir_entry entries[DIR_SCAN_ENTRIES];
+  size_t i, n;
+  off_t ofs;
   
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-    if (e.in_use && !strcmp (name, e.name)) 
-      {
-        if (ep != NULL)
-          *ep = e;
-        if (ofsp != NULL)
-          *ofsp = ofs;
-        return true;
-      }
+  if (dir->indexed)
+    return lookup_indexed (dir, name, ep, ofsp);
+
+  for (ofs = 0; (n = read_entries (dir->inode, ofs, entries)) > 0;
+       ofs += n * sizeof *entries) 
+    for (i = 0; i < n; i++)
+      if (entries[i].in_use && !strcmp (name, entries[i].name)) 
+        {
+          if (ep != NULL)
+            *ep = entries[i];
+          if (ofsp != NULL)
+            *ofsp = ofs + i * sizeof *entries;
+          return true;
+        }
   return false;
 }
 
 /* Searches DIR for a file with the given NAME
    and returns true if one exists, false otherwise.
    On success, sets *INODE to an inode for the file, otherwise to
-   a null pointer.  The caller must close *INODE. */
+   a null pointer.  The caller must close *INODE.
+   Answers from the dcache when it can, otherwise scans DIR holding its
+   lock shared and records the outcome there.  A directory a tmpfs is
+   mounted on opens the tmpfs root instead. */
 bool
 dir_lookup (const struct dir *dir, const char *name,
             struct inode **inode) 
 {
+  block_sector_t dir_sector, sector;
   struct dir_entry e;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  if (lookup (dir, name, &e, NULL))
-    *inode = inode_open (e.inode_sector);
+  dir_sector = inode_get_inumber (dir->inode);
+  if (!dcache_lookup (dir_sector, name, &sector))
+    {
+      /* Scan under the lock, so that a concurrent dir_add or dir_remove
+         can't slip in between the scan and caching its outcome. */
+      rwlock_acquire_read (dir->lock);
+      sector = lookup (dir, name, &e, NULL) ? e.inode_sector
+                                            : DCACHE_NEGATIVE;
+      dcache_insert (dir_sector, name, sector);
+      rwlock_release_read (dir->lock);
+    }
+
+  if (sector != DCACHE_NEGATIVE)
+    *inode = inode_open (tmpfs_resolve (sector));
   else
     *inode = NULL;
 
@@ -218,6 +380,13 @@ dir_parse_filename (const char *filepath)
   return filename + 1;
 }
 
+/* Initializes the directory module. */
+void
+dir_init (void)
+{
+  lock_init (&rename_lock);
+}
+
 /* Adds a file named NAME to DIR, which must not already contain a
    file by that name.  The file's inode is in sector
    INODE_SECTOR.
@@ -227,9 +396,7 @@ dir_parse_filename (const char *filepath)
 bool
 dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
 {
-  struct dir_entry e;
-  off_t ofs;
-  bool success = false;
+  bool success;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
@@ -239,37 +406,165 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
     return false;
 
   /* Check that NAME is not in use. */
-  lock_acquire (dir->lock);
-  if (lookup (dir, name, NULL, NULL))
-    goto done;
+  rwlock_acquire_write (dir->lock);
+  success = !lookup (dir, name, NULL, NULL)
+            && add_entry (dir, name, inode_sector);
+  rwlock_release_write (dir->lock);
+  return success;
+}
+
+/* Does the work of dir_add() for valid NAME, which DIR doesn't contain.
+   The caller must hold DIR's lock exclusive. */
+static bool
+add_entry (struct dir *dir, const char *name, block_sector_t inode_sector)
+{
+  struct dir_entry entries[DIR_SCAN_ENTRIES];
+  struct dir_entry e;
+  off_t *free_ofs;
+  off_t ofs;
+  size_t i, n;
+  bool success = false;
+
+  if (dir->indexed)
+    {
+      success = add_indexed (dir, name, inode_sector);
+      goto written;
+    }
 
-  /* Set OFS to offset of free slot.
+  /* Set OFS to offset of free slot, starting from the inode's hint
+     that there are none before it.
      If there are no free slots, then it will be set to the
      current end-of-file.
      
      inode_read_at() will only return a short read at end of file.
      Otherwise, we'd need to verify that we didn't get a short
      read due to something intermittent such as low memory. */
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-    if (!e.in_use)
-      break;
+  free_ofs = inode_dir_free_ofs (dir->inode);
+  for (ofs = *free_ofs; (n = read_entries (dir->inode, ofs, entries)) > 0;
+       ofs += n * sizeof *entries) 
+    {
+      for (i = 0; i < n; i++)
+        if (!entries[i].in_use)
+          break;
+      if (i < n)
+        {
+          ofs += i * sizeof *entries;
+          break;
+        }
+    }
+  *free_ofs = ofs;
 
   /* Write slot. */
   e.in_use = true;
   strlcpy (e.name, name, sizeof e.name);
   e.inode_sector = inode_sector;
   success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+  if (success)
+    *free_ofs = ofs + sizeof e;
 
- done:
-  if (lock_held_by_current_thread (dir->lock))
-    lock_release (dir->lock);
+ written:
+  if (success)
+    dcache_insert (inode_get_inumber (dir->inode), name, inode_sector);
+  else
+    dcache_invalidate (inode_get_inumber (dir->inode), name);
   return success;
 }
 
+/* Adds NAME for INODE_SECTOR to indexed DIR, which must not contain
+   NAME yet, in the first free slot of its bucket chain. Appends an
+   overflow bucket if they are full. The caller must hold DIR's lock
+   exclusive. Returns true if successful, false on a disk or memory error. */
+static bool
+add_indexed (struct dir *dir, const char *name, block_sector_t inode_sector)
+{
+  struct dir_bucket b;
+  struct dir_entry e;
+  off_t bucket, next;
+  size_t i;
+
+  e.in_use = true;
+  strlcpy (e.name, name, sizeof e.name);
+  e.inode_sector = inode_sector;
+
+  for (bucket = bucket_ofs (name); ; bucket = b.next)
+    {
+      read_bucket (dir->inode, &b, bucket);
+      for (i = 0; i < DIR_BUCKET_ENTRIES; i++)
+        if (!b.entries[i].in_use)
+          return inode_write_at (dir->inode, &e, sizeof e,
+                                 bucket_entry_ofs (bucket, i)) == sizeof e;
+      if (b.next == 0)
+        break;
+    }
+
+  /* Write the overflow bucket in full before linking it in. */
+  next = ROUND_UP (inode_length (dir->inode), BLOCK_SECTOR_SIZE);
+  if (next < (1 + DIR_INDEX_BUCKETS) * BLOCK_SECTOR_SIZE)
+    next = (1 + DIR_INDEX_BUCKETS) * BLOCK_SECTOR_SIZE;
+  memset (&b, 0, sizeof b);
+  b.entries[0] = e;
+  return (inode_write_at (dir->inode, &b, sizeof b, next) == sizeof b
+          && inode_write_at (dir->inode, &next, sizeof next, bucket)
+             == sizeof next);
+}
+
+/* Reads the in use entry of DIR at or after *POS into *EP, skipping
+   bucket links and the header in an indexed DIR, and advances *POS past
+   it. Returns false if there are no more entries. The caller must hold
+   DIR's lock. */
+static bool
+next_entry (const struct dir *dir, off_t *pos, struct dir_entry *ep)
+{
+  if (!dir->indexed)
+    {
+      struct dir_entry entries[DIR_SCAN_ENTRIES];
+      size_t i, n;
+
+      while ((n = read_entries (dir->inode, *pos, entries)) > 0)
+        for (i = 0; i < n; i++)
+          {
+            *pos += sizeof *ep;
+            if (entries[i].in_use)
+              {
+                *ep = entries[i];
+                return true;
+              }
+          }
+      return false;
+    }
+
+  while (*pos < inode_length (dir->inode))
+    {
+      struct dir_bucket b;
+      off_t bucket = *pos / BLOCK_SECTOR_SIZE * BLOCK_SECTOR_SIZE;
+      size_t i;
+
+      if (bucket == 0)
+        {
+          *pos = bucket_entry_ofs (BLOCK_SECTOR_SIZE, 0);
+          continue;
+        }
+      read_bucket (dir->inode, &b, bucket);
+      for (i = (*pos - bucket_entry_ofs (bucket, 0)) / sizeof *ep;
+           i < DIR_BUCKET_ENTRIES; i++)
+        if (b.entries[i].in_use
+            && strcmp (".", b.entries[i].name)
+            && strcmp ("..", b.entries[i].name))
+          {
+            *ep = b.entries[i];
+            *pos = bucket_entry_ofs (bucket, i + 1);
+            return true;
+          }
+      *pos = bucket_entry_ofs (bucket + BLOCK_SECTOR_SIZE, 0);
+    }
+  return false;
+}
+
 /* Removes any entry for NAME in DIR.
    Returns true if successful, false on failure,
-   which occurs only if there is no file with the given NAME. */
+   which occurs only if there is no file with the given NAME,
+   or NAME is a directory that isn't empty, is open or has a tmpfs
+   mounted on it. */
 bool
 dir_remove (struct dir *dir, const char *name) 
 {
@@ -283,8 +578,9 @@ dir_remove (struct dir *dir, const char *name)
   ASSERT (name != NULL);
 
   /* Find directory entry. */
-  lock_acquire (dir->lock);
-  if (!lookup (dir, name, &e, &ofs))
+  rwlock_acquire_write (dir->lock);
+  if (!lookup (dir, name, &e, &ofs)
+      || tmpfs_resolve (e.inode_sector) != e.inode_sector)
     goto done;
 
   /* Open inode and fail on error. */
@@ -308,15 +604,23 @@ dir_remove (struct dir *dir, const char *name)
   /* Erase directory entry. */
   e.in_use = false;
   if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e) 
-    goto done;
+    {
+      dcache_invalidate (inode_get_inumber (dir->inode), name);
+      goto done;
+    }
+  if (!dir->indexed && ofs < *inode_dir_free_ofs (dir->inode))
+    *inode_dir_free_ofs (dir->inode) = ofs;
+  dcache_insert (inode_get_inumber (dir->inode), name, DCACHE_NEGATIVE);
 
-  /* Remove inode. */
+  /* Remove inode, and what the dcache knows of it if it is a dir. */
+  if (dir_removed != NULL)
+    dcache_invalidate_dir (e.inode_sector);
   inode_remove (inode);
   success = true;
 
  done:
-  if (lock_held_by_current_thread (dir->lock))
-    lock_release (dir->lock);
+  if (rwlock_held_by_current_thread (dir->lock))
+    rwlock_release_write (dir->lock);
   if (dir_removed != NULL)
     dir_close (dir_removed);
   else if (inode != NULL)
@@ -324,26 +628,213 @@ dir_remove (struct dir *dir, const char *name)
   return success;
 }
 
+/* Returns true if DIR is the directory in SECTOR or inside it. Walks up
+   through "..", so the caller must keep the tree from changing shape,
+   as rename_lock does. */
+static bool
+is_within (struct dir *dir, block_sector_t sector)
+{
+  struct dir *cur = dir_reopen (dir);
+  bool within = false;
+
+  while (cur != NULL)
+    {
+      block_sector_t cur_sector = inode_get_inumber (cur->inode);
+      struct inode *parent;
+
+      if (cur_sector == sector)
+        within = true;
+      if (within || cur_sector == ROOT_DIR_SECTOR
+          || !dir_lookup (cur, "..", &parent))
+        break;
+      dir_close (cur);
+      cur = dir_open (parent);
+    }
+  dir_close (cur);
+  return within;
+}
+
+/* Moves the entry for OLD_NAME in OLD_DIR to NEW_NAME in NEW_DIR, which
+   may be the same directory, in place of any entry NEW_NAME already has
+   there: a file replaces a file, a directory an empty directory. The
+   inode isn't touched, so moving a file never copies its data, and the
+   replaced inode is removed. A directory moved to another directory
+   gets its ".." updated, and can't be moved inside itself. Returns true
+   if successful, false if OLD_NAME doesn't exist, either name is
+   invalid, the entry at NEW_NAME can't be replaced, or the move is
+   into or out of a tmpfs, or of the directory one is mounted on.
+   Neither name changes on failure. The caller should hold a journal
+   handle so that the move is all or nothing. */
+bool
+dir_rename (struct dir *old_dir, const char *old_name,
+            struct dir *new_dir, const char *new_name)
+{
+  block_sector_t old_sector = inode_get_inumber (old_dir->inode);
+  block_sector_t new_sector = inode_get_inumber (new_dir->inode);
+  bool cross = old_sector != new_sector;
+  struct dir *moved_dir = NULL;
+  struct inode *moved = NULL, *replaced = NULL;
+  struct dir_entry old_e, new_e, replaced_e;
+  off_t old_ofs, new_ofs;
+  bool is_dir, success = false;
+
+  if (*new_name == '\0' || strlen (new_name) > NAME_MAX
+      || !strcmp (old_name, ".") || !strcmp (old_name, "..")
+      || !strcmp (new_name, ".") || !strcmp (new_name, ".."))
+    return false;
+
+  if (cross)
+    lock_acquire (&rename_lock);
+  if (!dir_lookup (old_dir, old_name, &moved)
+      || tmpfs_owns (inode_get_inumber (moved)) != tmpfs_owns (new_sector))
+    goto done;
+  is_dir = inode_isdir (moved);
+  if (is_dir && cross && is_within (new_dir, inode_get_inumber (moved)))
+    goto done;
+
+  /* Open a moved directory now, since its ".." must be updated once
+     the names have changed. */
+  if (is_dir && cross)
+    {
+      moved_dir = dir_open (inode_reopen (moved));
+      if (moved_dir == NULL)
+        goto done;
+    }
+
+  /* Lock the directories in sector order. */
+  if (cross && new_sector < old_sector)
+    rwlock_acquire_write (new_dir->lock);
+  rwlock_acquire_write (old_dir->lock);
+  if (cross && new_sector > old_sector)
+    rwlock_acquire_write (new_dir->lock);
+
+  /* OLD_NAME may have changed since it was looked up. */
+  if (!lookup (old_dir, old_name, &old_e, &old_ofs)
+      || old_e.inode_sector != inode_get_inumber (moved))
+    goto unlock;
+
+  /* Link the inode at NEW_NAME first, so that it can't be lost. */
+  if (lookup (new_dir, new_name, &new_e, &new_ofs))
+    {
+      if (new_e.inode_sector == old_e.inode_sector)
+        {
+          success = true;
+          goto unlock;
+        }
+      replaced = inode_open (new_e.inode_sector);
+      if (replaced == NULL || inode_isdir (replaced) != is_dir
+          || new_e.inode_sector == old_sector
+          || tmpfs_resolve (new_e.inode_sector) != new_e.inode_sector)
+        goto unlock;
+      if (is_dir)
+        {
+          struct dir *d = dir_open (inode_reopen (replaced));
+          bool empty = (d != NULL && inode_open_count (replaced) == 2
+                        && dir_empty (d));
+          dir_close (d);
+          if (!empty)
+            goto unlock;
+          dcache_invalidate_dir (new_e.inode_sector);
+        }
+      replaced_e = new_e;
+      new_e.inode_sector = old_e.inode_sector;
+      if (inode_write_at (new_dir->inode, &new_e, sizeof new_e, new_ofs)
+          != sizeof new_e)
+        {
+          dcache_invalidate (new_sector, new_name);
+          goto unlock;
+        }
+      dcache_insert (new_sector, new_name, old_e.inode_sector);
+    }
+  else if (!add_entry (new_dir, new_name, old_e.inode_sector))
+    goto unlock;
+
+  /* Then erase OLD_NAME, or else put NEW_NAME back as it was. */
+  old_e.in_use = false;
+  if (inode_write_at (old_dir->inode, &old_e, sizeof old_e, old_ofs)
+      != sizeof old_e)
+    {
+      dcache_invalidate (old_sector, old_name);
+      if (replaced != NULL)
+        inode_write_at (new_dir->inode, &replaced_e, sizeof replaced_e,
+                        new_ofs);
+      else if (lookup (new_dir, new_name, &new_e, &new_ofs))
+        {
+          new_e.in_use = false;
+          inode_write_at (new_dir->inode, &new_e, sizeof new_e, new_ofs);
+          if (!new_dir->indexed
+              && new_ofs < *inode_dir_free_ofs (new_dir->inode))
+            *inode_dir_free_ofs (new_dir->inode) = new_ofs;
+        }
+      dcache_invalidate (new_sector, new_name);
+      goto unlock;
+    }
+  if (!old_dir->indexed && old_ofs < *inode_dir_free_ofs (old_dir->inode))
+    *inode_dir_free_ofs (old_dir->inode) = old_ofs;
+  dcache_insert (old_sector, old_name, DCACHE_NEGATIVE);
+
+  /* Point a moved directory's ".." at its new parent. */
+  if (is_dir && cross)
+    {
+      struct dir_entry e;
+      off_t ofs;
+
+      rwlock_acquire_write (moved_dir->lock);
+      if (lookup (moved_dir, "..", &e, &ofs))
+        {
+          e.inode_sector = new_sector;
+          inode_write_at (moved_dir->inode, &e, sizeof e, ofs);
+        }
+      dcache_invalidate (inode_get_inumber (moved), "..");
+      rwlock_release_write (moved_dir->lock);
+    }
+  success = true;
+
+ unlock:
+  if (cross)
+    rwlock_release_write (new_dir->lock);
+  rwlock_release_write (old_dir->lock);
+ done:
+  if (cross)
+    lock_release (&rename_lock);
+  if (replaced != NULL)
+    {
+      if (success)
+        inode_remove (replaced);
+      inode_close (replaced);
+    }
+  dir_close (moved_dir);
+  inode_close (moved);
+  return success;
+}
+
 /* Reads the next directory entry in DIR and stores the name in
    NAME.  Returns true if successful, false if the directory
    contains no more entries. */
 bool
 dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
+{
+  return dir_readdir_sector (dir, name, NULL);
+}
+
+/* Like dir_readdir, and also sets *SECTORP to the sector of the
+   entry's inode if SECTORP is non-null. */
+bool
+dir_readdir_sector (struct dir *dir, char name[NAME_MAX + 1],
+                    block_sector_t *sectorp)
 {
   struct dir_entry e;
 
-  lock_acquire (dir->lock);
-  while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e) 
+  rwlock_acquire_read (dir->lock);
+  if (next_entry (dir, &dir->pos, &e))
     {
-      dir->pos += sizeof e;
-      if (e.in_use)
-        {
-          strlcpy (name, e.name, NAME_MAX + 1);
-          lock_release (dir->lock);
-          return true;
-        } 
-    }
-  lock_release (dir->lock);
+      strlcpy (name, e.name, NAME_MAX + 1);
+      if (sectorp != NULL)
+        *sectorp = e.inode_sector;
+      rwlock_release_read (dir->lock);
+      return true;
+    } 
+  rwlock_release_read (dir->lock);
   return false;
 }
 
@@ -353,19 +844,18 @@ bool
 dir_empty (struct dir *dir)
 {
   struct dir_entry e;
-  size_t ofs;
+  off_t ofs = 0;
   
   ASSERT (dir != NULL);
 
-  lock_acquire (dir->lock);
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
+  rwlock_acquire_read (dir->lock);
+  while (next_entry (dir, &ofs, &e))
     /* Check if the entry is in_use and neither . nor .. */
     if (e.in_use && strcmp (".", e.name) && strcmp ("..", e.name))
       {
-        lock_release (dir->lock);
+        rwlock_release_read (dir->lock);
         return false;
       }
-  lock_release (dir->lock);
+  rwlock_release_read (dir->lock);
   return true;
 }
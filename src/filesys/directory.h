@@ -11,11 +11,16 @@
 
 struct inode;
 
+extern bool dir_use_index;
+
+void dir_init (void);
+
 /* Opening and closing directories. */
-bool dir_create (block_sector_t sector);
+bool dir_create (block_sector_t sector, bool indexed);
 struct dir *dir_open (struct inode *);
 struct dir *dir_open_root (void);
 struct dir *dir_open_dirs (const char *filepath);
+struct dir *dir_open_dirs_at (struct dir *base, const char *filepath);
 struct dir *dir_reopen (struct dir *);
 void dir_close (struct dir *);
 struct inode *dir_get_inode (struct dir *);
@@ -25,7 +30,11 @@ const char *dir_parse_filename (const char *filepath);
 bool dir_lookup (const struct dir *, const char *name, struct inode **);
 bool dir_add (struct dir *, const char *name, block_sector_t);
 bool dir_remove (struct dir *, const char *name);
+bool dir_rename (struct dir *old_dir, const char *old_name,
+                 struct dir *new_dir, const char *new_name);
 bool dir_readdir (struct dir *, char name[NAME_MAX + 1]);
+bool dir_readdir_sector (struct dir *, char name[NAME_MAX + 1],
+                         block_sector_t *sectorp);
 bool dir_empty (struct dir *);
 
 #endif /* filesys/directory.h */
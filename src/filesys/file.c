@@ -2,6 +2,8 @@
 #include <debug.h>
 #include "filesys/inode.h"
 #include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
 
 /* An open file. */
 struct file 
@@ -9,6 +11,8 @@ struct file
     struct inode *inode;        /* File's inode. */
     off_t pos;                  /* Current position. */
     bool deny_write;            /* Has file_deny_write() been called? */
+    bool write_through;         /* Sync each write before returning? */
+    struct inode_ra ra;         /* Read-ahead state of this opener. */
   };
 
 /* Opens a file for the given INODE, of which it takes ownership,
@@ -23,6 +27,8 @@ file_open (struct inode *inode)
       file->inode = inode;
       file->pos = 0;
       file->deny_write = false;
+      file->write_through = false;
+      inode_ra_init (&file->ra);
       return file;
     }
   else
@@ -68,7 +74,8 @@ file_get_inode (struct file *file)
 off_t
 file_read (struct file *file, void *buffer, off_t size) 
 {
-  off_t bytes_read = inode_read_at (file->inode, buffer, size, file->pos);
+  off_t bytes_read = inode_read_at_ra (file->inode, buffer, size, file->pos,
+                                       &file->ra);
   file->pos += bytes_read;
   return bytes_read;
 }
@@ -81,7 +88,16 @@ file_read (struct file *file, void *buffer, off_t size)
 off_t
 file_read_at (struct file *file, void *buffer, off_t size, off_t file_ofs) 
 {
-  return inode_read_at (file->inode, buffer, size, file_ofs);
+  return inode_read_at_ra (file->inode, buffer, size, file_ofs, &file->ra);
+}
+
+/* Like file_read_at(), but leaves the data out of the buffer cache. See
+   inode_read_uncached_at(). */
+off_t
+file_read_uncached_at (struct file *file, void *buffer, off_t size,
+                       off_t file_ofs)
+{
+  return inode_read_uncached_at (file->inode, buffer, size, file_ofs);
 }
 
 /* Writes SIZE bytes from BUFFER into FILE,
@@ -94,7 +110,7 @@ file_read_at (struct file *file, void *buffer, off_t size, off_t file_ofs)
 off_t
 file_write (struct file *file, const void *buffer, off_t size) 
 {
-  off_t bytes_written = inode_write_at (file->inode, buffer, size, file->pos);
+  off_t bytes_written = file_write_at (file, buffer, size, file->pos);
   file->pos += bytes_written;
   return bytes_written;
 }
@@ -105,12 +121,59 @@ file_write (struct file *file, const void *buffer, off_t size)
    which may be less than SIZE if end of file is reached.
    (Normally we'd grow the file in that case, but file growth is
    not yet implemented.)
-   The file's current position is unaffected. */
+   The file's current position is unaffected.
+   In write-through mode, also waits for the data to reach the disk. */
 off_t
 file_write_at (struct file *file, const void *buffer, off_t size,
                off_t file_ofs) 
 {
-  return inode_write_at (file->inode, buffer, size, file_ofs);
+  off_t bytes_written = inode_write_at (file->inode, buffer, size, file_ofs);
+  if (file->write_through && bytes_written > 0)
+    inode_write_through (file->inode);
+  return bytes_written;
+}
+
+/* Like file_write_at(), but only writes the sectors whose contents
+   change. See inode_write_changed_at(). */
+off_t
+file_write_changed_at (struct file *file, const void *buffer, off_t size,
+                       off_t file_ofs)
+{
+  off_t bytes_written = inode_write_changed_at (file->inode, buffer, size,
+                                                file_ofs);
+  if (file->write_through && bytes_written > 0)
+    inode_write_through (file->inode);
+  return bytes_written;
+}
+
+/* Copies up to SIZE bytes from SRC, starting at its current
+   position, into DST at its current position, advancing both by
+   the number of bytes copied.  The data passes through a kernel
+   page a chunk at a time.  Returns the number of bytes copied,
+   which may be less than SIZE if the end of SRC is reached, if DST
+   can't be written, or if no page is available. */
+off_t
+file_copy (struct file *dst, struct file *src, off_t size)
+{
+  uint8_t *buffer = palloc_get_page (0);
+  off_t bytes_copied = 0;
+
+  if (buffer == NULL)
+    return 0;
+  while (bytes_copied < size)
+    {
+      off_t chunk = size - bytes_copied < PGSIZE ? size - bytes_copied : PGSIZE;
+      off_t bytes_read = file_read_at (src, buffer, chunk, src->pos);
+      off_t bytes_written = (bytes_read > 0
+                             ? file_write (dst, buffer, bytes_read) : 0);
+
+      src->pos += bytes_written;
+      bytes_copied += bytes_written;
+      if (bytes_written < chunk)
+        break;
+    }
+  palloc_free_page (buffer);
+  return bytes_copied;
 }
 
 /* Prevents write operations on FILE's underlying inode
@@ -140,6 +203,17 @@ file_allow_write (struct file *file)
     }
 }
 
+/* Puts FILE in write-through mode, in which each write returns only
+   once its data is on disk, if WRITE_THROUGH, or back in the default
+   write-back mode, in which the buffer cache writes it out later. Other
+   files open on the same inode keep their own modes. */
+void
+file_set_write_through (struct file *file, bool write_through)
+{
+  ASSERT (file != NULL);
+  file->write_through = write_through;
+}
+
 /* Returns the size of FILE in bytes. */
 off_t
 file_length (struct file *file) 
@@ -148,6 +222,32 @@ file_length (struct file *file)
   return inode_length (file->inode);
 }
 
+/* Sets the size of FILE to LENGTH bytes. See inode_truncate(). */
+bool
+file_truncate (struct file *file, off_t length)
+{
+  ASSERT (file != NULL);
+  return inode_truncate (file->inode, length);
+}
+
+/* Reserves disk space for the LENGTH bytes of FILE at OFFSET. See
+   inode_allocate(). */
+bool
+file_allocate (struct file *file, off_t offset, off_t length)
+{
+  ASSERT (file != NULL);
+  return inode_allocate (file->inode, offset, length);
+}
+
+/* Moves the data of FILE into contiguous sectors. See
+   inode_defrag(). */
+bool
+file_defrag (struct file *file)
+{
+  ASSERT (file != NULL);
+  return inode_defrag (file->inode);
+}
+
 /* Sets the current position in FILE to NEW_POS bytes from the
    start of the file. */
 void
@@ -1,6 +1,7 @@
 #ifndef FILESYS_FILE_H
 #define FILESYS_FILE_H
 
+#include <stdbool.h>
 #include "filesys/off_t.h"
 
 struct inode;
@@ -14,16 +15,27 @@ struct inode *file_get_inode (struct file *);
 /* Reading and writing. */
 off_t file_read (struct file *, void *, off_t);
 off_t file_read_at (struct file *, void *, off_t size, off_t start);
+off_t file_read_uncached_at (struct file *, void *, off_t size,
+                             off_t start);
 off_t file_write (struct file *, const void *, off_t);
 off_t file_write_at (struct file *, const void *, off_t size, off_t start);
+off_t file_write_changed_at (struct file *, const void *, off_t size,
+                             off_t start);
+off_t file_copy (struct file *dst, struct file *src, off_t size);
 
 /* Preventing writes. */
 void file_deny_write (struct file *);
 void file_allow_write (struct file *);
 
+/* Write-through mode. */
+void file_set_write_through (struct file *, bool);
+
 /* File position. */
 void file_seek (struct file *, off_t);
 off_t file_tell (struct file *);
 off_t file_length (struct file *);
+bool file_truncate (struct file *, off_t length);
+bool file_allocate (struct file *, off_t offset, off_t length);
+bool file_defrag (struct file *);
 
 #endif /* filesys/file.h */
@@ -5,6 +5,9 @@
 #include "filesys/free-map.h"
 #include "filesys/inode.h"
 #include "filesys/cache.h"
+#include "filesys/dcache.h"
+#include "filesys/journal.h"
+#include "filesys/tmpfs.h"
 #include "threads/thread.h"
 
 /* Partition that contains the file system. */
@@ -23,14 +26,20 @@ filesys_init (bool format)
 
   inode_init ();
   free_map_init ();
+  dir_init ();
 
   if (!cache_init ())
     PANIC ("Could not initialize cache");
+  if (!dcache_init ())
+    PANIC ("Could not initialize directory entry cache");
 
   if (format) 
     do_format ();
 
+  /* Replay before reading any metadata. */
+  journal_open ();
   free_map_open ();
+  cache_warm_up ();
   thread_current ()->cwd = dir_open_root ();
 }
 
@@ -39,6 +48,8 @@ filesys_init (bool format)
 void
 filesys_done (void) 
 {
+  cache_save_warm ();
+  journal_commit ();
   free_map_close ();
   cache_write_all ();
 }
@@ -50,17 +61,32 @@ filesys_done (void)
    or if internal memory allocation fails. */
 bool
 filesys_create (const char *path, off_t initial_size) 
+{
+  return filesys_create_at (NULL, path, initial_size);
+}
+
+/* Like filesys_create(), but a relative PATH is resolved starting at
+   directory BASE, unless BASE is null. */
+bool
+filesys_create_at (struct dir *base, const char *path, off_t initial_size)
 {
   block_sector_t inode_sector = 0;
-  struct dir *dir = dir_open_dirs (path);
-  const char *name = dir_parse_filename (path);
-  bool success = (dir != NULL
-                  && free_map_allocate (1, &inode_sector)
-                  && inode_create (inode_sector, initial_size, false)
-                  && dir_add (dir, name, inode_sector));
+  struct dir *dir;
+  const char *name;
+  bool success;
+
+  journal_begin ();
+  dir = dir_open_dirs_at (base, path);
+  name = dir_parse_filename (path);
+  success = (dir != NULL
+             && inode_alloc_inumber (dir_get_inode (dir), false,
+                                     &inode_sector)
+             && inode_create (inode_sector, initial_size, false)
+             && dir_add (dir, name, inode_sector));
   if (!success && inode_sector != 0) 
-    free_map_release (inode_sector, 1);
+    inode_free_inumber (inode_sector);
   dir_close (dir);
+  journal_end ();
 
   return success;
 }
@@ -72,6 +98,13 @@ filesys_create (const char *path, off_t initial_size)
    /a/b/c does not. */
 bool
 filesys_mkdir (const char *path) 
+{
+  return filesys_mkdir_at (NULL, path);
+}
+
+/* Like filesys_mkdir(), but relative to BASE. */
+bool
+filesys_mkdir_at (struct dir *base, const char *path)
 {
   struct dir *parent_dir = NULL, *dir = NULL;
   struct inode *inode = NULL;
@@ -80,13 +113,15 @@ filesys_mkdir (const char *path)
 
   ASSERT (path != NULL);
 
-  parent_dir = dir_open_dirs (path);
+  journal_begin ();
+  parent_dir = dir_open_dirs_at (base, path);
   dir_name = dir_parse_filename (path);
   if (dir_name[0] == '\0')
     goto fail;  /* Name is empty. */
   if (parent_dir == NULL
-      || !free_map_allocate (1, &inode_sector)
-      || !dir_create (inode_sector))
+      || !inode_alloc_inumber (dir_get_inode (parent_dir), true,
+                               &inode_sector)
+      || !dir_create (inode_sector, dir_use_index))
     goto fail;
   /* dir inode created successfully. Now link the dirs. */
   inode = inode_open (inode_sector);
@@ -100,6 +135,7 @@ filesys_mkdir (const char *path)
     goto fail;
   dir_close (dir);
   dir_close (parent_dir);
+  journal_end ();
   return true;
 
 fail:
@@ -108,9 +144,10 @@ fail:
   if (dir != NULL)
     dir_close (dir);
   if (inode == NULL && inode_sector != 0)
-    free_map_release (inode_sector, 1);
+    inode_free_inumber (inode_sector);
   if (parent_dir != NULL)
     dir_close (parent_dir);
+  journal_end ();
   return false;
 }
 
@@ -125,12 +162,55 @@ filesys_readdir (struct dir *dir, char *name)
   return dir_readdir (dir, name);
 }
 
+/* Reads up to CNT directory entries from DIR into ENTRIES, along with
+   the inumber, type and length of each, and returns how many it read.
+   ENTRIES may be in user memory, so it is only written to with no
+   locks held. */
+size_t
+filesys_getdents (struct dir *dir, struct dirent *entries, size_t cnt)
+{
+  char name[NAME_MAX + 1];
+  block_sector_t sector;
+  struct inode *inode;
+  size_t i, n;
+
+  ASSERT (dir != NULL);
+  for (n = 0; n < cnt && dir_readdir_sector (dir, name, &sector); n++)
+    {
+      entries[n].inumber = tmpfs_resolve (sector);
+      strlcpy (entries[n].name, name, sizeof entries[n].name);
+    }
+
+  /* Queue every inode sector before reading any, so that the disk
+     queue, which is kept in sector order, fetches them in one sweep
+     instead of one seek per entry. */
+  for (i = 0; i < n; i++)
+    if (!inode_prefetch (entries[i].inumber))
+      break;
+
+  for (i = 0; i < n; i++)
+    {
+      inode = inode_open (entries[i].inumber);
+      entries[i].isdir = inode != NULL && inode_isdir (inode);
+      entries[i].length = inode != NULL ? inode_length (inode) : 0;
+      inode_close (inode);
+    }
+  return n;
+}
+
 /* Opens the file/dir with the given PATH. 
    Sets *ISDIR according to what is found at PATH if ISDIR is not NULL.
    Returns the new file/dir if successful or a null pointer otherwise.
    Fails if PATH doesn't exist, or if an internal memory allocation fails. */
 void *
 filesys_open (const char *path, bool *isdir)
+{
+  return filesys_open_at (NULL, path, isdir);
+}
+
+/* Like filesys_open(), but relative to BASE. */
+void *
+filesys_open_at (struct dir *base, const char *path, bool *isdir)
 {
   struct dir *dir;
   const char *name;
@@ -139,7 +219,7 @@ filesys_open (const char *path, bool *isdir)
 
   ASSERT (path != NULL);
 
-  dir = dir_open_dirs (path);
+  dir = dir_open_dirs_at (base, path);
   if (!strcmp (path, "/"))
     name = ".";  /* The root directory doesn't have a name by default. */
   else
@@ -155,6 +235,59 @@ filesys_open (const char *path, bool *isdir)
                              : (void *) file_open (inode);
 }
 
+/* Stores the metadata of INODE in *ST, leaving out EXTRA_OPENS of its
+   openers. */
+static void
+stat_inode (struct inode *inode, int extra_opens, struct stat *st)
+{
+  st->inumber = inode_get_inumber (inode);
+  st->isdir = inode_isdir (inode);
+  st->length = inode_length (inode);
+  st->open_cnt = inode_open_count (inode) - extra_opens;
+}
+
+/* Stores the metadata of the file/dir at PATH in *ST, resolving PATH
+   once and without opening a file or dir for it.
+   Returns true if successful, false if PATH doesn't exist. */
+bool
+filesys_stat (const char *path, struct stat *st)
+{
+  struct dir *dir;
+  const char *name;
+  struct inode *inode = NULL;
+  bool found = false;
+
+  ASSERT (path != NULL);
+
+  dir = dir_open_dirs (path);
+  if (!strcmp (path, "/"))
+    name = ".";  /* The root directory doesn't have a name by default. */
+  else
+    name = dir_parse_filename (path);
+  if (dir != NULL)
+    found = dir_lookup (dir, name, &inode);
+  dir_close (dir);
+  if (!found)
+    return false;
+  stat_inode (inode, 1, st);
+  inode_close (inode);
+  return true;
+}
+
+/* Stores the metadata of file FILE in *ST. */
+void
+filesys_file_stat (struct file *file, struct stat *st)
+{
+  stat_inode (file_get_inode (file), 0, st);
+}
+
+/* Stores the metadata of directory DIR in *ST. */
+void
+filesys_dir_stat (struct dir *dir, struct stat *st)
+{
+  stat_inode (dir_get_inode (dir), 0, st);
+}
+
 /* Returns the inumber of directory DIR. */
 int 
 filesys_dir_inumber (struct dir *dir)
@@ -169,6 +302,20 @@ filesys_file_inumber (struct file *file)
   return inode_get_inumber (file_get_inode (file));
 }
 
+/* Writes the dirty sectors of directory DIR to disk. */
+void
+filesys_dir_sync (struct dir *dir)
+{
+  inode_sync (dir_get_inode (dir));
+}
+
+/* Writes the dirty sectors of file FILE to disk. */
+void
+filesys_file_sync (struct file *file)
+{
+  inode_sync (file_get_inode (file));
+}
+
 /* Deletes the file/dir at PATH.
    Returns true if successful, false on failure.
    Fails if PATH does not exist,
@@ -177,10 +324,111 @@ filesys_file_inumber (struct file *file)
 bool
 filesys_remove (const char *path) 
 {
-  struct dir *dir = dir_open_dirs (path);
-  const char *name = dir_parse_filename (path);
-  bool success = dir != NULL && dir_remove (dir, name);
+  return filesys_remove_at (NULL, path);
+}
+
+/* Like filesys_remove(), but relative to BASE. */
+bool
+filesys_remove_at (struct dir *base, const char *path)
+{
+  struct dir *dir;
+  const char *name;
+  bool success;
+
+  journal_begin ();
+  dir = dir_open_dirs_at (base, path);
+  name = dir_parse_filename (path);
+  success = dir != NULL && dir_remove (dir, name);
   dir_close (dir); 
+  journal_end ();
+  return success;
+}
+
+/* Moves the file/dir at OLD_PATH to NEW_PATH, replacing any file, or
+   empty directory, already there, all at once: a crash leaves it at one
+   path or the other. Returns true if successful, false on failure.
+   Fails if OLD_PATH does not exist, if NEW_PATH's directories do not,
+   if NEW_PATH is a non-empty or open directory, or a file in place of
+   a directory or the reverse, or if a directory would be moved inside
+   itself. */
+bool
+filesys_rename (const char *old_path, const char *new_path)
+{
+  struct dir *old_dir, *new_dir;
+  bool success;
+
+  journal_begin ();
+  old_dir = dir_open_dirs (old_path);
+  new_dir = dir_open_dirs (new_path);
+  success = (old_dir != NULL && new_dir != NULL
+             && dir_rename (old_dir, dir_parse_filename (old_path),
+                            new_dir, dir_parse_filename (new_path)));
+  dir_close (old_dir);
+  dir_close (new_dir);
+  journal_end ();
+  return success;
+}
+
+/* Creates a file at NEW_PATH with the contents of the file at
+   OLD_PATH, which shares its data sectors until either is written, as
+   inode_clone() does, or gets a copy of them if they can't be shared.
+   Returns true if successful, false if OLD_PATH isn't a file, NEW_PATH
+   already exists or a directory in it doesn't, or memory or disk space
+   runs out. */
+bool
+filesys_clone (const char *old_path, const char *new_path)
+{
+  block_sector_t inode_sector = 0;
+  struct file *src, *dst = NULL;
+  struct dir *dir;
+  bool isdir, created = false, success = false;
+
+  src = filesys_open (old_path, &isdir);
+  if (src == NULL)
+    return false;
+  if (isdir)
+    {
+      dir_close ((struct dir *) src);
+      return false;
+    }
+
+  journal_begin ();
+  dir = dir_open_dirs (new_path);
+  if (dir != NULL
+      && inode_alloc_inumber (dir_get_inode (dir), false, &inode_sector))
+    created = inode_clone (file_get_inode (src), inode_sector);
+  journal_end ();
+
+  /* Copy what can't be shared, outside of a journal handle, since that
+     can take a while. */
+  if (inode_sector != 0 && !created
+      && inode_create (inode_sector, 0, false))
+    {
+      off_t length = file_length (src);
+
+      created = true;
+      dst = file_open (inode_open (inode_sector));
+      if (dst == NULL || file_copy (dst, src, length) != length)
+        goto done;
+    }
+
+  journal_begin ();
+  success = created && dir_add (dir, dir_parse_filename (new_path),
+                                inode_sector);
+  journal_end ();
+
+ done:
+  if (!success && created)
+    {
+      struct inode *inode = inode_open (inode_sector);
+      inode_remove (inode);
+      inode_close (inode);
+    }
+  else if (!success && inode_sector != 0)
+    inode_free_inumber (inode_sector);
+  file_close (dst);
+  file_close (src);
+  dir_close (dir);
   return success;
 }
 
@@ -193,7 +441,9 @@ do_format (void)
 
   printf ("Formatting file system...");
   free_map_create ();
-  if (!dir_create (ROOT_DIR_SECTOR))
+  journal_create ();
+  cache_create_warm ();
+  if (!dir_create (ROOT_DIR_SECTOR, dir_use_index))
     PANIC ("root directory creation failed");
   /* Open the created root directory. */
   root_inode = inode_open (ROOT_DIR_SECTOR);
@@ -259,6 +509,13 @@ filesys_closedir (struct dir *dir)
   dir_close (dir);
 }
 
+/* Wrapper for dir_reopen. */
+struct dir *
+filesys_reopendir (struct dir *dir)
+{
+  return dir_reopen (dir);
+}
+
 /* Wrapper for file_close. */
 void 
 filesys_close (struct file *file)
@@ -266,6 +523,13 @@ filesys_close (struct file *file)
   file_close (file);
 }
 
+/* Wrapper for file_reopen. */
+struct file *
+filesys_reopen (struct file *file)
+{
+  return file_reopen (file);
+}
+
 /* Wrapper for file_length. */
 int 
 filesys_filesize (struct file *file)
@@ -273,6 +537,34 @@ filesys_filesize (struct file *file)
   return file_length (file);
 }
 
+/* Wrapper for file_truncate. */
+bool
+filesys_truncate (struct file *file, off_t length)
+{
+  return file_truncate (file, length);
+}
+
+/* Wrapper for file_allocate. */
+bool
+filesys_allocate (struct file *file, off_t offset, off_t length)
+{
+  return file_allocate (file, offset, length);
+}
+
+/* Wrapper for file_defrag. */
+bool
+filesys_defrag (struct file *file)
+{
+  return file_defrag (file);
+}
+
+/* Wrapper for file_set_write_through. */
+void
+filesys_set_write_through (struct file *file, bool write_through)
+{
+  file_set_write_through (file, write_through);
+}
+
 /* Wrapper for file_read_at. */
 off_t 
 filesys_read_at (struct file *file, void *buffer, off_t size, off_t start)
@@ -280,9 +572,32 @@ filesys_read_at (struct file *file, void *buffer, off_t size, off_t start)
   return file_read_at (file, buffer, size, start);
 }
 
+/* Wrapper for file_read_uncached_at. */
+off_t
+filesys_read_uncached_at (struct file *file, void *buffer, off_t size,
+                          off_t start)
+{
+  return file_read_uncached_at (file, buffer, size, start);
+}
+
 /* Wrapper for file_write_at. */
 off_t filesys_write_at (struct file *file, const void *buffer, 
                         off_t size, off_t start)
 {
   return file_write_at (file, buffer, size, start);
 }
+
+/* Wrapper for file_copy. */
+off_t
+filesys_copy (struct file *dst, struct file *src, off_t size)
+{
+  return file_copy (dst, src, size);
+}
+
+/* Wrapper for file_write_changed_at. */
+off_t
+filesys_write_changed_at (struct file *file, const void *buffer,
+                          off_t size, off_t start)
+{
+  return file_write_changed_at (file, buffer, size, start);
+}
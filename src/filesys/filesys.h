@@ -1,7 +1,10 @@
 #ifndef FILESYS_FILESYS_H
 #define FILESYS_FILESYS_H
 
+#include <dirent.h>
+#include <stat.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include "filesys/off_t.h"
 #include "filesys/directory.h"
 #include "filesys/file.h"
@@ -12,6 +15,8 @@
 /* Sectors of system file inodes. */
 #define FREE_MAP_SECTOR 0       /* Free map file inode sector. */
 #define ROOT_DIR_SECTOR 1       /* Root directory file inode sector. */
+#define JOURNAL_SECTOR 2        /* Journal superblock sector. */
+#define WARM_SECTOR 3           /* Cache warm-up list sector. */
 
 /* Block device that contains the file system. */
 extern struct block *fs_device;
@@ -22,27 +27,51 @@ void filesys_done (void);
 
 /* File operations. */
 bool filesys_create (const char *path, off_t initial_size);
+bool filesys_create_at (struct dir *base, const char *path,
+                        off_t initial_size);
 void filesys_close (struct file *);
+struct file *filesys_reopen (struct file *);
 off_t filesys_read (struct file *, void *buffer, off_t size);
 off_t filesys_read_at (struct file *, void *, off_t size, off_t start);
+off_t filesys_read_uncached_at (struct file *, void *, off_t size,
+                                off_t start);
 off_t filesys_write (struct file *, const void *buffer, off_t size);
 off_t filesys_write_at (struct file *, const void *, off_t size, off_t start);
+off_t filesys_copy (struct file *dst, struct file *src, off_t size);
+off_t filesys_write_changed_at (struct file *, const void *, off_t size,
+                                off_t start);
 void filesys_seek (struct file *, off_t position);
 off_t filesys_tell (struct file *);
 int filesys_file_inumber (struct file *);
 int filesys_filesize (struct file *);
+bool filesys_truncate (struct file *, off_t length);
+bool filesys_allocate (struct file *, off_t offset, off_t length);
+bool filesys_defrag (struct file *);
+void filesys_file_sync (struct file *);
+void filesys_set_write_through (struct file *, bool);
 void filesys_deny_write (struct file *);
 void filesys_allow_write (struct file *);
 
 /* Directory operations. */
 bool filesys_mkdir (const char *path);
+bool filesys_mkdir_at (struct dir *base, const char *path);
 void filesys_closedir (struct dir *);
+struct dir *filesys_reopendir (struct dir *);
 bool filesys_readdir (struct dir *, char *name);
+size_t filesys_getdents (struct dir *, struct dirent *, size_t cnt);
 int filesys_dir_inumber (struct dir *);
+void filesys_dir_sync (struct dir *);
 
 /* File and directory operations. */
 bool filesys_remove (const char *path);
+bool filesys_remove_at (struct dir *base, const char *path);
+bool filesys_rename (const char *old_path, const char *new_path);
+bool filesys_clone (const char *old_path, const char *new_path);
+bool filesys_stat (const char *path, struct stat *);
+void filesys_file_stat (struct file *, struct stat *);
+void filesys_dir_stat (struct dir *, struct stat *);
 void *filesys_open (const char *path, bool *isdir);
+void *filesys_open_at (struct dir *base, const char *path, bool *isdir);
 
 
 #endif /* filesys/filesys.h */
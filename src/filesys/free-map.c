@@ -1,79 +1,1139 @@
 #include "filesys/free-map.h"
 #include <bitmap.h>
 #include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include <tree.h>
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+
+/* Number of free map bits held by one sector of the free map
+   file. */
+#define BITS_PER_SECTOR (BLOCK_SECTOR_SIZE * 8)
+
+/* Sectors per block group, those tracked by one sector of the free
+   map file.  Allocations start looking near a hint, skipping groups
+   without room, so related sectors stay close together. */
+#define GROUP_SECTORS BITS_PER_SECTOR
 
 static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per sector. */
+static struct lock free_map_lock;    /* Guards the free map. */
+
+/* One bit per sector of the free map file, set if the sector has
+   changes not yet written to the file.  Allocations and releases
+   only mark sectors here; free_map_flush() writes them. */
+static struct bitmap *dirty_sectors;
+
+/* Number of free sectors in each block group, guarded by
+   free_map_lock. */
+static size_t *group_free;
+static size_t group_cnt;
+
+/* One bit per block group, set once the group's part of the free
+   map is in memory.  Mounting reads none of them: each is read from
+   the free map file the first time an allocation or release needs
+   it, and until then it looks entirely allocated in FREE_MAP, so
+   that scans pass over it, while its GROUP_FREE count is as if it
+   were entirely free, so that scan_near() gives it a try.  Guarded
+   by free_map_lock. */
+static struct bitmap *loaded_groups;
+static size_t loaded_cnt;
+
+/* A maximal run of free sectors in the part of the free map in
+   memory. */
+struct free_extent
+  {
+    struct tree_elem start_elem;        /* Element in extents_by_start. */
+    struct tree_elem cnt_elem;          /* Element in extents_by_cnt. */
+    block_sector_t start;               /* First free sector. */
+    size_t cnt;                         /* Number of free sectors. */
+  };
+
+/* The free runs of FREE_MAP, ordered by start and by length, so that
+   an allocation finds the run at a hint or the one that fits best in
+   logarithmic time instead of scanning the bitmap.  Block groups not
+   in memory look allocated, so they get their runs as they are read.
+   If memory for an extent runs out, the index is dropped until the
+   next mount and allocations go back to scanning (EXTENTS_OK is
+   false).  Guarded by free_map_lock. */
+static struct tree extents_by_start;
+static struct tree extents_by_cnt;
+static bool extents_ok;
+
+/* A run of allocated sectors that more than one file owns, since
+   cloning a file shares its data sectors with the clone instead of
+   copying them.  A sector is freed once its last owner releases it. */
+struct shared_run
+  {
+    struct tree_elem elem;              /* Element in shared_runs. */
+    block_sector_t start;               /* First sector. */
+    size_t cnt;                         /* Number of sectors. */
+    unsigned refs;                      /* Number of owners, at least 2
+                                           except within an update. */
+  };
+
+/* The shared runs, ordered by start and never overlapping.  Allocated
+   sectors in none of them have a single owner.  SHARED_DIRTY is set
+   when they have changed since being written to the free map file.
+   Guarded by free_map_lock. */
+static struct tree shared_runs;
+static bool shared_dirty;
+
+/* The free map file keeps the shared runs after the bitmap, from the
+   first sector boundary past it: a header, then one record per run. */
+#define SHARED_MAGIC 0x53484152
+struct shared_header
+  {
+    uint32_t magic;                     /* SHARED_MAGIC. */
+    uint32_t cnt;                       /* Number of records. */
+  };
+struct shared_record
+  {
+    block_sector_t start;
+    uint32_t cnt;
+    uint32_t refs;
+  };
+
+static tree_less_func extent_less_start, extent_less_cnt, shared_less;
+static struct free_extent *extent_at (block_sector_t sector);
+static struct free_extent *extent_after (block_sector_t sector);
+static void set_extent_cnt (struct free_extent *, size_t cnt);
+static void index_run (block_sector_t sector, size_t cnt);
+static void unindex_run (block_sector_t sector, size_t cnt);
+static void index_range (size_t start, size_t cnt);
+static void clear_index (void);
+static struct free_extent *best_fit (size_t cnt);
+static size_t find_extent (size_t cnt, block_sector_t near);
+static void mark_dirty (block_sector_t sector, size_t cnt);
+static void count_groups (block_sector_t sector, size_t cnt,
+                          bool allocated);
+static size_t group_sectors (size_t group);
+static void recount_group (size_t group);
+static void recount_groups (void);
+static void load_groups (size_t group, size_t cnt);
+static void load_sectors (block_sector_t sector, size_t cnt);
+static void load_all (void);
+static size_t scan_near (size_t cnt, block_sector_t near);
+static void release_bits (block_sector_t sector, size_t cnt);
+static struct shared_run *shared_at (block_sector_t sector);
+static struct shared_run *shared_after (block_sector_t sector);
+static bool split_shared (block_sector_t sector);
+static void merge_shared (block_sector_t sector, size_t cnt);
+static bool write_shared (void);
+static void read_shared (void);
 
 /* Initializes the free map. */
 void
 free_map_init (void) 
 {
+  lock_init (&free_map_lock);
   free_map = bitmap_create (block_size (fs_device));
   if (free_map == NULL)
     PANIC ("bitmap creation failed--file system device is too large");
+  dirty_sectors = bitmap_create (DIV_ROUND_UP (bitmap_file_size (free_map),
+                                               BLOCK_SECTOR_SIZE));
+  if (dirty_sectors == NULL)
+    PANIC ("bitmap creation failed--file system device is too large");
+  group_cnt = DIV_ROUND_UP (bitmap_size (free_map), GROUP_SECTORS);
+  group_free = malloc (group_cnt * sizeof *group_free);
+  loaded_groups = bitmap_create (group_cnt);
+  if (group_free == NULL || loaded_groups == NULL)
+    PANIC ("block group creation failed--file system device is too large");
+  bitmap_set_all (loaded_groups, true);
+  loaded_cnt = group_cnt;
   bitmap_mark (free_map, FREE_MAP_SECTOR);
   bitmap_mark (free_map, ROOT_DIR_SECTOR);
+  bitmap_mark (free_map, JOURNAL_SECTOR);
+  bitmap_mark (free_map, WARM_SECTOR);
+  recount_groups ();
+  tree_init (&extents_by_start, extent_less_start, NULL);
+  tree_init (&extents_by_cnt, extent_less_cnt, NULL);
+  extents_ok = true;
+  index_range (0, bitmap_size (free_map));
+  tree_init (&shared_runs, shared_less, NULL);
+}
+
+/* Orders free extents by start. */
+static bool
+extent_less_start (const struct tree_elem *a_, const struct tree_elem *b_,
+                   void *aux UNUSED)
+{
+  const struct free_extent *a = tree_entry (a_, struct free_extent,
+                                            start_elem);
+  const struct free_extent *b = tree_entry (b_, struct free_extent,
+                                            start_elem);
+  return a->start < b->start;
+}
+
+/* Orders free extents by length, then by start. */
+static bool
+extent_less_cnt (const struct tree_elem *a_, const struct tree_elem *b_,
+                 void *aux UNUSED)
+{
+  const struct free_extent *a = tree_entry (a_, struct free_extent,
+                                            cnt_elem);
+  const struct free_extent *b = tree_entry (b_, struct free_extent,
+                                            cnt_elem);
+  if (a->cnt != b->cnt)
+    return a->cnt < b->cnt;
+  return a->start < b->start;
+}
+
+/* Orders shared runs by start. */
+static bool
+shared_less (const struct tree_elem *a_, const struct tree_elem *b_,
+             void *aux UNUSED)
+{
+  const struct shared_run *a = tree_entry (a_, struct shared_run, elem);
+  const struct shared_run *b = tree_entry (b_, struct shared_run, elem);
+  return a->start < b->start;
+}
+
+/* Returns the free extent that starts at or last before SECTOR, or a
+   null pointer if there is none.
+   The caller must hold free_map_lock. */
+static struct free_extent *
+extent_at (block_sector_t sector)
+{
+  struct free_extent key;
+  struct tree_elem *e;
+
+  key.start = sector;
+  e = tree_floor (&extents_by_start, &key.start_elem);
+  return e != NULL ? tree_entry (e, struct free_extent, start_elem) : NULL;
+}
+
+/* Returns the free extent that starts after SECTOR, or a null pointer
+   if there is none.
+   The caller must hold free_map_lock. */
+static struct free_extent *
+extent_after (block_sector_t sector)
+{
+  struct free_extent key;
+  struct tree_elem *e;
+
+  key.start = sector;
+  e = tree_next (&extents_by_start, &key.start_elem);
+  return e != NULL ? tree_entry (e, struct free_extent, start_elem) : NULL;
+}
+
+/* Sets the length of free extent E, which is in the index, to CNT. */
+static void
+set_extent_cnt (struct free_extent *e, size_t cnt)
+{
+  tree_remove (&extents_by_cnt, &e->cnt_elem);
+  e->cnt = cnt;
+  tree_insert (&extents_by_cnt, &e->cnt_elem);
+}
+
+/* Adds the CNT sectors starting at SECTOR, just freed, to the index,
+   merging them with the extents on either side.
+   The caller must hold free_map_lock. */
+static void
+index_run (block_sector_t sector, size_t cnt)
+{
+  struct free_extent *prev, *next;
+
+  if (!extents_ok)
+    return;
+  prev = extent_at (sector);
+  if (prev != NULL && prev->start + prev->cnt != sector)
+    prev = NULL;
+  next = extent_after (sector);
+  if (next != NULL && sector + cnt != next->start)
+    next = NULL;
+
+  if (prev != NULL && next != NULL)
+    {
+      tree_remove (&extents_by_start, &next->start_elem);
+      tree_remove (&extents_by_cnt, &next->cnt_elem);
+      set_extent_cnt (prev, prev->cnt + cnt + next->cnt);
+      free (next);
+    }
+  else if (prev != NULL)
+    set_extent_cnt (prev, prev->cnt + cnt);
+  else if (next != NULL)
+    {
+      /* Moving its start back keeps NEXT in order by start. */
+      tree_remove (&extents_by_cnt, &next->cnt_elem);
+      next->start = sector;
+      next->cnt += cnt;
+      tree_insert (&extents_by_cnt, &next->cnt_elem);
+    }
+  else
+    {
+      struct free_extent *e = malloc (sizeof *e);
+      if (e == NULL)
+        {
+          clear_index ();
+          extents_ok = false;
+          return;
+        }
+      e->start = sector;
+      e->cnt = cnt;
+      tree_insert (&extents_by_start, &e->start_elem);
+      tree_insert (&extents_by_cnt, &e->cnt_elem);
+    }
+}
+
+/* Takes the CNT sectors starting at SECTOR, just allocated, out of
+   the free extent holding them.
+   The caller must hold free_map_lock. */
+static void
+unindex_run (block_sector_t sector, size_t cnt)
+{
+  struct free_extent *e;
+  size_t left, right;
+
+  if (!extents_ok)
+    return;
+  e = extent_at (sector);
+  ASSERT (e != NULL && e->start + e->cnt >= sector + cnt);
+  left = sector - e->start;
+  right = e->start + e->cnt - (sector + cnt);
+
+  if (left == 0 && right == 0)
+    {
+      tree_remove (&extents_by_start, &e->start_elem);
+      tree_remove (&extents_by_cnt, &e->cnt_elem);
+      free (e);
+    }
+  else if (left == 0)
+    {
+      /* Moving its start forward keeps E in order by start. */
+      tree_remove (&extents_by_cnt, &e->cnt_elem);
+      e->start = sector + cnt;
+      e->cnt = right;
+      tree_insert (&extents_by_cnt, &e->cnt_elem);
+    }
+  else if (right == 0)
+    set_extent_cnt (e, left);
+  else
+    {
+      struct free_extent *r = malloc (sizeof *r);
+      if (r == NULL)
+        {
+          clear_index ();
+          extents_ok = false;
+          return;
+        }
+      set_extent_cnt (e, left);
+      r->start = sector + cnt;
+      r->cnt = right;
+      tree_insert (&extents_by_start, &r->start_elem);
+      tree_insert (&extents_by_cnt, &r->cnt_elem);
+    }
+}
+
+/* Adds the free runs among the CNT sectors starting at START, which
+   were not free in the index, to it.
+   The caller must hold free_map_lock, unless it is the only thread. */
+static void
+index_range (size_t start, size_t cnt)
+{
+  size_t end = start + cnt;
+
+  while (start < end && extents_ok)
+    {
+      size_t first = bitmap_scan (free_map, start, 1, false);
+      size_t last;
+
+      if (first == BITMAP_ERROR || first >= end)
+        break;
+      last = bitmap_scan (free_map, first, 1, true);
+      if (last == BITMAP_ERROR || last > end)
+        last = end;
+      index_run (first, last - first);
+      start = last;
+    }
+}
+
+/* Empties the index.
+   The caller must hold free_map_lock, unless it is the only thread. */
+static void
+clear_index (void)
+{
+  struct tree_elem *e;
+
+  while ((e = tree_min (&extents_by_start)) != NULL)
+    {
+      struct free_extent *x = tree_entry (e, struct free_extent, start_elem);
+      tree_remove (&extents_by_start, &x->start_elem);
+      tree_remove (&extents_by_cnt, &x->cnt_elem);
+      free (x);
+    }
+}
+
+/* Returns the smallest free extent at least CNT sectors long, or a
+   null pointer if there is none.
+   The caller must hold free_map_lock. */
+static struct free_extent *
+best_fit (size_t cnt)
+{
+  struct free_extent key;
+  struct tree_elem *e;
+
+  key.start = 0;
+  key.cnt = cnt;
+  e = tree_ceiling (&extents_by_cnt, &key.cnt_elem);
+  return e != NULL ? tree_entry (e, struct free_extent, cnt_elem) : NULL;
+}
+
+/* Returns the first of CNT free sectors from the index: at NEAR, or
+   the start of the extent after it, if that extent has room, so that
+   related sectors stay together, and otherwise the start of the
+   smallest extent with room.  Returns BITMAP_ERROR if no extent in
+   memory has room.
+   The caller must hold free_map_lock. */
+static size_t
+find_extent (size_t cnt, block_sector_t near)
+{
+  struct free_extent *e = extent_at (near);
+
+  if (e == NULL || e->start + e->cnt <= near)
+    e = extent_after (near);
+  if (e != NULL)
+    {
+      size_t start = e->start > near ? e->start : near;
+      if (e->start + e->cnt - start >= cnt)
+        return start;
+    }
+  e = best_fit (cnt);
+  return e != NULL ? e->start : BITMAP_ERROR;
+}
+
+/* Marks the free map file sectors holding the bits for the CNT
+   sectors starting at SECTOR as needing to be written.
+   The caller must hold free_map_lock. */
+static void
+mark_dirty (block_sector_t sector, size_t cnt)
+{
+  size_t first = sector / BITS_PER_SECTOR;
+  size_t last = (sector + cnt - 1) / BITS_PER_SECTOR;
+
+  ASSERT (cnt > 0);
+  bitmap_set_multiple (dirty_sectors, first, last - first + 1, true);
+}
+
+/* Updates the block group free counts for the CNT sectors starting at
+   SECTOR having been ALLOCATED, or released if false.
+   The caller must hold free_map_lock, unless it is the only thread. */
+static void
+count_groups (block_sector_t sector, size_t cnt, bool allocated)
+{
+  while (cnt > 0)
+    {
+      size_t group = sector / GROUP_SECTORS;
+      size_t n = (group + 1) * GROUP_SECTORS - sector;
+
+      if (n > cnt)
+        n = cnt;
+      if (allocated)
+        group_free[group] -= n;
+      else
+        group_free[group] += n;
+      sector += n;
+      cnt -= n;
+    }
+}
+
+/* Returns the number of sectors in block GROUP, which is less than
+   GROUP_SECTORS only for the last group. */
+static size_t
+group_sectors (size_t group)
+{
+  size_t size = bitmap_size (free_map);
+  size_t start = group * GROUP_SECTORS;
+
+  return size - start < GROUP_SECTORS ? size - start : GROUP_SECTORS;
+}
+
+/* Counts the free sectors of block GROUP from scratch.
+   The caller must hold free_map_lock, unless it is the only thread. */
+static void
+recount_group (size_t group)
+{
+  group_free[group] = bitmap_count (free_map, group * GROUP_SECTORS,
+                                    group_sectors (group), false);
+}
+
+/* Counts the free sectors of every block group from scratch.
+   The caller must hold free_map_lock, unless it is the only thread. */
+static void
+recount_groups (void)
+{
+  for (size_t group = 0; group < group_cnt; group++)
+    recount_group (group);
+}
+
+/* Reads the parts of the free map for those of the CNT block groups
+   starting at GROUP that are not in memory yet, each run of them in
+   a single read of the free map file, so that big runs go straight
+   from the disk.
+   The caller must hold free_map_lock, unless it is the only thread. */
+static void
+load_groups (size_t group, size_t cnt)
+{
+  size_t end = group + cnt;
+
+  ASSERT (end <= group_cnt);
+  while (group < end)
+    {
+      size_t first = bitmap_scan (loaded_groups, group, 1, false);
+      size_t last, start, bit_cnt;
+
+      if (first == BITMAP_ERROR || first >= end)
+        break;
+      last = bitmap_scan (loaded_groups, first, 1, true);
+      if (last == BITMAP_ERROR || last > end)
+        last = end;
+
+      start = first * GROUP_SECTORS;
+      bit_cnt = (last - 1) * GROUP_SECTORS + group_sectors (last - 1) - start;
+      if (!bitmap_read_range (free_map, free_map_file, start, bit_cnt))
+        PANIC ("can't read free map");
+      bitmap_set_multiple (loaded_groups, first, last - first, true);
+      loaded_cnt += last - first;
+      for (group = first; group < last; group++)
+        recount_group (group);
+      index_range (start, bit_cnt);
+    }
+}
+
+/* Reads the parts of the free map for the block groups holding the
+   CNT sectors starting at SECTOR, if they are not in memory yet.
+   The caller must hold free_map_lock. */
+static void
+load_sectors (block_sector_t sector, size_t cnt)
+{
+  size_t first = sector / GROUP_SECTORS;
+  size_t last = (sector + cnt - 1) / GROUP_SECTORS;
+
+  ASSERT (cnt > 0);
+  load_groups (first, last - first + 1);
+}
+
+/* Reads every part of the free map not in memory yet, for searches
+   that have to see all of it.
+   The caller must hold free_map_lock. */
+static void
+load_all (void)
+{
+  if (loaded_cnt < group_cnt)
+    load_groups (0, group_cnt);
+}
+
+/* Returns the first of CNT consecutive free sectors, looking from
+   NEAR onward first, past groups with too few free sectors to hold
+   them, and then anywhere: in the best fitting free extent, or if
+   the index was dropped, from the start of the device.  Groups not
+   in memory are read in as the search reaches them, and all the rest
+   only if the groups in memory have no such run.  Returns
+   BITMAP_ERROR if there is no such run.
+   The caller must hold free_map_lock. */
+static size_t
+scan_near (size_t cnt, block_sector_t near)
+{
+  size_t from = near < bitmap_size (free_map) ? near : 0;
+  size_t sector;
+
+  if (cnt <= GROUP_SECTORS)
+    {
+      size_t group = from / GROUP_SECTORS;
+      for (; group < group_cnt; group++)
+        if (group_free[group] >= cnt)
+          {
+            load_groups (group, 1);
+            if (group_free[group] >= cnt)
+              break;
+          }
+      if (group == group_cnt)
+        from = 0;
+      else if (group != from / GROUP_SECTORS)
+        from = group * GROUP_SECTORS;
+    }
+  else
+    load_all ();
+
+  for (;;)
+    {
+      if (extents_ok)
+        sector = find_extent (cnt, from);
+      else
+        {
+          sector = bitmap_scan (free_map, from, cnt, false);
+          if (sector == BITMAP_ERROR && from != 0)
+            sector = bitmap_scan (free_map, 0, cnt, false);
+        }
+      if (sector != BITMAP_ERROR || loaded_cnt == group_cnt)
+        return sector;
+      load_all ();
+    }
+}
+
+/* Writes the changed sectors of the free map to the free map
+   file, through the buffer cache, along with the shared runs if they
+   have changed.  Called before the cache writes
+   dirty sectors back to disk, so that a sector's allocation
+   reaches the disk no later than the metadata that points to it.
+   Returns true if successful, false if the free map file could
+   not be written. */
+bool
+free_map_flush (void)
+{
+  size_t bit_cnt = bitmap_size (free_map);
+  size_t i;
+  bool success = true;
+
+  /* Writing to the free map file takes a journal handle, which can't be
+     started with FREE_MAP_LOCK held. */
+  journal_begin ();
+  lock_acquire (&free_map_lock);
+  /* The shared runs go first, since making room for them allocates. */
+  if (free_map_file != NULL && shared_dirty && !write_shared ())
+    success = false;
+  if (free_map_file != NULL)
+    for (i = bitmap_scan (dirty_sectors, 0, 1, true);
+         i != BITMAP_ERROR;
+         i = bitmap_scan (dirty_sectors, i + 1, 1, true))
+      {
+        size_t start = i * BITS_PER_SECTOR;
+        size_t cnt = bit_cnt - start < BITS_PER_SECTOR
+                     ? bit_cnt - start : BITS_PER_SECTOR;
+        if (!bitmap_write_range (free_map, free_map_file, start, cnt))
+          {
+            success = false;
+            break;
+          }
+        bitmap_reset (dirty_sectors, i);
+      }
+  lock_release (&free_map_lock);
+  journal_end ();
+  return success;
 }
 
 /* Allocates CNT consecutive sectors from the free map and stores
-   the first into *SECTORP.
+   the first into *SECTORP.  The run is at or right after NEAR if it
+   has room there, so that callers can keep sectors close to those
+   they are used along with, and otherwise the smallest free run that
+   has room.
    Returns true if successful, false if not enough consecutive
-   sectors were available or if the free_map file could not be
-   written. */
+   sectors were available. */
 bool
-free_map_allocate (size_t cnt, block_sector_t *sectorp)
+free_map_allocate (size_t cnt, block_sector_t near, block_sector_t *sectorp)
 {
-  block_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
-  if (sector != BITMAP_ERROR
-      && free_map_file != NULL
-      && !bitmap_write (free_map, free_map_file))
+  block_sector_t sector;
+
+  lock_acquire (&free_map_lock);
+  sector = scan_near (cnt, near);
+  if (sector != BITMAP_ERROR)
     {
-      bitmap_set_multiple (free_map, sector, cnt, false); 
-      sector = BITMAP_ERROR;
+      bitmap_set_multiple (free_map, sector, cnt, true);
+      mark_dirty (sector, cnt);
+      count_groups (sector, cnt, true);
+      unindex_run (sector, cnt);
     }
+  lock_release (&free_map_lock);
   if (sector != BITMAP_ERROR)
     *sectorp = sector;
   return sector != BITMAP_ERROR;
 }
 
-/* Makes CNT sectors starting at SECTOR available for use. */
+/* Looks for free runs of sectors within [FROM, TO), updating
+   *BEST_START and *BEST_CNT whenever a run longer than *BEST_CNT
+   turns up.  Stops early once a run of MAX sectors is found. */
+static void
+find_free_run (size_t from, size_t to, size_t max,
+               size_t *best_start, size_t *best_cnt)
+{
+  while (from < to && *best_cnt < max)
+    {
+      size_t start = bitmap_scan (free_map, from, 1, false);
+      size_t end;
+
+      if (start == BITMAP_ERROR || start >= to)
+        break;
+      end = bitmap_scan (free_map, start, 1, true);
+      if (end == BITMAP_ERROR || end > to)
+        end = to;
+      if (end - start > *best_cnt)
+        {
+          *best_start = start;
+          *best_cnt = end - start;
+        }
+      from = end;
+    }
+}
+
+/* Like find_free_run() on the whole device, using the index: sets
+   *BEST_START and *BEST_CNT to the free extent right after NEAR if it
+   has MAX sectors, otherwise to the smallest extent that does, and
+   failing that to the longest one.  Leaves them alone if no sector
+   is free. */
+static void
+find_free_extent (block_sector_t near, size_t max,
+                  size_t *best_start, size_t *best_cnt)
+{
+  struct free_extent *e = extent_after (near);
+  struct tree_elem *longest;
+
+  if (e == NULL || e->cnt < max)
+    e = best_fit (max);
+  if (e == NULL && (longest = tree_max (&extents_by_cnt)) != NULL)
+    e = tree_entry (longest, struct free_extent, cnt_elem);
+  if (e != NULL)
+    {
+      *best_start = e->start;
+      *best_cnt = e->cnt;
+    }
+}
+
+/* Allocates a run of at most MAX consecutive sectors and stores
+   the first into *SECTORP.  If NEAR is free, the run starts
+   there, so that a caller can grow a run it already has in
+   place.  Otherwise it is the free run right after NEAR if that
+   has MAX sectors, or else the smallest one that does, or failing
+   that the longest free run, among the block groups whose free
+   map is in memory, or if none of those has a free sector, on the
+   whole device.  (If the free extent index was dropped, the first
+   run of MAX sectors scanning forward from NEAR stands in for the
+   smallest.)
+   Returns the number of sectors allocated, or 0 if none are
+   free. */
+size_t
+free_map_allocate_run (size_t max, block_sector_t near,
+                       block_sector_t *sectorp)
+{
+  size_t size = bitmap_size (free_map);
+  size_t start = BITMAP_ERROR, cnt = 0;
+
+  ASSERT (max > 0);
+  if (near >= size)
+    near = 0;
+
+  lock_acquire (&free_map_lock);
+  load_sectors (near, 1);
+  if (!bitmap_test (free_map, near))
+    {
+      start = near;
+      if (extents_ok)
+        {
+          struct free_extent *e = extent_at (near);
+          cnt = e->start + e->cnt - near;
+        }
+      else
+        {
+          size_t end = bitmap_scan (free_map, near, 1, true);
+          cnt = (end != BITMAP_ERROR ? end : size) - near;
+        }
+    }
+  else
+    for (;;)
+      {
+        if (extents_ok)
+          find_free_extent (near, max, &start, &cnt);
+        else
+          {
+            find_free_run (near, size, max, &start, &cnt);
+            find_free_run (0, near, max, &start, &cnt);
+          }
+        if (cnt > 0 || loaded_cnt == group_cnt)
+          break;
+        load_all ();
+      }
+  if (cnt > max)
+    cnt = max;
+  if (cnt > 0)
+    {
+      bitmap_set_multiple (free_map, start, cnt, true);
+      mark_dirty (start, cnt);
+      count_groups (start, cnt, true);
+      unindex_run (start, cnt);
+      *sectorp = start;
+    }
+  lock_release (&free_map_lock);
+  return cnt;
+}
+
+/* Frees the CNT allocated sectors starting at SECTOR in the bitmap.
+   The caller must hold free_map_lock. */
+static void
+release_bits (block_sector_t sector, size_t cnt)
+{
+  load_sectors (sector, cnt);
+  ASSERT_SLOW (bitmap_all (free_map, sector, cnt));
+  bitmap_set_multiple (free_map, sector, cnt, false);
+  mark_dirty (sector, cnt);
+  count_groups (sector, cnt, false);
+  index_run (sector, cnt);
+}
+
+/* Gives up one owner's hold on the CNT sectors starting at SECTOR,
+   making those it was the last owner of available for use.  If
+   memory to split a shared run runs out, the sectors stay allocated
+   for good, which is safer than freeing any of them too early. */
 void
 free_map_release (block_sector_t sector, size_t cnt)
 {
-  ASSERT (bitmap_all (free_map, sector, cnt));
-  bitmap_set_multiple (free_map, sector, cnt, false);
-  bitmap_write (free_map, free_map_file);
+  block_sector_t end = sector + cnt;
+  block_sector_t pos = sector;
+  struct shared_run *first;
+
+  lock_acquire (&free_map_lock);
+  first = shared_after (sector);
+  if (first == NULL || first->start >= end)
+    release_bits (sector, cnt);
+  else if (split_shared (sector) && split_shared (end))
+    {
+      while (pos < end)
+        {
+          struct shared_run *r = shared_after (pos);
+
+          if (r == NULL || r->start >= end)
+            {
+              release_bits (pos, end - pos);
+              break;
+            }
+          if (r->start > pos)
+            release_bits (pos, r->start - pos);
+          pos = r->start + r->cnt;
+          if (--r->refs < 2)
+            {
+              tree_remove (&shared_runs, &r->elem);
+              free (r);
+            }
+        }
+      merge_shared (sector, cnt);
+      shared_dirty = true;
+    }
+  lock_release (&free_map_lock);
 }
 
-/* Opens the free map file and reads it from disk. */
+/* Adds an owner to the CNT allocated sectors starting at SECTOR, so
+   that they stay allocated until it releases them too.  Returns false
+   if out of memory. */
+bool
+free_map_share (block_sector_t sector, size_t cnt)
+{
+  block_sector_t end = sector + cnt;
+  block_sector_t pos;
+  bool success = true;
+
+  ASSERT (cnt > 0);
+  lock_acquire (&free_map_lock);
+  if (!split_shared (sector) || !split_shared (end))
+    success = false;
+
+  /* Give the sectors not shared yet runs with one owner first, so that
+     running out of memory midway leaves nothing to undo but those. */
+  for (pos = sector; success && pos < end; )
+    {
+      struct shared_run *r = shared_after (pos);
+      block_sector_t gap_end = r != NULL && r->start < end ? r->start : end;
+
+      if (pos < gap_end)
+        {
+          struct shared_run *gap = malloc (sizeof *gap);
+          if (gap == NULL)
+            {
+              success = false;
+              break;
+            }
+          ASSERT_SLOW (bitmap_all (free_map, pos, gap_end - pos));
+          gap->start = pos;
+          gap->cnt = gap_end - pos;
+          gap->refs = 1;
+          tree_insert (&shared_runs, &gap->elem);
+          r = gap;
+        }
+      pos = r->start + r->cnt;
+    }
+
+  /* Then count the new owner, or take back the runs made above. */
+  for (pos = sector; pos < end; )
+    {
+      struct shared_run *r = shared_after (pos);
+
+      if (r == NULL || r->start >= end)
+        break;
+      pos = r->start + r->cnt;
+      if (success)
+        r->refs++;
+      else if (r->refs == 1)
+        {
+          tree_remove (&shared_runs, &r->elem);
+          free (r);
+        }
+    }
+  merge_shared (sector, cnt);
+  if (success)
+    shared_dirty = true;
+  lock_release (&free_map_lock);
+  return success;
+}
+
+/* Returns true if any of the CNT sectors starting at SECTOR has more
+   than one owner. */
+bool
+free_map_shared (block_sector_t sector, size_t cnt)
+{
+  struct shared_run *r;
+  bool shared;
+
+  /* Sectors only become shared while the file they belong to is kept
+     from being written, so a caller about to write sees any run that
+     matters to it without taking the lock. */
+  if (tree_empty (&shared_runs))
+    return false;
+
+  lock_acquire (&free_map_lock);
+  r = shared_after (sector);
+  shared = r != NULL && r->start < sector + cnt;
+  lock_release (&free_map_lock);
+  return shared;
+}
+
+/* Returns the shared run that holds SECTOR, if any, or else the first
+   one after it, or a null pointer if there is none.
+   The caller must hold free_map_lock. */
+static struct shared_run *
+shared_after (block_sector_t sector)
+{
+  struct shared_run key, *r;
+  struct tree_elem *e;
+
+  key.start = sector;
+  e = tree_floor (&shared_runs, &key.elem);
+  if (e != NULL)
+    {
+      r = tree_entry (e, struct shared_run, elem);
+      if (sector < r->start + r->cnt)
+        return r;
+    }
+  e = tree_ceiling (&shared_runs, &key.elem);
+  return e != NULL ? tree_entry (e, struct shared_run, elem) : NULL;
+}
+
+/* Returns the shared run that holds SECTOR, or a null pointer if none
+   does.
+   The caller must hold free_map_lock. */
+static struct shared_run *
+shared_at (block_sector_t sector)
+{
+  struct shared_run *r = shared_after (sector);
+  return r != NULL && r->start <= sector ? r : NULL;
+}
+
+/* Splits the shared run that holds SECTOR, if any, so that one run
+   ends right before SECTOR and another starts at it.  Returns false if
+   out of memory.
+   The caller must hold free_map_lock. */
+static bool
+split_shared (block_sector_t sector)
+{
+  struct shared_run *r = shared_at (sector);
+  struct shared_run *tail;
+
+  if (r == NULL || r->start == sector)
+    return true;
+  tail = malloc (sizeof *tail);
+  if (tail == NULL)
+    return false;
+  tail->start = sector;
+  tail->cnt = r->start + r->cnt - sector;
+  tail->refs = r->refs;
+  r->cnt = sector - r->start;
+  tree_insert (&shared_runs, &tail->elem);
+  return true;
+}
+
+/* Joins the shared runs that follow each other with the same number of
+   owners, among those from the one before SECTOR to the one after the
+   CNT sectors starting there, to keep the runs few.
+   The caller must hold free_map_lock. */
+static void
+merge_shared (block_sector_t sector, size_t cnt)
+{
+  struct shared_run *r = shared_after (sector > 0 ? sector - 1 : 0);
+
+  while (r != NULL && r->start <= sector + cnt)
+    {
+      struct tree_elem *e = tree_next (&shared_runs, &r->elem);
+      struct shared_run *next;
+
+      if (e == NULL)
+        break;
+      next = tree_entry (e, struct shared_run, elem);
+      if (next->start == r->start + r->cnt && next->refs == r->refs)
+        {
+          r->cnt += next->cnt;
+          tree_remove (&shared_runs, &next->elem);
+          free (next);
+        }
+      else
+        r = next;
+    }
+}
+
+/* Returns the offset of the shared runs in the free map file. */
+static off_t
+shared_ofs (void)
+{
+  return ROUND_UP (bitmap_file_size (free_map), BLOCK_SECTOR_SIZE);
+}
+
+/* Writes the shared runs to the free map file, growing it first if
+   they no longer fit.  Returns false if memory is short or the file
+   can't be written, leaving SHARED_DIRTY set to try again.
+   The caller must hold free_map_lock, which is let go of while the
+   file grows, since that allocates sectors. */
+static bool
+write_shared (void)
+{
+  struct shared_header *h;
+  struct shared_record *rec;
+  struct tree_elem *e;
+  size_t size;
+  bool success;
+
+  for (;;)
+    {
+      size = sizeof *h + tree_size (&shared_runs) * sizeof *rec;
+      if (shared_ofs () + (off_t) size <= file_length (free_map_file))
+        break;
+      lock_release (&free_map_lock);
+      success = file_truncate (free_map_file,
+                               ROUND_UP (shared_ofs () + size,
+                                         BLOCK_SECTOR_SIZE));
+      lock_acquire (&free_map_lock);
+      if (!success)
+        return false;
+    }
+
+  h = malloc (size);
+  if (h == NULL)
+    return false;
+  h->magic = SHARED_MAGIC;
+  h->cnt = tree_size (&shared_runs);
+  rec = (struct shared_record *) (h + 1);
+  for (e = tree_min (&shared_runs); e != NULL;
+       e = tree_next (&shared_runs, e))
+    {
+      struct shared_run *r = tree_entry (e, struct shared_run, elem);
+      rec->start = r->start;
+      rec->cnt = r->cnt;
+      rec->refs = r->refs;
+      rec++;
+    }
+  success = file_write_at (free_map_file, h, size, shared_ofs ())
+            == (off_t) size;
+  free (h);
+  if (success)
+    shared_dirty = false;
+  return success;
+}
+
+/* Reads the shared runs back from the free map file, if it has any.
+   The caller must be the only thread. */
+static void
+read_shared (void)
+{
+  struct shared_header h;
+  struct shared_record *recs;
+  size_t size;
+
+  if (file_length (free_map_file) < shared_ofs () + (off_t) sizeof h)
+    return;
+  if (file_read_at (free_map_file, &h, sizeof h, shared_ofs ()) != sizeof h)
+    PANIC ("can't read free map");
+  if (h.magic != SHARED_MAGIC || h.cnt == 0)
+    return;
+
+  size = h.cnt * sizeof *recs;
+  recs = malloc (size);
+  if (recs == NULL
+      || file_read_at (free_map_file, recs, size, shared_ofs () + sizeof h)
+         != (off_t) size)
+    PANIC ("can't read free map");
+  for (uint32_t i = 0; i < h.cnt; i++)
+    {
+      struct shared_run *r = malloc (sizeof *r);
+      if (r == NULL)
+        PANIC ("can't read free map");
+      r->start = recs[i].start;
+      r->cnt = recs[i].cnt;
+      r->refs = recs[i].refs;
+      tree_insert (&shared_runs, &r->elem);
+    }
+  free (recs);
+}
+
+/* Returns the length of the longest run of free sectors among the
+   block groups whose free map is in memory. */
+size_t
+free_map_largest_run (void)
+{
+  size_t start = 0, cnt = 0;
+
+  lock_acquire (&free_map_lock);
+  if (extents_ok)
+    {
+      struct tree_elem *e = tree_max (&extents_by_cnt);
+      if (e != NULL)
+        cnt = tree_entry (e, struct free_extent, cnt_elem)->cnt;
+    }
+  else
+    find_free_run (0, bitmap_size (free_map), SIZE_MAX, &start, &cnt);
+  lock_release (&free_map_lock);
+  return cnt;
+}
+
+/* Opens the free map file.  Its contents are read from disk a block
+   group at a time as they are needed, not all at once here, so that
+   mounting a big disk reads next to nothing. */
 void
 free_map_open (void) 
 {
   free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
   if (free_map_file == NULL)
     PANIC ("can't open free map");
-  if (!bitmap_read (free_map, free_map_file))
-    PANIC ("can't read free map");
+  bitmap_set_all (free_map, true);
+  clear_index ();
+  extents_ok = true;
+  bitmap_set_all (loaded_groups, false);
+  loaded_cnt = 0;
+  for (size_t group = 0; group < group_cnt; group++)
+    group_free[group] = group_sectors (group);
+  read_shared ();
 }
 
 /* Writes the free map to disk and closes the free map file. */
 void
 free_map_close (void) 
 {
+  free_map_flush ();
   file_close (free_map_file);
 }
 
 /* Creates a new free map file on disk and writes the free map to
-   it. */
+   it.  The file gets one contiguous run of sectors that are not
+   zeroed first, so that a big free map is written straight to disk
+   several sectors at a time instead of twice through the cache. */
 void
 free_map_create (void) 
 {
+  size_t size = bitmap_file_size (free_map);
+  block_sector_t start;
+
   /* Create inode. */
-  if (!inode_create (FREE_MAP_SECTOR, bitmap_file_size (free_map), false))
+  if (!free_map_allocate (DIV_ROUND_UP (size, BLOCK_SECTOR_SIZE),
+                          FREE_MAP_SECTOR + 1, &start)
+      || !inode_create_contiguous (FREE_MAP_SECTOR, size, start))
     PANIC ("free map creation failed");
 
   /* Write bitmap to file. */
@@ -82,4 +1142,5 @@ free_map_create (void)
     PANIC ("can't open free map");
   if (!bitmap_write (free_map, free_map_file))
     PANIC ("can't write free map");
+  bitmap_set_all (dirty_sectors, false);
 }
@@ -10,8 +10,14 @@ void free_map_read (void);
 void free_map_create (void);
 void free_map_open (void);
 void free_map_close (void);
+bool free_map_flush (void);
 
-bool free_map_allocate (size_t, block_sector_t *);
+bool free_map_allocate (size_t, block_sector_t near, block_sector_t *);
+size_t free_map_allocate_run (size_t max, block_sector_t near,
+                              block_sector_t *);
 void free_map_release (block_sector_t, size_t);
+bool free_map_share (block_sector_t, size_t);
+bool free_map_shared (block_sector_t, size_t);
+size_t free_map_largest_run (void);
 
 #endif /* filesys/free-map.h */
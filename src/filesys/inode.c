@@ -1,15 +1,54 @@
 #include "filesys/inode.h"
+#include <hash.h>
 #include <list.h>
+#include <lz.h>
 #include <debug.h>
 #include <round.h>
+#include <stddef.h>
 #include <string.h>
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
 #include "filesys/cache.h"
+#include "filesys/journal.h"
+#include "filesys/tmpfs.h"
+#include "threads/interrupt.h"
+#include "threads/kstat.h"
 #include "threads/malloc.h"
+#include "threads/slab.h"
+#include "threads/vaddr.h"
+#include "userprog/procstat.h"
 
-/* Identifies an inode. */
+/* Identifies an inode; the magic also tells which layout it uses. */
 #define INODE_MAGIC 0x494e4f44
+#define INODE_EXTENT_MAGIC 0x494e4f45
+#define INODE_INLINE_MAGIC 0x494e4f49
+#define INODE_BLOCK_MAGIC 0x494e4f42
+/* A packed inode whose full inode has moved to a sector of its own. */
+#define INODE_SPILL_MAGIC 0x494e4f53
+#define INODE_ZIP_MAGIC 0x494e4f5a
+
+/* Lay out new inodes as extents instead of indexed blocks.
+   Controlled by kernel command-line option "-extents". */
+bool inode_use_extents;
+
+/* Index new inodes by blocks of INODE_BLOCK_SECTORS sectors instead of
+   by single sectors, so large files need a fraction of the pointers,
+   allocations and transfers. Controlled by kernel command-line option
+   "-blocks"; "-extents" takes precedence. */
+bool inode_use_blocks;
+
+/* Give new files packed inodes, INODE_PACKED_SLOTS to an inode table
+   sector shared with their siblings, instead of a sector each.
+   Controlled by kernel command-line option "-packed". */
+bool inode_use_packed;
+
+/* Compress the data of files when they are last closed after being
+   written, a unit of INODE_ZIP_UNIT bytes at a time, and decompress it
+   as it is read, to trade CPU time for fewer bytes moved to and from
+   the disk.  A write to a compressed file expands it back into an
+   extent first, so this suits files written once and read many times.
+   Controlled by kernel command-line option "-compress". */
+bool inode_use_compress;
 
 /* Indexed Inodes Constants */
 // Number of Blocks
@@ -18,13 +57,95 @@
 #define INODE_IND_IDX INODE_NUM_DIRECT
 #define INODE_DUB_IND_IDX INODE_NUM_BLOCKS - 1
 #define INODE_NUM_IN_IND_BLOCK 128
+// Number of extents in an extent layout inode
+#define INODE_NUM_EXTENTS 62
+// Files up to this many bytes keep their data inside the inode sector
+#define INODE_INLINE_MAX (INODE_NUM_BLOCKS * sizeof (block_sector_t))
+// Transfers at least this large bypass the cache where they can
+#define INODE_DIRECT_MIN (64 * BLOCK_SECTOR_SIZE)
+/* Sectors a growing file reserves at once, so that small appends still
+   land in one contiguous run. */
+#define INODE_PREALLOC 32
+/* Sectors a write into data shared with a clone copies at least, aligned
+   to as many, so that small writes don't split the extents up a sector
+   at a time. */
+#define INODE_UNSHARE_SECTORS 8
+// Sectors in a block of a block layout inode, one page
+#define INODE_BLOCK_SECTORS (PGSIZE / BLOCK_SECTOR_SIZE)
+// Bytes of a compressed layout file compressed on their own, one page
+#define INODE_ZIP_UNIT PGSIZE
+// Entries of a compressed layout file's unit table in each sector
+#define INODE_ZIP_ENTRIES (BLOCK_SECTOR_SIZE / sizeof (uint32_t))
+
+/* Packed Inodes Constants */
+// Packed inodes per inode table sector, and the bytes of each
+#define INODE_PACKED_SLOTS 4
+#define INODE_PACKED_SIZE (BLOCK_SECTOR_SIZE / INODE_PACKED_SLOTS)
+// Extents and inline bytes that fit in a packed inode
+#define INODE_PACKED_EXTENTS 14
+#define INODE_PACKED_INLINE_MAX \
+  (INODE_PACKED_EXTENTS * sizeof (struct inode_extent) + sizeof (uint32_t))
+/* The inumber of a packed inode has INODE_PACKED_BIT set, its slot in
+   the two bits above INODE_PACKED_SHIFT and the inode table sector
+   below, so that inumbers stay distinct from sector numbers and
+   positive as ints. */
+#define INODE_PACKED_BIT 0x40000000
+#define INODE_PACKED_SHIFT 28
+#define INODE_PACKED_SECTORS (1u << INODE_PACKED_SHIFT)
 
 static char ZEROARRAY[BLOCK_SECTOR_SIZE];
 
-/* List of open inodes, so that opening a single inode twice
-   returns the same `struct inode'. */
-static struct lock open_inodes_lock;
-static struct list open_inodes;
+/* Guards the slots of inode table sectors and the table hints of open
+   directories. */
+static struct lock packed_lock;
+
+/* Incremented whenever an inode table sector is freed, which makes the
+   table hints taken before then stale, since the sector may have been
+   reused for something else. Guarded by packed_lock. */
+static unsigned packed_gen;
+
+/* Open inodes hashed by sector, so that opening a single inode twice
+   returns the same `struct inode'. Each bucket has its own lock so that
+   opens of different inodes don't serialize. */
+#define OPEN_INODES_BUCKETS 64
+
+struct open_inodes_bucket
+  {
+    struct lock lock;                   /* Guards INODES. */
+    struct list inodes;                 /* Open inodes hashing here. */
+  };
+
+static struct open_inodes_bucket open_inodes[OPEN_INODES_BUCKETS];
+
+/* Inodes no longer open, which stay in their buckets with their data
+   and block translations so that opening one again is memory only.
+   The least recently closed is at the back of UNUSED_INODES.  Past
+   UNUSED_INODES_MAX of them the oldest are freed, and all of them
+   when an inode can't be allocated.  A removed inode is freed on its
+   last close instead.  UNUSED_LOCK nests inside the bucket and inode
+   locks, and an inode's open count only goes from 0 to 1 and back
+   under its bucket's lock, so that it can be freed under that. */
+#define UNUSED_INODES_MAX 64
+
+static struct list unused_inodes;       /* Guarded by UNUSED_LOCK. */
+static size_t unused_cnt;               /* Inodes in it. */
+static struct lock unused_lock;
+
+static struct kstat_counter stat_reuse = KSTAT_COUNTER ("inode.reuse");
+static struct kstat_counter stat_evict = KSTAT_COUNTER ("inode.evict");
+
+/* In-memory inodes, constructed with their locks and condition
+   variables initialized.  An inode is freed once it is not open and
+   not kept unused, when none of them can be held or waited on. */
+static struct slab_cache inode_cache;
+static slab_obj_func inode_ctor;
+
+/* Returns the bucket of open inodes that SECTOR belongs in. */
+static struct open_inodes_bucket *
+open_inodes_bucket (block_sector_t sector)
+{
+  return &open_inodes[hash_int (sector) % OPEN_INODES_BUCKETS];
+}
 
 /* On-disk inode for indirect sector
  * Must be exactly BLOCK_SECTOR_SIZE bytes long. */
@@ -33,22 +154,189 @@ struct inode_indirect_sector
     block_sector_t block_idxs[INODE_NUM_IN_IND_BLOCK];
   };
 
+/* A run of LENGTH contiguous data sectors starting at START. */
+struct inode_extent
+  {
+    block_sector_t start;
+    uint32_t length;
+  };
+
 /* On-disk inode.
    Must be exactly BLOCK_SECTOR_SIZE bytes long. */
 struct inode_disk
   {
-    block_sector_t block_idxs [INODE_NUM_BLOCKS];
+    union
+      {
+        /* Indexed layout, if MAGIC is INODE_MAGIC, or block layout, if
+           it is INODE_BLOCK_MAGIC. Each data pointer is to a sector, or
+           to the first of a block of INODE_BLOCK_SECTORS contiguous
+           sectors, respectively. Indirect blocks are single sectors in
+           both. */
+        block_sector_t block_idxs [INODE_NUM_BLOCKS];
+        /* Extent layout, if MAGIC is INODE_EXTENT_MAGIC. Data sectors
+           are the EXTENT_CNT extents concatenated in order. */
+        struct
+          {
+            struct inode_extent extents [INODE_NUM_EXTENTS];
+            uint32_t extent_cnt;
+          };
+        /* Inline layout, if MAGIC is INODE_INLINE_MAGIC. The file's
+           bytes themselves, zero past LENGTH. */
+        uint8_t inline_data [INODE_INLINE_MAX];
+        /* Compressed layout, if MAGIC is INODE_ZIP_MAGIC. The file's
+           units of INODE_ZIP_UNIT bytes, each compressed on its own, or
+           kept as it is if that doesn't make it smaller, are packed
+           one after another into ZIP_SECTORS contiguous sectors from
+           ZIP_START on, after a table of where each unit ends. */
+        struct
+          {
+            block_sector_t zip_start;
+            uint32_t zip_sectors;
+          };
+      };
     bool is_dir;
     off_t length;                       /* File size in bytes. */
     unsigned magic;                     /* Magic number. */
   };
 
-static block_sector_t get_index (const struct inode_disk*, off_t);
-static struct inode_disk *get_data_at (block_sector_t);
-static bool inode_expand (struct inode_disk*, off_t);
-static bool inode_expand_helper (block_sector_t*, off_t, int);
+/* Packed on-disk inode, one of INODE_PACKED_SLOTS in an inode table
+   sector, with room for only the inline and extent layouts. It is just
+   a smaller encoding of a `struct inode_disk', which is what an open
+   inode keeps resident either way. An inode that outgrows it spills
+   into a full `struct inode_disk' in a sector of its own, keeping its
+   slot, and so its inumber, to point there.
+   Must be exactly INODE_PACKED_SIZE bytes long. */
+struct inode_packed
+  {
+    union
+      {
+        /* Inline layout, if MAGIC is INODE_INLINE_MAGIC. */
+        uint8_t inline_data [INODE_PACKED_INLINE_MAX];
+        /* Extent layout, if MAGIC is INODE_EXTENT_MAGIC. */
+        struct
+          {
+            struct inode_extent extents [INODE_PACKED_EXTENTS];
+            uint32_t extent_cnt;
+          };
+        /* Compressed layout, if MAGIC is INODE_ZIP_MAGIC. */
+        struct
+          {
+            block_sector_t zip_start;
+            uint32_t zip_sectors;
+          };
+        /* Sector of the full inode, if MAGIC is INODE_SPILL_MAGIC. */
+        block_sector_t full_sector;
+      };
+    bool is_dir;
+    off_t length;                       /* File size in bytes. */
+    unsigned magic;                     /* Magic number, 0 if free. */
+  };
+
+static block_sector_t get_index (struct inode *, off_t);
+static block_sector_t get_index_locked (struct inode *, off_t);
+static size_t get_indices (struct inode *, off_t, size_t cnt,
+                           block_sector_t *);
+static void inode_write_back (struct inode *);
+static bool is_metadata (const struct inode_disk *, block_sector_t);
+static off_t read_at (struct inode *, void *, off_t, off_t, struct inode_ra *,
+                      bool direct);
+static off_t write_at (struct inode *, const void *, off_t, off_t,
+                       bool direct);
+static off_t write_changed (struct inode *, const void *, off_t, off_t);
+static off_t write_tmpfs (struct inode *, const void *, off_t, off_t);
+static bool acquire_for_write (struct inode *, off_t, off_t);
+static bool is_shared (struct inode *, off_t, off_t);
+static bool unshare (struct inode *, off_t, off_t);
+static void zip (struct inode *);
+static bool unzip (struct inode *);
+static off_t zip_read (struct inode *, uint8_t *, off_t, off_t, off_t);
+static bool inline_io (struct inode *, void *, off_t, off_t, bool);
+static bool create_packed (block_sector_t, struct inode_disk *, off_t);
+static bool make_spill_room (struct inode *);
+static bool inode_uninline (struct inode_disk *, block_sector_t);
+static bool inode_expand (struct inode_disk*, block_sector_t, struct inode *,
+                          off_t, off_t, off_t);
+static bool inode_expand_extents (struct inode_disk *, block_sector_t,
+                                  struct inode *, off_t, off_t, off_t);
+static size_t take_prealloc (struct inode *, size_t cnt, block_sector_t near,
+                             block_sector_t *);
+static void release_prealloc (struct inode *);
+static off_t inode_direct_io (struct inode *, void *, off_t, off_t, off_t,
+                              bool);
+static block_sector_t inode_fill_hole (struct inode *, off_t, const void *,
+                                       bool *);
+static block_sector_t extent_index (const struct inode_disk *, off_t);
 static bool inode_clear (struct inode*);
-static void inode_clear_helper (block_sector_t, off_t, int);
+static void clear_data (const struct inode_disk *);
+static void inode_clear_helper (block_sector_t, int, size_t);
+static struct inode *bucket_find (struct open_inodes_bucket *,
+                                  block_sector_t);
+static bool unused_trim (size_t max);
+static void inode_free (struct inode *);
+static void inode_shrink (struct inode *, off_t);
+static void shrink_indirect (struct inode *, block_sector_t *, bool, int,
+                             off_t, off_t, size_t);
+static void inode_read_ahead (struct inode *, struct inode_ra *,
+                              off_t offset, off_t size, off_t length);
+
+/* Returns true if SECTOR, a block pointer of an indexed layout inode,
+   points to an allocated sector rather than a hole. Holes are
+   INODE_INVALID_SECTOR in the inode itself and 0 in indirect blocks,
+   which start out zeroed. */
+static inline bool
+is_allocated (block_sector_t sector)
+{
+  return sector != INODE_INVALID_SECTOR && sector != 0;
+}
+
+/* Returns true if inode number INUMBER is of a packed inode. */
+static inline bool
+is_packed (block_sector_t inumber)
+{
+  return inumber != INODE_INVALID_SECTOR
+         && (inumber & INODE_PACKED_BIT) != 0;
+}
+
+/* Returns the sector that holds the inode numbered INUMBER: the inode
+   table sector of a packed inode, or INUMBER itself. */
+static inline block_sector_t
+home_sector (block_sector_t inumber)
+{
+  return is_packed (inumber) ? inumber & (INODE_PACKED_SECTORS - 1)
+                             : inumber;
+}
+
+/* Returns the byte offset of packed inode INUMBER in its table
+   sector. */
+static inline off_t
+packed_ofs (block_sector_t inumber)
+{
+  return ((inumber >> INODE_PACKED_SHIFT) & (INODE_PACKED_SLOTS - 1))
+         * INODE_PACKED_SIZE;
+}
+
+/* Returns the most bytes the inode numbered INUMBER keeps inline. */
+static inline size_t
+inline_max (block_sector_t inumber)
+{
+  return is_packed (inumber) ? INODE_PACKED_INLINE_MAX : INODE_INLINE_MAX;
+}
+
+/* Returns true if the data of DISK_INODE, which lives at SECTOR, is file
+   system metadata itself, as for directories and the free map. */
+static bool
+is_metadata (const struct inode_disk *disk_inode, block_sector_t sector)
+{
+  return disk_inode->is_dir || sector == FREE_MAP_SECTOR;
+}
+
+/* Returns the number of contiguous sectors each data pointer of indexed
+   or block layout DISK_INODE points to. */
+static inline size_t
+block_sectors (const struct inode_disk *disk_inode)
+{
+  return disk_inode->magic == INODE_BLOCK_MAGIC ? INODE_BLOCK_SECTORS : 1;
+}
 
 /* Returns the number of sectors to allocate for an inode SIZE
    bytes long. */
@@ -58,23 +346,94 @@ bytes_to_sectors (off_t size)
   return DIV_ROUND_UP (size, BLOCK_SECTOR_SIZE);
 }
 
+/* Copy of the indirect block that last translated a data sector of an
+   inode. Its non-zero entries never change while the inode is open, since
+   expansion only ever fills in unallocated (zero) entries. */
+struct inode_xlate
+  {
+    off_t base;                         /* First pointer index ENTRIES
+                                           maps, -1 if none yet. */
+    block_sector_t entries[INODE_NUM_IN_IND_BLOCK];
+  };
+
 /* In-memory inode. */
 struct inode 
   {
     struct lock lock;                   /* Guards the inode. */
     struct lock eof_lock;               /* Lock to make read past EOF atomic*/
+    struct lock grow_lock;              /* Lock to fill holes one at a time. */
     struct condition data_loaded_cond;  /* Wait to load data on open. */
     bool data_loaded;                   /* If the inode is usable. */
-    struct lock dir_lock;               /* Lock for directory synch. */
-    struct list_elem elem;              /* Element in inode list. */
+    struct rwlock dir_lock;             /* Lock for directory synch. */
+    struct rwlock io_lock;              /* Held for reading by reads and
+                                           writes, for writing by
+                                           truncation. */
+    off_t dir_free_ofs;                 /* No free dir slot before it. */
+    struct list_elem elem;              /* Element in open inodes bucket. */
+    struct list_elem unused_elem;       /* Element in unused_inodes if
+                                           OPEN_CNT is 0. */
     block_sector_t sector;              /* Sector number of disk location. */
     bool is_dir;                        /* Whether this inode is dir or not*/
     off_t length;                       /* File size in bytes. */
     int open_cnt;                       /* Number of openers. */
     bool removed;                       /* True if deleted, false otherwise. */
     int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
+    unsigned version;                   /* See inode_version(). */
+    block_sector_t alloc_hint;          /* Where to allocate sectors next,
+                                           guarded by GROW_LOCK. */
+
+    /* Sectors reserved for the inode to grow into, guarded by
+       GROW_LOCK. They are marked in use in the free map and handed
+       back on the last close. */
+    block_sector_t prealloc_start;      /* First reserved sector. */
+    size_t prealloc_cnt;                /* Number of reserved sectors. */
+
+    /* Resident copy of the on-disk inode. The block pointers only change
+       while expanding under EOF_LOCK. */
+    struct inode_disk data;
+    bool data_dirty;                    /* DATA newer than its sector. */
+
+    /* Full inode sector of a packed inode that outgrew its slot, or
+       INODE_INVALID_SECTOR, guarded like DATA. */
+    block_sector_t spill_sector;
+    bool spill_linked;                  /* Slot points to SPILL_SECTOR? */
+
+    /* Inode table sector to pack a directory's new files into next, as
+       of PACKED_HINT_GEN, guarded by packed_lock. */
+    block_sector_t packed_hint;
+    unsigned packed_hint_gen;
+
+    /* Indirect block translation cache, allocated on first use. */
+    struct lock xlate_lock;             /* Guards XLATE. */
+    struct inode_xlate *xlate;          /* Null until needed. */
+
+    /* Read-ahead state of the reads that don't bring their own,
+       guarded by LOCK, like that of every stream. */
+    struct inode_ra ra;
+
+    /* Compressed layout state. */
+    bool zip_pending;                   /* Written since compressed? */
+    struct lock zip_lock;               /* Guards the members below. */
+    uint8_t *zip_buf;                   /* Unit ZIP_UNIT, decompressed,
+                                           and room to read a unit's
+                                           compressed bytes into. Null
+                                           until needed. */
+    off_t zip_unit;                     /* Unit in ZIP_BUF, or -1. */
   };
 
+/* Last version handed out to an inode. */
+static unsigned last_version;
+
+/* Returns a version no inode has had before. */
+static unsigned
+new_version (void)
+{
+  enum intr_level old_level = intr_disable ();
+  unsigned version = ++last_version;
+  intr_set_level (old_level);
+  return version;
+}
+
 /* Returns the block device sector that contains byte offset POS
    within INODE.
    Returns -1 if INODE does not contain data for a byte at offset
@@ -82,29 +441,162 @@ struct inode
    LENGTH is the size of INODE's data. This could be different from
    the length stored on disk while expanding the inode. */
 static block_sector_t
-byte_to_sector (const struct inode_disk *disk_inode, off_t pos, off_t length) 
+byte_to_sector (struct inode *inode, off_t pos, off_t length) 
 {
-  ASSERT (disk_inode != NULL);
+  ASSERT (inode != NULL);
   if (pos >= 0 && pos < length)
     {
       off_t abs_idx =  pos / BLOCK_SECTOR_SIZE;
-      return get_index (disk_inode, abs_idx);
+      return get_index (inode, abs_idx);
     }
   else
     return INODE_INVALID_SECTOR;
 }
 
+/* Initializes the synchronization members of the inode at INODE_,
+   which no open or close of the inode ever leaves changed. */
+static void
+inode_ctor (void *inode_)
+{
+  struct inode *inode = inode_;
+
+  lock_init (&inode->lock);
+  lock_init (&inode->eof_lock);
+  lock_init (&inode->grow_lock);
+  cond_init (&inode->data_loaded_cond);
+  rwlock_init (&inode->dir_lock);
+  rwlock_init (&inode->io_lock);
+  lock_init (&inode->xlate_lock);
+  lock_init (&inode->zip_lock);
+}
+
 /* Initializes the inode module. */
 void
 inode_init (void) 
 {
-  lock_init (&open_inodes_lock);
-  list_init (&open_inodes);
+  ASSERT (sizeof (struct inode_packed) == INODE_PACKED_SIZE);
+
+  slab_cache_init (&inode_cache, "inode", sizeof (struct inode),
+                   inode_ctor, NULL);
+  lock_init (&packed_lock);
+  for (int i = 0; i < OPEN_INODES_BUCKETS; ++i)
+    {
+      lock_init (&open_inodes[i].lock);
+      list_init (&open_inodes[i].inodes);
+    }
+  list_init (&unused_inodes);
+  lock_init (&unused_lock);
+  kstat_register (&stat_reuse);
+  kstat_register (&stat_evict);
+}
+
+/* Stores the packed encoding of DISK_INODE in *P and returns true, or
+   returns false if DISK_INODE doesn't fit in a packed inode. */
+static bool
+pack (const struct inode_disk *disk_inode, struct inode_packed *p)
+{
+  memset (p, 0, sizeof *p);
+  if (disk_inode->magic == INODE_INLINE_MAGIC
+      && (size_t) disk_inode->length <= INODE_PACKED_INLINE_MAX)
+    memcpy (p->inline_data, disk_inode->inline_data,
+            INODE_PACKED_INLINE_MAX);
+  else if (disk_inode->magic == INODE_EXTENT_MAGIC
+           && disk_inode->extent_cnt <= INODE_PACKED_EXTENTS)
+    {
+      memcpy (p->extents, disk_inode->extents,
+              disk_inode->extent_cnt * sizeof *p->extents);
+      p->extent_cnt = disk_inode->extent_cnt;
+    }
+  else if (disk_inode->magic == INODE_ZIP_MAGIC)
+    {
+      p->zip_start = disk_inode->zip_start;
+      p->zip_sectors = disk_inode->zip_sectors;
+    }
+  else
+    return false;
+  p->is_dir = disk_inode->is_dir;
+  p->length = disk_inode->length;
+  p->magic = disk_inode->magic;
+  return true;
+}
+
+/* Expands packed inode P, other than a spilled one, into
+   *DISK_INODE. */
+static void
+unpack (const struct inode_packed *p, struct inode_disk *disk_inode)
+{
+  ASSERT (p->magic == INODE_INLINE_MAGIC || p->magic == INODE_EXTENT_MAGIC
+          || p->magic == INODE_ZIP_MAGIC);
+
+  memset (disk_inode, 0, sizeof *disk_inode);
+  if (p->magic == INODE_INLINE_MAGIC)
+    memcpy (disk_inode->inline_data, p->inline_data,
+            INODE_PACKED_INLINE_MAX);
+  else if (p->magic == INODE_ZIP_MAGIC)
+    {
+      disk_inode->zip_start = p->zip_start;
+      disk_inode->zip_sectors = p->zip_sectors;
+    }
+  else
+    {
+      memcpy (disk_inode->extents, p->extents,
+              p->extent_cnt * sizeof *p->extents);
+      disk_inode->extent_cnt = p->extent_cnt;
+    }
+  disk_inode->is_dir = p->is_dir;
+  disk_inode->length = p->length;
+  disk_inode->magic = p->magic;
+}
+
+/* Writes packed inode P to the slot of inode INUMBER. */
+static void
+write_slot (block_sector_t inumber, const struct inode_packed *p)
+{
+  block_sector_t table = home_sector (inumber);
+
+  /* The table sector is shared, so it is owned by itself rather than by
+     whichever of its inodes wrote it last. */
+  cache_io_at (table, table, (void *) p, true, packed_ofs (inumber),
+               sizeof *p, true);
+}
+
+/* Does the work of inode_create() for packed inode INUMBER, with
+   DISK_INODE, which it frees, zeroed. A packed inode starts out
+   inline and empty and then grows like an open file: only an open
+   inode can spill out of its slot. */
+static bool
+create_packed (block_sector_t inumber, struct inode_disk *disk_inode,
+               off_t length)
+{
+  struct inode_packed p;
+  struct inode *inode;
+  bool success = true;
+
+  disk_inode->is_dir = false;
+  disk_inode->magic = INODE_INLINE_MAGIC;
+  pack (disk_inode, &p);
+  free (disk_inode);
+  write_slot (inumber, &p);
+  if (length == 0)
+    return true;
+
+  inode = inode_open (inumber);
+  if (inode == NULL)
+    return false;
+  if (!inode_truncate (inode, length))
+    {
+      /* Give back whatever it got, spilled sector included. */
+      inode_truncate (inode, 0);
+      success = false;
+    }
+  inode_close (inode);
+  return success;
 }
 
 /* Initializes an inode with LENGTH bytes of data and
    writes the new inode to sector SECTOR on the file system
-   device.
+   device, or to the slot SECTOR names if it is a packed inode
+   number from inode_alloc_inumber().
    Returns true if successful.
    Returns false if memory or disk allocation fails. */
 bool
@@ -119,19 +611,37 @@ inode_create (block_sector_t sector, off_t length, bool isdir)
      one sector in size, and you should fix that. */
   ASSERT (sizeof *t_disk_inode == BLOCK_SECTOR_SIZE);
 
+  if (tmpfs_owns (sector))
+    return tmpfs_create (sector, length, isdir);
   t_disk_inode = calloc (1, sizeof(struct inode_disk));
   if (t_disk_inode != NULL)
     {
       t_disk_inode->length = length;
-      t_disk_inode->magic = INODE_MAGIC;
       t_disk_inode->is_dir = isdir;
-      memset (&t_disk_inode->block_idxs, INODE_INVALID_SECTOR,
-              INODE_NUM_BLOCKS * sizeof(block_sector_t));
-      if (!inode_expand (t_disk_inode, length))
+      /* Tiny files need no data sectors of their own. Directories grow
+         by entries and get the usual layouts. */
+      if (is_packed (sector))
+        return create_packed (sector, t_disk_inode, length);
+      if (!isdir && (size_t) length <= INODE_INLINE_MAX)
+        t_disk_inode->magic = INODE_INLINE_MAGIC;
+      else if (inode_use_extents)
+        {
+          t_disk_inode->magic = INODE_EXTENT_MAGIC;
+          t_disk_inode->extent_cnt = 0;
+        }
+      else
+        {
+          t_disk_inode->magic = inode_use_blocks ? INODE_BLOCK_MAGIC
+                                                 : INODE_MAGIC;
+          memset (&t_disk_inode->block_idxs, INODE_INVALID_SECTOR,
+                  INODE_NUM_BLOCKS * sizeof(block_sector_t));
+        }
+      if (!inode_expand (t_disk_inode, sector, NULL, length, 0, 0))
         success = false;
       else
         {
-          cache_io_at (sector, t_disk_inode, true, 0, BLOCK_SECTOR_SIZE, true);
+          cache_io_at (sector, sector, t_disk_inode, true, 0,
+                       BLOCK_SECTOR_SIZE, true);
           success = true; 
         } 
     }
@@ -139,66 +649,348 @@ inode_create (block_sector_t sector, off_t length, bool isdir)
   return success;
 }
 
+/* Writes to SECTOR an inode for a file of LENGTH bytes kept in the
+   contiguous sectors from START on, which the caller has allocated
+   and fills in itself: nothing is zeroed or cached, so the caller
+   can write them straight to disk.  The inode is laid out as a
+   single extent whatever layout other new inodes get, for files like
+   the free map that are made once at a fixed size.
+   Returns false if memory allocation fails. */
+bool
+inode_create_contiguous (block_sector_t sector, off_t length,
+                         block_sector_t start)
+{
+  struct inode_disk *disk_inode;
+
+  ASSERT (length > 0);
+
+  disk_inode = calloc (1, sizeof *disk_inode);
+  if (disk_inode == NULL)
+    return false;
+  disk_inode->length = length;
+  disk_inode->is_dir = false;
+  disk_inode->magic = INODE_EXTENT_MAGIC;
+  disk_inode->extents[0].start = start;
+  disk_inode->extents[0].length = bytes_to_sectors (length);
+  disk_inode->extent_cnt = 1;
+  cache_io_at (sector, sector, disk_inode, true, 0, BLOCK_SECTOR_SIZE, true);
+  free (disk_inode);
+  return true;
+}
+
+/* Returns the magic number of packed inode SLOT of inode table sector
+   TABLE, 0 if the slot is free. */
+static unsigned
+slot_magic (block_sector_t table, int slot)
+{
+  unsigned magic;
+
+  cache_io_at (table, table, &magic, true,
+               slot * INODE_PACKED_SIZE + offsetof (struct inode_packed, magic),
+               sizeof magic, false);
+  return magic;
+}
+
+/* Returns the first free slot of inode table sector TABLE, or
+   INODE_PACKED_SLOTS if none is. The caller must hold packed_lock. */
+static int
+free_slot (block_sector_t table)
+{
+  int slot;
+
+  for (slot = 0; slot < INODE_PACKED_SLOTS; slot++)
+    if (slot_magic (table, slot) == 0)
+      break;
+  return slot;
+}
+
+/* Allocates an inode number for a new file or, if ISDIR, directory in
+   directory PARENT, and stores it into *INUMBERP for inode_create().
+   Directories, and every inode unless packed inodes are enabled, get
+   a sector of their own near PARENT. Files otherwise get a slot in the
+   inode table sector their last sibling went into, or in a new one
+   near PARENT, so that the inodes of a directory share few sectors.
+   In a tmpfs directory, the inode is a tmpfs node instead.
+   Returns false if out of disk space. */
+bool
+inode_alloc_inumber (struct inode *parent, bool isdir,
+                     block_sector_t *inumberp)
+{
+  block_sector_t near = home_sector (parent->sector);
+  block_sector_t table;
+  struct inode_packed p;
+  int slot = INODE_PACKED_SLOTS;
+
+  if (tmpfs_owns (parent->sector))
+    return tmpfs_alloc_inumber (inumberp);
+  if (!inode_use_packed || isdir)
+    return free_map_allocate (1, near, inumberp);
+
+  lock_acquire (&packed_lock);
+  table = parent->packed_hint;
+  if (table != INODE_INVALID_SECTOR && parent->packed_hint_gen == packed_gen)
+    slot = free_slot (table);
+  if (slot == INODE_PACKED_SLOTS)
+    {
+      if (!free_map_allocate (1, near, &table))
+        {
+          lock_release (&packed_lock);
+          return false;
+        }
+      if (table >= INODE_PACKED_SECTORS)
+        {
+          /* Too far out to be packed. */
+          lock_release (&packed_lock);
+          *inumberp = table;
+          return true;
+        }
+      cache_io_at (table, table, ZEROARRAY, true, 0, BLOCK_SECTOR_SIZE,
+                   true);
+      parent->packed_hint = table;
+      parent->packed_hint_gen = packed_gen;
+      slot = 0;
+    }
+  *inumberp = INODE_PACKED_BIT | (slot << INODE_PACKED_SHIFT) | table;
+
+  /* Claim the slot with an empty inode until inode_create() fills it
+     in. */
+  memset (&p, 0, sizeof p);
+  p.magic = INODE_INLINE_MAGIC;
+  write_slot (*inumberp, &p);
+  lock_release (&packed_lock);
+  return true;
+}
+
+/* Frees inode number INUMBER, which inode_alloc_inumber() returned,
+   along with the inode table sector of a packed inode if no other
+   inode is left in it. Doesn't free the inode's data, except for a
+   tmpfs node, whose data goes with it. */
+void
+inode_free_inumber (block_sector_t inumber)
+{
+  static const struct inode_packed free_packed;
+  block_sector_t table = home_sector (inumber);
+  int slot;
+
+  if (tmpfs_owns (inumber))
+    {
+      tmpfs_free_inumber (inumber);
+      return;
+    }
+  if (!is_packed (inumber))
+    {
+      free_map_release (inumber, 1);
+      return;
+    }
+
+  lock_acquire (&packed_lock);
+  write_slot (inumber, &free_packed);
+  for (slot = 0; slot < INODE_PACKED_SLOTS; slot++)
+    if (slot_magic (table, slot) != 0)
+      break;
+  if (slot == INODE_PACKED_SLOTS)
+    {
+      free_map_release (table, 1);
+      packed_gen++;
+    }
+  lock_release (&packed_lock);
+}
+
+/* Starts reading the inode numbered INUMBER into the cache in the
+   background, as cache_read_ahead() does for a sector. */
+bool
+inode_prefetch (block_sector_t inumber)
+{
+  if (tmpfs_owns (inumber))
+    return true;
+  return cache_read_ahead (home_sector (inumber));
+}
+
+/* Loads the resident inode of packed INODE from its slot, or from the
+   sector it spilled into. */
+static void
+load_packed (struct inode *inode)
+{
+  struct inode_packed p;
+  block_sector_t table = home_sector (inode->sector);
+
+  cache_io_at (table, table, &p, true, packed_ofs (inode->sector),
+               sizeof p, false);
+  if (p.magic == INODE_SPILL_MAGIC)
+    {
+      inode->spill_sector = p.full_sector;
+      inode->spill_linked = true;
+      cache_io_at (p.full_sector, inode->sector, &inode->data, true, 0,
+                   BLOCK_SECTOR_SIZE, false);
+    }
+  else
+    unpack (&p, &inode->data);
+}
+
 /* Reads an inode from SECTOR
    and returns a `struct inode' that contains it.
    Returns a null pointer if memory allocation fails. */
 struct inode *
 inode_open (block_sector_t sector)
 {
-  struct list_elem *e;
+  struct open_inodes_bucket *bucket = open_inodes_bucket (sector);
   struct inode *inode;
 
-  /* Check whether this inode is already open. */
-  lock_acquire (&open_inodes_lock);
-  for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
-       e = list_next (e)) 
+  /* Check whether this inode is already open, or kept unused. */
+  lock_acquire (&bucket->lock);
+  inode = bucket_find (bucket, sector);
+  if (inode != NULL)
     {
-      inode = list_entry (e, struct inode, elem);
-      if (inode->sector == sector) 
+      lock_acquire (&inode->lock);
+      if (inode->removed)
+        inode = NULL;
+      else if (inode->open_cnt++ == 0)
         {
-          lock_release (&open_inodes_lock);
-          return inode_reopen (inode);
+          lock_acquire (&unused_lock);
+          list_remove (&inode->unused_elem);
+          unused_cnt--;
+          lock_release (&unused_lock);
+          kstat_inc (&stat_reuse);
         }
+      lock_release (&bucket->lock);
+      if (inode == NULL)
+        return NULL;
+      while (!inode->data_loaded)
+        cond_wait (&inode->data_loaded_cond, &inode->lock);
+      lock_release (&inode->lock);
+      return inode;
     }
 
-  /* Allocate memory. */
-  inode = malloc (sizeof *inode);
+  /* Allocate memory, making room by freeing unused inodes if need
+     be. */
+  inode = slab_alloc (&inode_cache);
   if (inode == NULL)
     {
-      lock_release (&open_inodes_lock);
-      return NULL;
+      lock_release (&bucket->lock);
+      return unused_trim (0) ? inode_open (sector) : NULL;
     }
 
   /* Initialize. */
-  lock_init (&inode->lock);
-  lock_init (&inode->eof_lock);
-  cond_init (&inode->data_loaded_cond);
-  lock_init (&inode->dir_lock);
+  inode->dir_free_ofs = 0;
   lock_acquire (&inode->lock);
-  list_push_front (&open_inodes, &inode->elem);
+  list_push_front (&bucket->inodes, &inode->elem);
   inode->sector = sector;
   inode->open_cnt = 1;
   inode->deny_write_cnt = 0;
+  inode->alloc_hint = home_sector (sector);
+  inode->prealloc_cnt = 0;
+  inode->spill_sector = INODE_INVALID_SECTOR;
+  inode->spill_linked = false;
+  inode->packed_hint = INODE_INVALID_SECTOR;
   inode->removed = false;
+  inode->version = new_version ();
   inode->data_loaded = false;
+  inode->xlate = NULL;
+  inode_ra_init (&inode->ra);
+  inode->zip_pending = false;
+  inode->zip_buf = NULL;
+  inode->zip_unit = -1;
   lock_release (&inode->lock);
-  lock_release (&open_inodes_lock);
+  lock_release (&bucket->lock);
 
   /* Lazily load needed inode data from disk. */
   lock_acquire (&inode->lock);
-  struct inode_disk *disk_inode = get_data_at (inode->sector);
-  cache_io_at (inode->sector, disk_inode, true, 0, sizeof(struct inode_disk),
-               false);
-  inode->is_dir = disk_inode->is_dir;
-  inode->length = disk_inode->length;
+  if (tmpfs_owns (sector))
+    {
+      /* The tmpfs keeps the data, and the length. */
+      memset (&inode->data, 0, sizeof inode->data);
+      inode->data.is_dir = tmpfs_isdir (sector);
+    }
+  else if (is_packed (sector))
+    load_packed (inode);
+  else
+    cache_io_at (inode->sector, inode->sector, &inode->data, true, 0,
+                 BLOCK_SECTOR_SIZE, false);
+  inode->data_dirty = false;
+  inode->is_dir = inode->data.is_dir;
+  inode->length = inode->data.length;
   /* Broadcast the fact that the inode has been fully loaded. */
   inode->data_loaded = true;
   cond_broadcast (&inode->data_loaded_cond, &inode->lock);
   lock_release (&inode->lock);
-  free (disk_inode);
   return inode;
 }
 
+/* Returns the inode in BUCKET, whose lock the caller holds, for SECTOR,
+   or a null pointer if there is none. */
+static struct inode *
+bucket_find (struct open_inodes_bucket *bucket, block_sector_t sector)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&bucket->inodes); e != list_end (&bucket->inodes);
+       e = list_next (e))
+    {
+      struct inode *inode = list_entry (e, struct inode, elem);
+      if (inode->sector == sector)
+        return inode;
+    }
+  return NULL;
+}
+
+/* Frees unused inodes, the least recently closed first, until at most
+   MAX are left.  Returns true if it freed any. */
+static bool
+unused_trim (size_t max)
+{
+  bool freed = false;
+
+  for (;;)
+    {
+      struct open_inodes_bucket *bucket;
+      struct inode *inode;
+      block_sector_t sector;
+
+      lock_acquire (&unused_lock);
+      if (unused_cnt <= max)
+        {
+          lock_release (&unused_lock);
+          return freed;
+        }
+      sector = list_entry (list_back (&unused_inodes), struct inode,
+                           unused_elem)->sector;
+      lock_release (&unused_lock);
+
+      /* Find it again under its bucket's lock, under which it can't be
+         freed or opened, unless it has meanwhile. */
+      bucket = open_inodes_bucket (sector);
+      lock_acquire (&bucket->lock);
+      inode = bucket_find (bucket, sector);
+      if (inode != NULL && inode->open_cnt == 0)
+        {
+          list_remove (&inode->elem);
+          lock_acquire (&unused_lock);
+          list_remove (&inode->unused_elem);
+          unused_cnt--;
+          lock_release (&unused_lock);
+        }
+      else
+        inode = NULL;
+      lock_release (&bucket->lock);
+
+      if (inode != NULL)
+        {
+          inode_free (inode);
+          kstat_inc (&stat_evict);
+          freed = true;
+        }
+    }
+}
+
+/* Frees INODE, which is in no list. */
+static void
+inode_free (struct inode *inode)
+{
+  free (inode->xlate);
+  free (inode->zip_buf);
+  slab_free (&inode_cache, inode);
+}
+
 /* Reopens and returns INODE after acquiring and releasing its lock. */
 struct inode *
 inode_reopen (struct inode *inode)
@@ -238,105 +1030,281 @@ inode_get_inumber (const struct inode *inode)
   return inode->sector;
 }
 
+/* Returns INODE's version, which changes each time INODE's data is
+   written and is never the same for two inodes, even if opened from
+   the same sector one after the other.  Something computed from the
+   data can be kept along with the version to tell whether it is still
+   up to date. */
+unsigned
+inode_version (const struct inode *inode)
+{
+  return inode->version;
+}
+
 /* Returns a pointer to the directory lock. */
-struct lock *
+struct rwlock *
 inode_dir_lock (struct inode *inode)
 {
   return &inode->dir_lock;
 }
 
+/* Returns a pointer to the offset before which a linear directory
+   has no free slots. Guarded by the directory lock. */
+off_t *
+inode_dir_free_ofs (struct inode *inode)
+{
+  return &inode->dir_free_ofs;
+}
+
 /* Marks free all sectors related to this inode. */
 static bool
 inode_clear (struct inode* inode)
 {
-  struct inode_disk *disk_inode = get_data_at (inode->sector);
-  if (inode->length < 0) return false;
+  /* A tmpfs node's pages went with its inumber. */
+  if (inode->length < 0 || tmpfs_owns (inode->sector)) return false;
+  clear_data (&inode->data);
+  return true;
+}
 
-  int num_sectors_left = bytes_to_sectors (inode->length);
+/* Marks free the data sectors DISK_INODE points to, and its indirect
+   blocks. */
+static void
+clear_data (const struct inode_disk *disk_inode)
+{
+  if (disk_inode->magic == INODE_INLINE_MAGIC)
+    return;
 
-  // Clear direct blocks
-  int num_direct = (num_sectors_left < INODE_NUM_DIRECT) ?
-                    num_sectors_left : INODE_NUM_DIRECT;
-  for (int i = 0; i < num_direct; ++i)
+  if (disk_inode->magic == INODE_ZIP_MAGIC)
     {
-      free_map_release (disk_inode->block_idxs[i], 1);
+      free_map_release (disk_inode->zip_start, disk_inode->zip_sectors);
+      return;
     }
-  num_sectors_left -= num_direct;
-
-  // Free indirect blocks
-  int num_indirect = (num_sectors_left <  INODE_NUM_IN_IND_BLOCK) ?
-    num_sectors_left : INODE_NUM_IN_IND_BLOCK;
-  if (num_indirect > 0)
-  {
-    inode_clear_helper (disk_inode->block_idxs[INODE_IND_IDX], num_indirect, 1);
-    num_sectors_left -= num_indirect;
-  }
 
-  // Free doubly indirect blocks
-  off_t oRet = INODE_NUM_IN_IND_BLOCK * INODE_NUM_IN_IND_BLOCK;
-  num_indirect = (num_sectors_left <  oRet) ?  num_sectors_left : oRet;
-  if (num_indirect > 0)
+  if (disk_inode->magic == INODE_EXTENT_MAGIC)
     {
-      inode_clear_helper (disk_inode->block_idxs[INODE_DUB_IND_IDX], num_indirect, 1);
-      num_sectors_left -= num_indirect;
+      for (uint32_t i = 0; i < disk_inode->extent_cnt; ++i)
+        free_map_release (disk_inode->extents[i].start,
+                          disk_inode->extents[i].length);
+      return;
     }
 
-  ASSERT (num_sectors_left == 0);
-  free (disk_inode);
-  return true;
+  // Clear direct blocks, skipping holes
+  size_t cnt = block_sectors (disk_inode);
+  for (int i = 0; i < INODE_NUM_DIRECT; ++i)
+    if (is_allocated (disk_inode->block_idxs[i]))
+      free_map_release (disk_inode->block_idxs[i], cnt);
+
+  // Free indirect and doubly indirect blocks
+  if (is_allocated (disk_inode->block_idxs[INODE_IND_IDX]))
+    inode_clear_helper (disk_inode->block_idxs[INODE_IND_IDX], 1, cnt);
+  if (is_allocated (disk_inode->block_idxs[INODE_DUB_IND_IDX]))
+    inode_clear_helper (disk_inode->block_idxs[INODE_DUB_IND_IDX], 2, cnt);
 }
 
+/* Frees sector IDX and, if it is an indirect block LEVEL levels above the
+   data, every allocated sector below it. Data pointers are to runs of
+   DATA_CNT sectors. */
 static void
-inode_clear_helper (block_sector_t idx, off_t num_sectors, int level)
+inode_clear_helper (block_sector_t idx, int level, size_t data_cnt)
 {
   if (level != 0) 
     {
-      struct inode_indirect_sector indirect_block; 
-      cache_io_at (idx, &indirect_block, true, 0, BLOCK_SECTOR_SIZE, false);
+      struct inode_indirect_sector *indirect_block
+        = cache_get (idx, INODE_INVALID_SECTOR, true, false);
+
+      for (off_t i = 0; i < INODE_NUM_IN_IND_BLOCK; ++i) 
+        if (is_allocated (indirect_block->block_idxs[i]))
+          inode_clear_helper (indirect_block->block_idxs[i], level - 1,
+                              data_cnt);
+      cache_put (indirect_block, false);
+      data_cnt = 1;
+    }
+  free_map_release (idx, data_cnt);
+}
+
+/* Releases the data sectors of INODE wholly past its first LENGTH
+   bytes, fewer than it has, and zeroes the rest of the sector, or of the
+   block, that LENGTH ends in. The caller must hold INODE's IO_LOCK for
+   writing and its GROW_LOCK. */
+static void
+inode_shrink (struct inode *inode, off_t length)
+{
+  struct inode_disk *disk_inode = &inode->data;
+  bool meta = is_metadata (disk_inode, inode->sector);
+  size_t keep = bytes_to_sectors (length);
+  size_t cnt = block_sectors (disk_inode);
+  off_t keep_ptrs = DIV_ROUND_UP (keep, cnt);
+  int sector_ofs = length % BLOCK_SECTOR_SIZE;
+  block_sector_t sector;
+
+  ASSERT (rwlock_held_by_current_thread (&inode->io_lock));
+
+  if (disk_inode->magic == INODE_INLINE_MAGIC)
+    {
+      memset (disk_inode->inline_data + length, 0,
+              inode_length (inode) - length);
+      return;
+    }
+
+  /* Zero what is kept past LENGTH. */
+  if (sector_ofs != 0
+      && (sector = byte_to_sector (inode, length, length + 1))
+         != INODE_INVALID_SECTOR)
+    cache_io_at (sector, inode->sector, ZEROARRAY, meta, sector_ofs,
+                 BLOCK_SECTOR_SIZE - sector_ofs, true);
+  if (disk_inode->magic != INODE_EXTENT_MAGIC)
+    for (size_t i = keep; i < keep_ptrs * cnt; i++)
+      if ((sector = get_index (inode, i)) != INODE_INVALID_SECTOR)
+        cache_io_at (sector, inode->sector, ZEROARRAY, meta, 0,
+                     BLOCK_SECTOR_SIZE, true);
+
+  if (disk_inode->magic == INODE_EXTENT_MAGIC)
+    {
+      size_t have = 0;
+
+      for (uint32_t i = 0; i < disk_inode->extent_cnt; ++i)
+        {
+          struct inode_extent *e = &disk_inode->extents[i];
+          size_t kept = keep > have ? keep - have : 0;
+
+          have += e->length;
+          if (kept < e->length)
+            {
+              free_map_release (e->start + kept, e->length - kept);
+              e->length = kept;
+            }
+        }
+      while (disk_inode->extent_cnt > 0
+             && disk_inode->extents[disk_inode->extent_cnt - 1].length == 0)
+        disk_inode->extent_cnt--;
+    }
+  else
+    {
+      for (off_t i = keep_ptrs; i < INODE_NUM_DIRECT; ++i)
+        if (is_allocated (disk_inode->block_idxs[i]))
+          {
+            free_map_release (disk_inode->block_idxs[i], cnt);
+            disk_inode->block_idxs[i] = INODE_INVALID_SECTOR;
+          }
+      shrink_indirect (inode, &disk_inode->block_idxs[INODE_IND_IDX], true, 1,
+                       INODE_NUM_DIRECT, keep_ptrs, cnt);
+      shrink_indirect (inode, &disk_inode->block_idxs[INODE_DUB_IND_IDX],
+                       true, 2, INODE_NUM_DIRECT + INODE_NUM_IN_IND_BLOCK,
+                       keep_ptrs, cnt);
+
+      /* The released entries may be in the translation cache. */
+      lock_acquire (&inode->xlate_lock);
+      if (inode->xlate != NULL)
+        inode->xlate->base = -1;
+      lock_release (&inode->xlate_lock);
+    }
+  inode->data_dirty = true;
+}
+
+/* Releases the data pointers from index KEEP on below the indirect
+   block *PTR, LEVEL levels above the data, which maps the pointers
+   from index BASE on to runs of DATA_CNT sectors, along with the
+   indirect blocks left with none. IN_INODE tells whether *PTR is one of
+   the inode's own pointers, a hole being INODE_INVALID_SECTOR there
+   instead of 0. */
+static void
+shrink_indirect (struct inode *inode, block_sector_t *ptr, bool in_inode,
+                 int level, off_t base, off_t keep, size_t data_cnt)
+{
+  off_t span = level == 1 ? INODE_NUM_IN_IND_BLOCK
+                          : INODE_NUM_IN_IND_BLOCK * INODE_NUM_IN_IND_BLOCK;
+  struct inode_indirect_sector *indirect_block;
+
+  if (!is_allocated (*ptr) || keep >= base + span)
+    return;
+  if (keep <= base)
+    {
+      inode_clear_helper (*ptr, level, data_cnt);
+      *ptr = in_inode ? INODE_INVALID_SECTOR : 0;
+      return;
+    }
+
+  indirect_block = cache_get (*ptr, inode->sector, true, true);
+  for (off_t i = 0; i < INODE_NUM_IN_IND_BLOCK; ++i)
+    {
+      block_sector_t *entry = &indirect_block->block_idxs[i];
+      off_t child = base + i * (span / INODE_NUM_IN_IND_BLOCK);
 
-      off_t base = (level == 1 ? 1 : INODE_NUM_IN_IND_BLOCK);
-      off_t n = DIV_ROUND_UP (num_sectors, base);
-      for (off_t i = 0; i < n; ++i) 
+      if (level > 1)
+        shrink_indirect (inode, entry, false, level - 1, child, keep,
+                         data_cnt);
+      else if (child >= keep && is_allocated (*entry))
         {
-          off_t num_in_level = num_sectors < base? num_sectors : base;
-          inode_clear_helper (indirect_block.block_idxs[i], num_in_level, level - 1);
-          num_sectors -= num_in_level;
+          free_map_release (*entry, data_cnt);
+          *entry = 0;
         }
     }
-  free_map_release (idx, 1);
+  cache_put (indirect_block, true);
 }
 
 /* Closes INODE and writes it to disk.
-   If this was the last reference to INODE, frees its memory.
-   If INODE was also a removed inode, frees its blocks. */
+   If this was the last reference to INODE, keeps it unused for a while
+   before freeing its memory, or if INODE was also a removed inode,
+   frees its memory and its blocks. */
 void
 inode_close (struct inode *inode) 
 {
-  bool last_instance;
+  struct open_inodes_bucket *bucket;
+  bool last_instance, removed;
 
   /* Ignore null pointer. */
   if (inode == NULL)
     return;
 
+  /* Compress what the last opener wrote.  Another may open the file
+     meanwhile, which can't tell. */
+  if (inode_use_compress && inode->zip_pending && inode->open_cnt == 1
+      && !inode->removed && !tmpfs_owns (inode->sector))
+    zip (inode);
+
+  /* Closing the last instance may write back or free the inode. */
+  journal_begin ();
   /* Decrement the open count and find out if this is the last instance. */
-  lock_acquire (&open_inodes_lock);
+  bucket = open_inodes_bucket (inode->sector);
+  lock_acquire (&bucket->lock);
   lock_acquire (&inode->lock);
   last_instance = --inode->open_cnt == 0;
+  removed = inode->removed;
   if (last_instance)
     {
-      list_remove (&inode->elem);
+      release_prealloc (inode);
       if (inode->removed)
         {
-          free_map_release (inode->sector, 1);
+          list_remove (&inode->elem);
+          if (inode->spill_sector != INODE_INVALID_SECTOR)
+            free_map_release (inode->spill_sector, 1);
+          inode_free_inumber (inode->sector);
           inode_clear (inode);
         }
+      else
+        {
+          if (inode->data_dirty)
+            inode_write_back (inode);
+          /* The decompressed unit is too big to keep around. */
+          free (inode->zip_buf);
+          inode->zip_buf = NULL;
+          inode->zip_unit = -1;
+          lock_acquire (&unused_lock);
+          list_push_front (&unused_inodes, &inode->unused_elem);
+          unused_cnt++;
+          lock_release (&unused_lock);
+        }
     }
   lock_release (&inode->lock);
-  lock_release (&open_inodes_lock);
-
-  /* If this is the last instance, then we own it and can free it. */
-  if (last_instance)
-    free (inode); 
+  lock_release (&bucket->lock);
+  journal_end ();
+
+  /* If this is the last instance of a removed inode, then we own it and
+     can free it.  An unused one may be opened or freed by now. */
+  if (last_instance && removed)
+    inode_free (inode);
+  else if (last_instance)
+    unused_trim (UNUSED_INODES_MAX);
 }
 
 /* Returns true if INODE represents a directory not a file. */
@@ -358,22 +1326,164 @@ inode_remove (struct inode *inode)
   lock_release (&inode->lock);
 }
 
-/* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
-   Returns the number of bytes actually read, which may be less
-   than SIZE if an error occurs or end of file is reached. */
-off_t
-inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) 
+/* Initializes RA for a new stream of reads. */
+void
+inode_ra_init (struct inode_ra *ra)
 {
-  uint8_t *buffer = buffer_;
-  off_t bytes_read = 0;
-  off_t inode_len = inode_length (inode);
+  ra->next_ofs = 0;
+  ra->ahead_ofs = 0;
+  ra->window = 0;
+}
+
+/* Detects whether a read of SIZE bytes at OFFSET continues the sequential
+   stream through INODE that RA tracks and, if so, queues the sectors
+   following it for read-ahead. The window doubles on every sequential
+   read up to the limit the cache allows and collapses on a random
+   access. */
+static void
+inode_read_ahead (struct inode *inode, struct inode_ra *ra, off_t offset,
+                  off_t size, off_t length)
+{
+  block_sector_t sectors[CACHE_RA_MAX_WINDOW];
+  off_t start, end, ofs;
+  size_t window_max = cache_read_ahead_window ();
+  size_t cnt, i;
+
+  lock_acquire (&inode->lock);
+  if (offset == ra->next_ofs)
+    {
+      ra->window = ra->window == 0 ? CACHE_RA_MIN_WINDOW : ra->window * 2;
+      if (ra->window > window_max)
+        ra->window = window_max;
+    }
+  else
+    {
+      ra->window = 0;
+      ra->ahead_ofs = 0;
+    }
+  ra->next_ofs = offset + size;
+  /* Only issue sectors beyond what earlier reads already queued. */
+  start = ROUND_UP (offset + size, BLOCK_SECTOR_SIZE);
+  if (start < ra->ahead_ofs)
+    start = ra->ahead_ofs;
+  end = offset + size + (off_t) ra->window * BLOCK_SECTOR_SIZE;
+  if (end > length)
+    end = length;
+  lock_release (&inode->lock);
+
+  /* Translate the whole window in one pass. */
+  ofs = start;
+  if (ofs < end)
+    {
+      cnt = DIV_ROUND_UP (end - start, BLOCK_SECTOR_SIZE);
+      if (cnt > CACHE_RA_MAX_WINDOW)
+        cnt = CACHE_RA_MAX_WINDOW;
+      cnt = get_indices (inode, start / BLOCK_SECTOR_SIZE, cnt, sectors);
+      for (i = 0; i < cnt; i++, ofs += BLOCK_SECTOR_SIZE)
+        if (!cache_read_ahead (sectors[i]))
+          break;
+    }
+
+  lock_acquire (&inode->lock);
+  if (ofs > ra->ahead_ofs)
+    ra->ahead_ofs = ofs;
+  lock_release (&inode->lock);
+}
+
+/* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
+   Returns the number of bytes actually read, which may be less
+   than SIZE if an error occurs or end of file is reached. */
+off_t
+inode_read_at (struct inode *inode, void *buffer, off_t size, off_t offset) 
+{
+  return inode_read_at_ra (inode, buffer, size, offset, &inode->ra);
+}
+
+/* Like inode_read_at(), but reads ahead for the stream of reads RA
+   tracks, so that streams through the same inode don't see each other's
+   reads as random. */
+off_t
+inode_read_at_ra (struct inode *inode, void *buffer, off_t size,
+                  off_t offset, struct inode_ra *ra)
+{
+  off_t bytes_read;
 
-  struct inode_disk *disk_inode = get_data_at (inode->sector);
+  if (tmpfs_owns (inode->sector))
+    bytes_read = tmpfs_read_at (inode->sector, buffer, size, offset);
+  else
+    {
+      rwlock_acquire_read (&inode->io_lock);
+      bytes_read = read_at (inode, buffer, size, offset, ra,
+                            size >= INODE_DIRECT_MIN);
+      rwlock_release_read (&inode->io_lock);
+    }
+  procstat_add (&procstat_current ()->read_bytes, bytes_read);
+  return bytes_read;
+}
+
+/* Reads SIZE bytes from INODE into BUFFER at OFFSET like inode_read_at(),
+   but moves the whole sectors that aren't cached straight from the disk
+   into BUFFER, whatever SIZE is, and doesn't read ahead. For filling a
+   page of a mapping, which then caches the data itself, so that it
+   isn't in the buffer cache a second time. */
+off_t
+inode_read_uncached_at (struct inode *inode, void *buffer, off_t size,
+                        off_t offset)
+{
+  off_t bytes_read;
+
+  if (tmpfs_owns (inode->sector))
+    bytes_read = tmpfs_read_at (inode->sector, buffer, size, offset);
+  else
+    {
+      rwlock_acquire_read (&inode->io_lock);
+      bytes_read = read_at (inode, buffer, size, offset, NULL, true);
+      rwlock_release_read (&inode->io_lock);
+    }
+  procstat_add (&procstat_current ()->read_bytes, bytes_read);
+  return bytes_read;
+}
+
+/* Does the work of inode_read_at_ra(). DIRECT moves whole uncached
+   sectors past the cache; otherwise the read ahead is done for RA. */
+static off_t
+read_at (struct inode *inode, void *buffer_, off_t size, off_t offset,
+         struct inode_ra *ra, bool direct)
+{
+  uint8_t *buffer = buffer_;
+  off_t bytes_read = 0;
+  off_t inode_len = inode_length (inode);
+
+  if (offset < inode_len)
+    {
+      off_t inline_size = size < inode_len - offset ? size
+                                                    : inode_len - offset;
+      if (inline_io (inode, buffer, inline_size, offset, false))
+        return inline_size;
+    }
+  if (inode->data.magic == INODE_ZIP_MAGIC)
+    return zip_read (inode, buffer, size, offset, inode_len);
+
+  /* Large reads stream past the cache instead of reading ahead into it. */
+  if (!direct)
+    inode_read_ahead (inode, ra, offset, size, inode_len);
   while (size > 0) 
     {
+      if (direct)
+        {
+          off_t n = inode_direct_io (inode, buffer + bytes_read, size, offset,
+                                     inode_len, false);
+          if (n > 0)
+            {
+              size -= n;
+              offset += n;
+              bytes_read += n;
+              continue;
+            }
+        }
+
       /* Disk sector to read, starting byte offset within sector. */
-      block_sector_t sector_idx = byte_to_sector (disk_inode, offset, inode_len);
-      if (sector_idx == INODE_INVALID_SECTOR) break;
+      block_sector_t sector_idx = byte_to_sector (inode, offset, inode_len);
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
       /* Bytes left in inode, bytes left in sector, lesser of the two. */
@@ -386,11 +1496,13 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       if (chunk_size <= 0)
         break;
 
-      block_sector_t sector_next = byte_to_sector (disk_inode, offset + chunk_size, 
-                                                   inode_len);
-      if (sector_next == sector_idx) sector_next = INODE_INVALID_SECTOR;
-      cache_io_at_ (sector_idx, buffer + bytes_read, false, sector_ofs,
-                   chunk_size, false, sector_next);
+      /* Holes read back as zeros. */
+      if (sector_idx == INODE_INVALID_SECTOR)
+        memset (buffer + bytes_read, 0, chunk_size);
+      else
+        cache_io_at (sector_idx, inode->sector, buffer + bytes_read,
+                     is_metadata (&inode->data, inode->sector), sector_ofs,
+                     chunk_size, false);
       
       /* Advance. */
       size -= chunk_size;
@@ -398,7 +1510,6 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       bytes_read += chunk_size;
     }
 
-  free (disk_inode);
   return bytes_read;
 }
 
@@ -408,8 +1519,589 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
    (Normally a write at end of file would extend the inode, but
    growth is not yet implemented.) */
 off_t
-inode_write_at (struct inode *inode, const void *buffer_, off_t size,
+inode_write_at (struct inode *inode, const void *buffer, off_t size,
                 off_t offset) 
+{
+  off_t bytes_written = 0;
+
+  if (tmpfs_owns (inode->sector))
+    bytes_written = write_tmpfs (inode, buffer, size, offset);
+  else
+    {
+      journal_begin ();
+      if (acquire_for_write (inode, offset, size))
+        {
+          bytes_written = write_at (inode, buffer, size, offset,
+                                    size >= INODE_DIRECT_MIN);
+          rwlock_release_read (&inode->io_lock);
+        }
+      journal_end ();
+    }
+  if (bytes_written > 0)
+    {
+      inode->version = new_version ();
+      inode->zip_pending = true;
+    }
+  procstat_add (&procstat_current ()->write_bytes, bytes_written);
+  return bytes_written;
+}
+
+/* Writes SIZE bytes from BUFFER into INODE at OFFSET like
+   inode_write_at(), but leaves out the sectors the buffer cache already
+   holds with the same contents, so writing back a page with a few bytes
+   changed only dirties the sectors they are in. The sectors that aren't
+   cached, such as those of a page read by inode_read_uncached_at(), go
+   straight to the disk rather than into the cache. Returns the number of
+   bytes that are now in the file, written or already there. */
+off_t
+inode_write_changed_at (struct inode *inode, const void *buffer_, off_t size,
+                        off_t offset)
+{
+  const uint8_t *buffer = buffer_;
+  off_t length = inode_length (inode);
+  off_t pos, run;  /* RUN starts the changed bytes not written yet. */
+
+  /* A tmpfs file's bytes are cheap to write either way. */
+  if (tmpfs_owns (inode->sector))
+    return write_changed (inode, buffer, size, offset);
+  for (pos = run = 0; pos < size; )
+    {
+      off_t sector_ofs = (offset + pos) % BLOCK_SECTOR_SIZE;
+      off_t chunk = BLOCK_SECTOR_SIZE - sector_ofs;
+      block_sector_t sector;
+
+      if (chunk > size - pos)
+        chunk = size - pos;
+      sector = byte_to_sector (inode, offset + pos, length);
+      if (is_allocated (sector)
+          && cache_matches (sector, buffer + pos, sector_ofs, chunk))
+        {
+          if (run < pos && write_changed (inode, buffer + run, pos - run,
+                                          offset + run) != pos - run)
+            return run;
+          run = pos + chunk;
+        }
+      pos += chunk;
+    }
+  if (run < size)
+    return run + write_changed (inode, buffer + run, size - run,
+                                offset + run);
+  return size;
+}
+
+/* Writes one run of changed bytes for inode_write_changed_at(). */
+static off_t
+write_changed (struct inode *inode, const void *buffer, off_t size,
+               off_t offset)
+{
+  off_t bytes_written = 0;
+
+  if (tmpfs_owns (inode->sector))
+    bytes_written = write_tmpfs (inode, buffer, size, offset);
+  else
+    {
+      journal_begin ();
+      if (acquire_for_write (inode, offset, size))
+        {
+          bytes_written = write_at (inode, buffer, size, offset, true);
+          rwlock_release_read (&inode->io_lock);
+        }
+      journal_end ();
+    }
+  if (bytes_written > 0)
+    {
+      inode->version = new_version ();
+      inode->zip_pending = true;
+    }
+  procstat_add (&procstat_current ()->write_bytes, bytes_written);
+  return bytes_written;
+}
+
+/* Writes SIZE bytes from BUFFER into INODE, a tmpfs file, at OFFSET,
+   unless writes to it are denied.  Takes none of INODE's locks, since
+   paging in the frames for the data may write back pages of a mapping
+   of INODE. */
+static off_t
+write_tmpfs (struct inode *inode, const void *buffer, off_t size,
+             off_t offset)
+{
+  if (inode->deny_write_cnt)
+    return 0;
+  return tmpfs_write_at (inode->sector, buffer, size, offset);
+}
+
+/* Takes INODE's IO_LOCK for reading, for a write of SIZE bytes at
+   OFFSET, after expanding INODE if it is compressed and giving it
+   sectors of its own in place of those the write falls in that it
+   shares with a clone. Returns false, without the lock, if there is no
+   disk space for the copies. */
+static bool
+acquire_for_write (struct inode *inode, off_t offset, off_t size)
+{
+  for (;;)
+    {
+      bool success;
+
+      rwlock_acquire_read (&inode->io_lock);
+      if (inode->data.magic != INODE_ZIP_MAGIC
+          && !is_shared (inode, offset, size))
+        return true;
+      rwlock_release_read (&inode->io_lock);
+
+      /* A clone can be made again before the lock is back, so check
+         again under it. */
+      rwlock_acquire_write (&inode->io_lock);
+      lock_acquire (&inode->eof_lock);
+      lock_acquire (&inode->grow_lock);
+      success = unzip (inode) && unshare (inode, offset, size);
+      lock_release (&inode->grow_lock);
+      lock_release (&inode->eof_lock);
+      rwlock_release_write (&inode->io_lock);
+      if (!success)
+        return false;
+    }
+}
+
+/* Returns true if any of the data sectors of INODE that the SIZE bytes
+   at OFFSET fall in is shared with a clone, so that writing it would
+   change the clone too. The caller must hold INODE's IO_LOCK. */
+static bool
+is_shared (struct inode *inode, off_t offset, off_t size)
+{
+  const struct inode_disk *disk_inode = &inode->data;
+  size_t first = offset / BLOCK_SECTOR_SIZE;
+  size_t end = bytes_to_sectors (offset + size);
+  size_t have = 0;
+
+  /* Metadata is never cloned, and the free map's own file is written
+     with the free map locked. */
+  if (disk_inode->magic != INODE_EXTENT_MAGIC || size <= 0
+      || is_metadata (disk_inode, inode->sector))
+    return false;
+  for (uint32_t i = 0; i < disk_inode->extent_cnt && have < end; ++i)
+    {
+      const struct inode_extent *e = &disk_inode->extents[i];
+
+      if (have + e->length > first)
+        {
+          size_t from = first > have ? first - have : 0;
+          size_t to = end - have < e->length ? end - have : e->length;
+          if (free_map_shared (e->start + from, to - from))
+            return true;
+        }
+      have += e->length;
+    }
+  return false;
+}
+
+/* Gives INODE sectors of its own in place of those it shares with a
+   clone among the ones that the SIZE bytes at OFFSET fall in, rounded
+   out to INODE_UNSHARE_SECTORS, so that writing them leaves the clone
+   alone. Each shared piece of an extent is copied to a new run, through
+   the cache and on to disk, before the extent is split around the copy
+   and the piece released, as inode_defrag() does, or if the inode has
+   no room for the extents a split adds, the whole extent is copied.
+   Returns false if out of disk space or memory. The caller must hold
+   INODE's IO_LOCK for writing, its EOF_LOCK and its GROW_LOCK. */
+static bool
+unshare (struct inode *inode, off_t offset, off_t size)
+{
+  struct inode_disk *disk_inode = &inode->data;
+  bool meta = is_metadata (disk_inode, inode->sector);
+  size_t first = ROUND_DOWN (offset / BLOCK_SECTOR_SIZE,
+                             INODE_UNSHARE_SECTORS);
+  size_t end = ROUND_UP (bytes_to_sectors (offset + size),
+                         INODE_UNSHARE_SECTORS);
+  void *buffer;
+  size_t have = 0;
+  uint32_t i = 0;
+
+  ASSERT (rwlock_held_by_current_thread (&inode->io_lock));
+
+  if (!is_shared (inode, offset, size))
+    return true;
+  buffer = malloc (BLOCK_SECTOR_SIZE);
+  if (buffer == NULL)
+    return false;
+  while (i < disk_inode->extent_cnt && have < end)
+    {
+      struct inode_extent *e = &disk_inode->extents[i];
+      struct inode_extent old = *e;
+      size_t from = first > have ? first - have : 0;
+      size_t to = end - have < e->length ? end - have : e->length;
+      size_t added, cnt, k;
+      block_sector_t start;
+
+      if (have + e->length <= first
+          || !free_map_shared (e->start + from, to - from))
+        {
+          have += e->length;
+          i++;
+          continue;
+        }
+
+      /* Copy the piece, or the whole extent without room to split. */
+      added = (from > 0) + (to < e->length);
+      if (added > 0
+          && (disk_inode->extent_cnt + added > INODE_NUM_EXTENTS
+              || (disk_inode->extent_cnt + added > INODE_PACKED_EXTENTS
+                  && !make_spill_room (inode))))
+        {
+          from = 0;
+          to = e->length;
+          added = 0;
+        }
+      cnt = to - from;
+      if (!free_map_allocate (cnt, inode->alloc_hint, &start))
+        {
+          free (buffer);
+          return false;
+        }
+      for (k = 0; k < cnt; k++)
+        {
+          cache_io_at (old.start + from + k, inode->sector, buffer, meta, 0,
+                       BLOCK_SECTOR_SIZE, false);
+          cache_io_at (start + k, inode->sector, buffer, meta, 0,
+                       BLOCK_SECTOR_SIZE, true);
+        }
+      /* The journal only logs metadata, so write the copy first. */
+      cache_sync (inode->sector);
+
+      /* Replace the extent by what comes before the piece, the copy
+         and what comes after. */
+      memmove (&disk_inode->extents[i + added], &disk_inode->extents[i],
+               (disk_inode->extent_cnt - i) * sizeof *e);
+      disk_inode->extent_cnt += added;
+      if (from > 0)
+        {
+          disk_inode->extents[i].length = from;
+          have += from;
+          i++;
+        }
+      disk_inode->extents[i].start = start;
+      disk_inode->extents[i].length = cnt;
+      if (to < old.length)
+        {
+          disk_inode->extents[i + 1].start = old.start + to;
+          disk_inode->extents[i + 1].length = old.length - to;
+        }
+      inode->data_dirty = true;
+      inode_write_back (inode);
+      free_map_release (old.start + from, cnt);
+      inode->alloc_hint = start + cnt;
+    }
+  free (buffer);
+  return true;
+}
+
+/* Scratch space for compressing a file. */
+struct zip_work
+  {
+    uint8_t in[INODE_ZIP_UNIT];         /* A unit as it is. */
+    uint8_t out[INODE_ZIP_UNIT];        /* The unit compressed. */
+    uint16_t table[LZ_TABLE_SIZE];      /* For lz_compress(). */
+    uint32_t ends[INODE_ZIP_ENTRIES];   /* A sector of the unit table. */
+    uint8_t sector[BLOCK_SECTOR_SIZE];  /* Packed units being gathered. */
+    struct inode_disk old;              /* The inode before. */
+  };
+
+/* Rewrites the data of INODE, a file whose last opener wrote it, in the
+   compressed layout if that takes fewer sectors. As in inode_defrag(),
+   the new copy goes to disk before the inode is switched to it and the
+   old sectors are released, all in one journal handle. Leaves INODE as
+   it is if its data doesn't compress, or if memory or a free run long
+   enough is short. */
+static void
+zip (struct inode *inode)
+{
+  struct zip_work *w = NULL;
+  size_t unit_cnt, table_cnt, data_cnt, fill = 0, i;
+  block_sector_t start, next;
+  uint32_t end = 0;
+  off_t length;
+
+  journal_begin ();
+  rwlock_acquire_write (&inode->io_lock);
+  lock_acquire (&inode->eof_lock);
+  lock_acquire (&inode->grow_lock);
+  inode->zip_pending = false;
+  length = inode_length (inode);
+  if (length == 0 || inode->data.magic == INODE_INLINE_MAGIC
+      || inode->data.magic == INODE_ZIP_MAGIC || inode->deny_write_cnt > 0
+      || is_metadata (&inode->data, inode->sector))
+    goto done;
+
+  /* Take room for every unit as it is, and give back what is left. */
+  unit_cnt = DIV_ROUND_UP (length, INODE_ZIP_UNIT);
+  table_cnt = DIV_ROUND_UP (unit_cnt, INODE_ZIP_ENTRIES);
+  data_cnt = bytes_to_sectors (length);
+  release_prealloc (inode);
+  w = malloc (sizeof *w);
+  if (w == NULL
+      || !free_map_allocate (table_cnt + data_cnt, inode->alloc_hint, &start))
+    goto done;
+  next = start + table_cnt;
+  for (i = 0; i < unit_cnt; i++)
+    {
+      off_t ofs = (off_t) i * INODE_ZIP_UNIT;
+      size_t len = length - ofs < INODE_ZIP_UNIT ? length - ofs
+                                                 : INODE_ZIP_UNIT;
+      const uint8_t *data = w->out;
+      size_t size;
+
+      if (read_at (inode, w->in, len, ofs, NULL, true) != (off_t) len)
+        goto fail;
+      size = lz_compress (w->in, len, w->out, len - 1, w->table);
+      if (size == 0)
+        {
+          data = w->in;
+          size = len;
+        }
+
+      /* Pack its bytes right after those of the unit before. */
+      end += size;
+      while (size > 0)
+        {
+          size_t chunk = BLOCK_SECTOR_SIZE - fill;
+
+          if (chunk > size)
+            chunk = size;
+          memcpy (w->sector + fill, data, chunk);
+          fill += chunk;
+          data += chunk;
+          size -= chunk;
+          if (fill == BLOCK_SECTOR_SIZE)
+            {
+              cache_io_at (next++, inode->sector, w->sector, false, 0,
+                           BLOCK_SECTOR_SIZE, true);
+              fill = 0;
+            }
+        }
+      w->ends[i % INODE_ZIP_ENTRIES] = end;
+      if (i % INODE_ZIP_ENTRIES == INODE_ZIP_ENTRIES - 1 || i == unit_cnt - 1)
+        {
+          size_t used = i % INODE_ZIP_ENTRIES + 1;
+
+          memset (w->ends + used, 0, (INODE_ZIP_ENTRIES - used) * sizeof end);
+          cache_io_at (start + i / INODE_ZIP_ENTRIES, inode->sector, w->ends,
+                       false, 0, BLOCK_SECTOR_SIZE, true);
+        }
+    }
+  if (fill > 0)
+    {
+      memset (w->sector + fill, 0, BLOCK_SECTOR_SIZE - fill);
+      cache_io_at (next++, inode->sector, w->sector, false, 0,
+                   BLOCK_SECTOR_SIZE, true);
+    }
+  if (next - start >= data_cnt)
+    goto fail;
+  free_map_release (next, start + table_cnt + data_cnt - next);
+  /* The journal only logs metadata, so write the copy first. */
+  cache_sync (inode->sector);
+
+  w->old = inode->data;
+  memset (&inode->data.block_idxs, 0, sizeof inode->data.block_idxs);
+  inode->data.zip_start = start;
+  inode->data.zip_sectors = next - start;
+  barrier ();
+  inode->data.magic = INODE_ZIP_MAGIC;
+  lock_acquire (&inode->xlate_lock);
+  if (inode->xlate != NULL)
+    inode->xlate->base = -1;
+  lock_release (&inode->xlate_lock);
+  inode->zip_unit = -1;
+  inode_write_back (inode);
+  clear_data (&w->old);
+  inode->alloc_hint = next;
+  goto done;
+
+ fail:
+  free_map_release (start, table_cnt + data_cnt);
+ done:
+  lock_release (&inode->grow_lock);
+  lock_release (&inode->eof_lock);
+  rwlock_release_write (&inode->io_lock);
+  journal_end ();
+  free (w);
+}
+
+/* Returns where unit UNIT of compressed INODE ends, in bytes from the
+   start of its packed units. */
+static uint32_t
+zip_end (struct inode *inode, size_t unit)
+{
+  uint32_t end;
+
+  cache_io_at (inode->data.zip_start + unit / INODE_ZIP_ENTRIES,
+               inode->sector, &end, false,
+               unit % INODE_ZIP_ENTRIES * sizeof end, sizeof end, false);
+  return end;
+}
+
+/* Loads unit UNIT of compressed INODE, LEN bytes of the file's LENGTH,
+   into INODE's unit buffer, unless it is there already. Reads ahead the
+   unit after it, for a sequential read. Returns false if out of memory
+   or the data is corrupt. The caller must hold INODE's ZIP_LOCK and its
+   IO_LOCK. */
+static bool
+load_unit (struct inode *inode, size_t unit, size_t len, off_t length)
+{
+  size_t unit_cnt = DIV_ROUND_UP (length, INODE_ZIP_UNIT);
+  block_sector_t first = (inode->data.zip_start
+                          + DIV_ROUND_UP (unit_cnt, INODE_ZIP_ENTRIES));
+  block_sector_t last = inode->data.zip_start + inode->data.zip_sectors;
+  uint32_t start, end, ofs;
+  block_sector_t sector;
+  uint8_t *packed;
+  size_t size, done;
+
+  if (inode->zip_unit == (off_t) unit)
+    return true;
+  if (inode->zip_buf == NULL)
+    {
+      inode->zip_buf = malloc (2 * INODE_ZIP_UNIT);
+      if (inode->zip_buf == NULL)
+        return false;
+    }
+  inode->zip_unit = -1;
+  start = unit > 0 ? zip_end (inode, unit - 1) : 0;
+  end = zip_end (inode, unit);
+  if (unit >= unit_cnt || end < start || end - start > len
+      || DIV_ROUND_UP (end, BLOCK_SECTOR_SIZE) > last - first)
+    return false;
+
+  /* Start reading the sectors past the first together. */
+  size = end - start;
+  for (sector = first + start / BLOCK_SECTOR_SIZE + 1;
+       sector < last
+       && sector < first + DIV_ROUND_UP (end + INODE_ZIP_UNIT,
+                                         BLOCK_SECTOR_SIZE);
+       sector++)
+    if (!cache_read_ahead (sector))
+      break;
+
+  /* A unit as long as it was is kept as it is. */
+  packed = size == len ? inode->zip_buf : inode->zip_buf + INODE_ZIP_UNIT;
+  for (done = 0, ofs = start; done < size; )
+    {
+      size_t sector_ofs = ofs % BLOCK_SECTOR_SIZE;
+      size_t chunk = BLOCK_SECTOR_SIZE - sector_ofs;
+
+      if (chunk > size - done)
+        chunk = size - done;
+      cache_io_at (first + ofs / BLOCK_SECTOR_SIZE, inode->sector,
+                   packed + done, false, sector_ofs, chunk, false);
+      done += chunk;
+      ofs += chunk;
+    }
+  if (size < len && !lz_decompress (packed, size, inode->zip_buf, len))
+    return false;
+  inode->zip_unit = unit;
+  return true;
+}
+
+/* Reads SIZE bytes at OFFSET of compressed INODE, whose data is LENGTH
+   bytes long, into BUFFER, a unit at a time through INODE's unit
+   buffer. Returns the number of bytes read, fewer than asked for at end
+   of file or if out of memory or the data is corrupt. The caller must
+   hold INODE's IO_LOCK. */
+static off_t
+zip_read (struct inode *inode, uint8_t *buffer, off_t size, off_t offset,
+          off_t length)
+{
+  off_t bytes_read = 0;
+
+  lock_acquire (&inode->zip_lock);
+  while (size > 0 && offset < length)
+    {
+      size_t unit = offset / INODE_ZIP_UNIT;
+      off_t unit_ofs = offset % INODE_ZIP_UNIT;
+      off_t len = length - (off_t) unit * INODE_ZIP_UNIT;
+      off_t chunk;
+
+      if (len > INODE_ZIP_UNIT)
+        len = INODE_ZIP_UNIT;
+      chunk = len - unit_ofs < size ? len - unit_ofs : size;
+      if (!load_unit (inode, unit, len, length))
+        break;
+      memcpy (buffer + bytes_read, inode->zip_buf + unit_ofs, chunk);
+      size -= chunk;
+      offset += chunk;
+      bytes_read += chunk;
+    }
+  lock_release (&inode->zip_lock);
+  return bytes_read;
+}
+
+/* Expands compressed INODE back into a single extent, so that it can be
+   written, the data going to disk before the inode is switched to it as
+   in zip(). Returns true if INODE is not compressed, or no longer is,
+   false if out of memory or of free runs long enough or if the data is
+   corrupt. The caller must hold INODE's IO_LOCK for writing, its
+   EOF_LOCK and its GROW_LOCK. */
+static bool
+unzip (struct inode *inode)
+{
+  off_t length = inode_length (inode);
+  size_t cnt = bytes_to_sectors (length);
+  block_sector_t start, old_start;
+  uint32_t old_cnt;
+  bool success = true;
+  size_t unit;
+
+  ASSERT (rwlock_held_by_current_thread (&inode->io_lock));
+
+  if (inode->data.magic != INODE_ZIP_MAGIC)
+    return true;
+  if (!free_map_allocate (cnt, inode->alloc_hint, &start))
+    return false;
+  lock_acquire (&inode->zip_lock);
+  for (unit = 0; success && unit * INODE_ZIP_UNIT < (size_t) length; unit++)
+    {
+      off_t ofs = (off_t) unit * INODE_ZIP_UNIT;
+      size_t len = length - ofs < INODE_ZIP_UNIT ? length - ofs
+                                                 : INODE_ZIP_UNIT;
+      size_t k;
+
+      success = load_unit (inode, unit, len, length);
+      if (!success)
+        break;
+      memset (inode->zip_buf + len, 0,
+              ROUND_UP (len, BLOCK_SECTOR_SIZE) - len);
+      for (k = 0; k * BLOCK_SECTOR_SIZE < len; k++)
+        cache_io_at (start + ofs / BLOCK_SECTOR_SIZE + k, inode->sector,
+                     inode->zip_buf + k * BLOCK_SECTOR_SIZE, false, 0,
+                     BLOCK_SECTOR_SIZE, true);
+    }
+  inode->zip_unit = -1;
+  lock_release (&inode->zip_lock);
+  if (!success)
+    {
+      free_map_release (start, cnt);
+      return false;
+    }
+  /* The journal only logs metadata, so write the copy first. */
+  cache_sync (inode->sector);
+
+  old_start = inode->data.zip_start;
+  old_cnt = inode->data.zip_sectors;
+  memset (&inode->data.block_idxs, 0, sizeof inode->data.block_idxs);
+  inode->data.extents[0].start = start;
+  inode->data.extents[0].length = cnt;
+  inode->data.extent_cnt = 1;
+  barrier ();
+  inode->data.magic = INODE_EXTENT_MAGIC;
+  inode_write_back (inode);
+  free_map_release (old_start, old_cnt);
+  inode->alloc_hint = start + cnt;
+  return true;
+}
+
+/* Does the work of inode_write_at() inside a journal handle. DIRECT
+   moves whole uncached sectors past the cache. */
+static off_t
+write_at (struct inode *inode, const void *buffer_, off_t size, off_t offset,
+          bool direct)
 {
   const uint8_t *buffer = buffer_;
   off_t bytes_written = 0;
@@ -419,44 +2111,66 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
   if (inode->deny_write_cnt)
     return 0;
 
-  struct inode_disk *disk_inode = get_data_at (inode->sector);
+  struct inode_disk *disk_inode = &inode->data;
   length_after_write = inode_length (inode);
 
   /* Expand if write will go past end of file. */
   // Writes past EOF are atomic, claim lock if it is a write past EOF
   expand_write = (offset + size) > length_after_write;
   if (expand_write)
-    lock_acquire (&inode->eof_lock);
-
-  /*  We reach here when we aren't writing past file or if we are, we
-   *  are currently the only thread writing past EOF 
-   *  (we claimed the lock successfully)
-   *  So check to see noone else expanded while we were waiting
-   */
-  if (byte_to_sector (disk_inode, offset + size - 1, length_after_write) ==
-      INODE_INVALID_SECTOR)
     {
-      if (!inode_expand (disk_inode, offset + size))
+      lock_acquire (&inode->eof_lock);
+      /* Check to see noone else expanded while we were waiting. */
+      length_after_write = inode_length (inode);
+      if (offset + size <= length_after_write)
         {
+          expand_write = false;
           lock_release (&inode->eof_lock);
-          free (disk_inode);
-          return 0;  /* Failed to expand the inode. */
+        }
+      else
+        {
+          /* Sectors allocated before a failure stay recorded in DATA and
+             get reused by the next expansion. */
+          inode->data_dirty = true;
+          /* GROW_LOCK keeps inline data from moving under its users. */
+          lock_acquire (&inode->grow_lock);
+          if (!inode_expand (disk_inode, inode->sector, inode,
+                             offset + size, offset, size))
+            {
+              lock_release (&inode->grow_lock);
+              lock_release (&inode->eof_lock);
+              return 0;  /* Failed to expand the inode. */
+            }
+          lock_release (&inode->grow_lock);
+          /* Use the new size while writing.*/
+          length_after_write = offset + size;  
         }
     }
-  else if (expand_write)
+
+  if (offset < length_after_write
+      && inline_io (inode, (void *) buffer, size, offset, true))
     {
-      //While we where waiting for lock someone else expanded the file
-      expand_write = false;
-      lock_release (&inode->eof_lock);
+      bytes_written = size;
+      size = 0;
     }
-  /* Use the new size while writing.*/
-  if (expand_write)
-    length_after_write = offset + size;  
   
   while (size > 0) 
     {
+      if (direct)
+        {
+          off_t n = inode_direct_io (inode, (void *) buffer + bytes_written,
+                                     size, offset, length_after_write, true);
+          if (n > 0)
+            {
+              size -= n;
+              offset += n;
+              bytes_written += n;
+              continue;
+            }
+        }
+
       /* Sector to write, starting byte offset within sector. */
-      block_sector_t sector_idx = byte_to_sector (disk_inode, offset,
+      block_sector_t sector_idx = byte_to_sector (inode, offset,
                                                   length_after_write);
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
@@ -470,11 +2184,25 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
       if (chunk_size <= 0)
         break;
 
-      block_sector_t sector_next = byte_to_sector (disk_inode, offset + chunk_size,
-                                                   length_after_write);
-      if (sector_next == sector_idx) sector_next = INODE_INVALID_SECTOR;
-      cache_io_at_ (sector_idx, (void*) buffer + bytes_written, false,
-                    sector_ofs, chunk_size, true, sector_next);
+      /* Allocate holes as they get written. A sector we overwrite whole
+         starts out with our data instead of being zeroed first. */
+      bool filled = false;
+      if (sector_idx == INODE_INVALID_SECTOR)
+        {
+          bool whole = chunk_size == BLOCK_SECTOR_SIZE;
+          sector_idx = inode_fill_hole (inode, offset / BLOCK_SECTOR_SIZE,
+                                        whole ? (const void *) (buffer
+                                                                + bytes_written)
+                                              : ZEROARRAY, &filled);
+          if (sector_idx == INODE_INVALID_SECTOR)
+            break;
+          filled = filled && whole;
+        }
+      if (!filled)
+        cache_io_at (sector_idx, inode->sector,
+                     (void*) buffer + bytes_written,
+                     is_metadata (&inode->data, inode->sector),
+                     sector_ofs, chunk_size, true);
 
       /* Advance. */
       size -= chunk_size;
@@ -486,16 +2214,359 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
      increased the size further already so don't overwrite it. */
   if (expand_write)
     {
+      lock_acquire (&inode->lock);
       inode->length = length_after_write;
       disk_inode->length = length_after_write;
-      lock_release (&inode->eof_lock);
+      lock_release (&inode->lock);
       /* Flush the changes to cache. */
-      cache_io_at (inode->sector, disk_inode, true, 0, BLOCK_SECTOR_SIZE, true);
+      inode_write_back (inode);
+      lock_release (&inode->eof_lock);
     }
-  free (disk_inode);
   return bytes_written;
 }
 
+/* Moves the leading whole sectors of the SIZE bytes at OFFSET of INODE,
+   whose data is LENGTH bytes long, directly between the disk and BUFFER
+   if OFFSET is sector aligned. Moves at most one run of contiguous,
+   allocated, uncached sectors. Returns the number of bytes moved, 0 if
+   the next sector must go through the cache. */
+static off_t
+inode_direct_io (struct inode *inode, void *buffer, off_t size, off_t offset,
+                 off_t length, bool is_write)
+{
+  block_sector_t sectors[CACHE_DIRECT_MAX];
+  off_t left = length - offset < size ? length - offset : size;
+  size_t cnt, run;
+
+  if (offset % BLOCK_SECTOR_SIZE != 0 || left < BLOCK_SECTOR_SIZE)
+    return 0;
+  cnt = left / BLOCK_SECTOR_SIZE;
+  if (cnt > CACHE_DIRECT_MAX)
+    cnt = CACHE_DIRECT_MAX;
+  cnt = get_indices (inode, offset / BLOCK_SECTOR_SIZE, cnt, sectors);
+  if (cnt == 0)
+    return 0;
+  for (run = 1; run < cnt && sectors[run] == sectors[0] + run; run++)
+    continue;
+  if (!cache_direct_io (sectors[0], run, buffer, is_write))
+    return 0;
+  return run * BLOCK_SECTOR_SIZE;
+}
+
+/* Sets the length of INODE to LENGTH bytes. Shrinking releases the
+   sectors wholly past LENGTH in one go and zeroes the rest of the last
+   sector, or block, kept, so the file reads back zeros if it grows
+   again. Growing leaves a hole, as a write past end of file would,
+   except that extent layout inodes allocate and zero their new sectors.
+   Returns false if writes to INODE are denied or out of disk space. */
+bool
+inode_truncate (struct inode *inode, off_t length)
+{
+  off_t old_length;
+  bool success = true;
+
+  if (length < 0)
+    return false;
+  if (tmpfs_owns (inode->sector))
+    {
+      success = !inode->deny_write_cnt
+                && tmpfs_truncate (inode->sector, length);
+      if (success)
+        inode->version = new_version ();
+      return success;
+    }
+
+  journal_begin ();
+  rwlock_acquire_write (&inode->io_lock);
+  lock_acquire (&inode->eof_lock);
+  lock_acquire (&inode->grow_lock);
+  old_length = inode_length (inode);
+  if (inode->deny_write_cnt)
+    success = false;
+  else if (length != old_length && !unzip (inode))
+    success = false;
+  else if (length < old_length)
+    {
+      /* The rest of the last sector kept gets zeroed. */
+      success = (length % BLOCK_SECTOR_SIZE == 0
+                 || unshare (inode, length, 1));
+      if (success)
+        inode_shrink (inode, length);
+    }
+  else if (length > old_length)
+    {
+      inode->data_dirty = true;
+      success = inode_expand (&inode->data, inode->sector, inode, length, 0,
+                              0);
+    }
+  if (success && length != old_length)
+    {
+      lock_acquire (&inode->lock);
+      inode->length = length;
+      inode->data.length = length;
+      lock_release (&inode->lock);
+      inode_write_back (inode);
+      inode->version = new_version ();
+      inode->zip_pending = true;
+    }
+  lock_release (&inode->grow_lock);
+  lock_release (&inode->eof_lock);
+  rwlock_release_write (&inode->io_lock);
+  journal_end ();
+  return success;
+}
+
+/* Reserves contiguous disk space for INODE's bytes up to OFFSET +
+   LENGTH, as inode_reserve() does, and grows INODE to that size if it
+   is shorter, without writing anything to the space: the new bytes
+   read as zeros, being a hole, until written. Returns false if there
+   is no free run that long or writes to INODE are denied. */
+bool
+inode_allocate (struct inode *inode, off_t offset, off_t length)
+{
+  off_t end = offset + length;
+
+  if (offset < 0 || length <= 0 || end < offset
+      || !inode_reserve (inode, end))
+    return false;
+  if (end > inode_length (inode))
+    return inode_truncate (inode, end);
+  return true;
+}
+
+/* Moves the data of INODE, a file, into one run of contiguous sectors
+   and makes it a single extent, so that it reads back sequentially
+   again after churn has scattered it. The data is copied through the
+   cache and on disk before the inode is switched to the copy, in one
+   journal handle with the release of the old sectors, so that a crash
+   leaves the file whole in one place or the other. Holes are filled
+   in. Returns true if INODE is now contiguous, or a tmpfs file, which
+   has no sectors, false if there is no free run long enough or memory
+   is short. */
+bool
+inode_defrag (struct inode *inode)
+{
+  struct inode_disk *old = NULL;
+  bool meta = is_metadata (&inode->data, inode->sector);
+  block_sector_t first, start;
+  void *buffer = NULL;
+  bool success = false;
+  size_t cnt, i;
+
+  if (tmpfs_owns (inode->sector))
+    return true;
+
+  journal_begin ();
+  rwlock_acquire_write (&inode->io_lock);
+  lock_acquire (&inode->eof_lock);
+  lock_acquire (&inode->grow_lock);
+  cnt = bytes_to_sectors (inode_length (inode));
+
+  /* Done if inline, or if the sectors already follow each other, as a
+     compressed file's do. */
+  if (inode->data.magic == INODE_ZIP_MAGIC)
+    {
+      success = true;
+      goto done;
+    }
+  if (inode->data.magic == INODE_INLINE_MAGIC || cnt == 0)
+    goto done;
+  first = get_index (inode, 0);
+  for (i = 0; i < cnt; i++)
+    {
+      block_sector_t sector = get_index (inode, i);
+
+      if (sector == INODE_INVALID_SECTOR || sector != first + i)
+        break;
+    }
+  if (i == cnt)
+    {
+      success = true;
+      goto done;
+    }
+
+  /* The preallocation window is given up either way, and may be where
+     the new run fits best. */
+  release_prealloc (inode);
+  old = malloc (sizeof *old);
+  buffer = malloc (BLOCK_SECTOR_SIZE);
+  if (old == NULL || buffer == NULL
+      || !free_map_allocate (cnt, inode->alloc_hint, &start))
+    goto done;
+  for (i = 0; i < cnt; i++)
+    {
+      block_sector_t sector = get_index (inode, i);
+
+      if (sector == INODE_INVALID_SECTOR)
+        memset (buffer, 0, BLOCK_SECTOR_SIZE);
+      else
+        cache_io_at (sector, inode->sector, buffer, meta, 0,
+                     BLOCK_SECTOR_SIZE, false);
+      cache_io_at (start + i, inode->sector, buffer, meta, 0,
+                   BLOCK_SECTOR_SIZE, true);
+    }
+  /* The journal only logs metadata, so write the copy first. */
+  cache_sync (inode->sector);
+
+  *old = inode->data;
+  memset (&inode->data.extents, 0, sizeof inode->data.extents);
+  inode->data.extents[0].start = start;
+  inode->data.extents[0].length = cnt;
+  inode->data.extent_cnt = 1;
+  barrier ();
+  inode->data.magic = INODE_EXTENT_MAGIC;
+  lock_acquire (&inode->xlate_lock);
+  if (inode->xlate != NULL)
+    inode->xlate->base = -1;
+  lock_release (&inode->xlate_lock);
+  inode_write_back (inode);
+  clear_data (old);
+  inode->alloc_hint = start + cnt;
+  inode->version = new_version ();
+  success = true;
+
+ done:
+  lock_release (&inode->grow_lock);
+  lock_release (&inode->eof_lock);
+  rwlock_release_write (&inode->io_lock);
+  journal_end ();
+  free (buffer);
+  free (old);
+  return success;
+}
+
+/* Makes the inode numbered INUMBER, from inode_alloc_inumber(), a
+   clone of SRC, a file: a new file with the same contents that shares
+   SRC's data sectors, each counted as owned by both in the free map,
+   until either file writes to them and gets copies of its own. SRC's
+   data is written to disk first, so the clone needn't sync sectors it
+   doesn't own in the cache. Only extent layout and inline layout files
+   on disk can be cloned. Returns false if SRC can't be, or if out of
+   memory or disk space, in which case the caller can copy the data into
+   a new inode instead. */
+bool
+inode_clone (struct inode *src, block_sector_t inumber)
+{
+  struct inode_disk *disk_inode;
+  struct inode_packed p;
+  size_t cnt, have = 0;
+  uint32_t i = 0;
+  bool success = false;
+
+  if (tmpfs_owns (src->sector) || tmpfs_owns (inumber))
+    return false;
+  disk_inode = malloc (sizeof *disk_inode);
+  if (disk_inode == NULL)
+    return false;
+
+  journal_begin ();
+  rwlock_acquire_write (&src->io_lock);
+  lock_acquire (&src->eof_lock);
+  lock_acquire (&src->grow_lock);
+  *disk_inode = src->data;
+  if (disk_inode->is_dir
+      || (disk_inode->magic != INODE_EXTENT_MAGIC
+          && (disk_inode->magic != INODE_INLINE_MAGIC
+              || (size_t) disk_inode->length > inline_max (inumber))))
+    goto done;
+
+  if (disk_inode->magic == INODE_EXTENT_MAGIC)
+    {
+      /* Share the sectors up to the length only, and none of those past
+         it that a failed expansion left. */
+      cache_sync (src->sector);
+      cnt = bytes_to_sectors (disk_inode->length);
+      for (i = 0; i < disk_inode->extent_cnt && have < cnt; i++)
+        {
+          struct inode_extent *e = &disk_inode->extents[i];
+
+          if (e->length > cnt - have)
+            e->length = cnt - have;
+          if (!free_map_share (e->start, e->length))
+            goto unshare;
+          have += e->length;
+        }
+      memset (&disk_inode->extents[i], 0,
+              (INODE_NUM_EXTENTS - i) * sizeof *disk_inode->extents);
+      disk_inode->extent_cnt = i;
+    }
+
+  if (!is_packed (inumber))
+    cache_io_at (inumber, inumber, disk_inode, true, 0, BLOCK_SECTOR_SIZE,
+                 true);
+  else if (pack (disk_inode, &p))
+    write_slot (inumber, &p);
+  else
+    {
+      /* Too many extents for the slot, so spill right away. */
+      block_sector_t spill;
+
+      if (!free_map_allocate (1, home_sector (inumber), &spill))
+        goto unshare;
+      cache_io_at (spill, inumber, disk_inode, true, 0, BLOCK_SECTOR_SIZE,
+                   true);
+      memset (&p, 0, sizeof p);
+      p.full_sector = spill;
+      p.magic = INODE_SPILL_MAGIC;
+      write_slot (inumber, &p);
+    }
+  success = true;
+  goto done;
+
+ unshare:
+  while (i-- > 0)
+    free_map_release (disk_inode->extents[i].start,
+                      disk_inode->extents[i].length);
+ done:
+  lock_release (&src->grow_lock);
+  lock_release (&src->eof_lock);
+  rwlock_release_write (&src->io_lock);
+  journal_end ();
+  free (disk_inode);
+  return success;
+}
+
+/* Reserves one run of sectors for INODE to grow into until it is
+   LENGTH bytes long, for a caller about to write that much in pieces,
+   so that the file ends up contiguous however the pieces arrive. The
+   reservation lasts until INODE is closed. Returns false if the free
+   map has no free run that long, in which case the pieces are placed
+   as usual. A tmpfs file reserves nothing. */
+bool
+inode_reserve (struct inode *inode, off_t length)
+{
+  size_t have = bytes_to_sectors (inode_length (inode));
+  size_t need = bytes_to_sectors (length);
+  bool success = true;
+
+  if (tmpfs_owns (inode->sector))
+    return true;
+  if (need <= have || (size_t) length <= inline_max (inode->sector))
+    return true;
+  need -= have;
+
+  lock_acquire (&inode->grow_lock);
+  if (inode->prealloc_cnt < need)
+    {
+      block_sector_t near = inode->alloc_hint;
+
+      if (inode->data.magic == INODE_EXTENT_MAGIC
+          && inode->data.extent_cnt > 0)
+        {
+          struct inode_extent *last
+            = &inode->data.extents[inode->data.extent_cnt - 1];
+          near = last->start + last->length;
+        }
+      release_prealloc (inode);
+      if (free_map_allocate (need, near, &inode->prealloc_start))
+        inode->prealloc_cnt = need;
+      else
+        success = false;
+    }
+  lock_release (&inode->grow_lock);
+  return success;
+}
+
 /* Disables writes to INODE.
    May be called at most once per inode opener. */
 void
@@ -520,156 +2591,627 @@ inode_allow_write (struct inode *inode)
   lock_release (&inode->lock);
 }
 
+/* Writes INODE's dirty data and metadata sectors to disk, along with the
+   free map sectors recording their allocation, and waits for them. Other
+   inodes' dirty sectors stay in the cache. A tmpfs file has nothing to
+   write. */
+void
+inode_sync (struct inode *inode)
+{
+  if (tmpfs_owns (inode->sector))
+    return;
+  journal_begin ();
+  lock_acquire (&inode->eof_lock);
+  if (inode->data_dirty)
+    inode_write_back (inode);
+  lock_release (&inode->eof_lock);
+  journal_end ();
+
+  /* With a journal, committing makes all of the metadata durable in one
+     sequential write. */
+  journal_commit ();
+  if (!journal_active ())
+    cache_sync (FREE_MAP_SECTOR);
+  if (is_packed (inode->sector))
+    cache_sync (home_sector (inode->sector));
+  cache_sync (inode->sector);
+}
+
+/* Writes INODE's dirty data sectors to disk and waits for them, after a
+   write through a file opened for write-through. Bytes kept inline and
+   changes to which sectors hold the data are metadata, which only
+   inode_sync() makes durable, so falls back to it when there may be
+   any. */
+void
+inode_write_through (struct inode *inode)
+{
+  if (tmpfs_owns (inode->sector))
+    return;
+  if (inode->data_dirty || inode->data.magic == INODE_INLINE_MAGIC)
+    inode_sync (inode);
+  else
+    cache_sync (inode->sector);
+}
+
 /* Returns the length, in bytes, of INODE's data.
    INODE could potentially expand in length later and that's okay. */
 off_t
 inode_length (struct inode *inode)
 {
   off_t length;
+  if (tmpfs_owns (inode->sector))
+    return tmpfs_length (inode->sector);
   lock_acquire (&inode->lock);
   length = inode->length;
   lock_release (&inode->lock);
   return length;
 }
 
+/* Returns the sector holding the ABS_IDX'th data sector of INODE, or
+   INODE_INVALID_SECTOR if ABS_IDX is past what the pointer tree maps or
+   in a hole. */
 static block_sector_t
-get_index (const struct inode_disk *disk_inode, off_t abs_idx)
+get_index (struct inode *inode, off_t abs_idx)
 {
-  struct inode_indirect_sector *sect;
-  block_sector_t idx = INODE_INVALID_SECTOR;
-  if (abs_idx < INODE_NUM_DIRECT)
+  size_t cnt = block_sectors (&inode->data);
+  off_t ptr_idx = abs_idx / cnt;
+  block_sector_t idx;
+
+  if (inode->data.magic == INODE_INLINE_MAGIC
+      || inode->data.magic == INODE_ZIP_MAGIC)
+    return INODE_INVALID_SECTOR;
+  if (inode->data.magic == INODE_EXTENT_MAGIC)
+    return extent_index (&inode->data, abs_idx);
+  if (ptr_idx < INODE_NUM_DIRECT)
+    idx = inode->data.block_idxs[ptr_idx];
+  else
     {
-        idx = disk_inode->block_idxs[abs_idx];
+      lock_acquire (&inode->xlate_lock);
+      idx = get_index_locked (inode, ptr_idx);
+      lock_release (&inode->xlate_lock);
     }
-  else if (abs_idx < (INODE_NUM_DIRECT + INODE_NUM_IN_IND_BLOCK))
+  if (!is_allocated (idx))
+    return INODE_INVALID_SECTOR;
+  return idx + abs_idx % cnt;
+}
+
+/* Stores in SECTORS the sectors holding the CNT data sectors of INODE
+   starting at index ABS_IDX, translating all of them under one lock
+   acquisition. Returns the number translated, which is less than CNT if
+   a sector past the pointer tree or not yet allocated is reached. */
+static size_t
+get_indices (struct inode *inode, off_t abs_idx, size_t cnt,
+             block_sector_t *sectors)
+{
+  size_t i;
+
+  if (inode->data.magic == INODE_INLINE_MAGIC
+      || inode->data.magic == INODE_ZIP_MAGIC)
+    return 0;
+  if (inode->data.magic == INODE_EXTENT_MAGIC)
     {
-      sect = calloc (1, sizeof (struct inode_indirect_sector));
-      if (sect != NULL)
+      for (i = 0; i < cnt; i++)
         {
-          cache_io_at (disk_inode->block_idxs[INODE_IND_IDX], sect, true, 0,
-                       BLOCK_SECTOR_SIZE, false);
-          idx = sect->block_idxs [abs_idx - INODE_NUM_DIRECT];
-          free (sect);
+          sectors[i] = extent_index (&inode->data, abs_idx + i);
+          if (sectors[i] == INODE_INVALID_SECTOR)
+            break;
         }
+      return i;
     }
-  else if (abs_idx < (INODE_NUM_DIRECT + INODE_NUM_IN_IND_BLOCK) + 
-      INODE_NUM_IN_IND_BLOCK * INODE_NUM_IN_IND_BLOCK)
+
+  size_t per_ptr = block_sectors (&inode->data);
+  lock_acquire (&inode->xlate_lock);
+  for (i = 0; i < cnt; i++)
+    {
+      off_t ptr_idx = (abs_idx + (off_t) i) / per_ptr;
+      block_sector_t idx = ptr_idx < INODE_NUM_DIRECT
+                           ? inode->data.block_idxs[ptr_idx]
+                           : get_index_locked (inode, ptr_idx);
+      if (!is_allocated (idx))
+        break;
+      sectors[i] = idx + (abs_idx + i) % per_ptr;
+    }
+  lock_release (&inode->xlate_lock);
+  return i;
+}
+
+/* Returns the sector holding the ABS_IDX'th data sector of extent layout
+   DISK_INODE, or INODE_INVALID_SECTOR if it has no such sector. */
+static block_sector_t
+extent_index (const struct inode_disk *disk_inode, off_t abs_idx)
+{
+  ASSERT (disk_inode->magic == INODE_EXTENT_MAGIC);
+
+  for (uint32_t i = 0; i < disk_inode->extent_cnt && abs_idx >= 0; ++i)
+    {
+      const struct inode_extent *e = &disk_inode->extents[i];
+      if (abs_idx < (off_t) e->length)
+        return e->start + abs_idx;
+      abs_idx -= e->length;
+    }
+  return INODE_INVALID_SECTOR;
+}
+
+/* Translates data pointer index ABS_IDX, past the direct blocks, through
+   INODE's indirect blocks, reading each indirect block from the cache
+   only when the translation cache doesn't already map ABS_IDX. The
+   caller must hold INODE's XLATE_LOCK. */
+static block_sector_t
+get_index_locked (struct inode *inode, off_t abs_idx)
+{
+  const struct inode_disk *disk_inode = &inode->data;
+  block_sector_t ind_sector, idx;
+  off_t base;
+
+  ASSERT (lock_held_by_current_thread (&inode->xlate_lock));
+  ASSERT (abs_idx >= INODE_NUM_DIRECT);
+
+  /* Find the first data pointer index mapped by the indirect block that
+     maps ABS_IDX. */
+  if (abs_idx < INODE_NUM_DIRECT + INODE_NUM_IN_IND_BLOCK)
+    base = INODE_NUM_DIRECT;
+  else if (abs_idx < (INODE_NUM_DIRECT + INODE_NUM_IN_IND_BLOCK) +
+           INODE_NUM_IN_IND_BLOCK * INODE_NUM_IN_IND_BLOCK)
     {
       off_t start = abs_idx - (INODE_NUM_DIRECT + INODE_NUM_IN_IND_BLOCK);
-      off_t outer_idx = start / INODE_NUM_IN_IND_BLOCK;
-      off_t inner_idx = start % INODE_NUM_IN_IND_BLOCK;
+      base = abs_idx - start % INODE_NUM_IN_IND_BLOCK;
+    }
+  else
+    return INODE_INVALID_SECTOR;
+
+  if (inode->xlate != NULL && inode->xlate->base == base)
+    {
+      idx = inode->xlate->entries[abs_idx - base];
+      /* Unallocated entries may have been filled in since. */
+      if (idx != 0 && idx != INODE_INVALID_SECTOR)
+        return idx;
+    }
+
+  /* Locate the indirect block. */
+  if (base == INODE_NUM_DIRECT)
+    ind_sector = disk_inode->block_idxs[INODE_IND_IDX];
+  else
+    {
+      off_t outer_idx = (base - (INODE_NUM_DIRECT + INODE_NUM_IN_IND_BLOCK))
+                        / INODE_NUM_IN_IND_BLOCK;
+      block_sector_t dub_sector = disk_inode->block_idxs[INODE_DUB_IND_IDX];
+      if (dub_sector == INODE_INVALID_SECTOR)
+        return INODE_INVALID_SECTOR;
+      cache_io_at (dub_sector, inode->sector, &ind_sector, true,
+                   outer_idx * sizeof (block_sector_t),
+                   sizeof (block_sector_t), false);
+    }
+  if (ind_sector == INODE_INVALID_SECTOR || ind_sector == 0)
+    return INODE_INVALID_SECTOR;
 
-      sect = calloc (1, sizeof (struct inode_indirect_sector));
-      if (sect != NULL)
+  /* Load it into the translation cache, or just read the one entry if
+     there's no memory for one. */
+  if (inode->xlate == NULL)
+    inode->xlate = malloc (sizeof *inode->xlate);
+  if (inode->xlate == NULL)
+    {
+      cache_io_at (ind_sector, inode->sector, &idx, true,
+                   (abs_idx - base) * sizeof (block_sector_t),
+                   sizeof (block_sector_t), false);
+      return idx;
+    }
+  cache_io_at (ind_sector, inode->sector, inode->xlate->entries, true, 0,
+               BLOCK_SECTOR_SIZE, false);
+  inode->xlate->base = base;
+  return inode->xlate->entries[abs_idx - base];
+}
+
+/* Writes INODE's resident on-disk inode back to its sector through the
+   cache. The caller must hold EOF_LOCK or GROW_LOCK, or be the only user
+   of INODE. */
+static void
+inode_write_back (struct inode *inode)
+{
+  struct inode_packed p;
+
+  if (!is_packed (inode->sector))
+    cache_io_at (inode->sector, inode->sector, &inode->data, true, 0,
+                 BLOCK_SECTOR_SIZE, true);
+  else if (pack (&inode->data, &p))
+    {
+      /* Move back into the slot once it fits again. */
+      write_slot (inode->sector, &p);
+      if (inode->spill_sector != INODE_INVALID_SECTOR)
+        free_map_release (inode->spill_sector, 1);
+      inode->spill_sector = INODE_INVALID_SECTOR;
+      inode->spill_linked = false;
+    }
+  else
+    {
+      ASSERT (inode->spill_sector != INODE_INVALID_SECTOR);
+      cache_io_at (inode->spill_sector, inode->sector, &inode->data, true,
+                   0, BLOCK_SECTOR_SIZE, true);
+      if (!inode->spill_linked)
         {
-          cache_io_at (disk_inode->block_idxs[INODE_DUB_IND_IDX], sect, true, 0,
-                       BLOCK_SECTOR_SIZE, false);
-          cache_io_at (sect->block_idxs[outer_idx], sect, true, 0, BLOCK_SECTOR_SIZE,
-                       false);
-          idx = sect->block_idxs[inner_idx];
-          free (sect);
+          /* The rest of the slot goes unused from now on. */
+          memset (&p, 0, sizeof p);
+          p.full_sector = inode->spill_sector;
+          p.magic = INODE_SPILL_MAGIC;
+          write_slot (inode->sector, &p);
+          inode->spill_linked = true;
         }
     }
-
-  return idx;
+  inode->data_dirty = false;
 }
 
-/* Reads the sector data for inode from disk and returns it.
- *
- * NOTE: user is responsible for freeing the returned bufer after using it.
- */
-static struct inode_disk *
-get_data_at (block_sector_t sector_idx)
+/* Makes sure INODE's resident inode can be written back with more
+   extents than a packed inode holds: always, unless INODE is packed,
+   in which case it gets a sector of its own to spill into. Returns
+   false if out of disk space. The caller must hold EOF_LOCK. */
+static bool
+make_spill_room (struct inode *inode)
 {
-  struct inode_disk *ret_disk_inode = calloc (1, sizeof (struct inode_disk)); 
-  cache_io_at (sector_idx, ret_disk_inode, true, 0, BLOCK_SECTOR_SIZE, false);
-  return ret_disk_inode;
+  if (!is_packed (inode->sector)
+      || inode->spill_sector != INODE_INVALID_SECTOR)
+    return true;
+  return free_map_allocate (1, home_sector (inode->sector),
+                            &inode->spill_sector);
 }
 
 /* Expand inode so it has enough sectors to hold a file of size NEW_SIZE.
+   SECTOR is where the inode itself lives, and INODE is the open inode it
+   belongs to, or a null pointer while creating it. Indexed layout inodes are
+   sparse, they get sectors as they are written, so only extent layout
+   ones allocate here. Inline layout inodes that outgrow the inode sector
+   move their data out first. The caller is about to write SIZE bytes at
+   OFS, so sectors within that range needn't be zeroed.
    Returns true on success and false on error. */
 static bool
-inode_expand (struct inode_disk *disk_inode, off_t new_size)
+inode_expand (struct inode_disk *disk_inode, block_sector_t sector,
+              struct inode *inode, off_t new_size, off_t ofs, off_t size)
 {
   if (new_size < 0) return false;
+  if (disk_inode->magic == INODE_INLINE_MAGIC)
+    {
+      if ((size_t) new_size <= inline_max (sector))
+        return true;
+      if (!inode_uninline (disk_inode, sector))
+        return false;
+    }
+  if (disk_inode->magic == INODE_EXTENT_MAGIC)
+    return inode_expand_extents (disk_inode, sector, inode, new_size, ofs,
+                                 size);
+  return true;
+}
+
+/* Switches inline layout DISK_INODE, which lives at SECTOR, to the layout
+   new inodes get, or to extents if it is packed, moving its data to a
+   data sector of its own. Returns false, leaving it inline, if out of
+   disk space. The caller must hold the inode's GROW_LOCK. */
+static bool
+inode_uninline (struct inode_disk *disk_inode, block_sector_t sector)
+{
+  block_sector_t first = INODE_INVALID_SECTOR;
+  bool extents = inode_use_extents || is_packed (sector);
+  bool blocks = !extents && inode_use_blocks;
+  size_t cnt = blocks ? INODE_BLOCK_SECTORS : 1;
 
-  int num_sectors_left = bytes_to_sectors (new_size);
+  ASSERT (disk_inode->magic == INODE_INLINE_MAGIC);
 
-  // Fill in direct blocks
-  int num_direct = (num_sectors_left < INODE_NUM_DIRECT) ?
-                    num_sectors_left : INODE_NUM_DIRECT;
-  for (int i = 0; i < num_direct; ++i)
+  if (disk_inode->length > 0)
     {
-      block_sector_t *cand =  &disk_inode->block_idxs[i];
-      if (*cand == INODE_INVALID_SECTOR)
+      bool meta = is_metadata (disk_inode, sector);
+      uint8_t *data;
+
+      if (!free_map_allocate (cnt, home_sector (sector), &first))
+        return false;
+      data = cache_get (first, sector, meta, true);
+      memcpy (data, disk_inode->inline_data, INODE_INLINE_MAX);
+      memset (data + INODE_INLINE_MAX, 0,
+              BLOCK_SECTOR_SIZE - INODE_INLINE_MAX);
+      cache_put (data, true);
+      for (size_t i = 1; i < cnt; i++)
+        cache_io_at (first + i, sector, ZEROARRAY, meta, 0,
+                     BLOCK_SECTOR_SIZE, true);
+    }
+
+  if (extents)
+    {
+      memset (disk_inode->extents, 0, sizeof disk_inode->extents);
+      disk_inode->extent_cnt = 0;
+      if (first != INODE_INVALID_SECTOR)
         {
-          if (!free_map_allocate (1, cand))
-            {
-              return false;
-            }
-          cache_io_at (*cand, ZEROARRAY, false, 0, BLOCK_SECTOR_SIZE, true);
-        }
-    }
-  num_sectors_left -= num_direct;
-  if (num_sectors_left == 0) return true;
-
-  // Fill in indirect blocks
-  int num_indirect = (num_sectors_left <  INODE_NUM_IN_IND_BLOCK) ?
-    num_sectors_left : INODE_NUM_IN_IND_BLOCK;
-  bool bRet = inode_expand_helper (&disk_inode->block_idxs[INODE_IND_IDX],
-                                   num_indirect, 1);
-  if (!bRet) return false;
-  num_sectors_left -= num_indirect;
-  if(num_sectors_left == 0) return true;
-
-  // Fill in doubly indirect blocks
-  off_t oRet = INODE_NUM_IN_IND_BLOCK * INODE_NUM_IN_IND_BLOCK;
-  num_indirect = (num_sectors_left <  oRet) ?  num_sectors_left : oRet;
-  bRet = inode_expand_helper (&disk_inode->block_idxs[INODE_DUB_IND_IDX], 
-                              num_indirect, 2);
-  if (!bRet) return false;
-  num_sectors_left -= num_indirect;
-  if(num_sectors_left == 0) return true;
-  return false;
+          disk_inode->extents[0].start = first;
+          disk_inode->extents[0].length = 1;
+          disk_inode->extent_cnt = 1;
+        }
+    }
+  else
+    {
+      memset (&disk_inode->block_idxs, INODE_INVALID_SECTOR,
+              INODE_NUM_BLOCKS * sizeof (block_sector_t));
+      disk_inode->block_idxs[0] = first;
+    }
+  /* Lookups check the layout without locks, so switch it last. */
+  barrier ();
+  disk_inode->magic = (extents ? INODE_EXTENT_MAGIC
+                       : blocks ? INODE_BLOCK_MAGIC : INODE_MAGIC);
+  return true;
 }
 
+/* Reads or writes the SIZE bytes at OFFSET of INODE, which the caller
+   has made sure are within its length, between BUFFER and the resident
+   inode if INODE keeps its data inline. Returns false, doing nothing,
+   if it doesn't. */
 static bool
-inode_expand_helper (block_sector_t *idx, off_t num_sectors_left, int level)
+inline_io (struct inode *inode, void *buffer, off_t size, off_t offset,
+           bool is_write)
 {
-  if (level == 0) {
-    if (*idx == 0)
-      {
-        if (!free_map_allocate (1, idx)) 
-          {
-            return false;
-          }
-        cache_io_at (*idx, ZEROARRAY, false, 0, BLOCK_SECTOR_SIZE, true);
-      }
-    return true;
-  }
+  lock_acquire (&inode->grow_lock);
+  if (inode->data.magic != INODE_INLINE_MAGIC)
+    {
+      lock_release (&inode->grow_lock);
+      return false;
+    }
+  ASSERT ((size_t) (offset + size) <= inline_max (inode->sector));
+  if (is_write)
+    {
+      memcpy (inode->data.inline_data + offset, buffer, size);
+      inode_write_back (inode);
+    }
+  else
+    memcpy (buffer, inode->data.inline_data + offset, size);
+  lock_release (&inode->grow_lock);
+  return true;
+}
 
-  struct inode_indirect_sector indirect_block;
-  if(*idx == INODE_INVALID_SECTOR || *idx == 0) 
-  {
-    if (!free_map_allocate (1, idx)) 
-      {
+/* Allocates a run of at most CNT sectors for INODE out of its
+   preallocation window, storing the first into *STARTP. If the window
+   holds fewer than CNT sectors, first trades it for a new one reserved
+   near NEAR. Files reserve at least INODE_PREALLOC sectors at a time, so
+   that the sectors of a file written in many small appends end up in
+   one run. Returns the number of sectors allocated, 0 if out of disk
+   space. The caller must hold INODE's GROW_LOCK. */
+static size_t
+take_prealloc (struct inode *inode, size_t cnt, block_sector_t near,
+               block_sector_t *startp)
+{
+  if (inode->prealloc_cnt < cnt)
+    {
+      size_t want = cnt;
+
+      if (!inode->is_dir && want < INODE_PREALLOC)
+        want = INODE_PREALLOC;
+      release_prealloc (inode);
+      inode->prealloc_cnt = free_map_allocate_run (want, near,
+                                                   &inode->prealloc_start);
+      if (inode->prealloc_cnt == 0)
+        return 0;
+    }
+  if (cnt > inode->prealloc_cnt)
+    cnt = inode->prealloc_cnt;
+  *startp = inode->prealloc_start;
+  inode->prealloc_start += cnt;
+  inode->prealloc_cnt -= cnt;
+  return cnt;
+}
+
+/* Gives the sectors left in INODE's preallocation window back to the
+   free map. The caller must hold INODE's GROW_LOCK, or be the only user
+   of INODE. */
+static void
+release_prealloc (struct inode *inode)
+{
+  if (inode->prealloc_cnt > 0)
+    free_map_release (inode->prealloc_start, inode->prealloc_cnt);
+  inode->prealloc_cnt = 0;
+}
+
+/* Allocates CNT contiguous sectors for INODE near its ALLOC_HINT,
+   storing the first in *SECTORP, and moves the hint past them. Returns
+   false if out of disk space. The caller must hold INODE's GROW_LOCK. */
+static bool
+allocate_near (struct inode *inode, size_t cnt, block_sector_t *sectorp)
+{
+  size_t got = take_prealloc (inode, cnt, inode->alloc_hint, sectorp);
+
+  if (got < cnt)
+    {
+      /* The window came up short of a whole block. */
+      if (got > 0)
+        free_map_release (*sectorp, got);
+      if (!free_map_allocate (cnt, inode->alloc_hint, sectorp))
         return false;
-      }
-    cache_io_at (*idx, ZEROARRAY, true, 0, BLOCK_SECTOR_SIZE, true);
-  } 
-  cache_io_at (*idx, &indirect_block, true, 0, BLOCK_SECTOR_SIZE, false);
+    }
+  inode->alloc_hint = *sectorp + cnt;
+  return true;
+}
+
+/* Allocates a run of CNT sectors for INODE, storing the first in
+   *SECTORP, and initializes sector INIT_OFS of them with the
+   BLOCK_SECTOR_SIZE bytes at INIT and the rest with zeros. Returns
+   false if out of disk space. The caller must hold INODE's GROW_LOCK. */
+static bool
+new_pointer (struct inode *inode, size_t cnt, size_t init_ofs,
+             const void *init, bool is_metadata, block_sector_t *sectorp)
+{
+  if (!allocate_near (inode, cnt, sectorp))
+    return false;
+  for (size_t i = 0; i < cnt; i++)
+    cache_io_at (*sectorp + i, inode->sector,
+                 (void *) (i == init_ofs ? init : ZEROARRAY), is_metadata,
+                 0, BLOCK_SECTOR_SIZE, true);
+  return true;
+}
+
+/* Returns the sector that entry IDX of indirect block BLOCK of INODE
+   points to. If it is a hole, first allocates a run of CNT sectors,
+   initializes them as new_pointer() does and only then stores it in
+   the entry, so readers never see it uninitialized. Sets *FILLED to
+   whether it did. Returns INODE_INVALID_SECTOR if out of disk space. */
+static block_sector_t
+fill_pointer (struct inode *inode, block_sector_t block, off_t idx,
+              size_t cnt, size_t init_ofs, const void *init,
+              bool is_metadata, bool *filled)
+{
+  block_sector_t owner = inode->sector;
+  struct inode_indirect_sector *indirect_block;
+  block_sector_t entry;
+
+  *filled = false;
+  indirect_block = cache_get (block, owner, true, false);
+  entry = indirect_block->block_idxs[idx];
+  cache_put (indirect_block, false);
+  if (is_allocated (entry))
+    return entry;
+  if (!new_pointer (inode, cnt, init_ofs, init, is_metadata, &entry))
+    return INODE_INVALID_SECTOR;
+  indirect_block = cache_get (block, owner, true, true);
+  indirect_block->block_idxs[idx] = entry;
+  cache_put (indirect_block, true);
+  *filled = true;
+  return entry;
+}
+
+/* Like fill_pointer, for entry IDX of INODE's own block pointers. */
+static block_sector_t
+fill_inode_pointer (struct inode *inode, int idx, size_t cnt,
+                    size_t init_ofs, const void *init, bool is_metadata,
+                    bool *filled)
+{
+  block_sector_t entry = inode->data.block_idxs[idx];
+
+  *filled = false;
+  if (is_allocated (entry))
+    return entry;
+  if (!new_pointer (inode, cnt, init_ofs, init, is_metadata, &entry))
+    return INODE_INVALID_SECTOR;
+  inode->data.block_idxs[idx] = entry;
+  inode_write_back (inode);
+  *filled = true;
+  return entry;
+}
+
+/* Allocates a sector for the hole at data sector index ABS_IDX of indexed
+   or block layout INODE, along with the rest of its block and any
+   indirect blocks missing on the way to it. The sector starts out as the
+   BLOCK_SECTOR_SIZE bytes at INIT, the rest of its block as zeros. Sets
+   *FILLED to false if a concurrent writer filled the hole first. Returns
+   the sector, or INODE_INVALID_SECTOR on failure. */
+static block_sector_t
+inode_fill_hole (struct inode *inode, off_t abs_idx, const void *init,
+                 bool *filled)
+{
+  block_sector_t block = INODE_INVALID_SECTOR;
+  bool meta = is_metadata (&inode->data, inode->sector);
+  size_t cnt = block_sectors (&inode->data);
+  off_t ptr_idx = abs_idx / cnt;
+  size_t ofs = abs_idx % cnt;
+  block_sector_t prev;
+  bool ignored;
+
+  *filled = false;
+  if (inode->data.magic != INODE_MAGIC
+      && inode->data.magic != INODE_BLOCK_MAGIC)
+    return INODE_INVALID_SECTOR;
 
-  off_t base = (level == 1 ? 1 : INODE_NUM_IN_IND_BLOCK);
-  off_t n = DIV_ROUND_UP (num_sectors_left, base);
-  for (off_t i = 0; i < n; ++i) 
+  lock_acquire (&inode->grow_lock);
+  /* Place the block right after the one before it in the file, if
+     that one is there, otherwise after the last one allocated. */
+  prev = (ptr_idx > 0 ? get_index (inode, ptr_idx * cnt - 1)
+          : INODE_INVALID_SECTOR);
+  if (is_allocated (prev))
+    inode->alloc_hint = prev + 1;
+  if (ptr_idx < INODE_NUM_DIRECT)
+    block = fill_inode_pointer (inode, ptr_idx, cnt, ofs, init, meta,
+                                filled);
+  else if (ptr_idx < INODE_NUM_DIRECT + INODE_NUM_IN_IND_BLOCK)
+    {
+      block = fill_inode_pointer (inode, INODE_IND_IDX, 1, 0, ZEROARRAY,
+                                  true, &ignored);
+      if (block != INODE_INVALID_SECTOR)
+        block = fill_pointer (inode, block, ptr_idx - INODE_NUM_DIRECT,
+                              cnt, ofs, init, meta, filled);
+    }
+  else if (ptr_idx < (INODE_NUM_DIRECT + INODE_NUM_IN_IND_BLOCK) +
+           INODE_NUM_IN_IND_BLOCK * INODE_NUM_IN_IND_BLOCK)
     {
-      off_t num_in_level = (num_sectors_left <  base) ? num_sectors_left : base;
-      bool bRet = inode_expand_helper (&indirect_block.block_idxs[i], 
-                                       num_in_level, level - 1);
-      if (!bRet) return false;
-      num_sectors_left -= num_in_level;
+      off_t start = ptr_idx - (INODE_NUM_DIRECT + INODE_NUM_IN_IND_BLOCK);
+      block = fill_inode_pointer (inode, INODE_DUB_IND_IDX, 1, 0, ZEROARRAY,
+                                  true, &ignored);
+      if (block != INODE_INVALID_SECTOR)
+        block = fill_pointer (inode, block, start / INODE_NUM_IN_IND_BLOCK,
+                              1, 0, ZEROARRAY, true, &ignored);
+      if (block != INODE_INVALID_SECTOR)
+        block = fill_pointer (inode, block, start % INODE_NUM_IN_IND_BLOCK,
+                              cnt, ofs, init, meta, filled);
     }
+  lock_release (&inode->grow_lock);
+  if (block == INODE_INVALID_SECTOR)
+    return block;
+  return block + ofs;
+}
+
+/* Expand extent layout DISK_INODE, which lives at SECTOR, so it has enough
+   sectors to hold a file of size NEW_SIZE. Grows the last extent in place
+   when the sectors after it are free, otherwise adds the longest run the
+   free map has near it as a new extent. The sectors come out of the
+   preallocation window of INODE unless it is a null pointer. Sectors
+   entirely within the SIZE bytes at OFS are left for the caller to fill.
+   Returns true on success and false on error. */
+static bool
+inode_expand_extents (struct inode_disk *disk_inode, block_sector_t sector,
+                      struct inode *inode, off_t new_size, off_t ofs,
+                      off_t size)
+{
+  size_t have = 0;
+  size_t need = bytes_to_sectors (new_size);
+
+  for (uint32_t i = 0; i < disk_inode->extent_cnt; ++i)
+    have += disk_inode->extents[i].length;
+
+  while (have < need)
+    {
+      struct inode_extent *last = NULL;
+      block_sector_t near = home_sector (sector) + 1;
+      block_sector_t start;
+      size_t cnt;
 
-  cache_io_at (*idx, &indirect_block, true, 0, BLOCK_SECTOR_SIZE, true);
+      if (disk_inode->extent_cnt > 0)
+        {
+          last = &disk_inode->extents[disk_inode->extent_cnt - 1];
+          near = last->start + last->length;
+        }
+      if (inode != NULL)
+        cnt = take_prealloc (inode, need - have, near, &start);
+      else
+        cnt = free_map_allocate_run (need - have, near, &start);
+      if (cnt == 0)
+        return false;
+
+      if (last != NULL && start == near)
+        last->length += cnt;
+      else if (disk_inode->extent_cnt < INODE_NUM_EXTENTS
+               && (disk_inode->extent_cnt < INODE_PACKED_EXTENTS
+                   || inode == NULL || make_spill_room (inode)))
+        {
+          struct inode_extent *e = &disk_inode->extents[disk_inode->extent_cnt++];
+          e->start = start;
+          e->length = cnt;
+        }
+      else
+        {
+          /* Out of extents, the file is too fragmented to grow. */
+          free_map_release (start, cnt);
+          return false;
+        }
+
+      /* Zero the new sectors, except those about to be overwritten. */
+      for (size_t i = 0; i < cnt; ++i)
+        {
+          off_t sector_ofs = (off_t) (have + i) * BLOCK_SECTOR_SIZE;
+          if (sector_ofs < ofs
+              || sector_ofs + BLOCK_SECTOR_SIZE > ofs + size)
+            cache_io_at (start + i, sector, ZEROARRAY,
+                         is_metadata (disk_inode, sector), 0,
+                         BLOCK_SECTOR_SIZE, true);
+        }
+      have += cnt;
+    }
   return true;
 }
@@ -8,20 +8,57 @@
 
 #define INODE_INVALID_SECTOR (block_sector_t) -1
 struct bitmap;
+struct inode;
+
+extern bool inode_use_extents;
+extern bool inode_use_blocks;
+extern bool inode_use_packed;
+extern bool inode_use_compress;
+
+/* Read-ahead state of one stream of reads through an inode, such as
+   an open file. */
+struct inode_ra
+  {
+    off_t next_ofs;             /* Offset a sequential read hits. */
+    off_t ahead_ofs;            /* End of read-ahead issued so far. */
+    size_t window;              /* Read-ahead window in sectors. */
+  };
+
+void inode_ra_init (struct inode_ra *);
 
 void inode_init (void);
 bool inode_create (block_sector_t, off_t, bool isdir);
+bool inode_create_contiguous (block_sector_t, off_t, block_sector_t start);
+bool inode_alloc_inumber (struct inode *parent, bool isdir,
+                          block_sector_t *inumberp);
+void inode_free_inumber (block_sector_t);
+bool inode_prefetch (block_sector_t);
 struct inode *inode_open (block_sector_t);
 struct inode *inode_reopen (struct inode *);
 int inode_open_count (struct inode *);
 block_sector_t inode_get_inumber (const struct inode *);
-struct lock *inode_dir_lock (struct inode *inode);
+unsigned inode_version (const struct inode *);
+struct rwlock *inode_dir_lock (struct inode *inode);
+off_t *inode_dir_free_ofs (struct inode *inode);
 void inode_close (struct inode *);
 void inode_remove (struct inode *);
 off_t inode_read_at (struct inode *, void *, off_t size, off_t offset);
+off_t inode_read_at_ra (struct inode *, void *, off_t size, off_t offset,
+                        struct inode_ra *);
+off_t inode_read_uncached_at (struct inode *, void *, off_t size,
+                              off_t offset);
 off_t inode_write_at (struct inode *, const void *, off_t size, off_t offset);
+bool inode_reserve (struct inode *, off_t length);
+bool inode_truncate (struct inode *, off_t length);
+bool inode_allocate (struct inode *, off_t offset, off_t length);
+bool inode_defrag (struct inode *);
+bool inode_clone (struct inode *, block_sector_t inumber);
+off_t inode_write_changed_at (struct inode *, const void *, off_t size,
+                              off_t offset);
 void inode_deny_write (struct inode *);
 void inode_allow_write (struct inode *);
+void inode_sync (struct inode *);
+void inode_write_through (struct inode *);
 off_t inode_length (struct inode *);
 bool inode_isdir (const struct inode *);
 
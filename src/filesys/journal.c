@@ -0,0 +1,324 @@
+#include "filesys/journal.h"
+#include <debug.h>
+#include <hash.h>
+#include <inttypes.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/cache.h"
+#include "filesys/filesys.h"
+#include "filesys/free-map.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* Write-ahead journal of metadata sectors.
+
+   A commit logs a snapshot of every dirty metadata sector in the buffer
+   cache as one transaction, so replaying the newest committed
+   transaction after a crash brings all of the metadata on disk to its
+   state at that commit.  Metadata sectors are only written in place,
+   by the cache, once their contents are committed.  Transactions
+   alternate between two slots of the journal region, so the previous
+   one survives a crash while the next is being written, and a slot is
+   free for reuse as soon as the transaction after it commits.
+
+   Operations that change metadata run as handles between
+   journal_begin() and journal_end().  A commit holds new handles off
+   only while it takes its snapshot, so no operation is ever half in a
+   transaction, and one log write commits everything done by every
+   thread up to then. */
+
+/* Identifies the journal superblock and transaction headers. */
+#define JOURNAL_MAGIC 0x4c4e524a
+#define JOURNAL_TXN_MAGIC 0x4e58544a
+
+/* Sector numbers listed per sector of a transaction. */
+#define LIST_ENTRIES (BLOCK_SECTOR_SIZE / sizeof (block_sector_t))
+
+/* The journal takes at most this share of the disk. */
+#define JOURNAL_MAX_SHARE 8
+
+/* On-disk journal superblock, at JOURNAL_SECTOR.
+   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+struct journal_super
+  {
+    uint32_t magic;             /* JOURNAL_MAGIC if there is a journal. */
+    block_sector_t start;       /* First sector of the two slots. */
+    uint32_t capacity;          /* Most sectors in one transaction. */
+    uint32_t unused[125];       /* Not used. */
+  };
+
+/* On-disk header of a transaction, the first sector of its slot. The
+   sector lists and images follow it, and it is written only after
+   them, so a crash midway leaves a header whose checksum fails.
+   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+struct journal_header
+  {
+    uint32_t magic;             /* JOURNAL_TXN_MAGIC. */
+    uint32_t seq;               /* Sequence number, the newest wins. */
+    uint32_t cnt;               /* Number of sectors logged. */
+    unsigned checksum;          /* Of the sector lists and images. */
+    uint32_t unused[124];       /* Not used. */
+  };
+
+static bool journal_on;         /* Whether metadata is journaled. */
+static block_sector_t slot_start[2]; /* First sector of each slot. */
+static size_t capacity;         /* Most sectors in one transaction. */
+static size_t list_sectors;     /* Sectors listing a transaction's. */
+
+/* Held shared by handles and exclusive by a commit taking its
+   snapshot. */
+static struct rwlock handles;
+
+/* Serializes commits, and guards LOG_BUFFER and COMMITTED_SEQ. */
+static struct lock commit_lock;
+static uint8_t *log_buffer;     /* A slot's worth of memory. */
+static uint32_t committed_seq;  /* Newest transaction on disk. */
+static uint32_t snapped_seq;    /* Newest transaction snapshotted. */
+
+static size_t slot_size (size_t cap);
+static bool read_transaction (int slot);
+static void replay (void);
+static void commit (void);
+
+/* Returns the number of sectors in a slot for transactions of CAP
+   sectors. */
+static size_t
+slot_size (size_t cap)
+{
+  return 1 + DIV_ROUND_UP (cap, LIST_ENTRIES) + cap;
+}
+
+/* Creates an empty journal while formatting, big enough to log every
+   sector the buffer cache holds at once, unless that would take too
+   much of the disk. */
+void
+journal_create (void)
+{
+  struct journal_super *super;
+  size_t cap = cache_num_sectors;
+  size_t size = slot_size (cap);
+  block_sector_t start;
+
+  ASSERT (sizeof *super == BLOCK_SECTOR_SIZE);
+  super = calloc (1, sizeof *super);
+  if (super == NULL)
+    PANIC ("journal creation failed");
+  if (2 * size <= block_size (fs_device) / JOURNAL_MAX_SHARE
+      && free_map_allocate (2 * size, 0, &start))
+    {
+      /* Blank out both slot headers, so nothing a previous file system
+         left there is ever replayed. */
+      block_write (fs_device, start, super);
+      block_write (fs_device, start + size, super);
+      super->magic = JOURNAL_MAGIC;
+      super->start = start;
+      super->capacity = cap;
+    }
+  block_write (fs_device, JOURNAL_SECTOR, super);
+  free (super);
+}
+
+/* Opens the journal, if the file system has one, and replays the newest
+   committed transaction in it. Must be called before anything reads
+   metadata through the buffer cache. */
+void
+journal_open (void)
+{
+  struct journal_super *super;
+  size_t size;
+
+  rwlock_init (&handles);
+  lock_init (&commit_lock);
+
+  super = malloc (sizeof *super);
+  if (super == NULL)
+    PANIC ("can't open journal");
+  block_read (fs_device, JOURNAL_SECTOR, super);
+  if (super->magic != JOURNAL_MAGIC)
+    {
+      free (super);
+      return;
+    }
+  capacity = super->capacity;
+  list_sectors = DIV_ROUND_UP (capacity, LIST_ENTRIES);
+  size = slot_size (capacity);
+  slot_start[0] = super->start;
+  slot_start[1] = super->start + size;
+  free (super);
+
+  log_buffer = palloc_get_multiple (0, DIV_ROUND_UP (size * BLOCK_SECTOR_SIZE,
+                                                     PGSIZE));
+  if (log_buffer == NULL)
+    PANIC ("can't open journal");
+  replay ();
+
+  /* A commit must fit all the dirty sectors the cache can hold. */
+  if (cache_num_sectors > capacity)
+    {
+      printf ("journal: cache larger than %zu sectors, not journaling\n",
+              capacity);
+      return;
+    }
+  cache_journal_start (committed_seq);
+  journal_on = true;
+}
+
+/* Returns true if metadata is being journaled. */
+bool
+journal_active (void)
+{
+  return journal_on;
+}
+
+/* Reads the transaction in SLOT into LOG_BUFFER. Returns true if it is a
+   whole committed transaction. */
+static bool
+read_transaction (int slot)
+{
+  struct journal_header *h = (struct journal_header *) log_buffer;
+  struct block_request r;
+
+  block_read (fs_device, slot_start[slot], h);
+  if (h->magic != JOURNAL_TXN_MAGIC || h->cnt == 0 || h->cnt > capacity)
+    return false;
+  block_request_init (&r, slot_start[slot] + 1, list_sectors + h->cnt,
+                      log_buffer + BLOCK_SECTOR_SIZE, false, NULL, NULL);
+  block_submit (fs_device, &r);
+  block_wait (&r);
+  return h->checksum == hash_bytes (log_buffer + BLOCK_SECTOR_SIZE,
+                                    (list_sectors + h->cnt)
+                                    * BLOCK_SECTOR_SIZE);
+}
+
+/* Writes the newest committed transaction in the journal in place. */
+static void
+replay (void)
+{
+  struct journal_header *h = (struct journal_header *) log_buffer;
+  const block_sector_t *sectors;
+  const uint8_t *images;
+  uint32_t seq[2];
+  int newest;
+
+  for (int slot = 0; slot < 2; slot++)
+    seq[slot] = read_transaction (slot) ? h->seq : 0;
+  newest = seq[1] > seq[0];
+  if (seq[newest] == 0 || !read_transaction (newest))
+    return;
+
+  sectors = (const block_sector_t *) (log_buffer + BLOCK_SECTOR_SIZE);
+  images = log_buffer + (1 + list_sectors) * BLOCK_SECTOR_SIZE;
+  for (size_t i = 0; i < h->cnt; i++)
+    if (sectors[i] < block_size (fs_device))
+      block_write (fs_device, sectors[i], images + i * BLOCK_SECTOR_SIZE);
+  printf ("journal: replayed %"PRIu32" sectors of transaction %"PRIu32"\n",
+          h->cnt, h->seq);
+  committed_seq = snapped_seq = h->seq;
+}
+
+/* Starts a handle for an operation the current thread is about to do.
+   Handles nest, only the outermost one counts. The outermost one must be
+   started with no file system locks held, since it waits for a commit
+   in progress. */
+void
+journal_begin (void)
+{
+  struct thread *t = thread_current ();
+
+  if (t->journal_depth++ == 0 && journal_on)
+    rwlock_acquire_read (&handles);
+}
+
+/* Ends the current thread's handle started by journal_begin(). */
+void
+journal_end (void)
+{
+  struct thread *t = thread_current ();
+
+  ASSERT (t->journal_depth > 0);
+  if (--t->journal_depth == 0 && journal_on)
+    rwlock_release_read (&handles);
+}
+
+/* Commits every operation whose handle has ended by now and waits for
+   the commit to reach the disk. Threads calling this together share a
+   single commit. Without a journal, writes the free map back to the
+   cache instead, so allocations reach the disk no later than what
+   uses them. Must be called outside of any handle. */
+void
+journal_commit (void)
+{
+  uint32_t target;
+
+  ASSERT (thread_current ()->journal_depth == 0);
+  if (!journal_on)
+    {
+      free_map_flush ();
+      return;
+    }
+
+  /* A snapshot taken from here on includes all our operations. The read
+     needs no lock, since SNAPPED_SEQ only changes while no handles are
+     running. */
+  target = snapped_seq + 1;
+  lock_acquire (&commit_lock);
+  if (committed_seq < target)
+    commit ();
+  lock_release (&commit_lock);
+}
+
+/* Snapshots the dirty metadata and writes it to the journal as a new
+   transaction. The caller must hold COMMIT_LOCK. */
+static void
+commit (void)
+{
+  struct journal_header *h = (struct journal_header *) log_buffer;
+  block_sector_t *sectors = (block_sector_t *) (log_buffer
+                                                + BLOCK_SECTOR_SIZE);
+  uint8_t *images = log_buffer + (1 + list_sectors) * BLOCK_SECTOR_SIZE;
+  uint32_t seq = committed_seq + 1;
+  struct thread *t = thread_current ();
+  struct block_request r;
+  size_t cnt;
+
+  ASSERT (lock_held_by_current_thread (&commit_lock));
+
+  /* Bring the free map up to date as part of the snapshot, running
+     inside our own exclusive hold of the handles. */
+  rwlock_acquire_write (&handles);
+  t->journal_depth++;
+  free_map_flush ();
+  memset (sectors, 0, list_sectors * BLOCK_SECTOR_SIZE);
+  cnt = cache_journal_snapshot (seq, sectors, images, capacity);
+  t->journal_depth--;
+  if (cnt > 0)
+    snapped_seq = seq;
+  rwlock_release_write (&handles);
+  /* Nothing to do. Don't use up a sequence number, since the slot it
+     would take holds the newest transaction. */
+  if (cnt == 0)
+    return;
+
+  block_request_init (&r, slot_start[seq % 2] + 1, list_sectors + cnt,
+                      sectors, true, NULL, NULL);
+  block_submit (fs_device, &r);
+  block_wait (&r);
+
+  memset (h, 0, sizeof *h);
+  h->magic = JOURNAL_TXN_MAGIC;
+  h->seq = seq;
+  h->cnt = cnt;
+  h->checksum = hash_bytes (sectors, (list_sectors + cnt)
+                                     * BLOCK_SECTOR_SIZE);
+  block_request_init (&r, slot_start[seq % 2], 1, h, true, NULL, NULL);
+  block_submit (fs_device, &r);
+  block_wait (&r);
+
+  committed_seq = seq;
+  cache_journal_committed (seq);
+}
@@ -0,0 +1,16 @@
+#ifndef FILESYS_JOURNAL_H
+#define FILESYS_JOURNAL_H
+
+#include <stdbool.h>
+
+void journal_create (void);
+void journal_open (void);
+bool journal_active (void);
+
+/* Handles, bracketing an operation that changes metadata. */
+void journal_begin (void);
+void journal_end (void);
+
+void journal_commit (void);
+
+#endif /* filesys/journal.h */
@@ -0,0 +1,477 @@
+#include "filesys/tmpfs.h"
+#include <debug.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/directory.h"
+#include "filesys/filesys.h"
+#include "filesys/inode.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+#include "vm/frame.h"
+#include "vm/share.h"
+
+/* A file system in memory, for scratch files that needn't outlive the
+   boot, mounted over a directory of the disk file system.
+
+   Its files and directories are inodes like any other, except that
+   their inumbers say they are tmpfs nodes, which inode.c hands the
+   data to instead of the buffer cache.  The data of each is a shared
+   memory segment the kernel reads and writes through
+   share_shm_get(), so its pages live in frames until the clock evicts
+   them to swap, and nothing of it ever goes to the file system disk.
+   A file has no segment while empty, and its pages are only filled
+   when first used.
+
+   The directory it is mounted on keeps its entry in its parent, and
+   dir_lookup() turns the inumber there into the tmpfs root's through
+   tmpfs_resolve(), so paths lead into the tmpfs without the directory
+   code knowing.  The root's ".." leads back out. */
+
+/* Most files and directories at once, and share of the frames their
+   pages may take at most, as a fraction. */
+#define TMPFS_NODES 1024
+#define TMPFS_PAGE_SHARE 2
+
+/* A file or directory. */
+struct tmpfs_node
+  {
+    struct lock lock;           /* Guards the members below. */
+    struct condition idle;      /* Signaled when USERS drops to 0. */
+    bool in_use;                /* Allocated? */
+    bool is_dir;                /* Directory or file? */
+    off_t length;               /* File size in bytes. */
+    struct shm *shm;            /* Data pages, or null if none yet. */
+    unsigned users;             /* Reads and writes copying data. */
+    unsigned write_gen;         /* Incremented by each write. */
+  };
+
+/* Nodes, indexed by inumber less TMPFS_INUMBER_BIT, null until
+   mounted. */
+static struct tmpfs_node *nodes;
+
+/* Guards the IN_USE of nodes, NEXT_NODE and PAGE_CNT. */
+static struct lock tmpfs_lock;
+static size_t next_node;        /* Where to look for a free node. */
+static size_t page_cnt;         /* Pages of all segments. */
+static size_t page_max;         /* Most pages of all segments. */
+
+/* Inumber of the directory the tmpfs is mounted on, or
+   INODE_INVALID_SECTOR if none is. */
+static block_sector_t mount_inumber = INODE_INVALID_SECTOR;
+
+/* Returns the node numbered INUMBER. */
+static struct tmpfs_node *
+get_node (block_sector_t inumber)
+{
+  size_t idx = inumber & ~TMPFS_INUMBER_MASK;
+
+  ASSERT (tmpfs_owns (inumber) && idx < TMPFS_NODES);
+  ASSERT (nodes != NULL && nodes[idx].in_use);
+  return &nodes[idx];
+}
+
+/* Mounts a new, empty tmpfs over the directory at PATH, an absolute
+   path, making the directory first if it doesn't exist.  Whatever the
+   directory holds is hidden until the next boot.  Returns true if
+   successful, false if PATH can't be a directory or memory runs
+   short. */
+bool
+tmpfs_mount (const char *path)
+{
+  struct dir *dir = NULL, *root = NULL;
+  struct inode *parent = NULL;
+  bool isdir = false, success = false;
+  size_t i;
+
+  ASSERT (nodes == NULL);
+
+  if (path[0] != '/' || path[strspn (path, "/")] == '\0')
+    goto done;
+  nodes = calloc (TMPFS_NODES, sizeof *nodes);
+  if (nodes == NULL)
+    goto done;
+  for (i = 0; i < TMPFS_NODES; i++)
+    {
+      lock_init (&nodes[i].lock);
+      cond_init (&nodes[i].idle);
+    }
+  lock_init (&tmpfs_lock);
+  next_node = 1;
+  page_max = frame_count () / TMPFS_PAGE_SHARE;
+
+  /* Find the directory and its parent, for "..". */
+  filesys_mkdir (path);
+  dir = filesys_open (path, &isdir);
+  if (dir == NULL || !isdir || !dir_lookup (dir, "..", &parent))
+    goto done;
+
+  /* Make the root. */
+  nodes[0].in_use = true;
+  if (!dir_create (TMPFS_ROOT_INUMBER, false))
+    goto done;
+  root = dir_open (inode_open (TMPFS_ROOT_INUMBER));
+  if (root == NULL
+      || !dir_add (root, "..", inode_get_inumber (parent))
+      || !dir_add (root, ".", TMPFS_ROOT_INUMBER))
+    goto done;
+
+  mount_inumber = inode_get_inumber (dir_get_inode (dir));
+  printf ("tmpfs: mounted on %s, up to %zu pages.\n", path, page_max);
+  success = true;
+
+ done:
+  if (!success)
+    printf ("tmpfs: can't mount on %s\n", path);
+  dir_close (root);
+  inode_close (parent);
+  if (isdir)
+    dir_close (dir);
+  else if (dir != NULL)
+    file_close ((struct file *) dir);
+  return success;
+}
+
+/* Returns the inumber INUMBER, found in a directory entry, leads to:
+   the tmpfs root's if it is of the directory the tmpfs is mounted on,
+   otherwise INUMBER itself. */
+block_sector_t
+tmpfs_resolve (block_sector_t inumber)
+{
+  return inumber == mount_inumber ? TMPFS_ROOT_INUMBER : inumber;
+}
+
+/* Allocates a node for a new file or directory and stores its inumber
+   into *INUMBERP for tmpfs_create().  Returns false if none is
+   free. */
+bool
+tmpfs_alloc_inumber (block_sector_t *inumberp)
+{
+  size_t i;
+
+  lock_acquire (&tmpfs_lock);
+  for (i = 0; i < TMPFS_NODES; i++)
+    {
+      size_t idx = (next_node + i) % TMPFS_NODES;
+      struct tmpfs_node *node = &nodes[idx];
+
+      if (!node->in_use)
+        {
+          node->in_use = true;
+          node->is_dir = false;
+          node->length = 0;
+          node->shm = NULL;
+          node->users = 0;
+          next_node = idx + 1;
+          *inumberp = TMPFS_INUMBER_BIT | idx;
+          break;
+        }
+    }
+  lock_release (&tmpfs_lock);
+  return i < TMPFS_NODES;
+}
+
+/* Takes up to CNT pages from those left to the tmpfs, returning how
+   many it did. */
+static size_t
+take_pages (size_t cnt)
+{
+  lock_acquire (&tmpfs_lock);
+  if (cnt > page_max - page_cnt)
+    cnt = page_max - page_cnt;
+  page_cnt += cnt;
+  lock_release (&tmpfs_lock);
+  return cnt;
+}
+
+/* Gives CNT pages back to the tmpfs. */
+static void
+give_pages (size_t cnt)
+{
+  lock_acquire (&tmpfs_lock);
+  ASSERT (page_cnt >= cnt);
+  page_cnt -= cnt;
+  lock_release (&tmpfs_lock);
+}
+
+/* Returns the number of pages NODE's segment has. */
+static size_t
+node_pages (const struct tmpfs_node *node)
+{
+  return node->shm != NULL ? share_shm_page_cnt (node->shm) : 0;
+}
+
+/* Waits until nobody copies data to or from NODE, whose lock the
+   caller holds, so that its segment can change.  A read or write
+   never waits for that itself once it is copying, however: paging a
+   frame in for it may write a page of a mapping of NODE back first,
+   in the same thread. */
+static void
+wait_idle (struct tmpfs_node *node)
+{
+  while (node->users > 0)
+    cond_wait (&node->idle, &node->lock);
+}
+
+/* Starts copying data to or from NODE, whose lock the caller holds,
+   and releases the lock, keeping its segment as it is meanwhile. */
+static void
+begin_use (struct tmpfs_node *node)
+{
+  node->users++;
+  lock_release (&node->lock);
+}
+
+/* Finishes what begin_use() started, acquiring NODE's lock again. */
+static void
+end_use (struct tmpfs_node *node)
+{
+  lock_acquire (&node->lock);
+  if (--node->users == 0)
+    cond_broadcast (&node->idle, &node->lock);
+}
+
+/* Makes the segment of idle NODE CNT pages long, without counting
+   them.  Returns false if memory runs short. */
+static bool
+set_pages (struct tmpfs_node *node, size_t cnt)
+{
+  if (cnt == 0)
+    {
+      if (node->shm != NULL)
+        share_shm_close (node->shm);
+      node->shm = NULL;
+      return true;
+    }
+  if (node->shm == NULL)
+    return (node->shm = share_shm_create (cnt)) != NULL;
+  return share_shm_resize (node->shm, cnt);
+}
+
+/* Gives NODE, whose lock the caller holds, pages for at least the
+   bytes before END, or as many of them as the tmpfs has left, and
+   returns where its pages end then, or END if that is sooner. */
+static off_t
+grow (struct tmpfs_node *node, off_t end)
+{
+  size_t want = DIV_ROUND_UP (end, PGSIZE);
+
+  if (want > node_pages (node))
+    {
+      size_t old, cnt;
+
+      wait_idle (node);
+      old = node_pages (node);
+      cnt = want > old ? take_pages (want - old) : 0;
+      if (cnt > 0 && !set_pages (node, old + cnt))
+        give_pages (cnt);
+    }
+  if ((off_t) node_pages (node) * PGSIZE < end)
+    end = node_pages (node) * PGSIZE;
+  return end;
+}
+
+/* Gives back the pages of NODE, whose lock the caller holds, wholly
+   past its length. */
+static void
+trim (struct tmpfs_node *node)
+{
+  size_t keep = DIV_ROUND_UP (node->length, PGSIZE);
+  size_t old;
+
+  wait_idle (node);
+  old = node_pages (node);
+  if (keep < old && set_pages (node, keep))
+    give_pages (old - keep);
+}
+
+/* Frees node INUMBER and its pages. */
+void
+tmpfs_free_inumber (block_sector_t inumber)
+{
+  struct tmpfs_node *node = get_node (inumber);
+
+  lock_acquire (&node->lock);
+  node->length = 0;
+  trim (node);
+  lock_release (&node->lock);
+
+  lock_acquire (&tmpfs_lock);
+  node->in_use = false;
+  lock_release (&tmpfs_lock);
+}
+
+/* Makes node INUMBER, which tmpfs_alloc_inumber() returned, a file of
+   LENGTH bytes of zeros or, if ISDIR, an empty directory.  Returns
+   false if the tmpfs has no pages left for LENGTH bytes. */
+bool
+tmpfs_create (block_sector_t inumber, off_t length, bool isdir)
+{
+  struct tmpfs_node *node = get_node (inumber);
+
+  ASSERT (length >= 0);
+
+  node->is_dir = isdir;
+  return tmpfs_truncate (inumber, length);
+}
+
+/* Returns true if node INUMBER is a directory. */
+bool
+tmpfs_isdir (block_sector_t inumber)
+{
+  return get_node (inumber)->is_dir;
+}
+
+/* Returns the length, in bytes, of node INUMBER. */
+off_t
+tmpfs_length (block_sector_t inumber)
+{
+  struct tmpfs_node *node = get_node (inumber);
+  off_t length;
+
+  lock_acquire (&node->lock);
+  length = node->length;
+  lock_release (&node->lock);
+  return length;
+}
+
+/* Copies SIZE bytes between BUFFER and NODE's data from OFFSET on,
+   into NODE if WRITE, a page at a time.  NODE's pages must cover
+   them.  Returns the number of bytes copied, fewer if memory runs
+   short. */
+static off_t
+copy (struct tmpfs_node *node, uint8_t *buffer, off_t size, off_t offset,
+      bool write)
+{
+  off_t done = 0;
+
+  while (done < size)
+    {
+      size_t idx = (offset + done) / PGSIZE;
+      size_t page_ofs = (offset + done) % PGSIZE;
+      size_t chunk = PGSIZE - page_ofs;
+      uint8_t *kaddr = share_shm_get (node->shm, idx);
+
+      if (kaddr == NULL)
+        break;
+      if (chunk > (size_t) (size - done))
+        chunk = size - done;
+      if (write)
+        memcpy (kaddr + page_ofs, buffer + done, chunk);
+      else
+        memcpy (buffer + done, kaddr + page_ofs, chunk);
+      share_shm_put (node->shm, idx);
+      done += chunk;
+    }
+  return done;
+}
+
+/* Reads SIZE bytes from node INUMBER into BUFFER, starting at OFFSET.
+   Returns the number of bytes read, fewer than SIZE at end of file or
+   if memory runs short. */
+off_t
+tmpfs_read_at (block_sector_t inumber, void *buffer, off_t size,
+               off_t offset)
+{
+  struct tmpfs_node *node = get_node (inumber);
+
+  lock_acquire (&node->lock);
+  if (offset >= node->length)
+    size = 0;
+  else if (size > node->length - offset)
+    size = node->length - offset;
+  if (size > 0)
+    {
+      begin_use (node);
+      size = copy (node, buffer, size, offset, false);
+      end_use (node);
+    }
+  lock_release (&node->lock);
+  return size;
+}
+
+/* Writes SIZE bytes from BUFFER into node INUMBER, starting at OFFSET,
+   extending it if that is past its end.  Returns the number of bytes
+   written, fewer than SIZE if the tmpfs or memory runs out of
+   pages. */
+off_t
+tmpfs_write_at (block_sector_t inumber, const void *buffer, off_t size,
+                off_t offset)
+{
+  struct tmpfs_node *node = get_node (inumber);
+  off_t end;
+
+  if (size <= 0 || offset < 0)
+    return 0;
+
+  lock_acquire (&node->lock);
+  end = grow (node, offset + size);
+  size = end > offset ? end - offset : 0;
+  if (size > 0)
+    {
+      node->write_gen++;
+      begin_use (node);
+      size = copy (node, (uint8_t *) buffer, size, offset, true);
+      end_use (node);
+      if (offset + size > node->length)
+        node->length = offset + size;
+    }
+  lock_release (&node->lock);
+  return size;
+}
+
+/* Sets the length of node INUMBER to LENGTH bytes, giving back the
+   pages wholly past it if it shrinks, or adding zeros if it grows.
+   Returns false if the tmpfs has no pages left for LENGTH bytes. */
+bool
+tmpfs_truncate (block_sector_t inumber, off_t length)
+{
+  struct tmpfs_node *node = get_node (inumber);
+  bool success = true;
+
+  ASSERT (length >= 0);
+
+  lock_acquire (&node->lock);
+  if (length > node->length)
+    {
+      success = grow (node, length) == length;
+      if (success)
+        node->length = length;
+      else
+        trim (node);
+    }
+  else if (length < node->length)
+    {
+      size_t tail = length % PGSIZE;
+      unsigned gen;
+
+      /* Zero the rest of the page LENGTH ends in, which reads back if
+         the file grows again, over again if a write may have landed
+         there meanwhile. */
+      do
+        {
+          wait_idle (node);
+          gen = node->write_gen;
+          if (tail != 0)
+            {
+              uint8_t *kaddr;
+
+              begin_use (node);
+              kaddr = share_shm_get (node->shm, length / PGSIZE);
+              if (kaddr != NULL)
+                {
+                  memset (kaddr + tail, 0, PGSIZE - tail);
+                  share_shm_put (node->shm, length / PGSIZE);
+                }
+              end_use (node);
+              wait_idle (node);
+            }
+        }
+      while (gen != node->write_gen);
+      node->length = length;
+      trim (node);
+    }
+  lock_release (&node->lock);
+  return success;
+}
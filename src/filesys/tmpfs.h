@@ -0,0 +1,39 @@
+#ifndef FILESYS_TMPFS_H
+#define FILESYS_TMPFS_H
+
+#include <stdbool.h>
+#include "devices/block.h"
+#include "filesys/off_t.h"
+
+/* The inumber of a tmpfs file or directory is TMPFS_INUMBER_BIT with
+   the index of its node below, which no disk inode's can be: sectors
+   that far into a disk, 256 GB, are out of reach, and packed inumbers
+   and INODE_INVALID_SECTOR have a higher bit set too. */
+#define TMPFS_INUMBER_BIT 0x20000000
+#define TMPFS_INUMBER_MASK 0xf0000000
+
+/* Inumber of the root directory of the tmpfs. */
+#define TMPFS_ROOT_INUMBER TMPFS_INUMBER_BIT
+
+/* Returns true if INUMBER is of a tmpfs file or directory. */
+static inline bool
+tmpfs_owns (block_sector_t inumber)
+{
+  return (inumber & TMPFS_INUMBER_MASK) == TMPFS_INUMBER_BIT;
+}
+
+bool tmpfs_mount (const char *path);
+block_sector_t tmpfs_resolve (block_sector_t inumber);
+
+bool tmpfs_alloc_inumber (block_sector_t *inumberp);
+void tmpfs_free_inumber (block_sector_t inumber);
+bool tmpfs_create (block_sector_t inumber, off_t length, bool isdir);
+bool tmpfs_isdir (block_sector_t inumber);
+off_t tmpfs_length (block_sector_t inumber);
+off_t tmpfs_read_at (block_sector_t inumber, void *, off_t size,
+                     off_t offset);
+off_t tmpfs_write_at (block_sector_t inumber, const void *, off_t size,
+                      off_t offset);
+bool tmpfs_truncate (block_sector_t inumber, off_t length);
+
+#endif /* filesys/tmpfs.h */
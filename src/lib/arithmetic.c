@@ -159,6 +159,9 @@ long long __divdi3 (long long n, long long d);
 long long __moddi3 (long long n, long long d);
 unsigned long long __udivdi3 (unsigned long long n, unsigned long long d);
 unsigned long long __umoddi3 (unsigned long long n, unsigned long long d);
+long long __divmoddi4 (long long n, long long d, long long *r);
+unsigned long long __udivmoddi4 (unsigned long long n, unsigned long long d,
+                                 unsigned long long *r);
 
 /* Signed 64-bit division. */
 long long
@@ -187,3 +190,23 @@ __umoddi3 (unsigned long long n, unsigned long long d)
 {
   return umod64 (n, d);
 }
+
+/* Signed 64-bit division and remainder at once, which GCC calls for
+   both with optimization turned up. */
+long long
+__divmoddi4 (long long n, long long d, long long *r)
+{
+  long long q = sdiv64 (n, d);
+  *r = n - d * q;
+  return q;
+}
+
+/* Unsigned 64-bit division and remainder at once. */
+unsigned long long
+__udivmoddi4 (unsigned long long n, unsigned long long d,
+              unsigned long long *r)
+{
+  unsigned long long q = udiv64 (n, d);
+  *r = n - d * q;
+  return q;
+}
@@ -0,0 +1,20 @@
+#ifndef __LIB_CACHESTAT_H
+#define __LIB_CACHESTAT_H
+
+/* A process's buffer cache statistics as returned by the cachestat
+   system call, shared between the kernel and user programs. */
+
+#include <stdint.h>
+
+struct cachestat
+  {
+    uint32_t sectors;           /* Cache sectors charged to the process,
+                                   the last to use each of them. */
+    uint32_t quota;             /* Its soft quota of sectors, 0 if
+                                   there is none. */
+    uint64_t hits;              /* Its lookups that found the sector
+                                   cached. */
+    uint64_t misses;            /* Its lookups that had to read it. */
+  };
+
+#endif /* lib/cachestat.h */
@@ -25,9 +25,17 @@ void debug_backtrace_all (void);
 /* This is outside the header guard so that debug.h may be
    included multiple times with different settings of NDEBUG. */
 #undef ASSERT
+#undef ASSERT_SLOW
+#undef DEBUG_SLOW
 #undef NOT_REACHED
 
-#ifndef NDEBUG
+/* ASSERT_LEVEL, if defined, picks the checks compiled in: 0 for none,
+   like NDEBUG; 1 for the cheap ASSERT()s alone, as in the release
+   build ("make RELEASE=1"); 2, the default, for those plus
+   ASSERT_SLOW(), for checks that cost more than what they check, and
+   filling of freed memory to catch its use, which DEBUG_SLOW
+   enables. */
+#if !defined NDEBUG && (!defined ASSERT_LEVEL || ASSERT_LEVEL >= 1)
 #define ASSERT(CONDITION)                                       \
         if (CONDITION) { } else {                               \
                 PANIC ("assertion `%s' failed.", #CONDITION);   \
@@ -36,4 +44,12 @@ void debug_backtrace_all (void);
 #else
 #define ASSERT(CONDITION) ((void) 0)
 #define NOT_REACHED() for (;;)
+#endif
+
+#if !defined NDEBUG && (!defined ASSERT_LEVEL || ASSERT_LEVEL >= 2)
+#define DEBUG_SLOW 1
+#define ASSERT_SLOW(CONDITION) ASSERT (CONDITION)
+#else
+#define DEBUG_SLOW 0
+#define ASSERT_SLOW(CONDITION) ((void) 0)
 #endif /* lib/debug.h */
@@ -0,0 +1,21 @@
+#ifndef __LIB_DIRENT_H
+#define __LIB_DIRENT_H
+
+/* Directory entries as returned by the getdents system call, shared
+   between the kernel and user programs. */
+
+#include <stdbool.h>
+
+/* Maximum characters in a name in a struct dirent. */
+#define DIRENT_NAME_MAX 14
+
+/* A directory entry. */
+struct dirent
+  {
+    int inumber;                        /* Inode number of the entry. */
+    bool isdir;                         /* Whether it is a directory. */
+    unsigned length;                    /* Length in bytes. */
+    char name[DIRENT_NAME_MAX + 1];     /* Null terminated file name. */
+  };
+
+#endif /* lib/dirent.h */
@@ -3,6 +3,7 @@
 #include <limits.h>
 #include <round.h>
 #include <stdio.h>
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
 #ifdef FILESYS
 #include "filesys/filesys.h"
@@ -23,11 +24,18 @@ typedef unsigned long elem_type;
 
 /* From the outside, a bitmap is an array of bits.  From the
    inside, it's an array of elem_type (defined above) that
-   simulates an array of bits. */
+   simulates an array of bits.
+
+   A second, smaller array summarizes the first with one bit per
+   element, set if every bit in the element is set.  Searches for
+   false bits use it to skip a whole element's worth of full
+   elements at a time, which keeps them fast in mostly-full
+   bitmaps. */
 struct bitmap
   {
     size_t bit_cnt;     /* Number of bits. */
     elem_type *bits;    /* Elements that represent bits. */
+    elem_type *full;    /* Bit I set if element I of BITS is full. */
   };
 
 /* Returns the index of the element that contains the bit
@@ -60,6 +68,14 @@ byte_cnt (size_t bit_cnt)
   return sizeof (elem_type) * elem_cnt (bit_cnt);
 }
 
+/* Returns the number of bytes required for BIT_CNT bits together
+   with their summary. */
+static inline size_t
+buf_cnt (size_t bit_cnt)
+{
+  return byte_cnt (bit_cnt) + byte_cnt (elem_cnt (bit_cnt));
+}
+
 /* Returns a bit mask in which the bits actually used in the last
    element of B's bits are set to 1 and the rest are set to 0. */
 static inline elem_type
@@ -68,6 +84,36 @@ last_mask (const struct bitmap *b)
   int last_bits = b->bit_cnt % ELEM_BITS;
   return last_bits ? ((elem_type) 1 << last_bits) - 1 : (elem_type) -1;
 }
+
+/* Brings the summary bit for element IDX of B up to date. */
+static inline void
+update_summary (struct bitmap *b, size_t idx)
+{
+  elem_type used = (idx == elem_cnt (b->bit_cnt) - 1
+                    ? last_mask (b) : (elem_type) -1);
+
+  if ((b->bits[idx] & used) == used)
+    b->full[elem_idx (idx)] |= bit_mask (idx);
+  else
+    b->full[elem_idx (idx)] &= ~bit_mask (idx);
+}
+
+/* Sets the bits in MASK of element IDX of B to VALUE and updates
+   the summary to match.  Interrupts are off meanwhile, so every
+   change to B, and the summary of it, is atomic on a uniprocessor
+   machine. */
+static void
+set_bits (struct bitmap *b, size_t idx, elem_type mask, bool value)
+{
+  enum intr_level old_level = intr_disable ();
+
+  if (value)
+    b->bits[idx] |= mask;
+  else
+    b->bits[idx] &= ~mask;
+  update_summary (b, idx);
+  intr_set_level (old_level);
+}
 
 /* Creation and destruction. */
 
@@ -82,9 +128,10 @@ bitmap_create (size_t bit_cnt)
   if (b != NULL)
     {
       b->bit_cnt = bit_cnt;
-      b->bits = malloc (byte_cnt (bit_cnt));
+      b->bits = malloc (buf_cnt (bit_cnt));
       if (b->bits != NULL || bit_cnt == 0)
         {
+          b->full = b->bits + elem_cnt (bit_cnt);
           bitmap_set_all (b, false);
           return b;
         }
@@ -105,6 +152,7 @@ bitmap_create_in_buf (size_t bit_cnt, void *block, size_t block_size UNUSED)
 
   b->bit_cnt = bit_cnt;
   b->bits = (elem_type *) (b + 1);
+  b->full = b->bits + elem_cnt (bit_cnt);
   bitmap_set_all (b, false);
   return b;
 }
@@ -114,7 +162,7 @@ bitmap_create_in_buf (size_t bit_cnt, void *block, size_t block_size UNUSED)
 size_t
 bitmap_buf_size (size_t bit_cnt) 
 {
-  return sizeof (struct bitmap) + byte_cnt (bit_cnt);
+  return sizeof (struct bitmap) + buf_cnt (bit_cnt);
 }
 
 /* Destroys bitmap B, freeing its storage.
@@ -156,26 +204,14 @@ bitmap_set (struct bitmap *b, size_t idx, bool value)
 void
 bitmap_mark (struct bitmap *b, size_t bit_idx) 
 {
-  size_t idx = elem_idx (bit_idx);
-  elem_type mask = bit_mask (bit_idx);
-
-  /* This is equivalent to `b->bits[idx] |= mask' except that it
-     is guaranteed to be atomic on a uniprocessor machine.  See
-     the description of the OR instruction in [IA32-v2b]. */
-  asm ("orl %1, %0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+  set_bits (b, elem_idx (bit_idx), bit_mask (bit_idx), true);
 }
 
 /* Atomically sets the bit numbered BIT_IDX in B to false. */
 void
 bitmap_reset (struct bitmap *b, size_t bit_idx) 
 {
-  size_t idx = elem_idx (bit_idx);
-  elem_type mask = bit_mask (bit_idx);
-
-  /* This is equivalent to `b->bits[idx] &= ~mask' except that it
-     is guaranteed to be atomic on a uniprocessor machine.  See
-     the description of the AND instruction in [IA32-v2a]. */
-  asm ("andl %1, %0" : "=m" (b->bits[idx]) : "r" (~mask) : "cc");
+  set_bits (b, elem_idx (bit_idx), bit_mask (bit_idx), false);
 }
 
 /* Atomically toggles the bit numbered IDX in B;
@@ -185,12 +221,11 @@ void
 bitmap_flip (struct bitmap *b, size_t bit_idx) 
 {
   size_t idx = elem_idx (bit_idx);
-  elem_type mask = bit_mask (bit_idx);
+  enum intr_level old_level = intr_disable ();
 
-  /* This is equivalent to `b->bits[idx] ^= mask' except that it
-     is guaranteed to be atomic on a uniprocessor machine.  See
-     the description of the XOR instruction in [IA32-v2b]. */
-  asm ("xorl %1, %0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+  b->bits[idx] ^= bit_mask (bit_idx);
+  update_summary (b, idx);
+  intr_set_level (old_level);
 }
 
 /* Returns the value of the bit numbered IDX in B. */
@@ -217,14 +252,23 @@ bitmap_set_all (struct bitmap *b, bool value)
 void
 bitmap_set_multiple (struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i;
-  
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    bitmap_set (b, start + i, value);
+  /* One element at a time. */
+  while (cnt > 0)
+    {
+      size_t ofs = start % ELEM_BITS;
+      size_t n = ELEM_BITS - ofs < cnt ? ELEM_BITS - ofs : cnt;
+      elem_type mask = (n == ELEM_BITS
+                        ? (elem_type) -1
+                        : (((elem_type) 1 << n) - 1) << ofs);
+
+      set_bits (b, elem_idx (start), mask, value);
+      start += n;
+      cnt -= n;
+    }
 }
 
 /* Returns the number of bits in B between START and START + CNT,
@@ -245,21 +289,67 @@ bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value)
   return value_cnt;
 }
 
+/* Returns the index of the first element at or after IDX in B
+   that is not full, or the number of elements in B if there is
+   none. */
+static size_t
+next_nonfull (const struct bitmap *b, size_t idx)
+{
+  size_t cnt = elem_cnt (b->bit_cnt);
+  size_t s = elem_idx (idx);
+  elem_type e;
+
+  if (idx >= cnt)
+    return cnt;
+  e = ~b->full[s] & ~(bit_mask (idx) - 1);
+  while (e == 0)
+    {
+      if (++s >= elem_cnt (cnt))
+        return cnt;
+      e = ~b->full[s];
+    }
+  idx = s * ELEM_BITS + __builtin_ctzl (e);
+  return idx < cnt ? idx : cnt;
+}
+
+/* Returns the index of the first bit in B between START and
+   LIMIT, exclusive, that is set to VALUE, or LIMIT if there is
+   none.  Looks at a whole element at a time, and at none of the
+   full elements when looking for a false bit. */
+static size_t
+next_bit (const struct bitmap *b, size_t start, size_t limit, bool value)
+{
+  size_t idx = elem_idx (start);
+  elem_type e;
+
+  if (start >= limit)
+    return limit;
+  e = (value ? b->bits[idx] : ~b->bits[idx]) & ~(bit_mask (start) - 1);
+  while (e == 0)
+    {
+      idx++;
+      if (!value)
+        idx = next_nonfull (b, idx);
+      if (idx * ELEM_BITS >= limit)
+        return limit;
+      e = value ? b->bits[idx] : ~b->bits[idx];
+    }
+
+  /* __builtin_ctzl() compiles to a single BSF instruction. */
+  start = idx * ELEM_BITS + __builtin_ctzl (e);
+  return start < limit ? start : limit;
+}
+
 /* Returns true if any bits in B between START and START + CNT,
    exclusive, are set to VALUE, and false otherwise. */
 bool
 bitmap_contains (const struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i;
-  
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test (b, start + i) == value)
-      return true;
-  return false;
+  return next_bit (b, start, start + cnt, value) < start + cnt;
 }
 
 /* Returns true if any bits in B between START and START + CNT,
@@ -298,13 +388,22 @@ bitmap_scan (const struct bitmap *b, size_t start, size_t cnt, bool value)
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
 
-  if (cnt <= b->bit_cnt) 
+  if (cnt == 0)
+    return start;
+  while (cnt <= b->bit_cnt - start)
     {
-      size_t last = b->bit_cnt - cnt;
-      size_t i;
-      for (i = start; i <= last; i++)
-        if (!bitmap_contains (b, i, cnt, !value))
-          return i; 
+      /* Find the next bit set to VALUE, then see whether the run
+         starting there is long enough.  If not, the next one can
+         only start after the bit that ends it. */
+      size_t end;
+
+      start = next_bit (b, start, b->bit_cnt - cnt + 1, value);
+      if (start > b->bit_cnt - cnt)
+        break;
+      end = next_bit (b, start, start + cnt, !value);
+      if (end == start + cnt)
+        return start;
+      start = end;
     }
   return BITMAP_ERROR;
 }
@@ -344,12 +443,48 @@ bitmap_read (struct bitmap *b, void *file)
   if (b->bit_cnt > 0) 
     {
       off_t size = byte_cnt (b->bit_cnt);
+      size_t i;
+
       success = filesys_read_at (file, b->bits, size, 0) == size;
       b->bits[elem_cnt (b->bit_cnt) - 1] &= last_mask (b);
+      for (i = 0; i < elem_cnt (b->bit_cnt); i++)
+        update_summary (b, i);
     }
   return success;
 }
 
+/* Reads the CNT bits of B starting at START from FILE, where
+   bitmap_write() or bitmap_write_range() put them, leaving the rest
+   of B alone.  The range must start and end on element boundaries,
+   or end at the end of B.  Returns true if successful, false
+   otherwise. */
+bool
+bitmap_read_range (struct bitmap *b, void *file, size_t start, size_t cnt)
+{
+  size_t first, last, i;
+  off_t ofs, end;
+  bool success;
+
+  ASSERT (start <= b->bit_cnt);
+  ASSERT (start + cnt <= b->bit_cnt);
+  ASSERT (start % ELEM_BITS == 0);
+  ASSERT ((start + cnt) % ELEM_BITS == 0 || start + cnt == b->bit_cnt);
+  if (cnt == 0)
+    return true;
+
+  first = elem_idx (start);
+  last = elem_idx (start + cnt - 1);
+  ofs = first * sizeof (elem_type);
+  end = (last + 1) * sizeof (elem_type);
+  success = filesys_read_at (file, (uint8_t *) b->bits + ofs, end - ofs, ofs)
+            == end - ofs;
+  if (last == elem_cnt (b->bit_cnt) - 1)
+    b->bits[last] &= last_mask (b);
+  for (i = first; i <= last; i++)
+    update_summary (b, i);
+  return success;
+}
+
 /* Writes B to FILE.  Return true if successful, false
    otherwise. */
 bool
@@ -358,6 +493,28 @@ bitmap_write (const struct bitmap *b, void *file)
   off_t size = byte_cnt (b->bit_cnt);
   return filesys_write_at (file, b->bits, size, 0) == size;
 }
+
+/* Writes the part of B holding the CNT bits starting at START to
+   FILE, at the same offset bitmap_write() would put it.  Return
+   true if successful, false otherwise. */
+bool
+bitmap_write_range (const struct bitmap *b, void *file, size_t start,
+                    size_t cnt)
+{
+  off_t ofs, end;
+
+  ASSERT (start <= b->bit_cnt);
+  ASSERT (start + cnt <= b->bit_cnt);
+  if (cnt == 0)
+    return true;
+
+  ofs = elem_idx (start) * sizeof (elem_type);
+  end = (elem_idx (start + cnt - 1) + 1) * sizeof (elem_type);
+  if (end > (off_t) byte_cnt (b->bit_cnt))
+    end = byte_cnt (b->bit_cnt);
+  return filesys_write_at (file, (uint8_t *) b->bits + ofs, end - ofs, ofs)
+         == end - ofs;
+}
 #endif /* FILESYS */
 
 /* Debugging. */
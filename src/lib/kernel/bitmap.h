@@ -41,7 +41,11 @@ size_t bitmap_scan_and_flip (struct bitmap *, size_t start, size_t cnt, bool);
 #ifdef FILESYS
 size_t bitmap_file_size (const struct bitmap *);
 bool bitmap_read (struct bitmap *, void *file);
+bool bitmap_read_range (struct bitmap *, void *file, size_t start,
+                        size_t cnt);
 bool bitmap_write (const struct bitmap *, void *file);
+bool bitmap_write_range (const struct bitmap *, void *file,
+                         size_t start, size_t cnt);
 #endif
 
 /* Debugging. */
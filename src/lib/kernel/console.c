@@ -1,6 +1,7 @@
 #include <console.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <string.h>
 #include "devices/serial.h"
 #include "devices/vga.h"
 #include "threads/init.h"
@@ -9,6 +10,15 @@
 
 static void vprintf_helper (char, void *);
 static void putchar_have_lock (uint8_t c);
+static void putbuf_have_lock (const char *buffer, size_t n);
+
+/* Output of one vprintf() call, gathered to be written in blocks. */
+struct vprintf_aux
+  {
+    int char_cnt;               /* Characters output so far. */
+    size_t buf_cnt;             /* Characters in BUF not written yet. */
+    char buf[64];
+  };
 
 /* The console lock.
    Both the vga and serial layers do their own locking, so it's
@@ -125,13 +135,16 @@ console_locked_by_current_thread (void)
 int
 vprintf (const char *format, va_list args) 
 {
-  int char_cnt = 0;
+  struct vprintf_aux aux;
 
+  aux.char_cnt = 0;
+  aux.buf_cnt = 0;
   acquire_console ();
-  __vprintf (format, args, vprintf_helper, &char_cnt);
+  __vprintf (format, args, vprintf_helper, &aux);
+  putbuf_have_lock (aux.buf, aux.buf_cnt);
   release_console ();
 
-  return char_cnt;
+  return aux.char_cnt;
 }
 
 /* Writes string S to the console, followed by a new-line
@@ -140,8 +153,7 @@ int
 puts (const char *s) 
 {
   acquire_console ();
-  while (*s != '\0')
-    putchar_have_lock (*s++);
+  putbuf_have_lock (s, strlen (s));
   putchar_have_lock ('\n');
   release_console ();
 
@@ -153,8 +165,7 @@ void
 putbuf (const char *buffer, size_t n) 
 {
   acquire_console ();
-  while (n-- > 0)
-    putchar_have_lock (*buffer++);
+  putbuf_have_lock (buffer, n);
   release_console ();
 }
 
@@ -171,11 +182,17 @@ putchar (int c)
 
 /* Helper function for vprintf(). */
 static void
-vprintf_helper (char c, void *char_cnt_) 
+vprintf_helper (char c, void *aux_) 
 {
-  int *char_cnt = char_cnt_;
-  (*char_cnt)++;
-  putchar_have_lock (c);
+  struct vprintf_aux *aux = aux_;
+
+  aux->char_cnt++;
+  aux->buf[aux->buf_cnt++] = c;
+  if (aux->buf_cnt == sizeof aux->buf)
+    {
+      putbuf_have_lock (aux->buf, aux->buf_cnt);
+      aux->buf_cnt = 0;
+    }
 }
 
 /* Writes C to the vga display and serial port.
@@ -189,3 +206,15 @@ putchar_have_lock (uint8_t c)
   serial_putc (c);
   vga_putc (c);
 }
+
+/* Writes the N characters in BUFFER to the vga display and serial
+   port, handing each all of them at once.  The caller has already
+   acquired the console lock if appropriate. */
+static void
+putbuf_have_lock (const char *buffer, size_t n)
+{
+  ASSERT (console_locked_by_current_thread ());
+  write_cnt += n;
+  serial_putbuf ((const uint8_t *) buffer, n);
+  vga_putbuf (buffer, n);
+}
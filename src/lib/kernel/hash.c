@@ -298,7 +298,17 @@ hash_string (const char *s_)
 unsigned
 hash_int (int i) 
 {
-  return hash_bytes (&i, sizeof i);
+  /* Finalizer of MurmurHash3, which mixes every bit of I into every
+     bit of the hash, so the low bits that pick a bucket depend on
+     all of I. */
+  uint32_t hash = i;
+
+  hash ^= hash >> 16;
+  hash *= 0x85ebca6b;
+  hash ^= hash >> 13;
+  hash *= 0xc2b2ae35;
+  hash ^= hash >> 16;
+  return hash;
 }
 
 /* Returns the bucket in H that E belongs in. */
@@ -428,3 +438,161 @@ remove_elem (struct hash *h, struct hash_elem *e)
   list_remove (&e->list_elem);
 }
 
+
+/* Open addressing hash table. */
+
+static struct ihash_slot *ihash_probe (const struct ihash *, unsigned key);
+static bool ihash_grow (struct ihash *);
+
+/* Initializes integer-keyed hash table H with room for ELEM_CNT
+   elements before it has to grow.  Returns false if memory is not
+   available. */
+bool
+ihash_init (struct ihash *h, size_t elem_cnt)
+{
+  size_t i;
+
+  h->elem_cnt = 0;
+  h->slot_cnt = 4;
+  while (h->slot_cnt < elem_cnt * 2)
+    h->slot_cnt *= 2;
+  h->slots = malloc (sizeof *h->slots * h->slot_cnt);
+  if (h->slots == NULL)
+    return false;
+  for (i = 0; i < h->slot_cnt; i++)
+    h->slots[i].elem = NULL;
+  return true;
+}
+
+/* Destroys hash table H, leaving its elements alone. */
+void
+ihash_destroy (struct ihash *h)
+{
+  free (h->slots);
+}
+
+/* Returns the slot of H that holds KEY, or the free slot where KEY
+   goes if it is not in H. */
+static struct ihash_slot *
+ihash_probe (const struct ihash *h, unsigned key)
+{
+  size_t mask = h->slot_cnt - 1;
+  size_t i;
+
+  for (i = hash_int (key) & mask; h->slots[i].elem != NULL;
+       i = (i + 1) & mask)
+    if (h->slots[i].key == key)
+      break;
+  return &h->slots[i];
+}
+
+/* Doubles the slots of H.  Returns false if memory is not
+   available, leaving H as it was. */
+static bool
+ihash_grow (struct ihash *h)
+{
+  struct ihash old = *h;
+  size_t i;
+
+  h->slot_cnt *= 2;
+  h->slots = malloc (sizeof *h->slots * h->slot_cnt);
+  if (h->slots == NULL)
+    {
+      *h = old;
+      return false;
+    }
+  for (i = 0; i < h->slot_cnt; i++)
+    h->slots[i].elem = NULL;
+  for (i = 0; i < old.slot_cnt; i++)
+    if (old.slots[i].elem != NULL)
+      *ihash_probe (h, old.slots[i].key) = old.slots[i];
+  free (old.slots);
+  return true;
+}
+
+/* Grows H, if needed, so that ihash_insert() can't fail until it
+   holds ELEM_CNT elements.  Returns false if memory is not available
+   to grow it that far. */
+bool
+ihash_reserve (struct ihash *h, size_t elem_cnt)
+{
+  while (elem_cnt >= h->slot_cnt)
+    if (!ihash_grow (h))
+      return false;
+  return true;
+}
+
+/* Files element E in H under KEY.  Returns false without doing so
+   if H already has an element under KEY, or if H is out of room and
+   memory to grow it is not available. */
+bool
+ihash_insert (struct ihash *h, unsigned key, struct hash_elem *e)
+{
+  struct ihash_slot *slot;
+
+  ASSERT (e != NULL);
+
+  /* Keep a free slot to end every probe even if growing fails. */
+  if ((h->elem_cnt + 1) * 2 > h->slot_cnt && !ihash_grow (h)
+      && h->elem_cnt + 1 == h->slot_cnt)
+    return false;
+
+  slot = ihash_probe (h, key);
+  if (slot->elem != NULL)
+    return false;
+  slot->key = key;
+  slot->elem = e;
+  h->elem_cnt++;
+  return true;
+}
+
+/* Returns the element filed in H under KEY, or a null pointer if
+   there is none. */
+struct hash_elem *
+ihash_find (const struct ihash *h, unsigned key)
+{
+  return ihash_probe (h, key)->elem;
+}
+
+/* Removes the element filed in H under KEY from H and returns it, or
+   returns a null pointer if there is none.
+
+   Slots after the freed one whose keys would no longer be reached
+   by a probe are moved back into it, so no probe ever stops short
+   of its key. */
+struct hash_elem *
+ihash_delete (struct ihash *h, unsigned key)
+{
+  size_t mask = h->slot_cnt - 1;
+  struct ihash_slot *slot = ihash_probe (h, key);
+  struct hash_elem *e = slot->elem;
+  size_t hole, i;
+
+  if (e == NULL)
+    return NULL;
+  slot->elem = NULL;
+  h->elem_cnt--;
+
+  hole = slot - h->slots;
+  for (i = (hole + 1) & mask; h->slots[i].elem != NULL; i = (i + 1) & mask)
+    {
+      /* The slot probes for the key in slot I start from. */
+      size_t home = hash_int (h->slots[i].key) & mask;
+
+      /* Move slot I unless HOME lies cyclically in (HOLE, I]. */
+      if (hole < i ? home <= hole || home > i : home <= hole && home > i)
+        {
+          h->slots[hole] = h->slots[i];
+          h->slots[i].elem = NULL;
+          hole = i;
+        }
+    }
+  return e;
+}
+
+/* Returns the number of elements in H. */
+size_t
+ihash_size (const struct ihash *h)
+{
+  return h->elem_cnt;
+}
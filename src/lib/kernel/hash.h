@@ -95,6 +95,40 @@ struct hash_elem *hash_cur (struct hash_iterator *);
 size_t hash_size (struct hash *);
 bool hash_empty (struct hash *);
 
+/* Open addressing hash table from integer keys to hash elements.
+
+   For tables looked up often, by an integer key such as a sector
+   number.  The table is a single array of slots, each holding a
+   key next to a pointer to the hash element filed under it, and a
+   lookup probes consecutive slots from the one the key hashes to
+   until it finds the key or a free slot (linear probing).  So
+   unlike a struct hash it touches no elements or list nodes on the
+   way, and calls no hash or comparison functions.
+
+   The table grows to keep at most half of its slots in use.  An
+   element can be in a struct hash and a struct ihash at once with
+   the same struct hash_elem, which a struct ihash doesn't modify. */
+struct ihash_slot
+  {
+    unsigned key;               /* Key of ELEM. */
+    struct hash_elem *elem;     /* Element, or a null pointer if free. */
+  };
+
+struct ihash
+  {
+    size_t elem_cnt;            /* Number of elements in table. */
+    size_t slot_cnt;            /* Number of slots, a power of 2. */
+    struct ihash_slot *slots;   /* Array of `slot_cnt' slots. */
+  };
+
+bool ihash_init (struct ihash *, size_t elem_cnt);
+void ihash_destroy (struct ihash *);
+bool ihash_reserve (struct ihash *, size_t elem_cnt);
+bool ihash_insert (struct ihash *, unsigned key, struct hash_elem *);
+struct hash_elem *ihash_find (const struct ihash *, unsigned key);
+struct hash_elem *ihash_delete (struct ihash *, unsigned key);
+size_t ihash_size (const struct ihash *);
+
 /* Sample hash functions. */
 unsigned hash_bytes (const void *, size_t);
 unsigned hash_string (const char *);
@@ -0,0 +1,171 @@
+#include "heap.h"
+#include "../debug.h"
+
+static struct heap_elem *meld (struct heap *, struct heap_elem *,
+                               struct heap_elem *);
+static struct heap_elem *merge_pairs (struct heap *, struct heap_elem *);
+
+/* Initializes heap H to be empty, ordered by LESS given auxiliary
+   data AUX. */
+void
+heap_init (struct heap *h, heap_less_func *less, void *aux)
+{
+  ASSERT (h != NULL);
+  ASSERT (less != NULL);
+
+  h->root = NULL;
+  h->size = 0;
+  h->less = less;
+  h->aux = aux;
+}
+
+/* Returns the number of elements in H. */
+size_t
+heap_size (const struct heap *h)
+{
+  return h->size;
+}
+
+/* Returns true if H is empty, false otherwise. */
+bool
+heap_empty (const struct heap *h)
+{
+  return h->root == NULL;
+}
+
+/* Returns the minimum element of H, which must not be empty.  Of
+   equal elements, it may be any one. */
+struct heap_elem *
+heap_min (const struct heap *h)
+{
+  ASSERT (!heap_empty (h));
+  return h->root;
+}
+
+/* Inserts E into H. */
+void
+heap_push (struct heap *h, struct heap_elem *e)
+{
+  ASSERT (e != NULL);
+
+  e->child = e->next = e->prev = NULL;
+  h->root = meld (h, h->root, e);
+  h->size++;
+}
+
+/* Removes and returns the minimum element of H, which must not be
+   empty. */
+struct heap_elem *
+heap_pop (struct heap *h)
+{
+  struct heap_elem *min = heap_min (h);
+
+  h->root = merge_pairs (h, min->child);
+  h->size--;
+  return min;
+}
+
+/* Removes E, which must be in H, from H. */
+void
+heap_remove (struct heap *h, struct heap_elem *e)
+{
+  ASSERT (e != NULL);
+
+  if (e == h->root)
+    {
+      heap_pop (h);
+      return;
+    }
+
+  /* Cut E and the subtree under it out of its parent's children. */
+  if (e->prev->child == e)
+    e->prev->child = e->next;
+  else
+    e->prev->next = e->next;
+  if (e->next != NULL)
+    e->next->prev = e->prev;
+
+  h->root = meld (h, h->root, merge_pairs (h, e->child));
+  h->size--;
+}
+
+/* Moves E, which must be in H, to its place for a key that has
+   changed since it was inserted. */
+void
+heap_update (struct heap *h, struct heap_elem *e)
+{
+  heap_remove (h, e);
+  heap_push (h, e);
+}
+
+/* Melds the heaps rooted at A and B, either of which may be null,
+   whose roots have no siblings, and returns the root of the
+   result. */
+static struct heap_elem *
+meld (struct heap *h, struct heap_elem *a, struct heap_elem *b)
+{
+  struct heap_elem *t;
+
+  if (a == NULL)
+    return b;
+  if (b == NULL)
+    return a;
+  if (h->less (b, a, h->aux))
+    {
+      t = a;
+      a = b;
+      b = t;
+    }
+
+  /* B becomes the first child of A. */
+  b->next = a->child;
+  if (a->child != NULL)
+    a->child->prev = b;
+  b->prev = a;
+  a->child = b;
+  return a;
+}
+
+/* Melds the sibling heaps starting at FIRST into one, in the two
+   passes that give the pairing heap its amortized bounds, and
+   returns its root, or null if FIRST is null. */
+static struct heap_elem *
+merge_pairs (struct heap *h, struct heap_elem *first)
+{
+  struct heap_elem *pairs = NULL;
+  struct heap_elem *root;
+
+  /* Meld siblings in pairs from left to right, stacking the results
+     through their NEXT members. */
+  while (first != NULL)
+    {
+      struct heap_elem *a = first;
+      struct heap_elem *b = a->next;
+      struct heap_elem *m;
+
+      first = b != NULL ? b->next : NULL;
+      a->next = a->prev = NULL;
+      if (b != NULL)
+        b->next = b->prev = NULL;
+      m = meld (h, a, b);
+      m->next = pairs;
+      pairs = m;
+    }
+
+  /* Meld the pairs from right to left into one. */
+  root = pairs;
+  if (root != NULL)
+    {
+      pairs = root->next;
+      root->next = NULL;
+      while (pairs != NULL)
+        {
+          struct heap_elem *m = pairs;
+
+          pairs = m->next;
+          m->next = NULL;
+          root = meld (h, root, m);
+        }
+    }
+  return root;
+}
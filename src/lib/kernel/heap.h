@@ -0,0 +1,65 @@
+#ifndef __LIB_KERNEL_HEAP_H
+#define __LIB_KERNEL_HEAP_H
+
+/* Priority queue.
+
+   This is a pairing heap.  Adding an element takes constant time,
+   and taking out the minimum element, or any other one, takes
+   amortized logarithmic time.  An element whose key changes while
+   it is in the heap is moved to its new place with heap_update().
+
+   Like lists and hash tables, heaps do not use dynamic allocation.
+   Each structure that can potentially be in a heap must embed a
+   struct heap_elem member, and the heap_entry macro converts from
+   a struct heap_elem back to the structure that contains it.  See
+   lib/kernel/list.h for a detailed explanation of the technique. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Heap element. */
+struct heap_elem
+  {
+    struct heap_elem *child;    /* First child. */
+    struct heap_elem *next;     /* Next sibling. */
+    struct heap_elem *prev;     /* Previous sibling, or parent if the
+                                   first child, or null if the root. */
+  };
+
+/* Converts pointer to heap element HEAP_ELEM into a pointer to
+   the structure that HEAP_ELEM is embedded inside.  Supply the
+   name of the outer structure STRUCT and the member name MEMBER
+   of the heap element. */
+#define heap_entry(HEAP_ELEM, STRUCT, MEMBER)           \
+        ((STRUCT *) ((uint8_t *) &(HEAP_ELEM)->child    \
+                     - offsetof (STRUCT, MEMBER.child)))
+
+/* Compares the value of two heap elements A and B, given
+   auxiliary data AUX.  Returns true if A is less than B, that is,
+   should come out of the heap first, or false if A is greater
+   than or equal to B. */
+typedef bool heap_less_func (const struct heap_elem *a,
+                             const struct heap_elem *b,
+                             void *aux);
+
+/* Heap. */
+struct heap
+  {
+    struct heap_elem *root;     /* Minimum element, or null if empty. */
+    size_t size;                /* Number of elements. */
+    heap_less_func *less;       /* Comparison function. */
+    void *aux;                  /* Auxiliary data for `less'. */
+  };
+
+void heap_init (struct heap *, heap_less_func *, void *aux);
+size_t heap_size (const struct heap *);
+bool heap_empty (const struct heap *);
+
+struct heap_elem *heap_min (const struct heap *);
+void heap_push (struct heap *, struct heap_elem *);
+struct heap_elem *heap_pop (struct heap *);
+void heap_remove (struct heap *, struct heap_elem *);
+void heap_update (struct heap *, struct heap_elem *);
+
+#endif /* lib/kernel/heap.h */
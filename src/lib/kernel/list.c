@@ -399,8 +399,8 @@ inplace_merge (struct list_elem *a0, struct list_elem *a1b0,
   ASSERT (a1b0 != NULL);
   ASSERT (b1 != NULL);
   ASSERT (less != NULL);
-  ASSERT (is_sorted (a0, a1b0, less, aux));
-  ASSERT (is_sorted (a1b0, b1, less, aux));
+  ASSERT_SLOW (is_sorted (a0, a1b0, less, aux));
+  ASSERT_SLOW (is_sorted (a1b0, b1, less, aux));
 
   while (a0 != a1b0 && a1b0 != b1)
     if (!less (a1b0, a0, aux)) 
@@ -450,7 +450,7 @@ list_sort (struct list *list, list_less_func *less, void *aux)
     }
   while (output_run_cnt > 1);
 
-  ASSERT (is_sorted (list_begin (list), list_end (list), less, aux));
+  ASSERT_SLOW (is_sorted (list_begin (list), list_end (list), less, aux));
 }
 
 /* Inserts ELEM in the proper position in LIST, which must be
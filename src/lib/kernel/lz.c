@@ -0,0 +1,132 @@
+/* LZ77-style compression.  See lz.h for the format. */
+
+#include "lz.h"
+#include <stdbool.h>
+#include <string.h>
+#include <debug.h>
+
+/* Longest run of literals encoded. */
+#define LZ_MAX_LITERALS 0x80
+
+/* Farthest back a match may reach. */
+#define LZ_MAX_DISTANCE UINT16_MAX
+
+/* Returns the hash table index for the 3 bytes at P. */
+static inline size_t
+lz_hash (const uint8_t *p)
+{
+  uint32_t x = p[0] | (p[1] << 8) | ((uint32_t) p[2] << 16);
+  return (x * 2654435761u) >> 20;
+}
+
+/* Appends the CNT literal bytes at SRC to DST, which holds *OUT of CAP
+   bytes so far.  Returns false if they don't fit. */
+static bool
+put_literals (const uint8_t *src, size_t cnt, uint8_t *dst, size_t *out,
+              size_t cap)
+{
+  while (cnt > 0)
+    {
+      size_t run = cnt < LZ_MAX_LITERALS ? cnt : LZ_MAX_LITERALS;
+
+      if (*out + 1 + run > cap)
+        return false;
+      dst[(*out)++] = run - 1;
+      memcpy (dst + *out, src, run);
+      *out += run;
+      src += run;
+      cnt -= run;
+    }
+  return true;
+}
+
+/* Compresses the SIZE bytes at SRC into DST, which has room for CAP
+   bytes, using TABLE as scratch space.  Returns the size of the
+   compressed data, or 0 if it would take more than CAP bytes. */
+size_t
+lz_compress (const void *src_, size_t size, void *dst_, size_t cap,
+             uint16_t table[LZ_TABLE_SIZE])
+{
+  const uint8_t *src = src_;
+  uint8_t *dst = dst_;
+  size_t i = 0, literals = 0, out = 0;
+
+  ASSERT (LZ_TABLE_SIZE == 1 << 12);
+  ASSERT (size <= LZ_MAX_DISTANCE);
+
+  /* Entries hold a position plus 1, 0 for none. */
+  memset (table, 0, LZ_TABLE_SIZE * sizeof *table);
+  while (i + LZ_MIN_MATCH <= size)
+    {
+      size_t h = lz_hash (src + i);
+      size_t cand = table[h];
+      size_t len;
+
+      table[h] = i + 1;
+      if (cand == 0 || memcmp (src + --cand, src + i, LZ_MIN_MATCH))
+        {
+          i++;
+          continue;
+        }
+
+      /* Extend the match, which may overlap the bytes it copies. */
+      for (len = LZ_MIN_MATCH;
+           len < LZ_MAX_MATCH && i + len < size
+           && src[cand + len] == src[i + len]; len++)
+        continue;
+      if (!put_literals (src + literals, i - literals, dst, &out, cap)
+          || out + 3 > cap)
+        return 0;
+      dst[out++] = 0x80 | (len - LZ_MIN_MATCH);
+      dst[out++] = (i - cand) & 0xff;
+      dst[out++] = (i - cand) >> 8;
+      i += len;
+      literals = i;
+    }
+  if (!put_literals (src + literals, size - literals, dst, &out, cap))
+    return 0;
+  return out;
+}
+
+/* Decompresses the SIZE bytes of compressed data at SRC into DST, which
+   they must fill exactly DST_SIZE bytes of.  Returns false if the data
+   is corrupt. */
+bool
+lz_decompress (const void *src_, size_t size, void *dst_, size_t dst_size)
+{
+  const uint8_t *src = src_;
+  uint8_t *dst = dst_;
+  size_t in = 0, out = 0;
+
+  while (in < size)
+    {
+      uint8_t c = src[in++];
+      size_t len;
+
+      if (c < 0x80)
+        {
+          len = c + 1;
+          if (in + len > size || out + len > dst_size)
+            return false;
+          memcpy (dst + out, src + in, len);
+          in += len;
+        }
+      else
+        {
+          size_t distance;
+
+          len = (c & 0x7f) + LZ_MIN_MATCH;
+          if (in + 2 > size)
+            return false;
+          distance = src[in] | (src[in + 1] << 8);
+          in += 2;
+          if (distance == 0 || distance > out || out + len > dst_size)
+            return false;
+          /* Byte by byte, since the source may overlap the copy. */
+          for (size_t j = 0; j < len; j++)
+            dst[out + j] = dst[out + j - distance];
+        }
+      out += len;
+    }
+  return out == dst_size;
+}
@@ -0,0 +1,31 @@
+#ifndef __LIB_KERNEL_LZ_H
+#define __LIB_KERNEL_LZ_H
+
+/* LZ77-style compression of small buffers, such as pages.
+
+   The compressed data is a sequence of runs, each starting with a
+   control byte C.  If C < 0x80, C + 1 literal bytes follow.
+   Otherwise the run copies (C & 0x7f) + LZ_MIN_MATCH bytes from
+   earlier in the output, at the distance given by the next two
+   bytes, little-endian.  Matches are found with a hash table of the
+   last position each 3-byte sequence was seen at, so compression
+   takes a single pass and no memory beyond the table, and
+   decompression is a simple copy loop. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Shortest and longest match encoded. */
+#define LZ_MIN_MATCH 3
+#define LZ_MAX_MATCH (0x7f + LZ_MIN_MATCH)
+
+/* Entries in the hash table passed to lz_compress(). */
+#define LZ_TABLE_SIZE 4096
+
+size_t lz_compress (const void *src, size_t size, void *dst, size_t cap,
+                    uint16_t table[LZ_TABLE_SIZE]);
+bool lz_decompress (const void *src, size_t size, void *dst,
+                    size_t dst_size);
+
+#endif /* lib/kernel/lz.h */
@@ -0,0 +1,235 @@
+#include "tree.h"
+#include "../debug.h"
+#include "hash.h"
+
+static void split (struct tree *, struct tree_elem *,
+                   const struct tree_elem *key,
+                   struct tree_elem **less, struct tree_elem **rest);
+static struct tree_elem *join (struct tree_elem *, struct tree_elem *);
+
+/* Initializes tree T to be empty, ordered by LESS given auxiliary
+   data AUX. */
+void
+tree_init (struct tree *t, tree_less_func *less, void *aux)
+{
+  ASSERT (t != NULL);
+  ASSERT (less != NULL);
+
+  t->root = NULL;
+  t->size = 0;
+  t->less = less;
+  t->aux = aux;
+}
+
+/* Returns the number of elements in T. */
+size_t
+tree_size (const struct tree *t)
+{
+  return t->size;
+}
+
+/* Returns true if T is empty, false otherwise. */
+bool
+tree_empty (const struct tree *t)
+{
+  return t->root == NULL;
+}
+
+/* Inserts E, which must not be equal to any element of T, into
+   T. */
+void
+tree_insert (struct tree *t, struct tree_elem *e)
+{
+  struct tree_elem **p = &t->root;
+
+  ASSERT (e != NULL);
+
+  /* Walk down to where E outranks the subtree, then split the
+     subtree around E. */
+  e->priority = hash_bytes (&e, sizeof e);
+  while (*p != NULL && (*p)->priority >= e->priority)
+    p = t->less (e, *p, t->aux) ? &(*p)->left : &(*p)->right;
+  split (t, *p, e, &e->left, &e->right);
+  *p = e;
+  t->size++;
+}
+
+/* Removes E, which must be in T, from T. */
+void
+tree_remove (struct tree *t, struct tree_elem *e)
+{
+  struct tree_elem **p = &t->root;
+
+  ASSERT (e != NULL);
+
+  while (*p != e)
+    {
+      ASSERT (*p != NULL);
+      p = t->less (e, *p, t->aux) ? &(*p)->left : &(*p)->right;
+    }
+  *p = join (e->left, e->right);
+  t->size--;
+}
+
+/* Returns the least element of T, or a null pointer if T is
+   empty. */
+struct tree_elem *
+tree_min (const struct tree *t)
+{
+  struct tree_elem *e = t->root;
+
+  if (e != NULL)
+    while (e->left != NULL)
+      e = e->left;
+  return e;
+}
+
+/* Returns the greatest element of T, or a null pointer if T is
+   empty. */
+struct tree_elem *
+tree_max (const struct tree *t)
+{
+  struct tree_elem *e = t->root;
+
+  if (e != NULL)
+    while (e->right != NULL)
+      e = e->right;
+  return e;
+}
+
+/* Returns the element of T equal to KEY, or a null pointer if
+   there is none.  KEY need not be in T. */
+struct tree_elem *
+tree_find (const struct tree *t, const struct tree_elem *key)
+{
+  struct tree_elem *e = tree_ceiling (t, key);
+
+  return e != NULL && !t->less (key, e, t->aux) ? e : NULL;
+}
+
+/* Returns the least element of T that is greater than or equal to
+   KEY, or a null pointer if there is none.  KEY need not be in
+   T. */
+struct tree_elem *
+tree_ceiling (const struct tree *t, const struct tree_elem *key)
+{
+  struct tree_elem *e = t->root;
+  struct tree_elem *found = NULL;
+
+  while (e != NULL)
+    if (t->less (e, key, t->aux))
+      e = e->right;
+    else
+      {
+        found = e;
+        e = e->left;
+      }
+  return found;
+}
+
+/* Returns the greatest element of T that is less than or equal to
+   KEY, or a null pointer if there is none.  KEY need not be in
+   T. */
+struct tree_elem *
+tree_floor (const struct tree *t, const struct tree_elem *key)
+{
+  struct tree_elem *e = t->root;
+  struct tree_elem *found = NULL;
+
+  while (e != NULL)
+    if (t->less (key, e, t->aux))
+      e = e->left;
+    else
+      {
+        found = e;
+        e = e->right;
+      }
+  return found;
+}
+
+/* Returns the least element of T greater than E, or a null
+   pointer if there is none.  E need not be in T. */
+struct tree_elem *
+tree_next (const struct tree *t, const struct tree_elem *e)
+{
+  struct tree_elem *n = t->root;
+  struct tree_elem *found = NULL;
+
+  while (n != NULL)
+    if (t->less (e, n, t->aux))
+      {
+        found = n;
+        n = n->left;
+      }
+    else
+      n = n->right;
+  return found;
+}
+
+/* Returns the greatest element of T less than E, or a null
+   pointer if there is none.  E need not be in T. */
+struct tree_elem *
+tree_prev (const struct tree *t, const struct tree_elem *e)
+{
+  struct tree_elem *n = t->root;
+  struct tree_elem *found = NULL;
+
+  while (n != NULL)
+    if (t->less (n, e, t->aux))
+      {
+        found = n;
+        n = n->right;
+      }
+    else
+      n = n->left;
+  return found;
+}
+
+/* Splits the subtree rooted at E into the subtree of its elements
+   less than KEY, stored in *LESS, and that of the rest, stored in
+   *REST. */
+static void
+split (struct tree *t, struct tree_elem *e, const struct tree_elem *key,
+       struct tree_elem **less, struct tree_elem **rest)
+{
+  while (e != NULL)
+    if (t->less (e, key, t->aux))
+      {
+        *less = e;
+        less = &e->right;
+        e = e->right;
+      }
+    else
+      {
+        *rest = e;
+        rest = &e->left;
+        e = e->left;
+      }
+  *less = *rest = NULL;
+}
+
+/* Joins subtrees A and B, either of which may be null, every
+   element of A being less than every element of B, and returns
+   the root of the result. */
+static struct tree_elem *
+join (struct tree_elem *a, struct tree_elem *b)
+{
+  struct tree_elem *root = NULL;
+  struct tree_elem **p = &root;
+
+  while (a != NULL && b != NULL)
+    if (a->priority > b->priority)
+      {
+        *p = a;
+        p = &a->right;
+        a = a->right;
+      }
+    else
+      {
+        *p = b;
+        p = &b->left;
+        b = b->left;
+      }
+  *p = a != NULL ? a : b;
+  return root;
+}
@@ -0,0 +1,71 @@
+#ifndef __LIB_KERNEL_TREE_H
+#define __LIB_KERNEL_TREE_H
+
+/* Ordered search tree.
+
+   This is a treap: a binary search tree in key order that is also
+   a heap in a priority derived from each element's address, which
+   keeps it balanced with high probability.  Inserting, removing
+   and looking up an element take logarithmic time.  The elements
+   of a tree must be distinct under its comparison function.
+
+   Like lists and hash tables, trees do not use dynamic allocation.
+   Each structure that can potentially be in a tree must embed a
+   struct tree_elem member, and the tree_entry macro converts from
+   a struct tree_elem back to the structure that contains it.  See
+   lib/kernel/list.h for a detailed explanation of the technique. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Tree element. */
+struct tree_elem
+  {
+    struct tree_elem *left;     /* Subtree of lesser elements. */
+    struct tree_elem *right;    /* Subtree of greater elements. */
+    unsigned priority;          /* Heap order, greatest at the root. */
+  };
+
+/* Converts pointer to tree element TREE_ELEM into a pointer to
+   the structure that TREE_ELEM is embedded inside.  Supply the
+   name of the outer structure STRUCT and the member name MEMBER
+   of the tree element. */
+#define tree_entry(TREE_ELEM, STRUCT, MEMBER)           \
+        ((STRUCT *) ((uint8_t *) &(TREE_ELEM)->left     \
+                     - offsetof (STRUCT, MEMBER.left)))
+
+/* Compares the value of two tree elements A and B, given
+   auxiliary data AUX.  Returns true if A is less than B, or false
+   if A is greater than or equal to B. */
+typedef bool tree_less_func (const struct tree_elem *a,
+                             const struct tree_elem *b,
+                             void *aux);
+
+/* Tree. */
+struct tree
+  {
+    struct tree_elem *root;     /* Root, or null if empty. */
+    size_t size;                /* Number of elements. */
+    tree_less_func *less;       /* Comparison function. */
+    void *aux;                  /* Auxiliary data for `less'. */
+  };
+
+void tree_init (struct tree *, tree_less_func *, void *aux);
+size_t tree_size (const struct tree *);
+bool tree_empty (const struct tree *);
+
+void tree_insert (struct tree *, struct tree_elem *);
+void tree_remove (struct tree *, struct tree_elem *);
+
+struct tree_elem *tree_min (const struct tree *);
+struct tree_elem *tree_max (const struct tree *);
+struct tree_elem *tree_find (const struct tree *, const struct tree_elem *key);
+struct tree_elem *tree_ceiling (const struct tree *,
+                                const struct tree_elem *key);
+struct tree_elem *tree_floor (const struct tree *,
+                              const struct tree_elem *key);
+struct tree_elem *tree_next (const struct tree *, const struct tree_elem *);
+struct tree_elem *tree_prev (const struct tree *, const struct tree_elem *);
+
+#endif /* lib/kernel/tree.h */
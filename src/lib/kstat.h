@@ -0,0 +1,22 @@
+#ifndef __LIB_KSTAT_H
+#define __LIB_KSTAT_H
+
+/* Kernel statistics as returned by the kstat system call, shared
+   between the kernel and user programs. */
+
+#include <stdint.h>
+
+/* Maximum characters in the name of a statistic. */
+#define KSTAT_NAME_MAX 31
+
+/* One named kernel statistic. */
+struct kstat
+  {
+    char name[KSTAT_NAME_MAX + 1];      /* Such as "cache.hit". */
+    uint64_t value;                     /* Current value. */
+    uint32_t gauge;                     /* Nonzero if VALUE is a level,
+                                           such as pages in use, zero if
+                                           it is a count of events. */
+  };
+
+#endif /* lib/kstat.h */
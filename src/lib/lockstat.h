@@ -0,0 +1,25 @@
+#ifndef __LIB_LOCKSTAT_H
+#define __LIB_LOCKSTAT_H
+
+/* Lock contention statistics as returned by the lockstat system
+   call, shared between the kernel and user programs. */
+
+#include <stdint.h>
+
+/* Maximum characters in a name or site in a struct lockstat. */
+#define LOCKSTAT_NAME_MAX 31
+
+/* Statistics of one class of locks, that is, of all the locks
+   initialized at one place in the kernel's source. */
+struct lockstat
+  {
+    char name[LOCKSTAT_NAME_MAX + 1];   /* Lock as passed to lock_init(). */
+    char site[LOCKSTAT_NAME_MAX + 1];   /* "file:line" of the lock_init(). */
+    uint64_t acquire_cnt;               /* Times acquired. */
+    uint64_t contended_cnt;             /* Times acquired after waiting. */
+    int64_t wait_ticks;                 /* Total timer ticks waited. */
+    int64_t max_wait_ticks;             /* Longest single wait. */
+    int64_t hold_ticks;                 /* Total timer ticks held. */
+  };
+
+#endif /* lib/lockstat.h */
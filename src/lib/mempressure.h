@@ -0,0 +1,12 @@
+#ifndef __LIB_MEMPRESSURE_H
+#define __LIB_MEMPRESSURE_H
+
+/* Levels of memory pressure that a file descriptor from the
+   mempressure_open system call waits for, shared between the kernel
+   and user programs.  Each includes the ones below it. */
+#define MEMPRESSURE_NONE 0      /* Frames are free for the asking. */
+#define MEMPRESSURE_LOW 1       /* Frames are paged out ahead of demand. */
+#define MEMPRESSURE_MEDIUM 2    /* Page faults wait for evictions. */
+#define MEMPRESSURE_CRITICAL 3  /* They do so fast enough to thrash. */
+
+#endif /* lib/mempressure.h */
@@ -0,0 +1,49 @@
+#ifndef __LIB_MEMSTAT_H
+#define __LIB_MEMSTAT_H
+
+/* Kernel memory allocator statistics as returned by the memstat
+   system call, shared between the kernel and user programs. */
+
+#include <stdint.h>
+
+/* Most malloc() block sizes, and largest order of free block in a
+   page pool. */
+#define MEMSTAT_DESC_MAX 10
+#define MEMSTAT_ORDER_MAX 20
+
+/* Statistics of the kernel's malloc() blocks of one size. */
+struct memstat_desc
+  {
+    uint32_t block_size;        /* Bytes per block, 0 for big blocks. */
+    uint32_t in_use;            /* Bytes in blocks not freed. */
+    uint32_t pages;             /* Pages held in arenas. */
+    uint32_t peak_pages;        /* Most pages held at once. */
+    uint64_t alloc_cnt;         /* Blocks allocated. */
+    uint64_t free_cnt;          /* Blocks freed. */
+  };
+
+/* Statistics of one of the page allocator's pools. */
+struct memstat_pool
+  {
+    uint32_t page_cnt;          /* Pages in the pool. */
+    uint32_t used_cnt;          /* Pages allocated. */
+    uint32_t peak_used_cnt;     /* Most pages allocated at once. */
+    uint32_t zeroed_cnt;        /* Free pages zeroed ahead of time. */
+    uint64_t alloc_cnt;         /* Allocations. */
+    uint64_t zeroed_hit_cnt;    /* Allocations that took a zeroed page. */
+    uint64_t fail_cnt;          /* Allocations that found too few pages. */
+    uint32_t free_blocks[MEMSTAT_ORDER_MAX + 1]; /* Free blocks of
+                                                    2**ORDER pages. */
+  };
+
+/* All of the statistics. */
+struct memstat
+  {
+    uint32_t desc_cnt;          /* Entries in DESCS, the last for
+                                   blocks too big for any size. */
+    struct memstat_desc descs[MEMSTAT_DESC_MAX + 1];
+    struct memstat_pool kernel_pool;
+    struct memstat_pool user_pool;
+  };
+
+#endif /* lib/memstat.h */
@@ -0,0 +1,27 @@
+#ifndef __LIB_POLL_H
+#define __LIB_POLL_H
+
+/* File descriptors for the poll system call to wait on, shared
+   between the kernel and user programs. */
+
+/* Most file descriptors in one poll call. */
+#define POLL_FDS_MAX 512
+
+/* Events, in EVENTS and REVENTS. */
+#define POLLIN 0x001            /* Can read without blocking. */
+#define POLLOUT 0x004           /* Can write without blocking. */
+#define POLLERR 0x008           /* Write end of a pipe with no reader. */
+#define POLLHUP 0x010           /* Read end of a pipe with no writer. */
+#define POLLNVAL 0x020          /* FD is not open. */
+
+/* A file descriptor to wait on.  POLLERR, POLLHUP and POLLNVAL are
+   reported in REVENTS even if not asked for in EVENTS.  A negative
+   FD is skipped, with REVENTS set to 0. */
+struct pollfd
+  {
+    int fd;                     /* File descriptor. */
+    short events;               /* Events to wait for. */
+    short revents;              /* Events that happened. */
+  };
+
+#endif /* lib/poll.h */
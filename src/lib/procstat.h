@@ -0,0 +1,41 @@
+#ifndef __LIB_PROCSTAT_H
+#define __LIB_PROCSTAT_H
+
+/* A process's CPU time and I/O and memory statistics as returned by
+   the procstat system call, shared between the kernel and user
+   programs. */
+
+#include <stdint.h>
+
+/* Whose statistics procstat returns. */
+#define PROCSTAT_SELF 0         /* The calling process. */
+#define PROCSTAT_CHILDREN 1     /* Its children that have exited, and
+                                   theirs, in all. */
+
+/* Kinds of page fault, indexing FAULTS. */
+#define PROCSTAT_FAULT_NEW 0    /* First touch of a page to load. */
+#define PROCSTAT_FAULT_ZERO 1   /* Read of a page of zeros. */
+#define PROCSTAT_FAULT_SWAP 2   /* Page read back from swap. */
+#define PROCSTAT_FAULT_FILE 3   /* Page read from its file. */
+#define PROCSTAT_FAULT_SHM 4    /* Page of shared memory. */
+#define PROCSTAT_FAULT_COW 5    /* Write to a copy-on-write page. */
+#define PROCSTAT_FAULT_STACK 6  /* Growth of the stack. */
+#define PROCSTAT_FAULT_CNT 7
+
+struct procstat
+  {
+    uint64_t user_ns;           /* Nanoseconds run in user mode. */
+    uint64_t kernel_ns;         /* Nanoseconds run in the kernel. */
+    uint64_t read_bytes;        /* Bytes read from files and dirs. */
+    uint64_t write_bytes;       /* Bytes written to them. */
+    uint64_t cache_hits;        /* Buffer cache lookups that hit. */
+    uint64_t cache_misses;      /* And those that missed. */
+    uint64_t faults[PROCSTAT_FAULT_CNT]; /* Page faults, by kind. */
+    uint64_t swap_ins;          /* Pages read in from swap. */
+    uint64_t swap_outs;         /* Pages written out to swap. */
+    uint32_t frames;            /* Frames held now, 0 for children. */
+    uint32_t peak_frames;       /* Most frames held at once, by any one
+                                   process for children. */
+  };
+
+#endif /* lib/procstat.h */
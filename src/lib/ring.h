@@ -0,0 +1,84 @@
+#ifndef __LIB_RING_H
+#define __LIB_RING_H
+
+/* Submission and completion rings for the ring_enter system call,
+   shared between the kernel and user programs.
+
+   A program lays out a struct ring in its own memory, followed by
+   ENTRIES submission queue entries and then ENTRIES completion
+   queue entries; RING_SIZE gives the bytes needed.  It queues
+   operations by filling in the entry at SQ_TAIL and advancing
+   SQ_TAIL, then has the kernel run any number of them in one call
+   to ring_enter().  The kernel consumes entries at SQ_HEAD and
+   posts each result at CQ_TAIL, advancing both, and the program
+   reaps results from CQ_HEAD.  The counters only ever grow: an
+   entry's index is its counter's value modulo ENTRIES, which must
+   be a power of two. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Most entries in each queue of a ring. */
+#define RING_ENTRIES_MAX 256
+
+/* Operations, each like the system call of the same name. */
+enum ring_op
+  {
+    RING_OP_NOP,                /* Does nothing, for a result of 0. */
+    RING_OP_READ,               /* read (FD, BUFFER, SIZE). */
+    RING_OP_WRITE,              /* write (FD, BUFFER, SIZE). */
+    RING_OP_PREAD,              /* pread (FD, BUFFER, SIZE, OFFSET). */
+    RING_OP_PWRITE,             /* pwrite (FD, BUFFER, SIZE, OFFSET). */
+    RING_OP_OPEN,               /* open (BUFFER), a file name. */
+    RING_OP_CLOSE               /* close (FD), 0 or -1 if FD is bad. */
+  };
+
+/* Submission queue entry. */
+struct ring_sqe
+  {
+    uint32_t op;                /* A RING_OP_* constant. */
+    int32_t fd;                 /* File descriptor. */
+    void *buffer;               /* Data, or file name for open. */
+    uint32_t size;              /* Bytes in BUFFER to transfer. */
+    uint32_t offset;            /* File offset for pread and pwrite. */
+    uint32_t user_data;         /* Copied to the completion entry. */
+  };
+
+/* Completion queue entry. */
+struct ring_cqe
+  {
+    uint32_t user_data;         /* From the submission entry. */
+    int32_t result;             /* What the system call would return. */
+  };
+
+/* Head of a ring. */
+struct ring
+  {
+    uint32_t entries;           /* Entries in each queue. */
+    uint32_t sq_head;           /* Next to consume, advanced by kernel. */
+    uint32_t sq_tail;           /* Next to fill, advanced by program. */
+    uint32_t cq_head;           /* Next to reap, advanced by program. */
+    uint32_t cq_tail;           /* Next to post, advanced by kernel. */
+  };
+
+/* Bytes of memory for a ring of ENTRIES entries. */
+#define RING_SIZE(ENTRIES)                                      \
+        (sizeof (struct ring)                                   \
+         + (ENTRIES) * (sizeof (struct ring_sqe)                \
+                        + sizeof (struct ring_cqe)))
+
+/* Returns RING's submission queue entries. */
+static inline struct ring_sqe *
+ring_sqes (struct ring *ring)
+{
+  return (struct ring_sqe *) (ring + 1);
+}
+
+/* Returns RING's completion queue entries. */
+static inline struct ring_cqe *
+ring_cqes (struct ring *ring)
+{
+  return (struct ring_cqe *) (ring_sqes (ring) + ring->entries);
+}
+
+#endif /* lib/ring.h */
@@ -0,0 +1,21 @@
+#ifndef __LIB_RUSAGE_H
+#define __LIB_RUSAGE_H
+
+/* CPU time as returned by the getrusage system call, shared between
+   the kernel and user programs. */
+
+#include <stdint.h>
+
+/* Whose CPU time getrusage returns. */
+#define RUSAGE_SELF 0           /* The calling process, all threads. */
+#define RUSAGE_CHILDREN 1       /* Its children that have exited, and
+                                   theirs, in all. */
+#define RUSAGE_THREAD 2         /* The calling thread alone. */
+
+struct rusage
+  {
+    uint64_t user_ns;           /* Nanoseconds run in user mode. */
+    uint64_t kernel_ns;         /* Nanoseconds run in the kernel. */
+  };
+
+#endif /* lib/rusage.h */
@@ -0,0 +1,34 @@
+#ifndef __LIB_SPAWN_H
+#define __LIB_SPAWN_H
+
+/* Setting up a new process's file descriptors and working directory
+   with the spawn system call, shared between the kernel and user
+   programs. */
+
+/* Most actions in one spawn call. */
+#define SPAWN_ACTIONS_MAX 32
+
+/* Flags to spawn. */
+#define SPAWN_NOWAIT 0x1        /* Return before the program loads. */
+
+/* Kinds of action, in TYPE. */
+#define SPAWN_DUP 1             /* Make FD a copy of the caller's SRC_FD. */
+#define SPAWN_CLOSE 2           /* Close FD. */
+#define SPAWN_OPEN 3            /* Open PATH as FD, with openat FLAGS. */
+#define SPAWN_CHDIR 4           /* Change directory to PATH. */
+
+/* One step in setting up a new process, which otherwise starts with
+   no file descriptors beyond the console and in the caller's working
+   directory.  Actions run in order, so a relative PATH is relative
+   to any SPAWN_CHDIR before it, and FD may be any descriptor from 3
+   up, whatever the caller has open there. */
+struct spawn_action
+  {
+    int type;                   /* SPAWN_DUP, SPAWN_CLOSE, etc. */
+    int fd;                     /* Descriptor in the new process. */
+    int src_fd;                 /* SPAWN_DUP: caller's descriptor. */
+    int flags;                  /* SPAWN_OPEN: as for openat. */
+    const char *path;           /* SPAWN_OPEN, SPAWN_CHDIR: path. */
+  };
+
+#endif /* lib/spawn.h */
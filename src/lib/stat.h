@@ -0,0 +1,18 @@
+#ifndef __LIB_STAT_H
+#define __LIB_STAT_H
+
+/* File metadata as returned by the stat and fstat system calls, shared
+   between the kernel and user programs. */
+
+#include <stdbool.h>
+
+/* Metadata of a file or directory. */
+struct stat
+  {
+    int inumber;                /* Inode number. */
+    bool isdir;                 /* Whether it is a directory. */
+    unsigned length;            /* Length in bytes. */
+    unsigned open_cnt;          /* Openers, not counting stat itself. */
+  };
+
+#endif /* lib/stat.h */
@@ -28,7 +28,55 @@ enum
     SYS_MKDIR,                  /* Create a directory. */
     SYS_READDIR,                /* Reads a directory entry. */
     SYS_ISDIR,                  /* Tests if a fd represents a directory. */
-    SYS_INUMBER                 /* Returns the inode number for a fd. */
+    SYS_INUMBER,                /* Returns the inode number for a fd. */
+    SYS_GETDENTS,               /* Reads many directory entries. */
+    SYS_FSYNC,                  /* Writes a fd's dirty sectors to disk. */
+    SYS_FORK,                   /* Clones the current process. */
+    SYS_MSYNC,                  /* Writes a mapping back to its file. */
+    SYS_MADVISE,                /* Tells how a mapping will be used. */
+    SYS_SBRK,                   /* Moves the end of the heap. */
+    SYS_LOCKSTAT,               /* Reads lock contention statistics. */
+    SYS_MEMSTAT,                /* Reads kernel memory statistics. */
+    SYS_PREAD,                  /* Reads from a file at an offset. */
+    SYS_PWRITE,                 /* Writes to a file at an offset. */
+    SYS_READV,                  /* Reads from a file into many buffers. */
+    SYS_WRITEV,                 /* Writes many buffers to a file. */
+    SYS_COPY_FILE_RANGE,        /* Copies between files in the kernel. */
+    SYS_RING_ENTER,             /* Runs operations queued in a ring. */
+    SYS_PIPE,                   /* Creates a pipe. */
+    SYS_SHM_CREATE,             /* Creates a shared memory segment. */
+    SYS_FUTEX_WAIT,             /* Sleeps on a word of memory. */
+    SYS_FUTEX_WAKE,             /* Wakes threads sleeping on a word. */
+    SYS_THREAD_CREATE,          /* Starts a thread in the process. */
+    SYS_THREAD_EXIT,            /* Ends the current thread. */
+    SYS_THREAD_JOIN,            /* Waits for a thread to end. */
+    SYS_POLL,                   /* Waits for file descriptors. */
+    SYS_TRACE_READ,             /* Reads kernel trace events. */
+    SYS_SYSCALLSTAT,            /* Reads system call statistics. */
+    SYS_KSTAT,                  /* Reads kernel statistics. */
+    SYS_FTRUNCATE,              /* Sets the length of a file. */
+    SYS_FALLOCATE,              /* Reserves disk space for a file. */
+    SYS_RENAME,                 /* Moves a file or directory. */
+    SYS_STAT,                   /* Reads a path's metadata. */
+    SYS_FSTAT,                  /* Reads an open file's metadata. */
+    SYS_OPENAT,                 /* Opens a file relative to a dir. */
+    SYS_CREATEAT,               /* Creates a file relative to a dir. */
+    SYS_REMOVEAT,               /* Deletes a file relative to a dir. */
+    SYS_MKDIRAT,                /* Creates a dir relative to a dir. */
+    SYS_DEFRAG,                 /* Makes a file's sectors contiguous. */
+    SYS_CACHESTAT,              /* Reads buffer cache statistics. */
+    SYS_SCHED_DEADLINE,         /* Reserves CPU time each period. */
+    SYS_GETPRIORITY,            /* Reads the thread's priority. */
+    SYS_SETPRIORITY,            /* Lowers the thread's priority. */
+    SYS_GETNICE,                /* Reads the thread's nice value. */
+    SYS_SETNICE,                /* Raises the thread's nice value. */
+    SYS_SPAWN,                  /* Starts a process with set-up fds. */
+    SYS_WAITPID,                /* Waits for one child or any. */
+    SYS_PROCSTAT,               /* Reads I/O and memory statistics. */
+    SYS_MEMPRESSURE_OPEN,       /* Opens a memory pressure watch. */
+    SYS_CLONE,                  /* Copies a file, sharing its data. */
+    SYS_MMAP_RANGE,             /* Map part of a file into memory. */
+    SYS_GETRUSAGE               /* Reads CPU time used. */
   };
 
 #endif /* lib/syscall-nr.h */
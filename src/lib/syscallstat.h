@@ -0,0 +1,28 @@
+#ifndef __LIB_SYSCALLSTAT_H
+#define __LIB_SYSCALLSTAT_H
+
+/* System call statistics as returned by the syscallstat system
+   call, shared between the kernel and user programs. */
+
+#include <stdint.h>
+
+/* Buckets in a latency histogram.  Bucket I counts the calls that
+   took from 2**I up to 2**(I+1) time stamp counter cycles, except
+   that bucket 0 also counts calls under a cycle and the last bucket
+   all calls longer than it starts at. */
+#define SYSCALLSTAT_BUCKETS 32
+
+/* Statistics of one system call number.  Latencies are measured in
+   time stamp counter cycles, from entering the handler to leaving
+   it, and so include any time spent blocked. */
+struct syscallstat
+  {
+    uint64_t call_cnt;          /* Calls made. */
+    uint64_t return_cnt;        /* Calls that returned, which are
+                                   the only ones timed. */
+    uint64_t cycles;            /* Total cycles of calls that returned. */
+    uint64_t max_cycles;        /* Longest single call. */
+    uint32_t buckets[SYSCALLSTAT_BUCKETS]; /* Latency histogram. */
+  };
+
+#endif /* lib/syscallstat.h */
@@ -0,0 +1,38 @@
+#ifndef __LIB_TRACE_H
+#define __LIB_TRACE_H
+
+/* Kernel trace events as returned by the trace_read system call,
+   shared between the kernel and user programs. */
+
+#include <stdint.h>
+
+/* Places in the kernel that record events, and what their two
+   arguments are. */
+enum trace_event
+  {
+    TRACE_SWITCH,               /* Context switch: tid out, tid in. */
+    TRACE_FAULT,                /* Page fault: address, 1 if a write. */
+    TRACE_EVICT,                /* Frame evicted: kernel address, 1 if
+                                   shared. */
+    TRACE_CACHE_HIT,            /* Buffer cache hit: sector, 1 if
+                                   metadata. */
+    TRACE_CACHE_MISS,           /* Buffer cache miss: sector, 1 if
+                                   metadata. */
+    TRACE_BLOCK_READ,           /* Disk read: sector, sector count. */
+    TRACE_BLOCK_WRITE,          /* Disk write: sector, sector count. */
+    TRACE_SYSCALL_ENTER,        /* System call entry: number, 0. */
+    TRACE_SYSCALL_EXIT,         /* System call exit: number, result. */
+    TRACE_EVENT_CNT
+  };
+
+/* One recorded event. */
+struct trace_record
+  {
+    uint64_t tsc;               /* Time stamp counter when recorded. */
+    uint16_t event;             /* A TRACE_* constant. */
+    uint16_t cpu;               /* CPU it happened on. */
+    int32_t tid;                /* Thread running then. */
+    uint32_t arg0, arg1;        /* Event-specific arguments. */
+  };
+
+#endif /* lib/trace.h */
@@ -0,0 +1,19 @@
+#ifndef __LIB_UIO_H
+#define __LIB_UIO_H
+
+/* Buffers for the readv and writev system calls, shared between
+   the kernel and user programs. */
+
+#include <stddef.h>
+
+/* Most buffers in one readv or writev call. */
+#define IOV_MAX 64
+
+/* A buffer to read into or write from. */
+struct iovec
+  {
+    void *iov_base;             /* Start of the buffer. */
+    size_t iov_len;             /* Its length in bytes. */
+  };
+
+#endif /* lib/uio.h */
@@ -1,14 +1,243 @@
 #include <stdio.h>
+#include <malloc.h>
 #include <string.h>
+#include <synch.h>
 #include <syscall.h>
 #include <syscall-nr.h>
 
+/* Buffered output.
+
+   Output to a FILE is gathered in its buffer and written with one
+   system call when the buffer fills, when the FILE is flushed, and,
+   for a FILE on the console such as stdout, at the end of every
+   line.  exit() flushes every FILE, so buffered output is lost only
+   if the process is killed. */
+
+/* Bytes buffered by a FILE. */
+#define FILE_BUF_SIZE 1024
+
+struct FILE
+  {
+    int handle;                 /* File handle written to. */
+    bool line_buffered;         /* Flush after every new-line? */
+    bool error;                 /* A write failed. */
+    size_t cnt;                 /* Bytes in BUF not written yet. */
+    struct lock lock;           /* Guards the members above and BUF. */
+    struct FILE *next;          /* Next in OPEN_FILES. */
+    char buf[FILE_BUF_SIZE];
+  };
+
+static FILE stdout_file =
+  { STDOUT_FILENO, true, false, 0, LOCK_INITIALIZER, NULL, { 0 } };
+FILE *stdout = &stdout_file;
+
+/* FILEs fflush (NULL) flushes, guarded by OPEN_FILES_LOCK. */
+static FILE *open_files = &stdout_file;
+static struct lock open_files_lock = LOCK_INITIALIZER;
+
+/* Auxiliary data for file_add_char(). */
+struct vfprintf_aux
+  {
+    FILE *f;            /* Output file. */
+    int char_cnt;       /* Total characters written so far. */
+  };
+
+static bool file_flush (FILE *);
+static void file_put (FILE *, const char *, size_t);
+static void file_add_char (char, void *);
+
+/* Returns a new FILE that writes to HANDLE, buffered a line at a
+   time if HANDLE is the console and a buffer at a time otherwise,
+   or a null pointer if memory is not available. */
+FILE *
+fdopen (int handle)
+{
+  FILE *f = malloc (sizeof *f);
+
+  if (f == NULL)
+    return NULL;
+  f->handle = handle;
+  f->line_buffered = handle == STDOUT_FILENO;
+  f->error = false;
+  f->cnt = 0;
+  lock_init (&f->lock);
+
+  lock_acquire (&open_files_lock);
+  f->next = open_files;
+  open_files = f;
+  lock_release (&open_files_lock);
+  return f;
+}
+
+/* Flushes F, closes its handle, and frees it.  Returns 0 if
+   successful, EOF if a write has failed. */
+int
+fclose (FILE *f)
+{
+  FILE **p;
+  bool ok;
+
+  lock_acquire (&open_files_lock);
+  for (p = &open_files; *p != f; p = &(*p)->next)
+    continue;
+  *p = f->next;
+  lock_release (&open_files_lock);
+
+  ok = fflush (f) == 0;
+  if (f != stdout)
+    {
+      close (f->handle);
+      free (f);
+    }
+  return ok ? 0 : EOF;
+}
+
+/* Writes out what is buffered in F, or in every FILE if F is a null
+   pointer.  Returns 0 if successful, EOF if a write has failed. */
+int
+fflush (FILE *f)
+{
+  bool ok = true;
+
+  if (f == NULL)
+    {
+      lock_acquire (&open_files_lock);
+      for (f = open_files; f != NULL; f = f->next)
+        ok = fflush (f) == 0 && ok;
+      lock_release (&open_files_lock);
+    }
+  else
+    {
+      lock_acquire (&f->lock);
+      ok = file_flush (f);
+      lock_release (&f->lock);
+    }
+  return ok ? 0 : EOF;
+}
+
+/* Writes C to F.  Returns C, or EOF if a write has failed. */
+int
+fputc (int c, FILE *f)
+{
+  char c2 = c;
+  bool error;
+
+  lock_acquire (&f->lock);
+  file_put (f, &c2, 1);
+  error = f->error;
+  lock_release (&f->lock);
+  return error ? EOF : (unsigned char) c2;
+}
+
+/* Writes string S to F.  Returns 0, or EOF if a write has failed. */
+int
+fputs (const char *s, FILE *f)
+{
+  return fwrite (s, 1, strlen (s), f) == strlen (s) ? 0 : EOF;
+}
+
+/* Writes CNT objects of SIZE bytes each from BUFFER to F.  Returns
+   CNT, or 0 if a write has failed. */
+size_t
+fwrite (const void *buffer, size_t size, size_t cnt, FILE *f)
+{
+  bool error;
+
+  lock_acquire (&f->lock);
+  file_put (f, buffer, size * cnt);
+  error = f->error;
+  lock_release (&f->lock);
+  return error ? 0 : cnt;
+}
+
+/* Like printf(), but writes output to F. */
+int
+fprintf (FILE *f, const char *format, ...)
+{
+  va_list args;
+  int retval;
+
+  va_start (args, format);
+  retval = vfprintf (f, format, args);
+  va_end (args);
+
+  return retval;
+}
+
+/* Like vprintf(), but writes output to F.  Returns the number of
+   characters written, or EOF if a write has failed. */
+int
+vfprintf (FILE *f, const char *format, va_list args)
+{
+  struct vfprintf_aux aux;
+  bool error;
+
+  aux.f = f;
+  aux.char_cnt = 0;
+  lock_acquire (&f->lock);
+  __vprintf (format, args, file_add_char, &aux);
+  error = f->error;
+  lock_release (&f->lock);
+  return error ? EOF : aux.char_cnt;
+}
+
+/* Writes out the buffer of F, whose lock the caller holds.  Returns
+   false if a write has failed. */
+static bool
+file_flush (FILE *f)
+{
+  if (f->cnt > 0 && !f->error)
+    f->error = write (f->handle, f->buf, f->cnt) != (int) f->cnt;
+  f->cnt = 0;
+  return !f->error;
+}
+
+/* Adds the N bytes in BUFFER to F, whose lock the caller holds,
+   writing out the buffer as it fills and, if F is line buffered,
+   after the last new-line. */
+static void
+file_put (FILE *f, const char *buffer, size_t n)
+{
+  bool new_line = false;
+
+  while (n > 0)
+    {
+      size_t chunk = sizeof f->buf - f->cnt;
+
+      if (chunk > n)
+        chunk = n;
+      memcpy (f->buf + f->cnt, buffer, chunk);
+      if (f->line_buffered && memchr (buffer, '\n', chunk) != NULL)
+        new_line = true;
+      f->cnt += chunk;
+      buffer += chunk;
+      n -= chunk;
+      if (f->cnt == sizeof f->buf)
+        {
+          file_flush (f);
+          new_line = false;
+        }
+    }
+  if (new_line)
+    file_flush (f);
+}
+
+/* Adds C to the FILE in AUX, for vfprintf(). */
+static void
+file_add_char (char c, void *aux_)
+{
+  struct vfprintf_aux *aux = aux_;
+
+  file_put (aux->f, &c, 1);
+  aux->char_cnt++;
+}
+
 /* The standard vprintf() function,
    which is like printf() but uses a va_list. */
 int
 vprintf (const char *format, va_list args) 
 {
-  return vhprintf (STDOUT_FILENO, format, args);
+  return vfprintf (stdout, format, args);
 }
 
 /* Like printf(), but writes output to the given HANDLE. */
@@ -30,19 +259,22 @@ hprintf (int handle, const char *format, ...)
 int
 puts (const char *s) 
 {
-  write (STDOUT_FILENO, s, strlen (s));
-  putchar ('\n');
+  bool error;
 
-  return 0;
+  lock_acquire (&stdout->lock);
+  file_put (stdout, s, strlen (s));
+  file_put (stdout, "\n", 1);
+  error = stdout->error;
+  lock_release (&stdout->lock);
+
+  return error ? EOF : 0;
 }
 
 /* Writes C to the console. */
 int
 putchar (int c) 
 {
-  char c2 = c;
-  write (STDOUT_FILENO, &c2, 1);
-  return c;
+  return fputc (c, stdout);
 }
 
 /* Auxiliary data for vhprintf_helper(). */
@@ -0,0 +1,458 @@
+#include <malloc.h>
+#include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include <string.h>
+#include <synch.h>
+#include <syscall.h>
+
+/* A malloc() for user programs, on top of the heap that sbrk()
+   grows.
+
+   As in the kernel's, the size of each small request is rounded
+   up to a power of 2 and assigned to the "descriptor" that
+   manages blocks of that size.  A descriptor carves its blocks
+   out of one-page "arenas".  Each arena keeps its own list of the
+   free blocks in it, and the descriptor a list of the arenas that
+   have any, so an arena is easy to take back once all of its
+   blocks are free again.
+
+   Requests too big for a descriptor get an arena of as many
+   whole pages as they need.  The heap pages in no arena are kept
+   as "spans" on a list sorted by address, where neighboring spans
+   are merged as they are freed and arenas are cut from the first
+   span big enough.  A free span at the top of the heap is given
+   back to the kernel with sbrk() once it is big enough.
+
+   A single lock guards all of it, for programs with threads. */
+
+/* Size of a page of the heap. */
+#define PGSIZE 4096
+
+/* Least number of pages the heap grows by. */
+#define GROW_PAGES 4
+
+/* Free span length, in pages, at which the top of the heap is
+   given back. */
+#define TRIM_PAGES 16
+
+struct arena;
+
+/* Descriptor. */
+struct desc
+  {
+    size_t block_size;          /* Size of each element in bytes. */
+    size_t blocks_per_arena;    /* Number of blocks in an arena. */
+    struct arena *arenas;       /* Arenas with free blocks. */
+  };
+
+/* Magic number for detecting arena corruption. */
+#define ARENA_MAGIC 0x9a548eed
+
+/* Arena. */
+struct arena
+  {
+    unsigned magic;             /* Always set to ARENA_MAGIC. */
+    struct desc *desc;          /* Owning descriptor, null for big block. */
+    size_t free_cnt;            /* Free blocks; pages in big block. */
+    size_t carved_cnt;          /* Blocks ever handed out. */
+    struct block *free_list;    /* Free blocks among those. */
+    struct arena *prev, *next;  /* In the descriptor's arenas. */
+  };
+
+/* Free block. */
+struct block
+  {
+    struct block *next;         /* Next free block in its arena. */
+  };
+
+/* Free span of heap pages. */
+struct span
+  {
+    size_t page_cnt;            /* Number of pages. */
+    struct span *next;          /* Next free span, at a higher address. */
+  };
+
+/* Our set of descriptors. */
+static struct desc descs[10];   /* Descriptors. */
+static size_t desc_cnt;         /* Number of descriptors. */
+
+/* Free spans, sorted by address. */
+static struct span *spans;
+
+/* Guards the descriptors and the spans. */
+static struct lock malloc_lock = LOCK_INITIALIZER;
+
+static void malloc_init (void);
+static void *do_malloc (size_t size);
+static void do_free (void *);
+static struct arena *block_to_arena (struct block *);
+static void arena_push (struct desc *, struct arena *);
+static void arena_remove (struct desc *, struct arena *);
+static void *get_pages (size_t page_cnt);
+static void put_pages (void *, size_t page_cnt);
+static bool grow (size_t page_cnt);
+static void trim (void);
+
+/* Initializes the malloc() descriptors. */
+static void
+malloc_init (void)
+{
+  size_t block_size;
+
+  for (block_size = 16; block_size < PGSIZE / 2; block_size *= 2)
+    {
+      struct desc *d = &descs[desc_cnt++];
+      ASSERT (desc_cnt <= sizeof descs / sizeof *descs);
+      d->block_size = block_size;
+      d->blocks_per_arena = (PGSIZE - sizeof (struct arena)) / block_size;
+      d->arenas = NULL;
+    }
+}
+
+/* Obtains and returns a new block of at least SIZE bytes.
+   Returns a null pointer if memory is not available. */
+void *
+malloc (size_t size)
+{
+  void *p;
+
+  lock_acquire (&malloc_lock);
+  p = do_malloc (size);
+  lock_release (&malloc_lock);
+  return p;
+}
+
+/* Does malloc() with malloc_lock held. */
+static void *
+do_malloc (size_t size)
+{
+  struct desc *d;
+  struct block *b;
+  struct arena *a;
+
+  /* A null pointer satisfies a request for 0 bytes. */
+  if (size == 0)
+    return NULL;
+  if (desc_cnt == 0)
+    malloc_init ();
+
+  /* Find the smallest descriptor that satisfies a SIZE-byte
+     request. */
+  for (d = descs; d < descs + desc_cnt; d++)
+    if (d->block_size >= size)
+      break;
+  if (d == descs + desc_cnt)
+    {
+      /* SIZE is too big for any descriptor.
+         Allocate enough pages to hold SIZE plus an arena. */
+      size_t page_cnt;
+
+      if (size > SIZE_MAX - PGSIZE)
+        return NULL;
+      page_cnt = DIV_ROUND_UP (size + sizeof *a, PGSIZE);
+      a = get_pages (page_cnt);
+      if (a == NULL)
+        return NULL;
+
+      /* Initialize the arena to indicate a big block of PAGE_CNT
+         pages, and return it. */
+      a->magic = ARENA_MAGIC;
+      a->desc = NULL;
+      a->free_cnt = page_cnt;
+      return a + 1;
+    }
+
+  /* If no arena has a free block, create a new arena. */
+  a = d->arenas;
+  if (a == NULL)
+    {
+      a = get_pages (1);
+      if (a == NULL)
+        return NULL;
+      a->magic = ARENA_MAGIC;
+      a->desc = d;
+      a->free_cnt = d->blocks_per_arena;
+      a->carved_cnt = 0;
+      a->free_list = NULL;
+      arena_push (d, a);
+    }
+
+  /* Reuse a freed block, or else carve out the next one, so the
+     pages of a new arena are only touched as they are used. */
+  if (a->free_list != NULL)
+    {
+      b = a->free_list;
+      a->free_list = b->next;
+    }
+  else
+    b = (struct block *) ((uint8_t *) a + sizeof *a
+                          + a->carved_cnt++ * d->block_size);
+  if (--a->free_cnt == 0)
+    arena_remove (d, a);
+  return b;
+}
+
+/* Allocates and return A times B bytes initialized to zeroes.
+   Returns a null pointer if memory is not available. */
+void *
+calloc (size_t a, size_t b)
+{
+  void *p;
+  size_t size;
+
+  /* Calculate block size and make sure it fits in size_t. */
+  if (b != 0 && a > SIZE_MAX / b)
+    return NULL;
+  size = a * b;
+
+  /* Allocate and zero memory. */
+  p = malloc (size);
+  if (p != NULL)
+    memset (p, 0, size);
+
+  return p;
+}
+
+/* Returns the number of bytes allocated for BLOCK. */
+static size_t
+block_size (void *block)
+{
+  struct block *b = block;
+  struct arena *a = block_to_arena (b);
+  struct desc *d = a->desc;
+
+  return d != NULL ? d->block_size : PGSIZE * a->free_cnt - sizeof *a;
+}
+
+/* Attempts to resize OLD_BLOCK to NEW_SIZE bytes, possibly
+   moving it in the process.
+   If successful, returns the new block; on failure, returns a
+   null pointer.
+   A call with null OLD_BLOCK is equivalent to malloc(NEW_SIZE).
+   A call with zero NEW_SIZE is equivalent to free(OLD_BLOCK). */
+void *
+realloc (void *old_block, size_t new_size)
+{
+  if (new_size == 0)
+    {
+      free (old_block);
+      return NULL;
+    }
+  else
+    {
+      void *new_block;
+      size_t old_size = old_block != NULL ? block_size (old_block) : 0;
+
+      /* Stay put if the block still fits without wasting half of it. */
+      if (new_size <= old_size && new_size > old_size / 2)
+        return old_block;
+      new_block = malloc (new_size);
+      if (old_block != NULL && new_block != NULL)
+        {
+          size_t min_size = new_size < old_size ? new_size : old_size;
+          memcpy (new_block, old_block, min_size);
+          free (old_block);
+        }
+      return new_block;
+    }
+}
+
+/* Frees block P, which must have been previously allocated with
+   malloc(), calloc(), or realloc(). */
+void
+free (void *p)
+{
+  lock_acquire (&malloc_lock);
+  do_free (p);
+  lock_release (&malloc_lock);
+}
+
+/* Does free() with malloc_lock held. */
+static void
+do_free (void *p)
+{
+  struct block *b = p;
+  struct arena *a;
+  struct desc *d;
+
+  if (p == NULL)
+    return;
+  a = block_to_arena (b);
+  d = a->desc;
+  if (d == NULL)
+    {
+      /* It's a big block.  Free its pages. */
+      put_pages (a, a->free_cnt);
+      trim ();
+      return;
+    }
+
+#if DEBUG_SLOW
+  /* Clear the block to help detect use-after-free bugs. */
+  memset (b, 0xcc, d->block_size);
+#endif
+
+  /* Add block to its arena's free list. */
+  b->next = a->free_list;
+  a->free_list = b;
+  if (a->free_cnt++ == 0)
+    arena_push (d, a);
+
+  /* If the arena is now entirely unused, free it. */
+  if (a->free_cnt >= d->blocks_per_arena)
+    {
+      ASSERT (a->free_cnt == d->blocks_per_arena);
+      arena_remove (d, a);
+      put_pages (a, 1);
+      trim ();
+    }
+}
+
+/* Returns the arena that block B is inside. */
+static struct arena *
+block_to_arena (struct block *b)
+{
+  struct arena *a = (struct arena *) ((uintptr_t) b & ~(PGSIZE - 1));
+  size_t ofs = (uintptr_t) b & (PGSIZE - 1);
+
+  /* Check that the arena is valid. */
+  ASSERT (a != NULL);
+  ASSERT (a->magic == ARENA_MAGIC);
+
+  /* Check that the block is properly aligned for the arena. */
+  ASSERT (a->desc == NULL
+          || (ofs - sizeof *a) % a->desc->block_size == 0);
+  ASSERT (a->desc != NULL || ofs == sizeof *a);
+
+  return a;
+}
+
+/* Adds A to the front of D's arenas with free blocks. */
+static void
+arena_push (struct desc *d, struct arena *a)
+{
+  a->prev = NULL;
+  a->next = d->arenas;
+  if (d->arenas != NULL)
+    d->arenas->prev = a;
+  d->arenas = a;
+}
+
+/* Removes A from D's arenas with free blocks. */
+static void
+arena_remove (struct desc *d, struct arena *a)
+{
+  if (a->prev != NULL)
+    a->prev->next = a->next;
+  else
+    d->arenas = a->next;
+  if (a->next != NULL)
+    a->next->prev = a->prev;
+}
+
+/* Returns the address just past span S. */
+static uint8_t *
+span_end (struct span *s)
+{
+  return (uint8_t *) s + s->page_cnt * PGSIZE;
+}
+
+/* Returns PAGE_CNT contiguous free heap pages, cut from the first
+   free span long enough, growing the heap if there is none.
+   Returns a null pointer if the heap can't grow. */
+static void *
+get_pages (size_t page_cnt)
+{
+  for (;;)
+    {
+      struct span **sp, *s;
+
+      for (sp = &spans; (s = *sp) != NULL; sp = &s->next)
+        if (s->page_cnt >= page_cnt)
+          {
+            if (s->page_cnt > page_cnt)
+              {
+                struct span *rest = (struct span *) ((uint8_t *) s
+                                                     + page_cnt * PGSIZE);
+                rest->page_cnt = s->page_cnt - page_cnt;
+                rest->next = s->next;
+                *sp = rest;
+              }
+            else
+              *sp = s->next;
+            return s;
+          }
+      if (!grow (page_cnt))
+        return NULL;
+    }
+}
+
+/* Adds the PAGE_CNT pages at PAGES to the free spans, merging them
+   with the spans right before and after them. */
+static void
+put_pages (void *pages, size_t page_cnt)
+{
+  struct span *s = pages;
+  struct span *prev = NULL, *next = spans;
+
+  while (next != NULL && next < s)
+    {
+      prev = next;
+      next = next->next;
+    }
+  s->page_cnt = page_cnt;
+  s->next = next;
+  if (next != NULL && span_end (s) == (uint8_t *) next)
+    {
+      s->page_cnt += next->page_cnt;
+      s->next = next->next;
+    }
+  if (prev == NULL)
+    spans = s;
+  else if (span_end (prev) == (uint8_t *) s)
+    {
+      prev->page_cnt += s->page_cnt;
+      prev->next = s->next;
+    }
+  else
+    prev->next = s;
+}
+
+/* Grows the heap by at least PAGE_CNT pages, adding them to the free
+   spans. The first growth also aligns the heap to a page boundary.
+   Returns false if the kernel refuses. */
+static bool
+grow (size_t page_cnt)
+{
+  uintptr_t brk = (uintptr_t) sbrk (0);
+  uintptr_t start = ROUND_UP (brk, PGSIZE);
+
+  if (page_cnt < GROW_PAGES)
+    page_cnt = GROW_PAGES;
+  if (page_cnt > (INTPTR_MAX - (start - brk)) / PGSIZE
+      || sbrk (start - brk + page_cnt * PGSIZE) == SBRK_FAILED)
+    return false;
+  put_pages ((void *) start, page_cnt);
+  return true;
+}
+
+/* Gives the free span at the top of the heap back to the kernel, if
+   there is one at least TRIM_PAGES long. */
+static void
+trim (void)
+{
+  struct span **sp, *s;
+  size_t page_cnt;
+
+  if (spans == NULL)
+    return;
+  for (sp = &spans; (*sp)->next != NULL; sp = &(*sp)->next)
+    continue;
+  s = *sp;
+  if (s->page_cnt < TRIM_PAGES || span_end (s) != (uint8_t *) sbrk (0))
+    return;
+  page_cnt = s->page_cnt;
+  *sp = NULL;
+  sbrk (-(intptr_t) (page_cnt * PGSIZE));
+}
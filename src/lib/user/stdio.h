@@ -4,4 +4,23 @@
 int hprintf (int, const char *, ...) PRINTF_FORMAT (2, 3);
 int vhprintf (int, const char *, va_list) PRINTF_FORMAT (2, 0);
 
+/* Buffered output stream on a file handle. */
+typedef struct FILE FILE;
+
+/* Returned by the stream functions on error. */
+#define EOF (-1)
+
+/* The console, buffered a line at a time.  printf(), putchar() and
+   puts() write to it. */
+extern FILE *stdout;
+
+FILE *fdopen (int handle);
+int fclose (FILE *);
+int fflush (FILE *);
+int fputc (int, FILE *);
+int fputs (const char *, FILE *);
+size_t fwrite (const void *, size_t size, size_t cnt, FILE *);
+int fprintf (FILE *, const char *, ...) PRINTF_FORMAT (2, 3);
+int vfprintf (FILE *, const char *, va_list) PRINTF_FORMAT (2, 0);
+
 #endif /* lib/user/stdio.h */
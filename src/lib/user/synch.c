@@ -0,0 +1,128 @@
+#include <synch.h>
+#include <limits.h>
+#include <syscall.h>
+
+/* Locks and condition variables for user programs, on top of the
+   futex_wait() and futex_wake() system calls.
+
+   Their state is a word of the program's own memory changed with
+   atomic instructions, so taking a free lock, releasing one nobody
+   waits for, and signaling a condition nobody waits on never enter
+   the kernel.  Only waiting does, and waking up a waiter.
+
+   A lock is 0 when free, 1 when held, and 2 when held and some
+   thread may be sleeping on it.  A thread that finds it held sets it
+   to 2 before it sleeps, and releasing a lock that was 2 wakes one
+   sleeper, which takes it as 2 again since it can't tell whether any
+   others are left.  A condition is a count of signals, which a
+   waiter reads before releasing its lock and sleeps on only if no
+   signal came in between. */
+
+/* Atomically sets *P to NEW if it is OLD, and returns the value *P
+   had. */
+static inline int
+compare_and_swap (volatile int *p, int old, int new)
+{
+  int prev;
+
+  asm volatile ("lock cmpxchgl %2, %1"
+                : "=a" (prev), "+m" (*p)
+                : "r" (new), "0" (old)
+                : "memory");
+  return prev;
+}
+
+/* Atomically sets *P to NEW and returns the value it had. */
+static inline int
+exchange (volatile int *p, int new)
+{
+  asm volatile ("xchgl %0, %1" : "+r" (new), "+m" (*p) : : "memory");
+  return new;
+}
+
+/* Atomically adds 1 to *P. */
+static inline void
+increment (volatile int *p)
+{
+  asm volatile ("lock incl %0" : "+m" (*p) : : "memory");
+}
+
+/* Initializes LOCK as free. */
+void
+lock_init (struct lock *lock)
+{
+  lock->state = 0;
+}
+
+/* Acquires LOCK, sleeping until it is free if necessary. */
+void
+lock_acquire (struct lock *lock)
+{
+  int state = compare_and_swap (&lock->state, 0, 1);
+
+  if (state == 0)
+    return;
+  if (state != 2)
+    state = exchange (&lock->state, 2);
+  while (state != 0)
+    {
+      futex_wait (&lock->state, 2);
+      state = exchange (&lock->state, 2);
+    }
+}
+
+/* Acquires LOCK if it is free and returns true, or returns false
+   without waiting. */
+bool
+lock_try_acquire (struct lock *lock)
+{
+  return compare_and_swap (&lock->state, 0, 1) == 0;
+}
+
+/* Releases LOCK, which the caller must hold, waking up a thread
+   waiting for it if there may be one. */
+void
+lock_release (struct lock *lock)
+{
+  if (exchange (&lock->state, 0) == 2)
+    futex_wake (&lock->state, 1);
+}
+
+/* Initializes COND, which has no waiters. */
+void
+cond_init (struct condition *cond)
+{
+  cond->seq = 0;
+}
+
+/* Atomically releases LOCK, which the caller must hold, and waits
+   for COND to be signaled, then reacquires LOCK before returning.
+   As with any condition variable, the waited-for condition must be
+   checked again once this returns. */
+void
+cond_wait (struct condition *cond, struct lock *lock)
+{
+  int seq = *(volatile int *) &cond->seq;
+
+  lock_release (lock);
+  futex_wait (&cond->seq, seq);
+  /* Others woken with us may be waiting for LOCK too. */
+  while (exchange (&lock->state, 2) != 0)
+    futex_wait (&lock->state, 2);
+}
+
+/* Wakes up one thread waiting on COND, if any. */
+void
+cond_signal (struct condition *cond)
+{
+  increment (&cond->seq);
+  futex_wake (&cond->seq, 1);
+}
+
+/* Wakes up every thread waiting on COND. */
+void
+cond_broadcast (struct condition *cond)
+{
+  increment (&cond->seq);
+  futex_wake (&cond->seq, INT_MAX);
+}
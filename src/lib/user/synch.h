@@ -0,0 +1,33 @@
+#ifndef __LIB_USER_SYNCH_H
+#define __LIB_USER_SYNCH_H
+
+#include <stdbool.h>
+
+/* Lock, of which a free one is taken without a system call. */
+struct lock
+  {
+    int state;                  /* 0 if free, 1 if held, 2 if held
+                                   and others may be waiting. */
+  };
+
+#define LOCK_INITIALIZER { 0 }
+
+void lock_init (struct lock *);
+void lock_acquire (struct lock *);
+bool lock_try_acquire (struct lock *);
+void lock_release (struct lock *);
+
+/* Condition variable. */
+struct condition
+  {
+    int seq;                    /* Bumped by every signal. */
+  };
+
+#define CONDITION_INITIALIZER { 0 }
+
+void cond_init (struct condition *);
+void cond_wait (struct condition *, struct lock *);
+void cond_signal (struct condition *);
+void cond_broadcast (struct condition *);
+
+#endif /* lib/user/synch.h */
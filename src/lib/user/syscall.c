@@ -1,16 +1,31 @@
 #include <syscall.h>
+#include <stdio.h>
 #include "../syscall-nr.h"
 
+/* Traps into the kernel for a system call whose number and
+   arguments have been pushed, and the registers that clobbers.
+   Built with SYSCALL_SYSENTER defined, the library enters with
+   sysenter, which is quicker than the interrupt but takes the
+   stack pointer and return address in %ecx and %edx. */
+#ifdef SYSCALL_SYSENTER
+#define SYSCALL_TRAP                                            \
+        "movl %%esp, %%ecx; movl $1f, %%edx; sysenter; 1: "
+#define SYSCALL_CLOBBERS "ecx", "edx", "memory"
+#else
+#define SYSCALL_TRAP "int $0x30; "
+#define SYSCALL_CLOBBERS "memory"
+#endif
+
 /* Invokes syscall NUMBER, passing no arguments, and returns the
    return value as an `int'. */
 #define syscall0(NUMBER)                                        \
         ({                                                      \
           int retval;                                           \
           asm volatile                                          \
-            ("pushl %[number]; int $0x30; addl $4, %%esp"       \
+            ("pushl %[number]; " SYSCALL_TRAP "addl $4, %%esp"  \
                : "=a" (retval)                                  \
                : [number] "i" (NUMBER)                          \
-               : "memory");                                     \
+               : SYSCALL_CLOBBERS);                             \
           retval;                                               \
         })
 
@@ -20,11 +35,12 @@
         ({                                                               \
           int retval;                                                    \
           asm volatile                                                   \
-            ("pushl %[arg0]; pushl %[number]; int $0x30; addl $8, %%esp" \
+            ("pushl %[arg0]; pushl %[number]; "                          \
+             SYSCALL_TRAP "addl $8, %%esp"                               \
                : "=a" (retval)                                           \
                : [number] "i" (NUMBER),                                  \
                  [arg0] "g" (ARG0)                                       \
-               : "memory");                                              \
+               : SYSCALL_CLOBBERS);                                      \
           retval;                                                        \
         })
 
@@ -35,12 +51,12 @@
           int retval;                                           \
           asm volatile                                          \
             ("pushl %[arg1]; pushl %[arg0]; "                   \
-             "pushl %[number]; int $0x30; addl $12, %%esp"      \
+             "pushl %[number]; " SYSCALL_TRAP "addl $12, %%esp" \
                : "=a" (retval)                                  \
                : [number] "i" (NUMBER),                         \
                  [arg0] "r" (ARG0),                             \
                  [arg1] "r" (ARG1)                              \
-               : "memory");                                     \
+               : SYSCALL_CLOBBERS);                             \
           retval;                                               \
         })
 
@@ -51,19 +67,39 @@
           int retval;                                           \
           asm volatile                                          \
             ("pushl %[arg2]; pushl %[arg1]; pushl %[arg0]; "    \
-             "pushl %[number]; int $0x30; addl $16, %%esp"      \
+             "pushl %[number]; " SYSCALL_TRAP "addl $16, %%esp" \
                : "=a" (retval)                                  \
                : [number] "i" (NUMBER),                         \
                  [arg0] "r" (ARG0),                             \
                  [arg1] "r" (ARG1),                             \
                  [arg2] "r" (ARG2)                              \
-               : "memory");                                     \
+               : SYSCALL_CLOBBERS);                             \
+          retval;                                               \
+        })
+
+/* Invokes syscall NUMBER, passing arguments ARG0, ARG1, ARG2, and
+   ARG3, and returns the return value as an `int'. */
+#define syscall4(NUMBER, ARG0, ARG1, ARG2, ARG3)                \
+        ({                                                      \
+          int retval;                                           \
+          asm volatile                                          \
+            ("pushl %[arg3]; pushl %[arg2]; "                   \
+             "pushl %[arg1]; pushl %[arg0]; "                   \
+             "pushl %[number]; " SYSCALL_TRAP "addl $20, %%esp" \
+               : "=a" (retval)                                  \
+               : [number] "i" (NUMBER),                         \
+                 [arg0] "r" (ARG0),                             \
+                 [arg1] "r" (ARG1),                             \
+                 [arg2] "r" (ARG2),                             \
+                 [arg3] "r" (ARG3)                              \
+               : SYSCALL_CLOBBERS);                             \
           retval;                                               \
         })
 
 void
 halt (void) 
 {
+  fflush (NULL);
   syscall0 (SYS_HALT);
   NOT_REACHED ();
 }
@@ -71,6 +107,7 @@ halt (void)
 void
 exit (int status)
 {
+  fflush (NULL);
   syscall1 (SYS_EXIT, status);
   NOT_REACHED ();
 }
@@ -114,6 +151,9 @@ filesize (int fd)
 int
 read (int fd, void *buffer, unsigned size)
 {
+  /* Show a prompt still in the buffer before waiting for input. */
+  if (fd == STDIN_FILENO)
+    fflush (stdout);
   return syscall3 (SYS_READ, fd, buffer, size);
 }
 
@@ -141,6 +181,101 @@ close (int fd)
   syscall1 (SYS_CLOSE, fd);
 }
 
+int
+pread (int fd, void *buffer, unsigned size, unsigned offset)
+{
+  return syscall4 (SYS_PREAD, fd, buffer, size, offset);
+}
+
+int
+pwrite (int fd, const void *buffer, unsigned size, unsigned offset)
+{
+  return syscall4 (SYS_PWRITE, fd, buffer, size, offset);
+}
+
+int
+readv (int fd, const struct iovec *iov, unsigned iov_cnt)
+{
+  return syscall3 (SYS_READV, fd, iov, iov_cnt);
+}
+
+int
+writev (int fd, const struct iovec *iov, unsigned iov_cnt)
+{
+  return syscall3 (SYS_WRITEV, fd, iov, iov_cnt);
+}
+
+int
+copy_file_range (int fd_in, int fd_out, unsigned size)
+{
+  return syscall3 (SYS_COPY_FILE_RANGE, fd_in, fd_out, size);
+}
+
+int
+ring_enter (struct ring *ring, unsigned to_submit)
+{
+  return syscall2 (SYS_RING_ENTER, ring, to_submit);
+}
+
+bool
+pipe (int fds[2])
+{
+  return syscall1 (SYS_PIPE, fds);
+}
+
+int
+poll (struct pollfd *fds, unsigned fd_cnt, int timeout)
+{
+  return syscall3 (SYS_POLL, fds, fd_cnt, timeout);
+}
+
+bool
+futex_wait (int *addr, int val)
+{
+  return syscall2 (SYS_FUTEX_WAIT, addr, val);
+}
+
+int
+futex_wake (int *addr, int cnt)
+{
+  return syscall2 (SYS_FUTEX_WAKE, addr, cnt);
+}
+
+/* Where the function of a thread started by thread_create() returns
+   to, ending the thread with status 0. */
+static void
+thread_return (void)
+{
+  thread_exit (0);
+}
+
+/* Starts a thread running FUNC (AUX) on the stack that ends just
+   below STACK_TOP, which the caller keeps until the thread is
+   joined. */
+tid_t
+thread_create (thread_func *func, void *aux, void *stack_top)
+{
+  void **esp = stack_top;
+
+  /* Lay out the stack as if thread_return() had called FUNC. */
+  *--esp = aux;
+  *--esp = thread_return;
+  return syscall2 (SYS_THREAD_CREATE, func, esp);
+}
+
+void
+thread_exit (int status)
+{
+  syscall1 (SYS_THREAD_EXIT, status);
+  NOT_REACHED ();
+}
+
+int
+thread_join (tid_t tid)
+{
+  return syscall1 (SYS_THREAD_JOIN, tid);
+}
+
 mapid_t
 mmap (int fd, void *addr)
 {
@@ -182,3 +317,216 @@ inumber (int fd)
 {
   return syscall1 (SYS_INUMBER, fd);
 }
+
+int
+getdents (int fd, struct dirent *entries, unsigned cnt)
+{
+  return syscall3 (SYS_GETDENTS, fd, entries, cnt);
+}
+
+bool
+fsync (int fd)
+{
+  return syscall1 (SYS_FSYNC, fd);
+}
+
+bool
+ftruncate (int fd, unsigned length)
+{
+  return syscall2 (SYS_FTRUNCATE, fd, length);
+}
+
+bool
+fallocate (int fd, unsigned offset, unsigned length)
+{
+  return syscall3 (SYS_FALLOCATE, fd, offset, length);
+}
+
+bool
+defrag (int fd)
+{
+  return syscall1 (SYS_DEFRAG, fd);
+}
+
+void
+cachestat (struct cachestat *stats)
+{
+  syscall1 (SYS_CACHESTAT, stats);
+}
+
+bool
+sched_deadline (unsigned period_ms, unsigned budget_ms)
+{
+  return syscall2 (SYS_SCHED_DEADLINE, period_ms, budget_ms);
+}
+
+int
+getpriority (void)
+{
+  return syscall0 (SYS_GETPRIORITY);
+}
+
+bool
+setpriority (int priority)
+{
+  return syscall1 (SYS_SETPRIORITY, priority);
+}
+
+int
+getnice (void)
+{
+  return syscall0 (SYS_GETNICE);
+}
+
+bool
+setnice (int nice)
+{
+  return syscall1 (SYS_SETNICE, nice);
+}
+
+pid_t
+spawn (const char **argv, const struct spawn_action *actions,
+       int action_cnt, int flags)
+{
+  return (pid_t) syscall4 (SYS_SPAWN, argv, actions, action_cnt, flags);
+}
+
+pid_t
+waitpid (pid_t pid, int *status, int options)
+{
+  return (pid_t) syscall3 (SYS_WAITPID, pid, status, options);
+}
+
+bool
+procstat (int who, struct procstat *stats)
+{
+  return syscall2 (SYS_PROCSTAT, who, stats);
+}
+
+int
+mempressure_open (int level)
+{
+  return syscall1 (SYS_MEMPRESSURE_OPEN, level);
+}
+
+bool
+clone (const char *old, const char *new)
+{
+  return syscall2 (SYS_CLONE, old, new);
+}
+
+mapid_t
+mmap_range (int fd, void *addr, unsigned offset, size_t length)
+{
+  return syscall4 (SYS_MMAP_RANGE, fd, addr, offset, length);
+}
+
+bool
+getrusage (int who, struct rusage *usage)
+{
+  return syscall2 (SYS_GETRUSAGE, who, usage);
+}
+
+bool
+rename (const char *old, const char *new)
+{
+  return syscall2 (SYS_RENAME, old, new);
+}
+
+bool
+stat (const char *path, struct stat *buf)
+{
+  return syscall2 (SYS_STAT, path, buf);
+}
+
+bool
+fstat (int fd, struct stat *buf)
+{
+  return syscall2 (SYS_FSTAT, fd, buf);
+}
+
+int
+openat (int dirfd, const char *file, int flags)
+{
+  return syscall3 (SYS_OPENAT, dirfd, file, flags);
+}
+
+bool
+createat (int dirfd, const char *file, unsigned initial_size)
+{
+  return syscall3 (SYS_CREATEAT, dirfd, file, initial_size);
+}
+
+bool
+removeat (int dirfd, const char *file)
+{
+  return syscall2 (SYS_REMOVEAT, dirfd, file);
+}
+
+bool
+mkdirat (int dirfd, const char *dir)
+{
+  return syscall2 (SYS_MKDIRAT, dirfd, dir);
+}
+
+bool
+msync (mapid_t mapid)
+{
+  return syscall1 (SYS_MSYNC, mapid);
+}
+
+bool
+madvise (mapid_t mapid, int advice)
+{
+  return syscall2 (SYS_MADVISE, mapid, advice);
+}
+
+int
+shm_create (unsigned size)
+{
+  return syscall1 (SYS_SHM_CREATE, size);
+}
+
+void *
+sbrk (intptr_t increment)
+{
+  return (void *) syscall1 (SYS_SBRK, increment);
+}
+
+pid_t
+fork (void)
+{
+  /* Otherwise the child would write out the same output again. */
+  fflush (NULL);
+  return (pid_t) syscall0 (SYS_FORK);
+}
+
+int
+lockstat (struct lockstat *stats, unsigned cnt)
+{
+  return syscall2 (SYS_LOCKSTAT, stats, cnt);
+}
+
+bool
+memstat (struct memstat *stats)
+{
+  return syscall1 (SYS_MEMSTAT, stats);
+}
+
+int
+trace_read (struct trace_record *records, unsigned cnt)
+{
+  return syscall2 (SYS_TRACE_READ, records, cnt);
+}
+
+int
+syscallstat (bool all, struct syscallstat *stats, unsigned cnt)
+{
+  return syscall3 (SYS_SYSCALLSTAT, (int) all, stats, cnt);
+}
+
+int
+kstat (struct kstat *stats, unsigned cnt)
+{
+  return syscall2 (SYS_KSTAT, stats, cnt);
+}
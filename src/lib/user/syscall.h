@@ -2,16 +2,54 @@
 #define __LIB_USER_SYSCALL_H
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <debug.h>
+#include <dirent.h>
+#include <stat.h>
+#include <cachestat.h>
+#include <kstat.h>
+#include <lockstat.h>
+#include <memstat.h>
+#include <mempressure.h>
+#include <poll.h>
+#include <procstat.h>
+#include <ring.h>
+#include <rusage.h>
+#include <spawn.h>
+#include <syscallstat.h>
+#include <trace.h>
+#include <uio.h>
 
 /* Process identifier. */
 typedef int pid_t;
 #define PID_ERROR ((pid_t) -1)
 
+/* Thread identifier, and the function a new thread runs. */
+typedef int tid_t;
+#define TID_ERROR ((tid_t) -1)
+typedef void thread_func (void *aux);
+
 /* Map region identifier. */
 typedef int mapid_t;
 #define MAP_FAILED ((mapid_t) -1)
 
+/* Advice to madvise() about a mapping. */
+#define MADV_NORMAL 0           /* No particular pattern. */
+#define MADV_SEQUENTIAL 1       /* Read in order, each page once. */
+#define MADV_RANDOM 2           /* Read in no particular order. */
+#define MADV_WILLNEED 3         /* Will be used soon, load it now. */
+#define MADV_DONTNEED 4         /* Won't be used soon, drop it now. */
+
+/* Flags to openat(). */
+#define O_DSYNC 0x1             /* Each write returns once on disk. */
+
+/* PID to waitpid() for any child, and its options. */
+#define WAIT_ANY ((pid_t) -1)
+#define WNOHANG 0x1             /* Return 0 if no child has exited. */
+
+/* Returned by sbrk() when the heap can't be moved. */
+#define SBRK_FAILED ((void *) -1)
+
 /* Maximum characters in a filename written by readdir(). */
 #define READDIR_MAX_LEN 14
 
@@ -33,10 +71,32 @@ int write (int fd, const void *buffer, unsigned length);
 void seek (int fd, unsigned position);
 unsigned tell (int fd);
 void close (int fd);
+int pread (int fd, void *buffer, unsigned length, unsigned offset);
+int pwrite (int fd, const void *buffer, unsigned length, unsigned offset);
+int readv (int fd, const struct iovec *iov, unsigned iov_cnt);
+int writev (int fd, const struct iovec *iov, unsigned iov_cnt);
+int copy_file_range (int fd_in, int fd_out, unsigned length);
+int ring_enter (struct ring *, unsigned to_submit);
+bool pipe (int fds[2]);
+int poll (struct pollfd *fds, unsigned fd_cnt, int timeout);
+bool futex_wait (int *addr, int val);
+int futex_wake (int *addr, int cnt);
+tid_t thread_create (thread_func *, void *aux, void *stack_top);
+void thread_exit (int status) NO_RETURN;
+int thread_join (tid_t);
 
 /* Project 3 and optionally project 4. */
 mapid_t mmap (int fd, void *addr);
 void munmap (mapid_t);
+bool msync (mapid_t);
+bool madvise (mapid_t, int advice);
+int shm_create (unsigned size);
+void *sbrk (intptr_t increment);
+int lockstat (struct lockstat *stats, unsigned cnt);
+bool memstat (struct memstat *stats);
+int trace_read (struct trace_record *records, unsigned cnt);
+int syscallstat (bool all, struct syscallstat *stats, unsigned cnt);
+int kstat (struct kstat *stats, unsigned cnt);
 
 /* Project 4 only. */
 bool chdir (const char *dir);
@@ -44,5 +104,32 @@ bool mkdir (const char *dir);
 bool readdir (int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir (int fd);
 int inumber (int fd);
+int getdents (int fd, struct dirent *entries, unsigned cnt);
+bool fsync (int fd);
+bool ftruncate (int fd, unsigned length);
+bool fallocate (int fd, unsigned offset, unsigned length);
+bool defrag (int fd);
+void cachestat (struct cachestat *stats);
+bool sched_deadline (unsigned period_ms, unsigned budget_ms);
+int getpriority (void);
+bool setpriority (int priority);
+int getnice (void);
+bool setnice (int nice);
+pid_t spawn (const char **argv, const struct spawn_action *actions,
+             int action_cnt, int flags);
+pid_t waitpid (pid_t, int *status, int options);
+bool procstat (int who, struct procstat *);
+int mempressure_open (int level);
+bool clone (const char *old, const char *new);
+mapid_t mmap_range (int fd, void *addr, unsigned offset, size_t length);
+bool getrusage (int who, struct rusage *);
+bool rename (const char *old, const char *new);
+bool stat (const char *path, struct stat *buf);
+bool fstat (int fd, struct stat *buf);
+int openat (int dirfd, const char *file, int flags);
+bool createat (int dirfd, const char *file, unsigned initial_size);
+bool removeat (int dirfd, const char *file);
+bool mkdirat (int dirfd, const char *dir);
+pid_t fork (void);
 
 #endif /* lib/user/syscall.h */
@@ -0,0 +1,53 @@
+/* Grows two files a sector at a time, alternately, so that the
+   sectors of each are scattered between the other's, then
+   defragments one of them and checks that both still read back
+   correctly. */
+
+#include <random.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE 10240
+#define CHUNK_SIZE 512
+static char buf_a[FILE_SIZE];
+static char buf_b[FILE_SIZE];
+
+void
+test_main (void) 
+{
+  int fd_a, fd_b;
+  size_t ofs;
+
+  random_init (0);
+  random_bytes (buf_a, sizeof buf_a);
+  random_bytes (buf_b, sizeof buf_b);
+
+  CHECK (create ("a", 0), "create \"a\"");
+  CHECK (create ("b", 0), "create \"b\"");
+  CHECK ((fd_a = open ("a")) > 1, "open \"a\"");
+  CHECK ((fd_b = open ("b")) > 1, "open \"b\"");
+
+  msg ("write \"a\" and \"b\" alternately");
+  for (ofs = 0; ofs < FILE_SIZE; ofs += CHUNK_SIZE)
+    {
+      if (write (fd_a, buf_a + ofs, CHUNK_SIZE) != CHUNK_SIZE)
+        fail ("write %d bytes at offset %zu in \"a\" failed",
+              CHUNK_SIZE, ofs);
+      if (write (fd_b, buf_b + ofs, CHUNK_SIZE) != CHUNK_SIZE)
+        fail ("write %d bytes at offset %zu in \"b\" failed",
+              CHUNK_SIZE, ofs);
+    }
+
+  CHECK (defrag (fd_a), "defrag \"a\"");
+  seek (fd_a, 0);
+  check_file_handle (fd_a, "a", buf_a, FILE_SIZE);
+
+  msg ("close \"a\"");
+  close (fd_a);
+  msg ("close \"b\"");
+  close (fd_b);
+
+  check_file ("a", buf_a, FILE_SIZE);
+  check_file ("b", buf_b, FILE_SIZE);
+}
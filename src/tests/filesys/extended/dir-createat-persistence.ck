@@ -0,0 +1,8 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_archive ({"a" => {"x" => ["\0" x 10]},
+		"b" => {"y" => ["\0" x 20]},
+		"z" => ["\0" x 30]});
+pass;
@@ -0,0 +1,35 @@
+/* Creates files with createat() relative to a directory descriptor,
+   to the working directory when the descriptor is negative, and by
+   absolute path, then checks where each one ended up. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  int dirfd, fd;
+
+  CHECK (mkdir ("a"), "mkdir \"a\"");
+  CHECK (mkdir ("b"), "mkdir \"b\"");
+  CHECK ((dirfd = open ("a")) > 1, "open \"a\"");
+  CHECK (chdir ("b"), "chdir \"b\"");
+
+  CHECK (createat (dirfd, "x", 10), "createat \"a\", \"x\"");
+  CHECK (createat (-1, "y", 20), "createat -1, \"y\"");
+  CHECK (createat (dirfd, "/z", 30), "createat \"a\", \"/z\"");
+  CHECK (!createat (dirfd, "x", 0), "createat \"a\", \"x\" again (must fail)");
+  CHECK ((fd = open ("/a/x")) > 1, "open \"/a/x\"");
+  CHECK (!createat (fd, "w", 0), "createat \"/a/x\", \"w\" (must fail)");
+  CHECK (filesize (fd) == 10, "filesize of \"/a/x\" is 10");
+  close (fd);
+  CHECK ((fd = open ("/b/y")) > 1, "open \"/b/y\"");
+  CHECK (filesize (fd) == 20, "filesize of \"/b/y\" is 20");
+  close (fd);
+  CHECK ((fd = open ("/z")) > 1, "open \"/z\"");
+  CHECK (filesize (fd) == 30, "filesize of \"/z\" is 30");
+  close (fd);
+  msg ("close \"a\"");
+  close (dirfd);
+}
@@ -0,0 +1,25 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(dir-createat) begin
+(dir-createat) mkdir "a"
+(dir-createat) mkdir "b"
+(dir-createat) open "a"
+(dir-createat) chdir "b"
+(dir-createat) createat "a", "x"
+(dir-createat) createat -1, "y"
+(dir-createat) createat "a", "/z"
+(dir-createat) createat "a", "x" again (must fail)
+(dir-createat) open "/a/x"
+(dir-createat) createat "/a/x", "w" (must fail)
+(dir-createat) filesize of "/a/x" is 10
+(dir-createat) open "/b/y"
+(dir-createat) filesize of "/b/y" is 20
+(dir-createat) open "/z"
+(dir-createat) filesize of "/z" is 30
+(dir-createat) close "a"
+(dir-createat) end
+EOF
+pass;
@@ -0,0 +1,105 @@
+/* Creates more files in a directory than getdents() returns in one
+   call, then reads them back a few at a time and then as many as it
+   will give at once, checking that every entry comes back exactly
+   once with its type and length. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_CNT 150
+
+static struct dirent ents[FILE_CNT + 8];
+static bool seen[FILE_CNT + 1];
+
+/* Checks the CNT entries in ENTS against what was created, marking
+   each one seen, and returns how many there were apart from "." and
+   "..". */
+static int
+check_entries (int cnt, int sub_inumber)
+{
+  int i, found = 0;
+
+  for (i = 0; i < cnt; i++)
+    {
+      struct dirent *e = &ents[i];
+      int idx;
+
+      if (!strcmp (e->name, ".") || !strcmp (e->name, ".."))
+        continue;
+      if (!strcmp (e->name, "sub"))
+        {
+          if (!e->isdir || e->inumber != sub_inumber)
+            fail ("bad entry for \"sub\"");
+          idx = FILE_CNT;
+        }
+      else
+        {
+          idx = atoi (e->name + 1);
+          if (e->name[0] != 'f' || idx < 0 || idx >= FILE_CNT)
+            fail ("unexpected entry \"%s\"", e->name);
+          if (e->isdir || e->length != (unsigned) idx)
+            fail ("\"%s\" has length %u, expected %d", e->name, e->length,
+                  idx);
+        }
+      if (seen[idx])
+        fail ("\"%s\" returned twice", e->name);
+      seen[idx] = true;
+      found++;
+    }
+  return found;
+}
+
+void
+test_main (void) 
+{
+  int fd, sub_fd, sub_inumber, cnt, calls, total;
+  int i;
+
+  CHECK (mkdir ("d"), "mkdir \"d\"");
+  msg ("creating %d files in \"d\"", FILE_CNT);
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      char name[32];
+
+      snprintf (name, sizeof name, "d/f%d", i);
+      if (!create (name, i))
+        fail ("create \"%s\"", name);
+    }
+  CHECK (mkdir ("d/sub"), "mkdir \"d/sub\"");
+  CHECK ((sub_fd = open ("d/sub")) > 1, "open \"d/sub\"");
+  sub_inumber = inumber (sub_fd);
+  close (sub_fd);
+
+  CHECK ((fd = open ("d")) > 1, "open \"d\"");
+  msg ("getdents 7 entries at a time");
+  for (total = calls = 0; (cnt = getdents (fd, ents, 7)) > 0; calls++)
+    {
+      if (cnt > 7)
+        fail ("getdents returned %d entries", cnt);
+      total += check_entries (cnt, sub_inumber);
+    }
+  CHECK (cnt == 0, "getdents at end returned 0");
+  CHECK (total == FILE_CNT + 1, "saw all %d entries", FILE_CNT + 1);
+  CHECK (calls > (FILE_CNT + 1) / 7, "took more than one call");
+  close (fd);
+
+  memset (seen, 0, sizeof seen);
+  CHECK ((fd = open ("d")) > 1, "open \"d\" again");
+  msg ("getdents as many entries as fit");
+  for (total = calls = 0;
+       (cnt = getdents (fd, ents, sizeof ents / sizeof *ents)) > 0; calls++)
+    total += check_entries (cnt, sub_inumber);
+  CHECK (total == FILE_CNT + 1, "saw all %d entries", FILE_CNT + 1);
+  CHECK (getdents (fd, ents, 1) == 0, "getdents at end returned 0");
+  msg ("close \"d\"");
+  close (fd);
+
+  CHECK ((fd = open ("d/f1")) > 1, "open \"d/f1\"");
+  CHECK (getdents (fd, ents, 1) == -1, "getdents on a file (must fail)");
+  msg ("close \"d/f1\"");
+  close (fd);
+}
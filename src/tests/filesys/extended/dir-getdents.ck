@@ -0,0 +1,26 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(dir-getdents) begin
+(dir-getdents) mkdir "d"
+(dir-getdents) creating 150 files in "d"
+(dir-getdents) mkdir "d/sub"
+(dir-getdents) open "d/sub"
+(dir-getdents) open "d"
+(dir-getdents) getdents 7 entries at a time
+(dir-getdents) getdents at end returned 0
+(dir-getdents) saw all 151 entries
+(dir-getdents) took more than one call
+(dir-getdents) open "d" again
+(dir-getdents) getdents as many entries as fit
+(dir-getdents) saw all 151 entries
+(dir-getdents) getdents at end returned 0
+(dir-getdents) close "d"
+(dir-getdents) open "d/f1"
+(dir-getdents) getdents on a file (must fail)
+(dir-getdents) close "d/f1"
+(dir-getdents) end
+EOF
+pass;
@@ -0,0 +1,39 @@
+/* Makes directories with mkdirat() relative to a directory
+   descriptor, to the working directory when the descriptor is
+   negative, and by absolute path, then checks where each one ended
+   up. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  int dirfd, fd;
+
+  CHECK (mkdir ("a"), "mkdir \"a\"");
+  CHECK (mkdir ("b"), "mkdir \"b\"");
+  CHECK ((dirfd = open ("a")) > 1, "open \"a\"");
+  CHECK (chdir ("b"), "chdir \"b\"");
+
+  CHECK (mkdirat (dirfd, "c"), "mkdirat \"a\", \"c\"");
+  CHECK (mkdirat (dirfd, "c/d"), "mkdirat \"a\", \"c/d\"");
+  CHECK (mkdirat (-1, "e"), "mkdirat -1, \"e\"");
+  CHECK (mkdirat (dirfd, "/f"), "mkdirat \"a\", \"/f\"");
+  CHECK (!mkdirat (dirfd, "c"), "mkdirat \"a\", \"c\" again (must fail)");
+  CHECK (!mkdirat (dirfd, "x/y"), "mkdirat \"a\", \"x/y\" (must fail)");
+  CHECK ((fd = open ("/a/c/d")) > 1, "open \"/a/c/d\"");
+  CHECK (isdir (fd), "isdir \"/a/c/d\"");
+  CHECK (!mkdirat (STDOUT_FILENO, "g"), "mkdirat 1, \"g\" (must fail)");
+  close (fd);
+  CHECK ((fd = open ("/b/e")) > 1, "open \"/b/e\"");
+  CHECK (isdir (fd), "isdir \"/b/e\"");
+  close (fd);
+  CHECK ((fd = open ("/f")) > 1, "open \"/f\"");
+  CHECK (isdir (fd), "isdir \"/f\"");
+  close (fd);
+  msg ("close \"a\"");
+  close (dirfd);
+}
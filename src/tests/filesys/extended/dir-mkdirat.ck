@@ -0,0 +1,27 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(dir-mkdirat) begin
+(dir-mkdirat) mkdir "a"
+(dir-mkdirat) mkdir "b"
+(dir-mkdirat) open "a"
+(dir-mkdirat) chdir "b"
+(dir-mkdirat) mkdirat "a", "c"
+(dir-mkdirat) mkdirat "a", "c/d"
+(dir-mkdirat) mkdirat -1, "e"
+(dir-mkdirat) mkdirat "a", "/f"
+(dir-mkdirat) mkdirat "a", "c" again (must fail)
+(dir-mkdirat) mkdirat "a", "x/y" (must fail)
+(dir-mkdirat) open "/a/c/d"
+(dir-mkdirat) isdir "/a/c/d"
+(dir-mkdirat) mkdirat 1, "g" (must fail)
+(dir-mkdirat) open "/b/e"
+(dir-mkdirat) isdir "/b/e"
+(dir-mkdirat) open "/f"
+(dir-mkdirat) isdir "/f"
+(dir-mkdirat) close "a"
+(dir-mkdirat) end
+EOF
+pass;
@@ -0,0 +1,33 @@
+/* Writes a file opened for write-through with openat() and O_DSYNC,
+   both while its data still fits in the inode and once it has
+   grown into data sectors, and reads it back through another
+   descriptor. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[1000];
+
+void
+test_main (void) 
+{
+  int dirfd, fd, fd2;
+
+  memset (buf, 'd', sizeof buf);
+  CHECK (mkdir ("a"), "mkdir \"a\"");
+  CHECK ((dirfd = openat (-1, "a", O_DSYNC)) > 1, "openat -1, \"a\", O_DSYNC");
+  CHECK (createat (dirfd, "f", 0), "createat \"a\", \"f\"");
+  CHECK ((fd = openat (dirfd, "f", O_DSYNC)) > 1,
+         "openat \"a\", \"f\", O_DSYNC");
+  CHECK (write (fd, buf, 100) == 100, "write 100 bytes");
+  CHECK (write (fd, buf + 100, 900) == 900, "write 900 bytes");
+  CHECK ((fd2 = open ("a/f")) > 1, "open \"a/f\"");
+  check_file_handle (fd2, "a/f", buf, sizeof buf);
+  msg ("close \"a/f\"");
+  close (fd2);
+  close (fd);
+  msg ("close \"a\"");
+  close (dirfd);
+}
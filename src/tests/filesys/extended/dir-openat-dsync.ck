@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(dir-openat-dsync) begin
+(dir-openat-dsync) mkdir "a"
+(dir-openat-dsync) openat -1, "a", O_DSYNC
+(dir-openat-dsync) createat "a", "f"
+(dir-openat-dsync) openat "a", "f", O_DSYNC
+(dir-openat-dsync) write 100 bytes
+(dir-openat-dsync) write 900 bytes
+(dir-openat-dsync) open "a/f"
+(dir-openat-dsync) verified contents of "a/f"
+(dir-openat-dsync) close "a/f"
+(dir-openat-dsync) close "a"
+(dir-openat-dsync) end
+EOF
+pass;
@@ -0,0 +1,6 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_archive ({"a" => {"f" => ["\0" x 5]}, "g" => ["\0" x 7]});
+pass;
@@ -0,0 +1,43 @@
+/* Opens files with openat() relative to a directory descriptor, to
+   the working directory when the descriptor is negative, and by
+   absolute path, which ignores the descriptor. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  int dirfd, fd;
+
+  CHECK (mkdir ("a"), "mkdir \"a\"");
+  CHECK (create ("a/f", 5), "create \"a/f\"");
+  CHECK (create ("g", 7), "create \"g\"");
+  CHECK ((dirfd = open ("a")) > 1, "open \"a\"");
+
+  CHECK ((fd = openat (dirfd, "f", 0)) > 1, "openat \"a\", \"f\"");
+  CHECK (filesize (fd) == 5, "filesize is 5");
+  close (fd);
+  CHECK (openat (dirfd, "g", 0) == -1, "openat \"a\", \"g\" (must fail)");
+  CHECK ((fd = openat (dirfd, "/g", 0)) > 1, "openat \"a\", \"/g\"");
+  CHECK (filesize (fd) == 7, "filesize is 7");
+  CHECK (openat (fd, "f", 0) == -1, "openat \"g\", \"f\" (must fail)");
+  close (fd);
+  CHECK ((fd = openat (-1, "g", 0)) > 1, "openat -1, \"g\"");
+  CHECK (filesize (fd) == 7, "filesize is 7");
+  close (fd);
+  CHECK (openat (dirfd, "f", 0x100) == -1,
+         "openat \"a\", \"f\" with bad flags (must fail)");
+
+  CHECK (chdir ("a"), "chdir \"a\"");
+  CHECK ((fd = openat (-1, "f", 0)) > 1, "openat -1, \"f\"");
+  CHECK (filesize (fd) == 5, "filesize is 5");
+  close (fd);
+  CHECK ((fd = openat (dirfd, "..", 0)) > 1, "openat \"a\", \"..\"");
+  CHECK (isdir (fd), "isdir \"..\"");
+  CHECK ((fd = openat (fd, "g", 0)) > 1, "openat \"..\", \"g\"");
+  CHECK (filesize (fd) == 7, "filesize is 7");
+  msg ("close \"a\"");
+  close (dirfd);
+}
@@ -0,0 +1,30 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(dir-openat) begin
+(dir-openat) mkdir "a"
+(dir-openat) create "a/f"
+(dir-openat) create "g"
+(dir-openat) open "a"
+(dir-openat) openat "a", "f"
+(dir-openat) filesize is 5
+(dir-openat) openat "a", "g" (must fail)
+(dir-openat) openat "a", "/g"
+(dir-openat) filesize is 7
+(dir-openat) openat "g", "f" (must fail)
+(dir-openat) openat -1, "g"
+(dir-openat) filesize is 7
+(dir-openat) openat "a", "f" with bad flags (must fail)
+(dir-openat) chdir "a"
+(dir-openat) openat -1, "f"
+(dir-openat) filesize is 5
+(dir-openat) openat "a", ".."
+(dir-openat) isdir ".."
+(dir-openat) openat "..", "g"
+(dir-openat) filesize is 7
+(dir-openat) close "a"
+(dir-openat) end
+EOF
+pass;
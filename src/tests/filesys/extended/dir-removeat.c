@@ -0,0 +1,36 @@
+/* Removes files and directories with removeat() relative to a
+   directory descriptor, to the working directory when the descriptor
+   is negative, and by absolute path. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  int dirfd;
+
+  CHECK (mkdir ("a"), "mkdir \"a\"");
+  CHECK (mkdir ("b"), "mkdir \"b\"");
+  CHECK (create ("a/x", 0), "create \"a/x\"");
+  CHECK (mkdir ("a/d"), "mkdir \"a/d\"");
+  CHECK (create ("b/y", 0), "create \"b/y\"");
+  CHECK (create ("b/keep", 0), "create \"b/keep\"");
+  CHECK (create ("z", 0), "create \"z\"");
+  CHECK ((dirfd = open ("a")) > 1, "open \"a\"");
+  CHECK (chdir ("b"), "chdir \"b\"");
+
+  CHECK (!removeat (dirfd, "y"), "removeat \"a\", \"y\" (must fail)");
+  CHECK (removeat (dirfd, "x"), "removeat \"a\", \"x\"");
+  CHECK (removeat (dirfd, "d"), "removeat \"a\", \"d\"");
+  CHECK (removeat (-1, "y"), "removeat -1, \"y\"");
+  CHECK (removeat (dirfd, "/z"), "removeat \"a\", \"/z\"");
+  CHECK (!removeat (dirfd, "x"), "removeat \"a\", \"x\" again (must fail)");
+  CHECK (open ("/a/x") == -1, "open \"/a/x\" (must return -1)");
+  CHECK (open ("/a/d") == -1, "open \"/a/d\" (must return -1)");
+  CHECK (open ("/b/y") == -1, "open \"/b/y\" (must return -1)");
+  CHECK (open ("/z") == -1, "open \"/z\" (must return -1)");
+  msg ("close \"a\"");
+  close (dirfd);
+}
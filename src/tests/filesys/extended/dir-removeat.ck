@@ -0,0 +1,29 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(dir-removeat) begin
+(dir-removeat) mkdir "a"
+(dir-removeat) mkdir "b"
+(dir-removeat) create "a/x"
+(dir-removeat) mkdir "a/d"
+(dir-removeat) create "b/y"
+(dir-removeat) create "b/keep"
+(dir-removeat) create "z"
+(dir-removeat) open "a"
+(dir-removeat) chdir "b"
+(dir-removeat) removeat "a", "y" (must fail)
+(dir-removeat) removeat "a", "x"
+(dir-removeat) removeat "a", "d"
+(dir-removeat) removeat -1, "y"
+(dir-removeat) removeat "a", "/z"
+(dir-removeat) removeat "a", "x" again (must fail)
+(dir-removeat) open "/a/x" (must return -1)
+(dir-removeat) open "/a/d" (must return -1)
+(dir-removeat) open "/b/y" (must return -1)
+(dir-removeat) open "/z" (must return -1)
+(dir-removeat) close "a"
+(dir-removeat) end
+EOF
+pass;
@@ -0,0 +1,48 @@
+/* Checks what fstat() reports for open files and directories as
+   they change, and that it fails for descriptors without an
+   inode. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[100];
+
+void
+test_main (void) 
+{
+  struct stat st;
+  int fd, fd2, dir_fd, fds[2];
+
+  CHECK (create ("f", 50), "create \"f\"");
+  CHECK ((fd = open ("f")) > 1, "open \"f\"");
+  CHECK (fstat (fd, &st), "fstat \"f\"");
+  CHECK (!st.isdir && st.length == 50 && st.open_cnt == 1,
+         "\"f\" is a file of 50 bytes, open once");
+  CHECK (st.inumber == inumber (fd), "inumber matches");
+  seek (fd, 50);
+  CHECK (write (fd, buf, sizeof buf) == sizeof buf, "write 100 bytes");
+  CHECK ((fd2 = open ("f")) > 1, "open \"f\" again");
+  CHECK (fstat (fd2, &st), "fstat \"f\"");
+  CHECK (st.length == 150 && st.open_cnt == 2,
+         "\"f\" is 150 bytes, open twice");
+  msg ("close \"f\"");
+  close (fd2);
+  CHECK (fstat (fd, &st) && st.open_cnt == 1, "fstat \"f\" open once");
+
+  CHECK (mkdir ("d"), "mkdir \"d\"");
+  CHECK ((dir_fd = open ("d")) > 1, "open \"d\"");
+  CHECK (fstat (dir_fd, &st), "fstat \"d\"");
+  CHECK (st.isdir && st.open_cnt == 1, "\"d\" is a directory, open once");
+  CHECK (st.inumber == inumber (dir_fd), "inumber matches");
+
+  CHECK (pipe (fds), "pipe");
+  CHECK (!fstat (fds[0], &st), "fstat pipe (must fail)");
+  CHECK (!fstat (STDIN_FILENO, &st), "fstat stdin (must fail)");
+  CHECK (!fstat (fd2, &st), "fstat closed fd (must fail)");
+  msg ("close \"f\"");
+  close (fd);
+  msg ("close \"d\"");
+  close (dir_fd);
+}
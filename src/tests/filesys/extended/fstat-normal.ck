@@ -0,0 +1,31 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(fstat-normal) begin
+(fstat-normal) create "f"
+(fstat-normal) open "f"
+(fstat-normal) fstat "f"
+(fstat-normal) "f" is a file of 50 bytes, open once
+(fstat-normal) inumber matches
+(fstat-normal) write 100 bytes
+(fstat-normal) open "f" again
+(fstat-normal) fstat "f"
+(fstat-normal) "f" is 150 bytes, open twice
+(fstat-normal) close "f"
+(fstat-normal) fstat "f" open once
+(fstat-normal) mkdir "d"
+(fstat-normal) open "d"
+(fstat-normal) fstat "d"
+(fstat-normal) "d" is a directory, open once
+(fstat-normal) inumber matches
+(fstat-normal) pipe
+(fstat-normal) fstat pipe (must fail)
+(fstat-normal) fstat stdin (must fail)
+(fstat-normal) fstat closed fd (must fail)
+(fstat-normal) close "f"
+(fstat-normal) close "d"
+(fstat-normal) end
+EOF
+pass;
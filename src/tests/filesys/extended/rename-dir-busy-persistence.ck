@@ -0,0 +1,6 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_archive ({"b" => {"x" => ['']}, "c" => {}});
+pass;
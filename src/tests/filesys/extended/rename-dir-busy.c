@@ -0,0 +1,23 @@
+/* Tries to rename a directory over one that is not empty and over
+   one that is open, which must both fail. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  int fd;
+
+  CHECK (mkdir ("a"), "mkdir \"a\"");
+  CHECK (mkdir ("b"), "mkdir \"b\"");
+  CHECK (create ("b/x", 0), "create \"b/x\"");
+  CHECK (!rename ("a", "b"), "rename \"a\" to \"b\" (must fail)");
+  CHECK (mkdir ("c"), "mkdir \"c\"");
+  CHECK ((fd = open ("c")) > 1, "open \"c\"");
+  CHECK (!rename ("a", "c"), "rename \"a\" to \"c\" (must fail)");
+  msg ("close \"c\"");
+  close (fd);
+  CHECK (rename ("a", "c"), "rename \"a\" to \"c\"");
+}
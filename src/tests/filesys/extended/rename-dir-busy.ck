@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(rename-dir-busy) begin
+(rename-dir-busy) mkdir "a"
+(rename-dir-busy) mkdir "b"
+(rename-dir-busy) create "b/x"
+(rename-dir-busy) rename "a" to "b" (must fail)
+(rename-dir-busy) mkdir "c"
+(rename-dir-busy) open "c"
+(rename-dir-busy) rename "a" to "c" (must fail)
+(rename-dir-busy) close "c"
+(rename-dir-busy) rename "a" to "c"
+(rename-dir-busy) end
+EOF
+pass;
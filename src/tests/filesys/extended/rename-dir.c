@@ -0,0 +1,25 @@
+/* Renames a directory over an empty one, which must be replaced,
+   and checks that a file can't replace a directory nor a directory
+   a file. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  int fd;
+
+  CHECK (mkdir ("a"), "mkdir \"a\"");
+  CHECK (create ("a/x", 0), "create \"a/x\"");
+  CHECK (mkdir ("b"), "mkdir \"b\"");
+  CHECK (create ("f", 0), "create \"f\"");
+  CHECK (!rename ("f", "b"), "rename \"f\" to \"b\" (must fail)");
+  CHECK (!rename ("b", "f"), "rename \"b\" to \"f\" (must fail)");
+  CHECK (rename ("a", "b"), "rename \"a\" to \"b\"");
+  CHECK (open ("a") == -1, "open \"a\" (must return -1)");
+  CHECK ((fd = open ("b/x")) > 1, "open \"b/x\"");
+  msg ("close \"b/x\"");
+  close (fd);
+}
@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(rename-dir) begin
+(rename-dir) mkdir "a"
+(rename-dir) create "a/x"
+(rename-dir) mkdir "b"
+(rename-dir) create "f"
+(rename-dir) rename "f" to "b" (must fail)
+(rename-dir) rename "b" to "f" (must fail)
+(rename-dir) rename "a" to "b"
+(rename-dir) open "a" (must return -1)
+(rename-dir) open "b/x"
+(rename-dir) close "b/x"
+(rename-dir) end
+EOF
+pass;
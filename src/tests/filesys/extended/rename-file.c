@@ -0,0 +1,37 @@
+/* Renames a file over another one, which must be replaced. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static void
+create_with (const char *name, const char *data) 
+{
+  int fd;
+
+  CHECK (create (name, 0), "create \"%s\"", name);
+  CHECK ((fd = open (name)) > 1, "open \"%s\"", name);
+  CHECK (write (fd, data, strlen (data)) == (int) strlen (data),
+         "write \"%s\"", name);
+  msg ("close \"%s\"", name);
+  close (fd);
+}
+
+void
+test_main (void) 
+{
+  char buf[16];
+  int fd;
+
+  create_with ("a", "alpha");
+  create_with ("b", "beta");
+  CHECK (rename ("a", "b"), "rename \"a\" to \"b\"");
+  CHECK (open ("a") == -1, "open \"a\" (must return -1)");
+  CHECK ((fd = open ("b")) > 1, "open \"b\"");
+  CHECK (read (fd, buf, sizeof buf) == 5, "read \"b\"");
+  if (memcmp (buf, "alpha", 5))
+    fail ("\"b\" does not hold what \"a\" did");
+  msg ("close \"b\"");
+  close (fd);
+}
@@ -0,0 +1,22 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(rename-file) begin
+(rename-file) create "a"
+(rename-file) open "a"
+(rename-file) write "a"
+(rename-file) close "a"
+(rename-file) create "b"
+(rename-file) open "b"
+(rename-file) write "b"
+(rename-file) close "b"
+(rename-file) rename "a" to "b"
+(rename-file) open "a" (must return -1)
+(rename-file) open "b"
+(rename-file) read "b"
+(rename-file) close "b"
+(rename-file) end
+EOF
+pass;
@@ -0,0 +1,15 @@
+/* Tries to move a directory inside itself, which must fail. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  CHECK (mkdir ("a"), "mkdir \"a\"");
+  CHECK (mkdir ("a/b"), "mkdir \"a/b\"");
+  CHECK (!rename ("a", "a/c"), "rename \"a\" to \"a/c\" (must fail)");
+  CHECK (!rename ("a", "a/b/c"), "rename \"a\" to \"a/b/c\" (must fail)");
+  CHECK (!rename ("/a", "/a/b"), "rename \"/a\" to \"/a/b\" (must fail)");
+}
@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(rename-into-self) begin
+(rename-into-self) mkdir "a"
+(rename-into-self) mkdir "a/b"
+(rename-into-self) rename "a" to "a/c" (must fail)
+(rename-into-self) rename "a" to "a/b/c" (must fail)
+(rename-into-self) rename "/a" to "/a/b" (must fail)
+(rename-into-self) end
+EOF
+pass;
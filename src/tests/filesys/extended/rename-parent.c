@@ -0,0 +1,24 @@
+/* Moves a directory to another directory and checks that its ".."
+   leads to the new parent. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  int fd;
+
+  CHECK (mkdir ("a"), "mkdir \"a\"");
+  CHECK (mkdir ("b"), "mkdir \"b\"");
+  CHECK (mkdir ("a/x"), "mkdir \"a/x\"");
+  CHECK (rename ("a/x", "b/y"), "rename \"a/x\" to \"b/y\"");
+  CHECK (chdir ("b/y"), "chdir \"b/y\"");
+  CHECK (create ("../z", 0), "create \"../z\"");
+  CHECK (chdir (".."), "chdir \"..\"");
+  CHECK ((fd = open ("/b/z")) > 1, "open \"/b/z\"");
+  msg ("close \"/b/z\"");
+  close (fd);
+  CHECK (open ("/a/z") == -1, "open \"/a/z\" (must return -1)");
+}
@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(rename-parent) begin
+(rename-parent) mkdir "a"
+(rename-parent) mkdir "b"
+(rename-parent) mkdir "a/x"
+(rename-parent) rename "a/x" to "b/y"
+(rename-parent) chdir "b/y"
+(rename-parent) create "../z"
+(rename-parent) chdir ".."
+(rename-parent) open "/b/z"
+(rename-parent) close "/b/z"
+(rename-parent) open "/a/z" (must return -1)
+(rename-parent) end
+EOF
+pass;
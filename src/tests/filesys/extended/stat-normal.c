@@ -0,0 +1,40 @@
+/* Checks what stat() reports for a file and a directory: type,
+   length, inumber and the number of openers. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  struct stat st;
+  int fd, dir_fd;
+
+  CHECK (create ("f", 123), "create \"f\"");
+  CHECK (mkdir ("d"), "mkdir \"d\"");
+  CHECK (stat ("f", &st), "stat \"f\"");
+  CHECK (!st.isdir && st.length == 123 && st.open_cnt == 0,
+         "\"f\" is a file of 123 bytes, not open");
+  CHECK ((fd = open ("f")) > 1, "open \"f\"");
+  CHECK (stat ("f", &st), "stat \"f\"");
+  CHECK (st.inumber == inumber (fd), "inumber matches");
+  CHECK (st.open_cnt == 1, "\"f\" open once");
+
+  CHECK (stat ("/d", &st), "stat \"/d\"");
+  CHECK (st.isdir && st.open_cnt == 0, "\"/d\" is a directory, not open");
+  CHECK ((dir_fd = open ("d")) > 1, "open \"d\"");
+  CHECK (stat ("d", &st), "stat \"d\"");
+  CHECK (st.inumber == inumber (dir_fd), "inumber matches");
+  CHECK (st.open_cnt == 1, "\"d\" open once");
+  CHECK (stat ("/", &st) && st.isdir, "stat \"/\"");
+  CHECK (st.inumber != inumber (dir_fd) && st.inumber != inumber (fd),
+         "root has its own inumber");
+
+  CHECK (!stat ("missing", &st), "stat \"missing\" (must fail)");
+  CHECK (!stat ("f/x", &st), "stat \"f/x\" (must fail)");
+  msg ("close \"f\"");
+  close (fd);
+  msg ("close \"d\"");
+  close (dir_fd);
+}
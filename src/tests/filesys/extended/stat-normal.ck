@@ -0,0 +1,29 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(stat-normal) begin
+(stat-normal) create "f"
+(stat-normal) mkdir "d"
+(stat-normal) stat "f"
+(stat-normal) "f" is a file of 123 bytes, not open
+(stat-normal) open "f"
+(stat-normal) stat "f"
+(stat-normal) inumber matches
+(stat-normal) "f" open once
+(stat-normal) stat "/d"
+(stat-normal) "/d" is a directory, not open
+(stat-normal) open "d"
+(stat-normal) stat "d"
+(stat-normal) inumber matches
+(stat-normal) "d" open once
+(stat-normal) stat "/"
+(stat-normal) root has its own inumber
+(stat-normal) stat "missing" (must fail)
+(stat-normal) stat "f/x" (must fail)
+(stat-normal) close "f"
+(stat-normal) close "d"
+(stat-normal) end
+EOF
+pass;
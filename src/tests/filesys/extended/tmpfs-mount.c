@@ -0,0 +1,25 @@
+/* Tries to remove or rename /tmp, which a tmpfs is mounted on, to
+   replace it, and to move files into or out of the tmpfs, which must
+   all fail. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  CHECK (create ("/tmp/a", 0), "create \"/tmp/a\"");
+  CHECK (create ("/b", 0), "create \"/b\"");
+  CHECK (mkdir ("/c"), "mkdir \"/c\"");
+  CHECK (!remove ("/tmp"), "remove \"/tmp\" (must fail)");
+  CHECK (!rename ("/tmp", "/x"), "rename \"/tmp\" to \"/x\" (must fail)");
+  CHECK (!rename ("/c", "/tmp"), "rename \"/c\" to \"/tmp\" (must fail)");
+  CHECK (!rename ("/tmp/a", "/a"),
+         "rename \"/tmp/a\" to \"/a\" (must fail)");
+  CHECK (!rename ("/b", "/tmp/b"),
+         "rename \"/b\" to \"/tmp/b\" (must fail)");
+  CHECK (rename ("/tmp/a", "/tmp/a2"),
+         "rename \"/tmp/a\" to \"/tmp/a2\"");
+  CHECK (remove ("/tmp/a2"), "remove \"/tmp/a2\"");
+}
@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(tmpfs-mount) begin
+(tmpfs-mount) create "/tmp/a"
+(tmpfs-mount) create "/b"
+(tmpfs-mount) mkdir "/c"
+(tmpfs-mount) remove "/tmp" (must fail)
+(tmpfs-mount) rename "/tmp" to "/x" (must fail)
+(tmpfs-mount) rename "/c" to "/tmp" (must fail)
+(tmpfs-mount) rename "/tmp/a" to "/a" (must fail)
+(tmpfs-mount) rename "/b" to "/tmp/b" (must fail)
+(tmpfs-mount) rename "/tmp/a" to "/tmp/a2"
+(tmpfs-mount) remove "/tmp/a2"
+(tmpfs-mount) end
+EOF
+pass;
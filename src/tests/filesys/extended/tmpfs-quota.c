@@ -0,0 +1,48 @@
+/* Writes a file in the tmpfs mounted on /tmp until the tmpfs runs out
+   of pages, which must make a write come up short instead of
+   failing outright, then checks that removing the file gives the
+   pages back. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/* Most written before giving up on reaching the limit. */
+#define MAX_SIZE (64 * 1024 * 1024)
+
+static char buf[64 * 1024];
+
+void
+test_main (void) 
+{
+  size_t size;
+  int fd, n;
+
+  CHECK (create ("/tmp/big", 0), "create \"/tmp/big\"");
+  CHECK ((fd = open ("/tmp/big")) > 1, "open \"/tmp/big\"");
+  for (size = 0; size < MAX_SIZE; size += n)
+    {
+      n = write (fd, buf, sizeof buf);
+      if (n < 0)
+        fail ("write at offset %zu failed", size);
+      if (n < (int) sizeof buf)
+        {
+          size += n;
+          break;
+        }
+    }
+  if (size >= MAX_SIZE)
+    fail ("wrote %d bytes without coming up short", MAX_SIZE);
+  msg ("write came up short");
+  CHECK ((size_t) filesize (fd) == size, "filesize matches bytes written");
+  msg ("close \"/tmp/big\"");
+  close (fd);
+  CHECK (remove ("/tmp/big"), "remove \"/tmp/big\"");
+
+  CHECK (create ("/tmp/big2", 0), "create \"/tmp/big2\"");
+  CHECK ((fd = open ("/tmp/big2")) > 1, "open \"/tmp/big2\"");
+  CHECK (write (fd, buf, sizeof buf) == sizeof buf,
+         "write %zu bytes", sizeof buf);
+  msg ("close \"/tmp/big2\"");
+  close (fd);
+}
@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(tmpfs-quota) begin
+(tmpfs-quota) create "/tmp/big"
+(tmpfs-quota) open "/tmp/big"
+(tmpfs-quota) write came up short
+(tmpfs-quota) filesize matches bytes written
+(tmpfs-quota) close "/tmp/big"
+(tmpfs-quota) remove "/tmp/big"
+(tmpfs-quota) create "/tmp/big2"
+(tmpfs-quota) open "/tmp/big2"
+(tmpfs-quota) write 65536 bytes
+(tmpfs-quota) close "/tmp/big2"
+(tmpfs-quota) end
+EOF
+pass;
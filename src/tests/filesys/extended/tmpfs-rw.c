@@ -0,0 +1,41 @@
+/* Writes files in and under the tmpfs mounted on /tmp and reads them
+   back.  None of it may reach the disk. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[3 * 4096 + 123];
+
+static void
+write_file (const char *name) 
+{
+  int fd;
+
+  CHECK (create (name, 0), "create \"%s\"", name);
+  CHECK ((fd = open (name)) > 1, "open \"%s\"", name);
+  CHECK (write (fd, buf, sizeof buf) == sizeof buf, "write \"%s\"", name);
+  msg ("close \"%s\"", name);
+  close (fd);
+}
+
+void
+test_main (void) 
+{
+  size_t i;
+  int fd;
+
+  for (i = 0; i < sizeof buf; i++)
+    buf[i] = i % 241;
+  write_file ("/tmp/a");
+  CHECK (mkdir ("/tmp/d"), "mkdir \"/tmp/d\"");
+  write_file ("/tmp/d/b");
+  check_file ("/tmp/a", buf, sizeof buf);
+  CHECK (chdir ("/tmp/d"), "chdir \"/tmp/d\"");
+  check_file ("b", buf, sizeof buf);
+  check_file ("../a", buf, sizeof buf);
+  CHECK (chdir ("../.."), "chdir \"../..\"");
+  CHECK ((fd = open ("tmpfs-rw")) > 1, "open \"tmpfs-rw\"");
+  msg ("close \"tmpfs-rw\"");
+  close (fd);
+}
@@ -0,0 +1,31 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(tmpfs-rw) begin
+(tmpfs-rw) create "/tmp/a"
+(tmpfs-rw) open "/tmp/a"
+(tmpfs-rw) write "/tmp/a"
+(tmpfs-rw) close "/tmp/a"
+(tmpfs-rw) mkdir "/tmp/d"
+(tmpfs-rw) create "/tmp/d/b"
+(tmpfs-rw) open "/tmp/d/b"
+(tmpfs-rw) write "/tmp/d/b"
+(tmpfs-rw) close "/tmp/d/b"
+(tmpfs-rw) open "/tmp/a" for verification
+(tmpfs-rw) verified contents of "/tmp/a"
+(tmpfs-rw) close "/tmp/a"
+(tmpfs-rw) chdir "/tmp/d"
+(tmpfs-rw) open "b" for verification
+(tmpfs-rw) verified contents of "b"
+(tmpfs-rw) close "b"
+(tmpfs-rw) open "../a" for verification
+(tmpfs-rw) verified contents of "../a"
+(tmpfs-rw) close "../a"
+(tmpfs-rw) chdir "../.."
+(tmpfs-rw) open "tmpfs-rw"
+(tmpfs-rw) close "tmpfs-rw"
+(tmpfs-rw) end
+EOF
+pass;
@@ -0,0 +1,41 @@
+/* Grows and shrinks a file in the tmpfs mounted on /tmp with
+   ftruncate().  Growing must read back zeros, also where the file
+   had data before it was shrunk. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[3 * 4096 + 10];
+
+void
+test_main (void) 
+{
+  const char *file_name = "/tmp/f";
+  int fd;
+
+  CHECK (create (file_name, 0), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  memset (buf, 'x', 100);
+  CHECK (write (fd, buf, 100) == 100, "write 100 bytes");
+  CHECK (ftruncate (fd, sizeof buf), "grow to %zu bytes", sizeof buf);
+  memset (buf + 100, 0, sizeof buf - 100);
+  seek (fd, 0);
+  check_file_handle (fd, file_name, buf, sizeof buf);
+
+  CHECK (ftruncate (fd, 50), "shrink to 50 bytes");
+  seek (fd, 0);
+  check_file_handle (fd, file_name, buf, 50);
+
+  CHECK (ftruncate (fd, 2 * 4096), "grow to 8192 bytes");
+  memset (buf + 50, 0, 50);
+  seek (fd, 0);
+  check_file_handle (fd, file_name, buf, 2 * 4096);
+
+  CHECK (ftruncate (fd, 0), "shrink to 0 bytes");
+  seek (fd, 0);
+  check_file_handle (fd, file_name, buf, 0);
+  msg ("close \"%s\"", file_name);
+  close (fd);
+}
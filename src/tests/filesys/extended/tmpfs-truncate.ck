@@ -0,0 +1,21 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(tmpfs-truncate) begin
+(tmpfs-truncate) create "/tmp/f"
+(tmpfs-truncate) open "/tmp/f"
+(tmpfs-truncate) write 100 bytes
+(tmpfs-truncate) grow to 12298 bytes
+(tmpfs-truncate) verified contents of "/tmp/f"
+(tmpfs-truncate) shrink to 50 bytes
+(tmpfs-truncate) verified contents of "/tmp/f"
+(tmpfs-truncate) grow to 8192 bytes
+(tmpfs-truncate) verified contents of "/tmp/f"
+(tmpfs-truncate) shrink to 0 bytes
+(tmpfs-truncate) verified contents of "/tmp/f"
+(tmpfs-truncate) close "/tmp/f"
+(tmpfs-truncate) end
+EOF
+pass;
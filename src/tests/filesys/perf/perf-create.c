@@ -0,0 +1,51 @@
+/* Measures the rates of creating and deleting small files. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/perf.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_CNT 200
+#define FILE_SIZE 100
+
+static char buf[FILE_SIZE];
+
+void
+test_main (void)
+{
+  struct perf p;
+  int i;
+
+  CHECK (mkdir ("small"), "mkdir \"small\"");
+  CHECK (chdir ("small"), "chdir \"small\"");
+
+  perf_start (&p, "create", perf_fs_stats);
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      char name[16];
+      int fd;
+
+      snprintf (name, sizeof name, "f%d", i);
+      if (!create (name, 0) || (fd = open (name)) < 2)
+        fail ("create \"%s\" failed", name);
+      if (write (fd, buf, FILE_SIZE) != FILE_SIZE)
+        fail ("write \"%s\" failed", name);
+      close (fd);
+    }
+  perf_end (&p, FILE_CNT, FILE_CNT * FILE_SIZE);
+
+  perf_start (&p, "remove", perf_fs_stats);
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      char name[16];
+
+      snprintf (name, sizeof name, "f%d", i);
+      if (!remove (name))
+        fail ("remove \"%s\" failed", name);
+    }
+  perf_end (&p, FILE_CNT, 0);
+
+  CHECK (chdir (".."), "chdir \"..\"");
+  CHECK (remove ("small"), "remove \"small\"");
+}
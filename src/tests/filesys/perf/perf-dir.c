@@ -0,0 +1,50 @@
+/* Measures how looking up names scales with directory size. */
+
+#include <random.h>
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/perf.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define LOOKUP_CNT 256
+
+/* Fills a new directory with SIZE files, then opens LOOKUP_CNT of
+   them at random, measuring the lookups. */
+static void
+dir_pass (int size)
+{
+  char dir[16], name[32], label[32];
+  struct perf p;
+  int i;
+
+  snprintf (dir, sizeof dir, "dir%d", size);
+  CHECK (mkdir (dir), "mkdir \"%s\"", dir);
+  for (i = 0; i < size; i++)
+    {
+      snprintf (name, sizeof name, "%s/f%d", dir, i);
+      if (!create (name, 0))
+        fail ("create \"%s\" failed", name);
+    }
+
+  snprintf (label, sizeof label, "dir-lookup-%d", size);
+  perf_start (&p, label, perf_fs_stats);
+  for (i = 0; i < LOOKUP_CNT; i++)
+    {
+      int fd;
+
+      snprintf (name, sizeof name, "%s/f%lu", dir, random_ulong () % size);
+      if ((fd = open (name)) < 2)
+        fail ("open \"%s\" failed", name);
+      close (fd);
+    }
+  perf_end (&p, LOOKUP_CNT, 0);
+}
+
+void
+test_main (void)
+{
+  dir_pass (16);
+  dir_pass (64);
+  dir_pass (256);
+}
@@ -0,0 +1,6 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::perf;
+check_perf (qw (dir-lookup-16 dir-lookup-64 dir-lookup-256));
@@ -0,0 +1,38 @@
+/* Measures the rate of opening a file by a deep path. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/perf.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define DEPTH 16
+#define LOOKUP_CNT 500
+
+void
+test_main (void)
+{
+  char path[DEPTH * 2 + 8] = "";
+  struct perf p;
+  int i;
+
+  /* Make "/d/d/.../d" and a file at the bottom. */
+  for (i = 0; i < DEPTH; i++)
+    {
+      strlcat (path, "/d", sizeof path);
+      if (!mkdir (path))
+        fail ("mkdir \"%s\" failed", path);
+    }
+  strlcat (path, "/f", sizeof path);
+  CHECK (create (path, 0), "create \"%s\"", path);
+
+  perf_start (&p, "lookup-deep", perf_fs_stats);
+  for (i = 0; i < LOOKUP_CNT; i++)
+    {
+      int fd = open (path);
+      if (fd < 2)
+        fail ("open \"%s\" failed", path);
+      close (fd);
+    }
+  perf_end (&p, LOOKUP_CNT, 0);
+}
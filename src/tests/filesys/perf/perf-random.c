@@ -0,0 +1,66 @@
+/* Measures random read and write throughput within a large file,
+   at several block sizes. */
+
+#include <random.h>
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/perf.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE (512 * 1024)
+#define BLOCK_MAX 4096
+#define OP_CNT 512
+
+static char buf[BLOCK_MAX];
+
+/* Reads and then writes OP_CNT blocks of BLOCK_SIZE bytes at random
+   aligned offsets of the file open as FD, measuring each pass. */
+static void
+random_pass (int fd, size_t block_size)
+{
+  char name[32];
+  struct perf p;
+  size_t i;
+
+  snprintf (name, sizeof name, "random-read-%zu", block_size);
+  perf_start (&p, name, perf_fs_stats);
+  for (i = 0; i < OP_CNT; i++)
+    {
+      unsigned ofs = random_ulong () % (FILE_SIZE / block_size) * block_size;
+      if (pread (fd, buf, block_size, ofs) != (int) block_size)
+        fail ("read %zu bytes at offset %u failed", block_size, ofs);
+    }
+  perf_end (&p, OP_CNT, OP_CNT * block_size);
+
+  snprintf (name, sizeof name, "random-write-%zu", block_size);
+  perf_start (&p, name, perf_fs_stats);
+  for (i = 0; i < OP_CNT; i++)
+    {
+      unsigned ofs = random_ulong () % (FILE_SIZE / block_size) * block_size;
+      if (pwrite (fd, buf, block_size, ofs) != (int) block_size)
+        fail ("write %zu bytes at offset %u failed", block_size, ofs);
+    }
+  fsync (fd);
+  perf_end (&p, OP_CNT, OP_CNT * block_size);
+}
+
+void
+test_main (void)
+{
+  size_t ofs;
+  int fd;
+
+  CHECK (create ("random", 0), "create \"random\"");
+  CHECK ((fd = open ("random")) > 1, "open \"random\"");
+  for (ofs = 0; ofs < FILE_SIZE; ofs += BLOCK_MAX)
+    if (write (fd, buf, BLOCK_MAX) != BLOCK_MAX)
+      fail ("write %d bytes at offset %zu failed", BLOCK_MAX, ofs);
+  fsync (fd);
+
+  random_pass (fd, 512);
+  random_pass (fd, BLOCK_MAX);
+
+  close (fd);
+  CHECK (remove ("random"), "remove \"random\"");
+}
@@ -0,0 +1,6 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::perf;
+check_perf (map ("random-$_", qw (read-512 write-512 read-4096 write-4096)));
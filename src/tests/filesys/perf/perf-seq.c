@@ -0,0 +1,54 @@
+/* Measures sequential write and read throughput of a large file,
+   at several block sizes. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/perf.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE (512 * 1024)
+#define BLOCK_MAX 32768
+
+static char buf[BLOCK_MAX];
+
+/* Writes and then reads back a FILE_SIZE-byte file BLOCK_SIZE bytes
+   at a time, measuring each pass. */
+static void
+seq_pass (size_t block_size)
+{
+  char name[32];
+  struct perf p;
+  size_t ofs;
+  int fd;
+
+  CHECK (create ("seq", 0), "create \"seq\"");
+  CHECK ((fd = open ("seq")) > 1, "open \"seq\"");
+
+  snprintf (name, sizeof name, "seq-write-%zu", block_size);
+  perf_start (&p, name, perf_fs_stats);
+  for (ofs = 0; ofs < FILE_SIZE; ofs += block_size)
+    if (write (fd, buf, block_size) != (int) block_size)
+      fail ("write %zu bytes at offset %zu failed", block_size, ofs);
+  fsync (fd);
+  perf_end (&p, FILE_SIZE / block_size, FILE_SIZE);
+
+  seek (fd, 0);
+  snprintf (name, sizeof name, "seq-read-%zu", block_size);
+  perf_start (&p, name, perf_fs_stats);
+  for (ofs = 0; ofs < FILE_SIZE; ofs += block_size)
+    if (read (fd, buf, block_size) != (int) block_size)
+      fail ("read %zu bytes at offset %zu failed", block_size, ofs);
+  perf_end (&p, FILE_SIZE / block_size, FILE_SIZE);
+
+  close (fd);
+  CHECK (remove ("seq"), "remove \"seq\"");
+}
+
+void
+test_main (void)
+{
+  seq_pass (512);
+  seq_pass (4096);
+  seq_pass (BLOCK_MAX);
+}
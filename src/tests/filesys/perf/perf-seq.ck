@@ -0,0 +1,7 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::perf;
+check_perf (map ("seq-$_", qw (write-512 read-512 write-4096 read-4096
+                               write-32768 read-32768)));
@@ -0,0 +1,191 @@
+/* Test program for lib/kernel/tree.c.
+
+   Attempts to test the tree functionality that is not
+   sufficiently tested elsewhere in Pintos.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <debug.h>
+#include <tree.h>
+#include <random.h>
+#include <stdio.h>
+#include "threads/test.h"
+
+/* Maximum number of elements in a tree that we will test. */
+#define MAX_SIZE 64
+
+/* A tree element. */
+struct value
+  {
+    struct tree_elem elem;      /* Tree element. */
+    int value;                  /* Item value, twice its index. */
+  };
+
+static void shuffle (struct value *[], size_t);
+static bool value_less (const struct tree_elem *, const struct tree_elem *,
+                        void *);
+static int verify_subtree (const struct tree_elem *, size_t *cnt);
+static void verify_tree (struct tree *, struct value *[], int size);
+
+/* Test the tree implementation. */
+void
+test (void)
+{
+  int size;
+
+  printf ("testing various size trees:");
+  for (size = 0; size < MAX_SIZE; size++)
+    {
+      int repeat;
+
+      printf (" %d", size);
+      for (repeat = 0; repeat < 10; repeat++)
+        {
+          static struct value values[MAX_SIZE];
+          struct value *order[MAX_SIZE];
+          struct tree tree;
+          int i;
+
+          /* Insert values 0, 2, ..., 2 * (SIZE - 1) in random
+             order.  Elements in a tree must stay put, so ORDER is
+             shuffled rather than VALUES. */
+          for (i = 0; i < size; i++)
+            {
+              values[i].value = 2 * i;
+              order[i] = &values[i];
+            }
+          shuffle (order, size);
+          tree_init (&tree, value_less, NULL);
+          for (i = 0; i < size; i++)
+            tree_insert (&tree, &order[i]->elem);
+          verify_tree (&tree, order, size);
+
+          /* Remove half of them in random order, then put them
+             back. */
+          shuffle (order, size);
+          for (i = 0; i < size / 2; i++)
+            tree_remove (&tree, &order[i]->elem);
+          ASSERT (tree_size (&tree) == (size_t) (size - size / 2));
+          for (i = 0; i < size / 2; i++)
+            tree_insert (&tree, &order[i]->elem);
+          verify_tree (&tree, order, size);
+
+          /* Remove all of them. */
+          for (i = 0; i < size; i++)
+            tree_remove (&tree, &order[i]->elem);
+          ASSERT (tree_empty (&tree));
+          ASSERT (tree_min (&tree) == NULL && tree_max (&tree) == NULL);
+        }
+    }
+
+  printf (" done\n");
+  printf ("tree: PASS\n");
+}
+
+/* Shuffles the CNT elements in ARRAY into random order. */
+static void
+shuffle (struct value **array, size_t cnt)
+{
+  size_t i;
+
+  for (i = 0; i < cnt; i++)
+    {
+      size_t j = i + random_ulong () % (cnt - i);
+      struct value *t = array[j];
+      array[j] = array[i];
+      array[i] = t;
+    }
+}
+
+/* Returns true if value A is less than value B, false
+   otherwise. */
+static bool
+value_less (const struct tree_elem *a_, const struct tree_elem *b_,
+            void *aux UNUSED)
+{
+  const struct value *a = tree_entry (a_, struct value, elem);
+  const struct value *b = tree_entry (b_, struct value, elem);
+
+  return a->value < b->value;
+}
+
+/* Verifies that the subtree rooted at E is ordered by value and by
+   priority as a heap, adds its number of elements to *CNT, and
+   returns its height. */
+static int
+verify_subtree (const struct tree_elem *e, size_t *cnt)
+{
+  const struct value *v;
+  int left, right;
+
+  if (e == NULL)
+    return 0;
+
+  v = tree_entry (e, struct value, elem);
+  if (e->left != NULL)
+    {
+      ASSERT (tree_entry (e->left, struct value, elem)->value < v->value);
+      ASSERT (e->left->priority <= e->priority);
+    }
+  if (e->right != NULL)
+    {
+      ASSERT (tree_entry (e->right, struct value, elem)->value > v->value);
+      ASSERT (e->right->priority <= e->priority);
+    }
+  ++*cnt;
+
+  left = verify_subtree (e->left, cnt);
+  right = verify_subtree (e->right, cnt);
+  return 1 + (left > right ? left : right);
+}
+
+/* Verifies that TREE holds the SIZE elements VALUES point to, with
+   values 0, 2, ..., 2 * (SIZE - 1), in a valid treap, and that
+   lookups and traversal in both directions find them. */
+static void
+verify_tree (struct tree *tree, struct value *values[], int size)
+{
+  struct tree_elem *e;
+  struct value key;
+  size_t cnt = 0;
+  int height;
+  int i;
+
+  ASSERT (tree_size (tree) == (size_t) size);
+  height = verify_subtree (tree->root, &cnt);
+  ASSERT (cnt == (size_t) size);
+  ASSERT (height <= size);
+
+  /* Forward and backward traversal. */
+  for (i = 0, e = tree_min (tree); e != NULL; i++, e = tree_next (tree, e))
+    ASSERT (tree_entry (e, struct value, elem)->value == 2 * i);
+  ASSERT (i == size);
+  for (i = size - 1, e = tree_max (tree); e != NULL;
+       i--, e = tree_prev (tree, e))
+    ASSERT (tree_entry (e, struct value, elem)->value == 2 * i);
+  ASSERT (i == -1);
+
+  /* Exact and range lookups, at each value and between them. */
+  for (i = 0; i < size; i++)
+    {
+      key.value = values[i]->value;
+      ASSERT (tree_find (tree, &key.elem) == &values[i]->elem);
+      ASSERT (tree_ceiling (tree, &key.elem) == &values[i]->elem);
+      ASSERT (tree_floor (tree, &key.elem) == &values[i]->elem);
+
+      key.value = values[i]->value + 1;
+      ASSERT (tree_find (tree, &key.elem) == NULL);
+      e = tree_ceiling (tree, &key.elem);
+      ASSERT (values[i]->value == 2 * (size - 1)
+              ? e == NULL
+              : tree_entry (e, struct value, elem)->value == key.value + 1);
+      e = tree_floor (tree, &key.elem);
+      ASSERT (e == &values[i]->elem);
+    }
+  key.value = -1;
+  ASSERT (tree_floor (tree, &key.elem) == NULL);
+  ASSERT (tree_ceiling (tree, &key.elem) == tree_min (tree));
+}
@@ -0,0 +1,81 @@
+#include "tests/perf.h"
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+
+/* Kernel statistics a measurement may report the change in, in the
+   order printed. */
+const char *const perf_fs_stats[] =
+  {
+    "timer.ticks", "timer.ns", "cache.hit", "cache.miss", "cache.evict",
+    "cache.write_back", "cache.read_ahead", "inode.reuse",
+    "block.filesys.read", "block.filesys.write", NULL,
+  };
+const char *const perf_vm_stats[] =
+  {
+    "timer.ticks", "timer.ns", "fault.new", "fault.zero", "fault.swap",
+    "fault.file", "frame.reclaim", "frame.sweep", "frame.evict.swap",
+    "frame.evict.file", "swap.out.clean", "share.merge", "block.swap.read",
+    "block.swap.write", NULL,
+  };
+const char *const perf_sys_stats[] =
+  {
+    "timer.ticks", "timer.ns", NULL,
+  };
+
+static struct kstat stats[PERF_STATS_MAX];
+
+/* Returns the value of statistic NAME among the CNT in STATS, or 0
+   if the kernel doesn't keep it. */
+static unsigned long long
+stat_value (const struct kstat *stats, size_t cnt, const char *name)
+{
+  size_t i;
+
+  for (i = 0; i < cnt; i++)
+    if (!strcmp (stats[i].name, name))
+      return stats[i].value;
+  return 0;
+}
+
+/* Starts measurement NAME in P, which will report the statistics
+   in REPORTED, one of the lists above or another like them. */
+void
+perf_start (struct perf *p, const char *name, const char *const *reported)
+{
+  int cnt = kstat (p->start, PERF_STATS_MAX);
+
+  if (cnt < 0)
+    fail ("kstat failed");
+  p->name = name;
+  p->reported = reported;
+  p->stat_cnt = cnt;
+}
+
+/* Ends measurement P, which did OPS operations moving BYTES bytes,
+   and prints it as a single line:
+
+     perf NAME ops=OPS bytes=BYTES STAT=CHANGE...
+
+   with the change in each of the kernel statistics reported by P
+   since perf_start(). */
+void
+perf_end (struct perf *p, unsigned long long ops, unsigned long long bytes)
+{
+  char line[512];
+  size_t len;
+  int cnt = kstat (stats, PERF_STATS_MAX);
+  const char *const *r;
+
+  if (cnt < 0)
+    fail ("kstat failed");
+  len = snprintf (line, sizeof line, "perf %s ops=%llu bytes=%llu",
+                  p->name, ops, bytes);
+  for (r = p->reported; *r != NULL; r++)
+    if (len < sizeof line)
+      len += snprintf (line + len, sizeof line - len, " %s=%llu", *r,
+                       (stat_value (stats, cnt, *r)
+                        - stat_value (p->start, p->stat_cnt, *r)));
+  msg ("%s", line);
+}
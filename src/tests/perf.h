@@ -0,0 +1,31 @@
+#ifndef TESTS_PERF_H
+#define TESTS_PERF_H
+
+#include <kstat.h>
+#include <stddef.h>
+
+/* Most kernel statistics read at once. */
+#define PERF_STATS_MAX 64
+
+/* A measurement in progress. */
+struct perf
+  {
+    const char *name;                   /* Name of the measurement. */
+    const char *const *reported;        /* Statistics to report. */
+    struct kstat start[PERF_STATS_MAX]; /* Statistics when started. */
+    size_t stat_cnt;                    /* Number in START. */
+  };
+
+/* Null-terminated lists of the kernel statistics that matter to
+   file system and virtual memory measurements, and of just the
+   elapsed time. */
+extern const char *const perf_fs_stats[];
+extern const char *const perf_vm_stats[];
+extern const char *const perf_sys_stats[];
+
+void perf_start (struct perf *, const char *name,
+                 const char *const *reported);
+void perf_end (struct perf *, unsigned long long ops,
+               unsigned long long bytes);
+
+#endif /* tests/perf.h */
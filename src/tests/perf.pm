@@ -0,0 +1,59 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+# Checks a performance test's output.  The run must complete and
+# print a "perf NAME KEY=VALUE..." line for each NAME in @NAMES.
+#
+# The measurements are written to TEST.perf, in the same format
+# without the test name prefix, so that they can be kept as a
+# baseline.  If the PERF_BASELINE environment variable names a
+# directory holding a TEST.perf for this test, every value other
+# than "ops" and "bytes" must not exceed its baseline by more than
+# PERF_TOLERANCE percent, 20 by default, give or take 2 so that
+# small counts may vary a little.
+sub check_perf {
+    my (@names) = @_;
+    our ($test);
+    my (@output) = read_text_file ("$test.output");
+    common_checks ("run", @output);
+    my (@core) = get_core_output ("run", @output);
+
+    my ($prog) = $test =~ m%([^/]+)$%;
+    my (%results);
+    my (@lines);
+    for (@core) {
+	my ($name, $values) = /^\(\Q$prog\E\) perf (\S+) (.*)$/ or next;
+	$results{$name} = {map (split (/=/, $_, 2), split (' ', $values))};
+	push (@lines, "$name $values");
+    }
+    fail "missing \"end\" message\n" if !grep ($_ eq "($prog) end", @core);
+    for my $name (@names) {
+	fail "missing measurement $name\n" if !defined $results{$name};
+    }
+
+    open (PERF, '>', "$test.perf") or die "$test.perf: create: $!\n";
+    print PERF "$_\n" foreach @lines;
+    close (PERF);
+
+    my ($baseline_dir) = $ENV{PERF_BASELINE};
+    pass if !defined ($baseline_dir) || ! -e "$baseline_dir/$prog.perf";
+    my ($tolerance) = $ENV{PERF_TOLERANCE} // 20;
+    my (@slower);
+    for (read_text_file ("$baseline_dir/$prog.perf")) {
+	my ($name, $values) = /^(\S+) (.*)$/ or next;
+	next if !defined $results{$name};
+	for (split (' ', $values)) {
+	    my ($key, $base) = split (/=/, $_, 2);
+	    next if $key eq 'ops' || $key eq 'bytes';
+	    my ($value) = $results{$name}{$key};
+	    next if !defined ($value) || $value <= $base * (1 + $tolerance / 100) + 2;
+	    push (@slower, "$name $key: $value vs. $base in baseline\n");
+	}
+    }
+    fail "More than $tolerance% worse than baseline:\n", @slower if @slower;
+    pass;
+}
+
+1;
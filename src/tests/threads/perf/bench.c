@@ -0,0 +1,32 @@
+#include "tests/threads/perf/bench.h"
+#include <inttypes.h>
+#include "tests/threads/tests.h"
+
+/* Kernel-mode benchmarks report their measurements in the same
+   format as the user programs of the other performance tests, so
+   that tests/perf.pm can check them and compare them against a
+   baseline:
+
+     perf NAME ops=OPS cycles=CYCLES per-op=CYCLES/OPS
+
+   Cycles are time stamp counter ticks. */
+
+/* Reports measurement NAME, in which OPS operations took CYCLES
+   cycles in all. */
+void
+bench_report (const char *name, unsigned ops, uint64_t cycles)
+{
+  msg ("perf %s ops=%u cycles=%"PRIu64" per-op=%"PRIu64,
+       name, ops, cycles, ops > 0 ? cycles / ops : 0);
+}
+
+/* Reports measurement NAME like bench_report(), adding that the
+   fastest of the operations took MIN cycles and the slowest MAX. */
+void
+bench_report_range (const char *name, unsigned ops, uint64_t cycles,
+                    uint64_t min, uint64_t max)
+{
+  msg ("perf %s ops=%u cycles=%"PRIu64" per-op=%"PRIu64" min=%"PRIu64
+       " max=%"PRIu64,
+       name, ops, cycles, ops > 0 ? cycles / ops : 0, min, max);
+}
@@ -0,0 +1,13 @@
+#ifndef TESTS_THREADS_PERF_BENCH_H
+#define TESTS_THREADS_PERF_BENCH_H
+
+#include <stdint.h>
+
+/* Rounds most of the benchmarks repeat their operation. */
+#define BENCH_ITERATIONS 10000
+
+void bench_report (const char *name, unsigned ops, uint64_t cycles);
+void bench_report_range (const char *name, unsigned ops, uint64_t cycles,
+                         uint64_t min, uint64_t max);
+
+#endif /* tests/threads/perf/bench.h */
@@ -0,0 +1,109 @@
+/* Measures lock acquire and release:
+
+   - "uncontended": the main thread takes and releases a lock no
+     one else wants.
+
+   - "contended": two threads of the same priority take the lock
+     and yield while holding it, so that the other blocks on it.
+
+   - "donate": the main thread holds the lock while a
+     higher-priority thread blocks on it and donates its priority,
+     then hands the lock over by releasing it. */
+
+#include "tests/threads/tests.h"
+#include "tests/threads/perf/bench.h"
+#include "devices/timer.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Shared with the helper threads. */
+struct lock_bench
+  {
+    struct lock lock;           /* Lock measured. */
+    struct semaphore go;        /* Lets the donor start a round. */
+    struct semaphore done;      /* Helper finished. */
+  };
+
+static thread_func contend_thread;
+static thread_func donor_thread;
+
+void
+test_perf_lock (void)
+{
+  struct lock_bench b;
+  uint64_t start;
+  int i;
+
+  ASSERT (!thread_mlfqs);
+  ASSERT (thread_get_priority () == PRI_DEFAULT);
+
+  lock_init (&b.lock);
+  sema_init (&b.go, 0);
+  sema_init (&b.done, 0);
+
+  start = timer_tsc ();
+  for (i = 0; i < BENCH_ITERATIONS; i++)
+    {
+      lock_acquire (&b.lock);
+      lock_release (&b.lock);
+    }
+  bench_report ("uncontended", BENCH_ITERATIONS, timer_tsc () - start);
+
+  thread_create ("contender", PRI_DEFAULT, contend_thread, &b);
+  start = timer_tsc ();
+  for (i = 0; i < BENCH_ITERATIONS; i++)
+    {
+      lock_acquire (&b.lock);
+      thread_yield ();
+      lock_release (&b.lock);
+    }
+  sema_down (&b.done);
+  bench_report ("contended", 2 * BENCH_ITERATIONS, timer_tsc () - start);
+
+  thread_create ("donor", PRI_DEFAULT + 1, donor_thread, &b);
+  start = timer_tsc ();
+  for (i = 0; i < BENCH_ITERATIONS; i++)
+    {
+      lock_acquire (&b.lock);
+      sema_up (&b.go);
+      lock_release (&b.lock);
+    }
+  sema_down (&b.done);
+  bench_report ("donate", BENCH_ITERATIONS, timer_tsc () - start);
+}
+
+/* Takes the lock BENCH_ITERATIONS times, yielding while holding it,
+   against the main thread doing the same. */
+static void
+contend_thread (void *b_)
+{
+  struct lock_bench *b = b_;
+  int i;
+
+  for (i = 0; i < BENCH_ITERATIONS; i++)
+    {
+      lock_acquire (&b->lock);
+      thread_yield ();
+      lock_release (&b->lock);
+    }
+  sema_up (&b->done);
+}
+
+/* Each round, waits for the main thread to take the lock and then
+   blocks acquiring it, donating its priority until the main thread
+   releases it. */
+static void
+donor_thread (void *b_)
+{
+  struct lock_bench *b = b_;
+  int i;
+
+  for (i = 0; i < BENCH_ITERATIONS; i++)
+    {
+      sema_down (&b->go);
+      lock_acquire (&b->lock);
+      lock_release (&b->lock);
+    }
+  sema_up (&b->done);
+}
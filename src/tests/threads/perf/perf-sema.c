@@ -0,0 +1,48 @@
+/* Measures semaphore ping-pong latency: the main thread ups one
+   semaphore and downs another, which a thread of the same priority
+   ups in turn, so each round trip is two wake-ups and two context
+   switches. */
+
+#include "tests/threads/tests.h"
+#include "tests/threads/perf/bench.h"
+#include "devices/timer.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+static struct semaphore ping, pong;
+
+static thread_func pong_thread;
+
+void
+test_perf_sema (void)
+{
+  uint64_t start;
+  int i;
+
+  ASSERT (thread_get_priority () == PRI_DEFAULT);
+
+  sema_init (&ping, 0);
+  sema_init (&pong, 0);
+  thread_create ("pong", PRI_DEFAULT, pong_thread, NULL);
+
+  start = timer_tsc ();
+  for (i = 0; i < BENCH_ITERATIONS; i++)
+    {
+      sema_up (&ping);
+      sema_down (&pong);
+    }
+  bench_report ("ping-pong", BENCH_ITERATIONS, timer_tsc () - start);
+}
+
+static void
+pong_thread (void *aux UNUSED)
+{
+  int i;
+
+  for (i = 0; i < BENCH_ITERATIONS; i++)
+    {
+      sema_down (&ping);
+      sema_up (&pong);
+    }
+}
@@ -0,0 +1,47 @@
+/* Measures timer_sleep() wake-up jitter: how much the time a thread
+   actually sleeps for, in cycles, varies from one sleep of the same
+   number of ticks to the next.  Each sleep starts right after a
+   timer tick, so ideally all take exactly the same time. */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "tests/threads/perf/bench.h"
+#include "devices/timer.h"
+#include "threads/init.h"
+#include "threads/thread.h"
+
+/* Sleeps measured for each duration. */
+#define SLEEP_CNT 50
+
+static void
+sleep_pass (int64_t ticks)
+{
+  char name[16];
+  uint64_t total = 0, min = UINT64_MAX, max = 0;
+  int i;
+
+  timer_sleep (1);
+  for (i = 0; i < SLEEP_CNT; i++)
+    {
+      uint64_t start = timer_tsc ();
+      uint64_t elapsed;
+
+      timer_sleep (ticks);
+      elapsed = timer_tsc () - start;
+      total += elapsed;
+      if (elapsed < min)
+        min = elapsed;
+      if (elapsed > max)
+        max = elapsed;
+    }
+  snprintf (name, sizeof name, "sleep-%"PRId64, ticks);
+  bench_report_range (name, SLEEP_CNT, total, min, max);
+}
+
+void
+test_perf_sleep (void)
+{
+  sleep_pass (1);
+  sleep_pass (4);
+}
@@ -0,0 +1,43 @@
+/* Measures the cost of a context switch: the main thread and
+   another of the same priority yield to each other back and forth,
+   each switch going straight to the other thread. */
+
+#include "tests/threads/tests.h"
+#include "tests/threads/perf/bench.h"
+#include "devices/timer.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+static thread_func yield_thread;
+
+void
+test_perf_switch (void)
+{
+  struct semaphore done;
+  uint64_t start;
+  int i;
+
+  ASSERT (thread_get_priority () == PRI_DEFAULT);
+
+  sema_init (&done, 0);
+  thread_create ("yielder", PRI_DEFAULT, yield_thread, &done);
+  thread_yield ();
+
+  start = timer_tsc ();
+  for (i = 0; i < BENCH_ITERATIONS; i++)
+    thread_yield ();
+  sema_down (&done);
+  bench_report ("switch", 2 * BENCH_ITERATIONS, timer_tsc () - start);
+}
+
+static void
+yield_thread (void *done_)
+{
+  struct semaphore *done = done_;
+  int i;
+
+  for (i = 0; i < BENCH_ITERATIONS; i++)
+    thread_yield ();
+  sema_up (done);
+}
@@ -0,0 +1,55 @@
+/* Measures creating threads and having them exit, N at a time: the
+   main thread creates N threads of the same priority, which do not
+   run until it waits for all of them to finish. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "tests/threads/perf/bench.h"
+#include "devices/timer.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Times each batch of threads is created. */
+#define ROUND_CNT 20
+
+static thread_func exit_thread;
+
+static void
+create_pass (int thread_cnt)
+{
+  struct semaphore done;
+  char name[16];
+  uint64_t start;
+  int round, i;
+
+  sema_init (&done, 0);
+  start = timer_tsc ();
+  for (round = 0; round < ROUND_CNT; round++)
+    {
+      for (i = 0; i < thread_cnt; i++)
+        if (thread_create ("exiter", PRI_DEFAULT, exit_thread, &done)
+            == TID_ERROR)
+          fail ("thread_create failed with %d threads", i);
+      for (i = 0; i < thread_cnt; i++)
+        sema_down (&done);
+    }
+  snprintf (name, sizeof name, "create-%d", thread_cnt);
+  bench_report (name, ROUND_CNT * thread_cnt, timer_tsc () - start);
+}
+
+void
+test_perf_thread (void)
+{
+  ASSERT (thread_get_priority () == PRI_DEFAULT);
+
+  create_pass (1);
+  create_pass (8);
+  create_pass (32);
+}
+
+static void
+exit_thread (void *done)
+{
+  sema_up (done);
+}
@@ -65,7 +65,7 @@ test_priority_fifo (void)
 
   thread_set_priority (PRI_DEFAULT);
   /* All the other threads now run to termination here. */
-  ASSERT (lock.holder == NULL);
+  ASSERT (lock_holder (&lock) == NULL);
 
   cnt = 0;
   for (; output < op; output++) 
@@ -38,6 +38,11 @@ static const struct test tests[] =
     {"mlfqs-nice-2", test_mlfqs_nice_2},
     {"mlfqs-nice-10", test_mlfqs_nice_10},
     {"mlfqs-block", test_mlfqs_block},
+    {"perf-switch", test_perf_switch},
+    {"perf-lock", test_perf_lock},
+    {"perf-sema", test_perf_sema},
+    {"perf-sleep", test_perf_sleep},
+    {"perf-thread", test_perf_thread},
   };
 
 static const char *test_name;
@@ -32,6 +32,11 @@ extern test_func test_mlfqs_fair_20;
 extern test_func test_mlfqs_nice_2;
 extern test_func test_mlfqs_nice_10;
 extern test_func test_mlfqs_block;
+extern test_func test_perf_switch;
+extern test_func test_perf_lock;
+extern test_func test_perf_sema;
+extern test_func test_perf_sleep;
+extern test_func test_perf_thread;
 
 void msg (const char *, ...);
 void fail (const char *, ...);
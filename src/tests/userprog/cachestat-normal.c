@@ -0,0 +1,37 @@
+/* Writes a file a few sectors long and reads it back twice,
+   checking with cachestat() that the reads looked its sectors up
+   in the buffer cache, which charged them to the process, and
+   found them there.  (A smaller file would be kept in its inode,
+   out of the cache.) */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE 2048
+
+static char buf[FILE_SIZE];
+
+void
+test_main (void)
+{
+  struct cachestat before, first, second;
+  int handle;
+
+  memset (buf, 'c', sizeof buf);
+  CHECK (create ("data", FILE_SIZE), "create \"data\"");
+  CHECK ((handle = open ("data")) > 1, "open \"data\"");
+  CHECK (write (handle, buf, FILE_SIZE) == FILE_SIZE, "write \"data\"");
+  seek (handle, 0);
+  cachestat (&before);
+  CHECK (read (handle, buf, FILE_SIZE) == FILE_SIZE, "read \"data\"");
+  cachestat (&first);
+  CHECK (first.hits + first.misses > before.hits + before.misses,
+         "read looked up the cache");
+  CHECK (first.sectors > 0, "cached sectors charged to the process");
+  seek (handle, 0);
+  CHECK (read (handle, buf, FILE_SIZE) == FILE_SIZE, "read \"data\" again");
+  cachestat (&second);
+  CHECK (second.hits > first.hits, "second read hit the cache");
+}
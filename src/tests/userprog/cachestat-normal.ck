@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(cachestat-normal) begin
+(cachestat-normal) create "data"
+(cachestat-normal) open "data"
+(cachestat-normal) write "data"
+(cachestat-normal) read "data"
+(cachestat-normal) read looked up the cache
+(cachestat-normal) cached sectors charged to the process
+(cachestat-normal) read "data" again
+(cachestat-normal) second read hit the cache
+(cachestat-normal) end
+cachestat-normal: exit(0)
+EOF
+pass;
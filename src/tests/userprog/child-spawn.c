@@ -0,0 +1,32 @@
+/* Child process run by spawn-actions test.
+   Checks the descriptors and working directory that spawn-actions
+   asked spawn() to set up for it. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/userprog/sample.inc"
+
+int
+main (void) 
+{
+  char buf[sizeof sample];
+  int fd;
+
+  test_name = "child-spawn";
+  if (read (3, buf, sizeof buf) != sizeof sample - 1
+      || memcmp (buf, sample, sizeof sample - 1))
+    fail ("fd 3 does not read \"sample.txt\"");
+  msg ("fd 3 reads \"sample.txt\"");
+  if (read (5, buf, 10) != 10 || memcmp (buf, sample + 10, 10))
+    fail ("fd 5 does not read \"sample.txt\" from offset 10");
+  msg ("fd 5 reads \"sample.txt\" from offset 10");
+  if (read (4, buf, 1) != -1)
+    fail ("fd 4 is open");
+  msg ("fd 4 is not open");
+  if ((fd = open ("marker")) < 2)
+    fail ("open \"marker\" failed");
+  msg ("open \"marker\" in \"d\"");
+  close (fd);
+  return 0;
+}
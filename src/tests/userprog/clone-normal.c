@@ -0,0 +1,52 @@
+/* Clones a file and checks that the copy has its contents, and that
+   writing either one afterward leaves the other as it was. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+#include "tests/userprog/sample.inc"
+
+static void
+write_at (const char *name, unsigned ofs, const char *data) 
+{
+  int fd;
+
+  CHECK ((fd = open (name)) > 1, "open \"%s\"", name);
+  seek (fd, ofs);
+  CHECK (write (fd, data, strlen (data)) == (int) strlen (data),
+         "write \"%s\" at %u", name, ofs);
+  msg ("close \"%s\"", name);
+  close (fd);
+}
+
+void
+test_main (void) 
+{
+  char a[sizeof sample], b[sizeof sample];
+  int fd;
+
+  CHECK (create ("a", 0), "create \"a\"");
+  CHECK ((fd = open ("a")) > 1, "open \"a\"");
+  CHECK (write (fd, sample, sizeof sample - 1) == sizeof sample - 1,
+         "write \"a\"");
+  msg ("close \"a\"");
+  close (fd);
+  CHECK (clone ("a", "b"), "clone \"a\" to \"b\"");
+  check_file ("b", sample, sizeof sample - 1);
+
+  memcpy (a, sample, sizeof sample);
+  memcpy (b, sample, sizeof sample);
+  write_at ("b", 0, "Bbbb");
+  memcpy (b, "Bbbb", 4);
+  check_file ("a", a, sizeof sample - 1);
+  write_at ("a", 10, "Aaaa");
+  memcpy (a + 10, "Aaaa", 4);
+  check_file ("b", b, sizeof sample - 1);
+  check_file ("a", a, sizeof sample - 1);
+
+  CHECK (!clone ("a", "b"), "clone \"a\" to \"b\" again (must fail)");
+  CHECK (!clone ("missing", "c"), "clone \"missing\" (must fail)");
+  CHECK (mkdir ("d"), "mkdir \"d\"");
+  CHECK (!clone ("d", "e"), "clone \"d\" (must fail)");
+}
@@ -0,0 +1,37 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(clone-normal) begin
+(clone-normal) create "a"
+(clone-normal) open "a"
+(clone-normal) write "a"
+(clone-normal) close "a"
+(clone-normal) clone "a" to "b"
+(clone-normal) open "b" for verification
+(clone-normal) verified contents of "b"
+(clone-normal) close "b"
+(clone-normal) open "b"
+(clone-normal) write "b" at 0
+(clone-normal) close "b"
+(clone-normal) open "a" for verification
+(clone-normal) verified contents of "a"
+(clone-normal) close "a"
+(clone-normal) open "a"
+(clone-normal) write "a" at 10
+(clone-normal) close "a"
+(clone-normal) open "b" for verification
+(clone-normal) verified contents of "b"
+(clone-normal) close "b"
+(clone-normal) open "a" for verification
+(clone-normal) verified contents of "a"
+(clone-normal) close "a"
+(clone-normal) clone "a" to "b" again (must fail)
+(clone-normal) clone "missing" (must fail)
+(clone-normal) mkdir "d"
+(clone-normal) clone "d" (must fail)
+(clone-normal) end
+clone-normal: exit(0)
+EOF
+pass;
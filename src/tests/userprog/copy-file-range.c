@@ -0,0 +1,34 @@
+/* Copies part of a file to another with copy_file_range(), which must
+   copy from the position of one to the position of the other and
+   advance both. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+#include "tests/userprog/sample.inc"
+
+void
+test_main (void) 
+{
+  size_t size = sizeof sample - 1;
+  int in, out;
+
+  CHECK ((in = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK (create ("copy", 0), "create \"copy\"");
+  CHECK ((out = open ("copy")) > 1, "open \"copy\"");
+  seek (in, 10);
+  CHECK (copy_file_range (in, out, 50) == 50, "copy 50 bytes");
+  CHECK (tell (in) == 60 && tell (out) == 50, "both positions advanced");
+  CHECK (copy_file_range (in, out, 1000) == (int) size - 60,
+         "copy to end of \"sample.txt\"");
+  CHECK (copy_file_range (in, out, 10) == 0, "copy at end of file");
+  seek (out, 0);
+  check_file_handle (out, "copy", sample + 10, size - 10);
+  CHECK (copy_file_range (in, STDOUT_FILENO, 10) == -1,
+         "copy to stdout (must fail)");
+  msg ("close \"sample.txt\"");
+  close (in);
+  msg ("close \"copy\"");
+  close (out);
+}
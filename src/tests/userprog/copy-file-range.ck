@@ -0,0 +1,21 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(copy-file-range) begin
+(copy-file-range) open "sample.txt"
+(copy-file-range) create "copy"
+(copy-file-range) open "copy"
+(copy-file-range) copy 50 bytes
+(copy-file-range) both positions advanced
+(copy-file-range) copy to end of "sample.txt"
+(copy-file-range) copy at end of file
+(copy-file-range) verified contents of "copy"
+(copy-file-range) copy to stdout (must fail)
+(copy-file-range) close "sample.txt"
+(copy-file-range) close "copy"
+(copy-file-range) end
+copy-file-range: exit(0)
+EOF
+pass;
@@ -0,0 +1,42 @@
+/* Reserves space past the end of a file with fallocate(), which must
+   extend the file with zeros and keep its data, and then writes into
+   the reserved space. */
+
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+#include "tests/userprog/sample.inc"
+
+static char buf[5100];
+
+void
+test_main (void) 
+{
+  int fd;
+
+  CHECK (create ("data", 0), "create \"data\"");
+  CHECK ((fd = open ("data")) > 1, "open \"data\"");
+  CHECK (write (fd, sample, sizeof sample - 1) == sizeof sample - 1,
+         "write \"data\"");
+  CHECK (fallocate (fd, 100, sizeof buf - 100),
+         "fallocate \"data\" up to %zu bytes", sizeof buf);
+  memcpy (buf, sample, sizeof sample - 1);
+  seek (fd, 0);
+  check_file_handle (fd, "data", buf, sizeof buf);
+
+  CHECK (fallocate (fd, 0, 100), "fallocate \"data\" first 100 bytes");
+  seek (fd, 0);
+  check_file_handle (fd, "data", buf, sizeof buf);
+
+  seek (fd, 3000);
+  CHECK (write (fd, "hello", 5) == 5, "write \"hello\" at 3000");
+  memcpy (buf + 3000, "hello", 5);
+  seek (fd, 0);
+  check_file_handle (fd, "data", buf, sizeof buf);
+  CHECK (!fallocate (STDOUT_FILENO, 0, 100),
+         "fallocate stdout (must fail)");
+  msg ("close \"data\"");
+  close (fd);
+}
@@ -0,0 +1,21 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(fallocate-normal) begin
+(fallocate-normal) create "data"
+(fallocate-normal) open "data"
+(fallocate-normal) write "data"
+(fallocate-normal) fallocate "data" up to 5100 bytes
+(fallocate-normal) verified contents of "data"
+(fallocate-normal) fallocate "data" first 100 bytes
+(fallocate-normal) verified contents of "data"
+(fallocate-normal) write "hello" at 3000
+(fallocate-normal) verified contents of "data"
+(fallocate-normal) fallocate stdout (must fail)
+(fallocate-normal) close "data"
+(fallocate-normal) end
+fallocate-normal: exit(0)
+EOF
+pass;
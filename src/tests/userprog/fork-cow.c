@@ -0,0 +1,49 @@
+/* Checks that after fork() a write by either process to its data,
+   bss or stack is not seen by the other. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static int data = 1;
+static char buf[3 * 4096];
+
+void
+test_main (void) 
+{
+  int local = 1;
+  int fds[2];
+  pid_t pid;
+  size_t i;
+  char c;
+
+  memset (buf, 'a', sizeof buf);
+  CHECK (pipe (fds), "pipe");
+  pid = fork ();
+  if (pid == 0)
+    {
+      /* Wait until the parent has written its copies. */
+      close (fds[1]);
+      if (read (fds[0], &c, 1) != 1)
+        exit (1);
+      if (data != 1 || local != 1 || buf[0] != 'a'
+          || buf[sizeof buf - 1] != 'a')
+        exit (2);
+      data = local = 2;
+      memset (buf, 'b', sizeof buf);
+      exit (data + local);
+    }
+
+  data = local = 3;
+  memset (buf, 'c', sizeof buf);
+  if (write (fds[1], "x", 1) != 1)
+    fail ("write to pipe failed");
+  msg ("wait(fork()) = %d", wait (pid));
+  if (data != 3 || local != 3)
+    fail ("parent's variables changed by the child");
+  for (i = 0; i < sizeof buf; i++)
+    if (buf[i] != 'c')
+      fail ("parent's buf[%zu] changed by the child", i);
+  msg ("parent's memory unchanged");
+}
@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(fork-cow) begin
+(fork-cow) pipe
+fork-cow: exit(4)
+(fork-cow) wait(fork()) = 4
+(fork-cow) parent's memory unchanged
+(fork-cow) end
+fork-cow: exit(0)
+EOF
+pass;
@@ -0,0 +1,38 @@
+/* Checks that a forked child inherits the open files of its parent
+   at their positions, and that each process then has its own
+   position. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+#include "tests/userprog/sample.inc"
+
+void
+test_main (void) 
+{
+  char buf[sizeof sample];
+  pid_t pid;
+  int fd;
+
+  CHECK ((fd = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK (read (fd, buf, 10) == 10, "read 10 bytes");
+  pid = fork ();
+  if (pid == 0)
+    {
+      if (tell (fd) != 10)
+        exit (1);
+      if (read (fd, buf, 10) != 10 || memcmp (buf, sample + 10, 10))
+        exit (2);
+      close (fd);
+      exit (0);
+    }
+  msg ("wait(fork()) = %d", wait (pid));
+  CHECK (tell (fd) == 10, "tell \"sample.txt\" still 10");
+  CHECK (read (fd, buf, sizeof sample - 11) == sizeof sample - 11,
+         "read rest of \"sample.txt\"");
+  if (memcmp (buf, sample + 10, sizeof sample - 11))
+    fail ("read data differs from sample");
+  msg ("close \"sample.txt\"");
+  close (fd);
+}
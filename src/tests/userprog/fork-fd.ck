@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(fork-fd) begin
+(fork-fd) open "sample.txt"
+(fork-fd) read 10 bytes
+fork-fd: exit(0)
+(fork-fd) wait(fork()) = 0
+(fork-fd) tell "sample.txt" still 10
+(fork-fd) read rest of "sample.txt"
+(fork-fd) close "sample.txt"
+(fork-fd) end
+fork-fd: exit(0)
+EOF
+pass;
@@ -0,0 +1,67 @@
+/* Forks children that stay alive until fork() fails, then lets them
+   all exit, several times over.  Running out of memory must make
+   fork() return PID_ERROR without disturbing the parent, and a failed
+   fork must not leak, so every round must get about as far as the
+   first.  "About", because the kernel may keep some freed memory
+   cached. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define MAX_CHILDREN 1000
+#define ROUNDS 3
+
+static pid_t children[MAX_CHILDREN];
+
+/* Forks children blocked on a pipe until fork() fails or there are
+   MAX_CHILDREN of them, then closes the pipe, waits for them and
+   returns how many there were. */
+static int
+fork_until_failure (void) 
+{
+  int fds[2];
+  int cnt, i;
+  char c;
+
+  if (!pipe (fds))
+    fail ("pipe failed");
+  for (cnt = 0; cnt < MAX_CHILDREN; cnt++)
+    {
+      pid_t pid = fork ();
+      if (pid == 0)
+        {
+          /* Hold on to this process until the parent's write end,
+             the last one, is closed. */
+          close (fds[1]);
+          read (fds[0], &c, 1);
+          exit (0);
+        }
+      else if (pid == PID_ERROR)
+        break;
+      children[cnt] = pid;
+    }
+  close (fds[1]);
+  close (fds[0]);
+  for (i = 0; i < cnt; i++)
+    wait (children[i]);
+  return cnt;
+}
+
+void
+test_main (void) 
+{
+  int first = fork_until_failure ();
+  int round;
+
+  if (first < 10)
+    fail ("only %d children forked, expected at least 10", first);
+  for (round = 1; round < ROUNDS; round++)
+    {
+      int cnt = fork_until_failure ();
+      if (cnt < first * 9 / 10)
+        fail ("round %d forked %d children, but round 0 forked %d",
+              round, cnt, first);
+    }
+  msg ("forked until fork() failed %d times", ROUNDS);
+}
@@ -0,0 +1,10 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_USER_FAULTS => 1, IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(fork-oom) begin
+(fork-oom) forked until fork() failed 3 times
+(fork-oom) end
+EOF
+pass;
@@ -0,0 +1,17 @@
+/* Forks a child, which must see fork() return 0, while the parent
+   must get a pid it can wait for. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  pid_t pid = fork ();
+
+  if (pid == 0)
+    exit (81);
+  msg ("wait(fork()) = %d", wait (pid));
+  CHECK (wait (pid) == -1, "wait(fork()) again (must return -1)");
+}
@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(fork-return) begin
+fork-return: exit(81)
+(fork-return) wait(fork()) = 81
+(fork-return) wait(fork()) again (must return -1)
+(fork-return) end
+fork-return: exit(0)
+EOF
+pass;
@@ -0,0 +1,40 @@
+/* Shrinks and grows a file with ftruncate(), which must keep the data
+   before the new end, read back zeros past the old one, and leave the
+   file position alone. */
+
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+#include "tests/userprog/sample.inc"
+
+static char buf[1000];
+
+void
+test_main (void) 
+{
+  int fd;
+
+  CHECK (create ("data", 0), "create \"data\"");
+  CHECK ((fd = open ("data")) > 1, "open \"data\"");
+  CHECK (write (fd, sample, sizeof sample - 1) == sizeof sample - 1,
+         "write \"data\"");
+  CHECK (ftruncate (fd, 20), "shrink \"data\" to 20 bytes");
+  CHECK (tell (fd) == sizeof sample - 1, "tell \"data\" unchanged");
+  seek (fd, 0);
+  check_file_handle (fd, "data", sample, 20);
+
+  CHECK (ftruncate (fd, sizeof buf), "grow \"data\" to %zu bytes",
+         sizeof buf);
+  memcpy (buf, sample, 20);
+  seek (fd, 0);
+  check_file_handle (fd, "data", buf, sizeof buf);
+
+  CHECK (ftruncate (fd, 0), "shrink \"data\" to 0 bytes");
+  seek (fd, 0);
+  check_file_handle (fd, "data", buf, 0);
+  CHECK (!ftruncate (STDOUT_FILENO, 0), "ftruncate stdout (must fail)");
+  msg ("close \"data\"");
+  close (fd);
+}
@@ -0,0 +1,22 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(ftruncate-normal) begin
+(ftruncate-normal) create "data"
+(ftruncate-normal) open "data"
+(ftruncate-normal) write "data"
+(ftruncate-normal) shrink "data" to 20 bytes
+(ftruncate-normal) tell "data" unchanged
+(ftruncate-normal) verified contents of "data"
+(ftruncate-normal) grow "data" to 1000 bytes
+(ftruncate-normal) verified contents of "data"
+(ftruncate-normal) shrink "data" to 0 bytes
+(ftruncate-normal) verified contents of "data"
+(ftruncate-normal) ftruncate stdout (must fail)
+(ftruncate-normal) close "data"
+(ftruncate-normal) end
+ftruncate-normal: exit(0)
+EOF
+pass;
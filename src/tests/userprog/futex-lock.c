@@ -0,0 +1,51 @@
+/* Has threads add to a counter under a lock of <synch.h>, which
+   sleeps with futex_wait() while the lock is held and wakes sleepers
+   with futex_wake(), and checks that no addition is lost. */
+
+#include <synch.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define THREAD_CNT 4
+#define ITERATIONS 2000
+
+static struct lock lock = LOCK_INITIALIZER;
+static volatile int counter;
+static char stacks[THREAD_CNT][4096];
+
+/* Adds 1 to COUNTER ITERATIONS times, slowly, so that a timer
+   interrupt often finds the lock held. */
+static void
+adder (void *aux UNUSED) 
+{
+  int i, j;
+
+  for (i = 0; i < ITERATIONS; i++)
+    {
+      int old;
+
+      lock_acquire (&lock);
+      old = counter;
+      for (j = 0; j < 100; j++)
+        counter = old + j;
+      counter = old + 1;
+      lock_release (&lock);
+    }
+}
+
+void
+test_main (void) 
+{
+  tid_t tids[THREAD_CNT];
+  int i;
+
+  for (i = 0; i < THREAD_CNT; i++)
+    if ((tids[i] = thread_create (adder, NULL,
+                                  stacks[i] + sizeof stacks[i])) == TID_ERROR)
+      fail ("thread_create failed");
+  for (i = 0; i < THREAD_CNT; i++)
+    thread_join (tids[i]);
+  CHECK (counter == THREAD_CNT * ITERATIONS, "counter is %d",
+         THREAD_CNT * ITERATIONS);
+}
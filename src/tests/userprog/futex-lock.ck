@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(futex-lock) begin
+(futex-lock) counter is 8000
+(futex-lock) end
+futex-lock: exit(0)
+EOF
+pass;
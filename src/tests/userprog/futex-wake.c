@@ -0,0 +1,56 @@
+/* Checks that futex_wait() returns at once if the word has changed,
+   and otherwise sleeps until futex_wake() wakes it, which wakes no
+   more sleepers than asked. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define THREAD_CNT 3
+
+static int word;
+static char stacks[THREAD_CNT][4096];
+
+/* Sleeps on WORD and ends with status 1 once woken. */
+static void
+sleeper (void *aux UNUSED) 
+{
+  thread_exit (futex_wait (&word, 0) ? 1 : 0);
+}
+
+/* Calls futex_wake (&WORD, CNT) until it wakes someone, which must
+   take until the sleepers have gone to sleep, and returns how many
+   it woke. */
+static int
+wake (int cnt) 
+{
+  int woken;
+
+  while ((woken = futex_wake (&word, cnt)) == 0)
+    continue;
+  return woken;
+}
+
+void
+test_main (void) 
+{
+  tid_t tids[THREAD_CNT];
+  int i, woken;
+
+  CHECK (!futex_wait (&word, 1), "futex_wait on a changed word");
+  CHECK (futex_wake (&word, 1) == 0, "futex_wake with no sleepers");
+
+  for (i = 0; i < THREAD_CNT; i++)
+    if ((tids[i] = thread_create (sleeper, NULL,
+                                  stacks[i] + sizeof stacks[i])) == TID_ERROR)
+      fail ("thread_create failed");
+  for (woken = 0; woken < THREAD_CNT - 1; woken++)
+    if (wake (1) != 1)
+      fail ("futex_wake woke more than one thread");
+  msg ("futex_wake woke one thread at a time");
+  CHECK (wake (THREAD_CNT) == 1, "futex_wake woke the last thread");
+  for (i = 0; i < THREAD_CNT; i++)
+    if (thread_join (tids[i]) != 1)
+      fail ("thread %d was not woken", i);
+  msg ("joined all threads");
+}
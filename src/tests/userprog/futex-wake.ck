@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(futex-wake) begin
+(futex-wake) futex_wait on a changed word
+(futex-wake) futex_wake with no sleepers
+(futex-wake) futex_wake woke one thread at a time
+(futex-wake) futex_wake woke the last thread
+(futex-wake) joined all threads
+(futex-wake) end
+futex-wake: exit(0)
+EOF
+pass;
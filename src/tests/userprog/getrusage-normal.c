@@ -0,0 +1,43 @@
+/* Checks that getrusage() counts the CPU time that the process,
+   its thread and its children spend in user mode, and that it
+   refuses an invalid WHO. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/* Spins in user mode for a while. */
+static void
+spin (void)
+{
+  volatile int i;
+
+  for (i = 0; i < 1000000; i++)
+    continue;
+}
+
+void
+test_main (void)
+{
+  struct rusage self, thread, children;
+  pid_t pid;
+
+  CHECK (!getrusage (RUSAGE_THREAD + 1, &self), "try getrusage with bad who");
+  CHECK (!getrusage (-1, &self), "try getrusage with negative who");
+
+  spin ();
+  CHECK (getrusage (RUSAGE_SELF, &self), "getrusage self");
+  CHECK (self.user_ns > 0 && self.kernel_ns > 0, "process's time counted");
+  CHECK (getrusage (RUSAGE_THREAD, &thread), "getrusage thread");
+  CHECK (thread.user_ns > 0, "thread's time counted");
+
+  pid = fork ();
+  if (pid == 0)
+    {
+      spin ();
+      exit (0);
+    }
+  msg ("wait(fork()) = %d", wait (pid));
+  CHECK (getrusage (RUSAGE_CHILDREN, &children), "getrusage children");
+  CHECK (children.user_ns > 0, "child's time counted");
+}
@@ -0,0 +1,20 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(getrusage-normal) begin
+(getrusage-normal) try getrusage with bad who
+(getrusage-normal) try getrusage with negative who
+(getrusage-normal) getrusage self
+(getrusage-normal) process's time counted
+(getrusage-normal) getrusage thread
+(getrusage-normal) thread's time counted
+getrusage-normal: exit(0)
+(getrusage-normal) wait(fork()) = 0
+(getrusage-normal) getrusage children
+(getrusage-normal) child's time counted
+(getrusage-normal) end
+getrusage-normal: exit(0)
+EOF
+pass;
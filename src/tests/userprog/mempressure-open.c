@@ -0,0 +1,31 @@
+/* Checks that mempressure_open() refuses levels other than LOW,
+   MEDIUM and CRITICAL, and that a descriptor it returns for a
+   valid level polls as not ready while memory is plentiful. */
+
+#include <poll.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  struct pollfd pfd;
+  int fd;
+
+  CHECK (mempressure_open (MEMPRESSURE_NONE) == -1,
+         "try mempressure_open (MEMPRESSURE_NONE)");
+  CHECK (mempressure_open (MEMPRESSURE_CRITICAL + 1) == -1,
+         "try mempressure_open (MEMPRESSURE_CRITICAL + 1)");
+  CHECK (mempressure_open (-1) == -1, "try mempressure_open (-1)");
+
+  CHECK ((fd = mempressure_open (MEMPRESSURE_CRITICAL)) > 1,
+         "mempressure_open (MEMPRESSURE_CRITICAL)");
+  pfd.fd = fd;
+  pfd.events = POLLIN;
+  pfd.revents = -1;
+  CHECK (poll (&pfd, 1, 0) == 0, "poll without waiting");
+  CHECK (pfd.revents == 0, "not ready");
+  msg ("close");
+  close (fd);
+}
@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(mempressure-open) begin
+(mempressure-open) try mempressure_open (MEMPRESSURE_NONE)
+(mempressure-open) try mempressure_open (MEMPRESSURE_CRITICAL + 1)
+(mempressure-open) try mempressure_open (-1)
+(mempressure-open) mempressure_open (MEMPRESSURE_CRITICAL)
+(mempressure-open) poll without waiting
+(mempressure-open) not ready
+(mempressure-open) close
+(mempressure-open) end
+mempressure-open: exit(0)
+EOF
+pass;
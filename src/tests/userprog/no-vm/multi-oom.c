@@ -71,6 +71,7 @@ consume_some_resources_and_die (int seed)
     {
       case 0:
         *(volatile int *) NULL = 42;
+        /* Fall through. */
 
       case 1:
         return *(volatile int *) NULL;
@@ -80,6 +81,7 @@ consume_some_resources_and_die (int seed)
 
       case 3:
         *PHYS_BASE = 42;
+        /* Fall through. */
 
       case 4:
         open ((char *)PHYS_BASE);
@@ -0,0 +1,7 @@
+/* Child process for perf-exec, which does nothing. */
+
+int
+main (void)
+{
+  return 0;
+}
@@ -0,0 +1,26 @@
+/* Measures exec() and wait() of a child that exits right away. */
+
+#include <syscall.h>
+#include "tests/perf.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define EXEC_CNT 50
+
+void
+test_main (void)
+{
+  struct perf p;
+  int i;
+
+  perf_start (&p, "exec-wait", perf_vm_stats);
+  for (i = 0; i < EXEC_CNT; i++)
+    {
+      pid_t pid = exec ("perf-child");
+      if (pid == PID_ERROR)
+        fail ("exec \"perf-child\" failed");
+      if (wait (pid) != 0)
+        fail ("wait for \"perf-child\" failed");
+    }
+  perf_end (&p, EXEC_CNT, 0);
+}
@@ -0,0 +1,49 @@
+/* Measures mmap() and munmap() of files of 1 to 64 pages, reading a
+   byte of each page in between so that each is faulted in. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/perf.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define MAP_CNT 20
+
+static void
+mmap_pass (size_t page_cnt)
+{
+  char *addr = (char *) 0x10000000;
+  char name[32];
+  struct perf p;
+  int fd;
+  int i;
+
+  snprintf (name, sizeof name, "mmap-%zu", page_cnt);
+  CHECK (create (name, page_cnt * PAGE_SIZE), "create \"%s\"", name);
+  CHECK ((fd = open (name)) > 1, "open \"%s\"", name);
+
+  perf_start (&p, name, perf_vm_stats);
+  for (i = 0; i < MAP_CNT; i++)
+    {
+      volatile char *page;
+      mapid_t map = mmap (fd, addr);
+
+      if (map == MAP_FAILED)
+        fail ("mmap \"%s\" failed", name);
+      for (page = addr; page < addr + page_cnt * PAGE_SIZE;
+           page += PAGE_SIZE)
+        (void) *page;
+      munmap (map);
+    }
+  perf_end (&p, MAP_CNT, MAP_CNT * page_cnt * PAGE_SIZE);
+  close (fd);
+}
+
+void
+test_main (void)
+{
+  mmap_pass (1);
+  mmap_pass (16);
+  mmap_pass (64);
+}
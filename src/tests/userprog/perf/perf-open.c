@@ -0,0 +1,56 @@
+/* Measures open() and close() of a file at several directory
+   depths, timing the path lookup each open does. */
+
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/perf.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define DEPTH_MAX 8
+#define OPEN_CNT 1000
+
+static void
+open_pass (const char *path, int depth)
+{
+  char name[32];
+  struct perf p;
+  int i;
+
+  snprintf (name, sizeof name, "open-depth-%d", depth);
+  perf_start (&p, name, perf_fs_stats);
+  for (i = 0; i < OPEN_CNT; i++)
+    {
+      int fd = open (path);
+      if (fd < 2)
+        fail ("open \"%s\" failed", path);
+      close (fd);
+    }
+  perf_end (&p, OPEN_CNT, 0);
+}
+
+void
+test_main (void)
+{
+  char path[DEPTH_MAX * 2 + 8] = "";
+  int depth;
+
+  for (depth = 0; depth <= DEPTH_MAX; depth++)
+    {
+      if (depth > 0)
+        {
+          strlcat (path, "d", sizeof path);
+          CHECK (mkdir (path), "mkdir \"%s\"", path);
+          strlcat (path, "/", sizeof path);
+        }
+      if (depth == 0 || depth == 1 || depth == 4 || depth == DEPTH_MAX)
+        {
+          char file[sizeof path + 4];
+
+          snprintf (file, sizeof file, "%sf", path);
+          CHECK (create (file, 0), "create \"%s\"", file);
+          open_pass (file, depth);
+        }
+    }
+}
@@ -0,0 +1,51 @@
+/* Measures read() and write() of a file with buffers from 1 byte
+   to 64 kB, moving the same number of bytes with each. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/perf.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE 65536
+
+static char buf[FILE_SIZE];
+
+static void
+rw_pass (int fd, size_t size)
+{
+  char name[32];
+  struct perf p;
+  size_t ofs;
+
+  seek (fd, 0);
+  snprintf (name, sizeof name, "write-%zu", size);
+  perf_start (&p, name, perf_fs_stats);
+  for (ofs = 0; ofs < FILE_SIZE; ofs += size)
+    if (write (fd, buf, size) != (int) size)
+      fail ("write %zu bytes at offset %zu failed", size, ofs);
+  perf_end (&p, FILE_SIZE / size, FILE_SIZE);
+
+  seek (fd, 0);
+  snprintf (name, sizeof name, "read-%zu", size);
+  perf_start (&p, name, perf_fs_stats);
+  for (ofs = 0; ofs < FILE_SIZE; ofs += size)
+    if (read (fd, buf, size) != (int) size)
+      fail ("read %zu bytes at offset %zu failed", size, ofs);
+  perf_end (&p, FILE_SIZE / size, FILE_SIZE);
+}
+
+void
+test_main (void)
+{
+  int fd;
+
+  CHECK (create ("rw", FILE_SIZE), "create \"rw\"");
+  CHECK ((fd = open ("rw")) > 1, "open \"rw\"");
+  rw_pass (fd, 1);
+  rw_pass (fd, 64);
+  rw_pass (fd, 512);
+  rw_pass (fd, 4096);
+  rw_pass (fd, FILE_SIZE);
+  close (fd);
+}
@@ -0,0 +1,6 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::perf;
+check_perf (map (("write-$_", "read-$_"), 1, 64, 512, 4096, 65536));
@@ -0,0 +1,22 @@
+/* Measures the cost of a system call that does as little as
+   possible: tell() of a file descriptor that is not open, which
+   fails right after looking the descriptor up. */
+
+#include <syscall.h>
+#include "tests/perf.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define CALL_CNT 100000
+
+void
+test_main (void)
+{
+  struct perf p;
+  int i;
+
+  perf_start (&p, "null", perf_sys_stats);
+  for (i = 0; i < CALL_CNT; i++)
+    tell (-1);
+  perf_end (&p, CALL_CNT, 0);
+}
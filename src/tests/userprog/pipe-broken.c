@@ -0,0 +1,43 @@
+/* Checks that writing a pipe fails once the last read end is closed,
+   also for a writer that is waiting for room when that happens. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PIPE_SIZE 4096          /* See userprog/pipe.h. */
+
+static char buf[2 * PIPE_SIZE];
+
+void
+test_main (void) 
+{
+  int fds[2];
+  pid_t pid;
+
+  CHECK (pipe (fds), "pipe");
+  pid = fork ();
+  if (pid == 0)
+    {
+      /* Stops short once the parent closes its read end, the last. */
+      int written;
+
+      close (fds[0]);
+      written = write (fds[1], buf, sizeof buf);
+      if (written <= 0 || written >= (int) sizeof buf)
+        exit (1);
+      exit (write (fds[1], buf, 1) == -1 ? 0 : 2);
+    }
+  close (fds[1]);
+  if (read (fds[0], buf, 10) != 10)
+    fail ("read 10 bytes failed");
+  close (fds[0]);
+  msg ("wait(fork()) = %d", wait (pid));
+
+  CHECK (pipe (fds), "pipe");
+  CHECK (write (fds[1], "x", 1) == 1, "write with a read end open");
+  msg ("close read end");
+  close (fds[0]);
+  CHECK (write (fds[1], "x", 1) == -1,
+         "write with no read end (must return -1)");
+}
@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(pipe-broken) begin
+(pipe-broken) pipe
+pipe-broken: exit(0)
+(pipe-broken) wait(fork()) = 0
+(pipe-broken) pipe
+(pipe-broken) write with a read end open
+(pipe-broken) close read end
+(pipe-broken) write with no read end (must return -1)
+(pipe-broken) end
+pipe-broken: exit(0)
+EOF
+pass;
@@ -0,0 +1,49 @@
+/* Writes to a pipe in one go exactly as much as it holds and then
+   much more, which the kernel passes to the reader straight from the
+   writer's pages, and checks that the reader gets every byte in
+   order. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PIPE_SIZE 4096          /* See userprog/pipe.h. */
+
+static char buf[4 * PIPE_SIZE + 100];
+static char got[PIPE_SIZE + sizeof buf];
+
+void
+test_main (void) 
+{
+  size_t i, ofs;
+  int fds[2];
+  pid_t pid;
+
+  for (i = 0; i < sizeof buf; i++)
+    buf[i] = i % 251;
+  CHECK (pipe (fds), "pipe");
+  pid = fork ();
+  if (pid == 0)
+    {
+      close (fds[0]);
+      if (write (fds[1], buf, PIPE_SIZE) != PIPE_SIZE)
+        exit (1);
+      exit (write (fds[1], buf, sizeof buf) == sizeof buf ? 0 : 2);
+    }
+  close (fds[1]);
+
+  /* Read in pieces that don't line up with the writes. */
+  for (ofs = 0; ofs < sizeof got; )
+    {
+      size_t size = sizeof got - ofs < 1000 ? sizeof got - ofs : 1000;
+      int n = read (fds[0], got + ofs, size);
+
+      if (n <= 0)
+        fail ("read returned %d after %zu bytes", n, ofs);
+      ofs += n;
+    }
+  msg ("wait(fork()) = %d", wait (pid));
+  CHECK (read (fds[0], got, 1) == 0, "read at end of file");
+  compare_bytes (got, buf, PIPE_SIZE, 0, "pipe");
+  compare_bytes (got + PIPE_SIZE, buf, sizeof buf, PIPE_SIZE, "pipe");
+}
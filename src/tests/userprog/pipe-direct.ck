@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(pipe-direct) begin
+(pipe-direct) pipe
+pipe-direct: exit(0)
+(pipe-direct) wait(fork()) = 0
+(pipe-direct) read at end of file
+(pipe-direct) end
+pipe-direct: exit(0)
+EOF
+pass;
@@ -0,0 +1,30 @@
+/* Checks that reading a pipe returns what was written and then end
+   of file once the last write end, here the child's, is closed. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  char buf[16];
+  int fds[2];
+  pid_t pid;
+
+  CHECK (pipe (fds), "pipe");
+  pid = fork ();
+  if (pid == 0)
+    {
+      close (fds[0]);
+      exit (write (fds[1], "hello", 5) == 5 ? 0 : 1);
+    }
+  close (fds[1]);
+  msg ("wait(fork()) = %d", wait (pid));
+  CHECK (read (fds[0], buf, sizeof buf) == 5, "read 5 bytes");
+  if (memcmp (buf, "hello", 5))
+    fail ("read data differs from written");
+  CHECK (read (fds[0], buf, sizeof buf) == 0, "read at end of file");
+  CHECK (read (fds[0], buf, sizeof buf) == 0, "read at end of file again");
+}
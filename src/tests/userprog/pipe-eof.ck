@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(pipe-eof) begin
+(pipe-eof) pipe
+pipe-eof: exit(0)
+(pipe-eof) wait(fork()) = 0
+(pipe-eof) read 5 bytes
+(pipe-eof) read at end of file
+(pipe-eof) read at end of file again
+(pipe-eof) end
+pipe-eof: exit(0)
+EOF
+pass;
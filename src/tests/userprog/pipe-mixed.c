@@ -0,0 +1,62 @@
+/* Mixes writes to a pipe small enough to go through its buffer with
+   ones big enough to be read straight from the writer's pages, and
+   checks that the reader gets every byte in order. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PIPE_SIZE 4096          /* See userprog/pipe.h. */
+
+/* Sizes of the writes, in turn. */
+static const size_t sizes[] = 
+  {
+    1, 100, PIPE_SIZE, 7, 2 * PIPE_SIZE + 5, PIPE_SIZE - 1, 3 * PIPE_SIZE,
+    PIPE_SIZE / 2, PIPE_SIZE + 1, 1,
+  };
+
+static char buf[2 * (1 + 100 + PIPE_SIZE + 7 + 2 * PIPE_SIZE + 5
+                     + PIPE_SIZE - 1 + 3 * PIPE_SIZE + PIPE_SIZE / 2
+                     + PIPE_SIZE + 1 + 1)];
+static char got[sizeof buf];
+
+void
+test_main (void) 
+{
+  size_t i, ofs;
+  int fds[2];
+  pid_t pid;
+
+  for (i = 0; i < sizeof buf; i++)
+    buf[i] = i % 251;
+  CHECK (pipe (fds), "pipe");
+  pid = fork ();
+  if (pid == 0)
+    {
+      /* Go through SIZES twice. */
+      close (fds[0]);
+      for (i = ofs = 0; ofs < sizeof buf; i++)
+        {
+          size_t size = sizes[i % (sizeof sizes / sizeof *sizes)];
+          if (write (fds[1], buf + ofs, size) != (int) size)
+            exit (1);
+          ofs += size;
+        }
+      exit (0);
+    }
+  close (fds[1]);
+
+  /* Read in pieces that don't line up with the writes. */
+  for (ofs = 0; ofs < sizeof got; )
+    {
+      size_t size = sizeof got - ofs < 777 ? sizeof got - ofs : 777;
+      int n = read (fds[0], got + ofs, size);
+
+      if (n <= 0)
+        fail ("read returned %d after %zu bytes", n, ofs);
+      ofs += n;
+    }
+  msg ("wait(fork()) = %d", wait (pid));
+  CHECK (read (fds[0], got, 1) == 0, "read at end of file");
+  compare_bytes (got, buf, sizeof buf, 0, "pipe");
+}
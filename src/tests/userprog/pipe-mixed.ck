@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(pipe-mixed) begin
+(pipe-mixed) pipe
+pipe-mixed: exit(0)
+(pipe-mixed) wait(fork()) = 0
+(pipe-mixed) read at end of file
+(pipe-mixed) end
+pipe-mixed: exit(0)
+EOF
+pass;
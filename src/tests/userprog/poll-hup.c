@@ -0,0 +1,42 @@
+/* Polls a pipe whose other end a child closed by exiting: the read
+   end reports POLLHUP and the write end POLLERR, even when only
+   asked for POLLIN or POLLOUT. */
+
+#include <poll.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  struct pollfd pfd;
+  int a[2], b[2];
+  pid_t pid;
+
+  CHECK (pipe (a), "pipe a");
+  CHECK (pipe (b), "pipe b");
+  pid = fork ();
+  if (pid == 0)
+    {
+      close (a[0]);
+      close (b[1]);
+      exit (write (a[1], "x", 1) == 1 ? 0 : 1);
+    }
+  close (a[1]);
+  close (b[0]);
+  msg ("wait(fork()) = %d", wait (pid));
+
+  pfd.fd = a[0];
+  pfd.events = POLLIN;
+  CHECK (poll (&pfd, 1, 0) == 1, "poll read end");
+  CHECK (pfd.revents == (POLLIN | POLLHUP), "POLLIN and POLLHUP");
+  CHECK (read (a[0], &pfd, 1) == 1, "read 1 byte");
+  CHECK (poll (&pfd, 1, -1) == 1, "poll drained read end");
+  CHECK (pfd.revents == POLLHUP, "POLLHUP only");
+
+  pfd.fd = b[1];
+  pfd.events = POLLOUT;
+  CHECK (poll (&pfd, 1, -1) == 1, "poll write end");
+  CHECK (pfd.revents == (POLLOUT | POLLERR), "POLLOUT and POLLERR");
+}
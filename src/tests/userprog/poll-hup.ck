@@ -0,0 +1,21 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(poll-hup) begin
+(poll-hup) pipe a
+(poll-hup) pipe b
+poll-hup: exit(0)
+(poll-hup) wait(fork()) = 0
+(poll-hup) poll read end
+(poll-hup) POLLIN and POLLHUP
+(poll-hup) read 1 byte
+(poll-hup) poll drained read end
+(poll-hup) POLLHUP only
+(poll-hup) poll write end
+(poll-hup) POLLOUT and POLLERR
+(poll-hup) end
+poll-hup: exit(0)
+EOF
+pass;
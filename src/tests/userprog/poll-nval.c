@@ -0,0 +1,33 @@
+/* Polls descriptors that are not open, which report POLLNVAL, along
+   with a negative one, which is skipped, and stdout, which is always
+   ready for output. */
+
+#include <poll.h>
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  struct pollfd pfd[4];
+  int fds[2];
+
+  CHECK (pipe (fds), "pipe");
+  close (fds[1]);
+  pfd[0].fd = 100;
+  pfd[0].events = POLLIN;
+  pfd[1].fd = fds[1];
+  pfd[1].events = 0;
+  pfd[2].fd = -1;
+  pfd[2].events = POLLIN;
+  pfd[2].revents = -1;
+  pfd[3].fd = STDOUT_FILENO;
+  pfd[3].events = POLLIN | POLLOUT;
+  CHECK (poll (pfd, 4, -1) == 3, "poll 4 descriptors");
+  CHECK (pfd[0].revents == POLLNVAL, "fd 100 not open");
+  CHECK (pfd[1].revents == POLLNVAL, "closed write end not open");
+  CHECK (pfd[2].revents == 0, "negative fd skipped");
+  CHECK (pfd[3].revents == POLLOUT, "stdout ready for POLLOUT");
+}
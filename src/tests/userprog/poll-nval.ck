@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(poll-nval) begin
+(poll-nval) pipe
+(poll-nval) poll 4 descriptors
+(poll-nval) fd 100 not open
+(poll-nval) closed write end not open
+(poll-nval) negative fd skipped
+(poll-nval) stdout ready for POLLOUT
+(poll-nval) end
+poll-nval: exit(0)
+EOF
+pass;
@@ -0,0 +1,45 @@
+/* Polls both ends of a pipe as it goes from empty to holding data
+   to full, without waiting. */
+
+#include <poll.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PIPE_SIZE 4096          /* See userprog/pipe.h. */
+
+static char buf[PIPE_SIZE];
+
+void
+test_main (void) 
+{
+  struct pollfd pfd[2];
+  int fds[2];
+
+  CHECK (pipe (fds), "pipe");
+  pfd[0].fd = fds[0];
+  pfd[0].events = POLLIN;
+  pfd[1].fd = fds[1];
+  pfd[1].events = POLLOUT;
+  CHECK (poll (pfd, 2, 0) == 1, "poll empty pipe");
+  CHECK (pfd[0].revents == 0, "read end not ready");
+  CHECK (pfd[1].revents == POLLOUT, "write end ready for POLLOUT");
+
+  CHECK (write (fds[1], "x", 1) == 1, "write 1 byte");
+  CHECK (poll (pfd, 2, 0) == 2, "poll pipe with data");
+  CHECK (pfd[0].revents == POLLIN, "read end ready for POLLIN");
+  CHECK (pfd[1].revents == POLLOUT, "write end ready for POLLOUT");
+
+  memset (buf, 'y', sizeof buf);
+  CHECK (write (fds[1], buf, sizeof buf - 1) == sizeof buf - 1,
+         "fill pipe");
+  CHECK (poll (pfd, 2, 0) == 1, "poll full pipe");
+  CHECK (pfd[0].revents == POLLIN, "read end ready for POLLIN");
+  CHECK (pfd[1].revents == 0, "write end not ready");
+
+  CHECK (read (fds[0], buf, sizeof buf) == sizeof buf, "drain pipe");
+  pfd[1].events = POLLIN;
+  CHECK (poll (pfd, 2, 0) == 0, "poll drained pipe for POLLIN only");
+  CHECK (pfd[0].revents == 0 && pfd[1].revents == 0, "neither end ready");
+}
@@ -0,0 +1,25 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(poll-pipe) begin
+(poll-pipe) pipe
+(poll-pipe) poll empty pipe
+(poll-pipe) read end not ready
+(poll-pipe) write end ready for POLLOUT
+(poll-pipe) write 1 byte
+(poll-pipe) poll pipe with data
+(poll-pipe) read end ready for POLLIN
+(poll-pipe) write end ready for POLLOUT
+(poll-pipe) fill pipe
+(poll-pipe) poll full pipe
+(poll-pipe) read end ready for POLLIN
+(poll-pipe) write end not ready
+(poll-pipe) drain pipe
+(poll-pipe) poll drained pipe for POLLIN only
+(poll-pipe) neither end ready
+(poll-pipe) end
+poll-pipe: exit(0)
+EOF
+pass;
@@ -0,0 +1,29 @@
+/* Polls descriptors that never become ready, stdin with no input
+   and the read end of an empty pipe, until the timeout expires. */
+
+#include <poll.h>
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  struct pollfd pfd[2];
+  int fds[2];
+
+  CHECK (pipe (fds), "pipe");
+  pfd[0].fd = STDIN_FILENO;
+  pfd[0].events = POLLIN;
+  pfd[1].fd = fds[0];
+  pfd[1].events = POLLIN;
+  pfd[0].revents = pfd[1].revents = -1;
+  CHECK (poll (pfd, 2, 0) == 0, "poll stdin and pipe without waiting");
+  CHECK (pfd[0].revents == 0 && pfd[1].revents == 0, "neither ready");
+  CHECK (poll (pfd, 2, 100) == 0, "poll stdin and pipe for 100 ms");
+  CHECK (pfd[0].revents == 0 && pfd[1].revents == 0, "neither ready");
+  CHECK (poll (NULL, 0, 100) == 0, "poll nothing for 100 ms");
+  CHECK (poll (pfd, POLL_FDS_MAX + 1, 0) == -1,
+         "poll %d descriptors (must fail)", POLL_FDS_MAX + 1);
+}
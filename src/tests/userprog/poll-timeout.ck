@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(poll-timeout) begin
+(poll-timeout) pipe
+(poll-timeout) poll stdin and pipe without waiting
+(poll-timeout) neither ready
+(poll-timeout) poll stdin and pipe for 100 ms
+(poll-timeout) neither ready
+(poll-timeout) poll nothing for 100 ms
+(poll-timeout) poll 513 descriptors (must fail)
+(poll-timeout) end
+poll-timeout: exit(0)
+EOF
+pass;
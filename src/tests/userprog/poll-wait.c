@@ -0,0 +1,55 @@
+/* Waits in poll() on the read ends of two pipes until a child writes
+   one of them, then until the child's exit hangs up the other. */
+
+#include <poll.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  struct pollfd pfd[2];
+  int a[2], b[2], go[2];
+  char c;
+  pid_t pid;
+
+  CHECK (pipe (a), "pipe a");
+  CHECK (pipe (b), "pipe b");
+  CHECK (pipe (go), "pipe go");
+  pid = fork ();
+  if (pid == 0)
+    {
+      int i;
+
+      close (a[0]);
+      close (b[0]);
+      close (go[1]);
+      /* Give the parent time to go to sleep in poll(). */
+      for (i = 0; i < 10; i++)
+        poll (NULL, 0, 10);
+      if (write (b[1], "b", 1) != 1)
+        exit (1);
+      /* Exit, hanging up A, once the parent closes GO. */
+      exit (read (go[0], &c, 1));
+    }
+  close (a[1]);
+  close (b[1]);
+  close (go[0]);
+
+  pfd[0].fd = a[0];
+  pfd[0].events = POLLIN;
+  pfd[1].fd = b[0];
+  pfd[1].events = POLLIN;
+  CHECK (poll (pfd, 2, -1) == 1, "poll a and b");
+  CHECK (pfd[0].revents == 0, "a not ready");
+  CHECK (pfd[1].revents == POLLIN, "b ready for POLLIN");
+  CHECK (read (b[0], &c, 1) == 1 && c == 'b', "read 1 byte from b");
+
+  msg ("poll a until the child exits");
+  close (go[1]);
+  if (poll (pfd, 1, -1) != 1)
+    fail ("poll a until the child exits");
+  CHECK (pfd[0].revents == POLLHUP, "a hung up");
+  msg ("wait(fork()) = %d", wait (pid));
+}
@@ -0,0 +1,21 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(poll-wait) begin
+(poll-wait) pipe a
+(poll-wait) pipe b
+(poll-wait) pipe go
+(poll-wait) poll a and b
+(poll-wait) a not ready
+(poll-wait) b ready for POLLIN
+(poll-wait) read 1 byte from b
+(poll-wait) poll a until the child exits
+poll-wait: exit(0)
+(poll-wait) a hung up
+(poll-wait) wait(fork()) = 0
+(poll-wait) end
+poll-wait: exit(0)
+EOF
+pass;
@@ -0,0 +1,38 @@
+/* Reads and writes a file at given offsets with pread() and pwrite(),
+   which must leave the file position alone. */
+
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+#include "tests/userprog/sample.inc"
+
+void
+test_main (void) 
+{
+  char buf[sizeof sample];
+  int fd;
+
+  CHECK ((fd = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK (pread (fd, buf, 10, 20) == 10, "pread 10 bytes at 20");
+  if (memcmp (buf, sample + 20, 10))
+    fail ("pread data differs from sample");
+  CHECK (tell (fd) == 0, "tell \"sample.txt\" still 0");
+  CHECK (read (fd, buf, 5) == 5, "read 5 bytes");
+  if (memcmp (buf, sample, 5))
+    fail ("read data differs from sample");
+
+  CHECK (pwrite (fd, "XYZ", 3, 100) == 3, "pwrite 3 bytes at 100");
+  CHECK (tell (fd) == 5, "tell \"sample.txt\" still 5");
+  memcpy (sample + 100, "XYZ", 3);
+  CHECK (pread (fd, buf, sizeof sample, 0) == sizeof sample - 1,
+         "pread whole file");
+  if (memcmp (buf, sample, sizeof sample - 1))
+    fail ("pread data differs from what was written");
+  CHECK (pread (fd, buf, 10, sizeof sample + 100) == 0,
+         "pread past end of file");
+  CHECK (pread (STDIN_FILENO, buf, 1, 0) == -1, "pread stdin (must fail)");
+  msg ("close \"sample.txt\"");
+  close (fd);
+}
@@ -0,0 +1,20 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(pread-pwrite) begin
+(pread-pwrite) open "sample.txt"
+(pread-pwrite) pread 10 bytes at 20
+(pread-pwrite) tell "sample.txt" still 0
+(pread-pwrite) read 5 bytes
+(pread-pwrite) pwrite 3 bytes at 100
+(pread-pwrite) tell "sample.txt" still 5
+(pread-pwrite) pread whole file
+(pread-pwrite) pread past end of file
+(pread-pwrite) pread stdin (must fail)
+(pread-pwrite) close "sample.txt"
+(pread-pwrite) end
+pread-pwrite: exit(0)
+EOF
+pass;
@@ -0,0 +1,47 @@
+/* Checks that procstat() counts the bytes that the process and
+   its children write and read, the frames the process holds and
+   its CPU time, and that it refuses an invalid WHO. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE 2048
+
+static char buf[FILE_SIZE];
+
+void
+test_main (void)
+{
+  struct procstat before, after;
+  int handle;
+  pid_t pid;
+
+  CHECK (!procstat (PROCSTAT_CHILDREN + 1, &before),
+         "try procstat with bad who");
+  CHECK (!procstat (-1, &before), "try procstat with negative who");
+
+  CHECK (create ("data", FILE_SIZE), "create \"data\"");
+  CHECK ((handle = open ("data")) > 1, "open \"data\"");
+  CHECK (procstat (PROCSTAT_SELF, &before), "procstat self");
+  CHECK (write (handle, buf, FILE_SIZE) == FILE_SIZE, "write \"data\"");
+  seek (handle, 0);
+  CHECK (read (handle, buf, FILE_SIZE) == FILE_SIZE, "read \"data\"");
+  CHECK (procstat (PROCSTAT_SELF, &after), "procstat self");
+  CHECK (after.write_bytes - before.write_bytes >= FILE_SIZE,
+         "write counted");
+  CHECK (after.read_bytes - before.read_bytes >= FILE_SIZE, "read counted");
+  CHECK (after.user_ns + after.kernel_ns > 0, "CPU time counted");
+  CHECK (after.frames > 0 && after.peak_frames >= after.frames,
+         "frames counted");
+
+  pid = fork ();
+  if (pid == 0)
+    {
+      seek (handle, 0);
+      exit (read (handle, buf, FILE_SIZE) == FILE_SIZE ? 0 : 1);
+    }
+  msg ("wait(fork()) = %d", wait (pid));
+  CHECK (procstat (PROCSTAT_CHILDREN, &after), "procstat children");
+  CHECK (after.read_bytes >= FILE_SIZE, "child's read counted");
+}
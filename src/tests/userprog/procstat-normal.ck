@@ -0,0 +1,26 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(procstat-normal) begin
+(procstat-normal) try procstat with bad who
+(procstat-normal) try procstat with negative who
+(procstat-normal) create "data"
+(procstat-normal) open "data"
+(procstat-normal) procstat self
+(procstat-normal) write "data"
+(procstat-normal) read "data"
+(procstat-normal) procstat self
+(procstat-normal) write counted
+(procstat-normal) read counted
+(procstat-normal) CPU time counted
+(procstat-normal) frames counted
+procstat-normal: exit(0)
+(procstat-normal) wait(fork()) = 0
+(procstat-normal) procstat children
+(procstat-normal) child's read counted
+(procstat-normal) end
+procstat-normal: exit(0)
+EOF
+pass;
@@ -0,0 +1,50 @@
+/* Writes a file from several buffers with writev() and reads it back
+   into differently sized ones with readv(). */
+
+#include <string.h>
+#include <syscall.h>
+#include <uio.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+#include "tests/userprog/sample.inc"
+
+void
+test_main (void) 
+{
+  char a[3], b[100], c[sizeof sample];
+  struct iovec iov[IOV_MAX + 1];
+  size_t size = sizeof sample - 1;
+  int fd;
+
+  CHECK (create ("data", 0), "create \"data\"");
+  CHECK ((fd = open ("data")) > 1, "open \"data\"");
+  iov[0].iov_base = sample;
+  iov[0].iov_len = 7;
+  iov[1].iov_base = sample + 7;
+  iov[1].iov_len = 0;
+  iov[2].iov_base = sample + 7;
+  iov[2].iov_len = size - 7;
+  CHECK (writev (fd, iov, 3) == (int) size, "writev 3 buffers");
+  seek (fd, 0);
+  check_file_handle (fd, "data", sample, size);
+
+  seek (fd, 0);
+  iov[0].iov_base = a;
+  iov[0].iov_len = sizeof a;
+  iov[1].iov_base = b;
+  iov[1].iov_len = sizeof b;
+  iov[2].iov_base = c;
+  iov[2].iov_len = sizeof c;
+  CHECK (readv (fd, iov, 3) == (int) size, "readv 3 buffers");
+  if (memcmp (a, sample, sizeof a)
+      || memcmp (b, sample + sizeof a, sizeof b)
+      || memcmp (c, sample + sizeof a + sizeof b,
+                 size - sizeof a - sizeof b))
+    fail ("readv data differs from sample");
+
+  memset (iov, 0, sizeof iov);
+  CHECK (writev (fd, iov, IOV_MAX + 1) == -1,
+         "writev %d buffers (must fail)", IOV_MAX + 1);
+  msg ("close \"data\"");
+  close (fd);
+}
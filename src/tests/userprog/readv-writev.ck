@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(readv-writev) begin
+(readv-writev) create "data"
+(readv-writev) open "data"
+(readv-writev) writev 3 buffers
+(readv-writev) verified contents of "data"
+(readv-writev) readv 3 buffers
+(readv-writev) writev 65 buffers (must fail)
+(readv-writev) close "data"
+(readv-writev) end
+readv-writev: exit(0)
+EOF
+pass;
@@ -0,0 +1,40 @@
+/* Passes ring_enter() rings whose size is zero, not a power of two,
+   or too large, which must fail without running anything. */
+
+#include <ring.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static union
+  {
+    struct ring ring;
+    char bytes[RING_SIZE (1)];
+  }
+mem;
+
+/* Sets the size of the ring to ENTRIES and queues a no-op in it,
+   then returns what ring_enter() does with it. */
+static int
+try_entries (uint32_t entries)
+{
+  struct ring *ring = &mem.ring;
+
+  ring->entries = entries;
+  ring->sq_head = ring->sq_tail = ring->cq_head = ring->cq_tail = 0;
+  ring_sqes (ring)[0].op = RING_OP_NOP;
+  ring->sq_tail = 1;
+  return ring_enter (ring, 1);
+}
+
+void
+test_main (void) 
+{
+  CHECK (try_entries (0) == -1, "ring_enter with 0 entries (must fail)");
+  CHECK (try_entries (3) == -1, "ring_enter with 3 entries (must fail)");
+  CHECK (try_entries (RING_ENTRIES_MAX * 2) == -1,
+         "ring_enter with %d entries (must fail)", RING_ENTRIES_MAX * 2);
+  CHECK (mem.ring.sq_head == 0 && mem.ring.cq_tail == 0,
+         "failed ring_enter left the ring alone");
+  CHECK (try_entries (1) == 1, "ring_enter with 1 entry");
+}
@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(ring-bad-entries) begin
+(ring-bad-entries) ring_enter with 0 entries (must fail)
+(ring-bad-entries) ring_enter with 3 entries (must fail)
+(ring-bad-entries) ring_enter with 512 entries (must fail)
+(ring-bad-entries) failed ring_enter left the ring alone
+(ring-bad-entries) ring_enter with 1 entry
+(ring-bad-entries) end
+ring-bad-entries: exit(0)
+EOF
+pass;
@@ -0,0 +1,73 @@
+/* Fills a ring's completion queue and checks that ring_enter() then
+   runs only as many operations as there is room to complete,
+   leaving the rest queued for a later call. */
+
+#include <ring.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ENTRIES 4
+
+static union
+  {
+    struct ring ring;
+    char bytes[RING_SIZE (ENTRIES)];
+  }
+mem;
+
+/* Queues a no-op on RING, identified by its position in the
+   submission queue. */
+static void
+submit (struct ring *ring)
+{
+  struct ring_sqe *sqe = &ring_sqes (ring)[ring->sq_tail % ring->entries];
+
+  sqe->op = RING_OP_NOP;
+  sqe->user_data = ring->sq_tail;
+  ring->sq_tail++;
+}
+
+/* Reaps the next completion from RING, which must be in order. */
+static void
+reap (struct ring *ring)
+{
+  struct ring_cqe *cqe = &ring_cqes (ring)[ring->cq_head % ring->entries];
+
+  if (cqe->user_data != ring->cq_head || cqe->result != 0)
+    fail ("completion %u has user_data %u and result %d",
+          ring->cq_head, cqe->user_data, cqe->result);
+  ring->cq_head++;
+}
+
+void
+test_main (void) 
+{
+  struct ring *ring = &mem.ring;
+  int i;
+
+  ring->entries = ENTRIES;
+  for (i = 0; i < ENTRIES; i++)
+    submit (ring);
+  CHECK (ring_enter (ring, ENTRIES) == ENTRIES, "ring_enter %d no-ops",
+         ENTRIES);
+
+  submit (ring);
+  submit (ring);
+  CHECK (ring_enter (ring, 2) == 0, "ring_enter with full completion queue");
+  if (ring->sq_head != ENTRIES || ring->cq_tail != ENTRIES)
+    fail ("ring_enter made progress without room");
+
+  reap (ring);
+  CHECK (ring_enter (ring, 2) == 1, "ring_enter with room for 1");
+  if (ring->sq_head != ENTRIES + 1 || ring->cq_tail != ENTRIES + 1)
+    fail ("sq_head %u and cq_tail %u, expected %d", ring->sq_head,
+          ring->cq_tail, ENTRIES + 1);
+
+  for (i = 0; i < ENTRIES; i++)
+    reap (ring);
+  CHECK (ring_enter (ring, 2) == 1, "ring_enter the last queued no-op");
+  reap (ring);
+  if (ring->sq_head != ring->sq_tail || ring->cq_head != ring->cq_tail)
+    fail ("ring not drained");
+}
@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(ring-full) begin
+(ring-full) ring_enter 4 no-ops
+(ring-full) ring_enter with full completion queue
+(ring-full) ring_enter with room for 1
+(ring-full) ring_enter the last queued no-op
+(ring-full) end
+ring-full: exit(0)
+EOF
+pass;
@@ -0,0 +1,66 @@
+/* Runs batches of no-op operations through a ring, more of them in
+   all than the ring has entries, so that the counters wrap around
+   its queues, and checks each completion. */
+
+#include <ring.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ENTRIES 4
+
+static union
+  {
+    struct ring ring;
+    char bytes[RING_SIZE (ENTRIES)];
+  }
+mem;
+
+/* Queues operation OP on RING with USER_DATA. */
+static void
+submit (struct ring *ring, uint32_t op, uint32_t user_data)
+{
+  struct ring_sqe *sqe = &ring_sqes (ring)[ring->sq_tail % ring->entries];
+
+  sqe->op = op;
+  sqe->user_data = user_data;
+  ring->sq_tail++;
+}
+
+void
+test_main (void) 
+{
+  struct ring *ring = &mem.ring;
+  int round, i;
+
+  ring->entries = ENTRIES;
+  CHECK (ring_enter (ring, 1) == 0, "ring_enter with empty queue");
+  for (round = 0; round < 3; round++)
+    {
+      for (i = 0; i < 3; i++)
+        submit (ring, RING_OP_NOP, round * 10 + i);
+      CHECK (ring_enter (ring, 8) == 3, "ring_enter 3 no-ops");
+      if (ring->sq_head != ring->sq_tail)
+        fail ("sq_head %u, expected %u", ring->sq_head, ring->sq_tail);
+      for (i = 0; i < 3; i++)
+        {
+          struct ring_cqe *cqe
+            = &ring_cqes (ring)[ring->cq_head++ % ENTRIES];
+          if (cqe->user_data != (uint32_t) (round * 10 + i)
+              || cqe->result != 0)
+            fail ("completion %d has user_data %u and result %d",
+                  i, cqe->user_data, cqe->result);
+        }
+      if (ring->cq_head != ring->cq_tail)
+        fail ("cq_tail %u, expected %u", ring->cq_tail, ring->cq_head);
+    }
+
+  submit (ring, RING_OP_NOP, 98);
+  submit (ring, 99, 99);
+  CHECK (ring_enter (ring, 0) == 0, "ring_enter none of 2");
+  CHECK (ring_enter (ring, 2) == 2, "ring_enter a no-op and a bad op");
+  CHECK (ring_cqes (ring)[ring->cq_head++ % ENTRIES].result == 0,
+         "no-op result is 0");
+  CHECK (ring_cqes (ring)[ring->cq_head++ % ENTRIES].result == -1,
+         "bad op result is -1");
+}
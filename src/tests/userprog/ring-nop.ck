@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(ring-nop) begin
+(ring-nop) ring_enter with empty queue
+(ring-nop) ring_enter 3 no-ops
+(ring-nop) ring_enter 3 no-ops
+(ring-nop) ring_enter 3 no-ops
+(ring-nop) ring_enter none of 2
+(ring-nop) ring_enter a no-op and a bad op
+(ring-nop) no-op result is 0
+(ring-nop) bad op result is -1
+(ring-nop) end
+ring-nop: exit(0)
+EOF
+pass;
@@ -0,0 +1,71 @@
+/* Opens and closes files through a ring and checks that the file
+   descriptors it returns work with ordinary system calls. */
+
+#include <ring.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+#include "tests/userprog/sample.inc"
+
+#define ENTRIES 8
+
+static union
+  {
+    struct ring ring;
+    char bytes[RING_SIZE (ENTRIES)];
+  }
+mem;
+
+/* Queues operation OP on RING for FD, or for file NAME if OP is
+   RING_OP_OPEN. */
+static void
+submit (struct ring *ring, uint32_t op, int fd, const char *name)
+{
+  struct ring_sqe *sqe = &ring_sqes (ring)[ring->sq_tail % ring->entries];
+
+  sqe->op = op;
+  sqe->fd = fd;
+  sqe->buffer = (void *) name;
+  sqe->user_data = ring->sq_tail;
+  ring->sq_tail++;
+}
+
+/* Reaps the next completion from RING and returns its result. */
+static int
+reap (struct ring *ring)
+{
+  struct ring_cqe *cqe = &ring_cqes (ring)[ring->cq_head % ring->entries];
+
+  if (cqe->user_data != ring->cq_head)
+    fail ("completion %u out of order", cqe->user_data);
+  ring->cq_head++;
+  return cqe->result;
+}
+
+void
+test_main (void) 
+{
+  struct ring *ring = &mem.ring;
+  int fd1, fd2;
+
+  ring->entries = ENTRIES;
+  submit (ring, RING_OP_OPEN, 0, "sample.txt");
+  submit (ring, RING_OP_OPEN, 0, "sample.txt");
+  submit (ring, RING_OP_OPEN, 0, "no-such-file");
+  CHECK (ring_enter (ring, 3) == 3, "ring_enter 3 opens");
+  CHECK ((fd1 = reap (ring)) > 1, "open \"sample.txt\"");
+  CHECK ((fd2 = reap (ring)) > 1, "open \"sample.txt\" again");
+  if (fd1 == fd2)
+    fail ("both opens returned fd %d", fd1);
+  CHECK (reap (ring) == -1, "open \"no-such-file\" returned -1");
+  check_file_handle (fd1, "sample.txt", sample, sizeof sample - 1);
+
+  submit (ring, RING_OP_CLOSE, fd1, NULL);
+  submit (ring, RING_OP_CLOSE, fd1, NULL);
+  submit (ring, RING_OP_CLOSE, fd2, NULL);
+  CHECK (ring_enter (ring, 3) == 3, "ring_enter 3 closes");
+  CHECK (reap (ring) == 0, "close returned 0");
+  CHECK (reap (ring) == -1, "close again returned -1");
+  CHECK (reap (ring) == 0, "close second fd returned 0");
+  CHECK (filesize (fd1) == -1, "filesize of closed fd returned -1");
+}
@@ -0,0 +1,20 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(ring-open-close) begin
+(ring-open-close) ring_enter 3 opens
+(ring-open-close) open "sample.txt"
+(ring-open-close) open "sample.txt" again
+(ring-open-close) open "no-such-file" returned -1
+(ring-open-close) verified contents of "sample.txt"
+(ring-open-close) ring_enter 3 closes
+(ring-open-close) close returned 0
+(ring-open-close) close again returned -1
+(ring-open-close) close second fd returned 0
+(ring-open-close) filesize of closed fd returned -1
+(ring-open-close) end
+ring-open-close: exit(0)
+EOF
+pass;
@@ -0,0 +1,92 @@
+/* Writes a file through a ring and reads it back, in one batch with
+   pread at offsets and then with read at the file position. */
+
+#include <ring.h>
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+#include "tests/userprog/sample.inc"
+
+#define ENTRIES 4
+
+static union
+  {
+    struct ring ring;
+    char bytes[RING_SIZE (ENTRIES)];
+  }
+mem;
+
+/* Queues operation OP on RING for FD and SIZE bytes at BUFFER, at
+   OFFSET for pread. */
+static void
+submit (struct ring *ring, uint32_t op, int fd, void *buffer, size_t size,
+        unsigned offset)
+{
+  struct ring_sqe *sqe = &ring_sqes (ring)[ring->sq_tail % ring->entries];
+
+  sqe->op = op;
+  sqe->fd = fd;
+  sqe->buffer = buffer;
+  sqe->size = size;
+  sqe->offset = offset;
+  sqe->user_data = ring->sq_tail;
+  ring->sq_tail++;
+}
+
+/* Reaps the next completion from RING and returns its result. */
+static int
+reap (struct ring *ring)
+{
+  struct ring_cqe *cqe = &ring_cqes (ring)[ring->cq_head % ring->entries];
+
+  if (cqe->user_data != ring->cq_head)
+    fail ("completion %u out of order", cqe->user_data);
+  ring->cq_head++;
+  return cqe->result;
+}
+
+void
+test_main (void) 
+{
+  struct ring *ring = &mem.ring;
+  size_t size = sizeof sample - 1;
+  char a[sizeof sample], b[sizeof sample];
+  int fd;
+
+  ring->entries = ENTRIES;
+  CHECK (create ("data", 0), "create \"data\"");
+  CHECK ((fd = open ("data")) > 1, "open \"data\"");
+  submit (ring, RING_OP_WRITE, fd, sample, size, 0);
+  submit (ring, RING_OP_PREAD, fd, a, 10, 20);
+  submit (ring, RING_OP_PREAD, fd, b, sizeof b, 0);
+  submit (ring, RING_OP_READ, fd, a, sizeof a, 0);
+  CHECK (ring_enter (ring, 4) == 4, "ring_enter write, 2 preads, read");
+  CHECK (reap (ring) == (int) size, "write returned %zu", size);
+  CHECK (reap (ring) == 10, "pread at 20 returned 10");
+  CHECK (reap (ring) == (int) size, "pread at 0 returned %zu", size);
+  CHECK (reap (ring) == 0, "read at end of file returned 0");
+  if (memcmp (b, sample, size))
+    fail ("pread data differs from sample");
+  if (memcmp (a, sample + 20, 10))
+    fail ("pread data at 20 differs from sample");
+
+  seek (fd, 0);
+  submit (ring, RING_OP_READ, fd, a, 7, 0);
+  submit (ring, RING_OP_READ, fd, a + 7, sizeof a - 7, 0);
+  CHECK (ring_enter (ring, 2) == 2, "ring_enter 2 reads");
+  CHECK (reap (ring) == 7, "read returned 7");
+  CHECK (reap (ring) == (int) size - 7, "read returned %zu", size - 7);
+  if (memcmp (a, sample, size))
+    fail ("read data differs from sample");
+
+  submit (ring, RING_OP_READ, STDOUT_FILENO, a, 1, 0);
+  submit (ring, RING_OP_WRITE, STDIN_FILENO, a, 1, 0);
+  CHECK (ring_enter (ring, 2) == 2, "ring_enter read stdout, write stdin");
+  CHECK (reap (ring) == -1, "read stdout returned -1");
+  CHECK (reap (ring) == -1, "write stdin returned -1");
+  check_file_handle (fd, "data", sample, size);
+  msg ("close \"data\"");
+  close (fd);
+}
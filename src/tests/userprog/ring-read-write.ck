@@ -0,0 +1,25 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(ring-read-write) begin
+(ring-read-write) create "data"
+(ring-read-write) open "data"
+(ring-read-write) ring_enter write, 2 preads, read
+(ring-read-write) write returned 239
+(ring-read-write) pread at 20 returned 10
+(ring-read-write) pread at 0 returned 239
+(ring-read-write) read at end of file returned 0
+(ring-read-write) ring_enter 2 reads
+(ring-read-write) read returned 7
+(ring-read-write) read returned 232
+(ring-read-write) ring_enter read stdout, write stdin
+(ring-read-write) read stdout returned -1
+(ring-read-write) write stdin returned -1
+(ring-read-write) verified contents of "data"
+(ring-read-write) close "data"
+(ring-read-write) end
+ring-read-write: exit(0)
+EOF
+pass;
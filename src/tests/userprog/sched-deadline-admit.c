@@ -0,0 +1,30 @@
+/* Checks the admission limit of sched_deadline(): real-time
+   threads together may reserve at most 90%% of the CPU, so once
+   the parent holds that much a child can't join the class, but
+   can after the parent leaves it. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/* Forks a child that tries sched_deadline (100, 10) and exits
+   with 1 if it succeeded, 0 if not, and waits for it. */
+static int
+fork_child (void)
+{
+  pid_t pid = fork ();
+
+  if (pid == 0)
+    exit (sched_deadline (100, 10));
+  return wait (pid);
+}
+
+void
+test_main (void)
+{
+  CHECK (!sched_deadline (100, 95), "try to reserve 95%% of the CPU");
+  CHECK (sched_deadline (100, 90), "reserve 90%% of the CPU");
+  msg ("child admitted: %d", fork_child ());
+  CHECK (sched_deadline (0, 0), "leave the real-time class");
+  msg ("child admitted: %d", fork_child ());
+}
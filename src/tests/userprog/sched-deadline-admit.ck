@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(sched-deadline-admit) begin
+(sched-deadline-admit) try to reserve 95% of the CPU
+(sched-deadline-admit) reserve 90% of the CPU
+sched-deadline-admit: exit(0)
+(sched-deadline-admit) child admitted: 0
+(sched-deadline-admit) leave the real-time class
+sched-deadline-admit: exit(1)
+(sched-deadline-admit) child admitted: 1
+(sched-deadline-admit) end
+sched-deadline-admit: exit(0)
+EOF
+pass;
@@ -0,0 +1,17 @@
+/* Puts the process in the real-time class with sched_deadline(),
+   takes it out again, and checks that a budget of zero or longer
+   than the period is refused. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  CHECK (!sched_deadline (100, 0), "try sched_deadline (100, 0)");
+  CHECK (!sched_deadline (10, 20), "try sched_deadline (10, 20)");
+  CHECK (sched_deadline (100, 10), "sched_deadline (100, 10)");
+  CHECK (sched_deadline (50, 20), "sched_deadline (50, 20)");
+  CHECK (sched_deadline (0, 0), "sched_deadline (0, 0)");
+}
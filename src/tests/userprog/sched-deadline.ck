@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(sched-deadline) begin
+(sched-deadline) try sched_deadline (100, 0)
+(sched-deadline) try sched_deadline (10, 20)
+(sched-deadline) sched_deadline (100, 10)
+(sched-deadline) sched_deadline (50, 20)
+(sched-deadline) sched_deadline (0, 0)
+(sched-deadline) end
+sched-deadline: exit(0)
+EOF
+pass;
@@ -0,0 +1,18 @@
+/* Checks that a process may raise its nice value with setnice()
+   but not lower it again, nor raise it past the maximum of 20. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  int nice = getnice ();
+
+  CHECK (setnice (nice + 1), "raise nice by 1");
+  CHECK (getnice () == nice + 1, "getnice returns new nice");
+  CHECK (!setnice (nice), "try to lower nice back");
+  CHECK (!setnice (21), "try to set nice above maximum");
+  CHECK (getnice () == nice + 1, "nice unchanged");
+}
@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(setnice-raise) begin
+(setnice-raise) raise nice by 1
+(setnice-raise) getnice returns new nice
+(setnice-raise) try to lower nice back
+(setnice-raise) try to set nice above maximum
+(setnice-raise) nice unchanged
+(setnice-raise) end
+setnice-raise: exit(0)
+EOF
+pass;
@@ -0,0 +1,18 @@
+/* Checks that a process may lower its priority with setpriority()
+   but not raise it again, nor set it out of range. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  int priority = getpriority ();
+
+  CHECK (setpriority (priority - 1), "lower priority by 1");
+  CHECK (getpriority () == priority - 1, "getpriority returns new priority");
+  CHECK (!setpriority (priority), "try to raise priority back");
+  CHECK (!setpriority (-1), "try to set priority below minimum");
+  CHECK (getpriority () == priority - 1, "priority unchanged");
+}
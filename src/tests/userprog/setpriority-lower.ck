@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(setpriority-lower) begin
+(setpriority-lower) lower priority by 1
+(setpriority-lower) getpriority returns new priority
+(setpriority-lower) try to raise priority back
+(setpriority-lower) try to set priority below minimum
+(setpriority-lower) priority unchanged
+(setpriority-lower) end
+setpriority-lower: exit(0)
+EOF
+pass;
@@ -0,0 +1,17 @@
+/* Checks that under the MLFQS scheduler, which computes
+   priorities itself, setpriority() fails even to lower the
+   priority, while setnice() still works. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  int priority = getpriority ();
+
+  CHECK (!setpriority (priority), "try to set priority under MLFQS");
+  CHECK (!setpriority (0), "try to lower priority under MLFQS");
+  CHECK (setnice (getnice () + 1), "raise nice under MLFQS");
+}
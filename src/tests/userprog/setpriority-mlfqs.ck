@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(setpriority-mlfqs) begin
+(setpriority-mlfqs) try to set priority under MLFQS
+(setpriority-mlfqs) try to lower priority under MLFQS
+(setpriority-mlfqs) raise nice under MLFQS
+(setpriority-mlfqs) end
+setpriority-mlfqs: exit(0)
+EOF
+pass;
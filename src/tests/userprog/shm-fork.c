@@ -0,0 +1,42 @@
+/* Checks that a shared memory segment mapped before fork() is
+   shared by parent and child: each sees what the other writes
+   to it, unlike the rest of their memory. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SHM ((char *) 0x10000000)
+
+void
+test_main (void)
+{
+  int fds[2];
+  int shm;
+  pid_t pid;
+  char c;
+
+  CHECK ((shm = shm_create (4096)) >= 0, "shm_create");
+  CHECK (mmap (shm, SHM) != MAP_FAILED, "mmap shm");
+  CHECK (SHM[0] == 0 && SHM[4095] == 0, "shm reads as zeros");
+  CHECK (pipe (fds), "pipe");
+  pid = fork ();
+  if (pid == 0)
+    {
+      /* Wait until the parent has written to the segment. */
+      close (fds[1]);
+      if (read (fds[0], &c, 1) != 1)
+        exit (1);
+      if (strcmp (SHM, "parent"))
+        exit (2);
+      strlcpy (SHM + 2048, "child", 2048);
+      exit (3);
+    }
+
+  strlcpy (SHM, "parent", 2048);
+  if (write (fds[1], "x", 1) != 1)
+    fail ("write to pipe failed");
+  msg ("wait(fork()) = %d", wait (pid));
+  CHECK (!strcmp (SHM + 2048, "child"), "parent sees the child's write");
+}
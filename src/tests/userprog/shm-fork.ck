@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(shm-fork) begin
+(shm-fork) shm_create
+(shm-fork) mmap shm
+(shm-fork) shm reads as zeros
+(shm-fork) pipe
+shm-fork: exit(3)
+(shm-fork) wait(fork()) = 3
+(shm-fork) parent sees the child's write
+(shm-fork) end
+shm-fork: exit(0)
+EOF
+pass;
@@ -0,0 +1,44 @@
+/* Spawns child-spawn with actions that open a file as fd 3, copy one
+   of the parent's descriptors to fd 5 and change directory, for the
+   child to check.  The parent's descriptors must not be passed on
+   otherwise, and closing the console is not a valid action. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  /* The child starts in "d", where its name is looked up too. */
+  const char *child[] = {"/child-spawn", NULL};
+  struct spawn_action actions[3];
+  char buf[10];
+  int fd1, fd2;
+
+  CHECK (mkdir ("d"), "mkdir \"d\"");
+  CHECK (create ("d/marker", 0), "create \"d/marker\"");
+  CHECK ((fd1 = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK ((fd2 = open ("sample.txt")) > 1, "open \"sample.txt\" again");
+  CHECK (read (fd2, buf, sizeof buf) == sizeof buf, "read 10 bytes");
+
+  actions[0].type = SPAWN_OPEN;
+  actions[0].fd = 3;
+  actions[0].flags = 0;
+  actions[0].path = "sample.txt";
+  actions[1].type = SPAWN_DUP;
+  actions[1].fd = 5;
+  actions[1].src_fd = fd2;
+  actions[2].type = SPAWN_CHDIR;
+  actions[2].path = "d";
+  msg ("wait(spawn()) = %d", wait (spawn (child, actions, 3, 0)));
+
+  actions[0].type = SPAWN_CLOSE;
+  actions[0].fd = 2;
+  CHECK (spawn (child, actions, 1, 0) == PID_ERROR,
+         "spawn closing fd 2 (must fail)");
+  msg ("close \"sample.txt\"");
+  close (fd1);
+  msg ("close \"sample.txt\" again");
+  close (fd2);
+}
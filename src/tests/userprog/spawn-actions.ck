@@ -0,0 +1,24 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(spawn-actions) begin
+(spawn-actions) mkdir "d"
+(spawn-actions) create "d/marker"
+(spawn-actions) open "sample.txt"
+(spawn-actions) open "sample.txt" again
+(spawn-actions) read 10 bytes
+(child-spawn) fd 3 reads "sample.txt"
+(child-spawn) fd 5 reads "sample.txt" from offset 10
+(child-spawn) fd 4 is not open
+(child-spawn) open "marker" in "d"
+/child-spawn: exit(0)
+(spawn-actions) wait(spawn()) = 0
+(spawn-actions) spawn closing fd 2 (must fail)
+(spawn-actions) close "sample.txt"
+(spawn-actions) close "sample.txt" again
+(spawn-actions) end
+spawn-actions: exit(0)
+EOF
+pass;
@@ -0,0 +1,14 @@
+/* Spawns a missing program, waiting for it to load, which must
+   fail. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  const char *missing[] = {"no-such-file", NULL};
+
+  msg ("spawn(\"no-such-file\"): %d", spawn (missing, NULL, 0, 0));
+}
@@ -0,0 +1,21 @@
+/* Spawns a child and waits for it, then spawns a missing program
+   without waiting for it to load, which wait() must report as exit
+   status -1. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  const char *child[] = {"child-simple", NULL};
+  const char *missing[] = {"no-such-file", NULL};
+  pid_t pid;
+
+  msg ("wait(spawn()) = %d", wait (spawn (child, NULL, 0, 0)));
+  pid = spawn (missing, NULL, 0, SPAWN_NOWAIT);
+  if (pid == PID_ERROR)
+    fail ("spawn with SPAWN_NOWAIT failed");
+  msg ("wait(spawn()) = %d", wait (pid));
+}
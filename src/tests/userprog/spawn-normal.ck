@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(spawn-normal) begin
+(child-simple) run
+child-simple: exit(81)
+(spawn-normal) wait(spawn()) = 81
+load: no-such-file: open failed
+no-such-file: exit(-1)
+(spawn-normal) wait(spawn()) = -1
+(spawn-normal) end
+spawn-normal: exit(0)
+EOF
+pass;
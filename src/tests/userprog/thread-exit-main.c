@@ -0,0 +1,28 @@
+/* Ends the first thread of the process with thread_exit() while
+   another one is still running.  The other thread must run on, and
+   the process must end, with the first thread's status, only once it
+   has. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char stack[4096];
+
+static void
+worker (void *aux UNUSED) 
+{
+  volatile int i;
+
+  for (i = 0; i < 1000000; i++)
+    continue;
+  msg ("second thread done");
+}
+
+void
+test_main (void) 
+{
+  if (thread_create (worker, NULL, stack + sizeof stack) == TID_ERROR)
+    fail ("thread_create failed");
+  thread_exit (7);
+}
@@ -0,0 +1,10 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(thread-exit-main) begin
+(thread-exit-main) second thread done
+thread-exit-main: exit(7)
+EOF
+pass;
@@ -0,0 +1,54 @@
+/* Starts threads that share the process's memory and joins them,
+   checking the status each ends with, whether from thread_exit() or
+   from returning, and that a thread can only be joined once. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define THREAD_CNT 4
+
+static int results[THREAD_CNT];
+static char stacks[THREAD_CNT][4096];
+
+/* Stores the square of thread *AUX's number in RESULTS and ends with
+   status 10 more than it, except that the last thread returns. */
+static void
+worker (void *aux) 
+{
+  int i = *(int *) aux;
+
+  results[i] = i * i;
+  if (i < THREAD_CNT - 1)
+    thread_exit (10 + i);
+}
+
+void
+test_main (void) 
+{
+  int numbers[THREAD_CNT];
+  tid_t tids[THREAD_CNT];
+  int i;
+
+  for (i = 0; i < THREAD_CNT; i++)
+    {
+      numbers[i] = i;
+      tids[i] = thread_create (worker, &numbers[i],
+                               stacks[i] + sizeof stacks[i]);
+      if (tids[i] == TID_ERROR)
+        fail ("thread_create failed");
+    }
+  for (i = THREAD_CNT - 1; i >= 0; i--)
+    {
+      int status = thread_join (tids[i]);
+      int expected = i < THREAD_CNT - 1 ? 10 + i : 0;
+
+      if (status != expected)
+        fail ("thread %d ended with %d, expected %d", i, status, expected);
+      if (results[i] != i * i)
+        fail ("thread %d stored %d, expected %d", i, results[i], i * i);
+    }
+  msg ("joined %d threads", THREAD_CNT);
+  CHECK (thread_join (tids[0]) == -1, "join again (must return -1)");
+  CHECK (thread_join (TID_ERROR) == -1, "join TID_ERROR (must return -1)");
+}
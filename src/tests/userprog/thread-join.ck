@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(thread-join) begin
+(thread-join) joined 4 threads
+(thread-join) join again (must return -1)
+(thread-join) join TID_ERROR (must return -1)
+(thread-join) end
+thread-join: exit(0)
+EOF
+pass;
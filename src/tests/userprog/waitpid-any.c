@@ -0,0 +1,37 @@
+/* Waits for any child with waitpid(), which must return whichever
+   child has exited, not the oldest one, and then fails once no
+   children are left. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  pid_t first, second, pid;
+  int go[2], status;
+  char c;
+
+  CHECK (pipe (go), "pipe");
+  first = fork ();
+  if (first == 0)
+    {
+      close (go[1]);
+      exit (read (go[0], &c, 1) + 1);
+    }
+  second = fork ();
+  if (second == 0)
+    exit (2);
+  close (go[0]);
+
+  pid = waitpid (WAIT_ANY, &status, 0);
+  CHECK (pid == second && status == 2,
+         "waitpid(-1) returned the second child, status 2");
+  close (go[1]);
+  pid = waitpid (WAIT_ANY, &status, 0);
+  CHECK (pid == first && status == 1,
+         "waitpid(-1) returned the first child, status 1");
+  CHECK (waitpid (WAIT_ANY, &status, 0) == -1,
+         "waitpid(-1) with no children left (must fail)");
+}
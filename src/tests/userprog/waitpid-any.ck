@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(waitpid-any) begin
+(waitpid-any) pipe
+waitpid-any: exit(2)
+(waitpid-any) waitpid(-1) returned the second child, status 2
+waitpid-any: exit(1)
+(waitpid-any) waitpid(-1) returned the first child, status 1
+(waitpid-any) waitpid(-1) with no children left (must fail)
+(waitpid-any) end
+waitpid-any: exit(0)
+EOF
+pass;
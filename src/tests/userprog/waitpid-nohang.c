@@ -0,0 +1,37 @@
+/* Polls a running child with waitpid() and WNOHANG, which must
+   return 0 until the child exits. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  pid_t pid, result;
+  int go[2], status = -1;
+  char c;
+
+  CHECK (pipe (go), "pipe");
+  pid = fork ();
+  if (pid == 0)
+    {
+      close (go[1]);
+      exit (read (go[0], &c, 1) + 3);
+    }
+  close (go[0]);
+
+  CHECK (waitpid (pid, &status, WNOHANG) == 0,
+         "waitpid(child, WNOHANG) returned 0");
+  CHECK (waitpid (WAIT_ANY, &status, WNOHANG) == 0,
+         "waitpid(-1, WNOHANG) returned 0");
+  CHECK (status == -1, "status left alone");
+  CHECK (waitpid (pid, &status, 0x100) == -1,
+         "waitpid with bad options (must fail)");
+
+  close (go[1]);
+  result = waitpid (pid, &status, 0);
+  CHECK (result == pid && status == 3, "waitpid(child) returned it, status 3");
+  CHECK (waitpid (WAIT_ANY, &status, WNOHANG) == -1,
+         "waitpid(-1, WNOHANG) with no children left (must fail)");
+}
@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(waitpid-nohang) begin
+(waitpid-nohang) pipe
+(waitpid-nohang) waitpid(child, WNOHANG) returned 0
+(waitpid-nohang) waitpid(-1, WNOHANG) returned 0
+(waitpid-nohang) status left alone
+(waitpid-nohang) waitpid with bad options (must fail)
+waitpid-nohang: exit(3)
+(waitpid-nohang) waitpid(child) returned it, status 3
+(waitpid-nohang) waitpid(-1, WNOHANG) with no children left (must fail)
+(waitpid-nohang) end
+waitpid-nohang: exit(0)
+EOF
+pass;
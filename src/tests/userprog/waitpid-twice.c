@@ -0,0 +1,25 @@
+/* Waits for an exec'd child with waitpid() twice, with a null
+   status the second time.  The first call must return its pid, the
+   second -1 at once, as it has been reaped.  Waiting for a pid that
+   is no child must fail too. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  pid_t child = exec ("child-simple");
+  pid_t pid;
+  int status;
+
+  pid = waitpid (child, &status, 0);
+  CHECK (pid == child && status == 81,
+         "waitpid(exec()) returned it, status 81");
+  CHECK (waitpid (child, NULL, 0) == -1, "waitpid(exec()) again (must fail)");
+  CHECK (waitpid (child, NULL, WNOHANG) == -1,
+         "waitpid(exec(), WNOHANG) again (must fail)");
+  CHECK (waitpid (child + 1000, NULL, 0) == -1,
+         "waitpid of no such child (must fail)");
+}
@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(waitpid-twice) begin
+(child-simple) run
+child-simple: exit(81)
+(waitpid-twice) waitpid(exec()) returned it, status 81
+(waitpid-twice) waitpid(exec()) again (must fail)
+(waitpid-twice) waitpid(exec(), WNOHANG) again (must fail)
+(waitpid-twice) waitpid of no such child (must fail)
+(waitpid-twice) end
+waitpid-twice: exit(0)
+EOF
+pass;
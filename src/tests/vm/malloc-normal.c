@@ -0,0 +1,88 @@
+/* Allocates blocks of many sizes with malloc(), calloc() and
+   realloc(), checks that they don't overlap and keep their
+   contents, and frees them all. */
+
+#include <malloc.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define BLOCK_CNT 64
+
+static char *blocks[BLOCK_CNT];
+
+/* Returns the size of the Ith block: small ones from 1 to 2 kB
+   and then some of several pages. */
+static size_t
+block_size (int i)
+{
+  if (i < BLOCK_CNT - 8)
+    return 1 + i * 37;
+  else
+    return (i - BLOCK_CNT + 9) * 5000;
+}
+
+/* Checks that the Ith block, LEN bytes long, is all C. */
+static void
+check_block (int i, size_t len, char c)
+{
+  size_t j;
+
+  for (j = 0; j < len; j++)
+    if (blocks[i][j] != c)
+      fail ("byte %zu of block %d is %d, expected %d",
+            j, i, blocks[i][j], c);
+}
+
+void
+test_main (void)
+{
+  char *p;
+  int i;
+
+  for (i = 0; i < BLOCK_CNT; i++)
+    {
+      blocks[i] = malloc (block_size (i));
+      if (blocks[i] == NULL)
+        fail ("malloc (%zu) failed", block_size (i));
+      memset (blocks[i], 'A' + i % 26, block_size (i));
+    }
+  for (i = 0; i < BLOCK_CNT; i++)
+    check_block (i, block_size (i), 'A' + i % 26);
+  msg ("malloc %d blocks", BLOCK_CNT);
+
+  /* Free every other block and allocate them again zeroed. */
+  for (i = 0; i < BLOCK_CNT; i += 2)
+    free (blocks[i]);
+  for (i = 0; i < BLOCK_CNT; i += 2)
+    {
+      blocks[i] = calloc (block_size (i), 1);
+      if (blocks[i] == NULL)
+        fail ("calloc (%zu, 1) failed", block_size (i));
+      check_block (i, block_size (i), 0);
+    }
+  for (i = 1; i < BLOCK_CNT; i += 2)
+    check_block (i, block_size (i), 'A' + i % 26);
+  msg ("free and calloc every other block");
+
+  /* Grow each odd block to twice its size. */
+  for (i = 1; i < BLOCK_CNT; i += 2)
+    {
+      p = realloc (blocks[i], 2 * block_size (i));
+      if (p == NULL)
+        fail ("realloc (%zu) failed", 2 * block_size (i));
+      blocks[i] = p;
+      check_block (i, block_size (i), 'A' + i % 26);
+      memset (blocks[i], 'a' + i % 26, 2 * block_size (i));
+    }
+  for (i = 1; i < BLOCK_CNT; i += 2)
+    check_block (i, 2 * block_size (i), 'a' + i % 26);
+  for (i = 0; i < BLOCK_CNT; i += 2)
+    check_block (i, block_size (i), 0);
+  msg ("realloc every other block");
+
+  for (i = 0; i < BLOCK_CNT; i++)
+    free (blocks[i]);
+  msg ("free all blocks");
+}
@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(malloc-normal) begin
+(malloc-normal) malloc 64 blocks
+(malloc-normal) free and calloc every other block
+(malloc-normal) realloc every other block
+(malloc-normal) free all blocks
+(malloc-normal) end
+EOF
+pass;
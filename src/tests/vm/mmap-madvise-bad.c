@@ -0,0 +1,23 @@
+/* Verifies that madvise rejects an advice value that is not one
+   of the MADV_* constants, and a mapping that does not exist. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  int handle;
+  mapid_t map;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK ((map = mmap (handle, (void *) 0x10000000)) != MAP_FAILED,
+         "mmap \"sample.txt\"");
+  CHECK (madvise (map, MADV_DONTNEED + 1) == false,
+         "try to madvise with bad advice");
+  CHECK (madvise (map, -1) == false, "try to madvise with negative advice");
+  CHECK (madvise (map + 1, MADV_NORMAL) == false,
+         "try to madvise a bad mapping");
+  CHECK (madvise (map, MADV_SEQUENTIAL), "madvise sequential");
+}
@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(mmap-madvise-bad) begin
+(mmap-madvise-bad) open "sample.txt"
+(mmap-madvise-bad) mmap "sample.txt"
+(mmap-madvise-bad) try to madvise with bad advice
+(mmap-madvise-bad) try to madvise with negative advice
+(mmap-madvise-bad) try to madvise a bad mapping
+(mmap-madvise-bad) madvise sequential
+(mmap-madvise-bad) end
+EOF
+pass;
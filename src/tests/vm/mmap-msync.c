@@ -0,0 +1,34 @@
+/* Writes to a file through a mapping and calls msync, then
+   reads the data in the file back using the read system call
+   while the file is still mapped, to verify that msync wrote it
+   back. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ACTUAL ((void *) 0x10000000)
+
+void
+test_main (void)
+{
+  int handle;
+  mapid_t map;
+  char buf[1024];
+
+  CHECK (create ("sample.txt", strlen (sample)), "create \"sample.txt\"");
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK ((map = mmap (handle, ACTUAL)) != MAP_FAILED, "mmap \"sample.txt\"");
+  memcpy (ACTUAL, sample, strlen (sample));
+  CHECK (msync (map), "msync \"sample.txt\"");
+
+  /* Read back via read() before unmapping. */
+  CHECK (read (handle, buf, strlen (sample)) == (int) strlen (sample),
+         "read \"sample.txt\"");
+  CHECK (!memcmp (buf, sample, strlen (sample)),
+         "compare read data against written data");
+  munmap (map);
+  close (handle);
+}
@@ -0,0 +1,19 @@
+/* Verifies that mmap_range refuses an offset at the end of the
+   file, where there is nothing left to map. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+
+void
+test_main (void)
+{
+  int handle;
+
+  CHECK (create ("data", PAGE_SIZE), "create \"data\"");
+  CHECK ((handle = open ("data")) > 1, "open \"data\"");
+  CHECK (mmap_range (handle, (void *) 0x10000000, PAGE_SIZE, PAGE_SIZE)
+         == MAP_FAILED, "try to mmap_range at end of file");
+}
@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(mmap-range-eof) begin
+(mmap-range-eof) create "data"
+(mmap-range-eof) open "data"
+(mmap-range-eof) try to mmap_range at end of file
+(mmap-range-eof) end
+EOF
+pass;
@@ -0,0 +1,41 @@
+/* Maps a one-page window from the middle of a three-page file
+   with mmap_range and checks that it shows the middle page. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define ACTUAL ((char *) 0x10000000)
+
+static char buf[PAGE_SIZE];
+
+void
+test_main (void)
+{
+  int handle;
+  mapid_t map;
+  int i, j;
+
+  CHECK (create ("data", 3 * PAGE_SIZE), "create \"data\"");
+  CHECK ((handle = open ("data")) > 1, "open \"data\"");
+  for (i = 0; i < 3; i++)
+    {
+      for (j = 0; j < PAGE_SIZE; j++)
+        buf[j] = 'a' + i + j % 7;
+      if (write (handle, buf, PAGE_SIZE) != PAGE_SIZE)
+        fail ("write page %d", i);
+    }
+  msg ("write 3 pages");
+
+  CHECK ((map = mmap_range (handle, ACTUAL, PAGE_SIZE, PAGE_SIZE))
+         != MAP_FAILED, "mmap_range the middle page");
+  for (j = 0; j < PAGE_SIZE; j++)
+    if (ACTUAL[j] != 'b' + j % 7)
+      fail ("byte %d of the window is %d, expected %d",
+            j, ACTUAL[j], 'b' + j % 7);
+  msg ("verify the window");
+  munmap (map);
+  close (handle);
+}
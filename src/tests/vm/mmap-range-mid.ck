@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(mmap-range-mid) begin
+(mmap-range-mid) create "data"
+(mmap-range-mid) open "data"
+(mmap-range-mid) write 3 pages
+(mmap-range-mid) mmap_range the middle page
+(mmap-range-mid) verify the window
+(mmap-range-mid) end
+EOF
+pass;
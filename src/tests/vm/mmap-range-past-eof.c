@@ -0,0 +1,38 @@
+/* Maps a two-page window with mmap_range that starts at the
+   file's last, partial page and runs past the end of the file,
+   and checks that the file's data shows up followed by zeros. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define ACTUAL ((char *) 0x10000000)
+
+void
+test_main (void)
+{
+  size_t len = strlen (sample);
+  int handle;
+  mapid_t map;
+  size_t i;
+
+  CHECK (create ("data", PAGE_SIZE + len), "create \"data\"");
+  CHECK ((handle = open ("data")) > 1, "open \"data\"");
+  seek (handle, PAGE_SIZE);
+  CHECK (write (handle, sample, len) == (int) len,
+         "write \"sample\" after the first page");
+
+  CHECK ((map = mmap_range (handle, ACTUAL, PAGE_SIZE, 2 * PAGE_SIZE))
+         != MAP_FAILED, "mmap_range the last page and beyond");
+  if (memcmp (ACTUAL, sample, len))
+    fail ("window does not start with \"sample\"");
+  for (i = len; i < 2 * PAGE_SIZE; i++)
+    if (ACTUAL[i] != 0)
+      fail ("byte %zu of the window is %d, expected 0", i, ACTUAL[i]);
+  msg ("verify the window");
+  munmap (map);
+  close (handle);
+}
@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(mmap-range-past-eof) begin
+(mmap-range-past-eof) create "data"
+(mmap-range-past-eof) open "data"
+(mmap-range-past-eof) write "sample" after the first page
+(mmap-range-past-eof) mmap_range the last page and beyond
+(mmap-range-past-eof) verify the window
+(mmap-range-past-eof) end
+EOF
+pass;
@@ -0,0 +1,16 @@
+/* Verifies that mmap_range refuses an offset that is not a
+   multiple of the page size. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  int handle;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK (mmap_range (handle, (void *) 0x10000000, 100, 100) == MAP_FAILED,
+         "try to mmap_range at misaligned offset");
+}
@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(mmap-range-unaligned) begin
+(mmap-range-unaligned) open "sample.txt"
+(mmap-range-unaligned) try to mmap_range at misaligned offset
+(mmap-range-unaligned) end
+EOF
+pass;
@@ -43,7 +43,7 @@ sort_chunks (const char *subprocess, int exit_status)
 
   for (i = 0; i < CHUNK_CNT; i++) 
     {
-      char fn[128];
+      char fn[32];
       char cmd[128];
       int handle;
 
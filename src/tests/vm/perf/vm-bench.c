@@ -0,0 +1,190 @@
+/* Measures paging under memory pressure.  This program is used for
+   all of the vm-bench-* tests, which differ in their arguments:
+
+     vm-bench PERCENT PATTERN PROCESSES
+
+   The working set is PERCENT percent of the pages in the kernel's
+   user pool, so that 100 or more leaves too little memory for all
+   of it and some must be swapped.  It is split evenly among
+   PROCESSES processes, which first touch each of their pages and
+   then access them in PATTERN order: "seq" goes through the pages
+   in order, "random" picks pages uniformly, and "zipf" picks them
+   with probability inversely proportional to their rank, so that
+   a few pages are hot and most are cold.  Each access checks the
+   page still holds what was last written to it and writes it
+   again.
+
+   The whole run is one measurement named PATTERN, reporting the
+   faults, evictions and swap I/O of all the processes together. */
+
+#include <inttypes.h>
+#include <malloc.h>
+#include <memstat.h>
+#include <random.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/perf.h"
+#include "tests/lib.h"
+
+#define PAGE_SIZE 4096
+
+/* Most processes and most pages in a working set. */
+#define PROC_MAX 8
+#define PAGE_MAX 4096
+
+/* Accesses per page of the working set, after touching each. */
+#define ACCESS_FACTOR 4
+
+/* Access patterns. */
+enum pattern
+  {
+    SEQ,
+    RANDOM,
+    ZIPF
+  };
+
+/* Cumulative weights of ranks 0 through N-1 for "zipf": the weight
+   of rank R is ZIPF_SCALE / (R + 1). */
+#define ZIPF_SCALE 1000000
+static uint32_t zipf_cdf[PAGE_MAX];
+
+/* Fills in zipf_cdf[] for PAGE_CNT pages. */
+static void
+zipf_init (size_t page_cnt)
+{
+  uint32_t sum = 0;
+  size_t r;
+
+  for (r = 0; r < page_cnt; r++)
+    {
+      sum += ZIPF_SCALE / (r + 1);
+      zipf_cdf[r] = sum;
+    }
+}
+
+/* Returns a rank between 0 and PAGE_CNT - 1 chosen with zipf_cdf[]. */
+static size_t
+zipf_pick (size_t page_cnt)
+{
+  uint32_t x = random_ulong () % zipf_cdf[page_cnt - 1];
+  size_t lo = 0, hi = page_cnt - 1;
+
+  /* Find the first rank whose cumulative weight exceeds X. */
+  while (lo < hi)
+    {
+      size_t mid = lo + (hi - lo) / 2;
+      if (zipf_cdf[mid] > x)
+        hi = mid;
+      else
+        lo = mid + 1;
+    }
+  return lo;
+}
+
+/* Allocates PAGE_CNT pages, touches each, and then accesses them
+   PAGE_CNT * ACCESS_FACTOR times in PATTERN order. */
+static void
+run (size_t page_cnt, enum pattern pattern)
+{
+  uint8_t *pages;
+  uint32_t *tags;
+  size_t access_cnt = page_cnt * ACCESS_FACTOR;
+  size_t i;
+
+  pages = sbrk (page_cnt * PAGE_SIZE);
+  if (pages == (void *) -1)
+    fail ("sbrk %zu pages failed", page_cnt);
+  tags = malloc (page_cnt * sizeof *tags);
+  if (tags == NULL)
+    fail ("malloc failed");
+  if (pattern == ZIPF)
+    zipf_init (page_cnt);
+
+  for (i = 0; i < page_cnt; i++)
+    {
+      tags[i] = i;
+      *(uint32_t *) (pages + i * PAGE_SIZE) = tags[i];
+    }
+
+  for (i = 0; i < access_cnt; i++)
+    {
+      size_t page;
+      uint32_t *word;
+
+      if (pattern == SEQ)
+        page = i % page_cnt;
+      else if (pattern == RANDOM)
+        page = random_ulong () % page_cnt;
+      else
+        page = zipf_pick (page_cnt);
+
+      word = (uint32_t *) (pages + page * PAGE_SIZE);
+      if (*word != tags[page])
+        fail ("page %zu holds %"PRIu32" instead of %"PRIu32,
+              page, *word, tags[page]);
+      *word = tags[page] += page_cnt;
+    }
+}
+
+int
+main (int argc, char *argv[])
+{
+  struct memstat ms;
+  struct perf p;
+  pid_t children[PROC_MAX];
+  enum pattern pattern;
+  size_t page_cnt, proc_page_cnt;
+  int proc_cnt;
+  int i;
+
+  test_name = argv[0];
+  msg ("begin");
+
+  if (argc != 4)
+    fail ("usage: %s PERCENT seq|random|zipf PROCESSES", argv[0]);
+  if (!strcmp (argv[2], "seq"))
+    pattern = SEQ;
+  else if (!strcmp (argv[2], "random"))
+    pattern = RANDOM;
+  else if (!strcmp (argv[2], "zipf"))
+    pattern = ZIPF;
+  else
+    fail ("unknown access pattern \"%s\"", argv[2]);
+  proc_cnt = atoi (argv[3]);
+  if (proc_cnt < 1 || proc_cnt > PROC_MAX)
+    fail ("process count must be between 1 and %d", PROC_MAX);
+
+  CHECK (memstat (&ms), "memstat");
+  page_cnt = (size_t) ms.user_pool.page_cnt * atoi (argv[1]) / 100;
+  proc_page_cnt = page_cnt / proc_cnt;
+  if (proc_page_cnt == 0 || proc_page_cnt > PAGE_MAX)
+    fail ("%zu pages per process is out of range", proc_page_cnt);
+  msg ("%zu pages of %"PRIu32" in user pool, %d process(es)",
+       page_cnt, ms.user_pool.page_cnt, proc_cnt);
+
+  perf_start (&p, argv[2], perf_vm_stats);
+  for (i = 1; i < proc_cnt; i++)
+    {
+      children[i] = fork ();
+      if (children[i] == 0)
+        {
+          random_init (i);
+          run (proc_page_cnt, pattern);
+          exit (0);
+        }
+      CHECK (children[i] != -1, "fork child %d", i);
+    }
+  random_init (0);
+  run (proc_page_cnt, pattern);
+  for (i = 1; i < proc_cnt; i++)
+    if (wait (children[i]) != 0)
+      fail ("child %d failed", i);
+  perf_end (&p, (unsigned long long) proc_page_cnt * proc_cnt
+            * (ACCESS_FACTOR + 1),
+            (unsigned long long) proc_page_cnt * proc_cnt * PAGE_SIZE);
+
+  msg ("end");
+  return 0;
+}
@@ -1,6 +1,7 @@
 /* Reads from a file into a bad address.
    The process must be terminated with -1 exit code. */
 
+#include <stdint.h>
 #include <syscall.h>
 #include "tests/lib.h"
 #include "tests/main.h"
@@ -11,6 +12,6 @@ test_main (void)
   int handle;
 
   CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
-  read (handle, (char *) &handle - 4096, 1);
+  read (handle, (char *) ((uintptr_t) &handle - 4096), 1);
   fail ("survived reading data into bad address");
 }
@@ -0,0 +1,21 @@
+/* Verifies that sbrk() fails without moving the break when asked
+   to move it below the start of the heap or far past the end of
+   user memory. */
+
+#include <stdint.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  char *start = sbrk (0);
+
+  CHECK (sbrk (-1) == SBRK_FAILED, "try to shrink below start of heap");
+  CHECK (sbrk (INTPTR_MAX) == SBRK_FAILED, "try to grow past user memory");
+  CHECK (sbrk (0) == start, "break unchanged");
+  CHECK (sbrk (4096) == start, "grow by 1 page");
+  CHECK (sbrk (-8192) == SBRK_FAILED, "try to shrink by 2 pages");
+  CHECK (sbrk (0) == start + 4096, "break unchanged");
+}
@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(sbrk-bad) begin
+(sbrk-bad) try to shrink below start of heap
+(sbrk-bad) try to grow past user memory
+(sbrk-bad) break unchanged
+(sbrk-bad) grow by 1 page
+(sbrk-bad) try to shrink by 2 pages
+(sbrk-bad) break unchanged
+(sbrk-bad) end
+EOF
+pass;
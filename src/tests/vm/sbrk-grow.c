@@ -0,0 +1,30 @@
+/* Grows the heap with sbrk() by a few pages, checks that the new
+   memory reads as zeros and can be written, and that the break
+   moved by exactly the increment. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (3 * 4096 + 100)
+
+void
+test_main (void)
+{
+  char *start, *heap;
+  size_t i;
+
+  start = sbrk (0);
+  CHECK ((heap = sbrk (SIZE)) == start, "sbrk (%d)", SIZE);
+  CHECK (sbrk (0) == start + SIZE, "break moved by %d", SIZE);
+  for (i = 0; i < SIZE; i++)
+    if (heap[i] != 0)
+      fail ("byte %zu of new heap memory is %d, expected 0", i, heap[i]);
+  msg ("new heap memory reads as zeros");
+  for (i = 0; i < SIZE; i++)
+    heap[i] = i % 251;
+  for (i = 0; i < SIZE; i++)
+    if (heap[i] != (char) (i % 251))
+      fail ("byte %zu of heap memory changed", i);
+  msg ("heap memory holds what was written");
+}
@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(sbrk-grow) begin
+(sbrk-grow) sbrk (12388)
+(sbrk-grow) break moved by 12388
+(sbrk-grow) new heap memory reads as zeros
+(sbrk-grow) heap memory holds what was written
+(sbrk-grow) end
+EOF
+pass;
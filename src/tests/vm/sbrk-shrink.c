@@ -0,0 +1,34 @@
+/* Grows the heap with sbrk() and shrinks it again, checking that
+   the memory below the new break is kept and that memory given
+   back reads as zeros once the heap grows over it again. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+
+void
+test_main (void)
+{
+  char *heap;
+  size_t i;
+
+  CHECK ((heap = sbrk (3 * PAGE_SIZE)) != SBRK_FAILED, "grow by 3 pages");
+  for (i = 0; i < 3 * PAGE_SIZE; i++)
+    heap[i] = 'a';
+  CHECK (sbrk (-2 * PAGE_SIZE) == heap + 3 * PAGE_SIZE,
+         "shrink by 2 pages");
+  CHECK (sbrk (0) == heap + PAGE_SIZE, "break moved back by 2 pages");
+  for (i = 0; i < PAGE_SIZE; i++)
+    if (heap[i] != 'a')
+      fail ("byte %zu below the break changed", i);
+  msg ("memory below the break kept");
+
+  CHECK (sbrk (2 * PAGE_SIZE) == heap + PAGE_SIZE, "grow by 2 pages");
+  for (i = PAGE_SIZE; i < 3 * PAGE_SIZE; i++)
+    if (heap[i] != 0)
+      fail ("byte %zu of regrown heap memory is %d, expected 0",
+            i, heap[i]);
+  msg ("regrown heap memory reads as zeros");
+}
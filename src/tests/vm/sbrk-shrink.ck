@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(sbrk-shrink) begin
+(sbrk-shrink) grow by 3 pages
+(sbrk-shrink) shrink by 2 pages
+(sbrk-shrink) break moved back by 2 pages
+(sbrk-shrink) memory below the break kept
+(sbrk-shrink) grow by 2 pages
+(sbrk-shrink) regrown heap memory reads as zeros
+(sbrk-shrink) end
+EOF
+pass;
@@ -0,0 +1,302 @@
+#include "threads/fpu.h"
+#include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/thread.h"
+#ifdef USERPROG
+#include "userprog/process.h"
+#endif
+
+/* Floating-point and SSE state, switched lazily.
+
+   A thread that never runs an FPU instruction gets no state at all.
+   The first one it runs traps with #NM, since CR0.TS is set whenever
+   the thread running is not the one whose registers the FPU holds.
+   The trap saves that thread's registers into its state, loads the
+   running thread's, and clears TS, so that later instructions run at
+   full speed.  A thread switch touches no FPU registers, just TS, and
+   a thread that gets the CPU back without another having used the FPU
+   meanwhile doesn't trap at all.
+
+   The kernel itself is compiled not to use the FPU.  Code that wants
+   to, say for SIMD, brackets it with fpu_kernel_begin() and
+   fpu_kernel_end(). */
+
+/* CR0 bits. */
+#define CR0_MP 0x00000002       /* Monitor coprocessor. */
+#define CR0_EM 0x00000004       /* Emulation. */
+#define CR0_TS 0x00000008       /* Task switched. */
+#define CR0_NE 0x00000020       /* Numeric error. */
+
+/* CR4 bits. */
+#define CR4_OSFXSR 0x00000200   /* FXSAVE, FXRSTOR and SSE. */
+#define CR4_OSXMMEXCPT 0x00000400 /* #XF for SSE exceptions. */
+
+/* CPUID leaf 1 EDX bits. */
+#define CPUID_FXSR (1u << 24)
+#define CPUID_SSE (1u << 25)
+
+/* Bytes of FPU state FXSAVE stores, which FNSAVE's 108 fit in. */
+#define FPU_AREA_SIZE 512
+
+/* MXCSR of a new thread: all SSE exceptions masked. */
+#define MXCSR_DEFAULT 0x1f80
+
+/* Saved FPU state of a thread, as FXSAVE stores it, or FNSAVE on a
+   CPU without it.  FXSAVE wants its area 16-byte aligned, which
+   malloc() doesn't promise, so the area starts at the first aligned
+   byte of AREA. */
+struct fpu_state
+  {
+    uint8_t area[FPU_AREA_SIZE + 15];
+  };
+
+static bool has_fxsr;                   /* FXSAVE and FXRSTOR? */
+static bool has_sse;                    /* SSE instructions? */
+
+/* State a thread starts out with, initialized FPU and default
+   MXCSR. */
+static struct fpu_state initial_state;
+
+/* Thread whose state the FPU holds, if any, and whether TS is set,
+   for the one CPU brought up.  Guarded by turning interrupts off. */
+static struct thread *fpu_owner;
+static bool fpu_ts;
+
+static intr_handler_func fpu_trap;
+
+/* Returns the start of S's aligned save area. */
+static void *
+area (struct fpu_state *s)
+{
+  return (void *) ROUND_UP ((uintptr_t) s->area, 16);
+}
+
+/* Sets TS in CR0, if not set already. */
+static void
+set_ts (void)
+{
+  if (!fpu_ts)
+    {
+      uint32_t cr0;
+      asm volatile ("movl %%cr0, %0" : "=r" (cr0));
+      asm volatile ("movl %0, %%cr0" : : "r" (cr0 | CR0_TS) : "memory");
+      fpu_ts = true;
+    }
+}
+
+/* Clears TS in CR0, if set. */
+static void
+clear_ts (void)
+{
+  if (fpu_ts)
+    {
+      asm volatile ("clts" : : : "memory");
+      fpu_ts = false;
+    }
+}
+
+/* Stores the FPU registers in S.  FNSAVE reinitializes the FPU
+   afterward, so the FPU must be reloaded before its next use either
+   way. */
+static void
+save (struct fpu_state *s)
+{
+  if (has_fxsr)
+    asm volatile ("fxsave %0" : "=m" (*(uint8_t (*)[FPU_AREA_SIZE]) area (s)));
+  else
+    asm volatile ("fnsave %0; fwait"
+                  : "=m" (*(uint8_t (*)[FPU_AREA_SIZE]) area (s)));
+}
+
+/* Loads the FPU registers from S. */
+static void
+restore (struct fpu_state *s)
+{
+  if (has_fxsr)
+    asm volatile ("fxrstor %0"
+                  : : "m" (*(uint8_t (*)[FPU_AREA_SIZE]) area (s)));
+  else
+    asm volatile ("frstor %0"
+                  : : "m" (*(uint8_t (*)[FPU_AREA_SIZE]) area (s)));
+}
+
+/* Saves the state of the FPU's owner, if any, into its struct
+   fpu_state, and leaves the FPU unowned.  Interrupts must be off. */
+static void
+evict (void)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (fpu_owner != NULL)
+    {
+      clear_ts ();
+      save (fpu_owner->fpu);
+      fpu_owner = NULL;
+    }
+  set_ts ();
+}
+
+/* Turns on the FPU, and SSE if the CPU has it, with TS set so that the
+   first use traps. */
+void
+fpu_init (void)
+{
+  uint32_t eax = 1, ebx, ecx, edx, cr0, cr4;
+
+  asm volatile ("cpuid" : "+a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx));
+  has_fxsr = (edx & CPUID_FXSR) != 0;
+  has_sse = has_fxsr && (edx & CPUID_SSE) != 0;
+
+  asm volatile ("movl %%cr0, %0" : "=r" (cr0));
+  cr0 = (cr0 & ~(CR0_EM | CR0_TS)) | CR0_MP | CR0_NE;
+  asm volatile ("movl %0, %%cr0" : : "r" (cr0) : "memory");
+  if (has_fxsr)
+    {
+      asm volatile ("movl %%cr4, %0" : "=r" (cr4));
+      cr4 |= CR4_OSFXSR | (has_sse ? CR4_OSXMMEXCPT : 0);
+      asm volatile ("movl %0, %%cr4" : : "r" (cr4) : "memory");
+    }
+
+  asm volatile ("fninit");
+  if (has_sse)
+    {
+      uint32_t mxcsr = MXCSR_DEFAULT;
+      asm volatile ("ldmxcsr %0" : : "m" (mxcsr));
+    }
+  save (&initial_state);
+  fpu_ts = false;
+  set_ts ();
+
+  intr_register_int (7, 0, INTR_ON, fpu_trap,
+                     "#NM Device Not Available Exception");
+}
+
+/* Called when thread T starts running, with interrupts off, to trap
+   its first FPU instruction unless the FPU holds its state already. */
+void
+fpu_switch (struct thread *t)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (t == fpu_owner)
+    clear_ts ();
+  else
+    set_ts ();
+}
+
+/* Handles #NM, raised by the first FPU instruction a thread runs since
+   another thread used the FPU, by switching the FPU over to it. */
+static void
+fpu_trap (struct intr_frame *f)
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
+  if ((f->cs & 3) == 0)
+    PANIC ("kernel used the FPU outside fpu_kernel_begin()");
+
+  if (cur->fpu == NULL)
+    {
+      cur->fpu = malloc (sizeof *cur->fpu);
+      if (cur->fpu == NULL)
+        {
+          printf ("%s: out of memory for FPU state\n", cur->name);
+#ifdef USERPROG
+          process_terminate (-1);
+#else
+          thread_exit ();
+#endif
+        }
+      memcpy (area (cur->fpu), area (&initial_state), FPU_AREA_SIZE);
+    }
+
+  old_level = intr_disable ();
+  if (fpu_owner != cur)
+    {
+      evict ();
+      clear_ts ();
+      restore (cur->fpu);
+      fpu_owner = cur;
+    }
+  else
+    clear_ts ();
+  intr_set_level (old_level);
+}
+
+/* Stores in *COPY a copy of the running thread's FPU state, for a
+   child it is forking to start out with, or a null pointer if it has
+   never used the FPU.  Returns false if out of memory. */
+bool
+fpu_fork (struct fpu_state **copy)
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
+  *copy = NULL;
+  if (cur->fpu == NULL)
+    return true;
+  *copy = malloc (sizeof **copy);
+  if (*copy == NULL)
+    return false;
+
+  old_level = intr_disable ();
+  if (fpu_owner == cur)
+    evict ();
+  memcpy (area (*copy), area (cur->fpu), FPU_AREA_SIZE);
+  intr_set_level (old_level);
+  return true;
+}
+
+/* Discards the running thread's FPU state, as it exits. */
+void
+fpu_exit (void)
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level = intr_disable ();
+
+  if (fpu_owner == cur)
+    {
+      fpu_owner = NULL;
+      set_ts ();
+    }
+  intr_set_level (old_level);
+
+  /* Exiting with interrupts off leaks it, but can't free it. */
+  if (old_level == INTR_ON)
+    {
+      free (cur->fpu);
+      cur->fpu = NULL;
+    }
+}
+
+/* Lets the kernel use the FPU, and SSE if available, until
+   fpu_kernel_end(), starting from an initialized FPU.  The owner's
+   state is saved first.  Interrupts are off in between, so the code
+   there must be short and must not sleep.  Returns the interrupt
+   level to pass to fpu_kernel_end(). */
+enum intr_level
+fpu_kernel_begin (void)
+{
+  enum intr_level old_level = intr_disable ();
+
+  evict ();
+  clear_ts ();
+  restore (&initial_state);
+  return old_level;
+}
+
+/* Ends the use of the FPU started by the fpu_kernel_begin() call that
+   returned OLD_LEVEL. */
+void
+fpu_kernel_end (enum intr_level old_level)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  set_ts ();
+  intr_set_level (old_level);
+}
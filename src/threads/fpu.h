@@ -0,0 +1,18 @@
+#ifndef THREADS_FPU_H
+#define THREADS_FPU_H
+
+#include <stdbool.h>
+#include "threads/interrupt.h"
+
+struct thread;
+struct fpu_state;
+
+void fpu_init (void);
+void fpu_switch (struct thread *);
+bool fpu_fork (struct fpu_state **);
+void fpu_exit (void);
+
+enum intr_level fpu_kernel_begin (void);
+void fpu_kernel_end (enum intr_level);
+
+#endif /* threads/fpu.h */
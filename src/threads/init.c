@@ -15,19 +15,30 @@
 #include "devices/timer.h"
 #include "devices/vga.h"
 #include "devices/rtc.h"
+#include "threads/fpu.h"
 #include "threads/interrupt.h"
 #include "threads/io.h"
+#include "threads/kstack.h"
+#include "threads/vmalloc.h"
+#include "threads/trace.h"
 #include "threads/loader.h"
 #include "threads/malloc.h"
 #include "threads/palloc.h"
+#include "threads/profile.h"
 #include "threads/pte.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
+#include "threads/workqueue.h"
 #include "vm/frame.h"
+#include "vm/page.h"
+#include "vm/share.h"
 #include "vm/swap.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #include "userprog/exception.h"
 #include "userprog/gdt.h"
+#include "userprog/procstat.h"
+#include "userprog/prefetch.h"
 #include "userprog/syscall.h"
 #include "userprog/tss.h"
 #else
@@ -36,10 +47,17 @@
 #ifdef FILESYS
 #include "devices/block.h"
 #include "devices/ide.h"
+#include "devices/virtio-blk.h"
+#include "filesys/cache.h"
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
+#include "filesys/inode.h"
+#include "filesys/tmpfs.h"
 #endif
 
+#define CR4_PSE 0x00000010      /* Page Size Extensions. */
+#define CR4_PGE 0x00000080      /* Page Global Enable. */
+
 /* Page directory with kernel mappings only. */
 uint32_t *init_page_dir;
 
@@ -52,7 +70,10 @@ static bool format_filesys;
 static const char *filesys_bdev_name;
 static const char *scratch_bdev_name;
 #ifdef VM
-static const char *swap_bdev_name;
+static char *swap_bdev_name;
+
+/* -tmpfs: Directory to mount a tmpfs on, if any. */
+static const char *tmpfs_path;
 #endif
 #endif /* FILESYS */
 
@@ -70,6 +91,22 @@ static void usage (void);
 #ifdef FILESYS
 static void locate_block_devices (void);
 static void locate_block_device (enum block_type, const char *name);
+#ifdef VM
+static void locate_swap_devices (char *names);
+#endif
+static void swap_setup (void);
+
+/* An initializer run in a kernel thread of its own during boot, to
+   overlap with those main() runs itself. */
+struct init_task
+  {
+    void (*func) (void);        /* Initializer. */
+    struct semaphore done;      /* Upped when FUNC returns. */
+  };
+
+static void init_task_start (struct init_task *, const char *name,
+                             void (*func) (void));
+static void init_task_wait (struct init_task *);
 #endif
 
 int main (void);
@@ -99,8 +136,13 @@ main (void)
   /* Initialize memory system. */
   palloc_init (user_page_limit);
   malloc_init ();
+  trace_init ();
+  profile_init ();
   paging_init ();
+#ifdef VM
   frame_init ();
+  page_init ();
+#endif
 
   /* Segmentation. */
 #ifdef USERPROG
@@ -110,6 +152,7 @@ main (void)
 
   /* Initialize interrupt handlers. */
   intr_init ();
+  fpu_init ();
   timer_init ();
   kbd_init ();
   input_init ();
@@ -123,13 +166,29 @@ main (void)
   thread_start ();
   serial_init_queue ();
   timer_calibrate ();
+  workqueue_init ();
 
 #ifdef FILESYS
-  /* Initialize file system. */
-  ide_init ();
-  locate_block_devices (); 
-  swap_init (); /* Swap depends on block devices initialization. */
-  filesys_init (format_filesys);
+  /* Initialize file system.  Swap depends on block devices
+     initialization, but not on the file system, so it gets set up
+     while the file system reads its metadata. */
+  {
+    struct init_task swap_task;
+
+    ide_init ();
+    virtio_blk_init ();
+    locate_block_devices (); 
+    init_task_start (&swap_task, "swap-init", swap_setup);
+    filesys_init (format_filesys);
+#ifdef USERPROG
+    prefetch_start ();
+#endif
+    init_task_wait (&swap_task);
+#ifdef VM
+    if (tmpfs_path != NULL)
+      tmpfs_mount (tmpfs_path);
+#endif
+  }
 #endif
 
   printf ("Boot complete.\n");
@@ -158,13 +217,23 @@ bss_init (void)
 /* Populates the base page directory and page table with the
    kernel virtual mapping, and then sets up the CPU to use the
    new page directory.  Points init_page_dir to the page
-   directory it creates. */
+   directory it creates.
+
+   If the CPU supports them, 4 MB pages map every 4 MB of RAM
+   that holds no kernel text, which must stay read-only, so
+   kernel accesses to RAM take up few TLB entries. */
 static void
 paging_init (void)
 {
   uint32_t *pd, *pt;
   size_t page;
   extern char _start, _end_kernel_text;
+  uint32_t features = cpu_features ();
+  bool large = (features & CPUID_PSE) != 0;
+  /* The kernel mapping is the same in every page directory, so mark
+     it global for context switches not to flush it from the TLB. */
+  uint32_t global = (features & CPUID_PGE) != 0 ? PTE_G : 0;
+  uint32_t cr4;
 
   pd = init_page_dir = palloc_get_page (PAL_ASSERT | PAL_ZERO);
   pt = NULL;
@@ -176,14 +245,33 @@ paging_init (void)
       size_t pte_idx = pt_no (vaddr);
       bool in_kernel_text = &_start <= vaddr && vaddr < &_end_kernel_text;
 
+      if (large && pte_idx == 0 && page + PTSPAN / PGSIZE <= init_ram_pages
+          && (vaddr + PTSPAN <= &_start || &_end_kernel_text <= vaddr))
+        {
+          pd[pde_idx] = paddr | PTE_PS | PTE_P | PTE_W | global;
+          page += PTSPAN / PGSIZE - 1;
+          continue;
+        }
       if (pd[pde_idx] == 0)
         {
           pt = palloc_get_page (PAL_ASSERT | PAL_ZERO);
           pd[pde_idx] = pde_create (pt);
         }
 
-      pt[pte_idx] = pte_create_kernel (vaddr, !in_kernel_text);
+      pt[pte_idx] = pte_create_kernel (vaddr, !in_kernel_text) | global;
     }
+  kstack_init (pd);
+  vmalloc_init (pd);
+
+  /* Turn on 4 MB pages before the new page directory needs them,
+     and let global PTEs survive later CR3 loads.  See [IA32-v3a]
+     2.5 "Control Registers". */
+  asm volatile ("movl %%cr4, %0" : "=r" (cr4));
+  if (large)
+    cr4 |= CR4_PSE;
+  if (global)
+    cr4 |= CR4_PGE;
+  asm volatile ("movl %0, %%cr4" : : "r" (cr4) : "memory");
 
   /* Store the physical address of the page directory into CR3
      aka PDBR (page directory base register).  This activates our
@@ -193,6 +281,17 @@ paging_init (void)
   asm volatile ("movl %0, %%cr3" : : "r" (vtop (init_page_dir)));
 }
 
+/* Returns the CPU's feature flags, from EDX of CPUID leaf 1.  See
+   [IA32-v2a] "CPUID--CPU Identification". */
+uint32_t
+cpu_features (void)
+{
+  uint32_t eax = 1, ebx, ecx, edx;
+
+  asm volatile ("cpuid" : "+a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx));
+  return edx;
+}
+
 /* Breaks the kernel command line into words and returns them as
    an argv-like array. */
 static char **
@@ -255,12 +354,71 @@ parse_options (char **argv)
 #ifdef VM
       else if (!strcmp (name, "-swap"))
         swap_bdev_name = value;
+      else if (!strcmp (name, "-swap-pool"))
+        swap_pool_pages = atoi (value);
+      else if (!strcmp (name, "-stack-step"))
+        stack_growth_pages = atoi (value);
+      else if (!strcmp (name, "-mmap-populate"))
+        mmap_populate_pages = atoi (value);
+      else if (!strcmp (name, "-merge"))
+        share_merge_pages = atoi (value);
+      else if (!strcmp (name, "-tmpfs"))
+        tmpfs_path = value;
 #endif
 #endif
       else if (!strcmp (name, "-rs"))
         random_init (atoi (value));
       else if (!strcmp (name, "-mlfqs"))
         thread_mlfqs = true;
+      else if (!strcmp (name, "-lockstat"))
+        lock_stats_enabled = true;
+      else if (!strcmp (name, "-trace"))
+        trace_enabled = true;
+      else if (!strcmp (name, "-profile"))
+        profile_enabled = true;
+#ifdef USERPROG
+      else if (!strcmp (name, "-syscallstat"))
+        syscall_stats_enabled = true;
+      else if (!strcmp (name, "-procstat"))
+        procstat_enabled = true;
+#ifdef FILESYS
+      else if (!strcmp (name, "-prefetch"))
+        prefetch_programs = value;
+#endif
+#endif
+      else if (!strcmp (name, "-kstack"))
+        kstack_pages = atoi (value);
+#ifdef FILESYS
+      else if (!strcmp (name, "-dma"))
+        ide_use_dma = true;
+      else if (!strcmp (name, "-ide-poll"))
+        {
+          if (value == NULL || !ide_set_poll (value))
+            PANIC ("bad -ide-poll value `%s' (use -h for help)",
+                   value != NULL ? value : "");
+        }
+      else if (!strcmp (name, "-cache"))
+        cache_num_sectors = atoi (value);
+      else if (!strcmp (name, "-cache-policy"))
+        {
+          if (!cache_set_policy (value))
+            PANIC ("unknown cache policy `%s' (use -h for help)", value);
+        }
+      else if (!strcmp (name, "-cache-no-meta"))
+        cache_protect_meta = false;
+      else if (!strcmp (name, "-cache-quota"))
+        cache_quota_pct = atoi (value);
+      else if (!strcmp (name, "-extents"))
+        inode_use_extents = true;
+      else if (!strcmp (name, "-blocks"))
+        inode_use_blocks = true;
+      else if (!strcmp (name, "-packed"))
+        inode_use_packed = true;
+      else if (!strcmp (name, "-compress"))
+        inode_use_compress = true;
+      else if (!strcmp (name, "-dir-index"))
+        dir_use_index = true;
+#endif
 #ifdef USERPROG
       else if (!strcmp (name, "-ul"))
         user_page_limit = atoi (value);
@@ -379,11 +537,43 @@ usage (void)
           "  -filesys=BDEV      Use BDEV for file system instead of default.\n"
           "  -scratch=BDEV      Use BDEV for scratch instead of default.\n"
 #ifdef VM
-          "  -swap=BDEV         Use BDEV for swap instead of default.\n"
+          "  -swap=BDEV[,BDEV]...  Stripe swap over BDEVs instead of default.\n"
+          "  -swap-pool=PAGES   Keep up to PAGES pages of compressed swap in RAM.\n"
+          "  -stack-step=PAGES  Grow the stack by PAGES pages per fault.\n"
+          "  -mmap-populate=PAGES  Load the first PAGES pages of each mmap.\n"
+          "  -merge=PAGES       Merge identical pages, scanning PAGES a second.\n"
+          "  -tmpfs=DIR         Mount a file system kept in memory on DIR.\n"
 #endif
 #endif
           "  -rs=SEED           Set random number seed to SEED.\n"
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
+          "  -lockstat          Keep lock contention statistics.\n"
+          "  -trace             Record kernel events, printed at shutdown.\n"
+          "  -profile           Sample running code every tick, printed at shutdown.\n"
+#ifdef USERPROG
+          "  -syscallstat       Keep system call counts and latencies.\n"
+          "  -procstat          Print each process's I/O and memory use at exit.\n"
+#ifdef FILESYS
+          "  -prefetch=PROG[,PROG]...  Read PROGs into the cache at boot, or with\n"
+          "                     \"auto\" those run in the last boot run with it.\n"
+#endif
+#endif
+          "  -kstack=PAGES      Give threads PAGES-page kernel stacks with guards.\n"
+#ifdef FILESYS
+          "  -dma               Use bus-master DMA for IDE disks if possible.\n"
+          "  -ide-poll=[DISK:]US  Spin US microseconds for short IDE transfers\n"
+          "                     of DISK (e.g. hda), or all disks, before sleeping.\n"
+          "  -cache=SECTORS     Size the buffer cache to SECTORS sectors.\n"
+          "  -cache-policy=POL  Replace cache sectors by POL, clock or 2q.\n"
+          "  -cache-no-meta     Don't favor keeping file system metadata cached.\n"
+          "  -cache-quota=PCT   Keep each process to PCT%% of the cache while\n"
+          "                     others need their share.\n"
+          "  -extents           Lay out new files as extents of contiguous sectors.\n"
+          "  -blocks            Give new files 4 kB blocks instead of sectors.\n"
+          "  -packed            Pack new files' inodes 4 to a sector.\n"
+          "  -compress          Compress files' data when last closed.\n"
+          "  -dir-index         Create new directories as hash indexed.\n"
+#endif
 #ifdef USERPROG
           "  -ul=COUNT          Limit user memory to COUNT pages.\n"
 #endif
@@ -392,6 +582,44 @@ usage (void)
 }
 
 #ifdef FILESYS
+/* Runs init_task TASK_'s initializer and signals its completion. */
+static void
+init_task_run (void *task_)
+{
+  struct init_task *task = task_;
+
+  task->func ();
+  sema_up (&task->done);
+}
+
+/* Runs FUNC as TASK in a new thread named NAME, or right away if no
+   thread can be created. */
+static void
+init_task_start (struct init_task *task, const char *name,
+                 void (*func) (void))
+{
+  task->func = func;
+  sema_init (&task->done, 0);
+  if (thread_create (name, PRI_DEFAULT, init_task_run, task) == TID_ERROR)
+    init_task_run (task);
+}
+
+/* Waits for TASK's FUNC to return. */
+static void
+init_task_wait (struct init_task *task)
+{
+  sema_down (&task->done);
+}
+
+/* Sets up swap and starts the page-out and merge work. */
+static void
+swap_setup (void)
+{
+  swap_init ();
+  frame_pageout_init ();
+  share_merge_init ();
+}
+
 /* Figure out what block devices to cast in the various Pintos roles. */
 static void
 locate_block_devices (void)
@@ -399,10 +627,40 @@ locate_block_devices (void)
   locate_block_device (BLOCK_FILESYS, filesys_bdev_name);
   locate_block_device (BLOCK_SCRATCH, scratch_bdev_name);
 #ifdef VM
-  locate_block_device (BLOCK_SWAP, swap_bdev_name);
+  locate_swap_devices (swap_bdev_name);
 #endif
 }
 
+#ifdef VM
+/* Figures out what block devices to stripe swap over: those in
+   NAMES, a comma-separated list, if NAMES is non-null, otherwise
+   every block device of type BLOCK_SWAP in probe order. The first
+   one also gets the swap role. */
+static void
+locate_swap_devices (char *names)
+{
+  struct block *block;
+
+  if (names != NULL)
+    {
+      char *name, *save_ptr;
+
+      for (name = strtok_r (names, ",", &save_ptr); name != NULL;
+           name = strtok_r (NULL, ",", &save_ptr))
+        {
+          block = block_get_by_name (name);
+          if (block == NULL)
+            PANIC ("No such block device \"%s\"", name);
+          swap_add_device (block);
+        }
+    }
+  else
+    for (block = block_first (); block != NULL; block = block_next (block))
+      if (block_type (block) == BLOCK_SWAP)
+        swap_add_device (block);
+}
+#endif
+
 /* Figures out what block device to use for the given ROLE: the
    block device with the given NAME, if NAME is non-null,
    otherwise the first block device in probe order of type
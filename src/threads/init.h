@@ -9,4 +9,14 @@
 /* Page directory with kernel mappings only. */
 extern uint32_t *init_page_dir;
 
+/* Flags in cpu_features(). */
+#define CPUID_PSE 0x00000008    /* CPUID.1:EDX flag for 4 MB pages. */
+#define CPUID_TSC 0x00000010    /* CPUID.1:EDX flag for rdtsc. */
+#define CPUID_SEP 0x00000800    /* CPUID.1:EDX flag for sysenter. */
+#define CPUID_PGE 0x00002000    /* CPUID.1:EDX flag for global pages. */
+#define CPUID_SSE2 0x04000000   /* CPUID.1:EDX flag for SSE2, which has
+                                   non-temporal stores. */
+
+uint32_t cpu_features (void);
+
 #endif /* threads/init.h */
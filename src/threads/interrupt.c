@@ -9,6 +9,9 @@
 #include "threads/thread.h"
 #include "threads/vaddr.h"
 #include "devices/timer.h"
+#ifdef USERPROG
+#include "userprog/process.h"
+#endif
 
 /* Programmable Interrupt Controller (PIC) registers.
    A PC has two PICs, called the master and slave PICs, with the
@@ -40,13 +43,26 @@ static unsigned int unexpected_cnt[INTR_CNT];
 /* External interrupts are those generated by devices outside the
    CPU, such as the timer.  External interrupts run with
    interrupts turned off, so they never nest, nor are they ever
-   pre-empted.  Handlers for external interrupts also may not
-   sleep, although they may invoke intr_yield_on_return() to
-   request that a new process be scheduled just before the
-   interrupt returns. */
+   pre-empted, though they may interrupt bottom halves.  Handlers
+   for external interrupts also may not sleep, although they may
+   invoke intr_yield_on_return() to request that a new process be
+   scheduled just before the interrupt returns. */
 static bool in_external_intr;   /* Are we processing an external interrupt? */
 static bool yield_on_return;    /* Should we yield on interrupt return? */
 
+/* Bottom halves.  A handler for an external interrupt does only what
+   can't wait, and raises a bottom half for the rest, which runs
+   once the interrupt has been acknowledged, with interrupts turned
+   back on so that other devices' interrupts aren't held off by it.
+   Bottom halves count as interrupt context: they may not sleep
+   either, and may invoke intr_yield_on_return().  An interrupt that
+   arrives while they run raises its bottom halves for the running
+   ones to pick up, rather than running them nested. */
+static intr_softirq_func *softirq_handlers[INTR_SOFTIRQ_CNT];
+static unsigned softirq_pending; /* Raised bottom halves, one bit each. */
+static bool in_softirq;         /* Are we running bottom halves? */
+static void run_softirqs (void);
+
 /* Programmable Interrupt Controller helpers. */
 static void pic_init (void);
 static void pic_end_of_interrupt (int irq);
@@ -54,6 +70,7 @@ static void pic_end_of_interrupt (int irq);
 /* Interrupt Descriptor Table helpers. */
 static uint64_t make_intr_gate (void (*) (void), int dpl);
 static uint64_t make_trap_gate (void (*) (void), int dpl);
+static uint64_t make_task_gate (uint16_t tss_sel);
 static inline uint64_t make_idtr_operand (uint16_t limit, void *base);
 
 /* Interrupt handlers. */
@@ -185,6 +202,17 @@ intr_register_ext (uint8_t vec_no, intr_handler_func *handler,
   register_handler (vec_no, 0, INTR_OFF, handler, name);
 }
 
+/* Registers internal interrupt VEC_NO to switch to the task of
+   the TSS that selector TSS_SEL refers to, which is named NAME for
+   debugging purposes.  That task runs on a stack of its own, so it
+   can handle an exception whose cause is the current stack. */
+void
+intr_register_task (uint8_t vec_no, uint16_t tss_sel, const char *name)
+{
+  idt[vec_no] = make_task_gate (tss_sel);
+  intr_names[vec_no] = name;
+}
+
 /* Registers internal interrupt VEC_NO to invoke HANDLER, which
    is named NAME for debugging purposes.  The interrupt handler
    will be invoked with interrupt status LEVEL.
@@ -206,12 +234,80 @@ intr_register_int (uint8_t vec_no, int dpl, enum intr_level level,
   register_handler (vec_no, dpl, level, handler, name);
 }
 
-/* Returns true during processing of an external interrupt
-   and false at all other times. */
+/* Returns true during processing of an external interrupt,
+   including its bottom halves, and false at all other times. */
 bool
 intr_context (void) 
 {
-  return in_external_intr;
+  return in_external_intr || in_softirq;
+}
+
+/* Registers HANDLER to run as bottom half NR. */
+void
+intr_register_softirq (enum intr_softirq nr, intr_softirq_func *handler)
+{
+  ASSERT (nr < INTR_SOFTIRQ_CNT);
+  softirq_handlers[nr] = handler;
+}
+
+/* Has bottom half NR run at the end of the current external
+   interrupt, or of the next one if there is none.  Interrupts must
+   be off. */
+void
+intr_raise_softirq (enum intr_softirq nr)
+{
+  ASSERT (nr < INTR_SOFTIRQ_CNT);
+  ASSERT (intr_get_level () == INTR_OFF);
+  softirq_pending |= 1u << nr;
+}
+
+/* Runs the raised bottom halves with interrupts on, until none are
+   left raised.  Called with interrupts off at the end of an external
+   interrupt, and returns with them off. */
+static void
+run_softirqs (void)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  in_softirq = true;
+  while (softirq_pending != 0)
+    {
+      unsigned pending = softirq_pending;
+      int nr;
+
+      softirq_pending = 0;
+      intr_enable ();
+      for (nr = 0; nr < INTR_SOFTIRQ_CNT; nr++)
+        if ((pending & (1u << nr)) && softirq_handlers[nr] != NULL)
+          softirq_handlers[nr] ();
+      intr_disable ();
+    }
+  in_softirq = false;
+}
+
+/* Returns true if external interrupt VEC_NO has been raised but not
+   yet delivered, because interrupts are off. */
+bool
+intr_is_pending (uint8_t vec_no)
+{
+  enum intr_level old_level;
+  bool pending;
+
+  ASSERT (vec_no >= 0x20 && vec_no <= 0x2f);
+
+  /* OCW3: read the interrupt request register on the next read. */
+  old_level = intr_disable ();
+  if (vec_no < 0x28)
+    {
+      outb (PIC0_CTRL, 0x0a);
+      pending = (inb (PIC0_CTRL) >> (vec_no - 0x20)) & 1;
+    }
+  else
+    {
+      outb (PIC1_CTRL, 0x0a);
+      pending = (inb (PIC1_CTRL) >> (vec_no - 0x28)) & 1;
+    }
+  intr_set_level (old_level);
+  return pending;
 }
 
 /* During processing of an external interrupt, directs the
@@ -327,6 +423,19 @@ make_trap_gate (void (*function) (void), int dpl)
   return make_gate (function, dpl, 15);
 }
 
+/* Creates a task gate that switches to the task of the TSS
+   selected by TSS_SEL.  See [IA32-v3a] 6.2.5 "Task-Gate
+   Descriptor". */
+static uint64_t
+make_task_gate (uint16_t tss_sel)
+{
+  uint32_t e0 = (uint32_t) tss_sel << 16;  /* TSS segment selector. */
+  uint32_t e1 = ((1 << 15)                 /* Present. */
+                 | (5 << 8));              /* Task gate, DPL 0. */
+
+  return e0 | ((uint64_t) e1 << 32);
+}
+
 /* Returns a descriptor that yields the given LIMIT and BASE when
    used as an operand for the LIDT instruction. */
 static inline uint64_t
@@ -347,6 +456,10 @@ intr_handler (struct intr_frame *frame)
   bool external;
   intr_handler_func *handler;
 
+  /* The thread ran in user mode up to now. */
+  if ((frame->cs & 3) == 3)
+    thread_account_time (true);
+
   /* External interrupts are special.
      We only handle one at a time (so interrupts must be off)
      and they need to be acknowledged on the PIC (see below).
@@ -355,10 +468,12 @@ intr_handler (struct intr_frame *frame)
   if (external) 
     {
       ASSERT (intr_get_level () == INTR_OFF);
-      ASSERT (!intr_context ());
+      ASSERT (!in_external_intr);
 
       in_external_intr = true;
-      yield_on_return = false;
+      /* A yield asked for by interrupted bottom halves stands. */
+      if (!in_softirq)
+        yield_on_return = false;
     }
 
   /* Invoke the interrupt's handler. */
@@ -383,9 +498,29 @@ intr_handler (struct intr_frame *frame)
       in_external_intr = false;
       pic_end_of_interrupt (frame->vec_no); 
 
-      if (yield_on_return) 
-        thread_yield (); 
+      /* Bottom halves that we interrupted go on with ours once we
+         return to them. */
+      if (!in_softirq)
+        {
+          run_softirqs ();
+          if (yield_on_return) 
+            thread_yield (); 
+        }
     }
+
+#ifdef USERPROG
+  /* A thread of a process being terminated exits instead of going
+     back to user mode. */
+  if ((frame->cs & 3) == 3 && process_is_exiting ())
+    {
+      intr_enable ();
+      thread_exit ();
+    }
+#endif
+
+  /* And in the kernel since then. */
+  if ((frame->cs & 3) == 3)
+    thread_account_time (false);
 }
 
 /* Handles an unexpected interrupt with interrupt frame F.  An
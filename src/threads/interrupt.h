@@ -57,12 +57,24 @@ struct intr_frame
 
 typedef void intr_handler_func (struct intr_frame *);
 
+/* Bottom halves, the deferred part of handling external interrupts. */
+enum intr_softirq
+  {
+    INTR_SOFTIRQ_TIMER,         /* Kernel timers that have gone off. */
+    INTR_SOFTIRQ_CNT
+  };
+typedef void intr_softirq_func (void);
+
 void intr_init (void);
 void intr_register_ext (uint8_t vec, intr_handler_func *, const char *name);
+void intr_register_task (uint8_t vec, uint16_t tss_sel, const char *name);
 void intr_register_int (uint8_t vec, int dpl, enum intr_level,
                         intr_handler_func *, const char *name);
 bool intr_context (void);
+bool intr_is_pending (uint8_t vec_no);
 void intr_yield_on_return (void);
+void intr_register_softirq (enum intr_softirq, intr_softirq_func *);
+void intr_raise_softirq (enum intr_softirq);
 
 void intr_dump_frame (const struct intr_frame *);
 const char *intr_name (uint8_t vec);
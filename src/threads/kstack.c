@@ -0,0 +1,145 @@
+#include "threads/kstack.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <stdio.h>
+#include "threads/interrupt.h"
+#include "threads/loader.h"
+#include "threads/palloc.h"
+#include "threads/pte.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* Kernel stacks bigger than a page.
+
+   With the "-kstack" option, each thread but the initial one gets
+   a slot of the kernel stack region instead of a single page.  A
+   slot is a power of two pages long, so that the running thread is
+   still found by rounding down its stack pointer.  Only the pages
+   at the top of the slot are mapped: the struct thread at the very
+   top, and its stack right below it.  The pages under those are
+   never mapped, so a stack that overflows faults instead of running
+   into whatever is next, which costs no memory.
+
+   The page tables of the region are made once, in the initial page
+   directory, so every process's page directory shares them and a
+   stack mapped later shows up in all of them. */
+
+size_t kstack_pages;
+uintptr_t kstack_slot_size;
+
+/* Page tables of the region, one per 4 MB of it. */
+static uint32_t *page_tables[(KSTACK_END - KSTACK_BASE) / PTSPAN];
+
+/* Slots in use, guarded by turning interrupts off. */
+static struct bitmap *used_slots;
+
+static uint32_t *lookup_pte (const void *vaddr);
+static void unmap_pages (uint8_t *top, size_t page_cnt);
+
+/* Sets up the kernel stack region in initial page directory PD, if
+   the "-kstack" option asks for it. */
+void
+kstack_init (uint32_t *pd)
+{
+  size_t i;
+
+  if (kstack_pages == 0)
+    return;
+  if (kstack_pages > KSTACK_PAGES_MAX)
+    PANIC ("kernel stacks can be at most %d pages", KSTACK_PAGES_MAX);
+  ASSERT (sizeof (struct thread) <= KSTACK_THREAD_SIZE);
+  ASSERT ((uintptr_t) ptov (init_ram_pages * PGSIZE) <= KSTACK_BASE);
+
+  /* Leave at least one unmapped guard page under every stack. */
+  kstack_slot_size = PGSIZE;
+  while (kstack_slot_size <= kstack_pages * PGSIZE)
+    kstack_slot_size *= 2;
+  used_slots = bitmap_create ((KSTACK_END - KSTACK_BASE) / kstack_slot_size);
+  if (used_slots == NULL)
+    PANIC ("can't set up kernel stacks");
+
+  for (i = 0; i < sizeof page_tables / sizeof *page_tables; i++)
+    {
+      page_tables[i] = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+      pd[pd_no ((void *) (KSTACK_BASE + i * PTSPAN))]
+        = pde_create (page_tables[i]);
+    }
+}
+
+/* Returns the page table entry for VADDR in the region. */
+static uint32_t *
+lookup_pte (const void *vaddr)
+{
+  size_t pt_idx = ((uintptr_t) vaddr - KSTACK_BASE) / PTSPAN;
+
+  ASSERT (kstack_contains (vaddr));
+  return &page_tables[pt_idx][pt_no (vaddr)];
+}
+
+/* Unmaps and frees the PAGE_CNT pages right below TOP. */
+static void
+unmap_pages (uint8_t *top, size_t page_cnt)
+{
+  while (page_cnt-- > 0)
+    {
+      uint8_t *vaddr = top - (page_cnt + 1) * PGSIZE;
+      uint32_t *pte = lookup_pte (vaddr);
+      void *page = pte_get_page (*pte);
+
+      *pte = 0;
+      asm volatile ("invlpg (%0)" : : "r" (vaddr) : "memory");
+      palloc_free_page (page);
+    }
+}
+
+/* Maps a new kernel stack and returns where its struct thread goes,
+   or a null pointer if memory or slots are not available. */
+struct thread *
+kstack_alloc (void)
+{
+  enum intr_level old_level;
+  size_t slot;
+  uint8_t *top;
+  size_t i;
+
+  ASSERT (kstack_pages > 0);
+
+  old_level = intr_disable ();
+  slot = bitmap_scan_and_flip (used_slots, 0, 1, false);
+  intr_set_level (old_level);
+  if (slot == BITMAP_ERROR)
+    return NULL;
+
+  top = (uint8_t *) KSTACK_BASE + (slot + 1) * kstack_slot_size;
+  for (i = 0; i < kstack_pages; i++)
+    {
+      void *page = palloc_get_page (0);
+      if (page == NULL)
+        {
+          unmap_pages (top, i);
+          old_level = intr_disable ();
+          bitmap_reset (used_slots, slot);
+          intr_set_level (old_level);
+          return NULL;
+        }
+      *lookup_pte (top - (i + 1) * PGSIZE) = pte_create_kernel (page, true);
+    }
+  return kstack_thread (top - 1);
+}
+
+/* Unmaps the kernel stack of T, which kstack_alloc() returned, and
+   frees its pages and slot. */
+void
+kstack_free (struct thread *t)
+{
+  uint8_t *top = (uint8_t *) t + KSTACK_THREAD_SIZE;
+  enum intr_level old_level;
+
+  ASSERT (kstack_contains (t));
+
+  unmap_pages (top, kstack_pages);
+  old_level = intr_disable ();
+  bitmap_reset (used_slots,
+                ((uintptr_t) top - KSTACK_BASE) / kstack_slot_size - 1);
+  intr_set_level (old_level);
+}
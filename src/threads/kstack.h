@@ -0,0 +1,51 @@
+#ifndef THREADS_KSTACK_H
+#define THREADS_KSTACK_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct thread;
+
+/* Kernel virtual region that holds the kernel stacks of threads
+   when they are bigger than a page, above the direct mapping of
+   physical memory. */
+#define KSTACK_BASE ((uintptr_t) 0xf0000000)
+#define KSTACK_END ((uintptr_t) 0xf4000000)
+
+/* Most pages in a kernel stack. */
+#define KSTACK_PAGES_MAX 31
+
+/* Bytes kept for the struct thread at the top of each stack. */
+#define KSTACK_THREAD_SIZE 1024
+
+/* Set by the "-kstack" kernel command-line option: pages in each
+   thread's kernel stack, or 0 for a thread and its stack to share
+   a single page. */
+extern size_t kstack_pages;
+
+/* Bytes of virtual memory in each stack's slot of the region. */
+extern uintptr_t kstack_slot_size;
+
+void kstack_init (uint32_t *pd);
+struct thread *kstack_alloc (void);
+void kstack_free (struct thread *);
+
+/* Returns true if VADDR is in the kernel stack region. */
+static inline bool
+kstack_contains (const void *vaddr)
+{
+  return (uintptr_t) vaddr >= KSTACK_BASE && (uintptr_t) vaddr < KSTACK_END;
+}
+
+/* Returns the thread whose kernel stack holds VADDR, which must be
+   in the region.  Each thread sits at the top of its slot, just
+   above its stack. */
+static inline struct thread *
+kstack_thread (const void *vaddr)
+{
+  uintptr_t top = ((uintptr_t) vaddr | (kstack_slot_size - 1)) + 1;
+  return (struct thread *) (top - KSTACK_THREAD_SIZE);
+}
+
+#endif /* threads/kstack.h */
@@ -0,0 +1,88 @@
+#include "threads/kstat.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Registry of kernel statistics.
+
+   Modules keep their counters and gauges in static struct
+   kstat_counters and register them once, at initialization, so that
+   the kstat system call and the statistics printed at shutdown see
+   them all under their names.  Registration order is kept, so a
+   module's statistics stay together. */
+
+/* Most statistics that can be registered. */
+#define KSTAT_MAX 64
+
+/* Registered statistics, guarded by turning interrupts off. */
+static struct kstat_counter *counters[KSTAT_MAX];
+static size_t counter_cnt;
+
+/* Registers C, which must stay in place from now on. */
+void
+kstat_register (struct kstat_counter *c)
+{
+  enum intr_level old_level;
+
+  ASSERT (c != NULL && c->name != NULL);
+
+  old_level = intr_disable ();
+  if (counter_cnt >= KSTAT_MAX)
+    PANIC ("too many kernel statistics, increase KSTAT_MAX");
+  counters[counter_cnt++] = c;
+  intr_set_level (old_level);
+}
+
+/* Returns the current value of C. */
+static uint64_t
+counter_value (struct kstat_counter *c)
+{
+  enum intr_level old_level;
+  uint64_t value;
+
+  if (c->read != NULL)
+    return c->read ();
+  old_level = intr_disable ();
+  value = c->value;
+  intr_set_level (old_level);
+  return value;
+}
+
+/* Copies up to CNT of the registered statistics into STATS, in the
+   order they were registered.  Returns the number copied.  Gauges
+   are read on the spot, so this must not be called from an
+   interrupt handler. */
+size_t
+kstat_get (struct kstat *stats, size_t cnt)
+{
+  size_t i;
+
+  ASSERT (!intr_context ());
+
+  if (cnt > counter_cnt)
+    cnt = counter_cnt;
+  for (i = 0; i < cnt; i++)
+    {
+      struct kstat_counter *c = counters[i];
+
+      strlcpy (stats[i].name, c->name, sizeof stats[i].name);
+      stats[i].value = counter_value (c);
+      stats[i].gauge = c->read != NULL;
+    }
+  return cnt;
+}
+
+/* Prints the registered statistics that are not zero. */
+void
+kstat_print_stats (void)
+{
+  size_t i;
+
+  for (i = 0; i < counter_cnt; i++)
+    {
+      uint64_t value = counter_value (counters[i]);
+      if (value != 0)
+        printf ("Stat %s: %"PRIu64"\n", counters[i]->name, value);
+    }
+}
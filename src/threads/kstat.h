@@ -0,0 +1,45 @@
+#ifndef THREADS_KSTAT_H
+#define THREADS_KSTAT_H
+
+#include <kstat.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "threads/interrupt.h"
+
+/* A named statistic kept by some part of the kernel: a counter of
+   events, which the kernel adds to, or a gauge, whose value READ
+   returns when asked for. */
+struct kstat_counter
+  {
+    const char *name;           /* Name, such as "cache.hit". */
+    uint64_t value;             /* Counter value, guarded by turning
+                                   interrupts off. */
+    uint64_t (*read) (void);    /* Returns the gauge's value, or null
+                                   for a counter. */
+  };
+
+/* Initializers for a counter and a gauge named NAME. */
+#define KSTAT_COUNTER(NAME) { NAME, 0, NULL }
+#define KSTAT_GAUGE(NAME, READ) { NAME, 0, READ }
+
+void kstat_register (struct kstat_counter *);
+size_t kstat_get (struct kstat *, size_t cnt);
+void kstat_print_stats (void);
+
+/* Adds N to counter C.  May be called from interrupt handlers. */
+static inline void
+kstat_add (struct kstat_counter *c, uint64_t n)
+{
+  enum intr_level old_level = intr_disable ();
+  c->value += n;
+  intr_set_level (old_level);
+}
+
+/* Adds 1 to counter C. */
+static inline void
+kstat_inc (struct kstat_counter *c)
+{
+  kstat_add (c, 1);
+}
+
+#endif /* threads/kstat.h */
@@ -1,12 +1,16 @@
 #include "threads/malloc.h"
 #include <debug.h>
+#include <inttypes.h>
 #include <list.h>
+#include <memstat.h>
 #include <round.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/interrupt.h"
 #include "threads/palloc.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
 #include "threads/vaddr.h"
 
 /* A simple implementation of malloc().
@@ -32,7 +36,18 @@
    because they're too big to fit in a single page with a
    descriptor.  We handle those by allocating contiguous pages
    with the page allocator and sticking the allocation size at
-   the beginning of the allocated block's arena header. */
+   the beginning of the allocated block's arena header.
+
+   In front of the descriptors, each CPU keeps a "magazine" of free
+   blocks of each size, taken and refilled with interrupts off
+   instead of under the descriptor's lock.  An empty magazine is
+   refilled, and a full one drained, MAG_BATCH blocks at a time in
+   a single hold of the lock.  Blocks in magazines count as in use
+   as far as their arenas are concerned.
+
+   The counts of blocks allocated and freed are kept per CPU in the
+   magazines too, so that keeping them costs nothing more than
+   the magazines do. */
 
 /* Descriptor. */
 struct desc
@@ -41,6 +56,8 @@ struct desc
     size_t blocks_per_arena;    /* Number of blocks in an arena. */
     struct list free_list;      /* List of free blocks. */
     struct lock lock;           /* Lock. */
+    size_t arena_cnt;           /* Arenas held, guarded by LOCK. */
+    size_t peak_arena_cnt;      /* Most arenas held at once. */
   };
 
 /* Magic number for detecting arena corruption. */
@@ -61,11 +78,33 @@ struct block
   };
 
 /* Our set of descriptors. */
-static struct desc descs[10];   /* Descriptors. */
+#define DESC_MAX MEMSTAT_DESC_MAX
+static struct desc descs[DESC_MAX]; /* Descriptors. */
 static size_t desc_cnt;         /* Number of descriptors. */
 
+/* Magazine of a CPU for one descriptor. */
+#define MAG_SIZE 16             /* Most blocks in a magazine. */
+#define MAG_BATCH 8             /* Blocks moved per refill or drain. */
+struct magazine
+  {
+    size_t cnt;                 /* Number of blocks in BLOCKS. */
+    struct block *blocks[MAG_SIZE]; /* Free blocks, last in first out. */
+    uint64_t alloc_cnt;         /* Blocks this CPU allocated. */
+    uint64_t free_cnt;          /* Blocks this CPU freed. */
+  };
+
+/* Magazines of each CPU, for each descriptor. */
+static struct magazine magazines[CPU_MAX][DESC_MAX];
+
+/* Statistics of big blocks, guarded by BIG_LOCK. */
+static struct spinlock big_lock;
+static struct memstat_desc big_stats;
+
 static struct arena *block_to_arena (struct block *);
 static struct block *arena_to_block (struct arena *, size_t idx);
+static size_t desc_get (struct desc *, struct block **, size_t cnt);
+static void desc_put (struct desc *, struct block **, size_t cnt);
+static struct magazine *magazine (struct desc *);
 
 /* Initializes the malloc() descriptors. */
 void
@@ -76,12 +115,14 @@ malloc_init (void)
   for (block_size = 16; block_size < PGSIZE / 2; block_size *= 2)
     {
       struct desc *d = &descs[desc_cnt++];
-      ASSERT (desc_cnt <= sizeof descs / sizeof *descs);
+      ASSERT (desc_cnt <= DESC_MAX);
       d->block_size = block_size;
       d->blocks_per_arena = (PGSIZE - sizeof (struct arena)) / block_size;
       list_init (&d->free_list);
       lock_init (&d->lock);
+      d->arena_cnt = d->peak_arena_cnt = 0;
     }
+  spinlock_init (&big_lock);
 }
 
 /* Obtains and returns a new block of at least SIZE bytes.
@@ -92,6 +133,10 @@ malloc (size_t size)
   struct desc *d;
   struct block *b;
   struct arena *a;
+  struct magazine *m;
+  struct block *batch[MAG_BATCH];
+  enum intr_level old_level;
+  size_t cnt, i;
 
   /* A null pointer satisfies a request for 0 bytes. */
   if (size == 0)
@@ -116,41 +161,44 @@ malloc (size_t size)
       a->magic = ARENA_MAGIC;
       a->desc = NULL;
       a->free_cnt = page_cnt;
+
+      spinlock_acquire (&big_lock);
+      big_stats.alloc_cnt++;
+      big_stats.pages += page_cnt;
+      if (big_stats.pages > big_stats.peak_pages)
+        big_stats.peak_pages = big_stats.pages;
+      spinlock_release (&big_lock);
       return a + 1;
     }
 
-  lock_acquire (&d->lock);
-
-  /* If the free list is empty, create a new arena. */
-  if (list_empty (&d->free_list))
+  /* Take a block from this CPU's magazine. */
+  old_level = intr_disable ();
+  m = magazine (d);
+  if (m->cnt > 0)
     {
-      size_t i;
-
-      /* Allocate a page. */
-      a = palloc_get_page (0);
-      if (a == NULL) 
-        {
-          lock_release (&d->lock);
-          return NULL; 
-        }
-
-      /* Initialize arena and add its blocks to the free list. */
-      a->magic = ARENA_MAGIC;
-      a->desc = d;
-      a->free_cnt = d->blocks_per_arena;
-      for (i = 0; i < d->blocks_per_arena; i++) 
-        {
-          struct block *b = arena_to_block (a, i);
-          list_push_back (&d->free_list, &b->free_elem);
-        }
+      b = m->blocks[--m->cnt];
+      m->alloc_cnt++;
+      intr_set_level (old_level);
+      return b;
     }
-
-  /* Get a block from free list and return it. */
-  b = list_entry (list_pop_front (&d->free_list), struct block, free_elem);
-  a = block_to_arena (b);
-  a->free_cnt--;
-  lock_release (&d->lock);
-  return b;
+  intr_set_level (old_level);
+
+  /* Refill the magazine from the descriptor, keeping the first block
+     for ourselves.  Other threads may have filled the magazine
+     while we waited for the lock, so whatever doesn't fit goes
+     back. */
+  cnt = desc_get (d, batch, MAG_BATCH);
+  if (cnt == 0)
+    return NULL;
+  old_level = intr_disable ();
+  m = magazine (d);
+  m->alloc_cnt++;
+  for (i = 1; i < cnt && m->cnt < MAG_SIZE; i++)
+    m->blocks[m->cnt++] = batch[i];
+  intr_set_level (old_level);
+  if (i < cnt)
+    desc_put (d, batch + i, cnt - i);
+  return batch[0];
 }
 
 /* Allocates and return A times B bytes initialized to zeroes.
@@ -223,40 +271,43 @@ free (void *p)
       struct block *b = p;
       struct arena *a = block_to_arena (b);
       struct desc *d = a->desc;
+      struct magazine *m;
+      struct block *batch[MAG_BATCH];
+      enum intr_level old_level;
+      bool drained = false;
       
       if (d != NULL) 
         {
           /* It's a normal block.  We handle it here. */
 
-#ifndef NDEBUG
+#if DEBUG_SLOW
           /* Clear the block to help detect use-after-free bugs. */
           memset (b, 0xcc, d->block_size);
 #endif
   
-          lock_acquire (&d->lock);
-
-          /* Add block to free list. */
-          list_push_front (&d->free_list, &b->free_elem);
-
-          /* If the arena is now entirely unused, free it. */
-          if (++a->free_cnt >= d->blocks_per_arena) 
+          /* Put the block in this CPU's magazine, draining the
+             magazine first if it is full. */
+          old_level = intr_disable ();
+          m = magazine (d);
+          if (m->cnt == MAG_SIZE)
             {
-              size_t i;
-
-              ASSERT (a->free_cnt == d->blocks_per_arena);
-              for (i = 0; i < d->blocks_per_arena; i++) 
-                {
-                  struct block *b = arena_to_block (a, i);
-                  list_remove (&b->free_elem);
-                }
-              palloc_free_page (a);
+              m->cnt -= MAG_BATCH;
+              memcpy (batch, m->blocks + m->cnt, sizeof batch);
+              drained = true;
             }
-
-          lock_release (&d->lock);
+          m->blocks[m->cnt++] = b;
+          m->free_cnt++;
+          intr_set_level (old_level);
+          if (drained)
+            desc_put (d, batch, MAG_BATCH);
         }
       else
         {
           /* It's a big block.  Free its pages. */
+          spinlock_acquire (&big_lock);
+          big_stats.free_cnt++;
+          big_stats.pages -= a->free_cnt;
+          spinlock_release (&big_lock);
           palloc_free_multiple (a, a->free_cnt);
           return;
         }
@@ -292,3 +343,157 @@ arena_to_block (struct arena *a, size_t idx)
                            + sizeof *a
                            + idx * a->desc->block_size);
 }
+
+/* Takes up to CNT free blocks from descriptor D into BLOCKS,
+   creating arenas as needed, and returns the number taken.  Returns
+   fewer only if no more pages are available. */
+static size_t
+desc_get (struct desc *d, struct block **blocks, size_t cnt)
+{
+  size_t taken;
+
+  lock_acquire (&d->lock);
+  for (taken = 0; taken < cnt; taken++)
+    {
+      struct block *b;
+      struct arena *a;
+
+      /* If the free list is empty, create a new arena. */
+      if (list_empty (&d->free_list))
+        {
+          size_t i;
+
+          /* Allocate a page. */
+          a = palloc_get_page (0);
+          if (a == NULL)
+            break;
+
+          /* Initialize arena and add its blocks to the free list. */
+          a->magic = ARENA_MAGIC;
+          a->desc = d;
+          a->free_cnt = d->blocks_per_arena;
+          if (++d->arena_cnt > d->peak_arena_cnt)
+            d->peak_arena_cnt = d->arena_cnt;
+          for (i = 0; i < d->blocks_per_arena; i++)
+            {
+              struct block *b = arena_to_block (a, i);
+              list_push_back (&d->free_list, &b->free_elem);
+            }
+        }
+
+      /* Get a block from free list. */
+      b = list_entry (list_pop_front (&d->free_list), struct block,
+                      free_elem);
+      a = block_to_arena (b);
+      a->free_cnt--;
+      blocks[taken] = b;
+    }
+  lock_release (&d->lock);
+  return taken;
+}
+
+/* Returns the CNT free blocks in BLOCKS to descriptor D, giving
+   back each arena left with no blocks in use. */
+static void
+desc_put (struct desc *d, struct block **blocks, size_t cnt)
+{
+  size_t i;
+
+  lock_acquire (&d->lock);
+  for (i = 0; i < cnt; i++)
+    {
+      struct block *b = blocks[i];
+      struct arena *a = block_to_arena (b);
+
+      /* Add block to free list. */
+      list_push_front (&d->free_list, &b->free_elem);
+
+      /* If the arena is now entirely unused, free it. */
+      if (++a->free_cnt >= d->blocks_per_arena)
+        {
+          size_t j;
+
+          ASSERT (a->free_cnt == d->blocks_per_arena);
+          for (j = 0; j < d->blocks_per_arena; j++)
+            {
+              struct block *b = arena_to_block (a, j);
+              list_remove (&b->free_elem);
+            }
+          d->arena_cnt--;
+          palloc_free_page (a);
+        }
+    }
+  lock_release (&d->lock);
+}
+
+/* Returns the current CPU's magazine for descriptor D.  Interrupts
+   must be off. */
+static struct magazine *
+magazine (struct desc *d)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  return &magazines[thread_cpu_id ()][d - descs];
+}
+
+/* Copies the statistics of each block size, and of big blocks last,
+   into STATS. */
+void
+malloc_stats_get (struct memstat *stats)
+{
+  size_t i, cpu;
+
+  for (i = 0; i < desc_cnt; i++)
+    {
+      struct desc *d = &descs[i];
+      struct memstat_desc *s = &stats->descs[i];
+      enum intr_level old_level;
+
+      s->block_size = d->block_size;
+      s->alloc_cnt = s->free_cnt = 0;
+      old_level = intr_disable ();
+      for (cpu = 0; cpu < CPU_MAX; cpu++)
+        {
+          s->alloc_cnt += magazines[cpu][i].alloc_cnt;
+          s->free_cnt += magazines[cpu][i].free_cnt;
+        }
+      intr_set_level (old_level);
+      s->in_use = (s->alloc_cnt - s->free_cnt) * d->block_size;
+
+      /* Words are read without the lock, so this works in a panic. */
+      s->pages = d->arena_cnt;
+      s->peak_pages = d->peak_arena_cnt;
+    }
+
+  spinlock_acquire (&big_lock);
+  stats->descs[i] = big_stats;
+  spinlock_release (&big_lock);
+  stats->descs[i].in_use = stats->descs[i].pages * PGSIZE;
+  stats->desc_cnt = desc_cnt + 1;
+}
+
+/* Prints the statistics of each block size used so far.  Blocks
+   still in use at shutdown were most likely leaked. */
+void
+malloc_print_stats (void)
+{
+  static struct memstat stats;
+  size_t i;
+
+  malloc_stats_get (&stats);
+  for (i = 0; i < stats.desc_cnt; i++)
+    {
+      const struct memstat_desc *s = &stats.descs[i];
+
+      if (s->alloc_cnt == 0)
+        continue;
+      if (s->block_size != 0)
+        printf ("Malloc %"PRIu32"-byte blocks: ", s->block_size);
+      else
+        printf ("Malloc big blocks: ");
+      printf ("%"PRIu64" allocated, %"PRIu64" freed, %"PRIu32" bytes in "
+              "use, %"PRIu32" pages (peak %"PRIu32")\n",
+              s->alloc_cnt, s->free_cnt, s->in_use, s->pages,
+              s->peak_pages);
+    }
+}
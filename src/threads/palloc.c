@@ -2,11 +2,14 @@
 #include <bitmap.h>
 #include <debug.h>
 #include <inttypes.h>
+#include <list.h>
+#include <memstat.h>
 #include <round.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/init.h"
 #include "threads/loader.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
@@ -23,22 +26,73 @@
 
    By default, half of system RAM is given to the kernel pool and
    half to the user pool.  That should be huge overkill for the
-   kernel pool, but that's just fine for demonstration purposes. */
+   kernel pool, but that's just fine for demonstration purposes.
+
+   Each pool is a binary buddy allocator.  Its free pages are kept
+   as blocks of 2**ORDER pages aligned to their size, on one free
+   list per order, and a freed block is merged with its "buddy",
+   the other half of the block twice its size, whenever that is
+   free too.  A request for PAGE_CNT pages takes a block of the
+   smallest order that fits, splitting a bigger one if needed, and
+   returns the pages past PAGE_CNT to the free lists at once.
+
+   The idle thread also takes free pages out one at a time and
+   zeroes them, up to ZEROED_MAX per pool, for PAL_ZERO requests of a
+   single page to take without zeroing them then.  The zeroed pages
+   go back to the free lists if an allocation would fail otherwise. */
+
+/* Largest order of block. */
+#define MAX_ORDER MEMSTAT_ORDER_MAX
+
+/* Most pages kept zeroed in each pool. */
+#define ZEROED_MAX 32
 
 /* A memory pool. */
 struct pool
   {
+    const char *name;                   /* For statistics. */
     struct lock lock;                   /* Mutual exclusion. */
     struct bitmap *used_map;            /* Bitmap of free pages. */
     uint8_t *base;                      /* Base of pool. */
+    uint8_t *free_order;                /* Per page, 1 + order of the
+                                           free block it starts, or 0. */
+    struct list free[MAX_ORDER + 1];    /* Free blocks of each order,
+                                           linked through their first
+                                           pages. */
+    size_t free_cnt;                    /* Pages in the free lists. */
+    size_t block_cnt[MAX_ORDER + 1];    /* Blocks in each free list. */
+
+    /* Statistics, guarded by LOCK. */
+    size_t peak_used_cnt;               /* Most pages allocated at once. */
+    uint64_t alloc_cnt;                 /* Allocations that took LOCK. */
+    uint64_t fail_cnt;                  /* Allocations that failed. */
+
+    /* Zeroed pages, except for the list element at their start,
+       allocated as far as the free lists are concerned.  Guarded by
+       ZEROED_LOCK, not LOCK, so the idle thread never waits. */
+    struct spinlock zeroed_lock;
+    struct list zeroed;
+    size_t zeroed_cnt;
+    uint64_t zeroed_hit_cnt;            /* Allocations that took one. */
   };
 
 /* Two pools: one for kernel data, one for user pages. */
 static struct pool kernel_pool, user_pool;
 
+/* Whether the CPU has the movnti instruction. */
+static bool have_movnti;
+
 static void init_pool (struct pool *, void *base, size_t page_cnt,
                        const char *name);
 static bool page_from_pool (const struct pool *, void *page);
+static size_t alloc_pages (struct pool *, size_t page_cnt);
+static void free_pages (struct pool *, size_t page_idx, size_t page_cnt);
+static void *pop_zeroed (struct pool *);
+static bool drain_zeroed (struct pool *);
+static bool prezero_pool (struct pool *);
+static size_t used_pages (const struct pool *);
+static void pool_stats_get (struct pool *, struct memstat_pool *);
+static void pool_print_stats (struct pool *);
 
 /* Initializes the page allocator.  At most USER_PAGE_LIMIT
    pages are put into the user pool. */
@@ -59,6 +113,54 @@ palloc_init (size_t user_page_limit)
   init_pool (&kernel_pool, free_start, kernel_pages, "kernel pool");
   init_pool (&user_pool, free_start + kernel_pages * PGSIZE,
              user_pages, "user pool");
+
+  have_movnti = (cpu_features () & CPUID_SSE2) != 0;
+}
+
+/* Copies the page at SRC to the page at DST. */
+void
+palloc_copy_page (void *dst, const void *src)
+{
+  size_t cnt = PGSIZE / 4;
+
+  ASSERT (pg_ofs (dst) == 0 && pg_ofs (src) == 0);
+  asm volatile ("rep movsl"
+                : "+D" (dst), "+S" (src), "+c" (cnt) : : "memory");
+}
+
+/* Zeroes the page at PAGE. */
+void
+palloc_zero_page (void *page)
+{
+  size_t cnt = PGSIZE / 4;
+
+  ASSERT (pg_ofs (page) == 0);
+  asm volatile ("rep stosl"
+                : "+D" (page), "+c" (cnt) : "a" (0) : "memory");
+}
+
+/* Zeroes the page at PAGE, which is not about to be used, without
+   filling the CPU caches with it if the CPU has non-temporal stores.
+   Those go through general registers, so they need no FPU state. */
+void
+palloc_zero_page_ahead (void *page)
+{
+  uint32_t *word;
+
+  if (!have_movnti)
+    {
+      palloc_zero_page (page);
+      return;
+    }
+
+  ASSERT (pg_ofs (page) == 0);
+  for (word = page; word < (uint32_t *) page + PGSIZE / 4; word += 4)
+    asm volatile ("movnti %1, (%0)\n\t"
+                  "movnti %1, 4(%0)\n\t"
+                  "movnti %1, 8(%0)\n\t"
+                  "movnti %1, 12(%0)"
+                  : : "r" (word), "r" (0) : "memory");
+  asm volatile ("sfence" : : : "memory");
 }
 
 /* Obtains and returns a group of PAGE_CNT contiguous free pages.
@@ -73,12 +175,34 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
   struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
   void *pages;
   size_t page_idx;
+  size_t i;
 
   if (page_cnt == 0)
     return NULL;
 
+  /* Take a page zeroed ahead of time, if we can. */
+  if (page_cnt == 1 && (flags & PAL_ZERO)
+      && (pages = pop_zeroed (pool)) != NULL)
+    {
+      spinlock_acquire (&pool->zeroed_lock);
+      pool->zeroed_hit_cnt++;
+      spinlock_release (&pool->zeroed_lock);
+      return pages;
+    }
+
   lock_acquire (&pool->lock);
-  page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
+  pool->alloc_cnt++;
+  page_idx = alloc_pages (pool, page_cnt);
+  if (page_idx == BITMAP_ERROR && drain_zeroed (pool))
+    page_idx = alloc_pages (pool, page_cnt);
+  if (page_idx != BITMAP_ERROR)
+    {
+      bitmap_set_multiple (pool->used_map, page_idx, page_cnt, true);
+      if (used_pages (pool) > pool->peak_used_cnt)
+        pool->peak_used_cnt = used_pages (pool);
+    }
+  else
+    pool->fail_cnt++;
   lock_release (&pool->lock);
 
   if (page_idx != BITMAP_ERROR)
@@ -89,7 +213,8 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
   if (pages != NULL) 
     {
       if (flags & PAL_ZERO)
-        memset (pages, 0, PGSIZE * page_cnt);
+        for (i = 0; i < page_cnt; i++)
+          palloc_zero_page ((uint8_t *) pages + PGSIZE * i);
     }
   else 
     {
@@ -133,12 +258,15 @@ palloc_free_multiple (void *pages, size_t page_cnt)
 
   page_idx = pg_no (pages) - pg_no (pool->base);
 
-#ifndef NDEBUG
+#if DEBUG_SLOW
   memset (pages, 0xcc, PGSIZE * page_cnt);
 #endif
 
-  ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
+  lock_acquire (&pool->lock);
+  ASSERT_SLOW (bitmap_all (pool->used_map, page_idx, page_cnt));
   bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+  free_pages (pool, page_idx, page_cnt);
+  lock_release (&pool->lock);
 }
 
 /* Frees the page at PAGE. */
@@ -148,25 +276,245 @@ palloc_free_page (void *page)
   palloc_free_multiple (page, 1);
 }
 
+/* Zeroes a free page for later PAL_ZERO requests, unless enough are
+   zeroed already.  Returns true if it zeroed one.  Meant for the idle
+   thread, so it never sleeps or holds a lock another thread could
+   wait for. */
+bool
+palloc_prezero (void)
+{
+  return prezero_pool (&kernel_pool) || prezero_pool (&user_pool);
+}
+
+/* Copies the statistics of the kernel and user pools into KERNEL
+   and USER. */
+void
+palloc_stats_get (struct memstat_pool *kernel, struct memstat_pool *user)
+{
+  pool_stats_get (&kernel_pool, kernel);
+  pool_stats_get (&user_pool, user);
+}
+
+/* Prints the statistics of both pools. */
+void
+palloc_print_stats (void)
+{
+  pool_print_stats (&kernel_pool);
+  pool_print_stats (&user_pool);
+}
+
+/* Returns the first page of the user pool and sets *PAGE_CNT to the
+   number of pages in it, for indexing its pages by number. */
+void *
+palloc_user_pool (size_t *page_cnt)
+{
+  *page_cnt = bitmap_size (user_pool.used_map);
+  return user_pool.base;
+}
+
 /* Initializes pool P as starting at START and ending at END,
    naming it NAME for debugging purposes. */
 static void
 init_pool (struct pool *p, void *base, size_t page_cnt, const char *name) 
 {
-  /* We'll put the pool's used_map at its base.
-     Calculate the space needed for the bitmap
+  /* We'll put the pool's used_map and free_order at its base.
+     Calculate the space needed for them
      and subtract it from the pool's size. */
-  size_t bm_pages = DIV_ROUND_UP (bitmap_buf_size (page_cnt), PGSIZE);
+  size_t bm_size = bitmap_buf_size (page_cnt);
+  size_t bm_pages = DIV_ROUND_UP (bm_size + page_cnt, PGSIZE);
+  int order;
+
   if (bm_pages > page_cnt)
     PANIC ("Not enough memory in %s for bitmap.", name);
   page_cnt -= bm_pages;
 
   printf ("%zu pages available in %s.\n", page_cnt, name);
 
-  /* Initialize the pool. */
+  /* Initialize the pool, with all of its pages free. */
+  p->name = name;
   lock_init (&p->lock);
-  p->used_map = bitmap_create_in_buf (page_cnt, base, bm_pages * PGSIZE);
+  p->used_map = bitmap_create_in_buf (page_cnt, base, bm_size);
+  p->free_order = (uint8_t *) base + bm_size;
+  memset (p->free_order, 0, page_cnt);
+  for (order = 0; order <= MAX_ORDER; order++)
+    {
+      list_init (&p->free[order]);
+      p->block_cnt[order] = 0;
+    }
   p->base = base + bm_pages * PGSIZE;
+  p->free_cnt = 0;
+  free_pages (p, 0, page_cnt);
+  spinlock_init (&p->zeroed_lock);
+  list_init (&p->zeroed);
+  p->zeroed_cnt = 0;
+}
+
+/* Takes a zeroed page out of POOL and returns it, or a null pointer
+   if there is none. */
+static void *
+pop_zeroed (struct pool *pool)
+{
+  struct list_elem *e = NULL;
+
+  spinlock_acquire (&pool->zeroed_lock);
+  if (!list_empty (&pool->zeroed))
+    {
+      e = list_pop_front (&pool->zeroed);
+      pool->zeroed_cnt--;
+    }
+  spinlock_release (&pool->zeroed_lock);
+  if (e != NULL)
+    memset (e, 0, sizeof *e);
+  return e;
+}
+
+/* Returns all of POOL's zeroed pages to its free lists.  Returns true
+   if there were any.  The caller must hold POOL's lock. */
+static bool
+drain_zeroed (struct pool *pool)
+{
+  bool drained = false;
+  void *page;
+
+  ASSERT (lock_held_by_current_thread (&pool->lock));
+  while ((page = pop_zeroed (pool)) != NULL)
+    {
+      size_t page_idx = pg_no (page) - pg_no (pool->base);
+
+      bitmap_reset (pool->used_map, page_idx);
+      free_pages (pool, page_idx, 1);
+      drained = true;
+    }
+  return drained;
+}
+
+/* Zeroes a free page of POOL, as palloc_prezero(). */
+static bool
+prezero_pool (struct pool *pool)
+{
+  enum intr_level old_level;
+  struct list_elem *page;
+  size_t page_idx;
+
+  if (pool->zeroed_cnt >= ZEROED_MAX)
+    return false;
+
+  /* Interrupts stay off while we hold the lock, so no other thread
+     can come to wait for it. */
+  old_level = intr_disable ();
+  if (!lock_try_acquire (&pool->lock))
+    {
+      intr_set_level (old_level);
+      return false;
+    }
+  page_idx = alloc_pages (pool, 1);
+  if (page_idx != BITMAP_ERROR)
+    bitmap_mark (pool->used_map, page_idx);
+  lock_release (&pool->lock);
+  intr_set_level (old_level);
+  if (page_idx == BITMAP_ERROR)
+    return false;
+
+  page = (struct list_elem *) (pool->base + PGSIZE * page_idx);
+  palloc_zero_page_ahead (page);
+  spinlock_acquire (&pool->zeroed_lock);
+  list_push_front (&pool->zeroed, page);
+  pool->zeroed_cnt++;
+  spinlock_release (&pool->zeroed_lock);
+  return true;
+}
+
+/* Returns the free list element in the first page of the block at
+   PAGE_IDX in POOL. */
+static struct list_elem *
+block_elem (struct pool *pool, size_t page_idx)
+{
+  return (struct list_elem *) (pool->base + PGSIZE * page_idx);
+}
+
+/* Takes PAGE_CNT contiguous pages out of POOL's free blocks and
+   returns the index of the first, or BITMAP_ERROR if no free block
+   is big enough.  The caller must hold POOL's lock. */
+static size_t
+alloc_pages (struct pool *pool, size_t page_cnt)
+{
+  int order = 0;
+  int o;
+  size_t page_idx;
+
+  while (order <= MAX_ORDER && ((size_t) 1 << order) < page_cnt)
+    order++;
+  for (o = order; o <= MAX_ORDER; o++)
+    if (!list_empty (&pool->free[o]))
+      break;
+  if (o > MAX_ORDER)
+    return BITMAP_ERROR;
+
+  page_idx = ((uint8_t *) list_pop_front (&pool->free[o]) - pool->base)
+             / PGSIZE;
+  pool->free_order[page_idx] = 0;
+  pool->free_cnt -= (size_t) 1 << o;
+  pool->block_cnt[o]--;
+
+  /* Split the block down to ORDER, freeing the upper halves. */
+  while (o > order)
+    {
+      size_t buddy;
+
+      o--;
+      buddy = page_idx + ((size_t) 1 << o);
+      pool->free_order[buddy] = o + 1;
+      list_push_front (&pool->free[o], block_elem (pool, buddy));
+      pool->free_cnt += (size_t) 1 << o;
+      pool->block_cnt[o]++;
+    }
+
+  /* Give back the pages that round PAGE_CNT up to ORDER. */
+  free_pages (pool, page_idx + page_cnt, ((size_t) 1 << order) - page_cnt);
+  return page_idx;
+}
+
+/* Returns the PAGE_CNT pages starting at PAGE_IDX to POOL's free
+   blocks, merging each block with its buddy while that is free.
+   The caller must hold POOL's lock, unless the pool is still being
+   initialized. */
+static void
+free_pages (struct pool *pool, size_t page_idx, size_t page_cnt)
+{
+  size_t pool_size = bitmap_size (pool->used_map);
+
+  pool->free_cnt += page_cnt;
+  while (page_cnt > 0)
+    {
+      /* Largest aligned block at PAGE_IDX within the range. */
+      int order = 0;
+      size_t block_idx = page_idx;
+      int o;
+
+      while (order < MAX_ORDER
+             && (page_idx & ((size_t) 1 << order)) == 0
+             && ((size_t) 2 << order) <= page_cnt)
+        order++;
+      page_idx += (size_t) 1 << order;
+      page_cnt -= (size_t) 1 << order;
+
+      for (o = order; o < MAX_ORDER; o++)
+        {
+          size_t buddy = block_idx ^ ((size_t) 1 << o);
+
+          if (buddy + ((size_t) 1 << o) > pool_size
+              || pool->free_order[buddy] != o + 1)
+            break;
+          list_remove (block_elem (pool, buddy));
+          pool->free_order[buddy] = 0;
+          pool->block_cnt[o]--;
+          if (buddy < block_idx)
+            block_idx = buddy;
+        }
+      pool->free_order[block_idx] = o + 1;
+      list_push_front (&pool->free[o], block_elem (pool, block_idx));
+      pool->block_cnt[o]++;
+    }
 }
 
 /* Returns true if PAGE was allocated from POOL,
@@ -180,3 +528,54 @@ page_from_pool (const struct pool *pool, void *page)
 
   return page_no >= start_page && page_no < end_page;
 }
+
+/* Returns the number of pages allocated from POOL, not counting
+   those zeroed ahead of time. */
+static size_t
+used_pages (const struct pool *pool)
+{
+  return bitmap_size (pool->used_map) - pool->free_cnt - pool->zeroed_cnt;
+}
+
+/* Copies POOL's statistics into STATS.  Words are read without the
+   lock, so this works in a panic. */
+static void
+pool_stats_get (struct pool *pool, struct memstat_pool *stats)
+{
+  int order;
+
+  stats->page_cnt = bitmap_size (pool->used_map);
+  stats->used_cnt = used_pages (pool);
+  stats->peak_used_cnt = pool->peak_used_cnt;
+  stats->zeroed_cnt = pool->zeroed_cnt;
+  stats->alloc_cnt = pool->alloc_cnt + pool->zeroed_hit_cnt;
+  stats->zeroed_hit_cnt = pool->zeroed_hit_cnt;
+  stats->fail_cnt = pool->fail_cnt;
+  for (order = 0; order <= MAX_ORDER; order++)
+    stats->free_blocks[order] = pool->block_cnt[order];
+}
+
+/* Prints POOL's statistics, with how fragmented its free pages are
+   as the largest block among them. */
+static void
+pool_print_stats (struct pool *pool)
+{
+  struct memstat_pool s;
+  size_t free_cnt = 0, block_cnt = 0, largest = 0;
+  int order;
+
+  pool_stats_get (pool, &s);
+  for (order = 0; order <= MAX_ORDER; order++)
+    if (s.free_blocks[order] > 0)
+      {
+        free_cnt += (size_t) s.free_blocks[order] << order;
+        block_cnt += s.free_blocks[order];
+        largest = (size_t) 1 << order;
+      }
+  printf ("Palloc %s: %"PRIu32" of %"PRIu32" pages used (peak %"PRIu32"), "
+          "%"PRIu32" zeroed, %zu free in %zu blocks (largest %zu), "
+          "%"PRIu64" allocations (%"PRIu64" zeroed), %"PRIu64" failed\n",
+          pool->name, s.used_cnt, s.page_cnt, s.peak_used_cnt, s.zeroed_cnt,
+          free_cnt, block_cnt, largest, s.alloc_cnt, s.zeroed_hit_cnt,
+          s.fail_cnt);
+}
@@ -1,6 +1,7 @@
 #ifndef THREADS_PALLOC_H
 #define THREADS_PALLOC_H
 
+#include <stdbool.h>
 #include <stddef.h>
 
 /* How to allocate pages. */
@@ -11,10 +12,19 @@ enum palloc_flags
     PAL_USER = 004              /* User page. */
   };
 
+struct memstat_pool;
+
 void palloc_init (size_t user_page_limit);
 void *palloc_get_page (enum palloc_flags);
 void *palloc_get_multiple (enum palloc_flags, size_t page_cnt);
 void palloc_free_page (void *);
 void palloc_free_multiple (void *, size_t page_cnt);
+void palloc_copy_page (void *dst, const void *src);
+void palloc_zero_page (void *);
+void palloc_zero_page_ahead (void *);
+bool palloc_prezero (void);
+void *palloc_user_pool (size_t *page_cnt);
+void palloc_stats_get (struct memstat_pool *kernel, struct memstat_pool *user);
+void palloc_print_stats (void);
 
 #endif /* threads/palloc.h */
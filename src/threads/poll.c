@@ -0,0 +1,141 @@
+#include "threads/poll.h"
+#include <debug.h>
+#include "threads/interrupt.h"
+#include "threads/thread.h"
+
+/* Waiting on many objects at once.
+
+   An object that can be polled keeps a poll_queue, and wakes it
+   with poll_wake() whenever it may have become ready, which is safe
+   in an interrupt handler.  A poller sets up a poll_table, and the
+   first time it checks each object adds a poll_entry for the table
+   to the object's queue.  Then it sleeps in poll_table_wait() until
+   any of them wakes, checks them all again without adding any more
+   entries, and so on, until one is ready or the timeout passes.  A
+   wake between checking and sleeping is not lost, since the table
+   remembers it.
+
+   Wakes unblock the sleeper without yielding, as in devices/intq.c,
+   so a queue can't change while poll_wake() walks it. */
+
+static timer_func poll_timeout;
+static void wake (struct poll_table *);
+
+/* Initializes Q with no pollers. */
+void
+poll_queue_init (struct poll_queue *q)
+{
+  list_init (&q->entries);
+}
+
+/* Wakes up every poller waiting on Q. */
+void
+poll_wake (struct poll_queue *q)
+{
+  enum intr_level old_level = intr_disable ();
+  struct list_elem *e;
+
+  for (e = list_begin (&q->entries); e != list_end (&q->entries);
+       e = list_next (e))
+    wake (list_entry (e, struct poll_entry, elem)->table);
+  intr_set_level (old_level);
+}
+
+/* Initializes TABLE to wait for at most TIMEOUT timer ticks, not at
+   all if TIMEOUT is 0, or for as long as it takes if TIMEOUT is
+   negative. */
+void
+poll_table_init (struct poll_table *table, int64_t timeout)
+{
+  table->sleeper = NULL;
+  table->woken = false;
+  timer_setup (&table->timer, poll_timeout, table);
+  table->timed_out = timeout == 0;
+  if (timeout > 0)
+    timer_arm (&table->timer, timeout);
+}
+
+/* Puts TABLE's ENTRY in the pollers of Q. */
+void
+poll_add (struct poll_table *table, struct poll_entry *entry,
+          struct poll_queue *q)
+{
+  enum intr_level old_level;
+
+  ASSERT (entry->queue == NULL);
+
+  entry->table = table;
+  entry->queue = q;
+  old_level = intr_disable ();
+  list_push_back (&q->entries, &entry->elem);
+  intr_set_level (old_level);
+}
+
+/* Sleeps until one of TABLE's queues wakes it or its timeout passes,
+   or returns right away if it has been woken since it last slept.
+   Returns false, without sleeping, if the timeout has passed
+   already. */
+bool
+poll_table_wait (struct poll_table *table)
+{
+  enum intr_level old_level;
+
+  ASSERT (!intr_context ());
+
+  if (table->timed_out)
+    return false;
+  old_level = intr_disable ();
+  if (!table->woken)
+    {
+      table->sleeper = thread_current ();
+      thread_block ();
+    }
+  table->woken = false;
+  intr_set_level (old_level);
+  return true;
+}
+
+/* Takes the CNT ENTRIES of TABLE out of their queues, those that were
+   added, and stops its timeout. */
+void
+poll_table_done (struct poll_table *table, struct poll_entry *entries,
+                 size_t cnt)
+{
+  enum intr_level old_level;
+  size_t i;
+
+  timer_cancel (&table->timer);
+  old_level = intr_disable ();
+  for (i = 0; i < cnt; i++)
+    if (entries[i].queue != NULL)
+      {
+        list_remove (&entries[i].elem);
+        entries[i].queue = NULL;
+      }
+  intr_set_level (old_level);
+}
+
+/* Timer function that ends the wait of the poll_table TABLE_. */
+static void
+poll_timeout (void *table_)
+{
+  struct poll_table *table = table_;
+
+  table->timed_out = true;
+  wake (table);
+}
+
+/* Wakes up TABLE's poller, or has its next poll_table_wait() return
+   right away.  Interrupts must be off. */
+static void
+wake (struct poll_table *table)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  table->woken = true;
+  if (table->sleeper != NULL)
+    {
+      thread_unblock (table->sleeper);
+      table->sleeper = NULL;
+    }
+}
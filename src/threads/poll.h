@@ -0,0 +1,43 @@
+#ifndef THREADS_POLL_H
+#define THREADS_POLL_H
+
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "devices/timer.h"
+
+/* Pollers waiting on one object, woken with poll_wake(). */
+struct poll_queue
+  {
+    struct list entries;        /* struct poll_entry, guarded by turning
+                                   interrupts off. */
+  };
+
+/* A poller, waiting on any number of poll_queues until one of them
+   wakes or a timeout passes. */
+struct poll_table
+  {
+    struct thread *sleeper;     /* Thread asleep in poll_table_wait(). */
+    bool woken;                 /* Woken since it last slept? */
+    struct timer timer;         /* Goes off at the timeout. */
+    bool timed_out;             /* Whether the timeout passed. */
+  };
+
+/* A poll_table's place in one poll_queue. */
+struct poll_entry
+  {
+    struct list_elem elem;      /* In QUEUE's ENTRIES. */
+    struct poll_table *table;   /* Table to wake. */
+    struct poll_queue *queue;   /* Queue it is in, or null if none. */
+  };
+
+void poll_queue_init (struct poll_queue *);
+void poll_wake (struct poll_queue *);
+
+void poll_table_init (struct poll_table *, int64_t timeout);
+void poll_add (struct poll_table *, struct poll_entry *, struct poll_queue *);
+bool poll_table_wait (struct poll_table *);
+void poll_table_done (struct poll_table *, struct poll_entry *, size_t cnt);
+
+#endif /* threads/poll.h */
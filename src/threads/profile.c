@@ -0,0 +1,118 @@
+#include "threads/profile.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* Sampling profiler.
+
+   With the "-profile" option, every timer interrupt samples the
+   instruction it interrupted, with the thread that was running it,
+   into a histogram keyed by the pair.  The histogram is printed at
+   shutdown, one "profile:" line per bucket, for the "profile"
+   script in src/utils to add up by function against kernel.o and
+   the user programs that ran.
+
+   Samples are only taken in the timer interrupt handler, which
+   does not nest, so the histogram needs no lock.  It is read once
+   sampling has stopped. */
+
+/* Buckets in the histogram, a power of 2. */
+#define PROFILE_BUCKETS 2048
+
+/* Samples of one instruction run by one thread. */
+struct profile_bucket
+  {
+    uint32_t eip;               /* Instruction sampled. */
+    tid_t tid;                  /* Thread that ran it. */
+    uint32_t cnt;               /* Samples, 0 if the bucket is free. */
+    bool user;                  /* True if EIP is in user code. */
+    char name[16];              /* Name of the thread. */
+  };
+
+/* If false (default), the timer interrupt takes no samples.
+   Controlled by kernel command-line option "-profile". */
+bool profile_enabled;
+
+/* Histogram, in open addressing with linear probing. */
+static struct profile_bucket *buckets;
+
+/* Samples taken, and samples dropped because the histogram was
+   full. */
+static uint64_t sample_cnt;
+static uint64_t drop_cnt;
+
+/* Allocates the histogram, if the "-profile" option asks for
+   profiling. */
+void
+profile_init (void)
+{
+  size_t page_cnt = DIV_ROUND_UP (PROFILE_BUCKETS
+                                  * sizeof (struct profile_bucket), PGSIZE);
+
+  if (!profile_enabled)
+    return;
+  buckets = palloc_get_multiple (PAL_ZERO, page_cnt);
+  if (buckets == NULL)
+    {
+      printf ("profile: not enough memory, profiling disabled\n");
+      profile_enabled = false;
+    }
+}
+
+/* Samples the instruction that interrupt frame F interrupted.
+   Called by the timer interrupt handler while profiling is on. */
+void
+profile_sample (const struct intr_frame *f)
+{
+  struct thread *t = thread_current ();
+  uint32_t eip = (uint32_t) f->eip;
+  uint32_t hash = (eip ^ (uint32_t) t->tid * 0x9e3779b1u) * 0x85ebca6bu;
+  size_t i, probe;
+
+  ASSERT (intr_context ());
+
+  sample_cnt++;
+  for (i = hash >> 16, probe = 0; probe < PROFILE_BUCKETS; i++, probe++)
+    {
+      struct profile_bucket *b = &buckets[i & (PROFILE_BUCKETS - 1)];
+
+      if (b->cnt == 0)
+        {
+          b->eip = eip;
+          b->tid = t->tid;
+          b->user = (f->cs & 3) == 3;
+          strlcpy (b->name, t->name, sizeof b->name);
+        }
+      else if (b->eip != eip || b->tid != t->tid)
+        continue;
+      b->cnt++;
+      return;
+    }
+  drop_cnt++;
+}
+
+/* Stops sampling and prints the histogram. */
+void
+profile_dump (void)
+{
+  size_t i;
+
+  if (!profile_enabled)
+    return;
+  profile_enabled = false;
+  printf ("Profile: %"PRIu64" samples, %"PRIu64" dropped\n",
+          sample_cnt, drop_cnt);
+  for (i = 0; i < PROFILE_BUCKETS; i++)
+    {
+      struct profile_bucket *b = &buckets[i];
+      if (b->cnt != 0)
+        printf ("profile: %"PRIu32" %c 0x%08"PRIx32" %d %s\n", b->cnt,
+                b->user ? 'u' : 'k', b->eip, b->tid, b->name);
+    }
+}
@@ -0,0 +1,220 @@
+#include "threads/slab.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <round.h>
+#include <stdio.h>
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* Object caches.
+
+   A cache hands out objects of a single type, packed into
+   one-page "slabs" with no rounding of their size beyond
+   alignment.  Each slab keeps a stack of the indexes of its free
+   objects, rather than linking them through the objects, so an
+   object keeps its contents while it is free.  That lets a cache
+   run a constructor once on each object when its slab is created,
+   setting up locks, condition variables and the like, instead of
+   on every allocation; in exchange, an object must be freed in
+   the state the constructor left it in.
+
+   A slab whose objects are all free goes back to the page
+   allocator, after running the destructor on each object, unless
+   it is the only such slab of its cache, which is kept to absorb
+   a burst of allocations and frees. */
+
+/* Magic number for detecting slab corruption. */
+#define SLAB_MAGIC 0x51ab0bec
+
+/* A slab, at the start of its page. */
+struct slab
+  {
+    unsigned magic;             /* Always set to SLAB_MAGIC. */
+    struct slab_cache *cache;   /* Owning cache. */
+    struct list_elem elem;      /* In the cache's PARTIAL list. */
+    size_t free_cnt;            /* Number of free objects. */
+    uint16_t free[];            /* Indexes of the free objects. */
+  };
+
+/* All the caches, for statistics. */
+static struct list caches = LIST_INITIALIZER (caches);
+
+static struct slab *slab_create (struct slab_cache *);
+static void slab_destroy (struct slab *);
+static void *slab_obj (struct slab *, size_t idx);
+
+/* Initializes CACHE, named NAME, for objects of SIZE bytes.  CTOR,
+   if nonnull, is run on each object before it is first handed out
+   and DTOR, if nonnull, on each object before its memory is given
+   back. */
+void
+slab_cache_init (struct slab_cache *cache, const char *name, size_t size,
+                 slab_obj_func *ctor, slab_obj_func *dtor)
+{
+  size_t cnt;
+  enum intr_level old_level;
+
+  ASSERT (cache != NULL);
+  ASSERT (size > 0);
+
+  /* Fit as many objects as we can after the header and its index
+     stack. */
+  size = ROUND_UP (size, sizeof (void *));
+  cnt = (PGSIZE - sizeof (struct slab)) / (size + sizeof (uint16_t));
+  while (cnt > 0
+         && ROUND_UP (sizeof (struct slab) + cnt * sizeof (uint16_t),
+                      sizeof (void *)) + cnt * size > PGSIZE)
+    cnt--;
+  if (cnt == 0)
+    PANIC ("objects of slab cache %s too big", name);
+
+  cache->name = name;
+  cache->obj_size = size;
+  cache->obj_ofs = ROUND_UP (sizeof (struct slab) + cnt * sizeof (uint16_t),
+                             sizeof (void *));
+  cache->objs_per_slab = cnt;
+  cache->ctor = ctor;
+  cache->dtor = dtor;
+  lock_init (&cache->lock);
+  list_init (&cache->partial);
+  cache->empty_cnt = 0;
+  cache->slab_cnt = 0;
+  cache->in_use_cnt = 0;
+  cache->alloc_cnt = 0;
+
+  old_level = intr_disable ();
+  list_push_back (&caches, &cache->elem);
+  intr_set_level (old_level);
+}
+
+/* Obtains and returns an object from CACHE, in the state its
+   constructor left it.  Returns a null pointer if memory is not
+   available. */
+void *
+slab_alloc (struct slab_cache *cache)
+{
+  struct slab *s;
+  void *obj;
+
+  lock_acquire (&cache->lock);
+  if (list_empty (&cache->partial) && slab_create (cache) == NULL)
+    {
+      lock_release (&cache->lock);
+      return NULL;
+    }
+  s = list_entry (list_front (&cache->partial), struct slab, elem);
+  if (s->free_cnt == cache->objs_per_slab)
+    cache->empty_cnt--;
+  obj = slab_obj (s, s->free[--s->free_cnt]);
+  if (s->free_cnt == 0)
+    list_remove (&s->elem);
+  cache->in_use_cnt++;
+  cache->alloc_cnt++;
+  lock_release (&cache->lock);
+  return obj;
+}
+
+/* Returns OBJ, which must have been obtained from CACHE by
+   slab_alloc(), to CACHE.  OBJ must be in the state CACHE's
+   constructor leaves objects in. */
+void
+slab_free (struct slab_cache *cache, void *obj)
+{
+  struct slab *s = pg_round_down (obj);
+  size_t ofs = pg_ofs (obj);
+
+  if (obj == NULL)
+    return;
+  ASSERT (s->magic == SLAB_MAGIC);
+  ASSERT (s->cache == cache);
+  ASSERT (ofs >= cache->obj_ofs
+          && (ofs - cache->obj_ofs) % cache->obj_size == 0);
+
+  lock_acquire (&cache->lock);
+  ASSERT (s->free_cnt < cache->objs_per_slab);
+  if (s->free_cnt == 0)
+    list_push_front (&cache->partial, &s->elem);
+  s->free[s->free_cnt++] = (ofs - cache->obj_ofs) / cache->obj_size;
+  cache->in_use_cnt--;
+  if (s->free_cnt == cache->objs_per_slab)
+    {
+      if (cache->empty_cnt > 0)
+        {
+          list_remove (&s->elem);
+          slab_destroy (s);
+        }
+      else
+        cache->empty_cnt++;
+    }
+  lock_release (&cache->lock);
+}
+
+/* Prints statistics of each cache. */
+void
+slab_print_stats (void)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&caches); e != list_end (&caches); e = list_next (e))
+    {
+      struct slab_cache *c = list_entry (e, struct slab_cache, elem);
+
+      printf ("Slab %s: %zu of %zu objects of %zu bytes in use, "
+              "%"PRIu64" allocations\n",
+              c->name, c->in_use_cnt, c->slab_cnt * c->objs_per_slab,
+              c->obj_size, c->alloc_cnt);
+    }
+}
+
+/* Adds a new slab to CACHE's partial slabs and returns it, or a
+   null pointer if memory is not available.  The caller must hold
+   CACHE's lock. */
+static struct slab *
+slab_create (struct slab_cache *cache)
+{
+  struct slab *s = palloc_get_page (0);
+  size_t i;
+
+  if (s == NULL)
+    return NULL;
+  s->magic = SLAB_MAGIC;
+  s->cache = cache;
+  s->free_cnt = cache->objs_per_slab;
+  for (i = 0; i < cache->objs_per_slab; i++)
+    {
+      /* Hand out the lowest addresses first. */
+      s->free[i] = cache->objs_per_slab - 1 - i;
+      if (cache->ctor != NULL)
+        cache->ctor (slab_obj (s, i));
+    }
+  list_push_back (&cache->partial, &s->elem);
+  cache->empty_cnt++;
+  cache->slab_cnt++;
+  return s;
+}
+
+/* Gives slab S, with all its objects free and out of its cache's
+   lists, back to the page allocator.  The caller must hold its
+   cache's lock. */
+static void
+slab_destroy (struct slab *s)
+{
+  struct slab_cache *cache = s->cache;
+  size_t i;
+
+  if (cache->dtor != NULL)
+    for (i = 0; i < cache->objs_per_slab; i++)
+      cache->dtor (slab_obj (s, i));
+  cache->slab_cnt--;
+  palloc_free_page (s);
+}
+
+/* Returns object IDX of slab S. */
+static void *
+slab_obj (struct slab *s, size_t idx)
+{
+  ASSERT (idx < s->cache->objs_per_slab);
+
+  return (uint8_t *) s + s->cache->obj_ofs + idx * s->cache->obj_size;
+}
@@ -0,0 +1,38 @@
+#ifndef THREADS_SLAB_H
+#define THREADS_SLAB_H
+
+#include <list.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "threads/synch.h"
+
+/* Prepares a cache's object for use, or tears it down. */
+typedef void slab_obj_func (void *obj);
+
+/* A cache of objects of one type. */
+struct slab_cache
+  {
+    const char *name;           /* For statistics. */
+    size_t obj_size;            /* Bytes per object, rounded up. */
+    size_t obj_ofs;             /* Offset of the first object in a slab. */
+    size_t objs_per_slab;       /* Number of objects in a slab. */
+    slab_obj_func *ctor;        /* Run on each object of a new slab. */
+    slab_obj_func *dtor;        /* Run on each object of a freed slab. */
+    struct lock lock;           /* Guards the members below. */
+    struct list partial;        /* Slabs with free objects. */
+    size_t empty_cnt;           /* Slabs in PARTIAL with all objects free. */
+    struct list_elem elem;      /* In the list of all caches. */
+
+    /* Statistics. */
+    size_t slab_cnt;            /* Slabs allocated. */
+    size_t in_use_cnt;          /* Objects allocated. */
+    uint64_t alloc_cnt;         /* Calls to slab_alloc(). */
+  };
+
+void slab_cache_init (struct slab_cache *, const char *name, size_t size,
+                      slab_obj_func *ctor, slab_obj_func *dtor);
+void *slab_alloc (struct slab_cache *);
+void slab_free (struct slab_cache *, void *);
+void slab_print_stats (void);
+
+#endif /* threads/slab.h */
@@ -27,11 +27,46 @@
 */
 
 #include "threads/synch.h"
+#include <inttypes.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include "devices/timer.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
 
+/* Orders the waiters of each kind of heap.  A waiter comes out
+   before another if its thread has a higher priority, or the same
+   priority and started waiting earlier. */
+static heap_less_func sema_waiter_less;
+static heap_less_func lock_waiter_less;
+static heap_less_func cond_waiter_less;
+
+/* Gives each wait a number, for first-come first-served order among
+   waiters of equal priority. */
+static unsigned wait_seq;
+
+/* If false (default), locks keep no statistics.
+   If true, each class of locks counts its acquisitions, waits and
+   hold times.  Controlled by kernel command-line option
+   "-lockstat". */
+bool lock_stats_enabled;
+
+/* Lock classes, one for each place in the source that initializes
+   locks. */
+#define LOCK_CLASS_MAX 64
+static struct lockstat lock_classes[LOCK_CLASS_MAX];
+static const char *lock_class_files[LOCK_CLASS_MAX];
+static int lock_class_lines[LOCK_CLASS_MAX];
+static size_t lock_class_cnt;
+static size_t lock_class_dropped;   /* Sites beyond LOCK_CLASS_MAX. */
+
+static struct lockstat *lock_class (const char *name,
+                                    const char *file, int line);
+static void lock_note_acquire (struct lock *, int64_t wait_ticks,
+                               bool contended);
+static void lock_note_release (struct lock *);
+
 /* Initializes semaphore SEMA to VALUE.  A semaphore is a
    nonnegative integer along with two atomic operators for
    manipulating it:
@@ -47,7 +82,7 @@ sema_init (struct semaphore *sema, unsigned value)
   ASSERT (sema != NULL);
 
   sema->value = value;
-  list_init (&sema->waiters);
+  heap_init (&sema->waiters, sema_waiter_less, NULL);
 }
 
 /* Down or "P" operation on a semaphore.  Waits for SEMA's value
@@ -68,7 +103,11 @@ sema_down (struct semaphore *sema)
   old_level = intr_disable ();
   while (sema->value == 0) 
     {
-      list_push_back (&sema->waiters, &thread_current ()->elem);
+      struct thread *cur = thread_current ();
+
+      cur->waiting_sema = sema;
+      cur->sema_seq = wait_seq++;
+      heap_push (&sema->waiters, &cur->sema_elem);
       thread_block ();
     }
   sema->value--;
@@ -113,9 +152,13 @@ sema_up (struct semaphore *sema)
   ASSERT (sema != NULL);
 
   old_level = intr_disable ();
-  if (!list_empty (&sema->waiters)) 
-    thread_unblock (list_entry (list_pop_min (&sema->waiters, 
-                      thread_higher_priority, NULL), struct thread, elem));
+  if (!heap_empty (&sema->waiters)) 
+    {
+      struct thread *t = heap_entry (heap_pop (&sema->waiters),
+                                     struct thread, sema_elem);
+      t->waiting_sema = NULL;
+      thread_unblock (t);
+    }
   sema->value++;
   thread_yield_for_priority ();
   intr_set_level (old_level);
@@ -172,22 +215,48 @@ sema_test_helper (void *sema_)
    another one "up" it, but with a lock the same thread must both
    acquire and release it.  When these restrictions prove
    onerous, it's a good sign that a semaphore should be used,
-   instead of a lock. */
+   instead of a lock.
+
+   Called through the lock_init() macro, which passes the lock's
+   NAME and the FILE and LINE of the call, so under -lockstat
+   every lock initialized there counts towards the same
+   statistics. */
 void
-lock_init (struct lock *lock)
+lock_init_at (struct lock *lock, const char *name,
+              const char *file, int line)
 {
   ASSERT (lock != NULL);
 
-  lock->holder = NULL;
+  lock->owner = 0;
   lock->max_priority_donation = PRI_MIN;
-  list_init(&lock->waiters);
-  sema_init (&lock->semaphore, 1);
+  heap_init (&lock->waiters, lock_waiter_less, NULL);
+  lock->stat = lock_stats_enabled ? lock_class (name, file, line) : NULL;
+  lock->acquired_at = 0;
+}
+
+/* Atomically sets *P to NEW if it is OLD, and returns the value *P
+   had. */
+static inline uintptr_t
+compare_and_swap (volatile uintptr_t *p, uintptr_t old, uintptr_t new)
+{
+  uintptr_t prev;
+
+  asm volatile ("lock cmpxchgl %2, %1"
+                : "=a" (prev), "+m" (*p)
+                : "r" (new), "0" (old)
+                : "memory");
+  return prev;
 }
 
 /* Acquires LOCK, sleeping until it becomes available if
    necessary.  The lock must not already be held by the current
    thread.
 
+   A free lock is taken with a single atomic instruction.  Only if
+   it is held does this turn interrupts off, mark the lock
+   contended, and donate the current thread's priority to the
+   holder while it waits.
+
    This function may sleep, so it must not be called within an
    interrupt handler.  This function may be called with
    interrupts disabled, but interrupts will be turned back on if
@@ -196,31 +265,54 @@ void
 lock_acquire (struct lock *lock)
 {
   enum intr_level old_level;
-  struct list_elem *max_prior_elem;
   struct thread *curr_thread;
+  struct thread *holder;
+  int64_t wait_start = 0;
 
   ASSERT (lock != NULL);
   ASSERT (!intr_context ());
   ASSERT (!lock_held_by_current_thread (lock));
 
-  old_level = intr_disable ();
   curr_thread = thread_current ();
-  list_push_back(&lock->waiters, &curr_thread->lock_elem);
+  if (compare_and_swap (&lock->owner, 0, (uintptr_t) curr_thread) == 0)
+    {
+      lock_note_acquire (lock, 0, false);
+      return;
+    }
+
+  old_level = intr_disable ();
+  if (lock->owner == 0)
+    {
+      /* Released since. */
+      lock->owner = (uintptr_t) curr_thread;
+      intr_set_level (old_level);
+      lock_note_acquire (lock, 0, false);
+      return;
+    }
+  if (lock->stat != NULL)
+    wait_start = timer_ticks ();
+
+  /* The first waiter puts the lock among the holder's donations. */
+  holder = lock_holder (lock);
+  if (!(lock->owner & LOCK_CONTENDED))
+    {
+      lock->owner |= LOCK_CONTENDED;
+      lock->max_priority_donation = PRI_MIN;
+      list_push_back (&holder->locks_held, &lock->elem);
+    }
+  curr_thread->lock_seq = wait_seq++;
+  heap_push (&lock->waiters, &curr_thread->lock_elem);
   curr_thread->blocking_lock = lock;
   if (curr_thread->priority > lock->max_priority_donation)
     lock->max_priority_donation = curr_thread->priority;
-  if (lock->holder != NULL)
-    thread_recalculate_priority (lock->holder, 0);
-  sema_down (&lock->semaphore);
-  list_remove(&curr_thread->lock_elem);
-  curr_thread->blocking_lock = NULL;
-  max_prior_elem = list_min (&lock->waiters, thread_higher_priority, NULL);
-  lock->max_priority_donation = list_entry (max_prior_elem, struct thread,
-                                             lock_elem)->priority;
-  lock->holder = curr_thread;
-  list_push_back(&curr_thread->locks_held, &lock->elem);
-  thread_recalculate_priority(curr_thread, 0);
+  thread_recalculate_priority (holder, 0);
+
+  /* lock_release() hands the lock over before waking us. */
+  thread_block ();
+  ASSERT (lock_held_by_current_thread (lock));
   intr_set_level (old_level);
+  if (lock->stat != NULL)
+    lock_note_acquire (lock, timer_elapsed (wait_start), true);
 }
 
 /* Tries to acquires LOCK and returns true if successful or false
@@ -232,19 +324,22 @@ lock_acquire (struct lock *lock)
 bool
 lock_try_acquire (struct lock *lock)
 {
-  bool success;
-
   ASSERT (lock != NULL);
   ASSERT (!lock_held_by_current_thread (lock));
 
-  success = sema_try_down (&lock->semaphore);
-  if (success)
-    lock->holder = thread_current ();
-  return success;
+  if (compare_and_swap (&lock->owner, 0, (uintptr_t) thread_current ())
+      != 0)
+    return false;
+  lock_note_acquire (lock, 0, false);
+  return true;
 }
 
 /* Releases LOCK, which must be owned by the current thread.
 
+   If nobody waits for LOCK, this takes a single atomic
+   instruction.  Otherwise LOCK goes straight to the waiter with the
+   highest priority, along with the donations of the rest.
+
    An interrupt handler cannot acquire a lock, so it does not
    make sense to try to release a lock within an interrupt
    handler. */
@@ -252,18 +347,47 @@ void
 lock_release (struct lock *lock) 
 {
   enum intr_level old_level;
+  struct thread *curr_thread = thread_current ();
+  struct thread *next;
 
   ASSERT (lock != NULL);
   ASSERT (lock_held_by_current_thread (lock));
 
+  lock_note_release (lock);
+  if (compare_and_swap (&lock->owner, (uintptr_t) curr_thread, 0)
+      == (uintptr_t) curr_thread)
+    return;
+
   old_level = intr_disable ();
-  lock->holder = NULL;
   list_remove (&lock->elem);
-  thread_recalculate_priority (thread_current (), 0);
-  sema_up (&lock->semaphore);
+  next = heap_entry (heap_pop (&lock->waiters), struct thread, lock_elem);
+  next->blocking_lock = NULL;
+  if (heap_empty (&lock->waiters))
+    lock->owner = (uintptr_t) next;
+  else
+    {
+      lock->owner = (uintptr_t) next | LOCK_CONTENDED;
+      lock->max_priority_donation
+        = heap_entry (heap_min (&lock->waiters), struct thread,
+                      lock_elem)->priority;
+      list_push_back (&next->locks_held, &lock->elem);
+    }
+  thread_recalculate_priority (curr_thread, 0);
+  thread_recalculate_priority (next, 0);
+  thread_unblock (next);
+  thread_yield_for_priority ();
   intr_set_level (old_level);
 }
 
+/* Returns the thread holding LOCK, or a null pointer if it is free. */
+struct thread *
+lock_holder (const struct lock *lock)
+{
+  ASSERT (lock != NULL);
+
+  return (struct thread *) (lock->owner & ~(uintptr_t) LOCK_CONTENDED);
+}
+
 /* Returns true if the current thread holds LOCK, false
    otherwise.  (Note that testing whether some other thread holds
    a lock would be racy.) */
@@ -272,26 +396,152 @@ lock_held_by_current_thread (const struct lock *lock)
 {
   ASSERT (lock != NULL);
 
-  return lock->holder == thread_current ();
+  return lock_holder (lock) == thread_current ();
+}
+
+/* Returns the statistics of the class of locks initialized at
+   FILE and LINE, naming a new class NAME if there is none yet.
+   Returns a null pointer if there are too many classes. */
+static struct lockstat *
+lock_class (const char *name, const char *file, int line)
+{
+  struct lockstat *stat = NULL;
+  enum intr_level old_level;
+  size_t i;
+
+  /* Source paths are relative to the build directory. */
+  while (!memcmp (file, "../", 3))
+    file += 3;
+
+  old_level = intr_disable ();
+  for (i = 0; i < lock_class_cnt; i++)
+    if (lock_class_lines[i] == line && !strcmp (lock_class_files[i], file))
+      break;
+  if (i < lock_class_cnt)
+    stat = &lock_classes[i];
+  else if (lock_class_cnt < LOCK_CLASS_MAX)
+    {
+      stat = &lock_classes[lock_class_cnt];
+      lock_class_files[lock_class_cnt] = file;
+      lock_class_lines[lock_class_cnt] = line;
+      lock_class_cnt++;
+      strlcpy (stat->name, name, sizeof stat->name);
+      snprintf (stat->site, sizeof stat->site, "%s:%d", file, line);
+    }
+  else
+    lock_class_dropped++;
+  intr_set_level (old_level);
+  return stat;
+}
+
+/* Counts an acquisition of LOCK, after waiting WAIT_TICKS for it
+   if it was CONTENDED. */
+static void
+lock_note_acquire (struct lock *lock, int64_t wait_ticks, bool contended)
+{
+  struct lockstat *stat = lock->stat;
+  enum intr_level old_level;
+
+  if (stat == NULL)
+    return;
+
+  /* Locks of a class share its statistics. */
+  old_level = intr_disable ();
+  stat->acquire_cnt++;
+  if (contended)
+    {
+      stat->contended_cnt++;
+      stat->wait_ticks += wait_ticks;
+      if (wait_ticks > stat->max_wait_ticks)
+        stat->max_wait_ticks = wait_ticks;
+    }
+  lock->acquired_at = timer_ticks ();
+  intr_set_level (old_level);
+}
+
+/* Counts the time LOCK was held, as it is about to be released. */
+static void
+lock_note_release (struct lock *lock)
+{
+  struct lockstat *stat = lock->stat;
+  enum intr_level old_level;
+
+  if (stat == NULL)
+    return;
+
+  old_level = intr_disable ();
+  stat->hold_ticks += timer_elapsed (lock->acquired_at);
+  intr_set_level (old_level);
+}
+
+/* Copies the statistics of up to CNT lock classes, starting with
+   class FIRST, into STATS and returns the number copied. */
+size_t
+lock_stats_get (struct lockstat *stats, size_t first, size_t cnt)
+{
+  enum intr_level old_level;
+
+  old_level = intr_disable ();
+  if (first > lock_class_cnt)
+    first = lock_class_cnt;
+  if (cnt > lock_class_cnt - first)
+    cnt = lock_class_cnt - first;
+  memcpy (stats, lock_classes + first, cnt * sizeof *stats);
+  intr_set_level (old_level);
+  return cnt;
+}
+
+/* Orders lock classes by most timer ticks waited, then by most
+   contended acquisitions. */
+static int
+lock_class_compare (const void *a_, const void *b_)
+{
+  const struct lockstat *a = *(const struct lockstat **) a_;
+  const struct lockstat *b = *(const struct lockstat **) b_;
+
+  if (a->wait_ticks != b->wait_ticks)
+    return a->wait_ticks > b->wait_ticks ? -1 : 1;
+  if (a->contended_cnt != b->contended_cnt)
+    return a->contended_cnt > b->contended_cnt ? -1 : 1;
+  return 0;
+}
+
+/* Prints the statistics of each class of lock acquired so far, the
+   most waited for first. */
+void
+lock_print_stats (void)
+{
+  static struct lockstat *order[LOCK_CLASS_MAX];
+  size_t cnt = 0;
+  size_t i;
+
+  if (!lock_stats_enabled)
+    return;
+
+  for (i = 0; i < lock_class_cnt; i++)
+    if (lock_classes[i].acquire_cnt > 0)
+      order[cnt++] = &lock_classes[i];
+  qsort (order, cnt, sizeof *order, lock_class_compare);
+  for (i = 0; i < cnt; i++)
+    printf ("Lock %s (%s): %"PRIu64" acquires, %"PRIu64" contended, "
+            "%"PRId64" wait ticks (max %"PRId64"), %"PRId64" hold ticks\n",
+            order[i]->name, order[i]->site, order[i]->acquire_cnt,
+            order[i]->contended_cnt, order[i]->wait_ticks,
+            order[i]->max_wait_ticks, order[i]->hold_ticks);
+  if (lock_class_dropped > 0)
+    printf ("Lock: %zu initializations in untracked classes\n",
+            lock_class_dropped);
 }
 
-/* One semaphore in a list. */
+/* One semaphore in a condition's waiters. */
 struct semaphore_elem 
   {
-    struct list_elem elem;              /* List element. */
+    struct heap_elem elem;              /* Heap element. */
     struct semaphore semaphore;         /* This semaphore. */
     struct thread *thread;              /* Thread waiting on this semaphore. */
+    unsigned seq;                       /* Order of the wait. */
   };
 
-/* Returns true if A has higher priority than B or false otherwise. */
-static bool
-semaphore_elem_higher_priority (const struct list_elem *a, 
-                                const struct list_elem *b, void *aux UNUSED)
-{
-  return list_entry (a, struct semaphore_elem, elem)->thread-> priority
-         > list_entry (b, struct semaphore_elem, elem)->thread-> priority;
-}
-
 /* Initializes condition variable COND.  A condition variable
    allows one piece of code to signal a condition and cooperating
    code to receive the signal and act upon it. */
@@ -300,7 +550,7 @@ cond_init (struct condition *cond)
 {
   ASSERT (cond != NULL);
 
-  list_init (&cond->waiters);
+  heap_init (&cond->waiters, cond_waiter_less, NULL);
 }
 
 /* Atomically releases LOCK and waits for COND to be signaled by
@@ -327,6 +577,7 @@ void
 cond_wait (struct condition *cond, struct lock *lock) 
 {
   struct semaphore_elem waiter;
+  enum intr_level old_level;
 
   ASSERT (cond != NULL);
   ASSERT (lock != NULL);
@@ -335,7 +586,12 @@ cond_wait (struct condition *cond, struct lock *lock)
   
   sema_init (&waiter.semaphore, 0);
   waiter.thread = thread_current ();
-  list_push_back (&cond->waiters, &waiter.elem);
+  old_level = intr_disable ();
+  waiter.seq = wait_seq++;
+  heap_push (&cond->waiters, &waiter.elem);
+  waiter.thread->waiting_cond = cond;
+  waiter.thread->cond_elem = &waiter.elem;
+  intr_set_level (old_level);
   lock_release (lock);
   sema_down (&waiter.semaphore);
   lock_acquire (lock);
@@ -356,10 +612,15 @@ cond_signal (struct condition *cond, struct lock *lock UNUSED)
   ASSERT (!intr_context ());
   ASSERT (lock_held_by_current_thread (lock));
 
-  if (!list_empty (&cond->waiters)) 
-    sema_up (&list_entry (list_pop_min (&cond->waiters, 
-                                        semaphore_elem_higher_priority, NULL),
-             struct semaphore_elem, elem)->semaphore);
+  if (!heap_empty (&cond->waiters)) 
+    {
+      enum intr_level old_level = intr_disable ();
+      struct semaphore_elem *waiter = heap_entry (heap_pop (&cond->waiters),
+                                                  struct semaphore_elem, elem);
+      waiter->thread->waiting_cond = NULL;
+      intr_set_level (old_level);
+      sema_up (&waiter->semaphore);
+    }
 }
 
 /* Wakes up all threads, if any, waiting on COND (protected by
@@ -374,6 +635,338 @@ cond_broadcast (struct condition *cond, struct lock *lock)
   ASSERT (cond != NULL);
   ASSERT (lock != NULL);
 
-  while (!list_empty (&cond->waiters))
+  while (!heap_empty (&cond->waiters))
     cond_signal (cond, lock);
 }
+
+/* Initializes RWLOCK. A readers-writer lock may be held either
+   shared by any number of threads or exclusive by a single one.
+   Like locks, it is not recursive. Waiting writers keep new
+   readers out, so that a stream of readers can't starve them.
+   Called through the rwlock_init() macro, which names the lock
+   class of its internal lock after the call, like lock_init(). */
+void
+rwlock_init_at (struct rwlock *rwlock, const char *name,
+                const char *file, int line)
+{
+  ASSERT (rwlock != NULL);
+
+  lock_init_at (&rwlock->lock, name, file, line);
+  cond_init (&rwlock->can_read);
+  cond_init (&rwlock->can_write);
+  rwlock->readers = 0;
+  rwlock->waiting_writers = 0;
+  rwlock->writer = NULL;
+}
+
+/* Acquires RWLOCK shared, sleeping while a thread holds it
+   exclusive or waits to. */
+void
+rwlock_acquire_read (struct rwlock *rwlock)
+{
+  ASSERT (rwlock != NULL);
+  ASSERT (!intr_context ());
+  ASSERT (!rwlock_held_by_current_thread (rwlock));
+
+  lock_acquire (&rwlock->lock);
+  while (rwlock->writer != NULL || rwlock->waiting_writers > 0)
+    cond_wait (&rwlock->can_read, &rwlock->lock);
+  rwlock->readers++;
+  lock_release (&rwlock->lock);
+}
+
+/* Releases RWLOCK, which the current thread holds shared. */
+void
+rwlock_release_read (struct rwlock *rwlock)
+{
+  ASSERT (rwlock != NULL);
+
+  lock_acquire (&rwlock->lock);
+  ASSERT (rwlock->readers > 0);
+  if (--rwlock->readers == 0)
+    cond_signal (&rwlock->can_write, &rwlock->lock);
+  lock_release (&rwlock->lock);
+}
+
+/* Acquires RWLOCK exclusive, sleeping while any thread holds it. */
+void
+rwlock_acquire_write (struct rwlock *rwlock)
+{
+  ASSERT (rwlock != NULL);
+  ASSERT (!intr_context ());
+  ASSERT (!rwlock_held_by_current_thread (rwlock));
+
+  lock_acquire (&rwlock->lock);
+  rwlock->waiting_writers++;
+  while (rwlock->writer != NULL || rwlock->readers > 0)
+    cond_wait (&rwlock->can_write, &rwlock->lock);
+  rwlock->waiting_writers--;
+  rwlock->writer = thread_current ();
+  lock_release (&rwlock->lock);
+}
+
+/* Releases RWLOCK, which the current thread holds exclusive. */
+void
+rwlock_release_write (struct rwlock *rwlock)
+{
+  ASSERT (rwlock != NULL);
+  ASSERT (rwlock_held_by_current_thread (rwlock));
+
+  lock_acquire (&rwlock->lock);
+  rwlock->writer = NULL;
+  if (rwlock->waiting_writers > 0)
+    cond_signal (&rwlock->can_write, &rwlock->lock);
+  else
+    cond_broadcast (&rwlock->can_read, &rwlock->lock);
+  lock_release (&rwlock->lock);
+}
+
+/* Returns true if the current thread holds RWLOCK exclusive, false
+   otherwise. Whether it holds it shared is not tracked. */
+bool
+rwlock_held_by_current_thread (const struct rwlock *rwlock)
+{
+  ASSERT (rwlock != NULL);
+
+  return rwlock->writer == thread_current ();
+}
+
+/* Moves thread T, whose priority has changed, to its new place among
+   the waiters of whatever it is waiting for.  Must be called with
+   interrupts off. */
+void
+synch_priority_changed (struct thread *t)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (t->waiting_sema != NULL)
+    heap_update (&t->waiting_sema->waiters, &t->sema_elem);
+  if (t->blocking_lock != NULL)
+    heap_update (&t->blocking_lock->waiters, &t->lock_elem);
+  if (t->waiting_cond != NULL)
+    heap_update (&t->waiting_cond->waiters, t->cond_elem);
+}
+
+/* Returns true if thread A_ waits on a semaphore ahead of B_. */
+static bool
+sema_waiter_less (const struct heap_elem *a_, const struct heap_elem *b_,
+                  void *aux UNUSED)
+{
+  const struct thread *a = heap_entry (a_, struct thread, sema_elem);
+  const struct thread *b = heap_entry (b_, struct thread, sema_elem);
+
+  return (a->priority > b->priority
+          || (a->priority == b->priority
+              && (int) (a->sema_seq - b->sema_seq) < 0));
+}
+
+/* Returns true if thread A_ waits for a lock ahead of B_. */
+static bool
+lock_waiter_less (const struct heap_elem *a_, const struct heap_elem *b_,
+                  void *aux UNUSED)
+{
+  const struct thread *a = heap_entry (a_, struct thread, lock_elem);
+  const struct thread *b = heap_entry (b_, struct thread, lock_elem);
+
+  return (a->priority > b->priority
+          || (a->priority == b->priority
+              && (int) (a->lock_seq - b->lock_seq) < 0));
+}
+
+/* Returns true if condition waiter A_ waits ahead of B_. */
+static bool
+cond_waiter_less (const struct heap_elem *a_, const struct heap_elem *b_,
+                  void *aux UNUSED)
+{
+  const struct semaphore_elem *a = heap_entry (a_, struct semaphore_elem,
+                                               elem);
+  const struct semaphore_elem *b = heap_entry (b_, struct semaphore_elem,
+                                               elem);
+
+  return (a->thread->priority > b->thread->priority
+          || (a->thread->priority == b->thread->priority
+              && (int) (a->seq - b->seq) < 0));
+}
+
+/* Callbacks passed to call_rcu(): those queued since the current grace
+   period started, and those waiting for it to end, which started when
+   RCU_SNAP was taken.  Guarded by RCU_SPIN. */
+static struct list rcu_next = LIST_INITIALIZER (rcu_next);
+static struct list rcu_waiting = LIST_INITIALIZER (rcu_waiting);
+static uint64_t rcu_snap[CPU_MAX];
+static struct spinlock rcu_spin;
+
+static void rcu_advance (void);
+
+/* Starts an RCU read-side critical section, which may be nested.
+   Until the outermost one ends, the data it reads through
+   rcu_dereference() stays valid, and the thread must not sleep.  Not
+   for interrupt handlers. */
+void
+rcu_read_lock (void)
+{
+  ASSERT (!intr_context ());
+
+  thread_current ()->rcu_depth++;
+  barrier ();
+}
+
+/* Ends an RCU read-side critical section, yielding the CPU if the
+   scheduler asked for it during the outermost one. */
+void
+rcu_read_unlock (void)
+{
+  struct thread *t = thread_current ();
+
+  ASSERT (t->rcu_depth > 0);
+
+  barrier ();
+  if (--t->rcu_depth == 0 && t->rcu_yield)
+    {
+      t->rcu_yield = false;
+      thread_yield ();
+    }
+}
+
+/* Returns true if the current thread is in an RCU read-side critical
+   section. */
+bool
+rcu_read_held (void)
+{
+  return thread_current ()->rcu_depth > 0;
+}
+
+/* Waits for a grace period: until every RCU read-side critical section
+   running when it is called has ended, so that data unpublished before
+   the call can be freed.  With a single CPU there is nothing to wait
+   for, since no other thread can be left in the middle of one. */
+void
+synchronize_rcu (void)
+{
+  uint64_t snap[CPU_MAX];
+
+  ASSERT (!intr_context ());
+  ASSERT (!rcu_read_held ());
+
+  thread_quiescent_snapshot (snap);
+  while (!thread_quiescent_since (snap))
+    thread_yield ();
+  rcu_advance ();
+}
+
+/* Arranges for FUNC to be called with HEAD, usually embedded in an
+   object unpublished just before, after a grace period, without
+   waiting for one.  FUNC runs in a later call to call_rcu(),
+   synchronize_rcu() or rcu_barrier() outside of any read-side
+   critical section, and may sleep. */
+void
+call_rcu (struct rcu_head *head, rcu_func *func)
+{
+  ASSERT (!intr_context ());
+
+  head->func = func;
+  spinlock_acquire (&rcu_spin);
+  list_push_back (&rcu_next, &head->elem);
+  spinlock_release (&rcu_spin);
+  if (!rcu_read_held ())
+    rcu_advance ();
+}
+
+/* Waits until every callback passed to call_rcu() so far has been
+   called. */
+void
+rcu_barrier (void)
+{
+  bool empty;
+
+  do
+    {
+      synchronize_rcu ();
+      spinlock_acquire (&rcu_spin);
+      empty = list_empty (&rcu_next) && list_empty (&rcu_waiting);
+      spinlock_release (&rcu_spin);
+    }
+  while (!empty);
+}
+
+/* Calls the callbacks whose grace period has ended, and starts one for
+   those queued since, if none is running. */
+static void
+rcu_advance (void)
+{
+  struct list done;
+
+  ASSERT (!rcu_read_held ());
+
+  list_init (&done);
+  spinlock_acquire (&rcu_spin);
+  if (!list_empty (&rcu_waiting) && thread_quiescent_since (rcu_snap))
+    while (!list_empty (&rcu_waiting))
+      list_push_back (&done, list_pop_front (&rcu_waiting));
+  if (list_empty (&rcu_waiting) && !list_empty (&rcu_next))
+    {
+      while (!list_empty (&rcu_next))
+        list_push_back (&rcu_waiting, list_pop_front (&rcu_next));
+      thread_quiescent_snapshot (rcu_snap);
+    }
+  spinlock_release (&rcu_spin);
+
+  while (!list_empty (&done))
+    {
+      struct rcu_head *head = list_entry (list_pop_front (&done),
+                                          struct rcu_head, elem);
+      head->func (head);
+    }
+}
+
+/* Initializes spinlock LOCK as not held. */
+void
+spinlock_init (struct spinlock *lock)
+{
+  ASSERT (lock != NULL);
+
+  lock->locked = 0;
+  lock->old_level = INTR_OFF;
+}
+
+/* Acquires spinlock LOCK, turning interrupts off until it is released.
+   Unlike lock_acquire(), this never sleeps, so it may be used in an
+   interrupt handler, but LOCK must only be held briefly.  With a single
+   CPU turning interrupts off is enough; the atomic exchange is what
+   would keep out another CPU. */
+void
+spinlock_acquire (struct spinlock *lock)
+{
+  enum intr_level old_level;
+  int locked;
+
+  ASSERT (lock != NULL);
+
+  old_level = intr_disable ();
+  do
+    {
+      locked = 1;
+      asm volatile ("xchgl %0, %1" : "+r" (locked), "+m" (lock->locked)
+                    : : "memory");
+      if (locked)
+        asm volatile ("pause");
+    }
+  while (locked);
+  lock->old_level = old_level;
+}
+
+/* Releases spinlock LOCK and restores the interrupt level from before
+   it was acquired. */
+void
+spinlock_release (struct spinlock *lock)
+{
+  enum intr_level old_level;
+
+  ASSERT (lock != NULL);
+  ASSERT (lock->locked);
+
+  old_level = lock->old_level;
+  barrier ();
+  lock->locked = 0;
+  intr_set_level (old_level);
+}
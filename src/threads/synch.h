@@ -1,14 +1,21 @@
 #ifndef THREADS_SYNCH_H
 #define THREADS_SYNCH_H
 
+#include <heap.h>
 #include <list.h>
+#include <lockstat.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "threads/interrupt.h"
+
+struct thread;
 
 /* A counting semaphore. */
 struct semaphore 
   {
     unsigned value;             /* Current value. */
-    struct list waiters;        /* List of waiting threads. */
+    struct heap waiters;        /* Waiting threads, by priority. */
   };
 
 void sema_init (struct semaphore *, unsigned value);
@@ -20,23 +27,40 @@ void sema_self_test (void);
 /* Lock. */
 struct lock 
   {
-    struct thread *holder;      /* Thread holding lock (for debugging). */
-    struct semaphore semaphore; /* Binary semaphore controlling access. */
-    struct list waiters;        /* List of waiting threads. */
-    struct list_elem elem;      /* Element in thread's donations list. */
+    volatile uintptr_t owner;   /* Holding thread, or 0 if free, with
+                                   LOCK_CONTENDED set while threads
+                                   wait for it. */
+    struct heap waiters;        /* Waiting threads, by priority. */
+    struct list_elem elem;      /* Element in holder's donations list,
+                                   while contended. */
     int max_priority_donation;  /* Of the waiting threads' donations. */
+    struct lockstat *stat;      /* Class statistics, with -lockstat. */
+    int64_t acquired_at;        /* Timer ticks when last acquired. */
   };
 
-void lock_init (struct lock *);
+/* Low bit of a lock's owner, free since threads are page-aligned. */
+#define LOCK_CONTENDED 1
+
+/* Records where each lock is initialized, naming its class for the
+   statistics kept under -lockstat. */
+#define lock_init(LOCK) lock_init_at (LOCK, #LOCK, __FILE__, __LINE__)
+void lock_init_at (struct lock *, const char *name,
+                   const char *file, int line);
 void lock_acquire (struct lock *);
 bool lock_try_acquire (struct lock *);
 void lock_release (struct lock *);
+struct thread *lock_holder (const struct lock *);
 bool lock_held_by_current_thread (const struct lock *);
 
+/* Lock contention statistics. */
+extern bool lock_stats_enabled;
+size_t lock_stats_get (struct lockstat *, size_t first, size_t cnt);
+void lock_print_stats (void);
+
 /* Condition variable. */
 struct condition 
   {
-    struct list waiters;        /* List of waiting threads. */
+    struct heap waiters;        /* Waiting threads, by priority. */
   };
 
 void cond_init (struct condition *);
@@ -44,6 +68,75 @@ void cond_wait (struct condition *, struct lock *);
 void cond_signal (struct condition *, struct lock *);
 void cond_broadcast (struct condition *, struct lock *);
 
+void synch_priority_changed (struct thread *);
+
+/* Readers-writer lock. */
+struct rwlock
+  {
+    struct lock lock;           /* Guards the members below. */
+    struct condition can_read;  /* Signaled when readers may enter. */
+    struct condition can_write; /* Signaled when a writer may enter. */
+    unsigned readers;           /* Number of threads holding it shared. */
+    unsigned waiting_writers;   /* Number of threads waiting to write. */
+    struct thread *writer;      /* Thread holding it exclusive, if any. */
+  };
+
+#define rwlock_init(RWLOCK) \
+        rwlock_init_at (RWLOCK, #RWLOCK, __FILE__, __LINE__)
+void rwlock_init_at (struct rwlock *, const char *name,
+                     const char *file, int line);
+void rwlock_acquire_read (struct rwlock *);
+void rwlock_release_read (struct rwlock *);
+void rwlock_acquire_write (struct rwlock *);
+void rwlock_release_write (struct rwlock *);
+bool rwlock_held_by_current_thread (const struct rwlock *);
+
+/* Spinlock, for data shared with interrupt handlers and for short
+   critical sections that never sleep, such as a counter update. */
+struct spinlock
+  {
+    volatile int locked;        /* Nonzero while held. */
+    enum intr_level old_level;  /* Interrupt level before acquiring. */
+  };
+
+void spinlock_init (struct spinlock *);
+void spinlock_acquire (struct spinlock *);
+void spinlock_release (struct spinlock *);
+
+/* Read-copy-update, for read-mostly data that readers look through
+   without taking any lock.  Writers, serialized among themselves by a
+   lock of their own, publish a new version of what they change with
+   rcu_assign_pointer() and free the old one only after a grace period,
+   once every reader that could have seen it is done.  Readers bracket
+   their accesses with rcu_read_lock() and rcu_read_unlock() and must
+   not sleep in between; a thread is not switched out there, so each
+   context switch marks the end of whatever section its CPU was in. */
+struct rcu_head
+  {
+    struct list_elem elem;              /* Element in a callback list. */
+    void (*func) (struct rcu_head *);   /* Called after a grace period. */
+  };
+
+typedef void rcu_func (struct rcu_head *);
+
+void rcu_read_lock (void);
+void rcu_read_unlock (void);
+bool rcu_read_held (void);
+void synchronize_rcu (void);
+void call_rcu (struct rcu_head *, rcu_func *);
+void rcu_barrier (void);
+
+/* Makes the object P is set to point to, already initialized, visible
+   to readers. */
+#define rcu_assign_pointer(P, V) \
+        do { barrier (); (P) = (V); } while (0)
+
+/* Reads pointer P once for a reader, which may then follow it until
+   its read-side critical section ends. */
+#define rcu_dereference(P) \
+        ({ __typeof__ (P) rcu_p_ = *(__typeof__ (P) volatile *) &(P); \
+           barrier (); rcu_p_; })
+
 /* Optimization barrier.
 
    The compiler will not reorder operations across an
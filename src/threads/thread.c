@@ -2,40 +2,136 @@
 #include <debug.h>
 #include <stddef.h>
 #include <random.h>
+#include <round.h>
 #include <stdio.h>
 #include <string.h>
 #include "threads/flags.h"
+#include "threads/fpu.h"
 #include "threads/interrupt.h"
 #include "threads/intr-stubs.h"
+#include "threads/kstack.h"
 #include "threads/palloc.h"
 #include "threads/switch.h"
 #include "threads/synch.h"
+#include "threads/trace.h"
 #include "threads/vaddr.h"
 #include "devices/timer.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #endif
+#ifdef VM
+#include "vm/frame.h"
+#endif
 
 /* Random value for struct thread's `magic' member.
    Used to detect stack overflow.  See the big comment at the top
    of thread.h for details. */
 #define THREAD_MAGIC 0xcd6abf4b
 
-/* List of processes in THREAD_READY state, that is, processes
-   that are ready to run but not actually running. */
-static struct list ready_list;
-static int thread_num_ready; /*number of threads in ready list*/
+#define PRI_CNT (PRI_MAX - PRI_MIN + 1)
+
+/* Scheduler state of a CPU.  Only the bootstrap processor is ever
+   brought up, so there is just the one, but whatever a second CPU
+   would need its own copy of is kept here rather than in globals. */
+struct cpu
+  {
+    unsigned id;                /* Index in CPUS. */
+
+    /* Processes in THREAD_READY state, that is, processes that are
+       ready to run but not actually running, in one FIFO queue per
+       priority.  Bit P of READY_MASK is set if READY_QUEUES[P] is
+       not empty, so finding the highest priority ready thread takes
+       a bit scan instead of a search. */
+    struct list ready_queues[PRI_CNT];
+    uint32_t ready_mask[DIV_ROUND_UP (PRI_CNT, 32)];
+    int thread_num_ready;       /* Number of threads in ready queues. */
+
+    /* Real-time threads in THREAD_READY state with budget left,
+       ordered by deadline.  All of them run before any thread in
+       READY_QUEUES. */
+    struct list rt_queue;
+
+    struct thread *idle_thread; /* Idle thread. */
+    unsigned thread_ticks;      /* # of timer ticks since last yield. */
+
+    /* Number of quiescent states for RCU: context switches, since no
+       thread is switched out within a read-side critical section, and
+       timer ticks that find the running thread outside of one. */
+    uint64_t quiescent_cnt;
+
+    /* Pages of threads that died here, linked through their
+       ALLELEM, for thread_create() to reuse. */
+    struct list dead_threads;
+    size_t dead_cnt;            /* Number of DEAD_THREADS. */
+
+    /* Statistics. */
+    long long idle_ticks;       /* # of timer ticks spent idle. */
+    long long kernel_ticks;     /* # of timer ticks in kernel threads. */
+    long long user_ticks;       /* # of timer ticks in user programs. */
+  };
+
+static struct cpu cpus[CPU_MAX];
+static unsigned cpu_cnt = 1;    /* Number of CPUs brought up. */
+
+/* Most pages of dead threads a CPU keeps for reuse. */
+#define DEAD_THREADS_MAX 8
+
+/* Returns the CPU we are running on. */
+static inline struct cpu *
+this_cpu (void)
+{
+  return &cpus[0];
+}
+
+/* Returns the index of the CPU we are running on.  Only stable
+   while interrupts are off, since the current thread could be
+   moved to another CPU otherwise. */
+unsigned
+thread_cpu_id (void)
+{
+  return this_cpu ()->id;
+}
+
+/* Stores in SNAP the number of quiescent states each CPU has been
+   through so far, for thread_quiescent_since(). */
+void
+thread_quiescent_snapshot (uint64_t snap[CPU_MAX])
+{
+  enum intr_level old_level = intr_disable ();
+  unsigned i;
+
+  for (i = 0; i < cpu_cnt; i++)
+    snap[i] = cpus[i].quiescent_cnt;
+  intr_set_level (old_level);
+}
+
+/* Returns true if every CPU has been through a quiescent state since
+   thread_quiescent_snapshot() stored SNAP, so that no RCU read-side
+   critical section that was running then still is.  The caller's own
+   CPU counts as having been through one, since the caller must not be
+   in a read-side critical section. */
+bool
+thread_quiescent_since (const uint64_t snap[CPU_MAX])
+{
+  enum intr_level old_level = intr_disable ();
+  struct cpu *self = this_cpu ();
+  bool passed = true;
+  unsigned i;
 
-/* List of processes put to sleep by a call to timer_sleep */
-static struct list slept_list;
+  ASSERT (thread_current ()->rcu_depth == 0);
+  for (i = 0; i < cpu_cnt && passed; i++)
+    {
+      struct cpu *cpu = &cpus[i];
+      passed = cpu == self || cpu->quiescent_cnt != snap[i];
+    }
+  intr_set_level (old_level);
+  return passed;
+}
 
 /* List of all processes.  Processes are added to this list
    when they are first scheduled and removed when they exit. */
 static struct list all_list;
 
-/* Idle thread. */
-static struct thread *idle_thread;
-
 /* Initial thread, the thread running init.c:main(). */
 static struct thread *initial_thread;
 
@@ -50,28 +146,34 @@ struct kernel_thread_frame
     void *aux;                  /* Auxiliary data for function. */
   };
 
-/* Statistics. */
-static long long idle_ticks;    /* # of timer ticks spent idle. */
-static long long kernel_ticks;  /* # of timer ticks in kernel threads. */
-static long long user_ticks;    /* # of timer ticks in user programs. */
-
 /* Scheduling. */
 #define TIME_SLICE 4            /* # of timer ticks to give each thread. */
-static unsigned thread_ticks;   /* # of timer ticks since last yield. */
 
 /* If false (default), use priority scheduler.
    If true, use multi-level feedback queue scheduler.
    Controlled by kernel command-line option "-o mlfqs". */
 bool thread_mlfqs;
 #define MLFQS_NICE_DEFAULT 0
-#define MLFQS_NICE_MIN -20
-#define MLFQS_NICE_MAX 20
 #define MLFQS_RECENT_CPU_DEFAULT 0
 fp_t mlfqs_load_average;
 
+/* Seconds of MLFQS recent_cpu decay so far, and the decay
+   coefficient of each of the last MLFQS_DECAY_HISTORY of them,
+   indexed by second modulo that.  A blocked thread is left out of
+   the per-second update and catches up on the decays it missed
+   when it is unblocked. */
+#define MLFQS_DECAY_HISTORY 64
+static int64_t mlfqs_seconds;
+static fp_t mlfqs_decay[MLFQS_DECAY_HISTORY];
+
+/* Thousandths of the CPU reserved by real-time threads, which admission
+   keeps to RT_SHARE_MAX.  Guarded by disabling interrupts. */
+static int rt_share;
+
 static void kernel_thread (thread_func *, void *aux);
 
 static void idle (void *aux UNUSED);
+static bool idle_prezero (void);
 static struct thread *running_thread (void);
 static struct thread *next_thread_to_run (void);
 static void init_thread (struct thread *t, const char *name, int priority,
@@ -82,8 +184,23 @@ static void schedule (void);
 void thread_schedule_tail (struct thread *prev);
 static tid_t allocate_tid (void);
 static void thread_mlfqs_update_tick (void);
-static void thread_mlfqs_update_recent_cpu (struct thread *, void * UNUSED);
+static void thread_mlfqs_catch_up (struct thread *);
+static int thread_mlfqs_priority (struct thread *);
+static void thread_mlfqs_update_runnable (void);
 static void thread_mlfqs_update_priority (struct thread *, void * UNUSED);
+static void ready_push (struct thread *);
+static void ready_remove (struct thread *);
+static int ready_max_priority (struct cpu *);
+static bool ready_preempts (struct cpu *, struct thread *);
+static bool rt_active (const struct thread *);
+static int rt_share_of (const struct thread *);
+static void rt_new_period (struct thread *, int64_t now);
+static void rt_leave (struct thread *);
+static timer_func rt_replenish;
+static list_less_func rt_deadline_less;
+static void thread_change_priority (struct thread *, int priority);
+static struct thread *thread_page_get (void);
+static void thread_reap (void);
 
 
 /* Initializes the threading system by transforming the code
@@ -105,10 +222,13 @@ thread_init (void)
   ASSERT (intr_get_level () == INTR_OFF);
 
   lock_init (&tid_lock);
-  list_init (&ready_list);
-  list_init (&slept_list);
+  for (int i = 0; i < PRI_CNT; i++)
+    list_init (&cpus[0].ready_queues[i]);
+  list_init (&cpus[0].rt_queue);
   list_init (&all_list);
-  thread_num_ready = 0;
+  cpus[0].thread_num_ready = 0;
+  list_init (&cpus[0].dead_threads);
+  cpus[0].dead_cnt = 0;
   mlfqs_load_average = fp (0);
 
   /* Set up a thread structure for the running thread. */
@@ -142,19 +262,40 @@ void
 thread_tick (void)
 {
   struct thread *t = thread_current ();
+  struct cpu *cpu = this_cpu ();
 
   /* Update statistics. */
-  if (t == idle_thread)
-    idle_ticks++;
+  if (t == cpu->idle_thread)
+    cpu->idle_ticks++;
 #ifdef USERPROG
   else if (t->pagedir != NULL)
-    user_ticks++;
+    cpu->user_ticks++;
 #endif
   else
-    kernel_ticks++;
+    cpu->kernel_ticks++;
+
+  /* Charge a real-time thread for the tick.  Once it has spent its
+     budget it is throttled until its deadline; if it reaches that
+     first, having waited behind earlier ones, it starts afresh. */
+  if (rt_active (t))
+    {
+      int64_t now = timer_ticks ();
+
+      if (--t->rt_remaining <= 0)
+        {
+          t->rt_throttled = true;
+          timer_arm (&t->rt_timer, t->rt_deadline - now);
+          intr_yield_on_return ();
+        }
+      else if (now >= t->rt_deadline)
+        rt_new_period (t, now);
+    }
+
+  if (t->rcu_depth == 0)
+    cpu->quiescent_cnt++;
 
   /* Enforce preemption. */
-  if (++thread_ticks >= TIME_SLICE)
+  if (++cpu->thread_ticks >= TIME_SLICE)
     intr_yield_on_return ();
 
   /* Update MLFQS statistics. */
@@ -162,6 +303,57 @@ thread_tick (void)
     thread_mlfqs_update_tick ();
 }
 
+/* Accounts CNT timer ticks that went by with the idle thread running
+   and no timer interrupt, none of them starting a second. */
+void
+thread_account_idle (int64_t cnt)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  this_cpu ()->idle_ticks += cnt;
+}
+
+/* Accounts the time since the running thread's time was last
+   accounted as spent in user mode if USER, or in the kernel
+   otherwise.  The interrupt handler calls this on each entry to the
+   kernel from user mode and each return to it, so that a thread
+   switch, which is always in the kernel, accounts the time of the
+   thread switched from as kernel time.
+
+   Without a time stamp counter this measures in whole ticks, so one
+   entry or exit may be charged a tick that began before it; that
+   evens out over many, as sampling each tick would. */
+void
+thread_account_time (bool user)
+{
+  enum intr_level old_level = intr_disable ();
+  struct thread *t = thread_current ();
+  uint64_t now = timer_clock ();
+
+  if (user)
+    t->user_time += now - t->cpu_stamp;
+  else
+    t->kernel_time += now - t->cpu_stamp;
+  t->cpu_stamp = now;
+  intr_set_level (old_level);
+}
+
+/* Stores the nanoseconds T has spent in user mode and in the kernel
+   in *USER_NS and *KERNEL_NS, counting the time of the running
+   thread up to now as kernel time.  The times of threads that ran
+   before timer_calibrate() are not meaningful. */
+void
+thread_get_times (struct thread *t, uint64_t *user_ns, uint64_t *kernel_ns)
+{
+  enum intr_level old_level = intr_disable ();
+  uint64_t kernel_time = t->kernel_time;
+
+  if (t == thread_current ())
+    kernel_time += timer_clock () - t->cpu_stamp;
+  *user_ns = timer_clock_to_ns (t->user_time);
+  *kernel_ns = timer_clock_to_ns (kernel_time);
+  intr_set_level (old_level);
+}
+
 /* Called every tick by the timer to update the MLFQS scheduler
    load_average and recent_cpu statistics. */
 static void
@@ -170,7 +362,7 @@ thread_mlfqs_update_tick (void)
   ASSERT (thread_mlfqs);
   struct thread *t = thread_current ();
   /* Update this thread's recent_cpu every tick. */
-  if (t != idle_thread)
+  if (t != this_cpu ()->idle_thread)
     {
       t->mlfqs_recent_cpu = fp_add_to_int (t->mlfqs_recent_cpu, 1);
     }
@@ -178,14 +370,21 @@ thread_mlfqs_update_tick (void)
   if (timer_ticks () % TIMER_FREQ == 0)
     {
       /* Update load_average every second. */
-      int count_ready_threads = thread_num_ready +
-                          ((thread_current () != idle_thread) ? 1 : 0);
+      int count_ready_threads = (thread_current () != this_cpu ()->idle_thread
+                                 ? 1 : 0);
+      for (unsigned i = 0; i < cpu_cnt; i++)
+        count_ready_threads += (cpus[i].thread_num_ready
+                                + list_size (&cpus[i].rt_queue));
       mlfqs_load_average = fp_mult (fp_div (fp (59), fp (60)), mlfqs_load_average)
         + fp_div (fp (count_ready_threads), fp (60));
 
-      /* Update all threads' recent_cpu and priority every second. */
-      thread_foreach (thread_mlfqs_update_recent_cpu, NULL);
-      thread_foreach (thread_mlfqs_update_priority, NULL);
+      /* Decay recent_cpu and update priority every second, for the
+         runnable threads only. */
+      mlfqs_seconds++;
+      mlfqs_decay[mlfqs_seconds % MLFQS_DECAY_HISTORY]
+        = fp_div (2 * mlfqs_load_average,
+                  fp_add_to_int (2 * mlfqs_load_average, 1));
+      thread_mlfqs_update_runnable ();
     }
   if (timer_ticks () % TIME_SLICE== 0)
     {
@@ -196,6 +395,109 @@ thread_mlfqs_update_tick (void)
     }
 }
 
+/* Decays recent_cpu of the running thread and all ready threads,
+   and updates their priorities, moving each ready thread to the
+   queue of its new priority in the order they were queued.
+   Must be called with interrupts off. */
+static void
+thread_mlfqs_update_runnable (void)
+{
+  struct thread *cur = thread_current ();
+  struct list ready;
+  unsigned i;
+  int p;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (cur != this_cpu ()->idle_thread)
+    {
+      thread_mlfqs_catch_up (cur);
+      cur->priority = thread_mlfqs_priority (cur);
+    }
+
+  list_init (&ready);
+  for (i = 0; i < cpu_cnt; i++)
+    for (p = PRI_MAX; p >= PRI_MIN; p--)
+      while (!list_empty (&cpus[i].ready_queues[p - PRI_MIN]))
+        {
+          struct thread *t
+            = list_entry (list_front (&cpus[i].ready_queues[p - PRI_MIN]),
+                          struct thread, elem);
+          ready_remove (t);
+          list_push_back (&ready, &t->elem);
+        }
+  while (!list_empty (&ready))
+    {
+      struct thread *t = list_entry (list_pop_front (&ready),
+                                     struct thread, elem);
+      thread_mlfqs_catch_up (t);
+      t->priority = thread_mlfqs_priority (t);
+      ready_push (t);
+    }
+}
+
+/* Returns X raised to the power N. */
+static fp_t
+fp_pow (fp_t x, int64_t n)
+{
+  fp_t result = fp (1);
+
+  for (; n > 0; n /= 2)
+    {
+      if (n % 2)
+        result = fp_mult (result, x);
+      x = fp_mult (x, x);
+    }
+  return result;
+}
+
+/* Applies to recent_cpu of T the decays of the seconds since it was
+   last updated.  The seconds still in the history are applied one by
+   one; any older ones use the oldest coefficient remembered, in closed
+   form, since T's nice value can't have changed while it was blocked.
+   Must be called with interrupts off. */
+static void
+thread_mlfqs_catch_up (struct thread *t)
+{
+  int64_t s = t->mlfqs_seconds;
+  fp_t rc = t->mlfqs_recent_cpu;
+
+  ASSERT (thread_mlfqs);
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (mlfqs_seconds - s > MLFQS_DECAY_HISTORY)
+    {
+      /* recent_cpu after K decays by C is C^K * RC
+         + NICE * (1 - C^K) / (1 - C). */
+      int64_t k = mlfqs_seconds - MLFQS_DECAY_HISTORY - s;
+      fp_t c = mlfqs_decay[(mlfqs_seconds + 1) % MLFQS_DECAY_HISTORY];
+      fp_t ck = fp_pow (c, k);
+
+      rc = fp_mult (ck, rc)
+           + fp_div (fp_mult (fp (t->mlfqs_nice), fp (1) - ck), fp (1) - c);
+      s = mlfqs_seconds - MLFQS_DECAY_HISTORY;
+    }
+  while (s < mlfqs_seconds)
+    {
+      s++;
+      rc = fp_add_to_int (fp_mult (mlfqs_decay[s % MLFQS_DECAY_HISTORY], rc),
+                          t->mlfqs_nice);
+    }
+  t->mlfqs_recent_cpu = rc;
+  t->mlfqs_seconds = mlfqs_seconds;
+}
+
+/* Returns the MLFQS priority of T for its recent_cpu and nice. */
+static int
+thread_mlfqs_priority (struct thread *t)
+{
+  int priority = PRI_MAX - fp_to_int(t->mlfqs_recent_cpu / 4)
+                 - (t->mlfqs_nice * 2);
+  priority = priority < PRI_MIN ? PRI_MIN : priority;
+  priority = priority > PRI_MAX ? PRI_MAX : priority;
+  return priority;
+}
+
 /* Updates the priority of t */
 static void
 thread_mlfqs_update_priority (struct thread *t, void *aux UNUSED)
@@ -207,32 +509,18 @@ thread_mlfqs_update_priority (struct thread *t, void *aux UNUSED)
   /* Disable interrupts so thread isn't put on wrong queue
    * in the middle of clamping priority. */
   old_level = intr_disable ();
-  t->priority = PRI_MAX - fp_to_int(t->mlfqs_recent_cpu / 4)
-                - (t->mlfqs_nice * 2);
-  t->priority = t->priority < PRI_MIN ? PRI_MIN : t->priority;
-  t->priority = t->priority > PRI_MAX ? PRI_MAX : t->priority;
+  thread_change_priority (t, thread_mlfqs_priority (t));
   intr_set_level (old_level);
 }
 
-/* Update the recent_cpu member for t recent_cpu only changed
- * in timer_interrupt handler so interrupts should be off
- */
-static void
-thread_mlfqs_update_recent_cpu (struct thread *t, void *aux UNUSED)
-{
-  ASSERT (thread_mlfqs);
-  fp_t coeff = fp_div(2 * mlfqs_load_average,
-                      fp_add_to_int(2 * mlfqs_load_average,  1));
-  t->mlfqs_recent_cpu = fp_add_to_int(fp_mult(coeff, t->mlfqs_recent_cpu),
-                                      t->mlfqs_nice);
-}
-
 /* Prints thread statistics. */
 void
 thread_print_stats (void)
 {
+  struct cpu *cpu = this_cpu ();
+
   printf ("Thread: %lld idle ticks, %lld kernel ticks, %lld user ticks\n",
-          idle_ticks, kernel_ticks, user_ticks);
+          cpu->idle_ticks, cpu->kernel_ticks, cpu->user_ticks);
 }
 
 /* Creates a new kernel thread named NAME with the given initial
@@ -263,7 +551,7 @@ thread_create (const char *name, int priority,
   ASSERT (function != NULL);
 
   /* Allocate thread. */
-  t = palloc_get_page (PAL_ZERO);
+  t = thread_page_get ();
   if (t == NULL)
     return TID_ERROR;
 
@@ -307,6 +595,7 @@ thread_block (void)
 {
   ASSERT (!intr_context ());
   ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (thread_current ()->rcu_depth == 0);
 
   thread_current ()->status = THREAD_BLOCKED;
   schedule ();
@@ -329,8 +618,14 @@ thread_unblock (struct thread *t)
 
   old_level = intr_disable ();
   ASSERT (t->status == THREAD_BLOCKED);
-  list_push_back (&ready_list, &t->elem);
-  thread_num_ready++;
+  if (thread_mlfqs)
+    {
+      thread_mlfqs_catch_up (t);
+      t->priority = thread_mlfqs_priority (t);
+    }
+  if (rt_active (t) && timer_ticks () >= t->rt_deadline)
+    rt_new_period (t, timer_ticks ());
+  ready_push (t);
   t->status = THREAD_READY;
   intr_set_level (old_level);
 }
@@ -378,11 +673,18 @@ thread_exit (void)
 #ifdef USERPROG
   process_exit ();
 #endif
+  fpu_exit ();
+
+  /* Free what other threads left beyond what is worth keeping, while
+     we still can sleep. */
+  if (intr_get_level () == INTR_ON)
+    thread_reap ();
 
   /* Remove thread from all threads list, set our status to dying,
      and schedule another process.  That process will destroy us
      when it calls thread_schedule_tail(). */
   intr_disable ();
+  rt_leave (thread_current ());
   list_remove (&thread_current()->allelem);
   thread_current ()->status = THREAD_DYING;
   schedule ();
@@ -390,7 +692,9 @@ thread_exit (void)
 }
 
 /* Yields the CPU.  The current thread is not put to sleep and
-   may be scheduled again immediately at the scheduler's whim. */
+   may be scheduled again immediately at the scheduler's whim.
+   Within an RCU read-side critical section, the yield happens once
+   the section ends instead. */
 void
 thread_yield (void)
 {
@@ -399,34 +703,34 @@ thread_yield (void)
 
   ASSERT (!intr_context ());
 
-  old_level = intr_disable ();
-  if (cur != idle_thread)
+  if (cur->rcu_depth > 0)
     {
-      list_push_back (&ready_list, &cur->elem);
-      thread_num_ready++;
+      cur->rcu_yield = true;
+      return;
     }
+
+  old_level = intr_disable ();
+  if (cur != this_cpu ()->idle_thread)
+    ready_push (cur);
   cur->status = THREAD_READY;
   schedule ();
   intr_set_level (old_level);
 }
 
-/* Yields the CPU if the current thread's priority is smaller than some
-   other ready thread's priority by calling thread_yield(). */
+/* Yields the CPU if some other ready thread should run before the
+   current thread, one with higher priority or an earlier real-time
+   deadline, by calling thread_yield(). */
 void
 thread_yield_for_priority (void)
 {
   enum intr_level old_level;
   old_level = intr_disable ();
-  if (!list_empty (&ready_list)) {
-    struct thread* max_pri_thread = list_entry (list_min (&ready_list,
-          thread_higher_priority, NULL), struct thread, elem);
-    if (thread_current ()->priority < max_pri_thread->priority)
-      {
-        if (intr_context ())
-          intr_yield_on_return ();
-        else
-          thread_yield();
-      }
+  if (ready_preempts (this_cpu (), thread_current ()))
+    {
+      if (intr_context ())
+        intr_yield_on_return ();
+      else
+        thread_yield();
     }
   intr_set_level (old_level);
 }
@@ -448,52 +752,6 @@ thread_foreach (thread_action_func *func, void *aux)
     }
 }
 
-bool
-thread_less_sleep_func (const struct list_elem *a, const struct list_elem *b,
-                        void *aux UNUSED)
-{
-  return list_entry (a, struct thread, slept_elem)->wake_tick
-         < list_entry (b, struct thread, slept_elem)->wake_tick;
-}
-
-/* Adds current thread to the list of slept threads*/
-void
-thread_add_to_slept (void)
-{
-  /*Disable interrupts so updating slept_list is atomic*/
-  enum intr_level old_level = intr_disable();
-  struct thread *t = thread_current ();
-  list_insert_ordered(&slept_list, &(t->slept_elem),
-                      thread_less_sleep_func, NULL);
-  intr_set_level (old_level);
-}
-
-/* This function wakes sleeping threads that have been asleep
- * for longer than they were set to be */
-void
-thread_wake_eligible_slept (void)
-{
-  struct list_elem *e;
-
-  ASSERT (intr_get_level () == INTR_OFF);
-
-  if (!list_empty(&slept_list))
-    {
-      e = list_front(&slept_list);
-      while (e != list_end (&slept_list))
-        {
-          struct thread *t = list_entry (e, struct thread, slept_elem);
-          if (timer_ticks () >= t->wake_tick)
-            {
-              e = list_remove(e);
-              sema_up(t->sleep_sema);
-            }
-          else
-            break;
-        }
-    }
-}
-
 /* Sets the current thread's priority to NEW_PRIORITY.
    If any other ready thread has higher priority than NEW_PRIORITY, the
    current thread yields the CPU, so don't call in an interrupt context. */
@@ -516,6 +774,43 @@ thread_get_priority (void)
   return thread_current ()->priority;
 }
 
+/* Puts the current thread in the real-time class, to run for BUDGET
+   ticks out of every PERIOD ahead of all threads in the priority
+   classes, or takes it out of the class if PERIOD is 0.  Returns
+   false, changing nothing, if BUDGET is not between 1 and PERIOD or
+   admitting the thread would reserve more than RT_SHARE_MAX of the
+   CPU for real-time threads, which keeps all of their deadlines
+   within reach. */
+bool
+thread_set_realtime (int64_t period, int64_t budget)
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+  int share;
+
+  if (period < 0 || (period > 0 && (budget < 1 || budget > period)))
+    return false;
+  share = period > 0 ? DIV_ROUND_UP (budget * 1000, period) : 0;
+
+  old_level = intr_disable ();
+  if (rt_share - rt_share_of (cur) + share > RT_SHARE_MAX)
+    {
+      intr_set_level (old_level);
+      return false;
+    }
+  rt_leave (cur);
+  if (period > 0)
+    {
+      cur->rt_period = period;
+      cur->rt_budget = budget;
+      rt_share += share;
+      rt_new_period (cur, timer_ticks ());
+    }
+  thread_yield_for_priority ();
+  intr_set_level (old_level);
+  return true;
+}
+
 /* Looks at all threads awaiting locks held by the thread T
    to determine its maximum donated priority and store it. */
 void
@@ -536,7 +831,7 @@ thread_recalculate_priority (struct thread* t, size_t nested_depth)
   else
   {
     int max_priority;
-    struct list_elem *iterator, *max_lock_donation_elem;
+    struct list_elem *iterator;
     struct lock *lock;
 
 
@@ -549,17 +844,15 @@ thread_recalculate_priority (struct thread* t, size_t nested_depth)
         if (lock->max_priority_donation > max_priority)
           max_priority = lock->max_priority_donation;
       }
-    t->priority = max_priority;
+    thread_change_priority (t, max_priority);
     if (t->blocking_lock != NULL)
       {
-        max_lock_donation_elem = list_min (&t->blocking_lock->waiters,
-            thread_higher_priority, NULL);
         t->blocking_lock->max_priority_donation =
-          list_entry (max_lock_donation_elem, struct thread,
-                                                  lock_elem)->priority;
-        if (t->blocking_lock->holder)
+          heap_entry (heap_min (&t->blocking_lock->waiters), struct thread,
+                      lock_elem)->priority;
+        if (lock_holder (t->blocking_lock) != NULL)
           {
-            thread_recalculate_priority (t->blocking_lock->holder,
+            thread_recalculate_priority (lock_holder (t->blocking_lock),
                                          nested_depth + 1);
           }
       }
@@ -567,15 +860,6 @@ thread_recalculate_priority (struct thread* t, size_t nested_depth)
   intr_set_level (old_level);
 }
 
-/* Returns true if A has higher priority than B or false otherwise. */
-bool
-thread_higher_priority (const struct list_elem *a, const struct list_elem *b,
-                        void *aux UNUSED)
-{
-  return list_entry (a, struct thread, elem)->priority
-         > list_entry (b, struct thread, elem)->priority;
-}
-
 /* Sets the current thread's nice value to NICE. */
 void
 thread_set_nice (int nice)
@@ -624,7 +908,7 @@ static void
 idle (void *idle_started_ UNUSED)
 {
   struct semaphore *idle_started = idle_started_;
-  idle_thread = thread_current ();
+  this_cpu ()->idle_thread = thread_current ();
   sema_up (idle_started);
 
   for (;;)
@@ -633,6 +917,17 @@ idle (void *idle_started_ UNUSED)
       intr_disable ();
       thread_block ();
 
+      /* Zero free pages ahead of demand while there is nothing else
+         to do, a page at a time, so a thread woken meanwhile
+         preempts us as usual. */
+      intr_enable ();
+      while (idle_prezero ())
+        continue;
+      intr_disable ();
+      if (this_cpu ()->thread_num_ready > 0)
+        continue;
+      timer_idle_enter ();
+
       /* Re-enable interrupts and wait for the next one.
 
          The `sti' instruction disables interrupts until the
@@ -649,6 +944,18 @@ idle (void *idle_started_ UNUSED)
     }
 }
 
+/* Zeroes a free page or frame for later use by the idle thread.
+   Returns false once there is nothing left worth zeroing. */
+static bool
+idle_prezero (void)
+{
+#ifdef VM
+  if (frame_prezero ())
+    return true;
+#endif
+  return palloc_prezero ();
+}
+
 /* Function used as the basis for a kernel thread. */
 static void
 kernel_thread (thread_func *function, void *aux)
@@ -669,11 +976,23 @@ running_thread (void)
   /* Copy the CPU's stack pointer into `esp', and then round that
      down to the start of a page.  Because `struct thread' is
      always at the beginning of a page and the stack pointer is
-     somewhere in the middle, this locates the curent thread. */
+     somewhere in the middle, this locates the curent thread.
+     A thread with a stack in the kernel stack region is found at
+     the top of its slot instead. */
   asm ("mov %%esp, %0" : "=g" (esp));
+  if (kstack_contains (esp))
+    return kstack_thread (esp);
   return pg_round_down (esp);
 }
 
+/* Returns the top of T's kernel stack, where it starts out and
+   where an interrupt from user mode starts it over. */
+void *
+thread_stack_top (struct thread *t)
+{
+  return kstack_contains (t) ? (void *) t : (uint8_t *) t + PGSIZE;
+}
+
 /* Returns true if T appears to point to a valid thread. */
 static bool
 is_thread (struct thread *t)
@@ -696,19 +1015,23 @@ init_thread (struct thread *t, const char *name, int priority, int mlfqs_nice,
   memset (t, 0, sizeof *t);
   t->status = THREAD_BLOCKED;
   strlcpy (t->name, name, sizeof t->name);
-  t->stack = (uint8_t *) t + PGSIZE;
+  t->stack = thread_stack_top (t);
   t->base_priority = priority;
   t->priority = priority;
   t->mlfqs_nice = mlfqs_nice;
   t->mlfqs_recent_cpu = mlfqs_recent_cpu;
+  t->mlfqs_seconds = mlfqs_seconds;
   list_init(&t->locks_held);
 #ifdef USERPROG
+  t->process = t;
   list_init(&t->process_children);
-  list_init(&t->process_fd_table);
-  t->process_fd_next = START_FD;
+  t->process_child_exited = NULL;
+  list_init(&t->process_threads);
   list_init(&t->mmap_list);
+  list_init (&t->regions);
   t->mmap_next_id = 0;
 #endif
+  timer_setup (&t->rt_timer, rt_replenish, t);
   t->magic = THREAD_MAGIC;
   if (thread_mlfqs)
     thread_mlfqs_update_priority (t, NULL);
@@ -739,19 +1062,176 @@ alloc_frame (struct thread *t, size_t size)
 static struct thread *
 next_thread_to_run (void)
 {
-  struct list_elem *next_thread_elem;
+  struct cpu *cpu = this_cpu ();
+  int priority = ready_max_priority (cpu);
+  struct thread *t;
 
-  if (list_empty (&ready_list))
-    return idle_thread;
+  if (!list_empty (&cpu->rt_queue))
+    return list_entry (list_pop_front (&cpu->rt_queue), struct thread, elem);
+  else if (priority < PRI_MIN)
+    return cpu->idle_thread;
   else
     {
-      next_thread_elem = list_pop_min (&ready_list, thread_higher_priority,
-                                       NULL);
-      thread_num_ready--;
-      return list_entry (next_thread_elem, struct thread, elem);
+      t = list_entry (list_front (&cpu->ready_queues[priority - PRI_MIN]),
+                      struct thread, elem);
+      ready_remove (t);
+      return t;
+    }
+}
+
+/* Appends T to the ready queue of its priority, or if T is a
+   real-time thread with budget left, puts it in the real-time queue
+   by its deadline.  Must be called with interrupts off. */
+static void
+ready_push (struct thread *t)
+{
+  struct cpu *cpu = this_cpu ();
+  int p = t->priority - PRI_MIN;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  if (rt_active (t))
+    {
+      list_insert_ordered (&cpu->rt_queue, &t->elem, rt_deadline_less, NULL);
+      return;
+    }
+  list_push_back (&cpu->ready_queues[p], &t->elem);
+  cpu->ready_mask[p / 32] |= 1u << (p % 32);
+  cpu->thread_num_ready++;
+}
+
+/* Removes T from the queue ready_push() put it in.
+   Must be called with interrupts off. */
+static void
+ready_remove (struct thread *t)
+{
+  struct cpu *cpu = this_cpu ();
+  int p = t->priority - PRI_MIN;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  list_remove (&t->elem);
+  if (rt_active (t))
+    return;
+  if (list_empty (&cpu->ready_queues[p]))
+    cpu->ready_mask[p / 32] &= ~(1u << (p % 32));
+  cpu->thread_num_ready--;
+}
+
+/* Returns the highest priority of any thread ready on CPU, or
+   PRI_MIN - 1 if no thread is.  Must be called with interrupts off. */
+static int
+ready_max_priority (struct cpu *cpu)
+{
+  int i;
+
+  for (i = DIV_ROUND_UP (PRI_CNT, 32) - 1; i >= 0; i--)
+    if (cpu->ready_mask[i] != 0)
+      return PRI_MIN + i * 32 + 31 - __builtin_clz (cpu->ready_mask[i]);
+  return PRI_MIN - 1;
+}
+
+/* Returns true if a thread ready on CPU should run before T, which is
+   if T is outside the real-time class and some thread is ready in it
+   or at a higher priority, or T is in the class and another in it has
+   an earlier deadline.  Must be called with interrupts off. */
+static bool
+ready_preempts (struct cpu *cpu, struct thread *t)
+{
+  if (!list_empty (&cpu->rt_queue))
+    return (!rt_active (t)
+            || list_entry (list_front (&cpu->rt_queue), struct thread,
+                           elem)->rt_deadline < t->rt_deadline);
+  return !rt_active (t) && t->priority < ready_max_priority (cpu);
+}
+
+/* Returns true if T is a real-time thread with budget left. */
+static bool
+rt_active (const struct thread *t)
+{
+  return t->rt_period > 0 && !t->rt_throttled;
+}
+
+/* Returns the thousandths of the CPU reserved by T, rounded up. */
+static int
+rt_share_of (const struct thread *t)
+{
+  return t->rt_period > 0 ? DIV_ROUND_UP (t->rt_budget * 1000, t->rt_period)
+                          : 0;
+}
+
+/* Starts a period of real-time thread T at tick NOW, with its whole
+   budget.  T must not be in a ready queue. */
+static void
+rt_new_period (struct thread *t, int64_t now)
+{
+  t->rt_deadline = now + t->rt_period;
+  t->rt_remaining = t->rt_budget;
+}
+
+/* Takes T, if it is a real-time thread, out of the class, giving up
+   its reservation.  T must not be in a ready queue.  Must be called
+   with interrupts off. */
+static void
+rt_leave (struct thread *t)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  if (t->rt_period == 0)
+    return;
+  timer_cancel (&t->rt_timer);
+  rt_share -= rt_share_of (t);
+  t->rt_period = 0;
+  t->rt_throttled = false;
+}
+
+/* Starts the next period of real-time thread T_, throttled at its
+   deadline, moving it back into the real-time queue if it is ready. */
+static void
+rt_replenish (void *t_)
+{
+  struct thread *t = t_;
+  bool ready = t->status == THREAD_READY;
+
+  if (ready)
+    ready_remove (t);
+  t->rt_throttled = false;
+  rt_new_period (t, timer_ticks ());
+  if (ready)
+    {
+      ready_push (t);
+      thread_yield_for_priority ();
     }
 }
 
+/* Orders threads by real-time deadline, earliest first. */
+static bool
+rt_deadline_less (const struct list_elem *a_, const struct list_elem *b_,
+                  void *aux UNUSED)
+{
+  return (list_entry (a_, struct thread, elem)->rt_deadline
+          < list_entry (b_, struct thread, elem)->rt_deadline);
+}
+
+/* Sets the priority of T to PRIORITY, moving T to the matching ready
+   queue if it is ready.  Must be called with interrupts off. */
+static void
+thread_change_priority (struct thread *t, int priority)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  if (t->status == THREAD_READY && t != this_cpu ()->idle_thread
+      && t->priority != priority)
+    {
+      ready_remove (t);
+      t->priority = priority;
+      ready_push (t);
+    }
+  else if (t->status == THREAD_BLOCKED && t->priority != priority)
+    {
+      t->priority = priority;
+      synch_priority_changed (t);
+    }
+  else
+    t->priority = priority;
+}
+
 /* Completes a thread switch by activating the new thread's page
    tables, and, if the previous thread is dying, destroying it.
 
@@ -777,9 +1257,14 @@ thread_schedule_tail (struct thread *prev)
 
   /* Mark us as running. */
   cur->status = THREAD_RUNNING;
+  if (prev != NULL)
+    TRACE (TRACE_SWITCH, prev->tid, cur->tid);
 
   /* Start new time slice. */
-  thread_ticks = 0;
+  this_cpu ()->thread_ticks = 0;
+
+  /* Trap its first FPU instruction unless its state is loaded. */
+  fpu_switch (cur);
 
 #ifdef USERPROG
   /* Activate the new address space. */
@@ -790,11 +1275,71 @@ thread_schedule_tail (struct thread *prev)
      thread.  This must happen late so that thread_exit() doesn't
      pull out the rug under itself.  (We don't free
      initial_thread because its memory was not obtained via
-     palloc().) */
+     palloc().)  Its page is kept for a new thread, since freeing
+     it might have to wait for the page allocator's lock, which we
+     can't do here. */
   if (prev != NULL && prev->status == THREAD_DYING && prev != initial_thread)
     {
+      struct cpu *cpu = this_cpu ();
+
       ASSERT (prev != cur);
-      palloc_free_page (prev);
+      list_push_front (&cpu->dead_threads, &prev->allelem);
+      cpu->dead_cnt++;
+    }
+}
+
+/* Returns a page for a new thread, or a kernel stack with the
+   "-kstack" option, reusing that of a thread that died recently if
+   possible, or a null pointer if memory is not available.  Only
+   the struct thread needs clearing, which init_thread() does. */
+static struct thread *
+thread_page_get (void)
+{
+  struct thread *t = NULL;
+  enum intr_level old_level;
+  struct cpu *cpu;
+
+  thread_reap ();
+  old_level = intr_disable ();
+  cpu = this_cpu ();
+  if (!list_empty (&cpu->dead_threads))
+    {
+      t = list_entry (list_pop_front (&cpu->dead_threads), struct thread,
+                      allelem);
+      cpu->dead_cnt--;
+    }
+  intr_set_level (old_level);
+  if (t == NULL)
+    t = kstack_pages > 0 ? kstack_alloc () : palloc_get_page (0);
+  return t;
+}
+
+/* Frees the pages or kernel stacks of dead threads past the DEAD_THREADS_MAX kept on
+   this CPU, the least recently used first. */
+static void
+thread_reap (void)
+{
+  for (;;)
+    {
+      struct thread *t = NULL;
+      enum intr_level old_level;
+      struct cpu *cpu;
+
+      old_level = intr_disable ();
+      cpu = this_cpu ();
+      if (cpu->dead_cnt > DEAD_THREADS_MAX)
+        {
+          t = list_entry (list_pop_back (&cpu->dead_threads), struct thread,
+                          allelem);
+          cpu->dead_cnt--;
+        }
+      intr_set_level (old_level);
+      if (t == NULL)
+        break;
+      if (kstack_contains (t))
+        kstack_free (t);
+      else
+        palloc_free_page (t);
     }
 }
 
@@ -814,10 +1359,20 @@ schedule (void)
 
   ASSERT (intr_get_level () == INTR_OFF);
   ASSERT (cur->status != THREAD_RUNNING);
+  ASSERT (cur->rcu_depth == 0);
   ASSERT (is_thread (next));
 
+  this_cpu ()->quiescent_cnt++;
+  if (cur == this_cpu ()->idle_thread)
+    timer_idle_exit ();
   if (cur != next)
-    prev = switch_threads (cur, next);
+    {
+      uint64_t now = timer_clock ();
+
+      cur->kernel_time += now - cur->cpu_stamp;
+      next->cpu_stamp = now;
+      prev = switch_threads (cur, next);
+    }
   thread_schedule_tail (prev);
 }
 
@@ -4,8 +4,11 @@
 #include <debug.h>
 #include <list.h>
 #include <hash.h>
+#include <heap.h>
 #include <stdint.h>
 #include <fixed-point.h>
+#include <procstat.h>
+#include "devices/timer.h"
 #include "userprog/syscall.h"
 
 /* States in a thread's life cycle. */
@@ -28,7 +31,13 @@ typedef int tid_t;
 #define PRI_MAX 63                      /* Highest priority. */
 #define MAX_PRIORITY_DONATION_NESTED_DEPTH 8    /* For recursive donations. */
 
-#define START_FD 2                      /*First fd a process can use*/
+/* Thread nice values, for the MLFQS scheduler. */
+#define MLFQS_NICE_MIN -20              /* Least nice. */
+#define MLFQS_NICE_MAX 20               /* Nicest. */
+
+/* Most of the CPU, in thousandths, that real-time threads may reserve
+   between them, leaving the rest to the priority classes. */
+#define RT_SHARE_MAX 900
 
 /* A kernel thread or user process.
 
@@ -79,13 +88,18 @@ typedef int tid_t;
    an assertion failure in thread_current(), which checks that
    the `magic' member of the running thread's `struct thread' is
    set to THREAD_MAGIC.  Stack overflow will normally change this
-   value, triggering the assertion. */
-/* The `elem' member has a dual purpose.  It can be an element in
-   the run queue (thread.c), or it can be an element in a
-   semaphore wait list (synch.c).  It can be used these two ways
-   only because they are mutually exclusive: only a thread in the
-   ready state is on the run queue, whereas only a thread in the
-   blocked state is on a semaphore wait list. */
+   value, triggering the assertion.
+
+   With the "-kstack=PAGES" option, threads other than the initial
+   one are laid out the same way in the top PAGES pages of a slot
+   of their own instead (see threads/kstack.c), with the struct
+   thread at the top and the stack growing down from under it.
+   The rest of the slot is left unmapped, so an overflowing stack
+   causes a fault rather than corrupting memory. */
+/* The `elem' member is an element in the run queue (thread.c).  A
+   blocked thread is among the waiters of a semaphore (synch.c)
+   through `sema_elem' instead, in a heap ordered by priority, so
+   that it can be moved when a donation changes its priority. */
 struct thread
   {
     /* Owned by thread.c. */
@@ -97,50 +111,145 @@ struct thread
     int base_priority;                  /* Before donations priority. */
     int mlfqs_nice;                     /* Niceness value for MLFQS. */
     fp_t mlfqs_recent_cpu;              /* Recent_cpu value for MLFQS. */
+    int64_t mlfqs_seconds;              /* Seconds of decay applied to
+                                           mlfqs_recent_cpu. */
+    uint64_t cpu_stamp;                 /* timer_clock() when its time
+                                           was last accounted. */
+    uint64_t user_time;                 /* timer_clock() time spent in
+                                           user mode... */
+    uint64_t kernel_time;               /* ...and in the kernel. */
     struct list_elem allelem;           /* List element for all threads list. */
 
+    /* Real-time class, owned by thread.c.  A thread is in it if
+       RT_PERIOD is nonzero, and runs ahead of the priority classes,
+       earliest deadline first, until it spends RT_BUDGET ticks of a
+       period.  Then it is throttled, scheduled by its priority like
+       a normal thread, until RT_TIMER starts its next period. */
+    int64_t rt_period;                  /* Ticks in each period. */
+    int64_t rt_budget;                  /* Ticks it may run in one. */
+    int64_t rt_deadline;                /* Tick the current one ends. */
+    int64_t rt_remaining;               /* Ticks of budget left in it. */
+    bool rt_throttled;                  /* Budget spent? */
+    struct timer rt_timer;              /* Replenishes the budget. */
+
     /* Shared between thread.c and synch.c. */
-    struct list_elem elem;              /* List element. */
+    struct list_elem elem;              /* Ready queue element. */
     struct list locks_held;             /* List of the held locks. */
-    struct list_elem lock_elem;         /* Element in a lock waiters list. */
+    struct heap_elem lock_elem;         /* Element in a lock's waiters. */
+    unsigned lock_seq;                  /* Order of waiting for the lock. */
     struct lock *blocking_lock;         /* The lock blocking if any. */
+    struct heap_elem sema_elem;         /* Element in a semaphore's
+                                           waiters. */
+    unsigned sema_seq;                  /* Order of waiting on it. */
+    struct semaphore *waiting_sema;     /* Semaphore waited on, if any. */
+    struct heap_elem *cond_elem;        /* Element in a condition's
+                                           waiters. */
+    struct condition *waiting_cond;     /* Condition waited on, if any. */
+    int rcu_depth;                      /* Nesting of RCU read-side
+                                           critical sections. */
+    bool rcu_yield;                     /* Yield put off until the
+                                           outermost one ends? */
+
+    /* Owned by threads/fpu.c. */
+    struct fpu_state *fpu;              /* Saved FPU state, or a null
+                                           pointer if never used. */
 
 #ifdef USERPROG
     /* Owned by userprog/process.c. */
     uint32_t *pagedir;                  /* Page directory. */
+    int pagedir_batch;                  /* Nesting of pagedir batches,
+                                           owned by userprog/pagedir.c. */
+    bool pagedir_stale;                 /* TLB flush left to batch end. */
     char *process_fn;                   /* Filename in process_execute. */
     int32_t process_exit_code;          /* Exit code for process_exit. */
+    struct thread *process;             /* First thread of the process
+                                           T runs in, which holds the
+                                           state all of its threads
+                                           share below; T itself if T is
+                                           that thread. */
 
     /* Guarded by process.c/process_child_lock. */
-    struct process_child *inparent;     /* Record of T in its parent.
-                                           NULL if orphaned. */
+    struct process_child *inparent;     /* Record of T in its parent, or
+                                           in PROCESS if another thread
+                                           of it. NULL if orphaned. */
     struct list process_children;       /* List of child processes. */
+    struct condition *process_child_exited; /* Signaled when a child
+                                               exits, once there is
+                                               one. */
+    struct list process_threads;        /* Records of the other threads
+                                           of the process, not joined. */
+    int process_thread_cnt;             /* Other threads still running. */
+    struct semaphore *process_threads_done; /* Upped when the last of
+                                               them exits, if set. */
+    bool process_exiting;               /* Whether the process is being
+                                           torn down by exit(). */
 
     /* Owned by vm/page.c. */
-    struct hash page_table;             /* Supplemental page table for VM. */
+    struct page_table *page_table;      /* Supplemental page table for VM. */
     struct lock *page_table_lock;       /* Lock guarding the thread's SPT. */
 
     /* VM */
     struct list mmap_list;              /* List of process' mmap files*/
+    struct list regions;                /* Mapped regions, struct
+                                           page_region, guarded by
+                                           page_table_lock. */
     mapid_t mmap_next_id;               /* Next availabnle mmap id */
+    void *heap_start;                   /* Start of the heap, past the
+                                           executable's segments. */
+    void *heap_break;                   /* End of the heap, moved by
+                                           sbrk. */
+
+    /* Guarded by vm/frame.c's frame_table_lock. */
+    size_t resident_cnt;                /* Frames charged to the thread. */
+    size_t resident_limit;              /* Allowance of frames, 0 until
+                                           the first fault. */
+    int64_t pff_last_fault;             /* Ticks at the last page fault
+                                           needing a frame. */
+
+    /* Guarded by vm/swap.c's swap_table_lock. */
+    size_t swap_next;                   /* Next swap slot set aside for
+                                           the process's pages. */
+    size_t swap_end;                    /* End of the slots set aside. */
+
+    /* Guarded by filesys/cache.c's quota_lock. */
+    size_t cache_cnt;                   /* Cache sectors charged to the
+                                           process. */
+    uint64_t cache_hits;                /* Its cache lookups that hit. */
+    uint64_t cache_misses;              /* And those that missed. */
+
+    /* Owned by userprog/procstat.c, guarded by turning interrupts
+       off. */
+    struct procstat procstat;           /* The process's statistics. */
+    struct procstat procstat_children;  /* Totals of its exited
+                                           children's. */
 
     /* File system */
     void* exec_file;             /* The file that spawned this process*/
     void* cwd;                    /* Inherited current working directory.
                                            Initialized by filesys_init. */
-    struct list process_fd_table;       /* List of this process' file
-                                           descriptors. */
-    int process_fd_next;                /* ID to be assigned to next fd */
     /* Owened by userprog/syscall.c */
-    bool fd_table_ready;                /* Won't free up the following
-                                           resources if not ready. */
-    struct hash fd_table;               /* Open file descriptors table. */
-    int fd_next;                        /* ID to be assigned to next fd */
+    struct fd_entry *fd_table;          /* Open files, indexed by fd. */
+    int fd_cnt;                         /* Entries in FD_TABLE. */
+    struct lock *syscall_lock;          /* Serializes the system calls of
+                                           the process's threads that
+                                           change FD_TABLE, CWD, mmaps
+                                           or the heap. */
+    uint32_t syscall_args[5];           /* Number and arguments of the
+                                           running system call. */
+    void *syscall_esp;                  /* User stack pointer at it. */
+    struct syscallstat *syscall_stats;  /* Statistics of the process's
+                                           system calls, by number, or
+                                           NULL if not kept. */
+
+    /* Owned by userprog/uaccess.c. */
+    void *user_fixup;                   /* Where a fault in a user copy
+                                           resumes, if one is running. */
 #endif
 
-    int64_t wake_tick;                  /* Number of ticks left to sleep*/
-    struct semaphore *sleep_sema;       /* Semaphore to sleep and wake thread*/
-    struct list_elem slept_elem;        /* List element for slept_threads list*/
+#ifdef FILESYS
+    /* Owned by filesys/journal.c. */
+    int journal_depth;                  /* Nesting of journal handles. */
+#endif
 
     /* Owned by thread.c. */
     unsigned magic;                     /* Detects stack overflow. */
@@ -155,6 +264,10 @@ void thread_init (void);
 void thread_start (void);
 
 void thread_tick (void);
+void thread_account_idle (int64_t cnt);
+void thread_account_time (bool user);
+void thread_get_times (struct thread *, uint64_t *user_ns,
+                       uint64_t *kernel_ns);
 void thread_print_stats (void);
 
 typedef void thread_func (void *aux);
@@ -164,6 +277,7 @@ void thread_block (void);
 void thread_unblock (struct thread *);
 
 struct thread *thread_current (void);
+void *thread_stack_top (struct thread *);
 tid_t thread_tid (void);
 const char *thread_name (void);
 
@@ -171,21 +285,20 @@ void thread_exit (void) NO_RETURN;
 void thread_yield (void);
 void thread_yield_for_priority (void);
 
+/* Most CPUs the scheduler can run on. */
+#define CPU_MAX 8
+unsigned thread_cpu_id (void);
+void thread_quiescent_snapshot (uint64_t snap[CPU_MAX]);
+bool thread_quiescent_since (const uint64_t snap[CPU_MAX]);
+
 /* Performs some operation on thread t, given auxiliary data AUX. */
 typedef void thread_action_func (struct thread *t, void *aux);
 void thread_foreach (thread_action_func *, void *);
 
-void thread_add_to_slept (void);
-void thread_wake_eligible_slept (void);
 int thread_get_priority (void);
 void thread_set_priority (int);
 void thread_recalculate_priority (struct thread *, size_t);
-bool thread_higher_priority (const struct list_elem *,
-                             const struct list_elem *,
-                             void * UNUSED);
-bool thread_less_sleep_func(const struct list_elem *,
-                             const struct list_elem *,
-                             void * UNUSED);
+bool thread_set_realtime (int64_t period, int64_t budget);
 
 int thread_get_nice (void);
 void thread_set_nice (int);
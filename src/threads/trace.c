@@ -0,0 +1,136 @@
+#include "threads/trace.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <round.h>
+#include <stdio.h>
+#include "devices/timer.h"
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* Kernel tracing.
+
+   With the "-trace" option, tracepoints in hot paths record binary
+   events, stamped with the CPU's time stamp counter, into a ring of
+   the most recent TRACE_RING_SIZE events of each CPU.  Recording
+   turns interrupts off only to claim a slot, so tracepoints may be
+   hit in interrupt handlers too.  The events are read, oldest first,
+   by the trace_read system call, and whatever is left unread is
+   printed at shutdown. */
+
+/* Events kept by the ring of a CPU, a power of 2. */
+#define TRACE_RING_SIZE 2048
+
+/* Ring of the events of one CPU. */
+struct trace_ring
+  {
+    struct trace_record *records; /* TRACE_RING_SIZE records, or a null
+                                     pointer if the CPU keeps none. */
+    uint32_t head;              /* Events ever recorded. */
+    uint32_t tail;              /* Events ever read or lost. */
+    uint32_t lost_cnt;          /* Events overwritten before read. */
+  };
+
+/* If false (default), tracepoints record nothing.
+   Controlled by kernel command-line option "-trace". */
+bool trace_enabled;
+
+/* Rings, each guarded by turning interrupts off on its CPU.  Only
+   the bootstrap processor is brought up, so only its ring is
+   allocated. */
+static struct trace_ring rings[CPU_MAX];
+
+static const char *event_names[TRACE_EVENT_CNT] =
+  {
+    "switch", "fault", "evict", "cache-hit", "cache-miss",
+    "block-read", "block-write", "syscall", "syscall-ret",
+  };
+
+/* Allocates the ring of the bootstrap processor, if the "-trace"
+   option asks for tracing. */
+void
+trace_init (void)
+{
+  size_t page_cnt = DIV_ROUND_UP (TRACE_RING_SIZE
+                                  * sizeof (struct trace_record), PGSIZE);
+
+  if (!trace_enabled)
+    return;
+  rings[0].records = palloc_get_multiple (0, page_cnt);
+  if (rings[0].records == NULL)
+    {
+      printf ("trace: not enough memory, tracing disabled\n");
+      trace_enabled = false;
+    }
+}
+
+/* Records EVENT with arguments ARG0 and ARG1 in the current CPU's
+   ring, overwriting its oldest event if it is full.  Use TRACE()
+   instead, which does nothing quickly when tracing is off. */
+void
+trace_record (enum trace_event event, uint32_t arg0, uint32_t arg1)
+{
+  enum intr_level old_level = intr_disable ();
+  unsigned cpu = thread_cpu_id ();
+  struct trace_ring *ring = &rings[cpu];
+
+  if (ring->records != NULL)
+    {
+      struct trace_record *r
+        = &ring->records[ring->head++ & (TRACE_RING_SIZE - 1)];
+
+      if (ring->head - ring->tail > TRACE_RING_SIZE)
+        {
+          ring->tail++;
+          ring->lost_cnt++;
+        }
+      r->tsc = timer_tsc ();
+      r->event = event;
+      r->cpu = cpu;
+      r->tid = thread_current ()->tid;
+      r->arg0 = arg0;
+      r->arg1 = arg1;
+    }
+  intr_set_level (old_level);
+}
+
+/* Moves up to CNT of the oldest events not read yet into RECORDS,
+   one CPU's after another's.  Returns the number moved. */
+size_t
+trace_get (struct trace_record *records, size_t cnt)
+{
+  size_t got = 0;
+  size_t i;
+
+  for (i = 0; i < CPU_MAX && got < cnt; i++)
+    {
+      struct trace_ring *ring = &rings[i];
+      enum intr_level old_level = intr_disable ();
+
+      if (ring->records != NULL)
+        for (; got < cnt && ring->tail != ring->head; ring->tail++)
+          records[got++] = ring->records[ring->tail & (TRACE_RING_SIZE - 1)];
+      intr_set_level (old_level);
+    }
+  return got;
+}
+
+/* Prints the events not read yet. */
+void
+trace_dump (void)
+{
+  struct trace_record r;
+  uint32_t lost_cnt = 0;
+  size_t i;
+
+  if (!trace_enabled)
+    return;
+  for (i = 0; i < CPU_MAX; i++)
+    lost_cnt += rings[i].lost_cnt;
+  printf ("Trace: %"PRIu32" events lost\n", lost_cnt);
+  while (trace_get (&r, 1) == 1)
+    printf ("%20"PRIu64" cpu%"PRIu16" tid %5"PRId32" %-11s %08"PRIx32
+            " %08"PRIx32"\n", r.tsc, r.cpu, r.tid, event_names[r.event],
+            r.arg0, r.arg1);
+}
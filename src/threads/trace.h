@@ -0,0 +1,28 @@
+#ifndef THREADS_TRACE_H
+#define THREADS_TRACE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <trace.h>
+
+/* Set by the "-trace" kernel command-line option. */
+extern bool trace_enabled;
+
+/* Records EVENT with arguments ARG0 and ARG1 if tracing is on.
+   Costs a single branch, predicted not taken, when it is off. */
+#define TRACE(EVENT, ARG0, ARG1)                                \
+        do                                                      \
+          {                                                     \
+            if (__builtin_expect (trace_enabled, 0))            \
+              trace_record ((EVENT), (uint32_t) (ARG0),         \
+                            (uint32_t) (ARG1));                 \
+          }                                                     \
+        while (0)
+
+void trace_init (void);
+void trace_record (enum trace_event, uint32_t arg0, uint32_t arg1);
+size_t trace_get (struct trace_record *, size_t cnt);
+void trace_dump (void);
+
+#endif /* threads/trace.h */
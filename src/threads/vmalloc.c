@@ -0,0 +1,167 @@
+#include "threads/vmalloc.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <round.h>
+#include <string.h>
+#include "threads/loader.h"
+#include "threads/palloc.h"
+#include "threads/pte.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Large allocations that need not be physically contiguous.
+
+   malloc() takes a block bigger than half a page straight from
+   palloc_get_multiple(), which needs a run of free pages that gets
+   harder to find as memory fragments.  vmalloc() instead takes
+   pages one at a time, wherever they are, and maps them in a row
+   into a region of kernel virtual memory of its own.  Its memory
+   suits tables the CPU alone uses, but not buffers handed to
+   devices, which need vtop() and so the direct mapping.
+
+   Each allocation is followed in the region by an unmapped guard
+   page, which catches running off its end and tells vfree() where
+   it stops.  As for kernel stacks (see threads/kstack.c), the page
+   tables of the region are made once, in the initial page
+   directory, so every process's page directory shares them. */
+
+/* Page tables of the region, one per 4 MB of it. */
+static uint32_t *page_tables[(VMALLOC_END - VMALLOC_BASE) / PTSPAN];
+
+/* Pages of the region in use, guard pages included. */
+static struct bitmap *used_pages;
+static struct lock vmalloc_lock;
+
+static uint32_t *lookup_pte (const void *vaddr);
+static void unmap_pages (uint8_t *start, size_t page_cnt);
+
+/* Sets up the vmalloc() region in initial page directory PD. */
+void
+vmalloc_init (uint32_t *pd)
+{
+  size_t i;
+
+  ASSERT ((uintptr_t) ptov (init_ram_pages * PGSIZE) <= VMALLOC_BASE);
+
+  lock_init (&vmalloc_lock);
+  used_pages = bitmap_create ((VMALLOC_END - VMALLOC_BASE) / PGSIZE);
+  if (used_pages == NULL)
+    PANIC ("can't set up vmalloc");
+
+  for (i = 0; i < sizeof page_tables / sizeof *page_tables; i++)
+    {
+      page_tables[i] = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+      pd[pd_no ((void *) (VMALLOC_BASE + i * PTSPAN))]
+        = pde_create (page_tables[i]);
+    }
+}
+
+/* Returns the page table entry for VADDR in the region. */
+static uint32_t *
+lookup_pte (const void *vaddr)
+{
+  size_t pt_idx = ((uintptr_t) vaddr - VMALLOC_BASE) / PTSPAN;
+
+  ASSERT (vmalloc_contains (vaddr));
+  return &page_tables[pt_idx][pt_no (vaddr)];
+}
+
+/* Unmaps and frees the PAGE_CNT pages from START. */
+static void
+unmap_pages (uint8_t *start, size_t page_cnt)
+{
+  size_t i;
+
+  for (i = 0; i < page_cnt; i++)
+    {
+      uint8_t *vaddr = start + i * PGSIZE;
+      uint32_t *pte = lookup_pte (vaddr);
+      void *page = pte_get_page (*pte);
+
+      *pte = 0;
+      asm volatile ("invlpg (%0)" : : "r" (vaddr) : "memory");
+      palloc_free_page (page);
+    }
+}
+
+/* Obtains and returns a new block of at least SIZE bytes, page
+   aligned, made of pages that need not be physically contiguous.
+   Returns a null pointer if memory or room in the region is not
+   available, or if SIZE is 0. */
+void *
+vmalloc (size_t size)
+{
+  size_t page_cnt = DIV_ROUND_UP (size, PGSIZE);
+  size_t first;
+  uint8_t *start;
+  size_t i;
+
+  if (page_cnt == 0 || page_cnt >= (VMALLOC_END - VMALLOC_BASE) / PGSIZE)
+    return NULL;
+
+  lock_acquire (&vmalloc_lock);
+  first = bitmap_scan_and_flip (used_pages, 0, page_cnt + 1, false);
+  lock_release (&vmalloc_lock);
+  if (first == BITMAP_ERROR)
+    return NULL;
+
+  start = (uint8_t *) VMALLOC_BASE + first * PGSIZE;
+  for (i = 0; i < page_cnt; i++)
+    {
+      void *page = palloc_get_page (0);
+      if (page == NULL)
+        {
+          unmap_pages (start, i);
+          lock_acquire (&vmalloc_lock);
+          bitmap_set_multiple (used_pages, first, page_cnt + 1, false);
+          lock_release (&vmalloc_lock);
+          return NULL;
+        }
+      *lookup_pte (start + i * PGSIZE) = pte_create_kernel (page, true);
+    }
+  return start;
+}
+
+/* Allocates and returns A times B bytes initialized to zeroes, like
+   vmalloc().  Returns a null pointer if memory is not available. */
+void *
+vcalloc (size_t a, size_t b)
+{
+  void *p;
+  size_t size;
+
+  /* Calculate block size and make sure it fits in size_t. */
+  size = a * b;
+  if (size < a || size < b)
+    return NULL;
+
+  p = vmalloc (size);
+  if (p != NULL)
+    memset (p, 0, size);
+  return p;
+}
+
+/* Frees block P, which must have been previously allocated with
+   vmalloc() or vcalloc().  P may be a null pointer. */
+void
+vfree (void *p)
+{
+  uint8_t *start = p;
+  size_t page_cnt;
+
+  if (p == NULL)
+    return;
+  ASSERT (vmalloc_contains (p) && pg_ofs (p) == 0);
+
+  /* The block runs up to its guard page, the first one unmapped. */
+  for (page_cnt = 0; *lookup_pte (start + page_cnt * PGSIZE) & PTE_P;
+       page_cnt++)
+    continue;
+  ASSERT (page_cnt > 0);
+
+  unmap_pages (start, page_cnt);
+  lock_acquire (&vmalloc_lock);
+  bitmap_set_multiple (used_pages, (start - (uint8_t *) VMALLOC_BASE) / PGSIZE,
+                       page_cnt + 1, false);
+  lock_release (&vmalloc_lock);
+}
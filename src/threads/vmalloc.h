@@ -0,0 +1,25 @@
+#ifndef THREADS_VMALLOC_H
+#define THREADS_VMALLOC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Kernel virtual region that vmalloc() maps pages into, right above
+   the kernel stack region. */
+#define VMALLOC_BASE ((uintptr_t) 0xf4000000)
+#define VMALLOC_END ((uintptr_t) 0xf8000000)
+
+void vmalloc_init (uint32_t *pd);
+void *vmalloc (size_t size);
+void *vcalloc (size_t a, size_t b);
+void vfree (void *);
+
+/* Returns true if VADDR is in the vmalloc() region. */
+static inline bool
+vmalloc_contains (const void *vaddr)
+{
+  return (uintptr_t) vaddr >= VMALLOC_BASE && (uintptr_t) vaddr < VMALLOC_END;
+}
+
+#endif /* threads/vmalloc.h */
@@ -0,0 +1,165 @@
+#include "threads/workqueue.h"
+#include <debug.h>
+#include <stdio.h>
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Kernel workqueue.
+
+   Background jobs, such as writing dirty cache sectors behind or
+   paging out frames ahead of demand, are queued as struct work to
+   be run by a small pool of worker threads instead of each having
+   a thread of its own that sleeps most of the time.  Work of a
+   higher priority runs first, and work of the same priority in the
+   order it was queued.  Work may be queued from interrupt handlers,
+   and after a delay through a kernel timer.
+
+   A piece of work is queued at most once at a time.  Once a worker
+   has taken it off the queue it may be queued again, even by its
+   own function, so the same work can run on two workers at once if
+   it is queued again before its function returns. */
+
+/* Queued work, in descending order of priority, guarded by
+   QUEUE_LOCK since work is queued from interrupt handlers. */
+static struct list queue;
+static struct spinlock queue_lock;
+
+/* Upped once for each piece of work queued. */
+static struct semaphore queue_cnt;
+
+static thread_func worker;
+static timer_func work_timeout;
+static list_less_func work_more;
+
+/* Starts the worker threads. Must be called after thread_start(). */
+void
+workqueue_init (void)
+{
+  int i;
+
+  list_init (&queue);
+  spinlock_init (&queue_lock);
+  sema_init (&queue_cnt, 0);
+  for (i = 0; i < WORKQUEUE_WORKERS; i++)
+    {
+      char name[16];
+
+      snprintf (name, sizeof name, "worker-%d", i);
+      if (thread_create (name, PRI_DEFAULT, worker, NULL) == TID_ERROR)
+        PANIC ("Couldn't start the workqueue!");
+    }
+}
+
+/* Initializes WORK to run FUNC with AUX at PRIORITY, one of the
+   WORK_PRI_* values. WORK is not queued. */
+void
+work_init (struct work *work, work_func *func, void *aux, int priority)
+{
+  ASSERT (work != NULL);
+  ASSERT (priority >= WORK_PRI_LOW && priority <= WORK_PRI_HIGH);
+
+  work->func = func;
+  work->aux = aux;
+  work->priority = priority;
+  work->queued = false;
+  timer_setup (&work->timer, work_timeout, work);
+}
+
+/* Queues WORK to be run by a worker thread as soon as one is free,
+   putting forward the run if it was queued with a delay. Returns
+   false if WORK was queued already. May be called from an interrupt
+   handler. */
+bool
+work_queue (struct work *work)
+{
+  bool queued;
+
+  timer_cancel (&work->timer);
+  spinlock_acquire (&queue_lock);
+  queued = !work->queued;
+  if (queued)
+    {
+      work->queued = true;
+      list_insert_ordered (&queue, &work->elem, work_more, NULL);
+    }
+  spinlock_release (&queue_lock);
+  if (queued)
+    sema_up (&queue_cnt);
+  return queued;
+}
+
+/* Queues WORK to be run once TICKS timer ticks have passed. Returns
+   false, leaving WORK to run when it would have, if it is queued or
+   waiting to be already. */
+bool
+work_queue_delayed (struct work *work, int64_t ticks)
+{
+  bool waiting;
+
+  /* Arming under QUEUE_LOCK keeps two callers from both arming. */
+  spinlock_acquire (&queue_lock);
+  waiting = work->queued || work->timer.pending;
+  if (!waiting)
+    timer_arm (&work->timer, ticks);
+  spinlock_release (&queue_lock);
+  return !waiting;
+}
+
+/* Takes WORK off the queue, or stops its delay, so that it doesn't
+   run. Returns true if it was waiting to run, false if it wasn't
+   queued or a worker has started it already. */
+bool
+work_cancel (struct work *work)
+{
+  bool cancelled = timer_cancel (&work->timer);
+
+  spinlock_acquire (&queue_lock);
+  if (work->queued)
+    {
+      list_remove (&work->elem);
+      work->queued = false;
+      cancelled = true;
+      /* The worker that downs QUEUE_CNT for it finds nothing. */
+    }
+  spinlock_release (&queue_lock);
+  return cancelled;
+}
+
+/* Queues the work AUX, whose delay is up. */
+static void
+work_timeout (void *work)
+{
+  work_queue (work);
+}
+
+/* Worker thread, which runs the queued work in turn. */
+static void
+worker (void *aux UNUSED)
+{
+  for (;;)
+    {
+      struct work *work = NULL;
+
+      sema_down (&queue_cnt);
+      spinlock_acquire (&queue_lock);
+      if (!list_empty (&queue))
+        {
+          work = list_entry (list_pop_front (&queue), struct work, elem);
+          work->queued = false;
+        }
+      spinlock_release (&queue_lock);
+      if (work != NULL)
+        work->func (work->aux);
+    }
+}
+
+/* Orders work by descending priority. Work that compares equal keeps
+   the order it was queued in. */
+static bool
+work_more (const struct list_elem *a_, const struct list_elem *b_,
+           void *aux UNUSED)
+{
+  const struct work *a = list_entry (a_, struct work, elem);
+  const struct work *b = list_entry (b_, struct work, elem);
+  return a->priority > b->priority;
+}
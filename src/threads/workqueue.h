@@ -0,0 +1,38 @@
+#ifndef THREADS_WORKQUEUE_H
+#define THREADS_WORKQUEUE_H
+
+#include <list.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "devices/timer.h"
+
+/* Number of kernel threads that run queued work. */
+#define WORKQUEUE_WORKERS 2
+
+/* Priorities of work, higher running first. */
+#define WORK_PRI_LOW 0
+#define WORK_PRI_DEFAULT 1
+#define WORK_PRI_HIGH 2
+
+/* Function run by a worker thread for a piece of work. It may sleep,
+   but holds up the other work queued behind it while it does. */
+typedef void work_func (void *aux);
+
+/* A piece of background work, owned by whoever queues it. */
+struct work
+  {
+    struct list_elem elem;      /* Element in the queue. */
+    work_func *func;            /* Function to run. */
+    void *aux;                  /* Auxiliary data for FUNC. */
+    int priority;               /* One of the WORK_PRI_* values. */
+    bool queued;                /* Queued and not started yet? */
+    struct timer timer;         /* Queues the work when delayed. */
+  };
+
+void workqueue_init (void);
+void work_init (struct work *, work_func *, void *aux, int priority);
+bool work_queue (struct work *);
+bool work_queue_delayed (struct work *, int64_t ticks);
+bool work_cancel (struct work *);
+
+#endif /* threads/workqueue.h */
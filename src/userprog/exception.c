@@ -2,7 +2,9 @@
 #include <inttypes.h>
 #include <stdio.h>
 #include "userprog/gdt.h"
+#include "userprog/process.h"
 #include "threads/interrupt.h"
+#include "threads/kstack.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
 #include "vm/page.h"
@@ -48,8 +50,6 @@ exception_init (void)
   intr_register_int (0, 0, INTR_ON, kill, "#DE Divide Error");
   intr_register_int (1, 0, INTR_ON, kill, "#DB Debug Exception");
   intr_register_int (6, 0, INTR_ON, kill, "#UD Invalid Opcode Exception");
-  intr_register_int (7, 0, INTR_ON, kill,
-                     "#NM Device Not Available Exception");
   intr_register_int (11, 0, INTR_ON, kill, "#NP Segment Not Present");
   intr_register_int (12, 0, INTR_ON, kill, "#SS Stack Fault Exception");
   intr_register_int (13, 0, INTR_ON, kill, "#GP General Protection Exception");
@@ -61,6 +61,12 @@ exception_init (void)
      We need to disable interrupts for page faults because the
      fault address is stored in CR2 and needs to be preserved. */
   intr_register_int (14, 0, INTR_OFF, page_fault, "#PF Page-Fault Exception");
+
+  /* A kernel stack that overflows into its guard page faults
+     again delivering the page fault, so report double faults on
+     a stack of their own. */
+  if (kstack_pages > 0)
+    intr_register_task (8, SEL_DF_TSS, "#DF Double Fault Exception");
 }
 
 /* Prints exception statistics. */
@@ -92,8 +98,7 @@ kill (struct intr_frame *f)
       printf ("%s: dying due to interrupt %#04x (%s).\n",
               thread_name (), f->vec_no, intr_name (f->vec_no));
       intr_dump_frame (f);
-      thread_current()->process_exit_code = -1;
-      thread_exit ();
+      process_terminate (-1);
 
     case SEL_KCSEG:
       /* Kernel's code segment, which indicates a kernel bug.
@@ -127,6 +132,9 @@ static void
 page_fault (struct intr_frame *f)
 {
   void *fault_addr;  /* Fault address. */
+  struct thread *t;  /* Faulting thread. */
+  bool user;         /* True: access by user, false: by kernel. */
+  void *esp;         /* User stack pointer. */
 
   /* Obtain faulting address, the virtual address that was
      accessed to cause the fault.  It may point to code or to
@@ -144,14 +152,34 @@ page_fault (struct intr_frame *f)
   /* Count page faults. */
   page_fault_cnt++;
 
+  /* A fault in the kernel on a user address comes from a copy in
+     userprog/uaccess.c, which F->esp says nothing about: the user's
+     stack pointer is the one saved at the system call. */
+  t = thread_current ();
+  user = (f->error_code & PF_U) != 0;
+  esp = user ? f->esp : t->syscall_esp;
+
   /* For the case where the pagefault resulted from stack growth. */
   if (is_user_vaddr (fault_addr)
-      && (uint8_t *)(fault_addr) >= (uint8_t *)(f->esp) - 32
+      && (uint8_t *)(fault_addr) >= (uint8_t *)(esp) - 32
       && fault_addr >= STACK_LIMIT)
-    page_alloc (fault_addr);
+    page_grow_stack (fault_addr);
+
+  /* A user copy that faults on memory the process doesn't have
+     fails instead of killing it. */
+  if (!user && t->user_fixup != NULL)
+    {
+      if (!is_user_vaddr (fault_addr)
+          || !page_resolve_fault (fault_addr, (f->error_code & PF_W) != 0))
+        {
+          f->eip = t->user_fixup;
+          t->user_fixup = NULL;
+        }
+      return;
+    }
 
   /* Attempt to resolve pagefault with VM or kill otherwise. */
-  if (!page_resolve_fault (fault_addr))
+  if (!page_resolve_fault (fault_addr, (f->error_code & PF_W) != 0))
     kill (f);
 }
 
@@ -0,0 +1,169 @@
+#include "userprog/futex.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <stdint.h>
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "userprog/process.h"
+#include "userprog/uaccess.h"
+
+/* Futexes, the wait queues behind synchronization in user programs.
+
+   A user program keeps the state of its locks and condition
+   variables in plain words of its own memory, which it changes with
+   atomic instructions, and only calls into the kernel to sleep when
+   it must wait and to wake up whoever sleeps.  A word is known by
+   its address space, that is its page directory, and its user
+   virtual address.  Sleepers on every word are kept in a fixed table
+   of buckets by the hash of that, each with a lock of its own, so
+   nothing is allocated for a word and words in different buckets
+   never contend. */
+
+/* Number of buckets. */
+#define FUTEX_BUCKET_CNT 64
+
+/* Sleepers on the words that hash to one bucket. */
+struct futex_bucket
+  {
+    struct lock lock;           /* Guards WAITERS. */
+    struct list waiters;        /* struct futex_waiter, oldest first. */
+  };
+
+/* A thread sleeping on a word, on its stack. */
+struct futex_waiter
+  {
+    struct list_elem elem;      /* In its bucket's WAITERS. */
+    uint32_t *pd;               /* Address space of the word. */
+    const int *uaddr;           /* User address of the word. */
+    struct semaphore sema;      /* Upped to wake the thread. */
+  };
+
+static struct futex_bucket buckets[FUTEX_BUCKET_CNT];
+
+static struct futex_bucket *futex_bucket (uint32_t *pd, const int *uaddr);
+
+/* Initializes the buckets. */
+void
+futex_init (void)
+{
+  size_t i;
+
+  for (i = 0; i < FUTEX_BUCKET_CNT; i++)
+    {
+      lock_init (&buckets[i].lock);
+      list_init (&buckets[i].waiters);
+    }
+}
+
+/* Returns the bucket of the word at UADDR in address space PD. */
+static struct futex_bucket *
+futex_bucket (uint32_t *pd, const int *uaddr)
+{
+  uintptr_t key[2];
+
+  key[0] = (uintptr_t) pd;
+  key[1] = (uintptr_t) uaddr;
+  return &buckets[hash_bytes (key, sizeof key) % FUTEX_BUCKET_CNT];
+}
+
+/* Puts the current thread to sleep on the word at UADDR, which must
+   be aligned, if it holds VAL, until futex_wake() wakes it up.
+   The word is read under the lock that futex_wake() takes, so one
+   who changes it before waking sleepers can't miss the current
+   thread.  Reading it may fault it in meanwhile, which only holds up
+   the words of the same bucket. */
+enum futex_status
+futex_wait (const int *uaddr, int val)
+{
+  struct futex_waiter w;
+  struct futex_bucket *b;
+  int cur;
+
+  if ((uintptr_t) uaddr % sizeof *uaddr != 0)
+    return FUTEX_FAULT;
+  w.pd = thread_current ()->pagedir;
+  w.uaddr = uaddr;
+  b = futex_bucket (w.pd, uaddr);
+
+  lock_acquire (&b->lock);
+  /* A process being terminated has its sleepers woken up for good. */
+  if (process_is_exiting ())
+    {
+      lock_release (&b->lock);
+      return FUTEX_WOKEN;
+    }
+  if (!copy_from_user (&cur, uaddr, sizeof cur))
+    {
+      lock_release (&b->lock);
+      return FUTEX_FAULT;
+    }
+  if (cur != val)
+    {
+      lock_release (&b->lock);
+      return FUTEX_CHANGED;
+    }
+  sema_init (&w.sema, 0);
+  list_push_back (&b->waiters, &w.elem);
+  lock_release (&b->lock);
+
+  sema_down (&w.sema);
+  return FUTEX_WOKEN;
+}
+
+/* Wakes up to CNT of the threads sleeping on the word at UADDR in
+   the current thread's address space, those that slept the longest
+   first, and returns how many it woke. */
+size_t
+futex_wake (const int *uaddr, size_t cnt)
+{
+  uint32_t *pd = thread_current ()->pagedir;
+  struct futex_bucket *b = futex_bucket (pd, uaddr);
+  struct list_elem *e;
+  size_t woken = 0;
+
+  lock_acquire (&b->lock);
+  for (e = list_begin (&b->waiters);
+       woken < cnt && e != list_end (&b->waiters); )
+    {
+      struct futex_waiter *w = list_entry (e, struct futex_waiter, elem);
+
+      e = list_next (e);
+      if (w->pd == pd && w->uaddr == uaddr)
+        {
+          list_remove (&w->elem);
+          sema_up (&w->sema);
+          woken++;
+        }
+    }
+  lock_release (&b->lock);
+  return woken;
+}
+
+/* Wakes up all of the threads sleeping on any word in address space
+   PD, for their process to exit. */
+void
+futex_wake_process (uint32_t *pd)
+{
+  size_t i;
+
+  for (i = 0; i < FUTEX_BUCKET_CNT; i++)
+    {
+      struct futex_bucket *b = &buckets[i];
+      struct list_elem *e;
+
+      lock_acquire (&b->lock);
+      for (e = list_begin (&b->waiters); e != list_end (&b->waiters); )
+        {
+          struct futex_waiter *w = list_entry (e, struct futex_waiter, elem);
+
+          e = list_next (e);
+          if (w->pd == pd)
+            {
+              list_remove (&w->elem);
+              sema_up (&w->sema);
+            }
+        }
+      lock_release (&b->lock);
+    }
+}
@@ -0,0 +1,20 @@
+#ifndef USERPROG_FUTEX_H
+#define USERPROG_FUTEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Outcomes of futex_wait(). */
+enum futex_status
+  {
+    FUTEX_WOKEN,                /* Slept until woken. */
+    FUTEX_CHANGED,              /* The word didn't hold the value. */
+    FUTEX_FAULT                 /* The word can't be read. */
+  };
+
+void futex_init (void);
+enum futex_status futex_wait (const int *uaddr, int val);
+size_t futex_wake (const int *uaddr, size_t cnt);
+void futex_wake_process (uint32_t *pd);
+
+#endif /* userprog/futex.h */
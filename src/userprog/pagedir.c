@@ -5,9 +5,10 @@
 #include "threads/init.h"
 #include "threads/pte.h"
 #include "threads/palloc.h"
+#include "threads/thread.h"
 
 static uint32_t *active_pd (void);
-static void invalidate_pagedir (uint32_t *);
+static void invalidate_page (uint32_t *, const void *);
 
 /* Creates a new page directory that has mappings for kernel
    virtual addresses, but none for user virtual addresses.
@@ -18,7 +19,7 @@ pagedir_create (void)
 {
   uint32_t *pd = palloc_get_page (0);
   if (pd != NULL)
-    memcpy (pd, init_page_dir, PGSIZE);
+    palloc_copy_page (pd, init_page_dir);
   return pd;
 }
 
@@ -152,7 +153,7 @@ pagedir_clear_page (uint32_t *pd, void *upage)
   if (pte != NULL && (*pte & PTE_P) != 0)
     {
       *pte &= ~PTE_P;
-      invalidate_pagedir (pd);
+      invalidate_page (pd, upage);
     }
 }
 
@@ -180,7 +181,7 @@ pagedir_set_dirty (uint32_t *pd, const void *vpage, bool dirty)
       else
         {
           *pte &= ~(uint32_t) PTE_D;
-          invalidate_pagedir (pd);
+          invalidate_page (pd, vpage);
         }
     }
 }
@@ -209,7 +210,7 @@ pagedir_set_accessed (uint32_t *pd, const void *vpage, bool accessed)
       else
         {
           *pte &= ~(uint32_t) PTE_A;
-          invalidate_pagedir (pd);
+          invalidate_page (pd, vpage);
         }
     }
 }
@@ -227,7 +228,7 @@ pagedir_set_writable (uint32_t *pd, const void *vpage, bool writable)
       else
         {
           *pte &= ~(uint32_t) PTE_W;
-          invalidate_pagedir (pd);
+          invalidate_page (pd, vpage);
         }
     }
 }
@@ -248,6 +249,32 @@ pagedir_activate (uint32_t *pd)
   asm volatile ("movl %0, %%cr3" : : "r" (vtop (pd)) : "memory");
 }
 
+/* Starts a batch of PTE changes in the current thread's page
+   directory, during which the TLB isn't invalidated page by page.
+   Batches nest, and the TLB is flushed once at the end of the
+   outermost one if any change needed it. The caller must not access
+   the user pages it changes until then. */
+void
+pagedir_batch_begin (void)
+{
+  thread_current ()->pagedir_batch++;
+}
+
+/* Ends a batch started by pagedir_batch_begin(). */
+void
+pagedir_batch_end (void)
+{
+  struct thread *t = thread_current ();
+
+  ASSERT (t->pagedir_batch > 0);
+  if (--t->pagedir_batch == 0 && t->pagedir_stale)
+    {
+      t->pagedir_stale = false;
+      if (active_pd () == t->pagedir)
+        pagedir_activate (t->pagedir);
+    }
+}
+
 /* Returns the currently active page directory. */
 static uint32_t *
 active_pd (void)
@@ -261,21 +288,28 @@ active_pd (void)
   return ptov (pd);
 }
 
-/* Seom page table changes can cause the CPU's translation
+/* Some page table changes can cause the CPU's translation
    lookaside buffer (TLB) to become out-of-sync with the page
-   table.  When this happens, we have to "invalidate" the TLB by
-   re-activating it.
-
-   This function invalidates the TLB if PD is the active page
-   directory.  (If PD is not active then its entries are not in
-   the TLB, so there is no need to invalidate anything.) */
+   table.  When this happens, we have to "invalidate" the TLB
+   entry for the page that changed.
+
+   This function invalidates the TLB entry for VPAGE if PD is the
+   active page directory.  (If PD is not active then its entries
+   are not in the TLB, so there is no need to invalidate
+   anything.)  Inside a batch the invalidation is left for
+   pagedir_batch_end() to do all at once. */
 static void
-invalidate_pagedir (uint32_t *pd)
+invalidate_page (uint32_t *pd, const void *vpage)
 {
   if (active_pd () == pd)
     {
-      /* Re-activating PD clears the TLB.  See [IA32-v3a] 3.12
-         "Translation Lookaside Buffers (TLBs)". */
-      pagedir_activate (pd);
+      struct thread *t = thread_current ();
+
+      if (t->pagedir_batch > 0 && t->pagedir == pd)
+        t->pagedir_stale = true;
+      else
+        /* See [IA32-v3a] 3.12 "Translation Lookaside Buffers
+           (TLBs)". */
+        asm volatile ("invlpg (%0)" : : "r" (vpage) : "memory");
     }
 }
@@ -15,6 +15,8 @@ bool pagedir_is_accessed (uint32_t *pd, const void *upage);
 void pagedir_set_accessed (uint32_t *pd, const void *upage, bool accessed);
 void pagedir_set_writable (uint32_t *pd, const void *upage, bool writable);
 void pagedir_activate (uint32_t *pd);
+void pagedir_batch_begin (void);
+void pagedir_batch_end (void);
 
 
 #endif /* userprog/pagedir.h */
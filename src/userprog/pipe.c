@@ -0,0 +1,283 @@
+#include "userprog/pipe.h"
+#include <debug.h>
+#include <poll.h>
+#include <stdint.h>
+#include <string.h>
+#include <uio.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/poll.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* A pipe: a ring buffer in the kernel with one end for reading and
+   one for writing, each of which any number of file descriptors can
+   share.  Readers block while it is empty and writers while it is
+   full.  Reading an empty pipe with no writers left returns end of
+   file, and writing one with no readers left fails.
+
+   A big write can skip the ring: the writer publishes the kernel
+   addresses of its data with pipe_write_direct() and waits while
+   readers copy straight out of them, so the data is copied once
+   instead of twice.  The ring is empty throughout, which keeps the
+   bytes in order. */
+struct pipe
+  {
+    struct lock lock;           /* Guards the members below. */
+    struct condition not_empty; /* Signaled when data arrives or the
+                                   last writer leaves. */
+    struct condition not_full;  /* Signaled when room frees up or the
+                                   last reader leaves. */
+    struct poll_queue pollers;  /* Woken on either signal. */
+    uint8_t *buffer;            /* PIPE_SIZE bytes of ring. */
+    size_t head;                /* Bytes ever read. */
+    size_t tail;                /* Bytes ever written. */
+    struct iovec *direct;       /* Direct write's data left, or null. */
+    size_t direct_cnt;          /* Elements left in DIRECT. */
+    size_t direct_done;         /* Bytes of the direct write read. */
+    int reader_cnt;             /* Open read ends. */
+    int writer_cnt;             /* Open write ends. */
+  };
+
+/* The ring must fit in the page that holds it. */
+#if PIPE_SIZE > PGSIZE
+#error PIPE_SIZE is more than a page
+#endif
+
+/* Drops the buffers at the start of P's direct write that have been
+   read, clearing it once all have. */
+static void
+skip_direct (struct pipe *p)
+{
+  while (p->direct != NULL && p->direct->iov_len == 0)
+    p->direct = --p->direct_cnt > 0 ? p->direct + 1 : NULL;
+}
+
+/* Creates a pipe with one read end and one write end open.  Returns
+   a null pointer if memory is not available. */
+struct pipe *
+pipe_create (void)
+{
+  struct pipe *p = malloc (sizeof *p);
+
+  if (p == NULL)
+    return NULL;
+  p->buffer = palloc_get_page (0);
+  if (p->buffer == NULL)
+    {
+      free (p);
+      return NULL;
+    }
+  lock_init (&p->lock);
+  cond_init (&p->not_empty);
+  cond_init (&p->not_full);
+  poll_queue_init (&p->pollers);
+  p->head = p->tail = 0;
+  p->direct = NULL;
+  p->direct_cnt = p->direct_done = 0;
+  p->reader_cnt = p->writer_cnt = 1;
+  return p;
+}
+
+/* Opens another write end of P if WRITER, or else a read end. */
+void
+pipe_reopen (struct pipe *p, bool writer)
+{
+  lock_acquire (&p->lock);
+  if (writer)
+    p->writer_cnt++;
+  else
+    p->reader_cnt++;
+  lock_release (&p->lock);
+}
+
+/* Closes a write end of P if WRITER, or else a read end, waking
+   whoever waits on the other end if it was the last.  Frees P once
+   no end is open. */
+void
+pipe_close (struct pipe *p, bool writer)
+{
+  bool last;
+
+  lock_acquire (&p->lock);
+  if (writer)
+    {
+      ASSERT (p->writer_cnt > 0);
+      if (--p->writer_cnt == 0)
+        {
+          cond_broadcast (&p->not_empty, &p->lock);
+          poll_wake (&p->pollers);
+        }
+    }
+  else
+    {
+      ASSERT (p->reader_cnt > 0);
+      if (--p->reader_cnt == 0)
+        {
+          cond_broadcast (&p->not_full, &p->lock);
+          poll_wake (&p->pollers);
+        }
+    }
+  last = p->reader_cnt == 0 && p->writer_cnt == 0;
+  lock_release (&p->lock);
+
+  if (last)
+    {
+      palloc_free_page (p->buffer);
+      free (p);
+    }
+}
+
+/* Reads up to SIZE bytes from P into BUFFER, waiting until there is
+   at least one unless no writer is left.  Returns the number of
+   bytes read, 0 only at end of file or if SIZE is 0. */
+size_t
+pipe_read (struct pipe *p, void *buffer_, size_t size)
+{
+  uint8_t *buffer = buffer_;
+  size_t bytes_read = 0;
+
+  if (size == 0)
+    return 0;
+
+  lock_acquire (&p->lock);
+  while (p->head == p->tail && p->direct == NULL && p->writer_cnt > 0)
+    cond_wait (&p->not_empty, &p->lock);
+  while (bytes_read < size && p->head != p->tail)
+    {
+      size_t ofs = p->head % PIPE_SIZE;
+      size_t chunk = PIPE_SIZE - ofs;
+
+      if (chunk > p->tail - p->head)
+        chunk = p->tail - p->head;
+      if (chunk > size - bytes_read)
+        chunk = size - bytes_read;
+      memcpy (buffer + bytes_read, p->buffer + ofs, chunk);
+      p->head += chunk;
+      bytes_read += chunk;
+    }
+  while (bytes_read < size && p->direct != NULL)
+    {
+      struct iovec *iov = p->direct;
+      size_t chunk = iov->iov_len;
+
+      if (chunk > size - bytes_read)
+        chunk = size - bytes_read;
+      memcpy (buffer + bytes_read, iov->iov_base, chunk);
+      iov->iov_base = (uint8_t *) iov->iov_base + chunk;
+      iov->iov_len -= chunk;
+      p->direct_done += chunk;
+      bytes_read += chunk;
+      skip_direct (p);
+    }
+  if (bytes_read > 0)
+    {
+      cond_broadcast (&p->not_full, &p->lock);
+      poll_wake (&p->pollers);
+    }
+  lock_release (&p->lock);
+  return bytes_read;
+}
+
+/* Writes the SIZE bytes in BUFFER to P, waiting for room as needed.
+   Returns SIZE, or the number of bytes written before the last
+   reader left, or -1 if no reader was left to begin with. */
+int
+pipe_write (struct pipe *p, const void *buffer_, size_t size)
+{
+  const uint8_t *buffer = buffer_;
+  size_t bytes_written = 0;
+
+  lock_acquire (&p->lock);
+  while (bytes_written < size && p->reader_cnt > 0)
+    {
+      size_t ofs = p->tail % PIPE_SIZE;
+      size_t chunk = PIPE_SIZE - ofs;
+
+      if (p->tail - p->head == PIPE_SIZE || p->direct != NULL)
+        {
+          cond_wait (&p->not_full, &p->lock);
+          continue;
+        }
+      if (chunk > PIPE_SIZE - (p->tail - p->head))
+        chunk = PIPE_SIZE - (p->tail - p->head);
+      if (chunk > size - bytes_written)
+        chunk = size - bytes_written;
+      memcpy (p->buffer + ofs, buffer + bytes_written, chunk);
+      p->tail += chunk;
+      bytes_written += chunk;
+      cond_broadcast (&p->not_empty, &p->lock);
+      poll_wake (&p->pollers);
+    }
+  lock_release (&p->lock);
+  return bytes_written == 0 && size > 0 ? -1 : (int) bytes_written;
+}
+
+/* Writes the data in the IOV_CNT kernel buffers IOV to P by letting
+   readers copy it out of them, waiting until they have.  The buffers
+   must stay mapped meanwhile, and IOV is used up.  Returns what
+   pipe_write() does. */
+int
+pipe_write_direct (struct pipe *p, struct iovec *iov, size_t iov_cnt)
+{
+  size_t size = 0, bytes_written = 0;
+  size_t i;
+
+  for (i = 0; i < iov_cnt; i++)
+    size += iov[i].iov_len;
+  if (size == 0)
+    return 0;
+
+  lock_acquire (&p->lock);
+  /* Wait for the data before it to be read. */
+  while (p->reader_cnt > 0 && (p->head != p->tail || p->direct != NULL
+                               || p->direct_done != 0))
+    cond_wait (&p->not_full, &p->lock);
+  if (p->reader_cnt > 0)
+    {
+      p->direct = iov;
+      p->direct_cnt = iov_cnt;
+      skip_direct (p);
+      cond_broadcast (&p->not_empty, &p->lock);
+      poll_wake (&p->pollers);
+      while (p->direct != NULL && p->reader_cnt > 0)
+        cond_wait (&p->not_full, &p->lock);
+      bytes_written = p->direct_done;
+      p->direct = NULL;
+      p->direct_done = 0;
+      cond_broadcast (&p->not_full, &p->lock);
+      poll_wake (&p->pollers);
+    }
+  lock_release (&p->lock);
+  return bytes_written == 0 ? -1 : (int) bytes_written;
+}
+
+/* Returns the POLL* events that a write end of P is ready for if
+   WRITER, or else a read end, first adding ENTRY for TABLE to the
+   pollers of P if TABLE is not null. */
+unsigned
+pipe_poll (struct pipe *p, bool writer, struct poll_table *table,
+           struct poll_entry *entry)
+{
+  unsigned events = 0;
+
+  lock_acquire (&p->lock);
+  if (table != NULL)
+    poll_add (table, entry, &p->pollers);
+  if (writer)
+    {
+      if (p->reader_cnt == 0)
+        events |= POLLERR;
+      if (p->tail - p->head < PIPE_SIZE && p->direct == NULL)
+        events |= POLLOUT;
+    }
+  else
+    {
+      if (p->writer_cnt == 0)
+        events |= POLLHUP;
+      if (p->head != p->tail || p->direct != NULL)
+        events |= POLLIN;
+    }
+  lock_release (&p->lock);
+  return events;
+}
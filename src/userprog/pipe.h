@@ -0,0 +1,28 @@
+#ifndef USERPROG_PIPE_H
+#define USERPROG_PIPE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Bytes a pipe holds before writers block. */
+#define PIPE_SIZE 4096
+
+/* Writes at least this big are worth handing to readers with
+   pipe_write_direct() instead of copying through the ring. */
+#define PIPE_DIRECT_MIN PIPE_SIZE
+
+struct pipe;
+struct iovec;
+struct poll_table;
+struct poll_entry;
+
+struct pipe *pipe_create (void);
+void pipe_reopen (struct pipe *, bool writer);
+void pipe_close (struct pipe *, bool writer);
+size_t pipe_read (struct pipe *, void *, size_t size);
+int pipe_write (struct pipe *, const void *, size_t size);
+int pipe_write_direct (struct pipe *, struct iovec *, size_t iov_cnt);
+unsigned pipe_poll (struct pipe *, bool writer, struct poll_table *,
+                    struct poll_entry *);
+
+#endif /* userprog/pipe.h */
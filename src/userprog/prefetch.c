@@ -0,0 +1,200 @@
+#include "userprog/prefetch.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/cache.h"
+#include "filesys/directory.h"
+#include "filesys/file.h"
+#include "filesys/filesys.h"
+#include "filesys/inode.h"
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "userprog/process.h"
+
+/* Boot-time prefetch of executables.
+
+   The first exec of a program after boot waits on the disk for its
+   headers, its inode and indirect blocks, and then each page it
+   faults in.  Under "-prefetch=PROG[,PROG]..." a low priority thread
+   started right after the file system reads all of those for each
+   PROG into the buffer cache, and the layout load() checks into its
+   layout cache, while the rest of the boot goes on.  The frames of
+   shared text pages only live as long as some process maps them, so
+   it is the buffer cache that page faults then read them from.
+
+   Under "-prefetch=auto" the programs are instead those exec'd in
+   the previous boot that asked for it, which are kept in HISTORY_FILE
+   at shutdown.  Only the programs found from the root directory are
+   kept, by absolute name, since the prefetch thread has no working
+   directory of its own.  Prefetching stops at half the cache, as
+   cache_warm_up() does, or it would evict what it read. */
+
+/* Where "-prefetch=auto" keeps the programs exec'd in a boot. */
+#define HISTORY_FILE "/.prefetch"
+
+/* Most programs prefetched or kept in the history, and the longest
+   name kept. */
+#define PREFETCH_MAX 16
+#define PREFETCH_NAME_MAX 63
+
+/* Set by "-prefetch". */
+char *prefetch_programs;
+
+/* Absolute names of the programs exec'd in this boot, in order of
+   first exec, for "-prefetch=auto". */
+static char history[PREFETCH_MAX][PREFETCH_NAME_MAX + 1];
+static size_t history_cnt;
+static struct lock history_lock;
+
+/* The prefetch thread: whether it was started, a request for it to
+   stop, and its completion. */
+static bool prefetch_running;
+static volatile bool prefetch_stop;
+static struct semaphore prefetch_finished;
+
+static thread_func prefetch_thread;
+
+/* Returns true if "-prefetch=auto" was given. */
+static bool
+prefetch_auto (void)
+{
+  return prefetch_programs != NULL && !strcmp (prefetch_programs, "auto");
+}
+
+/* Starts prefetching the programs that "-prefetch" names, if it was
+   given, in the background.  Called right after filesys_init(). */
+void
+prefetch_start (void)
+{
+  lock_init (&history_lock);
+  sema_init (&prefetch_finished, 0);
+  if (prefetch_programs == NULL)
+    return;
+  prefetch_running = thread_create ("prefetch", PRI_MIN, prefetch_thread,
+                                    NULL) != TID_ERROR;
+}
+
+/* Prefetches the program named NAME, taking what it read off
+   *BUDGET. */
+static void
+prefetch_program (const char *name, off_t *budget)
+{
+  bool isdir;
+  void *f = filesys_open (name, &isdir);
+
+  if (f == NULL)
+    return;
+  if (isdir)
+    dir_close (f);
+  else
+    {
+      process_prefetch (f, budget);
+      file_close (f);
+    }
+}
+
+/* Prefetches each of the newline-separated names in HISTORY_FILE. */
+static void
+prefetch_history (off_t *budget)
+{
+  static char buf[PREFETCH_MAX * (PREFETCH_NAME_MAX + 1) + 1];
+  struct file *file = filesys_open (HISTORY_FILE, NULL);
+  char *name, *save_ptr;
+  off_t len;
+
+  if (file == NULL)
+    return;
+  len = file_read_at (file, buf, sizeof buf - 1, 0);
+  file_close (file);
+  buf[len > 0 ? len : 0] = '\0';
+  for (name = strtok_r (buf, "\n", &save_ptr);
+       name != NULL && *budget > 0 && !prefetch_stop;
+       name = strtok_r (NULL, "\n", &save_ptr))
+    prefetch_program (name, budget);
+}
+
+/* Thread function that prefetches the programs and exits. */
+static void
+prefetch_thread (void *aux UNUSED)
+{
+  off_t budget = (off_t) (cache_num_sectors / 2) * BLOCK_SECTOR_SIZE;
+
+  if (prefetch_auto ())
+    prefetch_history (&budget);
+  else
+    {
+      char *name, *save_ptr;
+      size_t cnt = 0;
+
+      for (name = strtok_r (prefetch_programs, ",", &save_ptr);
+           name != NULL && cnt < PREFETCH_MAX && budget > 0 && !prefetch_stop;
+           name = strtok_r (NULL, ",", &save_ptr), cnt++)
+        prefetch_program (name, &budget);
+    }
+  sema_up (&prefetch_finished);
+}
+
+/* Notes that the program NAME, as resolved from directory CWD, was
+   just exec'd, for "-prefetch=auto" to prefetch in the next boot. */
+void
+prefetch_record (const char *name, struct dir *cwd)
+{
+  char abs_name[PREFETCH_NAME_MAX + 1];
+  size_t i;
+
+  if (!prefetch_auto ())
+    return;
+  if (name[0] == '/')
+    strlcpy (abs_name, name, sizeof abs_name);
+  else if (cwd != NULL
+           && inode_get_inumber (dir_get_inode (cwd)) == ROOT_DIR_SECTOR)
+    snprintf (abs_name, sizeof abs_name, "/%s", name);
+  else
+    return;
+  /* A name that didn't fit would be a different program. */
+  if (strlen (abs_name) >= PREFETCH_NAME_MAX)
+    return;
+
+  lock_acquire (&history_lock);
+  for (i = 0; i < history_cnt; i++)
+    if (!strcmp (history[i], abs_name))
+      break;
+  if (i == history_cnt && history_cnt < PREFETCH_MAX)
+    strlcpy (history[history_cnt++], abs_name, sizeof history[0]);
+  lock_release (&history_lock);
+}
+
+/* Stops the prefetch thread and, under "-prefetch=auto", writes the
+   programs exec'd in this boot to HISTORY_FILE, leaving the last
+   boot's there if none were.  Called before filesys_done(). */
+void
+prefetch_done (void)
+{
+  struct file *file;
+  size_t i;
+
+  if (intr_context ())
+    return;
+  if (prefetch_running)
+    {
+      prefetch_stop = true;
+      sema_down (&prefetch_finished);
+      prefetch_running = false;
+    }
+  if (!prefetch_auto () || history_cnt == 0)
+    return;
+
+  filesys_remove (HISTORY_FILE);
+  if (!filesys_create (HISTORY_FILE, 0))
+    return;
+  file = filesys_open (HISTORY_FILE, NULL);
+  if (file == NULL)
+    return;
+  for (i = 0; i < history_cnt; i++)
+    {
+      file_write (file, history[i], strlen (history[i]));
+      file_write (file, "\n", 1);
+    }
+  file_close (file);
+}
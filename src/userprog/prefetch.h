@@ -0,0 +1,13 @@
+#ifndef USERPROG_PREFETCH_H
+#define USERPROG_PREFETCH_H
+
+struct dir;
+
+/* Set by the "-prefetch" kernel command-line option. */
+extern char *prefetch_programs;
+
+void prefetch_start (void);
+void prefetch_record (const char *name, struct dir *cwd);
+void prefetch_done (void);
+
+#endif /* userprog/prefetch.h */
@@ -5,15 +5,22 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "userprog/futex.h"
 #include "userprog/gdt.h"
 #include "userprog/pagedir.h"
+#include "userprog/prefetch.h"
+#include "userprog/procstat.h"
 #include "userprog/tss.h"
+#include "filesys/cache.h"
 #include "filesys/filesys.h"
+#include "filesys/inode.h"
 #include "threads/flags.h"
+#include "threads/fpu.h"
 #include "threads/init.h"
 #include "threads/interrupt.h"
 #include "threads/palloc.h"
 #include "threads/malloc.h"
+#include "threads/slab.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
 #include "threads/synch.h"
@@ -24,6 +31,23 @@
 /* Processes acquire this lock when modifying their parent or children
  to prevent race conditions when multiple processes exit at the same time. */
 static struct lock process_child_lock;
+static struct slab_cache process_child_cache;
+
+/* Records of child processes by tid, so that waiting for one doesn't
+   search its parent's children, guarded by process_child_lock. */
+static struct ihash process_table;
+/* Children being created, whose records process_table has room for
+   once they have tids, guarded by process_child_lock. */
+static size_t process_table_pending;
+
+/* Most exited processes reclaiming their memory and files at low
+   priority at once, after their parents have seen them exit. Beyond
+   that they reclaim at their own priority, so what exited processes
+   hold stays bounded. */
+#define PROCESS_REAP_MAX 8
+/* Exited processes reclaiming at low priority, guarded by
+   process_child_lock. */
+static size_t process_reap_cnt;
 
 /* Used to pass info concerning the process' name and arguments from
    process_execute() to start_process() to load(). Also holds a
@@ -37,18 +61,185 @@ struct process_info {
                                info is loaded in the stack */
   struct process_child *inparent;
                           /* Pointer to record of current process in parent. */
+  struct fd_entry *fd_table;  /* File descriptors to start with. */
+  int fd_cnt;               /* Number of entries in FD_TABLE. */
+  bool wait_load;           /* Does the parent wait for the load? */
   bool load_success;
 };
 
+/* Used to pass the state of the forking process from process_fork() to
+   start_fork(), and whether the fork succeeded back. */
+struct fork_info {
+  struct intr_frame if_;    /* User context to resume the child in. */
+  struct thread *parent;    /* Process being forked. */
+  struct semaphore forked;  /* Keeps the parent waiting until the child
+                               is set up. */
+  struct process_child *inparent;
+                          /* Pointer to record of child process in parent. */
+  struct fpu_state *fpu;    /* Copy of the parent's FPU state, which the
+                               child takes over. */
+  bool success;
+};
+
+/* Used to pass where a new thread of a process starts running from
+   process_thread_create() to start_thread(). */
+struct thread_info {
+  void *eip;                /* User code to start running. */
+  void *esp;                /* Top of the user stack of the thread. */
+  struct thread *process;   /* First thread of the process. */
+  struct process_child *inprocess;
+                          /* Pointer to record of the thread in PROCESS. */
+  struct semaphore started; /* Keeps the creator waiting until the thread
+                               is set up. */
+};
+
+/* A loadable segment of an executable, as load_segment() takes it. */
+struct exec_segment
+  {
+    uint32_t file_page;         /* Page aligned offset in the file. */
+    uint32_t mem_page;          /* Page aligned user virtual address. */
+    uint32_t read_bytes;        /* Bytes read from the file. */
+    uint32_t zero_bytes;        /* Bytes zeroed after them. */
+    bool writable;
+  };
+
+/* Most loadable segments in an executable. */
+#define EXEC_SEGMENT_MAX 16
+
+/* The checked layout of an executable, read from its headers. */
+struct exec_layout
+  {
+    block_sector_t inumber;     /* Inode of the executable. */
+    unsigned version;           /* inode_version() when it was read. */
+    unsigned last_used;         /* When it was last looked up. */
+    void (*entry) (void);       /* Entry point. */
+    size_t segment_cnt;
+    struct exec_segment segments[EXEC_SEGMENT_MAX];
+  };
+
+/* Layouts of the executables loaded most recently, so exec of a
+   program that is already running or just ran doesn't read and check
+   its headers again. An entry whose executable has since been written
+   or closed for good no longer matches its inode's version, and is
+   replaced in time by a newer one. */
+#define EXEC_CACHE_SIZE 8
+static struct exec_layout exec_cache[EXEC_CACHE_SIZE];
+static unsigned exec_cache_clock;  /* Last LAST_USED given out. */
+static struct lock exec_cache_lock;
+
 static thread_func start_process NO_RETURN;
-static bool load (struct process_info *p_info, void (**eip) (void), void **esp);
+static thread_func start_fork NO_RETURN;
+static thread_func start_thread NO_RETURN;
+static void process_thread_done (void);
+static bool load (struct process_info *p_info, struct file *file,
+                  void (**eip) (void), void **esp);
 static bool pass_args_to_stack(struct process_info *p_info, void **esp);
 static bool stack_push(void **esp, void *data, size_t size);
+static struct process_child *process_child_create (void);
+static bool process_child_link (struct process_child *);
+static void process_child_register (struct process_child *, tid_t);
+static void process_child_free (struct process_child *);
 
 void
 process_init (void)
 {
   lock_init(&process_child_lock);
+  lock_init (&exec_cache_lock);
+  slab_cache_init (&process_child_cache, "process_child",
+                   sizeof (struct process_child), NULL, NULL);
+  if (!ihash_init (&process_table, 64))
+    PANIC ("process table: out of memory");
+}
+
+/* Returns a new record of a child process that hasn't exited, or a
+   null pointer if memory is not available. */
+static struct process_child *
+process_child_create (void)
+{
+  struct process_child *p_child = slab_alloc (&process_child_cache);
+
+  if (p_child != NULL)
+    {
+      p_child->tid = 0;
+      p_child->thread = NULL;
+      p_child->exit_code = 0;
+      sema_init (&p_child->exited, 0);
+      p_child->parent = NULL;
+      p_child->has_exited = false;
+    }
+  return p_child;
+}
+
+/* Adds P_CHILD, the record of a child process about to be created, to
+   the current process's children, and makes room to file it in
+   process_table.  Returns false if memory is not available. */
+static bool
+process_child_link (struct process_child *p_child)
+{
+  struct thread *p = thread_current ()->process;
+  bool success;
+
+  lock_acquire (&process_child_lock);
+  if (p->process_child_exited == NULL)
+    {
+      p->process_child_exited = malloc (sizeof *p->process_child_exited);
+      if (p->process_child_exited != NULL)
+        cond_init (p->process_child_exited);
+    }
+  success = (p->process_child_exited != NULL
+             && ihash_reserve (&process_table, (ihash_size (&process_table)
+                                                + process_table_pending
+                                                + 1)));
+  if (success)
+    {
+      process_table_pending++;
+      p_child->parent = p;
+      list_push_back (&p->process_children, &p_child->elem);
+    }
+  lock_release (&process_child_lock);
+  return success;
+}
+
+/* Files P_CHILD, linked by process_child_link(), in process_table
+   under TID, its process's tid, or drops it from its parent's
+   children if TID is TID_ERROR. */
+static void
+process_child_register (struct process_child *p_child, tid_t tid)
+{
+  bool inserted;
+
+  lock_acquire (&process_child_lock);
+  process_table_pending--;
+  if (tid != TID_ERROR)
+    {
+      p_child->tid = tid;
+      inserted = ihash_insert (&process_table, tid, &p_child->table_elem);
+      ASSERT (inserted);
+    }
+  else
+    {
+      list_remove (&p_child->elem);
+      cond_broadcast (p_child->parent->process_child_exited,
+                      &process_child_lock);
+    }
+  lock_release (&process_child_lock);
+}
+
+/* Removes P_CHILD, a child process's record, from its parent's
+   children and process_table and frees it, waking anyone waiting for
+   any child in case it was the last.  The caller holds
+   process_child_lock. */
+static void
+process_child_free (struct process_child *p_child)
+{
+  ASSERT (lock_held_by_current_thread (&process_child_lock));
+
+  list_remove (&p_child->elem);
+  cond_broadcast (p_child->parent->process_child_exited,
+                  &process_child_lock);
+  if (p_child->tid != 0)
+    ihash_delete (&process_table, p_child->tid);
+  slab_free (&process_child_cache, p_child);
 }
 
 /* Starts a new thread running a user program loaded from
@@ -57,122 +248,222 @@ process_init (void)
    thread id, or TID_ERROR if the thread cannot be created. */
 tid_t
 process_execute (const char *file_name)
+{
+  return process_spawn (file_name, NULL, NULL, 0, true);
+}
+
+/* Starts a new thread running the user program named by the first
+   word of CMD_LINE, with the rest as its arguments, in working
+   directory CWD, or the current process's if CWD is null, and with
+   the FD_CNT entries of FD_TABLE as its file descriptors.  Takes
+   ownership of CWD and FD_TABLE either way.  If WAIT_LOAD, waits for
+   the program to load and returns TID_ERROR if it fails to, like
+   process_execute(); otherwise returns as soon as the thread exists,
+   and a failure to load is exit status -1 to process_wait(). */
+tid_t
+process_spawn (const char *cmd_line, struct dir *cwd,
+               struct fd_entry *fd_table, int fd_cnt, bool wait_load)
 {
   tid_t tid;
   struct thread *curr_t = thread_current ();
-
   struct process_info *p_info = calloc (1, sizeof(struct process_info));
-  struct process_child *p_child = calloc (1, sizeof(struct process_child));
-  if (p_info == NULL || p_child == NULL)
+  struct process_child *p_child = NULL;
+
+  if (p_info == NULL)
     {
-      tid = TID_ERROR;
-      goto done;
+      dir_close (cwd);
+      syscall_fds_free (fd_table, fd_cnt);
+      return TID_ERROR;
     }
+  p_info->cwd = cwd != NULL ? cwd : dir_reopen (curr_t->process->cwd);
+  p_info->fd_table = fd_table;
+  p_info->fd_cnt = fd_cnt;
+  p_info->wait_load = wait_load;
 
   /* Initialize process semaphore. */
   sema_init (&p_info->loaded, 0);
-  sema_init (&p_child->exited, 0);
 
   /* Add a pointer to child's record in parent to link them after creating the thread. */
-  p_child->thread = NULL;
+  p_child = process_child_create ();
+  if (p_child == NULL || !process_child_link (p_child))
+    {
+      slab_free (&process_child_cache, p_child);
+      tid = TID_ERROR;
+      goto done;
+    }
   p_info->inparent = p_child;
-  lock_acquire (&process_child_lock);
-  list_push_back (&curr_t->process_children, &p_child->elem);
-  lock_release (&process_child_lock);
 
-  /* Make a copy of FILE_NAME (the command line).
+  /* Make a copy of CMD_LINE.
      Otherwise there's a race between the caller and load(). */
+  tid = TID_ERROR;
   p_info->cmd_line = palloc_get_page (0);
-  if (p_info->cmd_line == NULL)
+  if (p_info->cmd_line != NULL)
     {
-      tid = TID_ERROR;
-      goto done;
-    }
-  strlcpy (p_info->cmd_line, file_name, PGSIZE);
+      strlcpy (p_info->cmd_line, cmd_line, PGSIZE);
 
-  /* Parse out program name without modifying str */
-  size_t len_prog_name = strcspn(p_info->cmd_line, " ");
-  p_info->program_name = calloc (sizeof(char), len_prog_name + 1);
-  p_info->cwd = dir_reopen (curr_t->cwd);
-  if (p_info->program_name == NULL)
+      /* Parse out program name without modifying str */
+      size_t len_prog_name = strcspn(p_info->cmd_line, " ");
+      p_info->program_name = calloc (sizeof(char), len_prog_name + 1);
+      if (p_info->program_name != NULL)
+        {
+          memcpy(p_info->program_name, p_info->cmd_line, len_prog_name);
+
+          /* Create a new thread to execute CMD_LINE.  Without
+             WAIT_LOAD, P_INFO belongs to the new thread from here
+             on. */
+          tid = thread_create (p_info->program_name, PRI_DEFAULT,
+                               start_process, p_info);
+        }
+    }
+  process_child_register (p_child, tid);
+  if (tid == TID_ERROR)
     {
-      tid = TID_ERROR;
-      goto done;
+      slab_free (&process_child_cache, p_child);
+      free (p_info->program_name);
+    }
+  else if (!wait_load)
+    return tid;
+  else
+    {
+      sema_down (&p_info->loaded);
+      if (!p_info->load_success)
+        {
+          lock_acquire (&process_child_lock);
+          process_child_free (p_child);
+          lock_release (&process_child_lock);
+          tid = TID_ERROR;
+        }
     }
-  memcpy(p_info->program_name, p_info->cmd_line, len_prog_name);
-
-  /* Create a new thread to execute FILE_NAME. */
-  tid = thread_create (p_info->program_name, PRI_DEFAULT, start_process,
-                       p_info);
-  sema_down (&p_info->loaded);
 
 done: /* Arrives here on success or error. */
-  if (p_info->load_success == false)
-    tid = TID_ERROR;
   if (tid == TID_ERROR)
     {
-      if (p_child != NULL)
-        list_remove (&p_child->elem);
-      free (p_child);
-      if (p_info != NULL)
-        dir_close (p_info->cwd);
+      dir_close (p_info->cwd);
+      syscall_fds_free (p_info->fd_table, p_info->fd_cnt);
     }
-  else
-    p_child->tid = tid;
-  if (p_info != NULL)
-    palloc_free_page (p_info->cmd_line);
+  palloc_free_page (p_info->cmd_line);
   free (p_info);
   return tid;
 }
 
-static bool
-process_elem_tid_equal (struct list_elem *elem, void *aux)
+/* Starts a new process running a copy of the current one, which resumes
+   from the interrupt frame F of the system call, but returning 0.
+   Returns the new process's thread id, or TID_ERROR if it cannot be
+   created. */
+tid_t
+process_fork (struct intr_frame *f)
 {
-  struct process_child *child = list_entry (elem, struct process_child, elem);
-  return child->tid == *(tid_t *)aux;
-}
+  tid_t tid;
+  struct thread *curr_t = thread_current ();
+  struct fork_info *f_info = malloc (sizeof (struct fork_info));
+  struct process_child *p_child = process_child_create ();
 
-static bool
-process_elem_fd_equal (struct list_elem *elem, void *aux)
-{
-  struct process_fd * fd = list_entry(elem, struct process_fd, list_elem);
-  return fd->id == *(int *)aux;
+  if (f_info == NULL || p_child == NULL || !process_child_link (p_child)
+      || !fpu_fork (&f_info->fpu))
+    {
+      free (f_info);
+      slab_free (&process_child_cache, p_child);
+      return TID_ERROR;
+    }
+  f_info->if_ = *f;
+  f_info->parent = curr_t->process;
+  f_info->inparent = p_child;
+  f_info->success = false;
+  sema_init (&f_info->forked, 0);
+
+  tid = thread_create (curr_t->name, PRI_DEFAULT, start_fork, f_info);
+  process_child_register (p_child, tid);
+  if (tid == TID_ERROR)
+    {
+      slab_free (&process_child_cache, p_child);
+      free (f_info->fpu);
+    }
+  else
+    {
+      sema_down (&f_info->forked);
+      if (!f_info->success)
+        {
+          lock_acquire (&process_child_lock);
+          process_child_free (p_child);
+          lock_release (&process_child_lock);
+          tid = TID_ERROR;
+        }
+    }
+  free (f_info);
+  return tid;
 }
 
-struct process_fd *
-process_get_fd(struct thread *t, int id)
+/* A thread function that makes the new thread a copy of the process
+   forking it and starts it running where the fork system call
+   returns. */
+static void
+start_fork (void *fork_info)
 {
-  struct list_elem *e;
-  if (!list_empty(&t->process_fd_table))
+  struct fork_info *f_info = (struct fork_info *) fork_info;
+  struct thread *parent = f_info->parent;
+  struct thread *cur = thread_current ();
+  struct intr_frame if_ = f_info->if_;
+  bool success;
+
+  /* Set up received member values. */
+  cur->fpu = f_info->fpu;
+  cur->process_fn = malloc (strlen (parent->process_fn) + 1);
+  if (cur->process_fn != NULL)
+    strlcpy (cur->process_fn, parent->process_fn,
+             strlen (parent->process_fn) + 1);
+  cur->cwd = dir_reopen (parent->cwd);
+  lock_acquire (&process_child_lock);
+  cur->inparent = f_info->inparent;
+  cur->inparent->thread = cur;
+  lock_release (&process_child_lock);
+
+  /* Copy the address space, the executable and the open files, which
+     the other threads of the parent can't change meanwhile. */
+  lock_acquire (parent->syscall_lock);
+  cur->pagedir = pagedir_create ();
+  success = cur->pagedir != NULL && page_table_init ();
+  if (success)
     {
-      e = list_find(&t->process_fd_table, process_elem_fd_equal,
-                    &id);
-      return list_entry(e, struct process_fd, list_elem);
+      process_activate ();
+      success = page_table_fork (parent);
     }
-  return NULL;
-}
+  if (parent->exec_file != NULL)
+    {
+      cur->exec_file = filesys_reopen (parent->exec_file);
+      if (cur->exec_file != NULL)
+        filesys_deny_write (cur->exec_file);
+    }
+  success = success && syscall_process_fork (parent);
+  success = success && cur->process_fn != NULL;
+  lock_release (parent->syscall_lock);
 
-int
-process_new_fd(struct thread *t, struct file *file, char* file_name)
-{
-  int id = t->process_fd_next++;
-  struct process_fd *fd = malloc (sizeof(struct process_fd));
-  if (fd == NULL) return -1;
-
-  fd->id = id;
-  list_push_back(&t->process_fd_table, &fd->list_elem);
-  fd->file = file;
-  fd->file_name = file_name;
-  return id;
+  /* The parent drops its record of a child that failed. */
+  if (!success)
+    {
+      lock_acquire (&process_child_lock);
+      cur->inparent = NULL;
+      lock_release (&process_child_lock);
+    }
+  f_info->success = success;
+  sema_up (&f_info->forked);
+  if (!success)
+    {
+      thread_current ()->process_exit_code = -1;
+      thread_exit ();
+    }
+
+  /* Return from the system call as the child, see start_process(). */
+  if_.eax = 0;
+  thread_account_time (false);
+  asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
+  NOT_REACHED ();
 }
 
-void
-process_remove_fd(struct thread *t, int id)
+static bool
+process_elem_tid_equal (struct list_elem *elem, void *aux)
 {
-  struct process_fd *fd = process_get_fd(t, id);
-  if (fd == NULL) return;
-  list_remove(&fd->list_elem);
-  free(fd);
+  struct process_child *child = list_entry (elem, struct process_child, elem);
+  return child->tid == *(tid_t *)aux;
 }
 
 /* A thread function that loads a user process and starts it
@@ -204,14 +495,37 @@ start_process (void *process_info)
   struct file* file = filesys_open (p_info->program_name, NULL);
   if (file != NULL) filesys_deny_write (file);
 
-  success = load (p_info, &if_.eip, &if_.esp);
+  success = load (p_info, file, &if_.eip, &if_.esp);
+  if (success)
+    prefetch_record (p_info->program_name, cur->cwd);
 
-  /* Setup the process's system calls infrastructure.
+  /* Setup the process's system calls infrastructure, taking over the
+     file descriptors it was given either way.
      syscall_process_done () must be called later to free resources. */
-  cur->fd_table_ready = false;
-  success = success && syscall_process_init ();
-
-  sema_up (&p_info->loaded);
+  success = syscall_process_spawn (p_info->fd_table, p_info->fd_cnt)
+            && success;
+  p_info->fd_table = NULL;
+  p_info->fd_cnt = 0;
+
+  /* A parent that waits for the load drops its record of a child
+     that failed, see start_fork().  One that didn't wait learns of
+     the failure from the exit status, and leaves P_INFO to us. */
+  if (p_info->wait_load)
+    {
+      if (!success)
+        {
+          lock_acquire (&process_child_lock);
+          cur->inparent = NULL;
+          lock_release (&process_child_lock);
+        }
+      p_info->load_success = success;
+      sema_up (&p_info->loaded);
+    }
+  else
+    {
+      palloc_free_page (p_info->cmd_line);
+      free (p_info);
+    }
 
   /* If load failed, quit. */
   if (!success)
@@ -229,7 +543,9 @@ start_process (void *process_info)
      threads/intr-stubs.S).  Because intr_exit takes all of its
      arguments on the stack in the form of a `struct intr_frame',
      we just point the stack pointer (%esp) to our stack frame
-     and jump to it. */
+     and jump to it.  Loading the program counts as kernel time,
+     as it would have as part of a system call. */
+  thread_account_time (false);
   asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
   NOT_REACHED ();
 }
@@ -243,28 +559,67 @@ start_process (void *process_info)
 int
 process_wait (tid_t child_tid)
 {
-  struct list_elem *child_elem;
-  struct process_child *child;
   int exit_code;
 
-  lock_acquire (&process_child_lock);
-  child_elem = list_find(&thread_current ()->process_children,
-                         process_elem_tid_equal, &child_tid);
-  lock_release (&process_child_lock);
+  if (child_tid == PROCESS_WAIT_ANY
+      || process_waitpid (child_tid, &exit_code, false) == TID_ERROR)
+    return -1;
+  return exit_code;
+}
+
+/* Waits for child process TID of the calling process, or any of its
+   children if TID is PROCESS_WAIT_ANY, to exit, stores its exit status
+   in *EXIT_CODE and returns its tid, after which it can't be waited
+   for again.  If NOHANG, returns 0 instead of waiting if it hasn't
+   exited yet.  Returns TID_ERROR immediately if there is no such
+   child.  A child is found through process_table, and an exited one
+   at the front of the list of children, without searching either. */
+tid_t
+process_waitpid (tid_t tid, int *exit_code, bool nohang)
+{
+  struct thread *p = thread_current ()->process;
+  struct process_child *child;
+  tid_t result;
 
-  if (child_elem != NULL)
+  lock_acquire (&process_child_lock);
+  for (;;)
     {
-      child = list_entry (child_elem, struct process_child, elem);
-      sema_down (&child->exited);
-      lock_acquire (&process_child_lock);
-      exit_code = child->exit_code;
-      list_remove (&child->elem);
-      free (child);
-      lock_release (&process_child_lock);
-      return exit_code;
+      if (tid != PROCESS_WAIT_ANY)
+        {
+          struct hash_elem *e = ihash_find (&process_table, tid);
+
+          child = e != NULL ? hash_entry (e, struct process_child,
+                                          table_elem) : NULL;
+          if (child != NULL && child->parent != p)
+            child = NULL;
+        }
+      else if (!list_empty (&p->process_children))
+        child = list_entry (list_front (&p->process_children),
+                            struct process_child, elem);
+      else
+        child = NULL;
+
+      if (child == NULL)
+        {
+          result = TID_ERROR;
+          break;
+        }
+      if (child->has_exited)
+        {
+          *exit_code = child->exit_code;
+          result = child->tid;
+          process_child_free (child);
+          break;
+        }
+      if (nohang)
+        {
+          result = 0;
+          break;
+        }
+      cond_wait (p->process_child_exited, &process_child_lock);
     }
-  else
-    return -1;
+  lock_release (&process_child_lock);
+  return result;
 }
 
 /* Free the current process's resources and print its exit code. */
@@ -272,36 +627,90 @@ void
 process_exit (void)
 {
   struct thread *cur = thread_current ();
-  struct list_elem *curr_child_elem;
   struct process_child *curr_child;
   uint32_t *pd;
+  bool reap;
+
+  if (cur->process != cur)
+    {
+      process_thread_done ();
+      return;
+    }
 
   if (!lock_held_by_current_thread (&process_child_lock))
     lock_acquire (&process_child_lock);
-  /* Update the parent (if exists) that this child has exited. */
-  if (cur->inparent != NULL)
+  /* Wait for the other threads to exit, then drop the records of those
+     not joined. */
+  while (cur->process_thread_cnt > 0)
     {
-      cur->inparent->exit_code = cur->process_exit_code;
-      cur->inparent->thread = NULL;
-      sema_up (&cur->inparent->exited);
+      struct semaphore threads_done;
+
+      sema_init (&threads_done, 0);
+      cur->process_threads_done = &threads_done;
+      lock_release (&process_child_lock);
+      sema_down (&threads_done);
+      lock_acquire (&process_child_lock);
+      cur->process_threads_done = NULL;
     }
+  while (!list_empty (&cur->process_threads))
+    slab_free (&process_child_cache,
+               list_entry (list_pop_front (&cur->process_threads),
+                           struct process_child, elem));
+
+  /* Allow writes to the exec file again, before the parent can see
+     that the process exited. */
+  if (cur->exec_file != NULL)
+  {
+    filesys_allow_write (cur->exec_file);
+    filesys_close (cur->exec_file);
+    cur->exec_file = NULL;
+  }
   if (cur->process_fn != NULL)
     {
       printf ("%s: exit(%d)\n", cur->process_fn, cur->process_exit_code);
+      if (procstat_enabled)
+        procstat_print (cur);
       free (cur->process_fn);
     }
+  /* Update the parent (if exists) that this child has exited, moving
+     the record to the front of its children for a wait for any. */
+  if (cur->inparent != NULL)
+    {
+      struct thread *parent = cur->inparent->parent;
+
+      cur->inparent->exit_code = cur->process_exit_code;
+      cur->inparent->thread = NULL;
+      cur->inparent->has_exited = true;
+      procstat_exit (cur, parent);
+      list_remove (&cur->inparent->elem);
+      list_push_front (&parent->process_children, &cur->inparent->elem);
+      cond_broadcast (parent->process_child_exited, &process_child_lock);
+    }
   /* Orphan all child processes. */
-  for (curr_child_elem = list_begin (&cur->process_children);
-       curr_child_elem != list_end (&cur->process_children);
-       curr_child_elem = list_remove (curr_child_elem))
+  while (!list_empty (&cur->process_children))
     {
-      curr_child = list_entry (curr_child_elem, struct process_child, elem);
+      curr_child = list_entry (list_front (&cur->process_children),
+                               struct process_child, elem);
       if (curr_child->thread != NULL)
         curr_child->thread->inparent = NULL;
-      free (curr_child);
+      process_child_free (curr_child);
     }
+  free (cur->process_child_exited);
+  cur->process_child_exited = NULL;
+  reap = process_reap_cnt < PROCESS_REAP_MAX;
+  process_reap_cnt += reap;
   lock_release (&process_child_lock);
 
+  /* Nobody waits for the rest, which writes back dirty mmaps and frees
+     frames, swap slots and files, so let everyone else go first. */
+  if (reap)
+    {
+      if (thread_mlfqs)
+        thread_set_nice (20);   /* The nicest there is. */
+      else
+        thread_set_priority (PRI_MIN);
+    }
+
   /* Free all mmaps */
   struct list* mmap_list = &thread_current ()->mmap_list;
   struct page_mmap *mmap_page;
@@ -317,13 +726,6 @@ process_exit (void)
   /* Destroy the the thread's supplemental page directory. */
   page_table_destroy ();
 
-  /* Allow writes to the exec file again */
-  if (cur->exec_file != NULL)
-  {
-    filesys_allow_write (cur->exec_file);
-    filesys_close (cur->exec_file);
-  }
-
   /* Free up the syscall resources including open file descriptors. */
   syscall_process_done ();
 
@@ -342,7 +744,212 @@ process_exit (void)
       cur->pagedir = NULL;
       pagedir_activate (NULL);
       pagedir_destroy (pd);
+
+      /* Without a page directory the process is no longer charged for
+         the cache sectors it uses. */
+      cache_release_user (cur);
+    }
+
+  lock_acquire (&process_child_lock);
+  process_reap_cnt -= reap;
+  lock_release (&process_child_lock);
+}
+
+/* Ends the current thread, which is not the first of its process,
+   leaving the state of the process to that thread. */
+static void
+process_thread_done (void)
+{
+  struct thread *cur = thread_current ();
+  struct thread *p = cur->process;
+
+  /* Stop using the page directory before the first thread may
+     destroy it. */
+  cur->pagedir = NULL;
+  pagedir_activate (NULL);
+
+  lock_acquire (&process_child_lock);
+  if (cur->inparent != NULL)
+    {
+      cur->inparent->exit_code = cur->process_exit_code;
+      cur->inparent->thread = NULL;
+      sema_up (&cur->inparent->exited);
+    }
+  procstat_thread_exit (cur, p);
+  if (--p->process_thread_cnt == 0 && p->process_threads_done != NULL)
+    sema_up (p->process_threads_done);
+  lock_release (&process_child_lock);
+}
+
+/* Starts a new thread in the current process, running the user code
+   at EIP on the user stack at ESP. The new thread may run (and even
+   exit) before this returns. Returns its thread id, or TID_ERROR if
+   it cannot be created or the process is exiting. */
+tid_t
+process_thread_create (void *eip, void *esp)
+{
+  struct thread *p = thread_current ()->process;
+  struct process_child *t_child = process_child_create ();
+  struct thread_info t_info;
+  tid_t tid;
+
+  if (t_child == NULL)
+    return TID_ERROR;
+  t_info.eip = eip;
+  t_info.esp = esp;
+  t_info.process = p;
+  t_info.inprocess = t_child;
+  sema_init (&t_info.started, 0);
+
+  lock_acquire (&process_child_lock);
+  if (p->process_exiting)
+    {
+      lock_release (&process_child_lock);
+      slab_free (&process_child_cache, t_child);
+      return TID_ERROR;
+    }
+  list_push_back (&p->process_threads, &t_child->elem);
+  p->process_thread_cnt++;
+  lock_release (&process_child_lock);
+
+  tid = thread_create (p->name, PRI_DEFAULT, start_thread, &t_info);
+  lock_acquire (&process_child_lock);
+  if (tid == TID_ERROR)
+    {
+      list_remove (&t_child->elem);
+      if (--p->process_thread_cnt == 0 && p->process_threads_done != NULL)
+        sema_up (p->process_threads_done);
+      slab_free (&process_child_cache, t_child);
+    }
+  else
+    t_child->tid = tid;
+  lock_release (&process_child_lock);
+  if (tid != TID_ERROR)
+    sema_down (&t_info.started);
+  return tid;
+}
+
+/* A thread function that joins the new thread to the process creating
+   it and starts it running in user mode. */
+static void
+start_thread (void *thread_info)
+{
+  struct thread_info *t_info = (struct thread_info *) thread_info;
+  struct thread *cur = thread_current ();
+  struct intr_frame if_;
+
+  /* The creator is still running, so the address space is there. */
+  cur->process = t_info->process;
+  cur->pagedir = cur->process->pagedir;
+  lock_acquire (&process_child_lock);
+  cur->inparent = t_info->inprocess;
+  cur->inparent->thread = cur;
+  lock_release (&process_child_lock);
+  process_activate ();
+
+  memset (&if_, 0, sizeof if_);
+  if_.gs = if_.fs = if_.es = if_.ds = if_.ss = SEL_UDSEG;
+  if_.cs = SEL_UCSEG;
+  if_.eflags = FLAG_IF | FLAG_MBS;
+  if_.eip = t_info->eip;
+  if_.esp = t_info->esp;
+  sema_up (&t_info->started);
+
+  /* Start running by simulating a return from an interrupt, see
+     start_process(). */
+  thread_account_time (false);
+  asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
+  NOT_REACHED ();
+}
+
+/* Waits for thread TID of the current process to exit and returns the
+   status it gave thread_exit. Returns -1 right away if TID is not a
+   thread of the process, is the caller, or has already been joined. */
+int
+process_thread_join (tid_t tid)
+{
+  struct thread *cur = thread_current ();
+  struct list_elem *t_elem;
+  struct process_child *t_child = NULL;
+  int exit_code;
+
+  lock_acquire (&process_child_lock);
+  t_elem = list_find (&cur->process->process_threads,
+                      process_elem_tid_equal, &tid);
+  if (t_elem != NULL)
+    {
+      t_child = list_entry (t_elem, struct process_child, elem);
+      if (t_child->thread == cur)
+        t_child = NULL;
+      else
+        list_remove (t_elem);
+    }
+  lock_release (&process_child_lock);
+  if (t_child == NULL)
+    return -1;
+
+  sema_down (&t_child->exited);
+  exit_code = t_child->exit_code;
+  slab_free (&process_child_cache, t_child);
+  return exit_code;
+}
+
+/* Ends the whole current process with STATUS, unless another of its
+   threads already did with its own. The other threads are woken from
+   futexes, and exit on their way back to user mode. Never returns. */
+void
+process_terminate (int status)
+{
+  struct thread *p = thread_current ()->process;
+
+  lock_acquire (&process_child_lock);
+  if (!p->process_exiting)
+    {
+      p->process_exiting = true;
+      p->process_exit_code = status;
+    }
+  lock_release (&process_child_lock);
+  futex_wake_process (p->pagedir);
+  thread_exit ();
+}
+
+/* Returns true if the current thread's process is being terminated,
+   so the thread should exit instead of returning to user mode. */
+bool
+process_is_exiting (void)
+{
+  return thread_current ()->process->process_exiting;
+}
+
+/* Stores the CPU time of all the threads of process P, those that
+   have exited and those still running, in *USER_NS and
+   *KERNEL_NS. */
+void
+process_get_times (struct thread *p, uint64_t *user_ns, uint64_t *kernel_ns)
+{
+  struct procstat st;
+  struct list_elem *e;
+
+  /* Under the lock, so that no thread moves its time to the process
+     between counting the one and the other. */
+  lock_acquire (&process_child_lock);
+  procstat_get (p, &st);
+  *user_ns = st.user_ns;
+  *kernel_ns = st.kernel_ns;
+  for (e = list_begin (&p->process_threads);
+       e != list_end (&p->process_threads); e = list_next (e))
+    {
+      struct thread *t = list_entry (e, struct process_child, elem)->thread;
+      uint64_t t_user_ns, t_kernel_ns;
+
+      if (t != NULL)
+        {
+          thread_get_times (t, &t_user_ns, &t_kernel_ns);
+          *user_ns += t_user_ns;
+          *kernel_ns += t_kernel_ns;
+        }
     }
+  lock_release (&process_child_lock);
 }
 
 /* Sets up the CPU for running user code in the current
@@ -430,36 +1037,17 @@ static bool load_segment (struct page_mmap* mmap, off_t ofs, uint8_t *upage,
                           uint32_t read_bytes, uint32_t zero_bytes,
                           bool writable);
 
-/* Loads an ELF executable from FILE_NAME into the current thread.
-   Stores the executable's entry point into *EIP
-   and its initial stack pointer into *ESP.
-   Returns true if successful, false otherwise. */
-bool
-load (struct process_info *p_info, void (**eip) (void), void **esp)
+/* Reads and checks the ELF header and program headers of FILE into
+   LAYOUT. Returns true if FILE is an executable we can load. */
+static bool
+layout_read (struct file *file, struct exec_layout *layout)
 {
-  struct thread *t = thread_current ();
   struct Elf32_Ehdr ehdr;
-  struct file *file = NULL;
   off_t file_ofs;
-  bool success = false;
   int i;
 
-  /* Allocate and activate page directory and supplemntal page table. */
-  t->pagedir = pagedir_create ();
-  if (t->pagedir == NULL || !page_table_init ())
-    goto done;
-
-  process_activate ();
-
-  /* Open executable file. */
-  file = filesys_open (p_info->program_name, NULL);
-  if (file == NULL)
-    {
-      printf ("load: %s: open failed\n", p_info->program_name);
-      goto done;
-    }
-
   /* Read and verify executable header. */
+  file_seek (file, 0);
   if (file_read (file, &ehdr, sizeof ehdr) != sizeof ehdr
       || memcmp (ehdr.e_ident, "\177ELF\1\1\1", 7)
       || ehdr.e_type != 2
@@ -467,27 +1055,24 @@ load (struct process_info *p_info, void (**eip) (void), void **esp)
       || ehdr.e_version != 1
       || ehdr.e_phentsize != sizeof (struct Elf32_Phdr)
       || ehdr.e_phnum > 1024)
-    {
-      printf ("load: %s: error loading executable\n", p_info->program_name);
-      goto done;
-    }
-
-  /* Create mmap for executable file*/
-  size_t file_size = file_length(file);
-  struct page_mmap *mmap = page_mmap_new(file,file_size);
+    return false;
+  layout->entry = (void (*) (void)) ehdr.e_entry;
+  layout->segment_cnt = 0;
 
   /* Read program headers. */
   file_ofs = ehdr.e_phoff;
   for (i = 0; i < ehdr.e_phnum; i++)
     {
       struct Elf32_Phdr phdr;
+      struct exec_segment *seg;
+      uint32_t page_offset;
 
       if (file_ofs < 0 || file_ofs > file_length (file))
-        goto done;
+        return false;
       file_seek (file, file_ofs);
 
       if (file_read (file, &phdr, sizeof phdr) != sizeof phdr)
-        goto done;
+        return false;
       file_ofs += sizeof phdr;
       switch (phdr.p_type)
         {
@@ -501,42 +1086,178 @@ load (struct process_info *p_info, void (**eip) (void), void **esp)
         case PT_DYNAMIC:
         case PT_INTERP:
         case PT_SHLIB:
-          goto done;
+          return false;
         case PT_LOAD:
-          if (validate_segment (&phdr, file))
+          if (!validate_segment (&phdr, file)
+              || layout->segment_cnt == EXEC_SEGMENT_MAX)
+            return false;
+          seg = &layout->segments[layout->segment_cnt++];
+          seg->writable = (phdr.p_flags & PF_W) != 0;
+          seg->file_page = phdr.p_offset & ~PGMASK;
+          seg->mem_page = phdr.p_vaddr & ~PGMASK;
+          page_offset = phdr.p_vaddr & PGMASK;
+          if (phdr.p_filesz > 0)
             {
-              bool writable = (phdr.p_flags & PF_W) != 0;
-              uint32_t file_page = phdr.p_offset & ~PGMASK;
-              uint32_t mem_page = phdr.p_vaddr & ~PGMASK;
-              uint32_t page_offset = phdr.p_vaddr & PGMASK;
-              uint32_t read_bytes, zero_bytes;
-              if (phdr.p_filesz > 0)
-                {
-                  /* Normal segment.
-                     Read initial part from disk and zero the rest. */
-                  read_bytes = page_offset + phdr.p_filesz;
-                  zero_bytes = (ROUND_UP (page_offset + phdr.p_memsz, PGSIZE)
-                                - read_bytes);
-                }
-              else
-                {
-                  /* Entirely zero.
-                     Don't read anything from disk. */
-                  read_bytes = 0;
-                  zero_bytes = ROUND_UP (page_offset + phdr.p_memsz, PGSIZE);
-                }
-              if (!load_segment (mmap, file_page, (void *) mem_page,
-                                 read_bytes, zero_bytes, writable))
-                goto done;
+              /* Normal segment.
+                 Read initial part from disk and zero the rest. */
+              seg->read_bytes = page_offset + phdr.p_filesz;
+              seg->zero_bytes = (ROUND_UP (page_offset + phdr.p_memsz, PGSIZE)
+                                 - seg->read_bytes);
             }
           else
-            goto done;
+            {
+              /* Entirely zero.
+                 Don't read anything from disk. */
+              seg->read_bytes = 0;
+              seg->zero_bytes = ROUND_UP (page_offset + phdr.p_memsz, PGSIZE);
+            }
           break;
         }
     }
+  return true;
+}
+
+/* Stores the layout of the executable FILE in LAYOUT, from the cache
+   if FILE hasn't been written since it was read, or else by reading
+   its headers and adding it to the cache. Returns false if FILE is not
+   an executable we can load. */
+static bool
+layout_get (struct file *file, struct exec_layout *layout)
+{
+  struct inode *inode = file_get_inode (file);
+  block_sector_t inumber = inode_get_inumber (inode);
+  unsigned version = inode_version (inode);
+  struct exec_layout *e, *victim;
+
+  lock_acquire (&exec_cache_lock);
+  for (e = exec_cache; e < exec_cache + EXEC_CACHE_SIZE; e++)
+    if (e->version != 0 && e->inumber == inumber && e->version == version)
+      {
+        e->last_used = ++exec_cache_clock;
+        *layout = *e;
+        lock_release (&exec_cache_lock);
+        return true;
+      }
+  lock_release (&exec_cache_lock);
+
+  /* VERSION was taken before reading, so if FILE is written meanwhile
+     the layout kept won't match any more. */
+  if (!layout_read (file, layout))
+    return false;
+  layout->inumber = inumber;
+  layout->version = version;
+
+  /* Replace an older layout of the same inode, else the least recently
+     used. */
+  lock_acquire (&exec_cache_lock);
+  victim = exec_cache;
+  for (e = exec_cache; e < exec_cache + EXEC_CACHE_SIZE; e++)
+    if (e->version != 0 && e->inumber == inumber)
+      {
+        victim = e;
+        break;
+      }
+    else if (e->last_used < victim->last_used)
+      victim = e;
+  *victim = *layout;
+  victim->last_used = ++exec_cache_clock;
+  lock_release (&exec_cache_lock);
+  return true;
+}
+
+/* Reads the parts of executable FILE that load() maps from it into
+   the buffer cache, along with its inode and indirect blocks, and
+   caches its layout, so that the first exec of it finds them there.
+   Reads no more than *BUDGET bytes of segments and takes what it read
+   off *BUDGET.  Returns false if FILE is not an executable we can
+   load or memory is not available. */
+bool
+process_prefetch (struct file *file, off_t *budget)
+{
+  struct exec_layout layout;
+  void *page;
+  size_t i;
+
+  if (!layout_get (file, &layout))
+    return false;
+  page = palloc_get_page (0);
+  if (page == NULL)
+    return false;
+  for (i = 0; i < layout.segment_cnt && *budget > 0; i++)
+    {
+      struct exec_segment *seg = &layout.segments[i];
+      off_t ofs = seg->file_page;
+      off_t left = seg->read_bytes;
+
+      while (left > 0 && *budget > 0)
+        {
+          off_t chunk = left < PGSIZE ? left : PGSIZE;
+
+          if (file_read_at (file, page, chunk, ofs) != chunk)
+            break;
+          ofs += chunk;
+          left -= chunk;
+          *budget -= chunk;
+        }
+    }
+  palloc_free_page (page);
+  return true;
+}
+
+/* Loads the ELF executable FILE, named in P_INFO, into the current
+   thread. Stores the executable's entry point into *EIP
+   and its initial stack pointer into *ESP.
+   Returns true if successful, false otherwise. */
+bool
+load (struct process_info *p_info, struct file *file,
+      void (**eip) (void), void **esp)
+{
+  struct thread *t = thread_current ();
+  struct exec_layout layout;
+  struct page_mmap *mmap = NULL;
+  bool success = false;
+  size_t i;
+
+  /* Allocate and activate page directory and supplemntal page table. */
+  t->pagedir = pagedir_create ();
+  if (t->pagedir == NULL || !page_table_init ())
+    goto done;
+
+  process_activate ();
+
+  if (file == NULL)
+    {
+      printf ("load: %s: open failed\n", p_info->program_name);
+      goto done;
+    }
+  if (!layout_get (file, &layout))
+    {
+      printf ("load: %s: error loading executable\n", p_info->program_name);
+      goto done;
+    }
+
+  /* Create mmap for executable file*/
+  mmap = page_mmap_new (file, file_length (file));
+  if (mmap == NULL)
+    goto done;
+  mmap->private = true;
+  for (i = 0; i < layout.segment_cnt; i++)
+    {
+      struct exec_segment *seg = &layout.segments[i];
+      void *seg_end;
+
+      if (!load_segment (mmap, seg->file_page, (void *) seg->mem_page,
+                         seg->read_bytes, seg->zero_bytes, seg->writable))
+        goto done;
+      /* The heap starts after the last segment. */
+      seg_end = (void *) (seg->mem_page + seg->read_bytes + seg->zero_bytes);
+      if (seg_end > t->heap_start)
+        t->heap_start = t->heap_break = seg_end;
+    }
 
-  mmap->id = thread_current ()->mmap_next_id++;
-  list_push_back (&thread_current ()->mmap_list, &mmap->list_elem);
+  mmap->id = t->mmap_next_id++;
+  list_push_back (&t->mmap_list, &mmap->list_elem);
+  mmap = NULL;
   /* Set up stack. */
   if (!setup_stack (esp))
     goto done;
@@ -545,15 +1266,15 @@ load (struct process_info *p_info, void (**eip) (void), void **esp)
     goto done;
 
   /* Start address. */
-  *eip = (void (*) (void)) ehdr.e_entry;
+  *eip = layout.entry;
 
   success = true;
 
-// MAY NEED modification
  done:
   /* We arrive here whether the load is successful or not. */
+  if (mmap != NULL)
+    page_delete_mmap (mmap);
   p_info->load_success = success;
-  if (file != NULL) file_close (file);
   return success;
 }
 
@@ -626,28 +1347,9 @@ load_segment (struct page_mmap *mmap, off_t ofs, uint8_t *upage,
   ASSERT (pg_ofs (upage) == 0);
   ASSERT (ofs % PGSIZE == 0);
 
-  while (read_bytes > 0 || zero_bytes > 0)
-    {
-      /* Calculate how to fill this page.
-         We will read PAGE_READ_BYTES bytes from FILE
-         and zero the final PAGE_ZERO_BYTES bytes. */
-      size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
-      size_t page_zero_bytes = PGSIZE - page_read_bytes;
-
-      if (!page_add_to_mmap(mmap, upage, ofs, page_zero_bytes))
-        return false;
-      struct page *page = page_lookup(upage);
-      if (writable)
-        page->evict_to = SWAP;
-      page_set_writable (upage, writable);
-
-      /* Advance. */
-      read_bytes -= page_read_bytes;
-      zero_bytes -= page_zero_bytes;
-      upage += PGSIZE;
-      ofs += PGSIZE;
-    }
-  return true;
+  /* The pages fault in from the region as they are touched. */
+  return page_add_region (mmap, upage, ofs, read_bytes, zero_bytes,
+                          writable);
 }
 
 /* Create a minimal stack by mapping a zeroed page at the top of
@@ -657,10 +1359,10 @@ setup_stack (void **esp)
 {
   uint8_t *page;
 
+  /* The page is zero-filled once the arguments get pushed onto it. */
   page = page_alloc (((uint8_t *) PHYS_BASE) - PGSIZE);
   if (page != NULL)
     {
-      memset (page, 0, PGSIZE);
       *esp = PHYS_BASE;
       return true;
     }
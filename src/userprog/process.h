@@ -1,38 +1,50 @@
 #ifndef USERPROG_PROCESS_H
 #define USERPROG_PROCESS_H
 
+#include "filesys/off_t.h"
 #include "threads/thread.h"
+#include "threads/interrupt.h"
 #include "threads/synch.h"
 #include "userprog/syscall.h"
 
-/* Struct and functions for process fd table*/
-struct process_fd
- {
-   int id;                     /* ID of file descriptor*/
-   struct list_elem list_elem; /* List element to place fd in table*/
-   struct file *file;          /* File associated with fd*/
-   char* file_name;            /* Name of file*/
- };
+struct dir;
+struct file;
 
-int process_new_fd(struct thread *t, struct file *file, char* file_name);
-void process_remove_fd(struct thread *t, int id);
-struct process_fd *process_get_fd(struct thread *t, int id);
+/* Tid for process_waitpid() to wait for any child. */
+#define PROCESS_WAIT_ANY ((tid_t) -1)
 
 /* Keeps track of the status of a child in the list of children
-   of a parent thread. */
+   of a parent thread, or of a thread in the list of threads of its
+   process.  A child process's record is also filed by tid in the
+   process table, and is at the front of its parent's list once it
+   has exited. */
 struct process_child
   {
     tid_t tid;
     struct thread *thread;
     struct list_elem elem;
     int32_t exit_code;
-    struct semaphore exited;
+    struct semaphore exited;            /* Upped when a thread exits. */
+    struct hash_elem table_elem;        /* Child process: table entry. */
+    struct thread *parent;              /* Child process: its parent. */
+    bool has_exited;                    /* Child process: exited yet? */
   };
 
 void process_init (void);
 tid_t process_execute (const char *file_name);
+tid_t process_spawn (const char *cmd_line, struct dir *cwd,
+                     struct fd_entry *fd_table, int fd_cnt, bool wait_load);
+tid_t process_fork (struct intr_frame *f);
 int process_wait (tid_t);
+tid_t process_waitpid (tid_t, int *exit_code, bool nohang);
 void process_exit (void);
 void process_activate (void);
+tid_t process_thread_create (void *eip, void *esp);
+int process_thread_join (tid_t);
+void process_terminate (int status) NO_RETURN;
+bool process_is_exiting (void);
+void process_get_times (struct thread *p, uint64_t *user_ns,
+                        uint64_t *kernel_ns);
+bool process_prefetch (struct file *, off_t *budget);
 
 #endif /* userprog/process.h */
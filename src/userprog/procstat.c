@@ -0,0 +1,136 @@
+#include "userprog/procstat.h"
+#include <inttypes.h>
+#include <stdio.h>
+
+/* Per-process CPU time and I/O and memory statistics.
+
+   The file system, the buffer cache and the VM code count what each
+   process does into the struct procstat of its first thread, for
+   the procstat system call to read, and for the process to print at
+   exit under "-procstat", so that the one behind a burst of disk
+   traffic or a shortage of frames can be found.  Work one process
+   does on behalf of another, such as evicting its pages, is charged
+   to the one whose data it is, and work on shared frames to nobody.
+   On exit a process adds its own statistics and its children's to
+   its parent's children's.  CPU time is kept by each thread (see
+   thread_account_time()), and a thread other than the first adds its
+   own to the process's as it exits.
+
+   The counters are guarded by turning interrupts off, except for
+   PEAK_FRAMES, which the frame table updates under its own lock.  The
+   buffer cache keeps hit and miss counts and the frame table resident
+   frames per process already, which a snapshot copies in. */
+
+static void procstat_sum (struct procstat *sum, const struct procstat *);
+
+/* Set by "-procstat". */
+bool procstat_enabled;
+
+/* Stores a snapshot of the statistics of process P in *ST, with the
+   CPU time of its first thread and of the others that have exited. */
+void
+procstat_get (struct thread *p, struct procstat *st)
+{
+  enum intr_level old_level = intr_disable ();
+  uint64_t user_ns, kernel_ns;
+
+  *st = p->procstat;
+  thread_get_times (p, &user_ns, &kernel_ns);
+  st->user_ns += user_ns;
+  st->kernel_ns += kernel_ns;
+  st->cache_hits = p->cache_hits;
+  st->cache_misses = p->cache_misses;
+  st->frames = p->resident_cnt;
+  if (st->peak_frames < st->frames)
+    st->peak_frames = st->frames;
+  intr_set_level (old_level);
+}
+
+/* Stores the totals of the statistics of the children of process P
+   that have exited, and of their children, in *ST. */
+void
+procstat_get_children (struct thread *p, struct procstat *st)
+{
+  enum intr_level old_level = intr_disable ();
+
+  *st = p->procstat_children;
+  intr_set_level (old_level);
+}
+
+/* Adds the statistics of process P, which is exiting, and those of
+   its children to the children's totals of PARENT. */
+void
+procstat_exit (struct thread *p, struct thread *parent)
+{
+  struct procstat own, children;
+  enum intr_level old_level;
+
+  procstat_get (p, &own);
+  procstat_get_children (p, &children);
+  own.frames = 0;
+  old_level = intr_disable ();
+  procstat_sum (&parent->procstat_children, &own);
+  procstat_sum (&parent->procstat_children, &children);
+  intr_set_level (old_level);
+}
+
+/* Adds the CPU time of thread T, which is exiting, to that of process
+   P, the process it is a thread of but not the first thread. */
+void
+procstat_thread_exit (struct thread *t, struct thread *p)
+{
+  uint64_t user_ns, kernel_ns;
+  enum intr_level old_level;
+
+  thread_get_times (t, &user_ns, &kernel_ns);
+  old_level = intr_disable ();
+  p->procstat.user_ns += user_ns;
+  p->procstat.kernel_ns += kernel_ns;
+  intr_set_level (old_level);
+}
+
+/* Prints the statistics of process P, named for its program. */
+void
+procstat_print (struct thread *p)
+{
+  struct procstat st;
+  const uint64_t *f = st.faults;
+
+  procstat_get (p, &st);
+  printf ("%s: procstat: cpu %"PRIu64" user %"PRIu64" kernel us; "
+          "read %"PRIu64" written %"PRIu64" bytes; "
+          "cache %"PRIu64" hits %"PRIu64" misses; "
+          "faults %"PRIu64" new %"PRIu64" zero %"PRIu64" swap "
+          "%"PRIu64" file %"PRIu64" shm %"PRIu64" cow %"PRIu64" stack; "
+          "swap %"PRIu64" in %"PRIu64" out; "
+          "%"PRIu32" peak frames\n",
+          p->process_fn, st.user_ns / 1000, st.kernel_ns / 1000,
+          st.read_bytes, st.write_bytes,
+          st.cache_hits, st.cache_misses,
+          f[PROCSTAT_FAULT_NEW], f[PROCSTAT_FAULT_ZERO],
+          f[PROCSTAT_FAULT_SWAP], f[PROCSTAT_FAULT_FILE],
+          f[PROCSTAT_FAULT_SHM], f[PROCSTAT_FAULT_COW],
+          f[PROCSTAT_FAULT_STACK], st.swap_ins, st.swap_outs,
+          st.peak_frames);
+}
+
+/* Adds the counters of ST to those of SUM, and keeps the larger of
+   their peaks. */
+static void
+procstat_sum (struct procstat *sum, const struct procstat *st)
+{
+  size_t i;
+
+  sum->user_ns += st->user_ns;
+  sum->kernel_ns += st->kernel_ns;
+  sum->read_bytes += st->read_bytes;
+  sum->write_bytes += st->write_bytes;
+  sum->cache_hits += st->cache_hits;
+  sum->cache_misses += st->cache_misses;
+  for (i = 0; i < PROCSTAT_FAULT_CNT; i++)
+    sum->faults[i] += st->faults[i];
+  sum->swap_ins += st->swap_ins;
+  sum->swap_outs += st->swap_outs;
+  if (sum->peak_frames < st->peak_frames)
+    sum->peak_frames = st->peak_frames;
+}
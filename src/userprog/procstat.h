@@ -0,0 +1,36 @@
+#ifndef USERPROG_PROCSTAT_H
+#define USERPROG_PROCSTAT_H
+
+#include <procstat.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "threads/interrupt.h"
+#include "threads/thread.h"
+
+/* Set by the "-procstat" kernel command-line option. */
+extern bool procstat_enabled;
+
+void procstat_get (struct thread *p, struct procstat *);
+void procstat_get_children (struct thread *p, struct procstat *);
+void procstat_exit (struct thread *p, struct thread *parent);
+void procstat_thread_exit (struct thread *t, struct thread *p);
+void procstat_print (struct thread *p);
+
+/* Adds N to counter C of a process's statistics, which threads of
+   other processes may be adding to as well. */
+static inline void
+procstat_add (uint64_t *c, uint64_t n)
+{
+  enum intr_level old_level = intr_disable ();
+  *c += n;
+  intr_set_level (old_level);
+}
+
+/* Returns the statistics of the process the running thread is in. */
+static inline struct procstat *
+procstat_current (void)
+{
+  return &thread_current ()->process->procstat;
+}
+
+#endif /* userprog/procstat.h */
@@ -1,28 +1,132 @@
 #include "userprog/syscall.h"
+#include "userprog/futex.h"
 #include "userprog/pagedir.h"
+#include "userprog/pipe.h"
 #include "userprog/process.h"
+#include "userprog/procstat.h"
+#include "userprog/uaccess.h"
+#include <inttypes.h>
 #include <stdio.h>
 #include <syscall-nr.h>
 #include <stddef.h>
-#include <hash.h>
+#include <cachestat.h>
+#include <memstat.h>
+#include <mempressure.h>
+#include <poll.h>
+#include <ring.h>
+#include <rusage.h>
+#include <spawn.h>
+#include <syscallstat.h>
+#include <round.h>
+#include <uio.h>
 #include <string.h>
 #include "threads/interrupt.h"
+#include "threads/kstat.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/poll.h"
 #include "threads/thread.h"
 #include "threads/synch.h"
+#include "threads/trace.h"
 #include "threads/vaddr.h"
-#include "threads/malloc.h"
 #include "devices/shutdown.h"
 #include "devices/input.h"
+#include "devices/timer.h"
+#include "filesys/cache.h"
 #include "filesys/filesys.h"
+#include "vm/frame.h"
 #include "vm/page.h"
+#include "vm/share.h"
 
-/* Array of syscall handler functions to dispatch on interrupt. */
-#define SYSCALL_CNT SYS_INUMBER + 1
+/* Array of syscall handler functions to dispatch on interrupt, with
+   the number of 32-bit arguments each takes. */
+#define SYSCALL_CNT (SYS_GETRUSAGE + 1)
 typedef void syscall_handler_func (struct intr_frame *);
 static syscall_handler_func *syscall_handlers[SYSCALL_CNT];
+static uint8_t syscall_arg_cnts[SYSCALL_CNT];
+
+/* Names of the syscalls, for printing statistics. */
+static const char *syscall_names[SYSCALL_CNT] =
+  {
+    [SYS_HALT] = "halt",
+    [SYS_EXIT] = "exit",
+    [SYS_EXEC] = "exec",
+    [SYS_WAIT] = "wait",
+    [SYS_CREATE] = "create",
+    [SYS_REMOVE] = "remove",
+    [SYS_OPEN] = "open",
+    [SYS_FILESIZE] = "filesize",
+    [SYS_READ] = "read",
+    [SYS_WRITE] = "write",
+    [SYS_SEEK] = "seek",
+    [SYS_TELL] = "tell",
+    [SYS_CLOSE] = "close",
+    [SYS_MMAP] = "mmap",
+    [SYS_MUNMAP] = "munmap",
+    [SYS_CHDIR] = "chdir",
+    [SYS_MKDIR] = "mkdir",
+    [SYS_READDIR] = "readdir",
+    [SYS_ISDIR] = "isdir",
+    [SYS_INUMBER] = "inumber",
+    [SYS_GETDENTS] = "getdents",
+    [SYS_FSYNC] = "fsync",
+    [SYS_FORK] = "fork",
+    [SYS_MSYNC] = "msync",
+    [SYS_MADVISE] = "madvise",
+    [SYS_SBRK] = "sbrk",
+    [SYS_LOCKSTAT] = "lockstat",
+    [SYS_MEMSTAT] = "memstat",
+    [SYS_PREAD] = "pread",
+    [SYS_PWRITE] = "pwrite",
+    [SYS_READV] = "readv",
+    [SYS_WRITEV] = "writev",
+    [SYS_COPY_FILE_RANGE] = "copy_file_range",
+    [SYS_RING_ENTER] = "ring_enter",
+    [SYS_PIPE] = "pipe",
+    [SYS_SHM_CREATE] = "shm_create",
+    [SYS_FUTEX_WAIT] = "futex_wait",
+    [SYS_FUTEX_WAKE] = "futex_wake",
+    [SYS_THREAD_CREATE] = "thread_create",
+    [SYS_THREAD_EXIT] = "thread_exit",
+    [SYS_THREAD_JOIN] = "thread_join",
+    [SYS_POLL] = "poll",
+    [SYS_TRACE_READ] = "trace_read",
+    [SYS_SYSCALLSTAT] = "syscallstat",
+    [SYS_KSTAT] = "kstat",
+    [SYS_FTRUNCATE] = "ftruncate",
+    [SYS_FALLOCATE] = "fallocate",
+    [SYS_RENAME] = "rename",
+    [SYS_STAT] = "stat",
+    [SYS_FSTAT] = "fstat",
+    [SYS_OPENAT] = "openat",
+    [SYS_CREATEAT] = "createat",
+    [SYS_REMOVEAT] = "removeat",
+    [SYS_MKDIRAT] = "mkdirat",
+    [SYS_DEFRAG] = "defrag",
+    [SYS_CACHESTAT] = "cachestat",
+    [SYS_SCHED_DEADLINE] = "sched_deadline",
+    [SYS_GETPRIORITY] = "getpriority",
+    [SYS_SETPRIORITY] = "setpriority",
+    [SYS_GETNICE] = "getnice",
+    [SYS_SETNICE] = "setnice",
+    [SYS_SPAWN] = "spawn",
+    [SYS_WAITPID] = "waitpid",
+    [SYS_PROCSTAT] = "procstat",
+    [SYS_MEMPRESSURE_OPEN] = "mempressure_open",
+    [SYS_CLONE] = "clone",
+    [SYS_MMAP_RANGE] = "mmap_range",
+    [SYS_GETRUSAGE] = "getrusage",
+  };
+
+/* If false (default), no system call statistics are kept.
+   Controlled by kernel command-line option "-syscallstat". */
+bool syscall_stats_enabled;
+
+/* Statistics of all processes' system calls, by number, guarded
+   like each process's by turning interrupts off. */
+static struct syscallstat syscall_stats[SYSCALL_CNT];
 
 /* Syscall handlers prototypes. */
-static void syscall_handler (struct intr_frame *);
 static void syscall_halt (struct intr_frame *);
 static void syscall_exit (struct intr_frame *);
 static void syscall_exec (struct intr_frame *);
@@ -32,6 +136,19 @@ static void syscall_mkdir (struct intr_frame *f);
 static void syscall_readdir (struct intr_frame *f);
 static void syscall_isdir (struct intr_frame *f);
 static void syscall_inumber (struct intr_frame *f);
+static void syscall_getdents (struct intr_frame *f);
+static void syscall_fsync (struct intr_frame *f);
+static void syscall_ftruncate (struct intr_frame *f);
+static void syscall_fallocate (struct intr_frame *f);
+static void syscall_rename (struct intr_frame *f);
+static void syscall_stat (struct intr_frame *f);
+static void syscall_fstat (struct intr_frame *f);
+static void syscall_openat (struct intr_frame *f);
+static void syscall_createat (struct intr_frame *f);
+static void syscall_removeat (struct intr_frame *f);
+static void syscall_mkdirat (struct intr_frame *f);
+static void syscall_defrag (struct intr_frame *f);
+static void syscall_fork (struct intr_frame *f);
 static void syscall_create (struct intr_frame *);
 static void syscall_remove (struct intr_frame *);
 static void syscall_open (struct intr_frame *);
@@ -42,72 +159,265 @@ static void syscall_seek (struct intr_frame *);
 static void syscall_tell (struct intr_frame *);
 static void syscall_close (struct intr_frame *);
 static void syscall_mmap (struct intr_frame *);
+static void syscall_mmap_range (struct intr_frame *);
 static void syscall_munmap (struct intr_frame *);
+static void syscall_msync (struct intr_frame *);
+static void syscall_madvise (struct intr_frame *);
+static void syscall_sbrk (struct intr_frame *);
+static void syscall_lockstat (struct intr_frame *);
+static void syscall_memstat (struct intr_frame *);
+static void syscall_pread (struct intr_frame *);
+static void syscall_pwrite (struct intr_frame *);
+static void syscall_readv (struct intr_frame *);
+static void syscall_writev (struct intr_frame *);
+static void syscall_copy_file_range (struct intr_frame *);
+static void syscall_ring_enter (struct intr_frame *);
+static void syscall_pipe (struct intr_frame *);
+static void syscall_shm_create (struct intr_frame *);
+static void syscall_futex_wait (struct intr_frame *);
+static void syscall_futex_wake (struct intr_frame *);
+static void syscall_thread_create (struct intr_frame *);
+static void syscall_thread_exit (struct intr_frame *);
+static void syscall_thread_join (struct intr_frame *);
+static void syscall_poll (struct intr_frame *);
+static unsigned syscall_poll_fd (int fd, unsigned events,
+                                 struct poll_table *, struct poll_entry *);
+static void syscall_trace_read (struct intr_frame *);
+static void syscall_syscallstat (struct intr_frame *);
+static void syscall_kstat (struct intr_frame *);
+static void syscall_cachestat (struct intr_frame *);
+static void syscall_sched_deadline (struct intr_frame *);
+static void syscall_getpriority (struct intr_frame *);
+static void syscall_setpriority (struct intr_frame *);
+static void syscall_getnice (struct intr_frame *);
+static void syscall_setnice (struct intr_frame *);
+static void syscall_spawn (struct intr_frame *);
+static void syscall_waitpid (struct intr_frame *);
+static void syscall_procstat (struct intr_frame *);
+static void syscall_getrusage (struct intr_frame *);
+static void syscall_mempressure_open (struct intr_frame *);
+static void syscall_clone (struct intr_frame *);
+static void syscall_account (int nr, uint64_t cycles);
+static void syscall_account_one (struct syscallstat *, size_t bucket,
+                                 uint64_t cycles);
+static void syscall_print_table (const char *who,
+                                 const struct syscallstat *);
+static int syscall_ring_execute (const struct ring_sqe *);
+static int syscall_do_open (int dirfd, const char *upath, int flags);
+static bool syscall_open_base (int dirfd, struct dir **basep);
+static bool syscall_do_close (int fd);
+static void syscall_transfer_vector (struct intr_frame *, bool write);
+static int syscall_transfer (int fd, bool write, const struct iovec *,
+                             size_t iov_cnt, off_t *pos);
 
 /* User memory access infrastructure. */
 static uint32_t syscall_get_arg (struct intr_frame *f, size_t idx);
-static void syscall_validate_user_memory (const void *uaddr, size_t, bool);
-static void syscall_validate_user_string (const char *uaddr, size_t max_size);
-static void syscall_terminate_process (void);
+static char *syscall_copy_in_string (const char *ustr);
+static void syscall_copy_in (void *dst, const void *usrc, size_t size);
+static void syscall_copy_out (void *udst, const void *src, size_t size);
+static void syscall_terminate_process (void) NO_RETURN;
+static void syscall_register (int nr, syscall_handler_func *, int arg_cnt);
+
+/* What a file descriptor refers to. */
+enum fd_type
+  {
+    FD_FILE,                    /* struct file *. */
+    FD_DIR,                     /* struct dir *. */
+    FD_PIPE_READER,             /* Read end of a struct pipe *. */
+    FD_PIPE_WRITER,             /* Write end of a struct pipe *. */
+    FD_SHM,                     /* struct shm *. */
+    FD_MEMPRESSURE              /* struct pressure_watch *. */
+  };
 
-/* Represents a file descriptor in the current process fd_table. */
+/* Represents a file descriptor in the current process fd_table, which
+   is an array indexed by fd.  An entry with a null FILESYS_PTR is
+   free. */
 struct fd_entry
   {
-    struct hash_elem hash_elem; /* Element in fd_table. */
-    int fd;                     /* File descriptor. */
-    void *filesys_ptr;          /* struct file * or struct dir *. */
-    bool isdir;                 /* True if filesys_ptr is struct dir *. */
+    void *filesys_ptr;          /* What TYPE says. */
+    enum fd_type type;          /* Type of FILESYS_PTR. */
   };
 /* File descriptors 0, 1, and 2 are reserved for std i/o/e. */
 #define SYSCALL_FIRST_FD 3
-static hash_less_func fd_entry_less;
-static hash_hash_func fd_entry_hash;
-static hash_action_func fd_entry_destroy;
-static int fd_allocate (void);
-static struct fd_entry *fd_lookup (int);
+/* Entries in a process's first fd_table. */
+#define SYSCALL_FD_TABLE_MIN 16
+/* Most pages in a shared memory segment. */
+#define SYSCALL_SHM_PAGES_MAX 4096
+/* Most pages of a user buffer pinned at once for file or pipe I/O. */
+#define SYSCALL_PIN_PAGES 16
+/* Highest file descriptor a spawn action may set up. */
+#define SYSCALL_SPAWN_FD_MAX 1023
+static int fd_allocate (void *filesys_ptr, enum fd_type);
+static bool fd_entry_reopen (const struct fd_entry *, struct fd_entry *copy);
+static void fd_entry_close (struct fd_entry *);
+static struct fd_entry *fd_lookup (int, struct fd_entry *copy);
+static bool fd_remove (int, struct fd_entry *entry);
 
 /* Initialize syscalls by registering dispatch functions for supported
    syscall numbers and then registering the syscall interrupt handler. */
 void
 syscall_init (void)
 {
-  syscall_handlers[SYS_HALT] = syscall_halt;
-  syscall_handlers[SYS_EXIT] = syscall_exit;
-  syscall_handlers[SYS_EXEC] = syscall_exec;
-  syscall_handlers[SYS_WAIT] = syscall_wait;
-  syscall_handlers[SYS_CREATE] = syscall_create;
-  syscall_handlers[SYS_REMOVE] = syscall_remove;
-  syscall_handlers[SYS_OPEN] = syscall_open;
-  syscall_handlers[SYS_FILESIZE] = syscall_filesize;
-  syscall_handlers[SYS_READ] = syscall_read;
-  syscall_handlers[SYS_WRITE] = syscall_write;
-  syscall_handlers[SYS_SEEK] = syscall_seek;
-  syscall_handlers[SYS_TELL] = syscall_tell;
-  syscall_handlers[SYS_CLOSE] = syscall_close;
-  syscall_handlers[SYS_MMAP] = syscall_mmap;
-  syscall_handlers[SYS_MUNMAP] = syscall_munmap;
-  syscall_handlers[SYS_CHDIR] = syscall_chdir;
-  syscall_handlers[SYS_MKDIR] = syscall_mkdir;
-  syscall_handlers[SYS_READDIR] = syscall_readdir;
-  syscall_handlers[SYS_ISDIR] = syscall_isdir;
-  syscall_handlers[SYS_INUMBER] = syscall_inumber;
+  syscall_register (SYS_HALT, syscall_halt, 0);
+  syscall_register (SYS_EXIT, syscall_exit, 1);
+  syscall_register (SYS_EXEC, syscall_exec, 1);
+  syscall_register (SYS_WAIT, syscall_wait, 1);
+  syscall_register (SYS_CREATE, syscall_create, 2);
+  syscall_register (SYS_REMOVE, syscall_remove, 1);
+  syscall_register (SYS_OPEN, syscall_open, 1);
+  syscall_register (SYS_FILESIZE, syscall_filesize, 1);
+  syscall_register (SYS_READ, syscall_read, 3);
+  syscall_register (SYS_WRITE, syscall_write, 3);
+  syscall_register (SYS_SEEK, syscall_seek, 2);
+  syscall_register (SYS_TELL, syscall_tell, 1);
+  syscall_register (SYS_CLOSE, syscall_close, 1);
+  syscall_register (SYS_MMAP, syscall_mmap, 2);
+  syscall_register (SYS_MUNMAP, syscall_munmap, 1);
+  syscall_register (SYS_CHDIR, syscall_chdir, 1);
+  syscall_register (SYS_MKDIR, syscall_mkdir, 1);
+  syscall_register (SYS_READDIR, syscall_readdir, 2);
+  syscall_register (SYS_ISDIR, syscall_isdir, 1);
+  syscall_register (SYS_INUMBER, syscall_inumber, 1);
+  syscall_register (SYS_GETDENTS, syscall_getdents, 3);
+  syscall_register (SYS_FSYNC, syscall_fsync, 1);
+  syscall_register (SYS_FORK, syscall_fork, 0);
+  syscall_register (SYS_MSYNC, syscall_msync, 1);
+  syscall_register (SYS_MADVISE, syscall_madvise, 2);
+  syscall_register (SYS_SBRK, syscall_sbrk, 1);
+  syscall_register (SYS_LOCKSTAT, syscall_lockstat, 2);
+  syscall_register (SYS_MEMSTAT, syscall_memstat, 1);
+  syscall_register (SYS_PREAD, syscall_pread, 4);
+  syscall_register (SYS_PWRITE, syscall_pwrite, 4);
+  syscall_register (SYS_READV, syscall_readv, 3);
+  syscall_register (SYS_WRITEV, syscall_writev, 3);
+  syscall_register (SYS_COPY_FILE_RANGE, syscall_copy_file_range, 3);
+  syscall_register (SYS_RING_ENTER, syscall_ring_enter, 2);
+  syscall_register (SYS_PIPE, syscall_pipe, 1);
+  syscall_register (SYS_SHM_CREATE, syscall_shm_create, 1);
+  syscall_register (SYS_FUTEX_WAIT, syscall_futex_wait, 2);
+  syscall_register (SYS_FUTEX_WAKE, syscall_futex_wake, 2);
+  syscall_register (SYS_THREAD_CREATE, syscall_thread_create, 2);
+  syscall_register (SYS_THREAD_EXIT, syscall_thread_exit, 1);
+  syscall_register (SYS_THREAD_JOIN, syscall_thread_join, 1);
+  syscall_register (SYS_POLL, syscall_poll, 3);
+  syscall_register (SYS_TRACE_READ, syscall_trace_read, 2);
+  syscall_register (SYS_SYSCALLSTAT, syscall_syscallstat, 3);
+  syscall_register (SYS_KSTAT, syscall_kstat, 2);
+  syscall_register (SYS_FTRUNCATE, syscall_ftruncate, 2);
+  syscall_register (SYS_FALLOCATE, syscall_fallocate, 3);
+  syscall_register (SYS_RENAME, syscall_rename, 2);
+  syscall_register (SYS_STAT, syscall_stat, 2);
+  syscall_register (SYS_FSTAT, syscall_fstat, 2);
+  syscall_register (SYS_OPENAT, syscall_openat, 3);
+  syscall_register (SYS_CREATEAT, syscall_createat, 3);
+  syscall_register (SYS_REMOVEAT, syscall_removeat, 2);
+  syscall_register (SYS_MKDIRAT, syscall_mkdirat, 2);
+  syscall_register (SYS_DEFRAG, syscall_defrag, 1);
+  syscall_register (SYS_CACHESTAT, syscall_cachestat, 1);
+  syscall_register (SYS_SCHED_DEADLINE, syscall_sched_deadline, 2);
+  syscall_register (SYS_GETPRIORITY, syscall_getpriority, 0);
+  syscall_register (SYS_SETPRIORITY, syscall_setpriority, 1);
+  syscall_register (SYS_GETNICE, syscall_getnice, 0);
+  syscall_register (SYS_SETNICE, syscall_setnice, 1);
+  syscall_register (SYS_SPAWN, syscall_spawn, 4);
+  syscall_register (SYS_WAITPID, syscall_waitpid, 3);
+  syscall_register (SYS_PROCSTAT, syscall_procstat, 2);
+  syscall_register (SYS_MEMPRESSURE_OPEN, syscall_mempressure_open, 1);
+  syscall_register (SYS_CLONE, syscall_clone, 2);
+  syscall_register (SYS_MMAP_RANGE, syscall_mmap_range, 4);
+  syscall_register (SYS_GETRUSAGE, syscall_getrusage, 2);
+  futex_init ();
   
   barrier ();  /* Write all handlers before starting syscalls. */
   intr_register_int (0x30, 3, INTR_ON, syscall_handler, "syscall");
 }
 
-/* Initializes the file descriptor infrastructure for the current thread. */
+/* Registers HANDLER for syscall number NR, which takes ARG_CNT
+   arguments. */
+static void
+syscall_register (int nr, syscall_handler_func *handler, int arg_cnt)
+{
+  ASSERT (nr >= 0 && nr < SYSCALL_CNT);
+  syscall_handlers[nr] = handler;
+  syscall_arg_cnts[nr] = arg_cnt;
+}
+
+/* Initializes the file descriptor infrastructure for the current thread,
+   the first of a new process.  Returns false if memory is not
+   available. */
 bool 
 syscall_process_init (void)
 {
   struct thread *t = thread_current ();
 
-  t->fd_next = SYSCALL_FIRST_FD;
-  t->fd_table_ready = hash_init (&t->fd_table, fd_entry_hash, 
-                                 fd_entry_less, NULL);
-  return t->fd_table_ready;
+  t->fd_table = NULL;
+  t->fd_cnt = 0;
+  t->syscall_stats = NULL;
+  t->syscall_lock = malloc (sizeof *t->syscall_lock);
+  if (t->syscall_lock == NULL)
+    return false;
+  lock_init (t->syscall_lock);
+  if (syscall_stats_enabled)
+    {
+      t->syscall_stats = calloc (SYSCALL_CNT, sizeof *t->syscall_stats);
+      if (t->syscall_stats == NULL)
+        return false;
+    }
+  return true;
+}
+
+/* Initializes the file descriptor infrastructure for the current thread
+   as a copy of PARENT's, reopening each of its files, directories,
+   pipe ends and shared memory segments under the same descriptor.
+   Files keep their positions.  The caller holds PARENT's
+   syscall_lock. */
+bool
+syscall_process_fork (struct thread *parent)
+{
+  struct thread *t = thread_current ();
+  int fd;
+
+  if (!syscall_process_init ())
+    return false;
+  if (parent->fd_cnt == 0)
+    return true;
+  t->fd_table = calloc (parent->fd_cnt, sizeof *t->fd_table);
+  if (t->fd_table == NULL)
+    return false;
+  t->fd_cnt = parent->fd_cnt;
+  for (fd = SYSCALL_FIRST_FD; fd < parent->fd_cnt; fd++)
+    if (parent->fd_table[fd].filesys_ptr != NULL
+        && !fd_entry_reopen (&parent->fd_table[fd], &t->fd_table[fd]))
+      return false;
+  return true;
+}
+
+/* Initializes the file descriptor infrastructure for the current thread
+   with the FD_CNT entries of FD_TABLE, which spawn set up for it, as
+   its open files.  Takes over FD_TABLE even if it fails, leaving it
+   for syscall_process_done() to close. */
+bool
+syscall_process_spawn (struct fd_entry *fd_table, int fd_cnt)
+{
+  struct thread *t = thread_current ();
+  bool success = syscall_process_init ();
+
+  t->fd_table = fd_table;
+  t->fd_cnt = fd_cnt;
+  return success;
 }
 
+/* Closes everything in the FD_CNT entries of FD_TABLE and frees it. */
+void
+syscall_fds_free (struct fd_entry *fd_table, int fd_cnt)
+{
+  int fd;
+
+  for (fd = SYSCALL_FIRST_FD; fd < fd_cnt; fd++)
+    if (fd_table[fd].filesys_ptr != NULL)
+      fd_entry_close (&fd_table[fd]);
+  free (fd_table);
+}
 
 /* Frees up the resources allocated for system calls if any. */
 void 
@@ -115,34 +425,73 @@ syscall_process_done (void)
 {
   struct thread *t = thread_current ();
 
-  /* Check if nothing was allocated in the first place and abort. */
-  if (!t->fd_table_ready)
-    return;
   /* Destroy the open file table by closing its files. */
-  hash_destroy (&t->fd_table, fd_entry_destroy);
-  t->fd_table_ready = false;
+  syscall_fds_free (t->fd_table, t->fd_cnt);
+  t->fd_table = NULL;
+  t->fd_cnt = 0;
+  free (t->syscall_lock);
+  t->syscall_lock = NULL;
+  if (t->syscall_stats != NULL)
+    {
+      syscall_print_table (t->name, t->syscall_stats);
+      free (t->syscall_stats);
+      t->syscall_stats = NULL;
+    }
 }
 
 /* Dispatches the correct syscall function to handle a syscall
-   interrupt. */
-static void
+   interrupt, or a sysenter from sysenter_entry in sysenter.S. */
+void
 syscall_handler (struct intr_frame *f)
 {
+  struct thread *t = thread_current ();
   int syscall_number;
   syscall_handler_func *handler_func;
 
   ASSERT (f != NULL);
 
-  syscall_number = syscall_get_arg(f, 0);
+  /* Copy in the syscall number, then all of its arguments at once,
+     for syscall_get_arg() to return. */
+  t->syscall_esp = f->esp;
+  syscall_copy_in (t->syscall_args, f->esp, sizeof *t->syscall_args);
+  syscall_number = t->syscall_args[0];
   if (syscall_number < 0 || syscall_number >= SYSCALL_CNT
       || syscall_handlers[syscall_number] == NULL)
     /* Unsupported syscall. */
     syscall_terminate_process ();
   else
     {
+      syscall_copy_in (t->syscall_args + 1, (uint32_t *) f->esp + 1,
+                       syscall_arg_cnts[syscall_number]
+                       * sizeof *t->syscall_args);
       handler_func = syscall_handlers[syscall_number];
-      handler_func (f);
+      TRACE (TRACE_SYSCALL_ENTER, syscall_number, 0);
+      if (!syscall_stats_enabled)
+        handler_func (f);
+      else
+        {
+          struct syscallstat *own = t->process->syscall_stats;
+          enum intr_level old_level;
+          uint64_t start;
+
+          /* Count the call before running it, since exit and the
+             like never come back to be timed. */
+          old_level = intr_disable ();
+          syscall_stats[syscall_number].call_cnt++;
+          if (own != NULL)
+            own[syscall_number].call_cnt++;
+          intr_set_level (old_level);
+
+          start = timer_tsc ();
+          handler_func (f);
+          syscall_account (syscall_number, timer_tsc () - start);
+        }
+      TRACE (TRACE_SYSCALL_EXIT, syscall_number, f->eax);
     }
+
+  /* Don't go back to a process that another thread is terminating. */
+  if (process_is_exiting ())
+    thread_exit ();
 }
 
 /* Shuts down the machine by calling shutdown_power_off.
@@ -153,14 +502,13 @@ syscall_halt (struct intr_frame *f UNUSED)
   shutdown_power_off ();
 }
 
-/* Terminates the current user program, returning STATUS to the parent.
-   Never returns. */
+/* Terminates the current user program, all of its threads, returning
+   STATUS to the parent.  Never returns. */
 static void
 syscall_exit (struct intr_frame *f)
 {
   int32_t status = syscall_get_arg (f, 1);
-  thread_current ()->process_exit_code = status;
-  thread_exit ();
+  process_terminate (status);
 }
 
 /* Runs the executable whose name is given in CMD_LINE, 
@@ -169,12 +517,21 @@ syscall_exit (struct intr_frame *f)
 static void
 syscall_exec (struct intr_frame *f)
 {
-  const char *cmd_line = (const char* ) syscall_get_arg (f, 1);
-  syscall_validate_user_string (cmd_line, PGSIZE);
+  char *cmd_line = syscall_copy_in_string ((const char *) syscall_get_arg (f, 1));
   tid_t tid = process_execute (cmd_line);
+  palloc_free_page (cmd_line);
   f->eax = tid;
 }
 
+/* Creates a child process running a copy of the current one, which
+   returns 0 in the child and the child's TID in the parent, or
+   TID_ERROR if the child couldn't be created. */
+static void
+syscall_fork (struct intr_frame *f)
+{
+  f->eax = process_fork (f);
+}
+
 /* Waits for a child process TID and retrieves the child's exit status. */
 static void
 syscall_wait (struct intr_frame *f)
@@ -190,18 +547,22 @@ syscall_wait (struct intr_frame *f)
 static void
 syscall_chdir (struct intr_frame *f)
 {
-  const char *dir_path = (const char *) syscall_get_arg (f, 1);
+  char *dir_path = syscall_copy_in_string ((const char *) syscall_get_arg (f, 1));
   void *dir_filesys_ptr;
   bool isdir = false;
-  syscall_validate_user_string (dir_path, PGSIZE);
 
   f->eax = false;
   dir_filesys_ptr = filesys_open (dir_path, &isdir);
+  palloc_free_page (dir_path);
   if (dir_filesys_ptr != NULL && isdir)
     {
+      struct thread *p = thread_current ()->process;
+
       /* Close the old directory and setup the new one. */
-      filesys_closedir (thread_current ()->cwd);
-      thread_current ()->cwd = dir_filesys_ptr;
+      lock_acquire (p->syscall_lock);
+      filesys_closedir (p->cwd);
+      p->cwd = dir_filesys_ptr;
+      lock_release (p->syscall_lock);
       f->eax = true;
     }
   else if (dir_filesys_ptr != NULL)
@@ -217,10 +578,27 @@ syscall_chdir (struct intr_frame *f)
 static void
 syscall_mkdir (struct intr_frame *f)
 {
-  const char *dir_path = (const char* ) syscall_get_arg (f, 1);
-  syscall_validate_user_string (dir_path, PGSIZE);
-  
+  char *dir_path = syscall_copy_in_string ((const char *) syscall_get_arg (f, 1));
+
   f->eax = filesys_mkdir (dir_path);
+  palloc_free_page (dir_path);
+}
+
+/* Like syscall_mkdir(), but relative to directory DIRFD. */
+static void
+syscall_mkdirat (struct intr_frame *f)
+{
+  int32_t dirfd = syscall_get_arg (f, 1);
+  char *dir_path = syscall_copy_in_string ((const char *) syscall_get_arg (f, 2));
+  struct dir *base;
+
+  f->eax = false;
+  if (syscall_open_base (dirfd, &base))
+    {
+      f->eax = filesys_mkdir_at (base, dir_path);
+      filesys_closedir (base);
+    }
+  palloc_free_page (dir_path);
 }
 
 /* Reads a directory entry from file descriptor FD, which must represent a
@@ -232,16 +610,20 @@ syscall_readdir (struct intr_frame *f)
 {
   int32_t fd = syscall_get_arg (f, 1);
   char *name = (char *) syscall_get_arg (f, 2);
-  struct fd_entry *fd_entry;
-  syscall_validate_user_memory (name, FILESYS_NAME_MAX + 1, true);
+  char kname[FILESYS_NAME_MAX + 1];
+  struct fd_entry fd_copy, *fd_entry;
 
-  fd_entry = fd_lookup (fd);
-  if (fd_entry == NULL || !fd_entry->isdir)
+  fd_entry = fd_lookup (fd, &fd_copy);
+  if (fd_entry == NULL || fd_entry->type != FD_DIR)
     /* FD invalid or not a directory, fail. */
     f->eax = false;
   else
-    /* Found valid dir, perform the readdir operation on it. */
-    f->eax = filesys_readdir (fd_entry->filesys_ptr, name);
+    {
+      /* Found valid dir, perform the readdir operation on it. */
+      f->eax = filesys_readdir (fd_entry->filesys_ptr, kname);
+      if (f->eax)
+        syscall_copy_out (name, kname, strlen (kname) + 1);
+    }
 }
 
 /* Returns true if FD represents a directory, 
@@ -250,10 +632,10 @@ static void
 syscall_isdir (struct intr_frame *f)
 {
   int32_t fd = syscall_get_arg (f, 1);
-  struct fd_entry *fd_entry;
+  struct fd_entry fd_copy, *fd_entry;
 
-  fd_entry = fd_lookup (fd);
-  f->eax = fd_entry != NULL && fd_entry->isdir;
+  fd_entry = fd_lookup (fd, &fd_copy);
+  f->eax = fd_entry != NULL && fd_entry->type == FD_DIR;
 }
 
 /* Returns the inode number of the inode associated with FD, 
@@ -262,16 +644,142 @@ static void
 syscall_inumber (struct intr_frame *f)
 {
   int32_t fd = syscall_get_arg (f, 1);
-  struct fd_entry *fd_entry;
+  struct fd_entry fd_copy, *fd_entry;
 
-  fd_entry = fd_lookup (fd);
-  if (fd_entry == NULL)
-    /* FD is invalid, fail. */
+  fd_entry = fd_lookup (fd, &fd_copy);
+  if (fd_entry == NULL || fd_entry->type > FD_DIR)
+    /* FD is invalid or not a file or directory, fail. */
     f->eax = SYSCALL_ERROR;
   else
     /* Query the filesystem for inumber. */
-    f->eax = fd_entry->isdir ? filesys_dir_inumber (fd_entry->filesys_ptr) 
-                             : filesys_file_inumber (fd_entry->filesys_ptr);
+    f->eax = (fd_entry->type == FD_DIR
+              ? filesys_dir_inumber (fd_entry->filesys_ptr) 
+              : filesys_file_inumber (fd_entry->filesys_ptr));
+}
+
+/* Reads up to CNT entries from file descriptor FD, which must represent a
+   directory, into the array ENTRIES of struct dirent. Returns the number
+   of entries read, 0 if none are left, or -1 if FD is not a directory. */
+static void
+syscall_getdents (struct intr_frame *f)
+{
+  int32_t fd = syscall_get_arg (f, 1);
+  struct dirent *entries = (struct dirent *) syscall_get_arg (f, 2);
+  uint32_t cnt = syscall_get_arg (f, 3);
+  struct fd_entry fd_copy, *fd_entry;
+  struct dirent *kentries;
+  int read_cnt;
+
+  /* Bound the work of one call by a page of entries. */
+  if (cnt > PGSIZE / sizeof *entries)
+    cnt = PGSIZE / sizeof *entries;
+
+  fd_entry = fd_lookup (fd, &fd_copy);
+  if (fd_entry == NULL || fd_entry->type != FD_DIR)
+    {
+      /* FD invalid or not a directory, fail. */
+      f->eax = SYSCALL_ERROR;
+      return;
+    }
+  kentries = palloc_get_page (0);
+  if (kentries == NULL)
+    {
+      f->eax = SYSCALL_ERROR;
+      return;
+    }
+  read_cnt = filesys_getdents (fd_entry->filesys_ptr, kentries, cnt);
+  if (read_cnt > 0
+      && !copy_to_user (entries, kentries, read_cnt * sizeof *entries))
+    {
+      palloc_free_page (kentries);
+      syscall_terminate_process ();
+    }
+  palloc_free_page (kentries);
+  f->eax = read_cnt;
+}
+
+/* Writes the dirty data and metadata of the file or directory FD
+   represents to disk, returning once they are there. Returns true if
+   successful, false if FD is invalid. */
+static void
+syscall_fsync (struct intr_frame *f)
+{
+  int32_t fd = syscall_get_arg (f, 1);
+  struct fd_entry fd_copy, *fd_entry;
+
+  fd_entry = fd_lookup (fd, &fd_copy);
+  if (fd_entry == NULL || fd_entry->type > FD_DIR)
+    /* FD is invalid or not a file or directory, fail. */
+    f->eax = false;
+  else
+    {
+      if (fd_entry->type == FD_DIR)
+        filesys_dir_sync (fd_entry->filesys_ptr);
+      else
+        filesys_file_sync (fd_entry->filesys_ptr);
+      f->eax = true;
+    }
+}
+
+/* Sets the length of the file FD represents to LENGTH bytes, releasing
+   the disk space past it or adding a hole that reads as zeros. The
+   position of FD is unchanged. Returns true if successful, false if FD
+   is invalid or not a file, the file can't be written or the disk is
+   full. */
+static void
+syscall_ftruncate (struct intr_frame *f)
+{
+  int32_t fd = syscall_get_arg (f, 1);
+  uint32_t length = syscall_get_arg (f, 2);
+  struct fd_entry fd_copy, *fd_entry;
+
+  fd_entry = fd_lookup (fd, &fd_copy);
+  if (fd_entry == NULL || fd_entry->type != FD_FILE || length > INT32_MAX)
+    /* FD is invalid or not a file, fail. */
+    f->eax = false;
+  else
+    f->eax = filesys_truncate (fd_entry->filesys_ptr, length);
+}
+
+/* Moves the data of the file FD represents into one run of contiguous
+   sectors, which it can be read back from sequentially. Readers and
+   writers of the file wait meanwhile. Returns true if successful,
+   false if FD is invalid or not a file or the disk has no free run
+   long enough. */
+static void
+syscall_defrag (struct intr_frame *f)
+{
+  int32_t fd = syscall_get_arg (f, 1);
+  struct fd_entry fd_copy, *fd_entry;
+
+  fd_entry = fd_lookup (fd, &fd_copy);
+  if (fd_entry == NULL || fd_entry->type != FD_FILE)
+    /* FD is invalid or not a file, fail. */
+    f->eax = false;
+  else
+    f->eax = filesys_defrag (fd_entry->filesys_ptr);
+}
+
+/* Reserves contiguous disk space for the LENGTH bytes at OFFSET of the
+   file FD represents, for as long as it stays open, and extends the
+   file to cover them, without writing anything to them. Returns true
+   if successful, false if FD is invalid or not a file, the file can't
+   be written or the disk has no free run that long. */
+static void
+syscall_fallocate (struct intr_frame *f)
+{
+  int32_t fd = syscall_get_arg (f, 1);
+  uint32_t offset = syscall_get_arg (f, 2);
+  uint32_t length = syscall_get_arg (f, 3);
+  struct fd_entry fd_copy, *fd_entry;
+
+  fd_entry = fd_lookup (fd, &fd_copy);
+  if (fd_entry == NULL || fd_entry->type != FD_FILE
+      || offset > INT32_MAX || length > INT32_MAX - offset)
+    /* FD is invalid or not a file, fail. */
+    f->eax = false;
+  else
+    f->eax = filesys_allocate (fd_entry->filesys_ptr, offset, length);
 }
 
 /* Creates a new file at PATH initially INITIAL_SIZE bytes in size. 
@@ -279,11 +787,29 @@ syscall_inumber (struct intr_frame *f)
 static void
 syscall_create (struct intr_frame *f)
 {
-  const char *path = (const char* ) syscall_get_arg (f, 1);
+  char *path = syscall_copy_in_string ((const char *) syscall_get_arg (f, 1));
   uint32_t initial_size = syscall_get_arg (f, 2);
-  syscall_validate_user_string(path, PGSIZE);
 
   f->eax = filesys_create (path, initial_size);
+  palloc_free_page (path);
+}
+
+/* Like syscall_create(), but relative to directory DIRFD. */
+static void
+syscall_createat (struct intr_frame *f)
+{
+  int32_t dirfd = syscall_get_arg (f, 1);
+  char *path = syscall_copy_in_string ((const char *) syscall_get_arg (f, 2));
+  uint32_t initial_size = syscall_get_arg (f, 3);
+  struct dir *base;
+
+  f->eax = false;
+  if (syscall_open_base (dirfd, &base))
+    {
+      f->eax = filesys_create_at (base, path, initial_size);
+      filesys_closedir (base);
+    }
+  palloc_free_page (path);
 }
 
 /* Deletes the file/dir at PATH. Returns true if successful, false otherwise.
@@ -292,386 +818,1856 @@ syscall_create (struct intr_frame *f)
 static void
 syscall_remove (struct intr_frame *f)
 {
-  const char *path = (const char *) syscall_get_arg (f, 1);
-  syscall_validate_user_string (path, PGSIZE);
+  char *path = syscall_copy_in_string ((const char *) syscall_get_arg (f, 1));
 
   f->eax = filesys_remove (path);
+  palloc_free_page (path);
 }
 
-/* Opens the file/dir at PATH. Returns a nonnegative integer handle called 
-   a "file descriptor" (fd), or -1 if PATH could not be opened. */
+/* Like syscall_remove(), but relative to directory DIRFD. */
 static void
-syscall_open (struct intr_frame *f)
+syscall_removeat (struct intr_frame *f)
 {
-  const char *path = (const char *) syscall_get_arg (f, 1);
-  struct fd_entry *fd_entry = NULL;
-  syscall_validate_user_string(path, PGSIZE);
+  int32_t dirfd = syscall_get_arg (f, 1);
+  char *path = syscall_copy_in_string ((const char *) syscall_get_arg (f, 2));
+  struct dir *base;
 
-  fd_entry = malloc (sizeof *fd_entry);
-  if (fd_entry == NULL)
-    goto fail;
-  /* Attempt to open the file and update the fd_entry accordingly. */
-  fd_entry->filesys_ptr = filesys_open (path, &fd_entry->isdir);
-  if (fd_entry->filesys_ptr == NULL)
-    goto fail;
-  fd_entry->fd = fd_allocate ();
-  /* Add the file descriptor to the thread. */
-  hash_insert (&thread_current ()->fd_table, &fd_entry->hash_elem);
-  /* Return the file descriptor. */
-  f->eax = fd_entry->fd;
-  return;
-fail:
-  free (fd_entry);
-  f->eax = -1;
-  return;
+  f->eax = false;
+  if (syscall_open_base (dirfd, &base))
+    {
+      f->eax = filesys_remove_at (base, path);
+      filesys_closedir (base);
+    }
+  palloc_free_page (path);
 }
 
-/* Returns the size, in bytes, of the file open as FD.
-   Returns SYSCALL_ERROR if FD is not a valid file. */
+/* Moves the file/dir at OLD to NEW in one step, replacing a file or
+   empty directory at NEW. Returns true if successful, false otherwise.
+   Open files and directories stay open across the move. */
 static void
-syscall_filesize (struct intr_frame *f)
+syscall_rename (struct intr_frame *f)
 {
-  int32_t fd = syscall_get_arg (f, 1);
-  struct fd_entry *fd_entry;
+  char *old_path = syscall_copy_in_string ((const char *) syscall_get_arg (f, 1));
+  char *new_path = palloc_get_page (0);
+
+  /* Don't leak OLD_PATH if NEW can't be copied in. */
+  if (new_path == NULL
+      || copy_string_from_user (new_path,
+                                (const char *) syscall_get_arg (f, 2),
+                                PGSIZE) < 0)
+    {
+      palloc_free_page (new_path);
+      palloc_free_page (old_path);
+      syscall_terminate_process ();
+    }
+  new_path[PGSIZE - 1] = '\0';
 
-  fd_entry = fd_lookup (fd);
-  if (fd_entry == NULL || fd_entry->isdir)
-    /* FD is invalid, fail. */
-    f->eax = SYSCALL_ERROR;
-  else
-    /* Query the filesystem for filesize. */
-    f->eax = filesys_filesize (fd_entry->filesys_ptr);
+  f->eax = filesys_rename (old_path, new_path);
+  palloc_free_page (old_path);
+  palloc_free_page (new_path);
 }
 
-/* Reads SIZE bytes from the file open as FD into BUFFER. 
-   Returns the number of bytes actually read (0 at end of file), 
-   or SYSCALL_ERROR if the file could not be read.
-   Fd 0 reads from the keyboard. */
+/* Stores the metadata of the file/dir at PATH in *BUF. Returns true if
+   successful, false if PATH doesn't exist. */
 static void
-syscall_read (struct intr_frame *f)
+syscall_stat (struct intr_frame *f)
+{
+  char *path = syscall_copy_in_string ((const char *) syscall_get_arg (f, 1));
+  struct stat *buf = (struct stat *) syscall_get_arg (f, 2);
+  struct stat st;
+
+  f->eax = filesys_stat (path, &st);
+  palloc_free_page (path);
+  if (f->eax && !copy_to_user (buf, &st, sizeof st))
+    syscall_terminate_process ();
+}
+
+/* Stores the metadata of the file/dir FD represents in *BUF. Returns
+   true if successful, false if FD is invalid or not a file or dir. */
+static void
+syscall_fstat (struct intr_frame *f)
 {
   int32_t fd = syscall_get_arg (f, 1);
-  uint8_t *buffer = (uint8_t *) syscall_get_arg (f, 2);
-  uint32_t size = syscall_get_arg (f, 3);
-  struct fd_entry *fd_entry;
-  /* Verify that the entire buffer is valid user memory that's writable. */
-  syscall_validate_user_memory (buffer, size, true);
+  struct stat *buf = (struct stat *) syscall_get_arg (f, 2);
+  struct fd_entry fd_copy, *fd_entry;
+  struct stat st;
 
-  if (fd == 0)
+  fd_entry = fd_lookup (fd, &fd_copy);
+  if (fd_entry == NULL)
     {
-      /* Read from stdin */
-      size_t bytes_read = 0;
-      while (bytes_read < size)
-        {
-          page_pin (buffer);
-          buffer[bytes_read] = input_getc ();
-          page_unpin (buffer);
-          bytes_read++;
-        }
-      f->eax = bytes_read;
+      f->eax = false;
+      return;
     }
+  if (fd_entry->type == FD_FILE)
+    filesys_file_stat (fd_entry->filesys_ptr, &st);
+  else if (fd_entry->type == FD_DIR)
+    filesys_dir_stat (fd_entry->filesys_ptr, &st);
   else
     {
-      fd_entry = fd_lookup (fd);
-      if (fd_entry == NULL || fd_entry->isdir)
-        {
-          /* FD is invalid, fail. */
-          f->eax = SYSCALL_ERROR;
-          return;
-        }
-      /* Pin buffer and read. */
-      for (uint8_t *cpage = pg_round_down (buffer); cpage <= buffer + size; cpage += PGSIZE)
-        page_pin (cpage);
-      f->eax = filesys_read (fd_entry->filesys_ptr, buffer, size);
-      for (uint8_t *cpage = pg_round_down (buffer); cpage <= buffer + size; cpage += PGSIZE)
-        page_unpin (cpage);
+      /* Pipes and shared memory have no inode. */
+      f->eax = false;
+      return;
     }
+  if (!copy_to_user (buf, &st, sizeof st))
+    syscall_terminate_process ();
+  f->eax = true;
 }
 
-/* Writes SIZE bytes from BUFFER to the open file FD. 
-  Returns the number of bytes actually written, which may be less 
-  than SIZE. */
+/* Opens the file/dir at PATH. Returns a nonnegative integer handle called 
+   a "file descriptor" (fd), or -1 if PATH could not be opened. */
 static void
-syscall_write (struct intr_frame *f)
+syscall_open (struct intr_frame *f)
 {
-  int32_t fd = syscall_get_arg (f, 1);
-  uint8_t *buffer = (uint8_t *) syscall_get_arg (f, 2);
-  size_t stride, size = syscall_get_arg (f, 3);
-  struct fd_entry *fd_entry;
-  /* Verify that the entire buffer is valid user memory. */
-  syscall_validate_user_memory (buffer, size, false);
+  f->eax = syscall_do_open (-1, (const char *) syscall_get_arg (f, 1), 0);
+}
+
+/* Opens the file/dir at PATH, which if relative is resolved starting at
+   directory DIRFD, or at the current working directory if DIRFD is
+   negative. FLAGS is 0 or O_DSYNC, which puts a file in write-through
+   mode. Returns a file descriptor, or -1 if PATH could not be opened,
+   DIRFD is not a directory or FLAGS is invalid. The other *at calls
+   resolve their paths the same way. */
+static void
+syscall_openat (struct intr_frame *f)
+{
+  f->eax = syscall_do_open (syscall_get_arg (f, 1),
+                            (const char *) syscall_get_arg (f, 2),
+                            syscall_get_arg (f, 3));
+}
+
+/* Opens the file/dir at user address UPATH, relative to DIRFD and with
+   FLAGS as for syscall_openat(), and returns its file descriptor, or -1
+   if it could not be opened. */
+static int
+syscall_do_open (int dirfd, const char *upath, int flags)
+{
+  char *path = syscall_copy_in_string (upath);
+  void *filesys_ptr = NULL;
+  struct dir *base;
+  bool isdir;
+  int fd;
 
-  if (fd == 1)
+  if (flags & ~O_DSYNC)
     {
-       /* For FD==1, print to the console strides of the buffer. */
-      while (size > 0)
-        {
-          size -= stride = size > 256 ? 256 : size;
-          page_pin (buffer);
-          putbuf ((char *) buffer, stride);
-          page_unpin (buffer);
-          buffer += stride;
-        }
+      palloc_free_page (path);
+      return -1;
     }
-  else
+
+  /* Attempt to open the file and give it a file descriptor. */
+  if (syscall_open_base (dirfd, &base))
     {
-      /* Write for files */
-      fd_entry = fd_lookup (fd);
-      if (fd_entry == NULL || fd_entry->isdir)
-        {
-          /* FD is invalid, fail. */
-          f->eax = SYSCALL_ERROR;
-          return;
-        }
-      /* Pin buffer and write. */
-      for (uint8_t *cpage = pg_round_down (buffer); cpage <= buffer + size; cpage += PGSIZE)
-        page_pin (cpage);
-      f->eax = filesys_write (fd_entry->filesys_ptr, buffer, size);
-      for (uint8_t *cpage = pg_round_down (buffer); cpage <= buffer + size; cpage += PGSIZE)
-        page_unpin (cpage);
+      filesys_ptr = filesys_open_at (base, path, &isdir);
+      filesys_closedir (base);
+    }
+  palloc_free_page (path);
+  if (filesys_ptr == NULL)
+    return -1;
+  if (!isdir && (flags & O_DSYNC))
+    filesys_set_write_through (filesys_ptr, true);
+  fd = fd_allocate (filesys_ptr, isdir ? FD_DIR : FD_FILE);
+  if (fd < 0)
+    {
+      struct fd_entry fd_entry = { filesys_ptr, isdir ? FD_DIR : FD_FILE };
+      fd_entry_close (&fd_entry);
     }
+  return fd;
 }
 
-/* Changes the next byte to be read or written in open file FD
-   to POSITION, expressed in bytes from the beginning of the file.
-   (Thus, a POSITION of 0 is the file's start). */
+/* Creates a pipe and stores file descriptors for its read end in
+   FDS[0] and its write end in FDS[1].  Returns true if successful,
+   false if memory is not available. */
 static void
-syscall_seek (struct intr_frame *f)
+syscall_pipe (struct intr_frame *f)
 {
-  int32_t fd = syscall_get_arg (f, 1);
-  unsigned position = syscall_get_arg (f, 2);
-  struct fd_entry *fd_entry;
+  int *ufds = (int *) syscall_get_arg (f, 1);
+  struct pipe *p;
+  int fds[2];
 
-  fd_entry = fd_lookup (fd);
-  if (fd_entry == NULL || fd_entry->isdir)
+  f->eax = false;
+  p = pipe_create ();
+  if (p == NULL)
+    return;
+  fds[0] = fd_allocate (p, FD_PIPE_READER);
+  if (fds[0] < 0)
     {
-      /* FD is invalid, fail. */
-      f->eax = SYSCALL_ERROR;
+      pipe_close (p, false);
+      pipe_close (p, true);
       return;
     }
-  filesys_seek (fd_entry->filesys_ptr, position);
+  fds[1] = fd_allocate (p, FD_PIPE_WRITER);
+  if (fds[1] < 0)
+    {
+      struct fd_entry reader;
+
+      if (fd_remove (fds[0], &reader))
+        fd_entry_close (&reader);
+      pipe_close (p, true);
+      return;
+    }
+  syscall_copy_out (ufds, fds, sizeof fds);
+  f->eax = true;
 }
 
-/* Returns the position of the next byte to be read or written in 
-   open file FD, expressed in bytes from the beginning of the file. */
+/* Waits until any of the FD_CNT file descriptors in FDS, an array of
+   struct pollfd, is ready for the events asked for, or for TIMEOUT
+   milliseconds if TIMEOUT is not negative, and sets the events each
+   is ready for.  Returns the number of descriptors with any events,
+   0 on timeout, or -1 if FD_CNT is more than POLL_FDS_MAX or memory
+   is not available. */
 static void
-syscall_tell (struct intr_frame *f)
+syscall_poll (struct intr_frame *f)
 {
-  int32_t fd = syscall_get_arg (f, 1);
-  struct fd_entry *fd_entry;
-
-  fd_entry = fd_lookup (fd);
-  if (fd_entry == NULL || fd_entry->isdir)
+  struct pollfd *ufds = (struct pollfd *) syscall_get_arg (f, 1);
+  uint32_t fd_cnt = syscall_get_arg (f, 2);
+  int32_t timeout = syscall_get_arg (f, 3);
+  struct pollfd *fds;
+  struct poll_entry *entries;
+  struct poll_table table;
+  int ready_cnt;
+  bool first;
+  size_t i;
+
+  f->eax = SYSCALL_ERROR;
+  if (fd_cnt > POLL_FDS_MAX)
+    return;
+  fds = malloc (fd_cnt * sizeof *fds);
+  entries = malloc (fd_cnt * sizeof *entries);
+  if (fd_cnt > 0 && (fds == NULL || entries == NULL))
     {
-      /* FD is invalid, fail. */
-      f->eax = SYSCALL_ERROR;
+      free (fds);
+      free (entries);
       return;
     }
-  f->eax = filesys_tell (fd_entry->filesys_ptr);
+  if (fd_cnt > 0 && !copy_from_user (fds, ufds, fd_cnt * sizeof *fds))
+    {
+      free (fds);
+      free (entries);
+      syscall_terminate_process ();
+    }
+  for (i = 0; i < fd_cnt; i++)
+    entries[i].queue = NULL;
+
+  /* Check every descriptor, only joining the wait queues of what they
+     refer to the first time, and sleep until one of those wakes. */
+  poll_table_init (&table, (timeout < 0 ? -1
+                            : DIV_ROUND_UP ((int64_t) timeout * TIMER_FREQ,
+                                            1000)));
+  for (first = true; ; first = false)
+    {
+      ready_cnt = 0;
+      for (i = 0; i < fd_cnt; i++)
+        {
+          fds[i].revents = (fds[i].fd < 0 ? 0
+                            : syscall_poll_fd (fds[i].fd, fds[i].events,
+                                               first ? &table : NULL,
+                                               &entries[i]));
+          if (fds[i].revents != 0)
+            ready_cnt++;
+        }
+      if (ready_cnt > 0 || !poll_table_wait (&table))
+        break;
+    }
+  poll_table_done (&table, entries, fd_cnt);
+  free (entries);
+
+  if (fd_cnt > 0 && !copy_to_user (ufds, fds, fd_cnt * sizeof *fds))
+    {
+      free (fds);
+      syscall_terminate_process ();
+    }
+  free (fds);
+  f->eax = ready_cnt;
 }
 
-/* Closes file descriptor FD and frees its resources. */
-static void
-syscall_close (struct intr_frame *f)
+/* Returns the POLL* events among EVENTS, plus POLLERR, POLLHUP and
+   POLLNVAL, that file descriptor FD is ready for, first adding ENTRY
+   for TABLE to the pollers of what FD refers to if TABLE is not
+   null.  Files and the console's output never block. */
+static unsigned
+syscall_poll_fd (int fd, unsigned events, struct poll_table *table,
+                 struct poll_entry *entry)
 {
-  int32_t fd = syscall_get_arg (f, 1);
-  struct fd_entry query;
-  struct hash_elem *e;
+  struct fd_entry fd_copy, *fd_entry;
+  unsigned revents;
 
-  query.fd = fd;
-  e = hash_delete (&thread_current ()->fd_table, &query.hash_elem);
-  if (e == NULL)
-    return; /* FD does not exist. */
-  /* Close FD and free its resources. */
-  fd_entry_destroy (e, NULL);
+  if (fd == 0)
+    revents = input_poll (table, entry) ? POLLIN : 0;
+  else if (fd == 1)
+    revents = POLLOUT;
+  else if ((fd_entry = fd_lookup (fd, &fd_copy)) == NULL)
+    return POLLNVAL;
+  else if (fd_entry->type == FD_PIPE_READER
+           || fd_entry->type == FD_PIPE_WRITER)
+    revents = pipe_poll (fd_entry->filesys_ptr,
+                         fd_entry->type == FD_PIPE_WRITER, table, entry);
+  else if (fd_entry->type == FD_MEMPRESSURE)
+    revents = (frame_pressure_poll (fd_entry->filesys_ptr, table, entry)
+               ? POLLIN : 0);
+  else
+    revents = POLLIN | POLLOUT;
+  return revents & (events | POLLERR | POLLHUP);
 }
 
-/* Maps the file open as fd into the process's virtual address space*/
+/* Creates a shared memory segment of SIZE bytes, rounded up to whole
+   pages, that reads as zeros, and returns a file descriptor for it,
+   which mmap() maps.  Processes forked while it is open share it.
+   Returns -1 if SIZE is 0 or too big or memory is not available. */
 static void
-syscall_mmap (struct intr_frame *f)
+syscall_shm_create (struct intr_frame *f)
 {
-  int32_t fd = syscall_get_arg (f, 1);
-  void *addr = (void *) syscall_get_arg (f, 2);
-  struct thread *t = thread_current ();  
-  struct fd_entry *fd_entry;
-  struct page_mmap *mmap;
-  size_t filesize, offset = 0;
+  size_t size = syscall_get_arg (f, 1);
+  size_t page_cnt = DIV_ROUND_UP (size, PGSIZE);
+  struct shm *shm;
 
-  f->eax = MAP_FAILED;
-  /* Fail if addr is 0, addr is not page-aligned, or fd is 0 or 1. */
-  if (addr == 0 || pg_round_down (addr) != addr || fd == 0 || fd == 1)
+  f->eax = SYSCALL_ERROR;
+  if (page_cnt == 0 || page_cnt > SYSCALL_SHM_PAGES_MAX)
     return;
-  /* Get file that will back mmap. */
-  fd_entry = fd_lookup (fd);
-  if (fd_entry == NULL || fd_entry->isdir)
+  shm = share_shm_create (page_cnt);
+  if (shm == NULL)
     return;
-  filesize = filesys_filesize (fd_entry->filesys_ptr);
-  /* Fail if backing file has length 0. */
-  if (filesize == 0)
-      return;
-  /* Create a new memory map. */
-  mmap = page_mmap_new (fd_entry->filesys_ptr, filesize);
-  /* Populate mmap's pages. */
-  while (offset < mmap->file_size)
-    {
-      /* Get zero bytes of page. */
-      size_t zero_bytes = 0;
-      size_t stick_out = mmap->file_size - offset;
-      if (stick_out < PGSIZE)
-        zero_bytes = PGSIZE - stick_out;
-      bool success = page_add_to_mmap (mmap, addr + offset, 
-                                       offset, zero_bytes);
-      if (!success)
-        {
-          page_delete_mmap (mmap);
-          return;
-        }
-      offset += PGSIZE;
-    }
-  /* Associate mmap with thread. */
-  mmap->id = t->mmap_next_id++;
-  list_push_back (&t->mmap_list, &mmap->list_elem);
-  f->eax = mmap->id;
-  return;
+  f->eax = fd_allocate (shm, FD_SHM);
+  if ((int) f->eax < 0)
+    share_shm_close (shm);
 }
 
-/* Unmaps the mapping designated by mapping, which must be a mapping ID
-   returned by a previous call to mmap by the same process that has not
-   yet been unmapped. */
+/* Sleeps until woken up by futex_wake() on ADDR, if the int at ADDR
+   holds VAL.  Returns true once woken, or false right away if the
+   int held something else.  Terminates the process if ADDR is not an
+   aligned, readable address. */
 static void
-syscall_munmap (struct intr_frame *f)
+syscall_futex_wait (struct intr_frame *f)
 {
-  mapid_t id = syscall_get_arg (f, 1);
+  const int *uaddr = (const int *) syscall_get_arg (f, 1);
+  int val = syscall_get_arg (f, 2);
+  enum futex_status status = futex_wait (uaddr, val);
 
-  struct page_mmap *mmap = page_get_mmap (thread_current (), id);
-  if (mmap != NULL)
-    {
-      list_remove (&mmap->list_elem);
-      page_delete_mmap (mmap);
-    }
+  if (status == FUTEX_FAULT)
+    syscall_terminate_process ();
+  f->eax = status == FUTEX_WOKEN;
 }
 
-/* Returns the next available file descriptor for the current thread. */
-static int 
-fd_allocate (void)
+/* Wakes up to CNT threads sleeping in futex_wait() on ADDR and
+   returns how many it woke. */
+static void
+syscall_futex_wake (struct intr_frame *f)
 {
-  return thread_current ()->fd_next++;
+  const int *uaddr = (const int *) syscall_get_arg (f, 1);
+  uint32_t cnt = syscall_get_arg (f, 2);
+
+  f->eax = futex_wake (uaddr, cnt);
 }
 
-/* Closes the file/dir of the fd_entry owning E and frees its resources. */
-static void 
-fd_entry_destroy (struct hash_elem *e, void *aux UNUSED)
+/* Starts a new thread in the current process, running the code at EIP
+   on the stack that ESP points to, and returns its thread id, or
+   TID_ERROR if it cannot be created. */
+static void
+syscall_thread_create (struct intr_frame *f)
 {
-  struct fd_entry *fd_entry;
+  void *eip = (void *) syscall_get_arg (f, 1);
+  void *esp = (void *) syscall_get_arg (f, 2);
 
-  fd_entry = hash_entry (e, struct fd_entry, hash_elem);
-  if (fd_entry->isdir)
-    filesys_closedir (fd_entry->filesys_ptr);
-  else
-    filesys_close (fd_entry->filesys_ptr);
-  free (fd_entry);
+  f->eax = is_user_vaddr (eip) && is_user_vaddr (esp)
+           ? process_thread_create (eip, esp) : TID_ERROR;
 }
 
-/* Returns a pointer to `struct fd_entry` corresponding to file
-   descriptor FD in the current thread's fd_table. Returns NULL
-   if FD is not found. */
-static struct fd_entry *
-fd_lookup (int fd)
+/* Ends the current thread, leaving the rest of its process running,
+   with STATUS for thread_join() to return.  The process ends with
+   STATUS as well if this is its first thread.  Never returns. */
+static void
+syscall_thread_exit (struct intr_frame *f)
 {
-  struct thread *t = thread_current ();
-  struct fd_entry query, *found;
-  struct hash_elem *e;
+  thread_current ()->process_exit_code = syscall_get_arg (f, 1);
+  thread_exit ();
+}
 
-  query.fd = fd;
-  e = hash_find (&t->fd_table, &query.hash_elem);
-  found = e != NULL ? hash_entry (e, struct fd_entry, hash_elem) : NULL;
-  return found;
+/* Waits for thread TID of the current process to end and returns the
+   status it passed to thread_exit(), or -1 if TID is not a thread of
+   the process that can be joined. */
+static void
+syscall_thread_join (struct intr_frame *f)
+{
+  tid_t tid = syscall_get_arg (f, 1);
+
+  f->eax = process_thread_join (tid);
 }
 
+/* Returns the size, in bytes, of the file or shared memory segment
+   open as FD.  Returns SYSCALL_ERROR if FD is not a valid file. */
+static void
+syscall_filesize (struct intr_frame *f)
+{
+  int32_t fd = syscall_get_arg (f, 1);
+  struct fd_entry fd_copy, *fd_entry;
 
-/* Hash function that hashes an fd_entry's fd into its fd_table hash table. */
-static unsigned
-fd_entry_hash (const struct hash_elem *e, void *aux UNUSED)
+  fd_entry = fd_lookup (fd, &fd_copy);
+  if (fd_entry != NULL && fd_entry->type == FD_SHM)
+    f->eax = share_shm_page_cnt (fd_entry->filesys_ptr) * PGSIZE;
+  else if (fd_entry == NULL || fd_entry->type != FD_FILE)
+    /* FD is invalid, fail. */
+    f->eax = SYSCALL_ERROR;
+  else
+    /* Query the filesystem for filesize. */
+    f->eax = filesys_filesize (fd_entry->filesys_ptr);
+}
+
+/* Reads SIZE bytes from the file open as FD into BUFFER. 
+   Returns the number of bytes actually read (0 at end of file), 
+   or SYSCALL_ERROR if the file could not be read.
+   Fd 0 reads from the keyboard. */
+static void
+syscall_read (struct intr_frame *f)
+{
+  int32_t fd = syscall_get_arg (f, 1);
+  struct iovec iov;
+
+  iov.iov_base = (void *) syscall_get_arg (f, 2);
+  iov.iov_len = syscall_get_arg (f, 3);
+  f->eax = syscall_transfer (fd, false, &iov, 1, NULL);
+}
+
+/* Writes SIZE bytes from BUFFER to the open file FD. 
+  Returns the number of bytes actually written, which may be less 
+  than SIZE. */
+static void
+syscall_write (struct intr_frame *f)
+{
+  int32_t fd = syscall_get_arg (f, 1);
+  struct iovec iov;
+
+  iov.iov_base = (void *) syscall_get_arg (f, 2);
+  iov.iov_len = syscall_get_arg (f, 3);
+  f->eax = syscall_transfer (fd, true, &iov, 1, NULL);
+}
+
+/* Reads SIZE bytes from the file open as FD into BUFFER, starting at
+   byte OFFSET of the file and leaving its position alone.  Returns
+   the number of bytes actually read (0 at end of file), or
+   SYSCALL_ERROR if FD is not a file or OFFSET is negative. */
+static void
+syscall_pread (struct intr_frame *f)
+{
+  int32_t fd = syscall_get_arg (f, 1);
+  off_t offset = syscall_get_arg (f, 4);
+  struct iovec iov;
+
+  iov.iov_base = (void *) syscall_get_arg (f, 2);
+  iov.iov_len = syscall_get_arg (f, 3);
+  f->eax = (offset < 0 ? SYSCALL_ERROR
+            : syscall_transfer (fd, false, &iov, 1, &offset));
+}
+
+/* Writes SIZE bytes from BUFFER to the file open as FD, starting at
+   byte OFFSET of the file and leaving its position alone.  Returns
+   the number of bytes actually written, or SYSCALL_ERROR if FD is
+   not a file or OFFSET is negative. */
+static void
+syscall_pwrite (struct intr_frame *f)
+{
+  int32_t fd = syscall_get_arg (f, 1);
+  off_t offset = syscall_get_arg (f, 4);
+  struct iovec iov;
+
+  iov.iov_base = (void *) syscall_get_arg (f, 2);
+  iov.iov_len = syscall_get_arg (f, 3);
+  f->eax = (offset < 0 ? SYSCALL_ERROR
+            : syscall_transfer (fd, true, &iov, 1, &offset));
+}
+
+/* Reads from the file open as FD into the IOV_CNT buffers of the
+   array IOV of struct iovec, filling each in turn.  Returns the
+   number of bytes actually read, or SYSCALL_ERROR if FD is invalid
+   or IOV_CNT is more than IOV_MAX. */
+static void
+syscall_readv (struct intr_frame *f)
+{
+  syscall_transfer_vector (f, false);
+}
+
+/* Writes the IOV_CNT buffers of the array IOV of struct iovec, in
+   turn, to the file open as FD.  Returns the number of bytes
+   actually written, or SYSCALL_ERROR if FD is invalid or IOV_CNT is
+   more than IOV_MAX. */
+static void
+syscall_writev (struct intr_frame *f)
+{
+  syscall_transfer_vector (f, true);
+}
+
+/* Copies SIZE bytes from the file open as FD_IN, starting at its
+   position, to the file open as FD_OUT at its position, advancing
+   both, without passing the data through user memory.  Returns the
+   number of bytes copied, which is less than SIZE at the end of
+   FD_IN, or SYSCALL_ERROR if either FD is not a file. */
+static void
+syscall_copy_file_range (struct intr_frame *f)
+{
+  struct fd_entry in_copy, out_copy;
+  struct fd_entry *in = fd_lookup (syscall_get_arg (f, 1), &in_copy);
+  struct fd_entry *out = fd_lookup (syscall_get_arg (f, 2), &out_copy);
+  uint32_t size = syscall_get_arg (f, 3);
+
+  if (in == NULL || in->type != FD_FILE
+      || out == NULL || out->type != FD_FILE)
+    {
+      /* FD is invalid, fail. */
+      f->eax = SYSCALL_ERROR;
+      return;
+    }
+  if (size > INT32_MAX)
+    size = INT32_MAX;
+  f->eax = filesys_copy (out->filesys_ptr, in->filesys_ptr, size);
+}
+
+/* Runs up to TO_SUBMIT of the operations queued in the submission
+   queue of RING, a struct ring in user memory, in order, posting the
+   result of each to its completion queue.  Stops early when the
+   submission queue runs empty or the completion queue fills up.
+   Returns the number of operations run, or SYSCALL_ERROR if RING's
+   size is invalid. */
+static void
+syscall_ring_enter (struct intr_frame *f)
+{
+  struct ring *uring = (struct ring *) syscall_get_arg (f, 1);
+  uint32_t to_submit = syscall_get_arg (f, 2);
+  struct ring_sqe *sqes;
+  struct ring_cqe *cqes;
+  struct ring ring;
+  uint32_t mask, done;
+
+  syscall_copy_in (&ring, uring, sizeof ring);
+  if (ring.entries == 0 || ring.entries > RING_ENTRIES_MAX
+      || (ring.entries & (ring.entries - 1)) != 0)
+    {
+      f->eax = SYSCALL_ERROR;
+      return;
+    }
+  mask = ring.entries - 1;
+  /* Not ring_cqes(), which would read the size from user memory. */
+  sqes = ring_sqes (uring);
+  cqes = (struct ring_cqe *) (sqes + ring.entries);
+
+  for (done = 0; done < to_submit && ring.sq_head != ring.sq_tail
+                 && ring.cq_tail - ring.cq_head < ring.entries; done++)
+    {
+      struct ring_sqe sqe;
+      struct ring_cqe cqe;
+
+      syscall_copy_in (&sqe, &sqes[ring.sq_head & mask], sizeof sqe);
+      cqe.user_data = sqe.user_data;
+      cqe.result = syscall_ring_execute (&sqe);
+      syscall_copy_out (&cqes[ring.cq_tail & mask], &cqe, sizeof cqe);
+      ring.sq_head++;
+      ring.cq_tail++;
+
+      /* Publish progress as it is made, in case a later entry kills
+         the process. */
+      syscall_copy_out (&uring->sq_head, &ring.sq_head, sizeof ring.sq_head);
+      syscall_copy_out (&uring->cq_tail, &ring.cq_tail, sizeof ring.cq_tail);
+    }
+  f->eax = done;
+}
+
+/* Runs the operation SQE from a ring's submission queue and returns
+   its result, as the matching system call would. */
+static int
+syscall_ring_execute (const struct ring_sqe *sqe)
+{
+  struct iovec iov;
+  off_t offset = sqe->offset;
+
+  iov.iov_base = sqe->buffer;
+  iov.iov_len = sqe->size;
+  switch (sqe->op)
+    {
+    case RING_OP_NOP:
+      return 0;
+    case RING_OP_READ:
+    case RING_OP_WRITE:
+      return syscall_transfer (sqe->fd, sqe->op == RING_OP_WRITE, &iov, 1,
+                               NULL);
+    case RING_OP_PREAD:
+    case RING_OP_PWRITE:
+      if (offset < 0)
+        return SYSCALL_ERROR;
+      return syscall_transfer (sqe->fd, sqe->op == RING_OP_PWRITE, &iov, 1,
+                               &offset);
+    case RING_OP_OPEN:
+      return syscall_do_open (-1, sqe->buffer, 0);
+    case RING_OP_CLOSE:
+      return syscall_do_close (sqe->fd) ? 0 : SYSCALL_ERROR;
+    default:
+      return SYSCALL_ERROR;
+    }
+}
+
+/* Does readv, or writev if WRITE, for F by copying in its array of
+   struct iovec. */
+static void
+syscall_transfer_vector (struct intr_frame *f, bool write)
+{
+  int32_t fd = syscall_get_arg (f, 1);
+  const struct iovec *uiov = (const struct iovec *) syscall_get_arg (f, 2);
+  uint32_t iov_cnt = syscall_get_arg (f, 3);
+  struct iovec iov[IOV_MAX];
+
+  if (iov_cnt > IOV_MAX)
+    {
+      f->eax = SYSCALL_ERROR;
+      return;
+    }
+  syscall_copy_in (iov, uiov, iov_cnt * sizeof *iov);
+  f->eax = syscall_transfer (fd, write, iov, iov_cnt, NULL);
+}
+
+/* Waits on memory pressure watch W and stores the level reached, an
+   int, at the start of the first of the IOV_CNT user buffers in IOV.
+   Returns the size of an int, or SYSCALL_ERROR if that buffer is too
+   small for one. */
+static int
+syscall_read_pressure (struct pressure_watch *w, const struct iovec *iov,
+                       size_t iov_cnt)
+{
+  int level;
+
+  if (iov_cnt == 0 || iov[0].iov_len < sizeof level)
+    return SYSCALL_ERROR;
+  level = frame_pressure_wait (w);
+  syscall_copy_out (iov[0].iov_base, &level, sizeof level);
+  return sizeof level;
+}
+
+/* Writes the SIZE bytes at BUFFER, which page_pin_range() pinned, to
+   pipe P, letting its readers copy them straight out of the process's
+   pages.  Returns what pipe_write() does. */
+static int
+syscall_pipe_write_pinned (struct pipe *p, const uint8_t *buffer,
+                           size_t size)
+{
+  struct iovec iov[SYSCALL_PIN_PAGES + 1];
+  size_t cnt, ofs;
+
+  ASSERT (size <= SYSCALL_PIN_PAGES * PGSIZE);
+
+  for (cnt = ofs = 0; ofs < size; cnt++)
+    {
+      size_t chunk = PGSIZE - pg_ofs (buffer + ofs);
+
+      if (chunk > size - ofs)
+        chunk = size - ofs;
+      iov[cnt].iov_base = page_pinned_kaddr (buffer + ofs);
+      iov[cnt].iov_len = chunk;
+      ofs += chunk;
+    }
+  return pipe_write_direct (p, iov, cnt);
+}
+
+/* Reads into, or if WRITE writes from, the IOV_CNT user buffers in
+   IOV through FD, which may be the keyboard (fd 0) or console (fd 1)
+   if POS is null.  The file is read or written at *POS, which is
+   advanced, if POS is not null, and otherwise at its own position.
+   File and pipe data moves straight between the file system or pipe
+   and the buffer, pinned a chunk at a time, and a big write to a pipe
+   is read straight out of the writer's pages.  Console data passes
+   through a kernel page, as does other data if the buffer can't be
+   pinned, stopping after a short transfer.  Returns the number of bytes transferred,
+   or SYSCALL_ERROR if FD can't be used so.  Terminates the process
+   if a buffer is not accessible. */
+static int
+syscall_transfer (int fd, bool write, const struct iovec *iov,
+                  size_t iov_cnt, off_t *pos)
+{
+  struct fd_entry fd_copy, *fd_entry = NULL;
+  bool console = pos == NULL && fd == (write ? 1 : 0);
+  bool pipe = false;
+  uint8_t *kbuf;
+  size_t total = 0;
+  size_t i;
+
+  if (!console)
+    {
+      fd_entry = fd_lookup (fd, &fd_copy);
+      if (fd_entry == NULL)
+        /* FD is invalid, fail. */
+        return SYSCALL_ERROR;
+      pipe = fd_entry->type == (write ? FD_PIPE_WRITER : FD_PIPE_READER);
+      if (fd_entry->type == FD_MEMPRESSURE && !write && pos == NULL)
+        return syscall_read_pressure (fd_entry->filesys_ptr, iov, iov_cnt);
+      if (fd_entry->type != FD_FILE && !(pipe && pos == NULL))
+        /* Not a file, or the wrong end of a pipe, fail. */
+        return SYSCALL_ERROR;
+    }
+
+  kbuf = palloc_get_page (0);
+  if (kbuf == NULL)
+    return SYSCALL_ERROR;
+  for (i = 0; i < iov_cnt; i++)
+    {
+      uint8_t *buffer = iov[i].iov_base;
+      size_t size = iov[i].iov_len;
+      size_t done;
+
+      for (done = 0; done < size; )
+        {
+          /* Print to the console a page at a time, which putbuf()
+             hands to the devices at once, so that lines from
+             different processes don't get interleaved much. */
+          size_t chunk = size - done;
+          bool direct = false;
+          uint8_t *buf = kbuf;
+          size_t cnt;
+
+          if (!console)
+            {
+              if (chunk > SYSCALL_PIN_PAGES * PGSIZE)
+                chunk = SYSCALL_PIN_PAGES * PGSIZE;
+              direct = page_pin_range (buffer + done, chunk, !write);
+            }
+          if (direct)
+            buf = buffer + done;
+          else if (chunk > PGSIZE)
+            chunk = PGSIZE;
+          if (!direct && write && !copy_from_user (kbuf, buffer + done, chunk))
+            goto fault;
+
+          if (console && write)
+            putbuf ((char *) kbuf, cnt = chunk);
+          else if (console)
+            for (cnt = 0; cnt < chunk; cnt++)
+              kbuf[cnt] = input_getc ();
+          else if (pipe && write)
+            {
+              int n = (direct && chunk >= PIPE_DIRECT_MIN
+                       ? syscall_pipe_write_pinned (fd_entry->filesys_ptr,
+                                                    buf, chunk)
+                       : pipe_write (fd_entry->filesys_ptr, buf, chunk));
+              if (n < 0 && total == 0)
+                {
+                  /* No reader is left. */
+                  if (direct)
+                    page_unpin_range (buffer + done, chunk);
+                  palloc_free_page (kbuf);
+                  return SYSCALL_ERROR;
+                }
+              cnt = n > 0 ? n : 0;
+            }
+          else if (pipe)
+            cnt = pipe_read (fd_entry->filesys_ptr, buf, chunk);
+          else if (pos != NULL)
+            {
+              off_t n = (write
+                         ? filesys_write_at (fd_entry->filesys_ptr, buf,
+                                             chunk, *pos)
+                         : filesys_read_at (fd_entry->filesys_ptr, buf,
+                                            chunk, *pos));
+              cnt = n > 0 ? n : 0;
+              *pos += cnt;
+            }
+          else
+            {
+              off_t n = (write
+                         ? filesys_write (fd_entry->filesys_ptr, buf, chunk)
+                         : filesys_read (fd_entry->filesys_ptr, buf, chunk));
+              cnt = n > 0 ? n : 0;
+            }
+
+          if (direct)
+            page_unpin_range (buffer + done, chunk);
+          else if (!write && cnt > 0
+                   && !copy_to_user (buffer + done, kbuf, cnt))
+            goto fault;
+          done += cnt;
+          total += cnt;
+
+          /* Don't wait on a pipe for more once some has been read. */
+          if (cnt < chunk || (pipe && !write))
+            goto done;
+        }
+    }
+ done:
+  palloc_free_page (kbuf);
+  return total;
+
+ fault:
+  palloc_free_page (kbuf);
+  syscall_terminate_process ();
+}
+
+/* Changes the next byte to be read or written in open file FD
+   to POSITION, expressed in bytes from the beginning of the file.
+   (Thus, a POSITION of 0 is the file's start). */
+static void
+syscall_seek (struct intr_frame *f)
 {
-  const struct fd_entry *fd_entry = hash_entry (e, struct fd_entry, hash_elem);
-  return hash_int (fd_entry->fd);
+  int32_t fd = syscall_get_arg (f, 1);
+  unsigned position = syscall_get_arg (f, 2);
+  struct fd_entry fd_copy, *fd_entry;
+
+  fd_entry = fd_lookup (fd, &fd_copy);
+  if (fd_entry == NULL || fd_entry->type != FD_FILE)
+    {
+      /* FD is invalid, fail. */
+      f->eax = SYSCALL_ERROR;
+      return;
+    }
+  filesys_seek (fd_entry->filesys_ptr, position);
 }
 
-/* Hash comparison function for fd_entry's in `hash fd_table`. */
+/* Returns the position of the next byte to be read or written in 
+   open file FD, expressed in bytes from the beginning of the file. */
+static void
+syscall_tell (struct intr_frame *f)
+{
+  int32_t fd = syscall_get_arg (f, 1);
+  struct fd_entry fd_copy, *fd_entry;
+
+  fd_entry = fd_lookup (fd, &fd_copy);
+  if (fd_entry == NULL || fd_entry->type != FD_FILE)
+    {
+      /* FD is invalid, fail. */
+      f->eax = SYSCALL_ERROR;
+      return;
+    }
+  f->eax = filesys_tell (fd_entry->filesys_ptr);
+}
+
+/* Closes file descriptor FD and frees its resources. */
+static void
+syscall_close (struct intr_frame *f)
+{
+  syscall_do_close (syscall_get_arg (f, 1));
+}
+
+/* Closes file descriptor FD.  Returns false if FD does not exist. */
 static bool
-fd_entry_less (const struct hash_elem *a_,
-               const struct hash_elem *b_,
-               void *aux UNUSED)
+syscall_do_close (int fd)
 {
-  const struct fd_entry *a = hash_entry (a_, struct fd_entry, hash_elem);
-  const struct fd_entry *b = hash_entry (b_, struct fd_entry, hash_elem);
-  return a->fd < b->fd;
+  struct fd_entry fd_entry;
+
+  if (!fd_remove (fd, &fd_entry))
+    return false; /* FD does not exist. */
+  /* Close FD, its entry already free for reuse. */
+  fd_entry_close (&fd_entry);
+  return true;
 }
 
+/* Maps LENGTH bytes of the file or shared memory segment open as FD,
+   starting at OFFSET, into the process's virtual address space at ADDR,
+   or all of it from OFFSET on if LENGTH is SIZE_MAX, and sets the
+   return value to the mapping's ID or MAP_FAILED.  Pages past the end
+   of the file or segment read as zeros. */
+static void
+syscall_do_mmap (struct intr_frame *f, int fd, void *addr, off_t offset,
+                 size_t length)
+{
+  struct thread *t = thread_current ()->process;
+  struct fd_entry fd_copy, *fd_entry;
+  struct page_mmap *mmap;
+  size_t filesize, read_bytes, span;
 
-/* Terminates the current process with error code -1 freeing its
-   resources. Called in various syscalls on error. Never returns. */
+  f->eax = MAP_FAILED;
+  /* Fail if addr is 0, addr or offset is not page-aligned, or fd is 0
+     or 1. */
+  if (addr == 0 || pg_round_down (addr) != addr || offset < 0
+      || offset % PGSIZE != 0 || length == 0 || fd == 0 || fd == 1)
+    return;
+  /* Get file that will back mmap. */
+  fd_entry = fd_lookup (fd, &fd_copy);
+  if (fd_entry == NULL)
+    return;
+  if (fd_entry->type == FD_SHM)
+    mmap = page_mmap_new_shm (fd_entry->filesys_ptr);
+  else if (fd_entry->type == FD_FILE)
+    {
+      filesize = filesys_filesize (fd_entry->filesys_ptr);
+      /* Fail if backing file has length 0. */
+      if (filesize == 0)
+        return;
+      /* Create a new memory map. */
+      mmap = page_mmap_new (fd_entry->filesys_ptr, filesize);
+    }
+  else
+    return;
+  if (mmap == NULL)
+    return;
+  /* Fail if there is nothing of it to map from OFFSET on. */
+  if ((size_t) offset >= mmap->file_size)
+    goto fail;
+
+  /* Map the window as one region, its pages zero-filled past the
+     end. */
+  read_bytes = mmap->file_size - offset;
+  if (length < read_bytes)
+    read_bytes = length;
+  if (length == SIZE_MAX)
+    length = read_bytes;
+  if (length > (uintptr_t) PHYS_BASE - (uintptr_t) addr)
+    goto fail;
+  span = ROUND_UP (length, PGSIZE);
+  mmap->next_fault = offset;
+  if (!page_add_region (mmap, addr, offset, read_bytes, span - read_bytes,
+                        true))
+    goto fail;
+  /* Associate mmap with the process. */
+  lock_acquire (t->syscall_lock);
+  mmap->id = t->mmap_next_id++;
+  list_push_back (&t->mmap_list, &mmap->list_elem);
+  f->eax = mmap->id;
+  lock_release (t->syscall_lock);
+  page_mmap_populate (mmap);
+  return;
+
+ fail:
+  page_delete_mmap (mmap);
+}
+
+/* Maps the file or shared memory segment open as fd into the
+   process's virtual address space*/
 static void
-syscall_terminate_process (void)
+syscall_mmap (struct intr_frame *f)
 {
-  thread_current()->process_exit_code = -1;
-  thread_exit();
+  syscall_do_mmap (f, syscall_get_arg (f, 1), (void *) syscall_get_arg (f, 2),
+                   0, SIZE_MAX);
 }
 
-/* Returns only if UADDR is a valid virtual address in the page directory
-   of the curren thread along with the entire block of SIZE bytes following
-   UADDR. Otherwise, calls syscall_terminate_process and never returns.
-   SIZE must be a positive value. */
+/* Maps the LENGTH bytes at byte OFFSET of the file or shared memory
+   segment open as FD at ADDR, so that a program can slide a small
+   window through a big file.  OFFSET must be page-aligned and within
+   the file.  Returns the mapping's ID, or MAP_FAILED. */
 static void
-syscall_validate_user_memory (const void *uaddr, size_t size, bool writable)
+syscall_mmap_range (struct intr_frame *f)
 {
-  const void *current_page;
-  struct page *p;
+  syscall_do_mmap (f, syscall_get_arg (f, 1), (void *) syscall_get_arg (f, 2),
+                   syscall_get_arg (f, 3), syscall_get_arg (f, 4));
+}
 
-  ASSERT (thread_current ()->pagedir != NULL);
+/* Unmaps the mapping designated by mapping, which must be a mapping ID
+   returned by a previous call to mmap by the same process that has not
+   yet been unmapped. */
+static void
+syscall_munmap (struct intr_frame *f)
+{
+  mapid_t id = syscall_get_arg (f, 1);
+  struct thread *p = thread_current ()->process;
+  struct page_mmap *mmap;
 
-  if (uaddr == NULL)
-      syscall_terminate_process ();
-  /* Loop over every page in the queried block and check its validity. */
-  for (current_page = pg_round_down (uaddr);
-       current_page <= pg_round_down ((const uint8_t *)uaddr + size);
-       current_page += PGSIZE)
-    {
-      if (!is_user_vaddr (current_page)
-          || (p = page_lookup ((void *) current_page)) == NULL
-          || (writable && !page_is_writable (p)))
+  lock_acquire (p->syscall_lock);
+  mmap = page_get_mmap (p, id);
+  if (mmap != NULL)
+    list_remove (&mmap->list_elem);
+  lock_release (p->syscall_lock);
+  if (mmap != NULL)
+    page_delete_mmap (mmap);
+}
+
+/* Writes the pages of the mapping MAPPING changed since they were read
+   or last written back to its file, keeping them mapped. Returns true
+   if successful, false if MAPPING is invalid or writing fails. */
+static void
+syscall_msync (struct intr_frame *f)
+{
+  mapid_t id = syscall_get_arg (f, 1);
+  struct thread *p = thread_current ()->process;
+  struct page_mmap *mmap;
+
+  lock_acquire (p->syscall_lock);
+  mmap = page_get_mmap (p, id);
+  f->eax = mmap != NULL && page_mmap_sync (mmap);
+  lock_release (p->syscall_lock);
+}
+
+/* Tells the VM how the mapping MAPPING is going to be used: ADVICE is
+   one of the MADV_* constants. Returns true if successful, false if
+   MAPPING or ADVICE is invalid. */
+static void
+syscall_madvise (struct intr_frame *f)
+{
+  mapid_t id = syscall_get_arg (f, 1);
+  int advice = syscall_get_arg (f, 2);
+  struct thread *p = thread_current ()->process;
+  struct page_mmap *mmap;
+
+  lock_acquire (p->syscall_lock);
+  mmap = page_get_mmap (p, id);
+  f->eax = mmap != NULL && page_mmap_advise (mmap, advice);
+  lock_release (p->syscall_lock);
+}
+
+/* Moves the end of the heap by INCREMENT bytes, which may be negative.
+   Returns the old end of the heap, or (void *) -1 if it can't move that
+   far. New heap memory reads as zeros. */
+static void
+syscall_sbrk (struct intr_frame *f)
+{
+  intptr_t increment = syscall_get_arg (f, 1);
+  struct thread *p = thread_current ()->process;
+  void *old_break;
+
+  lock_acquire (p->syscall_lock);
+  old_break = page_sbrk (increment);
+  lock_release (p->syscall_lock);
+
+  f->eax = old_break != NULL ? (uint32_t) old_break : (uint32_t) -1;
+}
+
+/* Reads the statistics of up to CNT lock classes into the array STATS
+   of struct lockstat. Returns the number of classes read, or -1 if the
+   kernel keeps no lock statistics. */
+static void
+syscall_lockstat (struct intr_frame *f)
+{
+  struct lockstat *stats = (struct lockstat *) syscall_get_arg (f, 1);
+  uint32_t cnt = syscall_get_arg (f, 2);
+  struct lockstat *kstats;
+  size_t read_cnt;
+
+  if (!lock_stats_enabled)
+    {
+      f->eax = SYSCALL_ERROR;
+      return;
+    }
+  if (cnt > PGSIZE)
+    cnt = PGSIZE;  /* Bound the work of one call. */
+  kstats = palloc_get_page (0);
+  if (kstats == NULL)
+    {
+      f->eax = SYSCALL_ERROR;
+      return;
+    }
+
+  /* Copy out a page of classes at a time. */
+  for (read_cnt = 0; read_cnt < cnt; )
+    {
+      size_t chunk = cnt - read_cnt;
+      size_t got;
+
+      if (chunk > PGSIZE / sizeof *kstats)
+        chunk = PGSIZE / sizeof *kstats;
+      got = lock_stats_get (kstats, read_cnt, chunk);
+      if (got > 0 && !copy_to_user (stats + read_cnt, kstats,
+                                    got * sizeof *kstats))
+        {
+          palloc_free_page (kstats);
           syscall_terminate_process ();
+        }
+      read_cnt += got;
+      if (got < chunk)
+        break;
+    }
+  palloc_free_page (kstats);
+  f->eax = read_cnt;
+}
+
+/* Reads the statistics of the kernel's memory allocators into the
+   struct memstat STATS.  Returns false if memory for collecting them
+   is not available. */
+static void
+syscall_memstat (struct intr_frame *f)
+{
+  struct memstat *stats = (struct memstat *) syscall_get_arg (f, 1);
+  struct memstat *snapshot;
+
+  snapshot = malloc (sizeof *snapshot);
+  if (snapshot == NULL)
+    {
+      f->eax = false;
+      return;
+    }
+  malloc_stats_get (snapshot);
+  palloc_stats_get (&snapshot->kernel_pool, &snapshot->user_pool);
+  if (!copy_to_user (stats, snapshot, sizeof *stats))
+    {
+      free (snapshot);
+      syscall_terminate_process ();
+    }
+  free (snapshot);
+  f->eax = true;
+}
+
+/* Reads the calling process's buffer cache statistics into the struct
+   cachestat STATS. */
+static void
+syscall_cachestat (struct intr_frame *f)
+{
+  struct cachestat *stats = (struct cachestat *) syscall_get_arg (f, 1);
+  struct cachestat snapshot;
+
+  cache_get_stat (&snapshot);
+  syscall_copy_out (stats, &snapshot, sizeof snapshot);
+}
+
+/* Puts the calling thread in the real-time class, to run for BUDGET_MS
+   milliseconds of every PERIOD_MS ahead of other threads, or takes it
+   out of the class if PERIOD_MS is 0.  Both are rounded up to timer
+   ticks.  Returns true if successful, false if the budget is not
+   within the period or the CPU can't take the reservation. */
+static void
+syscall_sched_deadline (struct intr_frame *f)
+{
+  uint32_t period_ms = syscall_get_arg (f, 1);
+  uint32_t budget_ms = syscall_get_arg (f, 2);
+
+  f->eax = thread_set_realtime (DIV_ROUND_UP ((int64_t) period_ms
+                                              * TIMER_FREQ, 1000),
+                                DIV_ROUND_UP ((int64_t) budget_ms
+                                              * TIMER_FREQ, 1000));
+}
+
+/* Returns the calling thread's priority, including any donated to it
+   and, under the MLFQS scheduler, as last computed from its nice value
+   and recent CPU use. */
+static void
+syscall_getpriority (struct intr_frame *f)
+{
+  f->eax = thread_get_priority ();
+}
+
+/* Sets the calling thread's priority to PRIORITY, which may only lower
+   it, so a process can give way to others but not take over the CPU.
+   Returns true if successful, false if PRIORITY is out of range or
+   above the thread's own priority, or the MLFQS scheduler, which sets
+   priorities itself, is in use. */
+static void
+syscall_setpriority (struct intr_frame *f)
+{
+  int32_t priority = syscall_get_arg (f, 1);
+
+  if (thread_mlfqs || priority < PRI_MIN
+      || priority > thread_current ()->base_priority)
+    f->eax = false;
+  else
+    {
+      thread_set_priority (priority);
+      f->eax = true;
+    }
+}
+
+/* Returns the calling thread's nice value. */
+static void
+syscall_getnice (struct intr_frame *f)
+{
+  f->eax = thread_get_nice ();
+}
+
+/* Sets the calling thread's nice value, its niceness to others under
+   the MLFQS scheduler, to NICE, which may only raise it.  Returns true
+   if successful, false if NICE is more than MLFQS_NICE_MAX or below the
+   current value. */
+static void
+syscall_setnice (struct intr_frame *f)
+{
+  int32_t nice = syscall_get_arg (f, 1);
+
+  if (nice > MLFQS_NICE_MAX || nice < thread_get_nice ())
+    f->eax = false;
+  else
+    {
+      thread_set_nice (nice);
+      f->eax = true;
+    }
+}
+
+/* Joins the arguments in UARGV, a null-terminated array in user
+   memory, into CMD_LINE, a page, separated by spaces.  Returns 1 if
+   successful, 0 if there are none, one is empty or has a space in it
+   or they don't fit, or -1 if they are not all readable. */
+static int
+spawn_cmd_line (char *cmd_line, const char **uargv)
+{
+  size_t len = 0;
+  size_t i;
+
+  for (i = 0; ; i++)
+    {
+      const char *uarg;
+      int arg_len;
+
+      if (!copy_from_user (&uarg, &uargv[i], sizeof uarg))
+        return -1;
+      if (uarg == NULL)
+        return i > 0;
+      if (i > 0)
+        cmd_line[len++] = ' ';
+      if (len == PGSIZE)
+        return 0;
+      arg_len = copy_string_from_user (cmd_line + len, uarg, PGSIZE - len);
+      if (arg_len < 0)
+        return -1;
+      if (arg_len == 0 || (size_t) arg_len == PGSIZE - len
+          || memchr (cmd_line + len, ' ', arg_len) != NULL)
+        return 0;
+      len += arg_len;
+    }
+}
+
+/* Puts ENTRY, or nothing if ENTRY is null, under descriptor FD in the
+   *FD_CNT-entry table *FD_TABLE for a new process, closing what was
+   there and growing the table as needed.  Closes ENTRY and returns
+   false if memory is not available. */
+static bool
+spawn_set_fd (struct fd_entry **fd_table, int *fd_cnt, int fd,
+              struct fd_entry *entry)
+{
+  if (fd >= *fd_cnt)
+    {
+      int cnt = fd < SYSCALL_FD_TABLE_MIN ? SYSCALL_FD_TABLE_MIN : fd + 1;
+      struct fd_entry *table;
+
+      if (entry == NULL)
+        return true;
+      table = realloc (*fd_table, cnt * sizeof *table);
+      if (table == NULL)
+        {
+          fd_entry_close (entry);
+          return false;
+        }
+      memset (table + *fd_cnt, 0, (cnt - *fd_cnt) * sizeof *table);
+      *fd_table = table;
+      *fd_cnt = cnt;
+    }
+  if ((*fd_table)[fd].filesys_ptr != NULL)
+    fd_entry_close (&(*fd_table)[fd]);
+  if (entry != NULL)
+    (*fd_table)[fd] = *entry;
+  return true;
+}
+
+/* Carries out ACTION on the table *FD_TABLE of *FD_CNT descriptors
+   and the working directory *CWD, null for the caller's, of a new
+   process, using PATH, a page, for ACTION's path.  Returns 1 if
+   successful, 0 if ACTION is invalid or fails, or -1 if its path is
+   not readable. */
+static int
+spawn_run_action (const struct spawn_action *action, char *path,
+                  struct fd_entry **fd_table, int *fd_cnt, struct dir **cwd)
+{
+  struct thread *t = thread_current ()->process;
+  struct fd_entry entry;
+  bool isdir;
+  bool found;
+
+  if (action->type != SPAWN_CHDIR
+      && (action->fd < SYSCALL_FIRST_FD || action->fd > SYSCALL_SPAWN_FD_MAX))
+    return 0;
+  if (action->type == SPAWN_OPEN && (action->flags & ~O_DSYNC))
+    return 0;
+  if (action->type == SPAWN_OPEN || action->type == SPAWN_CHDIR)
+    {
+      int len = copy_string_from_user (path, action->path, PGSIZE);
+
+      if (len < 0)
+        return -1;
+      if (len == PGSIZE)
+        return 0;
+      entry.filesys_ptr = filesys_open_at (*cwd, path, &isdir);
+      if (entry.filesys_ptr == NULL)
+        return 0;
+      entry.type = isdir ? FD_DIR : FD_FILE;
+    }
+
+  switch (action->type)
+    {
+    case SPAWN_DUP:
+      lock_acquire (t->syscall_lock);
+      found = (action->src_fd >= SYSCALL_FIRST_FD
+               && action->src_fd < t->fd_cnt
+               && t->fd_table[action->src_fd].filesys_ptr != NULL
+               && fd_entry_reopen (&t->fd_table[action->src_fd], &entry));
+      lock_release (t->syscall_lock);
+      return found && spawn_set_fd (fd_table, fd_cnt, action->fd, &entry);
+
+    case SPAWN_CLOSE:
+      return spawn_set_fd (fd_table, fd_cnt, action->fd, NULL);
+
+    case SPAWN_OPEN:
+      if (!isdir && (action->flags & O_DSYNC))
+        filesys_set_write_through (entry.filesys_ptr, true);
+      return spawn_set_fd (fd_table, fd_cnt, action->fd, &entry);
+
+    case SPAWN_CHDIR:
+      if (!isdir)
+        {
+          fd_entry_close (&entry);
+          return 0;
+        }
+      filesys_closedir (*cwd);
+      *cwd = entry.filesys_ptr;
+      return 1;
+
+    default:
+      return 0;
     }
 }
 
-/* Returns only if UADDR points to a valid null-terminated string in the
-   current thread's page directory or if no null-terminator is found
-   in the MAX_SIZE valid chars following UADDR. Otherwise, calls
-   syscall_terminate_process and never returns.
-   MAX_SIZE must be positive. */
+/* Starts a new process running the program UARGV[0] with the
+   arguments in UARGV, a null-terminated array, after carrying out the
+   ACTION_CNT actions in UACTIONS, in order, on the file descriptors
+   and working directory it starts with, see lib/spawn.h.  Waits for
+   the program to load unless FLAGS has SPAWN_NOWAIT, in which case
+   wait() reports a failure to load as exit status -1.  Returns the
+   new process's pid, or TID_ERROR if an argument or action is
+   invalid, an action fails, or a program waited for can't load. */
 static void
-syscall_validate_user_string (const char *uaddr, size_t max_size)
+syscall_spawn (struct intr_frame *f)
 {
-  const char *caddr = uaddr;
+  const char **uargv = (const char **) syscall_get_arg (f, 1);
+  const struct spawn_action *uactions
+    = (const struct spawn_action *) syscall_get_arg (f, 2);
+  uint32_t action_cnt = syscall_get_arg (f, 3);
+  uint32_t flags = syscall_get_arg (f, 4);
+  struct spawn_action *actions;
+  struct fd_entry *fd_table = NULL;
+  int fd_cnt = 0;
+  struct dir *cwd = NULL;
+  char *cmd_line, *path;
+  int result = 0;
+  uint32_t i;
+
+  f->eax = TID_ERROR;
+  if (action_cnt > SPAWN_ACTIONS_MAX || (flags & ~SPAWN_NOWAIT) != 0)
+    return;
+  cmd_line = palloc_get_page (0);
+  path = palloc_get_page (0);
+  actions = malloc (action_cnt * sizeof *actions);
+  if (cmd_line != NULL && path != NULL
+      && (actions != NULL || action_cnt == 0))
+    result = spawn_cmd_line (cmd_line, uargv);
+  if (result > 0 && action_cnt > 0
+      && !copy_from_user (actions, uactions, action_cnt * sizeof *actions))
+    result = -1;
+
+  /* Set up the new process's descriptors and directory here, where a
+     failure can still be reported, and hand them over. */
+  for (i = 0; result > 0 && i < action_cnt; i++)
+    result = spawn_run_action (&actions[i], path, &fd_table, &fd_cnt, &cwd);
+  if (result > 0)
+    f->eax = process_spawn (cmd_line, cwd, fd_table, fd_cnt,
+                            !(flags & SPAWN_NOWAIT));
+  else
+    {
+      syscall_fds_free (fd_table, fd_cnt);
+      filesys_closedir (cwd);
+    }
+  palloc_free_page (cmd_line);
+  palloc_free_page (path);
+  free (actions);
+  if (result < 0)
+    syscall_terminate_process ();
+}
 
-  ASSERT (thread_current ()->pagedir != NULL);
+/* Waits for child process PID, or any child if PID is -1, to exit and
+   stores its exit status in *STATUS unless STATUS is null.  Returns
+   the child's pid, 0 if OPTIONS has WNOHANG and it hasn't exited yet,
+   or -1 if there is no such child. */
+static void
+syscall_waitpid (struct intr_frame *f)
+{
+  tid_t tid = syscall_get_arg (f, 1);
+  int *ustatus = (int *) syscall_get_arg (f, 2);
+  uint32_t options = syscall_get_arg (f, 3);
+  int exit_code;
+  tid_t result;
+
+  if (options & ~WNOHANG)
+    {
+      f->eax = TID_ERROR;
+      return;
+    }
+  result = process_waitpid (tid, &exit_code, options & WNOHANG);
+  if (result > 0 && ustatus != NULL)
+    syscall_copy_out (ustatus, &exit_code, sizeof exit_code);
+  f->eax = result;
+}
+
+/* Reads the I/O and memory statistics of the calling process, if WHO
+   is PROCSTAT_SELF, or the totals of its children that have exited,
+   if PROCSTAT_CHILDREN, into the struct procstat STATS.  Returns true
+   if successful, false if WHO is neither. */
+static void
+syscall_procstat (struct intr_frame *f)
+{
+  int32_t who = syscall_get_arg (f, 1);
+  struct procstat *stats = (struct procstat *) syscall_get_arg (f, 2);
+  struct thread *p = thread_current ()->process;
+  struct procstat snapshot;
+
+  f->eax = false;
+  if (who == PROCSTAT_SELF)
+    procstat_get (p, &snapshot);
+  else if (who == PROCSTAT_CHILDREN)
+    procstat_get_children (p, &snapshot);
+  else
+    return;
+  syscall_copy_out (stats, &snapshot, sizeof snapshot);
+  f->eax = true;
+}
+
+/* Reads the CPU time used by the calling process, if WHO is
+   RUSAGE_SELF, by its children that have exited, if RUSAGE_CHILDREN,
+   or by the calling thread, if RUSAGE_THREAD, into the struct rusage
+   USAGE.  Returns true if successful, false if WHO is none of
+   those. */
+static void
+syscall_getrusage (struct intr_frame *f)
+{
+  int32_t who = syscall_get_arg (f, 1);
+  struct rusage *usage = (struct rusage *) syscall_get_arg (f, 2);
+  struct thread *t = thread_current ();
+  struct rusage snapshot;
+
+  f->eax = false;
+  if (who == RUSAGE_SELF)
+    process_get_times (t->process, &snapshot.user_ns, &snapshot.kernel_ns);
+  else if (who == RUSAGE_CHILDREN)
+    {
+      struct procstat children;
+
+      procstat_get_children (t->process, &children);
+      snapshot.user_ns = children.user_ns;
+      snapshot.kernel_ns = children.kernel_ns;
+    }
+  else if (who == RUSAGE_THREAD)
+    thread_get_times (t, &snapshot.user_ns, &snapshot.kernel_ns);
+  else
+    return;
+  syscall_copy_out (usage, &snapshot, sizeof snapshot);
+  f->eax = true;
+}
+
+/* Returns a file descriptor that is readable, to poll(), each time
+   memory pressure reaches LEVEL, one of MEMPRESSURE_LOW,
+   MEMPRESSURE_MEDIUM and MEMPRESSURE_CRITICAL, and that read() waits
+   on until then and reads the level reached from, as an int.  Returns
+   -1 if LEVEL is not one of those or memory is not available. */
+static void
+syscall_mempressure_open (struct intr_frame *f)
+{
+  int32_t level = syscall_get_arg (f, 1);
+  struct pressure_watch *w;
+
+  f->eax = SYSCALL_ERROR;
+  w = frame_pressure_watch (level);
+  if (w == NULL)
+    return;
+  f->eax = fd_allocate (w, FD_MEMPRESSURE);
+  if ((int) f->eax < 0)
+    frame_pressure_close (w);
+}
+
+/* Creates a file at NEW with the contents of the file at OLD, sharing
+   its disk sectors until either one writes to them, so that even a big
+   file is copied in constant time. Returns true if successful, false if
+   OLD is not a file or NEW already exists. */
+static void
+syscall_clone (struct intr_frame *f)
+{
+  char *old_path
+    = syscall_copy_in_string ((const char *) syscall_get_arg (f, 1));
+  char *new_path = palloc_get_page (0);
+
+  /* Don't leak OLD_PATH if NEW can't be copied in. */
+  if (new_path == NULL
+      || copy_string_from_user (new_path,
+                                (const char *) syscall_get_arg (f, 2),
+                                PGSIZE) < 0)
+    {
+      palloc_free_page (new_path);
+      palloc_free_page (old_path);
+      syscall_terminate_process ();
+    }
+  new_path[PGSIZE - 1] = '\0';
+
+  f->eax = filesys_clone (old_path, new_path);
+  palloc_free_page (old_path);
+  palloc_free_page (new_path);
+}
+
+/* Moves up to CNT of the oldest kernel trace events not read yet into
+   the array RECORDS of struct trace_record. Returns the number of
+   events read, or -1 if the kernel isn't tracing. */
+static void
+syscall_trace_read (struct intr_frame *f)
+{
+  struct trace_record *records
+    = (struct trace_record *) syscall_get_arg (f, 1);
+  uint32_t cnt = syscall_get_arg (f, 2);
+  struct trace_record *krecords;
+  size_t read_cnt;
+
+  if (!trace_enabled)
+    {
+      f->eax = SYSCALL_ERROR;
+      return;
+    }
+  if (cnt > PGSIZE)
+    cnt = PGSIZE;  /* Bound the work of one call. */
+  krecords = palloc_get_page (0);
+  if (krecords == NULL)
+    {
+      f->eax = SYSCALL_ERROR;
+      return;
+    }
 
-  for (; caddr != uaddr + max_size + 1; ++caddr)
+  /* Copy out a page of events at a time. Events taken from the ring
+     are gone, so a bad RECORDS loses them. */
+  for (read_cnt = 0; read_cnt < cnt; )
     {
-      syscall_validate_user_memory (caddr, sizeof (char), false);
-      if (*caddr == '\0')
+      size_t chunk = cnt - read_cnt;
+      size_t got;
+
+      if (chunk > PGSIZE / sizeof *krecords)
+        chunk = PGSIZE / sizeof *krecords;
+      got = trace_get (krecords, chunk);
+      if (got > 0 && !copy_to_user (records + read_cnt, krecords,
+                                    got * sizeof *krecords))
+        {
+          palloc_free_page (krecords);
+          syscall_terminate_process ();
+        }
+      read_cnt += got;
+      if (got < chunk)
         break;
     }
+  palloc_free_page (krecords);
+  f->eax = read_cnt;
+}
+
+/* Copies the statistics of system call numbers 0 up to CNT into the
+   array STATS of struct syscallstat, those of all processes if ALL is
+   true, otherwise those of the current process.  Returns the number
+   of system calls copied, or -1 if the kernel keeps no statistics. */
+static void
+syscall_syscallstat (struct intr_frame *f)
+{
+  bool all = syscall_get_arg (f, 1);
+  struct syscallstat *stats = (struct syscallstat *) syscall_get_arg (f, 2);
+  uint32_t cnt = syscall_get_arg (f, 3);
+  struct syscallstat *own = thread_current ()->process->syscall_stats;
+  struct syscallstat *snapshot;
+  enum intr_level old_level;
+
+  if (!syscall_stats_enabled || (!all && own == NULL))
+    {
+      f->eax = SYSCALL_ERROR;
+      return;
+    }
+  if (cnt > SYSCALL_CNT)
+    cnt = SYSCALL_CNT;
+  snapshot = malloc (cnt * sizeof *snapshot);
+  if (snapshot == NULL && cnt > 0)
+    {
+      f->eax = SYSCALL_ERROR;
+      return;
+    }
+
+  old_level = intr_disable ();
+  memcpy (snapshot, all ? syscall_stats : own, cnt * sizeof *snapshot);
+  intr_set_level (old_level);
+  if (!copy_to_user (stats, snapshot, cnt * sizeof *snapshot))
+    {
+      free (snapshot);
+      syscall_terminate_process ();
+    }
+  free (snapshot);
+  f->eax = cnt;
+}
+
+/* Reads up to CNT of the kernel's statistics into the array STATS of
+   struct kstat.  Returns the number read, or -1 if memory for
+   collecting them is not available. */
+static void
+syscall_kstat (struct intr_frame *f)
+{
+  struct kstat *stats = (struct kstat *) syscall_get_arg (f, 1);
+  uint32_t cnt = syscall_get_arg (f, 2);
+  struct kstat *kstats;
+  size_t got;
+
+  if (cnt > PGSIZE / sizeof *kstats)
+    cnt = PGSIZE / sizeof *kstats;  /* More than are ever registered. */
+  kstats = palloc_get_page (0);
+  if (kstats == NULL)
+    {
+      f->eax = SYSCALL_ERROR;
+      return;
+    }
+  got = kstat_get (kstats, cnt);
+  if (got > 0 && !copy_to_user (stats, kstats, got * sizeof *kstats))
+    {
+      palloc_free_page (kstats);
+      syscall_terminate_process ();
+    }
+  palloc_free_page (kstats);
+  f->eax = got;
+}
+
+/* Adds a call to system call NR that took CYCLES to the system-wide
+   statistics and to the current process's. */
+static void
+syscall_account (int nr, uint64_t cycles)
+{
+  struct syscallstat *own = thread_current ()->process->syscall_stats;
+  enum intr_level old_level;
+  size_t bucket = 0;
+
+  if (cycles >> 32 != 0)
+    bucket = SYSCALLSTAT_BUCKETS - 1;
+  else if (cycles != 0)
+    bucket = 31 - __builtin_clz ((uint32_t) cycles);
+  if (bucket >= SYSCALLSTAT_BUCKETS)
+    bucket = SYSCALLSTAT_BUCKETS - 1;
+
+  old_level = intr_disable ();
+  syscall_account_one (&syscall_stats[nr], bucket, cycles);
+  if (own != NULL)
+    syscall_account_one (&own[nr], bucket, cycles);
+  intr_set_level (old_level);
+}
+
+/* Adds a call that took CYCLES, which go in histogram bucket
+   BUCKET, to STAT. */
+static void
+syscall_account_one (struct syscallstat *stat, size_t bucket,
+                     uint64_t cycles)
+{
+  stat->return_cnt++;
+  stat->cycles += cycles;
+  if (cycles > stat->max_cycles)
+    stat->max_cycles = cycles;
+  stat->buckets[bucket]++;
+}
+
+/* Prints STATS, the statistics of WHO's system calls by number: the
+   calls of each, their mean and longest latencies, and the nonzero
+   buckets of its latency histogram as "2^I:COUNT". */
+static void
+syscall_print_table (const char *who, const struct syscallstat *stats)
+{
+  int nr;
+
+  for (nr = 0; nr < SYSCALL_CNT; nr++)
+    {
+      const struct syscallstat *s = &stats[nr];
+      size_t i;
+
+      if (s->call_cnt == 0)
+        continue;
+      printf ("%s: syscall %s: %"PRIu64" calls, %"PRIu64" cycles mean, "
+              "%"PRIu64" max;", who, syscall_names[nr], s->call_cnt,
+              s->return_cnt != 0 ? s->cycles / s->return_cnt : 0,
+              s->max_cycles);
+      for (i = 0; i < SYSCALLSTAT_BUCKETS; i++)
+        if (s->buckets[i] != 0)
+          printf (" 2^%zu:%"PRIu32, i, s->buckets[i]);
+      printf ("\n");
+    }
+}
+
+/* Prints the statistics of all processes' system calls. */
+void
+syscall_print_stats (void)
+{
+  if (syscall_stats_enabled)
+    syscall_print_table ("Syscalls", syscall_stats);
+}
+
+/* Gives FILESYS_PTR, of TYPE, the lowest free file descriptor of the
+   current process, growing its fd_table if it is full.  Returns the
+   file descriptor, or -1 if memory is not available. */
+static int 
+fd_allocate (void *filesys_ptr, enum fd_type type)
+{
+  struct thread *t = thread_current ()->process;
+  int fd;
+
+  lock_acquire (t->syscall_lock);
+  for (fd = SYSCALL_FIRST_FD; fd < t->fd_cnt; fd++)
+    if (t->fd_table[fd].filesys_ptr == NULL)
+      break;
+  if (fd == t->fd_cnt)
+    {
+      int cnt = t->fd_cnt > 0 ? t->fd_cnt * 2 : SYSCALL_FD_TABLE_MIN;
+      struct fd_entry *table = realloc (t->fd_table, cnt * sizeof *table);
+
+      if (table == NULL)
+        {
+          lock_release (t->syscall_lock);
+          return -1;
+        }
+      memset (table + t->fd_cnt, 0, (cnt - t->fd_cnt) * sizeof *table);
+      t->fd_table = table;
+      t->fd_cnt = cnt;
+    }
+  t->fd_table[fd].filesys_ptr = filesys_ptr;
+  t->fd_table[fd].type = type;
+  lock_release (t->syscall_lock);
+  return fd;
+}
+
+/* Makes COPY a new reference to the file, dir, pipe end, shared
+   memory segment, or memory pressure watch of FD_ENTRY, a file keeping
+   its position and a watch what it has seen.  Returns false if memory
+   is not available. */
+static bool
+fd_entry_reopen (const struct fd_entry *fd_entry, struct fd_entry *copy)
+{
+  copy->type = fd_entry->type;
+  if (fd_entry->type == FD_DIR)
+    copy->filesys_ptr = filesys_reopendir (fd_entry->filesys_ptr);
+  else if (fd_entry->type == FD_SHM)
+    copy->filesys_ptr = share_shm_reopen (fd_entry->filesys_ptr);
+  else if (fd_entry->type == FD_MEMPRESSURE)
+    copy->filesys_ptr = frame_pressure_reopen (fd_entry->filesys_ptr);
+  else if (fd_entry->type != FD_FILE)
+    {
+      pipe_reopen (fd_entry->filesys_ptr, fd_entry->type == FD_PIPE_WRITER);
+      copy->filesys_ptr = fd_entry->filesys_ptr;
+    }
+  else
+    {
+      copy->filesys_ptr = filesys_reopen (fd_entry->filesys_ptr);
+      if (copy->filesys_ptr != NULL)
+        filesys_seek (copy->filesys_ptr,
+                      filesys_tell (fd_entry->filesys_ptr));
+    }
+  return copy->filesys_ptr != NULL;
+}
+
+/* Closes the file, dir, pipe end, shared memory segment, or memory
+   pressure watch of FD_ENTRY and marks the entry free. */
+static void 
+fd_entry_close (struct fd_entry *fd_entry)
+{
+  if (fd_entry->type == FD_DIR)
+    filesys_closedir (fd_entry->filesys_ptr);
+  else if (fd_entry->type == FD_FILE)
+    filesys_close (fd_entry->filesys_ptr);
+  else if (fd_entry->type == FD_SHM)
+    share_shm_close (fd_entry->filesys_ptr);
+  else if (fd_entry->type == FD_MEMPRESSURE)
+    frame_pressure_close (fd_entry->filesys_ptr);
+  else
+    pipe_close (fd_entry->filesys_ptr, fd_entry->type == FD_PIPE_WRITER);
+  fd_entry->filesys_ptr = NULL;
+}
+
+/* Copies the `struct fd_entry` of file descriptor FD in the current
+   process's fd_table into COPY and returns COPY, since another thread
+   may move the table meanwhile. Returns NULL if FD is not found. */
+static struct fd_entry *
+fd_lookup (int fd, struct fd_entry *copy)
+{
+  struct thread *t = thread_current ()->process;
+  bool found;
+
+  lock_acquire (t->syscall_lock);
+  found = (fd >= SYSCALL_FIRST_FD && fd < t->fd_cnt
+           && t->fd_table[fd].filesys_ptr != NULL);
+  if (found)
+    *copy = t->fd_table[fd];
+  lock_release (t->syscall_lock);
+  return found ? copy : NULL;
+}
+
+/* Stores in *BASEP a new reference to the directory that file
+   descriptor DIRFD represents, for the *at calls to resolve paths from,
+   or a null pointer, meaning the current working directory, if DIRFD
+   is negative. The reference is taken under the syscall lock, so that
+   another thread closing DIRFD can't free the directory meanwhile.
+   Returns false if DIRFD is not a directory or memory is short. */
+static bool
+syscall_open_base (int dirfd, struct dir **basep)
+{
+  struct thread *t = thread_current ()->process;
+
+  *basep = NULL;
+  if (dirfd < 0)
+    return true;
+  lock_acquire (t->syscall_lock);
+  if (dirfd >= SYSCALL_FIRST_FD && dirfd < t->fd_cnt
+      && t->fd_table[dirfd].filesys_ptr != NULL
+      && t->fd_table[dirfd].type == FD_DIR)
+    *basep = filesys_reopendir (t->fd_table[dirfd].filesys_ptr);
+  lock_release (t->syscall_lock);
+  return *basep != NULL;
+}
+
+/* Frees file descriptor FD in the current process's fd_table, storing
+   what was there in ENTRY for the caller to close.  Returns false if
+   FD is not found. */
+static bool
+fd_remove (int fd, struct fd_entry *entry)
+{
+  struct thread *t = thread_current ()->process;
+  bool found;
+
+  lock_acquire (t->syscall_lock);
+  found = (fd >= SYSCALL_FIRST_FD && fd < t->fd_cnt
+           && t->fd_table[fd].filesys_ptr != NULL);
+  if (found)
+    {
+      *entry = t->fd_table[fd];
+      t->fd_table[fd].filesys_ptr = NULL;
+    }
+  lock_release (t->syscall_lock);
+  return found;
+}
+
+
+/* Terminates the current process with error code -1 freeing its
+   resources. Called in various syscalls on error. Never returns. */
+static void
+syscall_terminate_process (void)
+{
+  process_terminate (-1);
+}
+
+/* Copies SIZE bytes from user address USRC to DST, or terminates the
+   process if they are not all readable. */
+static void
+syscall_copy_in (void *dst, const void *usrc, size_t size)
+{
+  if (!copy_from_user (dst, usrc, size))
+    syscall_terminate_process ();
+}
+
+/* Copies SIZE bytes from SRC to user address UDST, or terminates the
+   process if they are not all writable. */
+static void
+syscall_copy_out (void *udst, const void *src, size_t size)
+{
+  if (!copy_to_user (udst, src, size))
+    syscall_terminate_process ();
+}
+
+/* Returns a copy of the null-terminated string at user address USTR
+   in a new page, which the caller must free with palloc_free_page().
+   A string too long for the page is cut short.  Terminates the
+   process if the string is not readable or no page is available. */
+static char *
+syscall_copy_in_string (const char *ustr)
+{
+  char *kstr = palloc_get_page (0);
+
+  if (kstr == NULL)
+    syscall_terminate_process ();
+  if (copy_string_from_user (kstr, ustr, PGSIZE) < 0)
+    {
+      palloc_free_page (kstr);
+      syscall_terminate_process ();
+    }
+  kstr[PGSIZE - 1] = '\0';
+  return kstr;
 }
 
-/* Returns argument number IDX passed to the system call threough
-   interrupt frame F after passing it to syscall_validate_user_memory.
+/* Returns argument number IDX passed to the system call through
+   interrupt frame F, which syscall_handler() has already copied in
+   along with the rest of the arguments.
    Remember that all arguments are of size 32-bit.
    Remember that IDX=0 is the syscall number. */
 static uint32_t
-syscall_get_arg (struct intr_frame *f, size_t idx)
+syscall_get_arg (struct intr_frame *f UNUSED, size_t idx)
 {
-  uint32_t *arg = (uint32_t *)(f->esp) + idx;
-  syscall_validate_user_memory (arg, sizeof (uint32_t), false);
-  return *arg;
+  ASSERT (idx < sizeof thread_current ()->syscall_args
+                / sizeof *thread_current ()->syscall_args);
+  return thread_current ()->syscall_args[idx];
 }
@@ -5,13 +5,38 @@
 
 #define SYSCALL_ERROR -1
 
+struct fd_entry;
+struct intr_frame;
+struct thread;
+
+/* Set by the "-syscallstat" kernel command-line option. */
+extern bool syscall_stats_enabled;
+
 void syscall_init (void);
+void syscall_handler (struct intr_frame *);
 bool syscall_process_init (void);
+bool syscall_process_fork (struct thread *parent);
+bool syscall_process_spawn (struct fd_entry *fd_table, int fd_cnt);
+void syscall_fds_free (struct fd_entry *fd_table, int fd_cnt);
 void syscall_process_done (void);
+void syscall_print_stats (void);
 void syscall_close_helper (int fd);
 
 /* Map region identifier. */
 typedef int mapid_t;
 #define MAP_FAILED ((mapid_t) -1)
 
+/* Advice to madvise() about a mapping. */
+#define MADV_NORMAL 0           /* No particular pattern. */
+#define MADV_SEQUENTIAL 1       /* Read in order, each page once. */
+#define MADV_RANDOM 2           /* Read in no particular order. */
+#define MADV_WILLNEED 3         /* Will be used soon, load it now. */
+#define MADV_DONTNEED 4         /* Won't be used soon, drop it now. */
+
+/* Flags to openat(). */
+#define O_DSYNC 0x1             /* Each write returns once on disk. */
+
+/* Options to waitpid(). */
+#define WNOHANG 0x1             /* Return 0 if no child has exited. */
+
 #endif /* userprog/syscall.h */
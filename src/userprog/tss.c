@@ -2,6 +2,8 @@
 #include <debug.h>
 #include <stddef.h>
 #include "userprog/gdt.h"
+#include "threads/init.h"
+#include "threads/kstack.h"
 #include "threads/thread.h"
 #include "threads/palloc.h"
 #include "threads/vaddr.h"
@@ -75,6 +77,22 @@ struct tss
 /* Kernel TSS. */
 static struct tss *tss;
 
+/* TSS of the task that a double fault switches to, with a stack of
+   its own.  A kernel stack that overflows into its guard page
+   faults again pushing the page fault's frame, and only a task
+   switch gets the processor off of that stack to report it. */
+static struct tss *df_tss;
+
+static void double_fault (void) NO_RETURN;
+
+/* Model-specific registers that sysenter loads CS, ESP, and EIP
+   from.  See [IA32-v3a] 4.8.7 "Fast System Calls". */
+#define MSR_SYSENTER_CS 0x174
+#define MSR_SYSENTER_ESP 0x175
+#define MSR_SYSENTER_EIP 0x176
+
+static void sysenter_init (void);
+
 /* Initializes the kernel TSS. */
 void
 tss_init (void) 
@@ -86,6 +104,35 @@ tss_init (void)
   tss->ss0 = SEL_KDSEG;
   tss->bitmap = 0xdfff;
   tss_update ();
+  sysenter_init ();
+
+  df_tss = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+  df_tss->esp = (uint32_t) palloc_get_page (PAL_ASSERT) + PGSIZE;
+  df_tss->eip = double_fault;
+  df_tss->eflags = 0x2;
+  df_tss->cr3 = vtop (init_page_dir);
+  df_tss->cs = SEL_KCSEG;
+  df_tss->ss = df_tss->ds = df_tss->es = SEL_KDSEG;
+  df_tss->fs = df_tss->gs = SEL_KDSEG;
+  df_tss->bitmap = 0xdfff;
+}
+
+/* Points sysenter at sysenter_entry in sysenter.S, if the CPU has
+   it.  The stack sysenter switches to is a single word that holds
+   the TSS's esp0, which the entry loads as its real stack, so that
+   the register need not change on every thread switch. */
+static void
+sysenter_init (void)
+{
+  extern void sysenter_entry (void);
+
+  if ((cpu_features () & CPUID_SEP) == 0)
+    return;
+  asm volatile ("wrmsr" : : "c" (MSR_SYSENTER_CS), "a" (SEL_KCSEG), "d" (0));
+  asm volatile ("wrmsr" : : "c" (MSR_SYSENTER_ESP), "a" (&tss->esp0),
+                "d" (0));
+  asm volatile ("wrmsr" : : "c" (MSR_SYSENTER_EIP), "a" (sysenter_entry),
+                "d" (0));
 }
 
 /* Returns the kernel TSS. */
@@ -96,11 +143,32 @@ tss_get (void)
   return tss;
 }
 
+/* Returns the double fault TSS. */
+struct tss *
+tss_get_double_fault (void)
+{
+  ASSERT (df_tss != NULL);
+  return df_tss;
+}
+
+/* Runs as the task of the double fault TSS.  The state of the code
+   that faulted was saved in the kernel TSS by the switch. */
+static void
+double_fault (void)
+{
+  void *esp = (void *) tss->esp;
+
+  if (kstack_contains (esp))
+    PANIC ("double fault at %p: kernel stack of thread `%s' overflowed "
+           "(esp=%p)", tss->eip, kstack_thread (esp)->name, esp);
+  PANIC ("double fault at %p (esp=%p)", tss->eip, esp);
+}
+
 /* Sets the ring 0 stack pointer in the TSS to point to the end
    of the thread stack. */
 void
 tss_update (void) 
 {
   ASSERT (tss != NULL);
-  tss->esp0 = (uint8_t *) thread_current () + PGSIZE;
+  tss->esp0 = thread_stack_top (thread_current ());
 }
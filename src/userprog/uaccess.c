@@ -0,0 +1,106 @@
+#include "userprog/uaccess.h"
+#include <debug.h>
+#include <stdint.h>
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* Each copy stores the address just past its copying instructions
+   in the running thread's user_fixup before it starts.  If one of
+   them faults on a user address that can't be brought in, the page
+   fault handler resumes at that address and clears user_fixup, so
+   a cleared user_fixup afterward means the copy failed.  A fault
+   that is resolved just resumes the copy, which the string
+   instructions allow. */
+
+/* Returns true if the SIZE bytes at UADDR lie wholly in user
+   memory. */
+static bool
+is_user_range (const void *uaddr, size_t size)
+{
+  uintptr_t start = (uintptr_t) uaddr;
+
+  return start + size >= start && start + size <= (uintptr_t) PHYS_BASE;
+}
+
+/* Ends a copy of the running thread T, returning false if it
+   faulted. */
+static bool
+copy_done (struct thread *t)
+{
+  bool ok = t->user_fixup != NULL;
+
+  t->user_fixup = NULL;
+  return ok;
+}
+
+/* Copies SIZE bytes from SRC to DST, any of which may be user
+   memory.  Returns false on an unresolved fault. */
+static bool
+copy_bytes (void *dst, const void *src, size_t size)
+{
+  struct thread *t = thread_current ();
+
+  ASSERT (t->user_fixup == NULL);
+  asm volatile ("movl $1f, %[fixup]\n\t"
+                "rep movsb\n"
+                "1:"
+                : "+D" (dst), "+S" (src), "+c" (size),
+                  [fixup] "=m" (t->user_fixup)
+                : : "memory");
+  return copy_done (t);
+}
+
+/* Copies SIZE bytes from user address USRC to DST in the kernel.
+   Returns false if some of them are not readable user memory, in
+   which case DST may have been partly written. */
+bool
+copy_from_user (void *dst, const void *usrc, size_t size)
+{
+  return is_user_range (usrc, size) && copy_bytes (dst, usrc, size);
+}
+
+/* Copies SIZE bytes from SRC in the kernel to user address UDST.
+   Returns false if some of them are not writable user memory, in
+   which case UDST may have been partly written. */
+bool
+copy_to_user (void *udst, const void *src, size_t size)
+{
+  return is_user_range (udst, size) && copy_bytes (udst, src, size);
+}
+
+/* Copies the null-terminated string at user address USRC into DST,
+   which has room for SIZE bytes, stopping at the null terminator or
+   after SIZE bytes.  Returns the length of the string, SIZE if it
+   did not fit, in which case DST is not null-terminated, or -1 if a
+   byte of it is not readable user memory. */
+int
+copy_string_from_user (char *dst, const char *usrc, size_t size)
+{
+  struct thread *t = thread_current ();
+  size_t left = size;
+  char *end = dst;
+
+  ASSERT (t->user_fixup == NULL);
+  ASSERT (size > 0 && size <= INT32_MAX);
+
+  /* Don't read past PHYS_BASE: the kernel is mapped there. */
+  if ((uintptr_t) usrc >= (uintptr_t) PHYS_BASE)
+    return -1;
+  if (left > (uintptr_t) PHYS_BASE - (uintptr_t) usrc)
+    left = (uintptr_t) PHYS_BASE - (uintptr_t) usrc;
+
+  asm volatile ("movl $2f, %[fixup]\n"
+                "1:\tlodsb\n\t"
+                "stosb\n\t"
+                "testb %%al, %%al\n\t"
+                "loopnz 1b\n"
+                "2:"
+                : "+D" (end), "+S" (usrc), "+c" (left),
+                  [fixup] "=m" (t->user_fixup)
+                : : "eax", "cc", "memory");
+  if (!copy_done (t))
+    return -1;
+  if (end > dst && end[-1] == '\0')
+    return end - dst - 1;
+  return (size_t) (end - dst) < size ? -1 : (int) size;
+}
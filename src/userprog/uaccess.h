@@ -0,0 +1,19 @@
+#ifndef USERPROG_UACCESS_H
+#define USERPROG_UACCESS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Copying between the kernel and the running process's memory.
+
+   These touch user memory directly and let the page fault handler
+   bring in whatever is not resident, so nothing is checked up
+   front but that the range lies below PHYS_BASE.  A fault the
+   handler can't resolve makes the copy return failure instead of
+   killing the process. */
+
+bool copy_from_user (void *dst, const void *usrc, size_t size);
+bool copy_to_user (void *udst, const void *src, size_t size);
+int copy_string_from_user (char *dst, const char *usrc, size_t size);
+
+#endif /* userprog/uaccess.h */
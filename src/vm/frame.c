@@ -1,19 +1,103 @@
 #include "vm/frame.h"
 #include <debug.h>
+#include <mempressure.h>
 #include <stdio.h>
-#include "threads/palloc.h"
+#include <string.h>
+#include "devices/timer.h"
+#include "threads/kstat.h"
 #include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/poll.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/trace.h"
+#include "threads/vaddr.h"
+#include "threads/vmalloc.h"
+#include "threads/workqueue.h"
 #include "userprog/pagedir.h"
+#include "vm/share.h"
+
+/* The page-out work starts reclaiming frames once fewer than
+   1/FRAME_LOW_WATER_SHARE of them are free, and goes on until twice
+   that many are. */
+#define FRAME_LOW_WATER_SHARE 64
+
+/* Page-fault-frequency control of each process's allowance of frames.
+   A process faulting again within PFF_INTERVAL ticks of its last fault
+   is short of frames, and its allowance grows by PFF_STEP. One faulting
+   less often gets an allowance of 3/4 of the frames it holds, at least
+   PFF_MIN, which makes the rest the first choice of the clock. */
+#define PFF_INTERVAL 4
+#define PFF_STEP 8
+#define PFF_MIN 16
+
+/* Memory pressure is judged from the evictions of the current and the
+   last PRESSURE_WINDOW ticks: any by the page-out work is low pressure,
+   any by page faults medium, and page faults evicting more than
+   1/PRESSURE_CRITICAL_SHARE of the frames in a window critical. */
+#define PRESSURE_WINDOW (TIMER_FREQ / 4)
+#define PRESSURE_CRITICAL_SHARE 16
 
 /* Frame table keeping track of all frames in the system. */
 static struct frame_table ft;
-/* Lock guarding operations on ft. */
+/* Lock guarding the free frames and counts of ft, and the clock. It is
+   never held across I/O. */
 static struct lock frame_table_lock;
-/* Hand of the clock algorithm */
-static struct list_elem *clock_hand;
+/* Number of the frame the hand of the clock algorithm is at. */
+static size_t clock_hand;
+
+/* Free frame watermarks of the page-out work. */
+static size_t low_water, high_water;
+/* Queued when free frames run below LOW_WATER, once started. */
+static struct work pageout_work;
+static bool pageout_started;
+/* Broadcast when frames stop being evicted. */
+static struct condition frames_changed;
+
+/* Memory pressure, guarded by frame_table_lock. Evictions by the
+   page-out work, index 0, and by page faults, index 1, in the window
+   starting at PRESSURE_START and in the one before it. Each level's
+   events count the windows in which it was reached, and its watches
+   are woken by each. */
+struct pressure_watch
+  {
+    int level;                  /* MEMPRESSURE_* level watched. */
+    unsigned seen;              /* Events of LEVEL when last read. */
+  };
+static int64_t pressure_start;
+static size_t pressure_cur[2], pressure_prev[2];
+static unsigned pressure_events[MEMPRESSURE_CRITICAL + 1];
+static int64_t pressure_signaled[MEMPRESSURE_CRITICAL + 1];
+static struct condition pressure_changed;
+static struct poll_queue pressure_pollers;
 
-static struct frame *frame_pick_and_evict (void);
+static void push_free (struct frame *);
+static void push_free_front (struct frame *);
+static struct frame *pop_free (bool zero);
+static struct frame *pop_free_back (void);
+static work_func pageout;
+
+/* Statistics. */
+static uint64_t read_free_cnt (void);
+static struct kstat_counter stat_reclaim = KSTAT_COUNTER ("frame.reclaim");
+static struct kstat_counter stat_sweep = KSTAT_COUNTER ("frame.sweep");
+static struct kstat_counter stat_evict_swap
+  = KSTAT_COUNTER ("frame.evict.swap");
+static struct kstat_counter stat_evict_file
+  = KSTAT_COUNTER ("frame.evict.file");
+static struct kstat_counter stat_evict_shared
+  = KSTAT_COUNTER ("frame.evict.shared");
+static struct kstat_counter stat_free
+  = KSTAT_GAUGE ("frame.free", read_free_cnt);
+static struct frame *frame_reclaim (bool *busy);
+static bool frame_claim (struct frame *, bool *busy);
+static bool frame_evict_cluster (struct frame *);
+static void frame_detach (struct frame *);
+static bool over_limit (struct thread *);
+static void charge (struct frame *, struct thread *);
+static void set_limit (struct thread *, size_t limit);
+static void pressure_note (bool demand);
+static int pressure_level (void);
 
 /* Frees up FRAME for future use. Does not evict the data in
    FRAME. */
@@ -21,163 +105,812 @@ void
 frame_free (struct frame *frame)
 {
   lock_acquire (&frame_table_lock);
-  /* Move the frame to the list of free frames. */
+  /* Move the frame to the free frames. */
+  charge (frame, NULL);
   frame->page = NULL;
   frame->pinned = false;
-  list_remove (&frame->elem);
-  list_push_back (&ft.free_frames, &frame->elem);
+  push_free (frame);
   lock_release (&frame_table_lock);
 }
 
+/* Returns the number of FRAME in the frame table. */
+static inline size_t
+frame_no (struct frame *frame)
+{
+  return frame - ft.frames;
+}
+
+/* Returns the frame at kernel address KADDR, or a null pointer if
+   KADDR is not in a page of the user pool. */
+struct frame *
+frame_lookup (void *kaddr)
+{
+  size_t no = ((uint8_t *) kaddr - ft.base) / PGSIZE;
+
+  if ((uint8_t *) kaddr < ft.base || no >= ft.frame_cnt
+      || ft.frames[no].kaddr == NULL)
+    return NULL;
+  return &ft.frames[no];
+}
+
+/* Puts FRAME at the back of the free frames.
+   Assumes frame_table_lock is acquired. */
+static void
+push_free (struct frame *frame)
+{
+  frame->zeroed = false;
+  ft.free_frames[(ft.free_start + ft.free_cnt) % ft.frame_cnt]
+    = frame_no (frame);
+  ft.free_cnt++;
+}
+
+/* Puts FRAME at the front of the free frames, leaving its ZEROED bit
+   as it is. Assumes frame_table_lock is acquired. */
+static void
+push_free_front (struct frame *frame)
+{
+  ft.free_start = (ft.free_start + ft.frame_cnt - 1) % ft.frame_cnt;
+  ft.free_frames[ft.free_start] = frame_no (frame);
+  ft.free_cnt++;
+}
+
+/* Takes the frame at the back off the free frames, which must not be
+   empty. Assumes frame_table_lock is acquired. */
+static struct frame *
+pop_free_back (void)
+{
+  ASSERT (ft.free_cnt > 0);
+  ft.free_cnt--;
+  return &ft.frames[ft.free_frames[(ft.free_start + ft.free_cnt)
+                                   % ft.frame_cnt]];
+}
+
+/* Takes a frame off the free frames, which must not be empty, and
+   queues the page-out work if that leaves too few. A zeroed frame
+   if ZERO and there is one, otherwise preferably one that isn't.
+   Assumes frame_table_lock is acquired. */
+static struct frame *
+pop_free (bool zero)
+{
+  struct frame *frame;
+
+  ASSERT (ft.free_cnt > 0);
+  if (zero)
+    {
+      frame = &ft.frames[ft.free_frames[ft.free_start]];
+      ft.free_start = (ft.free_start + 1) % ft.frame_cnt;
+      ft.free_cnt--;
+    }
+  else
+    frame = pop_free_back ();
+  if (ft.free_cnt < low_water && pageout_started)
+    work_queue (&pageout_work);
+  if (frame->zeroed)
+    ft.zeroed_cnt--;
+  return frame;
+}
+
+/* Zeroes a free frame for a later frame_alloc (true), unless all of
+   them are zeroed already. Returns true if it zeroed one. Meant for
+   the idle thread: the frame is zeroed with interrupts off while
+   holding the frame table, which no other thread can then come to
+   wait for, and nothing waits if the frame table is busy. */
+bool
+frame_prezero (void)
+{
+  enum intr_level old_level;
+  bool zeroed = false;
+
+  old_level = intr_disable ();
+  if (ft.zeroed_cnt < ft.free_cnt && lock_try_acquire (&frame_table_lock))
+    {
+      struct frame *frame = pop_free_back ();
+
+      ASSERT (!frame->zeroed);
+      palloc_zero_page_ahead (frame->kaddr);
+      frame->zeroed = true;
+      push_free_front (frame);
+      ft.zeroed_cnt++;
+      lock_release (&frame_table_lock);
+      zeroed = true;
+    }
+  intr_set_level (old_level);
+  return zeroed;
+}
+
 /* Initializes the frame table FT by calling palloc_get_page on all
-   user pages and storing them as free frames for future use. */
+   user pages and storing them as free frames for future use, with a
+   descriptor for each page of the user pool at its number in it. */
 void
 frame_init (void)
 {
-  void *upage;
-  struct frame *frame;
+  uint8_t *upage;
+  size_t i;
 
   lock_init (&frame_table_lock);
+  work_init (&pageout_work, pageout, NULL, WORK_PRI_HIGH);
+  cond_init (&frames_changed);
+  cond_init (&pressure_changed);
+  poll_queue_init (&pressure_pollers);
+  for (i = 0; i <= MEMPRESSURE_CRITICAL; i++)
+    pressure_signaled[i] = -1;
   lock_acquire (&frame_table_lock);
-  list_init (&ft.free_frames);
-  list_init (&ft.allocated_frames);
-  clock_hand = list_head (&ft.allocated_frames);
+  ft.base = palloc_user_pool (&ft.frame_cnt);
+  ft.frames = vcalloc (ft.frame_cnt, sizeof *ft.frames);
+  ft.free_frames = vcalloc (ft.frame_cnt, sizeof *ft.free_frames);
+  if (ft.frame_cnt > 0 && (ft.frames == NULL || ft.free_frames == NULL))
+    PANIC ("OOM when allocating the frame table!");
+  ft.free_start = 0;
+  ft.free_cnt = 0;
+  ft.zeroed_cnt = 0;
+  ft.evicting_cnt = 0;
+  ft.over_limit_cnt = 0;
+  clock_hand = 0;
   /* Query palloc_get_page until user pool is exhausted. */
   while ((upage = palloc_get_page (PAL_USER)))
+    ft.frames[(upage - ft.base) / PGSIZE].kaddr = upage;
+  /* Free them in reverse, so they are handed out in address order. */
+  for (i = ft.frame_cnt; i-- > 0; )
+    if (ft.frames[i].kaddr != NULL)
+      push_free (&ft.frames[i]);
+  low_water = ft.free_cnt / FRAME_LOW_WATER_SHARE + 1;
+  high_water = 2 * low_water;
+  lock_release (&frame_table_lock);
+  kstat_register (&stat_reclaim);
+  kstat_register (&stat_sweep);
+  kstat_register (&stat_evict_swap);
+  kstat_register (&stat_evict_file);
+  kstat_register (&stat_evict_shared);
+  kstat_register (&stat_free);
+  share_init ();
+}
+
+/* Returns the number of free frames, for the frame.free statistic. */
+static uint64_t
+read_free_cnt (void)
+{
+  return ft.free_cnt;
+}
+
+/* Returns the number of frames in the frame table. */
+size_t
+frame_count (void)
+{
+  return ft.frame_cnt;
+}
+
+/* Tries to take the lock of a page in frame number NO, which is in
+   use and not pinned or being evicted: the page the frame is of, or
+   the first page mapping it if it is shared copy-on-write. Returns
+   the page, with its lock held and settled in the frame, or a null
+   pointer if there is none or its lock is taken. */
+struct page *
+frame_try_lock (size_t no)
+{
+  struct frame *frame;
+  struct page *page = NULL;
+
+  ASSERT (no < ft.frame_cnt);
+
+  lock_acquire (&frame_table_lock);
+  frame = &ft.frames[no];
+  if (frame->kaddr == NULL || frame->pinned || frame->evicting)
+    ;
+  else if (frame->share != NULL)
+    page = share_try_lock (frame);
+  else if (frame->page != NULL && lock_try_acquire (&frame->page->lock))
     {
-      frame = malloc (sizeof (struct frame));
-      ASSERT (frame != NULL); /* Otherwise fails to build frame table. */
-      frame->kaddr = upage;
-      frame->page = NULL;
-      frame->pinned = false;
-      list_push_back (&ft.free_frames, &frame->elem);
+      page = frame->page;
+      if (page->in_transit || page->location != FRAME
+          || page->frame != frame)
+        {
+          lock_release (&page->lock);
+          page = NULL;
+        }
     }
   lock_release (&frame_table_lock);
+  return page;
+}
+
+/* Starts paging out ahead of demand. Must be called after swap_init()
+   and workqueue_init(). */
+void
+frame_pageout_init (void)
+{
+  lock_acquire (&frame_table_lock);
+  pageout_started = true;
+  if (ft.free_cnt < low_water)
+    work_queue (&pageout_work);
+  lock_release (&frame_table_lock);
 }
 
-/* Helper function to let the clock hand loop to the front of the list */
-static struct list_elem *
+/* Page-out work, queued each time free frames run low. Evicts frames
+   ahead of demand until HIGH_WATER of them are free, so that page
+   faults seldom have to wait for a page to be written out. It gives up
+   the frame table between victims, so faults can take frames as they
+   become free. */
+static void
+pageout (void *aux UNUSED)
+{
+  lock_acquire (&frame_table_lock);
+  while (ft.free_cnt < high_water)
+    {
+      bool busy;
+      struct frame *frame = frame_reclaim (&busy);
+
+      if (frame == NULL)
+        break;
+      pressure_note (false);
+      push_free (frame);
+      lock_release (&frame_table_lock);
+      thread_yield ();
+      lock_acquire (&frame_table_lock);
+    }
+  lock_release (&frame_table_lock);
+}
+
+/* Moves the clock hand on to the next frame, wrapping around from the
+   last one to the first, and returns that frame. */
+static struct frame *
 clock_next (void)
 {
-  clock_hand = list_next (clock_hand);
-  if (clock_hand == list_end (&ft.allocated_frames))
-    clock_hand = list_begin (&ft.allocated_frames);
+  clock_hand = (clock_hand + 1) % ft.frame_cnt;
+  return &ft.frames[clock_hand];
+}
+
+/* Returns true if the page in FRAME, or any page sharing it, was
+   accessed, also clearing the accessed bits if CLEAR is true. A page a
+   sequential scan has left behind counts as unaccessed.
+   Assumes frame_table_lock is acquired. */
+static bool
+frame_accessed (struct frame *frame, bool clear)
+{
+  struct page *page = frame->page;
+  bool accessed;
+
+  if (frame->share != NULL)
+    return share_accessed (frame, clear);
+  if (page_is_behind_scan (page))
+    return false;
+  accessed = pagedir_is_accessed (page->thread->pagedir, page->uaddr);
+  if (accessed && clear)
+    pagedir_set_accessed (page->thread->pagedir, page->uaddr, false);
+  return accessed;
+}
+
+/* Returns true if evicting FRAME, which must be unpinned, costs no
+   write, because its page is backed by a file it has not changed, or
+   it has not changed since it came from the swap slot it still keeps.
+   Read-only pages, such as executable code, always are. */
+static bool
+frame_is_clean (struct frame *frame)
+{
+  struct page *page = frame->page;
 
-  return clock_hand;
+  if (frame->share != NULL)
+    return share_is_clean (frame);
+  if (page->evict_to == SWAP)
+    return (page->swap_slot != SWAP_ERROR
+            && !pagedir_is_dirty (page->thread->pagedir, page->uaddr));
+  return (page->evict_to == FILE
+          && (!page->writable
+              || !pagedir_is_dirty (page->thread->pagedir, page->uaddr)));
 }
 
-/* Helper for frame_alloc. Chooses which frame to evict and evicts it.
-   Assumes that frame_table_lock is acquired by the current thread.
-   Uses the clock algorithm. */
+/* Chooses which frame to evict with the enhanced clock algorithm and
+   evicts it, returning it no longer allocated. Returns a null pointer
+   if no frame could be evicted, setting *BUSY to whether that may change
+   once other threads are done with some frames. Assumes that
+   frame_table_lock is acquired by the current thread, and gives it up
+   while writing the victim out. */
 static struct frame *
-frame_pick_and_evict (void)
+frame_reclaim (bool *busy)
 {
-  struct frame *frame = NULL;
-  struct frame *clock_start;
+  struct frame *frame, *clock_start;
+  struct frame *victim = NULL;
+  bool shared = false;
+  size_t sweep_cnt = 0;
+  int pass;
 
   ASSERT (lock_held_by_current_thread (&frame_table_lock));
-  ASSERT (!list_empty (&ft.allocated_frames));
 
-  /* Look through all allocated frames for LRU */
-  /* Find first unpinned frame */
-  clock_start = list_entry (clock_next (), struct frame, elem);
-  frame = clock_start;
-  while (frame->pinned)
+  *busy = ft.evicting_cnt > 0;
+  if (ft.free_cnt == ft.frame_cnt)
+    return NULL;
+
+  /* Sweep the clock in up to four passes. Even passes look for an
+     unaccessed clean frame, which can be dropped, and change nothing.
+     Odd passes settle for an unaccessed frame that must be written
+     first, and clear the accessed bits they see. By the fourth pass
+     every unpinned frame is unaccessed, so only all frames being pinned
+     or busy makes it fail. If any process holds more frames than its
+     allowance, two passes over just its frames come first. */
+  for (pass = ft.over_limit_cnt > 0 ? -2 : 0; pass < 4 && victim == NULL;
+       pass++)
     {
-      frame = list_entry (clock_next (), struct frame, elem);
-      /* Panic if unable to evict any frames, i.e. OOM. */
-      if (frame == clock_start)
-        PANIC ("Attempting to evict a frame but all frames are pinned!");
+      clock_start = clock_next ();
+      frame = clock_start;
+      do
+        {
+          if (!frame->pinned && !frame->evicting
+              && (frame->page != NULL || frame->share != NULL)
+              && (pass >= 0
+                  || (frame->owner != NULL && over_limit (frame->owner)))
+              && !frame_accessed (frame, pass % 2 != 0)
+              && (pass % 2 != 0 || frame_is_clean (frame)))
+            {
+              /* Shared frames are claimed from all the pages mapping
+                 them at once. */
+              shared = frame->share != NULL;
+              if (shared ? share_evict (frame, busy)
+                         : frame_claim (frame, busy))
+                {
+                  victim = frame;
+                  break;
+                }
+            }
+          sweep_cnt++;
+          frame = clock_next ();
+        }
+      while (frame != clock_start);
     }
-  do {
-    /* Find LRU unpinned frame */
-    if (!frame->pinned)
-      {
-        if (pagedir_is_accessed (frame->page->thread->pagedir,
-                             frame->page->uaddr))
-          {
-            pagedir_set_accessed (frame->page->thread->pagedir,
-                                frame->page->uaddr, false);
-          }
-        else
-          break;
-        frame = list_entry (clock_next (), struct frame, elem);
-      }
-  } while (frame != clock_start);
-  if (!frame_evict (frame))
-    PANIC ("Attempting to evict a frame but all frames are pinned!");
+  kstat_inc (&stat_reclaim);
+  kstat_add (&stat_sweep, sweep_cnt);
+  if (victim == NULL)
+    return NULL;
+  TRACE (TRACE_EVICT, victim->kaddr, shared);
+  if (shared)
+    {
+      /* A copy-on-write frame still has to be written to swap. */
+      if (victim->share != NULL)
+        {
+          bool success;
 
-  return frame;
+          victim->evicting = true;
+          ft.evicting_cnt++;
+          lock_release (&frame_table_lock);
+          success = share_swap_out (victim);
+          lock_acquire (&frame_table_lock);
+          victim->evicting = false;
+          ft.evicting_cnt--;
+          cond_broadcast (&frames_changed, &frame_table_lock);
+          if (!success)
+            return NULL;
+        }
+      kstat_inc (&stat_evict_shared);
+      frame_detach (victim);
+    }
+  else if (!frame_evict_cluster (victim))
+    return NULL;
+  return victim;
+}
+
+/* Tries to take the lock of the page in FRAME, which frame_table_lock
+   keeps from being freed meanwhile. Only tries, since its owner may be
+   waiting on frame_table_lock while holding it, and sets *BUSY if it
+   is taken. Returns true if successful and the frame can be evicted,
+   which only holding the page lock makes certain.
+   Assumes frame_table_lock is acquired. */
+static bool
+frame_claim (struct frame *frame, bool *busy)
+{
+  struct page *page = frame->page;
+
+  if (!lock_try_acquire (&page->lock))
+    {
+      *busy = true;
+      return false;
+    }
+  if (frame->pinned || page->pinned || page->in_transit
+      || page->location != FRAME)
+    {
+      lock_release (&page->lock);
+      return false;
+    }
+  return true;
+}
+
+/* Evicts VICTIM, whose page lock frame_claim() took, and along with it
+   the frames following it in the clock that are unpinned, unaccessed
+   and bound for swap too from the same process, up to SWAP_CLUSTER in
+   all. The pages in them go to adjacent swap slots in a single write,
+   and the extra frames become free. The frames are marked as being evicted and frame_table_lock is
+   released during the write, so other threads can use the frame table
+   meanwhile. Returns false if the victim couldn't be written out.
+   Assumes frame_table_lock is acquired. */
+static bool
+frame_evict_cluster (struct frame *victim)
+{
+  struct page *pages[SWAP_CLUSTER];
+  struct frame *frames[SWAP_CLUSTER];
+  bool to_swap = victim->page->evict_to == SWAP;
+  size_t cnt, i, no;
+  bool success;
+
+  ASSERT (lock_held_by_current_thread (&frame_table_lock));
+  ASSERT (lock_held_by_current_thread (&victim->page->lock));
+
+  frames[0] = victim;
+  pages[0] = victim->page;
+  cnt = 1;
+  for (no = frame_no (victim) + 1;
+       to_swap && cnt < SWAP_CLUSTER && no < ft.frame_cnt; no++)
+    {
+      struct frame *f = &ft.frames[no];
+      struct page *p = f->page;
+      bool ignored;
+
+      if (f->pinned || f->evicting || p == NULL || p->evict_to != SWAP
+          || p->thread != victim->page->thread
+          || pagedir_is_accessed (p->thread->pagedir, p->uaddr)
+          || !frame_claim (f, &ignored))
+        break;
+      frames[cnt] = f;
+      pages[cnt++] = p;
+    }
+  for (i = 0; i < cnt; i++)
+    frames[i]->evicting = true;
+  ft.evicting_cnt += cnt;
+  lock_release (&frame_table_lock);
+
+  success = cnt > 1 && page_swap_out (pages, cnt);
+  if (!success)
+    {
+      /* Fall back to evicting the victim alone. */
+      for (i = 1; i < cnt; i++)
+        lock_release (&pages[i]->lock);
+      success = page_evict (pages[0]);
+      lock_acquire (&frame_table_lock);
+      for (i = 1; i < cnt; i++)
+        frames[i]->evicting = false;
+      ft.evicting_cnt -= cnt - 1;
+      cnt = 1;
+    }
+  else
+    lock_acquire (&frame_table_lock);
+
+  for (i = 0; i < cnt; i++)
+    {
+      frames[i]->evicting = false;
+      if (success)
+        frame_detach (frames[i]);
+      lock_release (&pages[i]->lock);
+    }
+  /* Free the extra frames last first, so they go out again in order. */
+  if (success)
+    for (i = cnt; i-- > 1; )
+      push_free (frames[i]);
+  ft.evicting_cnt -= cnt;
+  cond_broadcast (&frames_changed, &frame_table_lock);
+  if (success)
+    kstat_add (to_swap ? &stat_evict_swap : &stat_evict_file, cnt);
+  return success;
 }
 
 /* Allocates a free frame for THREAD's PAGE and updates THREAD's
    pagedir to reflect the new physical address. Useful when resolving
-   a pagefault. The returned frame is pinned by default. */
+   a pagefault. The returned frame is pinned by default. If ZERO, the
+   frame is filled with zeros, taking one zeroed while idle if there
+   is one. */
 struct frame *
-frame_alloc (void)
+frame_alloc (bool zero)
 {
-  struct frame *frame;
+  struct frame *frame = NULL;
 
   lock_acquire (&frame_table_lock);
-  if (!list_empty (&ft.free_frames))
-    frame = list_entry (list_pop_back (&ft.free_frames), struct frame, elem);
-  else
-    frame = frame_pick_and_evict ();
+  while (frame == NULL)
+    {
+      bool busy;
+
+      if (ft.free_cnt > 0)
+        frame = pop_free (zero);
+      else if ((frame = frame_reclaim (&busy)) != NULL)
+        {
+          pressure_note (true);
+          continue;
+        }
+      /* Panic if unable to evict any frames, i.e. OOM. */
+      else if (!busy)
+        PANIC ("Attempting to evict a frame but all frames are pinned!");
+      /* Wait for other threads to finish with the frames they hold. */
+      else if (ft.evicting_cnt > 0)
+        cond_wait (&frames_changed, &frame_table_lock);
+      else
+        {
+          lock_release (&frame_table_lock);
+          thread_yield ();
+          lock_acquire (&frame_table_lock);
+        }
+    }
   frame->pinned = true;
-  list_push_back (&ft.allocated_frames, &frame->elem);
+  charge (frame, thread_current ()->process);
+  lock_release (&frame_table_lock);
+  if (zero && !frame->zeroed)
+    palloc_zero_page (frame->kaddr);
+  frame->zeroed = false;
+  return frame;
+}
+
+/* Like frame_alloc, but returns a null pointer instead of evicting a
+   frame if none is free. */
+struct frame *
+frame_alloc_free (void)
+{
+  struct frame *frame = NULL;
+
+  lock_acquire (&frame_table_lock);
+  if (ft.free_cnt > 0)
+    {
+      frame = pop_free (false);
+      frame->zeroed = false;
+      frame->pinned = true;
+      charge (frame, thread_current ()->process);
+    }
   lock_release (&frame_table_lock);
   return frame;
 }
 
 /* Makes sure FRAME is never evicted after this call until
-   frame_unpin (FRAME) is called. */
+   frame_unpin (FRAME) is called. The caller must hold the lock of
+   FRAME's page, which evicting threads check PINNED under. Does
+   nothing to a shared frame, which the pinned bit of the caller's page
+   keeps in memory. */
 void
 frame_pin (struct frame *frame)
 {
-  lock_acquire (&frame_table_lock);
-  frame->pinned = true;
-  lock_release (&frame_table_lock);
+  ASSERT (frame->page == NULL
+          || lock_held_by_current_thread (&frame->page->lock));
+  if (frame->share == NULL)
+    frame->pinned = true;
 }
 
 /* Cancels the effect of frame_pin and makes FRAME a candidate
-   for eviction. */
+   for eviction. The caller must hold the lock of FRAME's page. */
 void
 frame_unpin (struct frame *frame)
+{
+  ASSERT (frame->page == NULL
+          || lock_held_by_current_thread (&frame->page->lock));
+  if (frame->share == NULL)
+    frame->pinned = false;
+}
+
+/* Makes FRAME a frame shared as S, or if S is null, a frame of PAGE
+   alone again, pinned if PAGE is. The caller must hold the lock of
+   every page mapping FRAME. */
+void
+frame_set_share (struct frame *frame, struct share *s, struct page *page)
 {
   lock_acquire (&frame_table_lock);
-  frame->pinned = false;
+  frame->share = s;
+  frame->page = page;
+  frame->pinned = page != NULL && page->pinned;
+  /* A shared frame is nobody's to pay for. */
+  charge (frame, s == NULL && page != NULL ? page->thread : NULL);
   lock_release (&frame_table_lock);
 }
 
-/* Evicts FRAME by calling page_evict on its page if it exists.
-   It also removes the frame from the list of allocated frames.
-   Returns false if FRAME is pinned or page_evict fails and
-   true otherwise. Assumes frame_table_lock is acquired. */
-bool
-frame_evict (struct frame *frame)
+/* Records a page fault of the current thread that needs a frame, and
+   adjusts the thread's allowance of frames by how long it has been
+   since its last one. */
+void
+frame_note_fault (void)
 {
-  ASSERT (lock_held_by_current_thread (&frame_table_lock));
+  struct thread *t = thread_current ()->process;
+  int64_t now = timer_ticks ();
 
-  /* Will not evict a pinned frame. */
-  if (frame->pinned)
-    return false;
-  /* Evict page if it exists. */
-  lock_acquire (&frame->page->lock);
-  bool bRet = page_evict (frame->page);
-  lock_release (&frame->page->lock);
-  if (frame->page != NULL && !bRet)
-    return false;
+  lock_acquire (&frame_table_lock);
+  if (t->pff_last_fault != 0 && now - t->pff_last_fault < PFF_INTERVAL)
+    set_limit (t, (t->resident_limit > t->resident_cnt
+                   ? t->resident_limit : t->resident_cnt) + PFF_STEP);
+  else
+    set_limit (t, t->resident_cnt * 3 / 4);
+  t->pff_last_fault = now;
+  lock_release (&frame_table_lock);
+}
+
+/* Returns true if T holds more frames than its allowance. A thread
+   without an allowance yet, that hasn't faulted, has no limit.
+   Assumes frame_table_lock is acquired. */
+static bool
+over_limit (struct thread *t)
+{
+  return t->resident_limit != 0 && t->resident_cnt > t->resident_limit;
+}
+
+/* Charges FRAME to thread OWNER instead of whichever thread it was
+   charged to, or to no thread if OWNER is null.
+   Assumes frame_table_lock is acquired. */
+static void
+charge (struct frame *frame, struct thread *owner)
+{
+  struct thread *t = frame->owner;
+
+  if (t != NULL)
+    {
+      bool over = over_limit (t);
+      t->resident_cnt--;
+      ft.over_limit_cnt -= over && !over_limit (t);
+    }
+  frame->owner = t = owner;
+  if (t != NULL)
+    {
+      bool over = over_limit (t);
+      t->resident_cnt++;
+      ft.over_limit_cnt += !over && over_limit (t);
+      if (t->procstat.peak_frames < t->resident_cnt)
+        t->procstat.peak_frames = t->resident_cnt;
+    }
+}
+
+/* Sets the allowance of frames of T to LIMIT, at least PFF_MIN.
+   Assumes frame_table_lock is acquired. */
+static void
+set_limit (struct thread *t, size_t limit)
+{
+  bool over = over_limit (t);
+
+  t->resident_limit = limit > PFF_MIN ? limit : PFF_MIN;
+  if (over != over_limit (t))
+    {
+      if (over)
+        ft.over_limit_cnt--;
+      else
+        ft.over_limit_cnt++;
+    }
+}
+
+/* Takes FRAME, just evicted, away from its page, which keeps the clock
+   from choosing it again. Assumes frame_table_lock is acquired. */
+static void
+frame_detach (struct frame *frame)
+{
+  charge (frame, NULL);
   frame->page = NULL;
-  /* Remove the frame from list of allocated frames. */
-  if (&frame->elem == clock_hand)
+}
+
+
+/* Moves the pressure windows on to the one holding the current time.
+   Assumes frame_table_lock is acquired. */
+static void
+pressure_roll (void)
+{
+  int64_t windows = (timer_ticks () - pressure_start) / PRESSURE_WINDOW;
+  int i;
+
+  if (windows == 0)
+    return;
+  for (i = 0; i < 2; i++)
     {
-      clock_hand = list_next (clock_hand);
-	    list_remove (&frame->elem);
-      if (clock_hand == list_end (&ft.allocated_frames))
-        clock_hand = list_begin (&ft.allocated_frames);
+      pressure_prev[i] = windows == 1 ? pressure_cur[i] : 0;
+      pressure_cur[i] = 0;
     }
+  pressure_start += windows * PRESSURE_WINDOW;
+}
+
+/* Returns the current MEMPRESSURE_* level. Assumes frame_table_lock is
+   acquired. */
+static int
+pressure_level (void)
+{
+  size_t background, demand;
+
+  pressure_roll ();
+  background = (pressure_cur[0] > pressure_prev[0]
+                ? pressure_cur[0] : pressure_prev[0]);
+  demand = (pressure_cur[1] > pressure_prev[1]
+            ? pressure_cur[1] : pressure_prev[1]);
+  if (demand > ft.frame_cnt / PRESSURE_CRITICAL_SHARE)
+    return MEMPRESSURE_CRITICAL;
+  else if (demand > 0)
+    return MEMPRESSURE_MEDIUM;
+  else if (background > 0 || ft.free_cnt < low_water)
+    return MEMPRESSURE_LOW;
   else
-    list_remove (&frame->elem);
-  return true;
+    return MEMPRESSURE_NONE;
+}
+
+/* Counts an eviction by a page fault if DEMAND, or else by the
+   page-out work, and wakes the watches of each level that this
+   reaches for the first time in the window. Assumes frame_table_lock
+   is acquired. */
+static void
+pressure_note (bool demand)
+{
+  bool woke = false;
+  int level, i;
+
+  pressure_roll ();
+  pressure_cur[demand]++;
+  level = pressure_level ();
+  for (i = MEMPRESSURE_LOW; i <= level; i++)
+    if (pressure_signaled[i] != pressure_start)
+      {
+        pressure_signaled[i] = pressure_start;
+        pressure_events[i]++;
+        woke = true;
+      }
+  if (woke)
+    {
+      cond_broadcast (&pressure_changed, &frame_table_lock);
+      poll_wake (&pressure_pollers);
+    }
+}
+
+/* Returns a new watch for memory pressure of LEVEL, one of the
+   MEMPRESSURE_* levels above MEMPRESSURE_NONE, or a null pointer if
+   LEVEL is not one or memory is not available. Only pressure reached
+   after this call counts. */
+struct pressure_watch *
+frame_pressure_watch (int level)
+{
+  struct pressure_watch *w;
+
+  if (level < MEMPRESSURE_LOW || level > MEMPRESSURE_CRITICAL)
+    return NULL;
+  w = malloc (sizeof *w);
+  if (w == NULL)
+    return NULL;
+  w->level = level;
+  lock_acquire (&frame_table_lock);
+  w->seen = pressure_events[level];
+  lock_release (&frame_table_lock);
+  return w;
+}
+
+/* Returns a copy of watch W, which has seen what W has, or a null
+   pointer if memory is not available. */
+struct pressure_watch *
+frame_pressure_reopen (const struct pressure_watch *w)
+{
+  struct pressure_watch *copy = malloc (sizeof *copy);
+
+  if (copy != NULL)
+    {
+      lock_acquire (&frame_table_lock);
+      *copy = *w;
+      lock_release (&frame_table_lock);
+    }
+  return copy;
 }
 
+/* Frees watch W. */
+void
+frame_pressure_close (struct pressure_watch *w)
+{
+  free (w);
+}
+
+/* Waits until memory pressure reaches the level of watch W, unless it
+   has since W was created or last waited on, and returns the current
+   level, or W's if it has already eased off. */
+int
+frame_pressure_wait (struct pressure_watch *w)
+{
+  int level;
+
+  lock_acquire (&frame_table_lock);
+  while (w->seen == pressure_events[w->level])
+    cond_wait (&pressure_changed, &frame_table_lock);
+  w->seen = pressure_events[w->level];
+  level = pressure_level ();
+  lock_release (&frame_table_lock);
+  return level > w->level ? level : w->level;
+}
+
+/* Returns true if frame_pressure_wait() on W would return right away,
+   first adding ENTRY for TABLE to the pollers of memory pressure if
+   TABLE is not null. */
+bool
+frame_pressure_poll (struct pressure_watch *w,
+                     struct poll_table *table, struct poll_entry *entry)
+{
+  bool ready;
+
+  lock_acquire (&frame_table_lock);
+  if (table != NULL)
+    poll_add (table, entry, &pressure_pollers);
+  ready = w->seen != pressure_events[w->level];
+  lock_release (&frame_table_lock);
+  return ready;
+}
@@ -2,30 +2,72 @@
 #define VM_FRAME_H
 #include <list.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include "vm/page.h"
 
+struct share;
+struct pressure_watch;
+struct poll_table;
+struct poll_entry;
+
 /* Keeps track of free and allocated frames in the system. */
 struct frame_table
   {
-    struct list free_frames;      /* Available for allocation. */
-    struct list allocated_frames; /* Candidates for eviction. */
+    struct frame *frames;         /* Descriptor of each page of the user
+                                     pool, indexed by its number. */
+    size_t frame_cnt;             /* Number of FRAMES. */
+    uint8_t *base;                /* Kernel address of the first one. */
+    uint32_t *free_frames;        /* Numbers of the frames available for
+                                     allocation, a ring of FRAME_CNT
+                                     entries. */
+    size_t free_start;            /* Position of the first of them. */
+    size_t free_cnt;              /* Number of FREE_FRAMES. */
+    size_t zeroed_cnt;            /* Zeroed FREE_FRAMES, kept at the
+                                     front of the ring. */
+    size_t evicting_cnt;          /* Frames being evicted. */
+    size_t over_limit_cnt;        /* Threads holding more frames than
+                                     their allowance. */
   };
 
-/* An entry in either lists of frame_table reflecting one frame. */
+/* The descriptor of one frame in the frame table. Every frame not
+   free is a candidate for eviction. */
 struct frame
   {
-    struct list_elem elem;        /* Elem in either frame_table lists. */
-    void *kaddr;                  /* Physical address = kernel address. */
-    struct page *page;            /* The page mapped to this frame. */
-    bool pinned;                  /* Don't evict when pinned. */
+    void *kaddr;                  /* Physical address = kernel address,
+                                     null if palloc didn't give it out. */
+    struct page *page;            /* The page mapped to this frame, null
+                                     if SHARE is set. */
+    struct share *share;          /* Shared read-only frame, or null. */
+    struct thread *owner;         /* Thread charged for the frame, null
+                                     while it is shared. */
+    bool pinned;                  /* Don't evict when pinned, guarded
+                                     by the lock of PAGE. Shared frames
+                                     go by the pinned bits of their
+                                     pages instead. */
+    bool evicting;                /* Claimed by an evicting thread. */
+    bool zeroed;                  /* Free and known to hold zeros. */
   };
 
 void frame_init (void);
-struct frame *frame_alloc (void);
+struct frame *frame_lookup (void *kaddr);
+size_t frame_count (void);
+struct page *frame_try_lock (size_t no);
+void frame_pageout_init (void);
+struct frame *frame_alloc (bool zero);
+struct frame *frame_alloc_free (void);
 void frame_pin (struct frame *frame);
 void frame_unpin (struct frame *frame);
 void frame_free (struct frame *frame);
-bool frame_evict (struct frame *frame);
+void frame_set_share (struct frame *frame, struct share *s,
+                      struct page *page);
+void frame_note_fault (void);
+bool frame_prezero (void);
+struct pressure_watch *frame_pressure_watch (int level);
+struct pressure_watch *frame_pressure_reopen (const struct pressure_watch *);
+void frame_pressure_close (struct pressure_watch *);
+int frame_pressure_wait (struct pressure_watch *);
+bool frame_pressure_poll (struct pressure_watch *, struct poll_table *,
+                          struct poll_entry *);
 
 
 #endif /* vm/frame.h */
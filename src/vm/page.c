@@ -1,38 +1,146 @@
 #include "vm/page.h"
 #include <stdio.h>
 #include <string.h>
+#include "threads/kstat.h"
+#include "threads/palloc.h"
+#include "threads/pte.h"
 #include "threads/vaddr.h"
 #include "threads/malloc.h"
+#include "threads/slab.h"
 #include "threads/synch.h"
+#include "threads/trace.h"
 #include "userprog/pagedir.h"
+#include "userprog/process.h"
+#include "userprog/procstat.h"
 #include "filesys/filesys.h"
+#include "vm/share.h"
 
 extern struct lock syscall_file_lock;
+
+/* Most pages a fault on a mapped file reads in, counting its own, when
+   the mmap is being scanned sequentially. */
+#define FILE_CLUSTER 8
+
+/* Number of page tables covering user memory, one per 4 MB. */
+#define PAGE_TABLE_CNT (LOADER_PHYS_BASE >> PDSHIFT)
+
+/* A thread's supplemental page table, laid out like the page directory
+   mapping the same addresses: a directory of page tables, each holding
+   the pages of 4 MB of user memory, which is allocated the first time
+   one of those pages is. */
+struct page_table
+  {
+    struct page **tables[PAGE_TABLE_CNT];   /* Indexed by pd_no(). */
+  };
+
+/* Pages the stack grows by per fault, set by -stack-step. */
+size_t stack_growth_pages = 1;
+
+/* Pages loaded up front at the start of each mmap, set by
+   -mmap-populate. */
+size_t mmap_populate_pages = 0;
+
+/* A page of zeros that every untouched page of anonymous memory maps
+   read-only, only getting a frame of its own once first written. */
+static void *zero_page;
+
+/* Supplemental page table entries, constructed with their locks
+   initialized, which are released whenever one is freed. */
+static struct slab_cache page_cache;
+
+/* Page faults resolved, by what they took. */
+static struct kstat_counter stat_fault_new = KSTAT_COUNTER ("fault.new");
+static struct kstat_counter stat_fault_zero = KSTAT_COUNTER ("fault.zero");
+static struct kstat_counter stat_fault_swap = KSTAT_COUNTER ("fault.swap");
+static struct kstat_counter stat_fault_file = KSTAT_COUNTER ("fault.file");
+static struct kstat_counter stat_fault_shm = KSTAT_COUNTER ("fault.shm");
+static struct kstat_counter stat_fault_cow = KSTAT_COUNTER ("fault.cow");
+static struct kstat_counter stat_swap_clean
+  = KSTAT_COUNTER ("swap.out.clean");
+static struct kstat_counter stat_fault_stack
+  = KSTAT_COUNTER ("fault.stack");
+static slab_obj_func page_ctor;
+
+static void count_fault (struct kstat_counter *, int kind);
 static bool page_in (struct page *page);
-static bool page_file_in (struct page *page);
+static bool page_is_zero_fill (struct page *page);
+static bool page_map_zero (struct page *page);
+static bool page_swap_in (struct page *page);
+static bool page_try_lock (struct page *page);
+static void page_begin_transit (struct page *page);
+static void page_end_transit (struct page *page);
+static void page_remap (struct page *p);
+static void page_file_around (struct page *page);
 static void page_page_pin (struct page *page);
 static void page_page_unpin (struct page *page);
 static void page_page_free (struct page *p);
-static hash_less_func page_less;
-static hash_hash_func page_hash;
-static hash_action_func hash_page_free;
+static bool page_fork (struct page *p, struct page *c);
+static struct page_mmap *page_mmap_copy (struct page_mmap *mmap);
+static void page_mmap_discard (struct page_mmap *mmap);
+static void page_mmap_close (struct page_mmap *mmap);
+static struct page **page_table_entry (struct thread *t, const void *uaddr,
+                                       bool create);
+static struct page *page_table_next (struct thread *t, uintptr_t *uaddr,
+                                     uintptr_t end);
+static struct page *page_new (struct thread *t, void *upage);
+static struct page *page_lookup_create (void *uaddr);
+static struct page_region *page_region_at (struct thread *t,
+                                           const void *uaddr);
+static void page_region_free (struct thread *t, struct page_region *r);
+static bool page_load (void *uaddr);
+static void page_mmap_prefault (struct page_mmap *mmap, size_t cnt);
+
+/* Initializes the lock of the page at PAGE_. */
+static void
+page_ctor (void *page_)
+{
+  struct page *p = page_;
+
+  lock_init (&p->lock);
+  cond_init (&p->transit_done);
+  p->in_transit = false;
+}
+
+/* Allocates the shared zero page and the cache of pages. */
+void
+page_init (void)
+{
+  slab_cache_init (&page_cache, "page", sizeof (struct page), page_ctor,
+                   NULL);
+  zero_page = palloc_get_page (PAL_ZERO);
+  if (zero_page == NULL)
+    PANIC ("Couldn't allocate the zero page!");
+  kstat_register (&stat_fault_new);
+  kstat_register (&stat_fault_zero);
+  kstat_register (&stat_fault_swap);
+  kstat_register (&stat_fault_file);
+  kstat_register (&stat_fault_shm);
+  kstat_register (&stat_fault_cow);
+  kstat_register (&stat_fault_stack);
+  kstat_register (&stat_swap_clean);
+}
 
 /* Initializes the page_table for the current thread.
    Called in process.c/load before any memory allocation. */
 bool
 page_table_init (void)
 {
-  struct thread *t = thread_current ();
-  bool success;
+  struct thread *t = thread_current ()->process;
+
+  ASSERT (sizeof *t->page_table <= PGSIZE);
 
   t->page_table_lock = malloc (sizeof (struct lock));
   if (t->page_table_lock == NULL)
     return false;
   lock_init (t->page_table_lock);
-  lock_acquire (t->page_table_lock);
-  success = hash_init (&t->page_table, page_hash, page_less, NULL);
-  lock_release (t->page_table_lock);
-  return success;
+  t->page_table = palloc_get_page (PAL_ZERO);
+  if (t->page_table == NULL)
+    {
+      free (t->page_table_lock);
+      t->page_table_lock = NULL;
+      return false;
+    }
+  return true;
 }
 
 /* Destroys the page_table for the current thread and frees all pages.
@@ -40,59 +148,219 @@ page_table_init (void)
 void
 page_table_destroy (void)
 {
-  struct thread *t = thread_current ();
+  struct thread *t = thread_current ()->process;
+  uintptr_t uaddr = 0;
+  struct page *p;
+  size_t i;
 
+  if (t->page_table == NULL)  /* page_table_init() failed. */
+    return;
   lock_acquire (t->page_table_lock);
-  /* Destroy the page table hash table to free its memory.
-     hash_page_free will call page_page_free on each entry. */
-  hash_destroy (&t->page_table, hash_page_free);
+  /* Free every page, then the tables that held them. */
+  pagedir_batch_begin ();
+  while ((p = page_table_next (t, &uaddr, (uintptr_t) PHYS_BASE)) != NULL)
+    page_page_free (p);
+  pagedir_batch_end ();
+  /* The regions of a failed fork's mmaps are left behind. */
+  while (!list_empty (&t->regions))
+    free (list_entry (list_pop_front (&t->regions), struct page_region,
+                      list_elem));
+  for (i = 0; i < PAGE_TABLE_CNT; i++)
+    palloc_free_page (t->page_table->tables[i]);
+  palloc_free_page (t->page_table);
+  t->page_table = NULL;
   /* Release and destroy the page table lock. */
   lock_release (t->page_table_lock);
   free (t->page_table_lock);
 }
 
+/* Fills the page_table of the current thread, just forked from PARENT,
+   with a copy of PARENT's memory, mmaps and their regions. Pages in
+   frames are shared copy-on-write instead of being copied, so each
+   process only gets its own copy of a page when either of them writes
+   it, and swapped out pages share their swap slots. Returns true if successful.
+   Assumes PARENT is waiting for the fork to finish. */
+bool
+page_table_fork (struct thread *parent)
+{
+  struct thread *t = thread_current ()->process;
+  uintptr_t uaddr = 0;
+  struct page *p;
+  struct list_elem *e;
+  bool success = true;
+
+  /* Copy the mmaps first, for the pages to find theirs. */
+  for (e = list_begin (&parent->mmap_list);
+       success && e != list_end (&parent->mmap_list); e = list_next (e))
+    {
+      struct page_mmap *mmap = page_mmap_copy (list_entry (e, struct page_mmap,
+                                                           list_elem));
+      if (mmap != NULL)
+        list_push_back (&t->mmap_list, &mmap->list_elem);
+      else
+        success = false;
+    }
+  t->mmap_next_id = parent->mmap_next_id;
+  t->heap_start = parent->heap_start;
+  t->heap_break = parent->heap_break;
+
+  lock_acquire (parent->page_table_lock);
+  lock_acquire (t->page_table_lock);
+  for (e = list_begin (&parent->regions);
+       success && e != list_end (&parent->regions); e = list_next (e))
+    {
+      struct page_region *r = list_entry (e, struct page_region, list_elem);
+      struct page_region *c = malloc (sizeof *c);
+
+      if (c == NULL)
+        {
+          success = false;
+          break;
+        }
+      *c = *r;
+      c->mmap = page_get_mmap (t, r->mmap->id);
+      list_push_back (&t->regions, &c->list_elem);
+    }
+  while (success
+         && (p = page_table_next (parent, &uaddr, (uintptr_t) PHYS_BASE))
+            != NULL)
+    {
+      struct page **entry = page_table_entry (t, p->uaddr, true);
+      struct page *c = entry != NULL ? slab_alloc (&page_cache) : NULL;
+
+      if (c == NULL)
+        {
+          success = false;
+          break;
+        }
+      c->thread = t;
+      c->uaddr = p->uaddr;
+      c->frame = NULL;
+      c->pinned = false;
+      page_lock (p);
+      c->location = p->location;
+      c->writable = p->writable;
+      /* A slot P only keeps as a copy is none of C's. */
+      c->swap_slot = p->location == SWAP ? p->swap_slot : SWAP_ERROR;
+      c->evict_to = p->evict_to;
+      c->file_zero_bytes = p->file_zero_bytes;
+      c->start_byte = p->start_byte;
+      c->mmap = p->mmap != NULL ? page_get_mmap (t, p->mmap->id) : NULL;
+      success = page_fork (p, c);
+      lock_release (&p->lock);
+      if (success)
+        *entry = c;
+      else
+        slab_free (&page_cache, c);
+    }
+  lock_release (t->page_table_lock);
+  lock_release (parent->page_table_lock);
+
+  /* The pages of a failed fork go with the rest of the page table, but
+     the mmaps must not take them along. */
+  if (!success)
+    while (!list_empty (&t->mmap_list))
+      page_mmap_discard (list_entry (list_pop_front (&t->mmap_list),
+                                     struct page_mmap, list_elem));
+  return success;
+}
+
+/* Sets up C, the copy for a forked process of P, to hold the same data.
+   Returns true if successful. Assumes P->lock is acquired. */
+static bool
+page_fork (struct page *p, struct page *c)
+{
+  switch (p->location)
+    {
+      case SWAP:
+        swap_share (p->swap_slot, 1);
+        break;
+      case ZERO:
+        return page_map_zero (c);
+      case FRAME:
+        if (p->evict_to == SHM)
+          /* The child finds the page in the segment. */
+          c->location = SHM;
+        else if (p->evict_to == FILE && p->frame->share == NULL)
+          {
+            /* A mapped file. Make sure the child reads back what P wrote
+               to it. */
+            if (p->writable && pagedir_is_dirty (p->thread->pagedir,
+                                                 p->uaddr))
+              {
+                off_t bytes = PGSIZE - p->file_zero_bytes;
+
+                if (filesys_write_changed_at (p->mmap->file, p->frame->kaddr,
+                                              bytes, p->start_byte) != bytes)
+                  return false;
+                pagedir_set_dirty (p->thread->pagedir, p->uaddr, false);
+              }
+            c->location = FILE;
+          }
+        else
+          {
+            /* A shared frame gets a slot of its own if it goes to swap. */
+            page_drop_swap_copy (p);
+            if (!share_fork (p, c))
+              return false;
+          }
+        break;
+      default:
+        break;
+    }
+  return true;
+}
+
 /* Allocates a page with user address UADDR in the current thread's
    page_table. Invalidates the PTE for that page such that a future
    pagefault would load the page lazily. Returns NULL if the page is
-   already mapped or UADDR on success. Thread-safe. */
+   already mapped, by a page or a region, or UADDR on success.
+   Thread-safe. */
 void *
 page_alloc (void *uaddr)
 {
-  struct thread *t = thread_current ();
-  void *paddr = pg_round_down (uaddr);
-  struct page *p;
+  struct thread *t = thread_current ()->process;
+  void *upage = pg_round_down (uaddr);
+  struct page *p = NULL;
 
   ASSERT (is_user_vaddr (uaddr));
 
   lock_acquire (t->page_table_lock);
-  /* Verify that there's not already a page at that virtual
-     address, then create a new page. */
-  p = page_lookup (paddr);
-  if (p != NULL)  /* A page already exists with this address. */
-    {
-      uaddr = NULL;
-      goto done;
-    }
-  p = malloc (sizeof (struct page));
-  if (p == NULL)  /* Failed to allocate a page entry. */
-    {
-      uaddr = NULL;
-      goto done;
-    }
-  lock_init (&p->lock);
-  p->uaddr = paddr;
+  if (page_region_at (t, upage) == NULL)
+    p = page_new (t, upage);
+  lock_release (t->page_table_lock);
+  return p != NULL ? uaddr : NULL;
+}
+
+/* Creates a page of new memory at user address UPAGE in T's page_table
+   and returns it, or returns NULL if there is a page there already or
+   memory is short. Assumes T's page table lock is acquired. */
+static struct page *
+page_new (struct thread *t, void *upage)
+{
+  struct page **entry;
+  struct page *p;
+
+  ASSERT (lock_held_by_current_thread (t->page_table_lock));
+
+  entry = page_table_entry (t, upage, true);
+  if (entry == NULL || *entry != NULL)
+    return NULL;
+  p = slab_alloc (&page_cache);
+  if (p == NULL)
+    return NULL;
+  p->uaddr = upage;
   p->thread = t;
   p->location = NEW;
   p->evict_to = SWAP;
+  p->swap_slot = SWAP_ERROR;
   p->frame = NULL;
   p->writable = true;
   p->pinned = false;
   p->mmap = NULL;
-  pagedir_clear_page (t->pagedir, paddr);
-  hash_insert (&t->page_table, &p->hash_elem);
-done:
-  lock_release (t->page_table_lock);
-  return uaddr;
+  pagedir_clear_page (t->pagedir, upage);
+  *entry = p;
+  return p;
 }
 
 /* Sets the writable bit to WRITABLE for page at UADDR
@@ -100,7 +368,7 @@ done:
 void
 page_set_writable (void *uaddr, bool writable)
 {
-  struct thread *t = thread_current ();
+  struct thread *t = thread_current ()->process;
   void *upage = pg_round_down (uaddr);
   struct page *p;
 
@@ -110,10 +378,17 @@ page_set_writable (void *uaddr, bool writable)
   p = page_lookup (uaddr);
   if (p != NULL)
     {
-      lock_acquire (&p->lock);
+      page_lock (p);
+      /* A page in a shared frame of a file must get a frame of its own,
+         while a copy-on-write one gets it on its first write. One of a
+         shared memory segment is writable where it is. */
+      if (writable && p->location == FRAME && p->frame->share != NULL
+          && !share_is_cow (p->frame) && !share_is_shm (p->frame))
+        share_page_release (p);
       p->writable = writable;
       /* Update the pagedir if the page is present. */
-      if (p->location == FRAME)
+      if (p->location == FRAME
+          && (p->frame->share == NULL || share_is_shm (p->frame)))
         pagedir_set_writable (t->pagedir, upage, writable);
       lock_release (&p->lock);
     }
@@ -126,7 +401,7 @@ page_is_writable (struct page *page)
 {
   bool writable;
 
-  lock_acquire (&page->lock);
+  page_lock (page);
   writable = page->writable;
   lock_release (&page->lock);
   return writable;
@@ -137,9 +412,9 @@ page_is_writable (struct page *page)
 static void
 page_page_free (struct page *p)
 {
-  struct thread *t = thread_current ();
+  struct thread *t = thread_current ()->process;
 
-  lock_acquire (&p->lock);
+  page_lock (p);
   if (p != NULL)
     {
       /* Free up the resources for this page's data. */
@@ -150,21 +425,29 @@ page_page_free (struct page *p)
             swap_free (p->swap_slot);
             break;
           case FRAME:
+            /* Leave a shared frame to the other pages using it. */
+            if (p->frame->share != NULL)
+              {
+                share_page_release (p);
+                break;
+              }
             /* Evict the page data to the appropriate location (e.g. FILE). */
             if (p->evict_to != SWAP)
               page_evict (p);
+            else
+              page_drop_swap_copy (p);
             frame_free (p->frame);
             break;
           default:
             break;
         }
     }
-  /* Remove page from the page table hash table. */
-  hash_delete (&t->page_table, &p->hash_elem);
+  /* Remove page from the page table. */
+  *page_table_entry (t, p->uaddr, false) = NULL;
   pagedir_clear_page (t->pagedir, p->uaddr);
   lock_release (&p->lock);
   /* Free up the memory for this page table entry. */
-  free (p);
+  slab_free (&page_cache, p);
 }
 
 /* Removes the page at UADDR from the current thread's page_table and
@@ -172,7 +455,7 @@ page_page_free (struct page *p)
 void
 page_free (void *uaddr)
 {
-  struct thread *t = thread_current ();
+  struct thread *t = thread_current ()->process;
   struct page *p;
 
   lock_acquire (t->page_table_lock);
@@ -183,34 +466,164 @@ page_free (void *uaddr)
   lock_release (t->page_table_lock);
 }
 
-/* Alias for page_page_pin (page_lookup (UADDR)). Thread-safe. */
+/* Alias for page_pin_range (UADDR, 1, false). Thread-safe. */
 void
 page_pin (void *uaddr)
 {
-  struct page *page = page_lookup (uaddr);
-
-  if (page == NULL)
+  if (!page_pin_range (uaddr, 1, false))
     PANIC ("Pinning invalid page!");
-
-  lock_acquire (&page->lock);
-  page_page_pin (page);
-  lock_release (&page->lock);
 }
 
-/* Alias for page_page_unpin (page_lookup (UADDR)). Thread-safe. */
+/* Alias for page_unpin_range (UADDR, 1). Thread-safe. */
 void
 page_unpin (void *uaddr)
 {
-  struct page *page = page_lookup (uaddr);
+  page_unpin_range (uaddr, 1);
+}
 
-  if (page == NULL)
-    PANIC ("Unpinning invalid page!");
+/* Pins every page of the SIZE bytes at UADDR, as page_page_pin()
+   does, so that the kernel may access them directly, and write them
+   if WRITE. Looks the pages up under the page table lock, taken once
+   for the range, and faults in those not resident, which brings in
+   their neighbours with them. Returns true if successful, or false
+   with nothing pinned if some page is missing or corrupted, or
+   read-only and WRITE is true. Thread-safe. */
+bool
+page_pin_range (const void *uaddr, size_t size, bool write)
+{
+  struct lock *page_table_lock = thread_current ()->process->page_table_lock;
+  uint8_t *start = pg_round_down (uaddr);
+  uint8_t *end = (uint8_t *) uaddr + size;
+  uint8_t *upage;
 
+  if (size == 0)
+    return true;
+  if (end < start || !is_user_vaddr (end - 1))
+    return false;
+
+  lock_acquire (page_table_lock);
+  for (upage = start; upage < end; upage += PGSIZE)
+    {
+      struct page *page = page_lookup_create (upage);
+
+      if (page == NULL)
+        break;
+      page_lock (page);
+      if (page->location == CORRUPTED || (write && !page->writable))
+        {
+          lock_release (&page->lock);
+          break;
+        }
+      page_page_pin (page);
+      lock_release (&page->lock);
+    }
+  lock_release (page_table_lock);
+
+  if (upage < end)
+    {
+      /* Undo the pins of the pages before the one that failed. */
+      page_unpin_range (start, upage - start);
+      return false;
+    }
+  return true;
+}
+
+/* Unpins every page of the SIZE bytes at UADDR, which a successful
+   page_pin_range() pinned. Thread-safe. */
+void
+page_unpin_range (const void *uaddr, size_t size)
+{
+  struct lock *page_table_lock = thread_current ()->process->page_table_lock;
+  uint8_t *end = (uint8_t *) uaddr + size;
+  uint8_t *upage;
+
+  if (size == 0)
+    return;
+
+  lock_acquire (page_table_lock);
+  for (upage = pg_round_down (uaddr); upage < end; upage += PGSIZE)
+    {
+      struct page *page = page_lookup (upage);
+
+      ASSERT (page != NULL);
+      page_lock (page);
+      page_page_unpin (page);
+      lock_release (&page->lock);
+    }
+  lock_release (page_table_lock);
+}
+
+/* Returns the kernel address of the byte at UADDR, in a page that
+   page_pin_range() pinned, which stays valid until it is unpinned, for
+   another thread to access it through. Thread-safe. */
+void *
+page_pinned_kaddr (const void *uaddr)
+{
+  struct lock *page_table_lock = thread_current ()->process->page_table_lock;
+  struct page *page;
+  void *kaddr;
+
+  lock_acquire (page_table_lock);
+  page = page_lookup (pg_round_down (uaddr));
+  ASSERT (page != NULL);
+  page_lock (page);
+  ASSERT (page->pinned && page->location == FRAME);
+  kaddr = (uint8_t *) page->frame->kaddr + pg_ofs (uaddr);
+  lock_release (&page->lock);
+  lock_release (page_table_lock);
+  return kaddr;
+}
+
+/* Acquires the lock of PAGE once no I/O on it is in transit, so the
+   page is in a settled state. */
+void
+page_lock (struct page *page)
+{
   lock_acquire (&page->lock);
-  page_page_unpin (page);
+  while (page->in_transit)
+    cond_wait (&page->transit_done, &page->lock);
+}
+
+/* Tries to acquire the lock of PAGE without waiting, for it or for
+   I/O in transit. Returns true if successful. */
+static bool
+page_try_lock (struct page *page)
+{
+  if (!lock_try_acquire (&page->lock))
+    return false;
+  if (page->in_transit)
+    {
+      lock_release (&page->lock);
+      return false;
+    }
+  return true;
+}
+
+/* Marks PAGE, whose lock the current thread holds, as in transit and
+   releases its lock for the I/O that follows, which page_end_transit()
+   ends. Meanwhile page_lock() waits for the I/O, and nothing else may
+   touch the page. */
+static void
+page_begin_transit (struct page *page)
+{
+  ASSERT (lock_held_by_current_thread (&page->lock));
+  ASSERT (!page->in_transit);
+
+  page->in_transit = true;
   lock_release (&page->lock);
 }
 
+/* Ends the transit of PAGE that page_begin_transit() began, taking its
+   lock back and waking up the threads waiting for the I/O. */
+static void
+page_end_transit (struct page *page)
+{
+  lock_acquire (&page->lock);
+  ASSERT (page->in_transit);
+  page->in_transit = false;
+  cond_broadcast (&page->transit_done, &page->lock);
+}
+
 /* PAGE will never pagefault after this function call until
    page_page_unpin (PAGE) is called.
    Assumes PAGE->lock is acquired. */
@@ -223,6 +636,10 @@ page_page_pin (struct page *page)
   /* Make sure the page has a frame. */
   if (page->location != FRAME && !page_in (page))
     PANIC ("Failed to Page-in page before pinning it!");
+  /* The kernel may write it, so it can't stay copy-on-write. */
+  if (page->writable && share_is_cow (page->frame)
+      && !share_copy_on_write (page))
+    PANIC ("Failed to copy page before pinning it!");
   /* Pin the frame if not already pinned. */
   frame_pin (page->frame);
 }
@@ -248,19 +665,30 @@ page_page_unpin (struct page *page)
 static bool
 page_in (struct page *page)
 {
-  struct thread *t = thread_current ();
+  struct thread *t = thread_current ()->process;
   struct frame *frame;
+  bool success;
 
   ASSERT (lock_held_by_current_thread (&page->lock));
 
   /* Return true if already paged in. */
   if (page->location == FRAME)
     return true;
-  /* Allocate a pinned frame to resolve the pagefault into. */
-  frame = frame_alloc ();
+  /* Read-only file pages go in frames shared by all who load them. */
+  if (share_can_share (page))
+    return share_page_in (page);
+  /* So do pages of a shared memory segment. */
+  if (page->location == SHM)
+    return share_shm_page_in (page);
+  /* Allocate a pinned frame to resolve the pagefault into, zeroed if
+     it is for anonymous memory. */
+  frame = frame_alloc (page->location == NEW || page->location == ZERO);
   page->pinned = true;
   frame->page = page;
   page->frame = frame;
+  /* Stop mapping the zero page, if it did. */
+  if (page->location == ZERO)
+    pagedir_clear_page (t->pagedir, page->uaddr);
   /* Set the page to be writable until the data is fully loaded. */
   if (!pagedir_set_page (t->pagedir, page->uaddr, frame->kaddr,
                          true))
@@ -273,17 +701,21 @@ page_in (struct page *page)
   switch (page->location)
     {
       case NEW:
-        /* NEW pages are populated with 0xcc just for debugging. */
-        memset (frame->kaddr, 0xcc, PGSIZE);
+      case ZERO:
+        /* Anonymous memory starts out zeroed, as the frame is. */
         break;
       case SWAP:
         /* Swap-in the page data. */
-        if (!swap_in (frame, page->swap_slot))
+        if (!page_swap_in (page))
           goto fail;
         break;
       case FILE:
-        if (!page_file_in (page))
+        page_begin_transit (page);
+        success = page_file_in (page);
+        page_end_transit (page);
+        if (!success)
           goto fail;
+        page_file_around (page);
         break;
       default:
         PANIC ("Failed to page-in at address %p!", page->uaddr);
@@ -300,21 +732,100 @@ fail:
   return false;
 }
 
-/* Reads data into mmapped PAGE from file backing it */
+/* Swaps PAGE, which has a frame to go to, back in. The pages right after
+   it in the current thread's address space that were swapped out to the
+   slots right after its come along in the same read, as far as there
+   are free frames for them, up to SWAP_CLUSTER pages in all. They start
+   out unaccessed, so the clock reclaims them first if they go unused.
+   Assumes PAGE->lock is acquired. */
 static bool
+page_swap_in (struct page *page)
+{
+  struct thread *t = thread_current ()->process;
+  struct page *pages[SWAP_CLUSTER];
+  struct frame *frames[SWAP_CLUSTER];
+  size_t cnt, i;
+  bool success;
+
+  ASSERT (lock_held_by_current_thread (&page->lock));
+
+  pages[0] = page;
+  frames[0] = page->frame;
+  for (cnt = 1; cnt < SWAP_CLUSTER; cnt++)
+    {
+      struct page *p = page_lookup (page->uaddr + cnt * PGSIZE);
+      struct frame *f;
+
+      if (p == NULL || !page_try_lock (p))
+        break;
+      if (p->location != SWAP || p->swap_slot != page->swap_slot + cnt)
+        {
+          lock_release (&p->lock);
+          break;
+        }
+      f = frame_alloc_free ();
+      if (f == NULL)
+        {
+          lock_release (&p->lock);
+          break;
+        }
+      if (!pagedir_set_page (t->pagedir, p->uaddr, f->kaddr, p->writable))
+        {
+          frame_free (f);
+          lock_release (&p->lock);
+          break;
+        }
+      f->page = p;
+      p->frame = f;
+      pages[cnt] = p;
+      frames[cnt] = f;
+    }
+
+  for (i = 0; i < cnt; i++)
+    page_begin_transit (pages[i]);
+  success = swap_in_multiple (frames, page->swap_slot, cnt, true);
+  for (i = 0; i < cnt; i++)
+    page_end_transit (pages[i]);
+  if (success)
+    {
+      for (i = 0; i < cnt; i++)
+        if (!swap_on_device (pages[i]->swap_slot))
+          pages[i]->swap_slot = SWAP_ERROR;
+      procstat_add (&t->procstat.swap_ins, cnt);
+    }
+  for (i = 1; i < cnt; i++)
+    {
+      struct page *p = pages[i];
+
+      if (success)
+        {
+          p->location = FRAME;
+          frame_unpin (frames[i]);
+        }
+      else
+        {
+          pagedir_clear_page (t->pagedir, p->uaddr);
+          frame_free (frames[i]);
+        }
+      lock_release (&p->lock);
+    }
+  return success;
+}
+
+/* Reads data into mmapped PAGE from file backing it */
+bool
 page_file_in (struct page *page)
 {
   struct page_mmap *mmap = page->mmap;
   if (mmap == NULL)
     return false;
-  /* Read data from mmap file. */
-  off_t old_cur = filesys_tell (mmap->file);
-  filesys_seek (mmap->file, page->start_byte);
+  /* Read data from mmap file. The frame caches it from now on, so it
+     stays out of the buffer cache. */
   off_t bytes_to_read = PGSIZE - page->file_zero_bytes;
   off_t bytes_read = 0;
   if (bytes_to_read)
-    bytes_read = filesys_read (mmap->file, page->frame->kaddr, bytes_to_read);
-  filesys_seek (mmap->file, old_cur);
+    bytes_read = filesys_read_uncached_at (mmap->file, page->frame->kaddr,
+                                           bytes_to_read, page->start_byte);
 
   if (bytes_read != bytes_to_read)
     return false;
@@ -325,37 +836,423 @@ page_file_in (struct page *page)
   return true;
 }
 
+/* Reads the pages of the mmap of PAGE, just read in, that follow it in,
+   up to FILE_CLUSTER pages in all, if PAGE is where a sequential scan
+   of the mmap would fault next, or always or never if the mapping was
+   advised to be used sequentially or randomly. As in page_swap_in, only free frames
+   are used and the pages start out unaccessed. Pages that would share
+   a frame or map the zero page are left to fault in.
+   Assumes PAGE->lock and the page table lock are acquired. */
+static void
+page_file_around (struct page *page)
+{
+  struct thread *t = thread_current ()->process;
+  struct page_mmap *mmap = page->mmap;
+  size_t cnt = 1;
+
+  ASSERT (lock_held_by_current_thread (&page->lock));
+
+  if (mmap->advice == MADV_SEQUENTIAL
+      || (mmap->advice == MADV_NORMAL && page->start_byte == mmap->next_fault))
+    for (; cnt < FILE_CLUSTER; cnt++)
+      {
+        struct page *p = page_lookup_create (page->uaddr + cnt * PGSIZE);
+        struct frame *f;
+        bool loaded;
+
+        if (p == NULL || !page_try_lock (p))
+          break;
+        if (p->location != FILE || p->mmap != mmap
+            || p->start_byte != page->start_byte + cnt * PGSIZE
+            || share_can_share (p) || page_is_zero_fill (p)
+            || (f = frame_alloc_free ()) == NULL)
+          {
+            lock_release (&p->lock);
+            break;
+          }
+        f->page = p;
+        p->frame = f;
+        loaded = pagedir_set_page (t->pagedir, p->uaddr, f->kaddr,
+                                   p->writable);
+        if (loaded)
+          {
+            page_begin_transit (p);
+            loaded = page_file_in (p);
+            page_end_transit (p);
+          }
+        if (loaded)
+          frame_unpin (f);
+        else
+          {
+            pagedir_clear_page (t->pagedir, p->uaddr);
+            p->frame = NULL;
+            frame_free (f);
+          }
+        lock_release (&p->lock);
+        if (!loaded)
+          break;
+      }
+  mmap->next_fault = page->start_byte + cnt * PGSIZE;
+}
+
+/* Returns true if PAGE holds nothing but zeros so far, i.e. it is new
+   anonymous memory or entirely zero-filled, like BSS. */
+static bool
+page_is_zero_fill (struct page *page)
+{
+  return (page->location == NEW || page->location == ZERO
+          || (page->location == FILE && page->file_zero_bytes == PGSIZE));
+}
+
+/* Maps the shared zero page read-only at PAGE, which must hold nothing
+   but zeros, so reading it needs no frame. A write faults it in.
+   Assumes PAGE->lock is acquired. */
+static bool
+page_map_zero (struct page *page)
+{
+  uint32_t *pd = page->thread->pagedir;
+
+  ASSERT (lock_held_by_current_thread (&page->lock));
+  ASSERT (page_is_zero_fill (page));
+
+  pagedir_clear_page (pd, page->uaddr);
+  if (!pagedir_set_page (pd, page->uaddr, zero_page, false))
+    return false;
+  page->location = ZERO;
+  return true;
+}
+
 /* Attempts to resolve a pagefault on FAULT_ADDR by calling
-   page_in on its page. Returns true on success and false if
-   FAULT_ADDR is not a valid address in the first place. */
+   page_in on its page, or mapping the zero page on reads of untouched
+   memory. WRITE tells whether the fault was on a write. Returns true
+   on success and false if FAULT_ADDR is not a valid address in the
+   first place. Holds the page table lock throughout, so another thread
+   of the process can't free the page meanwhile. */
 bool
-page_resolve_fault (void *fault_addr)
+page_resolve_fault (void *fault_addr, bool write)
 {
+  struct lock *page_table_lock = thread_current ()->process->page_table_lock;
   bool success;
   struct page *page;
 
   if (!is_user_vaddr (fault_addr))
+    process_terminate (-1);
+
+  TRACE (TRACE_FAULT, fault_addr, write);
+  lock_acquire (page_table_lock);
+  page = page_lookup_create (fault_addr);
+  /* Fault address is not mapped, or page is corrupted. */
+  if (page == NULL || page->location == CORRUPTED)
+    {
+      lock_release (page_table_lock);
+      return false;
+    }
+  page_lock (page);
+  if (page->location == FRAME && page->frame->share == NULL
+      && (!write || page->writable))
+    {
+      /* An eviction that failed while the fault waited for it has
+         mapped the page back, or left it to map here. */
+      if (pagedir_get_page (page->thread->pagedir, page->uaddr) == NULL)
+        page_remap (page);
+      success = true;
+    }
+  else if (page->location == FRAME)
+    {
+      /* A page already in a frame only faults on writes, which is fine
+         if it's writable but copy-on-write. */
+      success = (page->writable && share_is_cow (page->frame)
+                 && share_copy_on_write (page));
+      count_fault (&stat_fault_cow, PROCSTAT_FAULT_COW);
+    }
+  else if (!write && page_is_zero_fill (page))
+    {
+      success = page_map_zero (page);
+      count_fault (&stat_fault_zero, PROCSTAT_FAULT_ZERO);
+    }
+  else
     {
-      thread_current ()->process_exit_code = -1;
-      thread_exit ();
+      /* Page-in to a frame. */
+      if (page->location == SWAP)
+        count_fault (&stat_fault_swap, PROCSTAT_FAULT_SWAP);
+      else if (page->location == FILE)
+        count_fault (&stat_fault_file, PROCSTAT_FAULT_FILE);
+      else if (page->location == SHM)
+        count_fault (&stat_fault_shm, PROCSTAT_FAULT_SHM);
+      else
+        count_fault (&stat_fault_new, PROCSTAT_FAULT_NEW);
+      frame_note_fault ();
+      success = page_in (page);
     }
+  /* Unpin the page by default. */
+  page_page_unpin (page);
+  lock_release (&page->lock);
+  lock_release (page_table_lock);
+  return success;
+}
 
-  page = page_lookup (fault_addr);
-  /* Fault address is not mapped. */
-  if (page == NULL)
-    return false;
-  /* Page is already in a frame (can't be paged-in) or is corrupted. */
-  if (page->location == FRAME || page->location == CORRUPTED)
+/* Moves the current thread's program break, the end of its heap, by
+   INCREMENT bytes and returns its old value, or NULL if the heap would
+   end before it starts, run into the stack's reserved area or into
+   memory already mapped. Heap pages are allocated like any new memory,
+   so they take no frame until touched, and are freed once the break
+   drops below them. */
+void *
+page_sbrk (intptr_t increment)
+{
+  struct thread *t = thread_current ()->process;
+  uintptr_t old_break = (uintptr_t) t->heap_break;
+  uintptr_t new_break = old_break + increment;
+  uint8_t *old_end = pg_round_up (t->heap_break);
+  uint8_t *new_end, *upage;
+
+  if (increment < 0
+      ? new_break > old_break || new_break < (uintptr_t) t->heap_start
+      : new_break < old_break || new_break > (uintptr_t) STACK_LIMIT)
+    return NULL;
+  new_end = pg_round_up ((void *) new_break);
+  for (upage = old_end; upage < new_end; upage += PGSIZE)
+    if (page_alloc (upage) == NULL)
+      {
+        /* Give back the pages allocated so far. */
+        while (upage > old_end)
+          page_free (upage -= PGSIZE);
+        return NULL;
+      }
+  for (upage = new_end; upage < old_end; upage += PGSIZE)
+    page_free (upage);
+  t->heap_break = (void *) new_break;
+  return (void *) old_break;
+}
+
+/* Loads the page at UADDR in the current thread into a frame ahead of
+   its first access, so touching it won't fault. Returns false if there
+   is no page there or it fails to load. Thread-safe. */
+bool
+page_prefault (void *uaddr)
+{
+  struct lock *page_table_lock = thread_current ()->process->page_table_lock;
+  bool success;
+
+  lock_acquire (page_table_lock);
+  success = page_load (uaddr);
+  lock_release (page_table_lock);
+  return success;
+}
+
+/* Does the work of page_prefault (UADDR). Assumes the page table lock
+   is acquired. */
+static bool
+page_load (void *uaddr)
+{
+  struct page *page = page_lookup_create (uaddr);
+  bool success;
+
+  if (page == NULL || page->location == CORRUPTED)
     return false;
-  /* Page-in to a frame. */
-  lock_acquire (&page->lock);
+  page_lock (page);
   success = page_in (page);
-  /* Unpin the page by default. */
   page_page_unpin (page);
   lock_release (&page->lock);
   return success;
 }
 
+/* Counts a page fault of KIND, one of the PROCSTAT_FAULT_* kinds, in
+   STAT and in the statistics of the faulting process. */
+static void
+count_fault (struct kstat_counter *stat, int kind)
+{
+  kstat_inc (stat);
+  procstat_add (&procstat_current ()->faults[kind], 1);
+}
+
+/* Grows the current thread's stack to reach FAULT_ADDR, which must be
+   above STACK_LIMIT. Its page faults in as usual, and the
+   STACK_GROWTH_PAGES - 1 pages below it are allocated and loaded right
+   away, as far as they are free and above STACK_LIMIT, so a stack
+   going deeper doesn't fault on each of them. */
+void
+page_grow_stack (void *fault_addr)
+{
+  uint8_t *upage = pg_round_down (fault_addr);
+  size_t i;
+
+  ASSERT (fault_addr >= STACK_LIMIT);
+
+  count_fault (&stat_fault_stack, PROCSTAT_FAULT_STACK);
+  page_alloc (upage);
+  for (i = 1; i < stack_growth_pages; i++)
+    {
+      upage -= PGSIZE;
+      if ((void *) upage < STACK_LIMIT || page_alloc (upage) == NULL)
+        break;
+      page_prefault (upage);
+    }
+}
+
+/* Loads the first MMAP_POPULATE_PAGES pages of MMAP, which belongs to
+   the current thread, in file order, so a pass over them doesn't fault
+   on each. Pages failing to load are left to fault in later. */
+void
+page_mmap_populate (struct page_mmap *mmap)
+{
+  page_mmap_prefault (mmap, mmap_populate_pages);
+}
+
+/* Loads the first CNT pages of MMAP, which belongs to the current
+   thread, region by region. Pages failing to load are left to fault
+   in later. */
+static void
+page_mmap_prefault (struct page_mmap *mmap, size_t cnt)
+{
+  struct thread *t = thread_current ()->process;
+  struct list_elem *e;
+
+  lock_acquire (t->page_table_lock);
+  for (e = list_begin (&t->regions); cnt > 0 && e != list_end (&t->regions);
+       e = list_next (e))
+    {
+      struct page_region *r = list_entry (e, struct page_region, list_elem);
+      uint8_t *upage;
+
+      if (r->mmap == mmap)
+        for (upage = r->start; cnt > 0 && upage < r->end;
+             upage += PGSIZE, cnt--)
+          page_load (upage);
+    }
+  lock_release (t->page_table_lock);
+}
+
+/* Writes the pages of MMAP, which belongs to the current thread,
+   changed since they were read or last written back to its file,
+   keeping them mapped. Returns true if successful. */
+bool
+page_mmap_sync (struct page_mmap *mmap)
+{
+  struct thread *t = thread_current ()->process;
+  struct list_elem *e;
+  bool success = true;
+
+  lock_acquire (t->page_table_lock);
+  for (e = list_begin (&t->regions); e != list_end (&t->regions);
+       e = list_next (e))
+    {
+      struct page_region *r = list_entry (e, struct page_region, list_elem);
+      uintptr_t uaddr = (uintptr_t) r->start;
+      struct page *p;
+
+      /* Pages never touched haven't changed. */
+      while (r->mmap == mmap
+             && (p = page_table_next (t, &uaddr, (uintptr_t) r->end)) != NULL)
+        {
+          off_t bytes = PGSIZE - p->file_zero_bytes;
+
+          page_lock (p);
+          if (p->location == FRAME && p->evict_to == FILE && p->writable
+              && pagedir_is_dirty (t->pagedir, p->uaddr))
+            {
+              bool written;
+
+              /* Clean the page before writing it, so a write to it in
+                 the meantime dirties it again. */
+              pagedir_set_dirty (t->pagedir, p->uaddr, false);
+              page_begin_transit (p);
+              written = (filesys_write_changed_at (mmap->file,
+                                                   p->frame->kaddr, bytes,
+                                                   p->start_byte)
+                         == bytes);
+              page_end_transit (p);
+              if (!written)
+                {
+                  pagedir_set_dirty (t->pagedir, p->uaddr, true);
+                  success = false;
+                }
+            }
+          lock_release (&p->lock);
+        }
+    }
+  lock_release (t->page_table_lock);
+  return success;
+}
+
+/* Writes back the pages of MMAP, which belongs to the current thread,
+   and gives up their frames, so they fault in again from the file. */
+static void
+page_mmap_drop (struct page_mmap *mmap)
+{
+  struct thread *t = thread_current ()->process;
+  struct list_elem *e;
+
+  lock_acquire (t->page_table_lock);
+  pagedir_batch_begin ();
+  for (e = list_begin (&t->regions); e != list_end (&t->regions);
+       e = list_next (e))
+    {
+      struct page_region *r = list_entry (e, struct page_region, list_elem);
+      uintptr_t uaddr = (uintptr_t) r->start;
+      struct page *p;
+
+      while (r->mmap == mmap
+             && (p = page_table_next (t, &uaddr, (uintptr_t) r->end)) != NULL)
+        {
+          page_lock (p);
+          if (p->location == FRAME && !p->pinned)
+            {
+              if (p->frame->share != NULL)
+                share_page_release (p);
+              else if (page_evict (p) && p->location == FILE)
+                {
+                  frame_free (p->frame);
+                  p->frame = NULL;
+                }
+            }
+          lock_release (&p->lock);
+        }
+    }
+  pagedir_batch_end ();
+  lock_release (t->page_table_lock);
+}
+
+/* Takes ADVICE, one of the MADV_* constants, on how MMAP, which belongs
+   to the current thread, is going to be used. Sequential and random
+   use set how much is read around faults and whether pages a
+   sequential scan has left behind are reclaimed first, and the other
+   advice acts on the whole mapping right away. Returns false if ADVICE
+   is invalid. */
+bool
+page_mmap_advise (struct page_mmap *mmap, int advice)
+{
+  switch (advice)
+    {
+      case MADV_NORMAL:
+      case MADV_SEQUENTIAL:
+      case MADV_RANDOM:
+        mmap->advice = advice;
+        return true;
+      case MADV_WILLNEED:
+        page_mmap_prefault (mmap, SIZE_MAX);
+        return true;
+      case MADV_DONTNEED:
+        page_mmap_drop (mmap);
+        return true;
+      default:
+        return false;
+    }
+}
+
+/* Returns true if PAGE is in a mapping advised to be used sequentially
+   and a scan of it has gone well past PAGE, so PAGE is unlikely to be
+   used again even if it was accessed. Used by the clock to reclaim such
+   pages first. PAGE need not belong to the current thread. */
+bool
+page_is_behind_scan (struct page *page)
+{
+  struct page_mmap *mmap = page->mmap;
+
+  return (mmap != NULL && mmap->advice == MADV_SEQUENTIAL
+          && page->start_byte + FILE_CLUSTER * PGSIZE <= mmap->next_fault);
+}
+
 /* Evicts PAGE by swapping its frame out. PAGE need not belong
    to the current thread and it's thread-safe. Returns true
    when the page is no longer on memory or false on failure.
@@ -387,15 +1284,25 @@ page_evict (struct page *page)
     {
       if (page->evict_to == FILE)
         {
+          /* Unmap the page first, so it can't change while it is being
+             written. That leaves its dirty bit as it was. */
+          pagedir_clear_page (page->thread->pagedir, page->uaddr);
           if (page->writable && pagedir_is_dirty (page->thread->pagedir,
                 page->uaddr))
             {
-              /* Write page to file. */
+              /* Write the sectors of the page that changed to file. */
               struct page_mmap *mmap = page->mmap;
-              filesys_seek (mmap->file, page->start_byte);
               off_t bytes_to_write = PGSIZE - page->file_zero_bytes;
-              success = bytes_to_write == filesys_write (mmap->file,
-                                  page->frame->kaddr, bytes_to_write);
+
+              page_begin_transit (page);
+              success = bytes_to_write == filesys_write_changed_at (
+                                  mmap->file, page->frame->kaddr,
+                                  bytes_to_write, page->start_byte);
+              page_end_transit (page);
+              if (success)
+                page->location = FILE;
+              else
+                page_remap (page);
             }
           else
             {
@@ -404,25 +1311,102 @@ page_evict (struct page *page)
               page->location = FILE;
               success = true;
             }
-          pagedir_clear_page (page->thread->pagedir, page->uaddr);
         }
       else
-        {
-          page->swap_slot = swap_out (page->frame);
-          if (page->swap_slot != SWAP_ERROR)
-          {
-            pagedir_clear_page (page->thread->pagedir, page->uaddr);
-            page->location = SWAP;
-            success = true;
-          }
-          else
-            success = false;
-        }
+        success = page_swap_out (&page, 1);
     }
 done:
   return success;
 }
 
+/* Evicts the CNT PAGES, at most SWAP_CLUSTER, into adjacent swap slots
+   with a single write. Pages still unchanged since they were swapped in
+   go back to the slot they came from without any write. Every page must
+   be in an unpinned frame and be evicted to swap, the pages must all
+   belong to one process, and the caller must hold all of their locks,
+   which are released during the write. Returns false, evicting none of
+   them, if there is no run of free swap slots for the changed ones. */
+bool
+page_swap_out (struct page **pages, size_t cnt)
+{
+  struct page *dirty[SWAP_CLUSTER];
+  struct frame *frames[SWAP_CLUSTER];
+  size_t dirty_cnt = 0;
+  size_t swap_slot = SWAP_ERROR;
+  size_t i;
+
+  ASSERT (cnt <= SWAP_CLUSTER);
+  for (i = 0; i < cnt; i++)
+    {
+      struct page *p = pages[i];
+
+      ASSERT (lock_held_by_current_thread (&p->lock));
+      ASSERT (p->location == FRAME && !p->pinned);
+      /* Unmap the page first, so it can't change while the others are
+         being written. That leaves its dirty bit as it was. */
+      pagedir_clear_page (p->thread->pagedir, p->uaddr);
+      if (p->swap_slot != SWAP_ERROR
+          && !pagedir_is_dirty (p->thread->pagedir, p->uaddr))
+        continue;
+      /* Whatever copy a changed page had is out of date, and its slot
+         may as well go to the write. */
+      page_drop_swap_copy (p);
+      frames[dirty_cnt] = p->frame;
+      dirty[dirty_cnt++] = p;
+    }
+  if (dirty_cnt > 0)
+    {
+      for (i = 0; i < dirty_cnt; i++)
+        page_begin_transit (dirty[i]);
+      swap_slot = swap_out_multiple (frames, dirty_cnt, pages[0]->thread);
+      for (i = 0; i < dirty_cnt; i++)
+        page_end_transit (dirty[i]);
+      if (swap_slot == SWAP_ERROR)
+        {
+          for (i = 0; i < cnt; i++)
+            page_remap (pages[i]);
+          return false;
+        }
+      for (i = 0; i < dirty_cnt; i++)
+        dirty[i]->swap_slot = swap_slot + i;
+      procstat_add (&pages[0]->thread->procstat.swap_outs, dirty_cnt);
+    }
+  kstat_add (&stat_swap_clean, cnt - dirty_cnt);
+  for (i = 0; i < cnt; i++)
+    pages[i]->location = SWAP;
+  return true;
+}
+
+/* Maps the frame of page P, which an eviction that failed unmapped,
+   back in, as dirty as it was. Assumes P->lock is acquired. */
+static void
+page_remap (struct page *p)
+{
+  uint32_t *pd = p->thread->pagedir;
+  bool dirty = pagedir_is_dirty (pd, p->uaddr);
+
+  ASSERT (lock_held_by_current_thread (&p->lock));
+  ASSERT (p->location == FRAME);
+
+  if (pagedir_set_page (pd, p->uaddr, p->frame->kaddr, p->writable))
+    pagedir_set_dirty (pd, p->uaddr, dirty);
+}
+
+/* Lets go of the swap slot that FRAME page P keeps as a copy of its
+   data, if any, as when P changes or goes away. Assumes P->lock is
+   acquired. */
+void
+page_drop_swap_copy (struct page *p)
+{
+  ASSERT (lock_held_by_current_thread (&p->lock));
+  ASSERT (p->location == FRAME);
+  if (p->swap_slot != SWAP_ERROR)
+    {
+      swap_free (p->swap_slot);
+      p->swap_slot = SWAP_ERROR;
+    }
+}
+
 /* This function assumes the lock for the file as already been acquired*/
 struct page_mmap*
 page_mmap_new (struct file* file, size_t file_size)
@@ -431,79 +1415,215 @@ page_mmap_new (struct file* file, size_t file_size)
   struct page_mmap *mmap = malloc (sizeof (struct page_mmap));
   if (mmap == NULL)
     return NULL;
-  list_init (&mmap->mmap_pages);
   mmap->file = file_reopen(file);
   if (mmap->file == NULL)
     {
       free(mmap);
       return NULL;
     }
+  mmap->shm = NULL;
   mmap->file_size = file_size;
+  mmap->private = false;
   mmap->id = MAP_FAILED;
+  mmap->next_fault = 0;
+  mmap->advice = MADV_NORMAL;
 
   return mmap;
 }
 
-/* Allocate a page in user address UADDR and associate it with file backed
- * memory map MMAP */
-bool page_add_to_mmap(struct page_mmap *mmap, void* uaddr,
-                      unsigned offset, size_t zero_bytes)
+/* Returns a new memory map of all of shared memory segment SHM, taking
+   a reference to it, or a null pointer if memory is not available.
+   Its regions are added with page_add_region() like those of a file,
+   their offsets telling which pages of SHM they are. */
+struct page_mmap *
+page_mmap_new_shm (struct shm *shm)
 {
-  struct thread *t = thread_current ();
+  struct page_mmap *mmap = malloc (sizeof *mmap);
 
-  // Check that address isn't already mapped to a page
-  struct page *pRet = page_lookup(uaddr);
-  if (pRet != NULL || pagedir_get_page(t->pagedir, uaddr))
-    return false;
+  if (mmap == NULL)
+    return NULL;
+  mmap->file = NULL;
+  mmap->shm = share_shm_reopen (shm);
+  mmap->file_size = share_shm_page_cnt (shm) * PGSIZE;
+  mmap->private = false;
+  mmap->id = MAP_FAILED;
+  mmap->next_fault = 0;
+  mmap->advice = MADV_NORMAL;
+  return mmap;
+}
 
-  struct page_mmap_elem *page_wrapper = malloc (sizeof (struct page_mmap_elem));
-  if (page_wrapper == NULL)
+/* Gives up the file or shared memory segment backing MMAP. */
+static void
+page_mmap_close (struct page_mmap *mmap)
+{
+  if (mmap->shm != NULL)
+    share_shm_close (mmap->shm);
+  else
+    filesys_close (mmap->file);
+}
+
+/* Maps the READ_BYTES + ZERO_BYTES bytes at UADDR, a multiple of
+   PGSIZE, to MMAP as a region read from OFFSET in its file or segment,
+   followed by zeros, and writable if WRITABLE. Its pages are not
+   allocated until touched. Returns false if the range is not
+   page-aligned user memory, or any of it is mapped already. */
+bool
+page_add_region (struct page_mmap *mmap, void *uaddr, unsigned offset,
+                 size_t read_bytes, size_t zero_bytes, bool writable)
+{
+  struct thread *t = thread_current ()->process;
+  uint8_t *start = uaddr;
+  uint8_t *end = start + read_bytes + zero_bytes;
+  uintptr_t next = (uintptr_t) start;
+  struct page_region *r;
+  struct list_elem *e;
+  bool success = false;
+
+  ASSERT ((read_bytes + zero_bytes) % PGSIZE == 0);
+
+  if (pg_ofs (uaddr) != 0 || end < start || end > (uint8_t *) PHYS_BASE)
+    return false;
+  if (end == start)
+    return true;
+  r = malloc (sizeof *r);
+  if (r == NULL)
     return false;
-  page_wrapper->page_addr = uaddr;
 
-  // Add page to page table
-  void *addr = page_alloc(uaddr);
-  pRet = page_lookup(addr);
-  if (pRet == NULL)
+  lock_acquire (t->page_table_lock);
+  for (e = list_begin (&t->regions); e != list_end (&t->regions);
+       e = list_next (e))
     {
-      free (page_wrapper);
-      return false;
+      struct page_region *o = list_entry (e, struct page_region, list_elem);
+
+      if (o->start < end && start < o->end)
+        goto done;
     }
+  if (page_table_next (t, &next, (uintptr_t) end) != NULL)
+    goto done;
+  r->mmap = mmap;
+  r->start = start;
+  r->end = end;
+  r->offset = offset;
+  r->read_bytes = read_bytes;
+  r->writable = writable;
+  list_push_back (&t->regions, &r->list_elem);
+  success = true;
+ done:
+  lock_release (t->page_table_lock);
+  if (!success)
+    free (r);
+  return success;
+}
 
-  pRet->location = FILE;
-  pRet->evict_to = FILE;
-  pRet->file_zero_bytes = zero_bytes;
-  pRet->start_byte = offset;
-  pRet->mmap = mmap;
+/* Returns the region of T that UADDR is in, or NULL if there is none.
+   Assumes T's page table lock is acquired. */
+static struct page_region *
+page_region_at (struct thread *t, const void *uaddr)
+{
+  struct list_elem *e;
 
-  // add page to mmap list of pages
-  list_push_back(&mmap->mmap_pages, &page_wrapper->list_elem);
-  return true;
+  for (e = list_begin (&t->regions); e != list_end (&t->regions);
+       e = list_next (e))
+    {
+      struct page_region *r = list_entry (e, struct page_region, list_elem);
+
+      if (r->start <= (uint8_t *) uaddr && (uint8_t *) uaddr < r->end)
+        return r;
+    }
+  return NULL;
+}
+
+/* Like page_lookup(), but if there is no page at UADDR yet and it is in
+   a region, creates the page, to load from its part of the region.
+   Assumes the current thread's page table lock is acquired. */
+static struct page *
+page_lookup_create (void *uaddr)
+{
+  struct thread *t = thread_current ()->process;
+  struct page *p = page_lookup (uaddr);
+  struct page_region *r;
+  size_t ofs;
+
+  ASSERT (lock_held_by_current_thread (t->page_table_lock));
+
+  if (p != NULL || !is_user_vaddr (uaddr)
+      || (r = page_region_at (t, uaddr)) == NULL
+      || (p = page_new (t, pg_round_down (uaddr))) == NULL)
+    return p;
+  ofs = (uint8_t *) p->uaddr - r->start;
+  p->mmap = r->mmap;
+  p->location = r->mmap->shm != NULL ? SHM : FILE;
+  p->evict_to = (r->mmap->shm != NULL ? SHM
+                 : r->writable && r->mmap->private ? SWAP : FILE);
+  p->writable = r->writable;
+  p->start_byte = r->offset + ofs;
+  p->file_zero_bytes = (ofs >= r->read_bytes ? PGSIZE
+                        : r->read_bytes - ofs >= PGSIZE ? 0
+                        : PGSIZE - (r->read_bytes - ofs));
+  return p;
+}
+
+/* Frees region R of T and the pages of it that were touched.
+   Assumes T's page table lock is acquired. */
+static void
+page_region_free (struct thread *t, struct page_region *r)
+{
+  uintptr_t uaddr = (uintptr_t) r->start;
+  struct page *p;
+
+  ASSERT (lock_held_by_current_thread (t->page_table_lock));
+
+  while ((p = page_table_next (t, &uaddr, (uintptr_t) r->end)) != NULL)
+    page_page_free (p);
+  list_remove (&r->list_elem);
+  free (r);
 }
 
 /* Delete mmapp and free all resources associated with it*/
 void page_delete_mmap (struct page_mmap *mmap)
 {
-  struct list_elem *curr_elem = NULL;
-  struct list_elem *next_elem = NULL;
+  struct thread *t = thread_current ()->process;
+  struct list_elem *e;
 
-  for (curr_elem = list_begin (&mmap->mmap_pages);
-       curr_elem != list_end (&mmap->mmap_pages);
-       curr_elem = next_elem)
+  lock_acquire (t->page_table_lock);
+  pagedir_batch_begin ();
+  for (e = list_begin (&t->regions); e != list_end (&t->regions); )
     {
-      next_elem = list_next(curr_elem);
-
-      struct page_mmap_elem *page = list_entry(curr_elem,
-                                               struct page_mmap_elem,
-                                               list_elem);
+      struct page_region *r = list_entry (e, struct page_region, list_elem);
 
-      struct page *pRet = page_lookup(page->page_addr);
-      if (pRet == NULL)
-        PANIC ("Error in mmap, missing page entry");
-      page_free(page->page_addr);
-      free(page);
+      e = list_next (e);
+      if (r->mmap == mmap)
+        page_region_free (t, r);
     }
-  filesys_close (mmap->file);
+  pagedir_batch_end ();
+  lock_release (t->page_table_lock);
+  page_mmap_close (mmap);
+  free (mmap);
+}
+
+/* Returns a copy of MMAP for the current thread, with the same ID and a
+   file of its own, or a reference to the same segment, or a null
+   pointer on failure. page_table_fork() copies its regions. */
+static struct page_mmap *
+page_mmap_copy (struct page_mmap *mmap)
+{
+  struct page_mmap *copy = (mmap->shm != NULL
+                            ? page_mmap_new_shm (mmap->shm)
+                            : page_mmap_new (mmap->file, mmap->file_size));
+
+  if (copy == NULL)
+    return NULL;
+  copy->id = mmap->id;
+  copy->private = mmap->private;
+  copy->advice = mmap->advice;
+  return copy;
+}
+
+/* Frees MMAP without touching its regions or pages. */
+static void
+page_mmap_discard (struct page_mmap *mmap)
+{
+  page_mmap_close (mmap);
   free (mmap);
 }
 
@@ -522,7 +1642,8 @@ struct page_mmap *page_get_mmap(struct thread *t, mapid_t id)
     {
       e = list_find(&t->mmap_list, page_mmap_equal,
                     &id);
-      return list_entry(e, struct page_mmap, list_elem);
+      if (e != NULL)
+        return list_entry(e, struct page_mmap, list_elem);
     }
   return NULL;
 }
@@ -531,43 +1652,51 @@ struct page_mmap *page_get_mmap(struct thread *t, mapid_t id)
 struct page *
 page_lookup (void *uaddr)
 {
-  struct thread *t = thread_current ();
-  struct page p;
-  struct hash_elem *e;
-  struct page *result;
+  struct thread *t = thread_current ()->process;
+  struct page **entry;
 
-  p.uaddr = pg_round_down (uaddr);
-  e = hash_find (&t->page_table, &p.hash_elem);
-  result = e != NULL ? hash_entry (e, struct page, hash_elem) : NULL;
-  return result;
+  if (t->page_table == NULL || !is_user_vaddr (uaddr))
+    return NULL;
+  entry = page_table_entry (t, uaddr, false);
+  return entry != NULL ? *entry : NULL;
 }
 
-/* Hash function that hashes a page's uaddr into its page_table hash table. */
-static unsigned
-page_hash (const struct hash_elem *e, void *aux UNUSED)
+/* Returns the entry for user address UADDR in T's page_table. If
+   the page table holding it doesn't exist yet, allocates it if CREATE
+   is true, otherwise or on failure returns NULL. */
+static struct page **
+page_table_entry (struct thread *t, const void *uaddr, bool create)
 {
-  const struct page *p = hash_entry (e, struct page, hash_elem);
-  return hash_bytes (&p->uaddr, sizeof p->uaddr);
-}
+  struct page ***table = &t->page_table->tables[pd_no (uaddr)];
 
-/* Hash comparison function necessary to use page_table as a hash table. */
-static bool
-page_less (const struct hash_elem *a_,
-           const struct hash_elem *b_,
-           void *aux UNUSED)
-{
-  const struct page *a = hash_entry (a_, struct page, hash_elem);
-  const struct page *b = hash_entry (b_, struct page, hash_elem);
-  return a->uaddr < b->uaddr;
+  ASSERT (is_user_vaddr (uaddr));
+
+  if (*table == NULL
+      && (!create || (*table = palloc_get_page (PAL_ZERO)) == NULL))
+    return NULL;
+  return &(*table)[pt_no (uaddr)];
 }
 
-/* Helper function that calls page_page_free on a hash
-   element. Useful when destroying the hash table. */
-static void
-hash_page_free (struct hash_elem *e, void *aux UNUSED)
+/* Returns the page of T with the lowest address at or above *UADDR and
+   below END, and advances *UADDR past it, or returns NULL if there is
+   none. Page tables that were never allocated are skipped whole. */
+static struct page *
+page_table_next (struct thread *t, uintptr_t *uaddr, uintptr_t end)
 {
-  struct page *page;
+  while (*uaddr < end)
+    {
+      struct page **table = t->page_table->tables[pd_no ((void *) *uaddr)];
+      struct page *p;
 
-  page = hash_entry (e, struct page, hash_elem);
-  page_page_free (page);
+      if (table == NULL)
+        {
+          *uaddr = ((*uaddr >> PDSHIFT) + 1) << PDSHIFT;
+          continue;
+        }
+      p = table[pt_no ((void *) *uaddr)];
+      *uaddr += PGSIZE;
+      if (p != NULL)
+        return p;
+    }
+  return NULL;
 }
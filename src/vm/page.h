@@ -2,12 +2,14 @@
 #define VM_PAGE_H
 #include <stdbool.h>
 #include <stddef.h>
-#include <hash.h>
+#include <stdint.h>
 #include "threads/thread.h"
 #include "threads/synch.h"
 #include "vm/frame.h"
 #include "vm/swap.h"
 
+struct shm;
+
 /* Where to load the page from. */
 enum page_location
   {
@@ -15,25 +17,36 @@ enum page_location
     FRAME,       /* Page already in a frame. */
     SWAP,        /* Page has been swapped out. */
     FILE,        /* Page is in mapped file. */
+    ZERO,        /* Page maps the shared zero page until written. */
+    SHM,         /* Page is in a shared memory segment. */
     CORRUPTED,   /* Page lost. */
   };
 
 /* A page in a threads page_table. */
 struct page
   {
-    struct hash_elem hash_elem;   /* In thread's page_table hash table. */
-    struct lock lock;
+    struct lock lock;             /* Guards the page's state, but is not
+                                     held across I/O on it. */
+    bool in_transit;              /* Its data is being read or written,
+                                     by the thread that set this, which
+                                     alone may touch the page until it
+                                     is done. */
+    struct condition transit_done; /* Signaled when IN_TRANSIT clears. */
     struct thread *thread;
     void *uaddr;                  /* User virtual address, page_table key. */
     enum page_location location;  /* Where to load the page from. */
     bool writable;                /* RW vs RO. */
     struct frame *frame;
     bool pinned;
-    size_t swap_slot;
+    size_t swap_slot;             /* Slot holding the page's data: in
+                                     SWAP, or in a FRAME it hasn't written
+                                     since swapping in. Else SWAP_ERROR. */
     enum page_location evict_to;  /* Where to evict the frame (e.g. FILE). */
     struct page_mmap *mmap;       /* For MMAP: mmap corresponding to this page*/
     size_t file_zero_bytes;       /* For MMAP: Number of bytes that stick out*/
     unsigned start_byte;          /* For MMAP: Page starting location in file */
+    struct list_elem share_elem;  /* For shared frames: in the share's list
+                                     of pages mapping it. */
   };
 
 /* Wrapper struct for a mmaped file */
@@ -42,32 +55,65 @@ struct page_mmap
     mapid_t id;                 /* ID of mmap*/
     struct list_elem list_elem; /* List element to place mmap in list */
     struct file *file;          /* File backing mmap */
+    struct shm *shm;            /* Shared memory segment backing mmap
+                                   instead of FILE, or null. */
     size_t file_size;           /* Size of above */
-    struct list mmap_pages;     /* List of pages mapped to this mmap */
+    bool private;               /* Writable pages go to swap, not back
+                                   to FILE, as an executable's do. */
+    unsigned next_fault;        /* Start byte a sequential scan of the
+                                   mapping faults on next. */
+    int advice;                 /* MADV_* given by madvise(). */
   };
 
-/* Wrapper struct for a page in an mmap*/
-struct page_mmap_elem
+/* A run of pages of an mmap, loaded from consecutive parts of its file
+   or segment. A page of it gets its struct page when first touched. */
+struct page_region
   {
-    struct list_elem list_elem; /* List element to put page in mmap_pages */
-    void* page_addr;            /* Virtual Address of page */
+    struct list_elem list_elem; /* In the process's regions. */
+    struct page_mmap *mmap;     /* Mapping the region is of. */
+    uint8_t *start;             /* Address of the first page. */
+    uint8_t *end;               /* Address past the last page. */
+    unsigned offset;            /* Where START is read from. */
+    size_t read_bytes;          /* Bytes read, the rest are zeros. */
+    bool writable;              /* RW vs RO. */
   };
 
+/* Tunables, set from the kernel command line. */
+extern size_t stack_growth_pages;
+extern size_t mmap_populate_pages;
+
+void page_init (void);
 bool page_table_init (void);
 void page_table_destroy (void);
+bool page_table_fork (struct thread *parent);
 void *page_alloc (void *uaddr);
 struct page *page_lookup (void *uaddr);
 void page_free (void *uaddr);
+void page_lock (struct page *page);
+void page_drop_swap_copy (struct page *p);
 bool page_evict (struct page *page);
+bool page_file_in (struct page *page);
+bool page_swap_out (struct page **pages, size_t cnt);
 void page_pin (void *uaddr);
 void page_unpin (void *uaddr);
+bool page_pin_range (const void *uaddr, size_t size, bool write);
+void page_unpin_range (const void *uaddr, size_t size);
+void *page_pinned_kaddr (const void *uaddr);
 void page_set_writable (void *uaddr, bool writable);
 bool page_is_writable (struct page *page);
-bool page_resolve_fault (void *fault_addr);
+bool page_resolve_fault (void *fault_addr, bool write);
+void *page_sbrk (intptr_t increment);
+bool page_prefault (void *uaddr);
+void page_grow_stack (void *fault_addr);
 struct page_mmap *page_mmap_new (struct file* file, size_t file_size);
-bool page_add_to_mmap (struct page_mmap *mmap, void* uaddr,
-                       unsigned offset, size_t zero_bytes);
+struct page_mmap *page_mmap_new_shm (struct shm *shm);
+bool page_add_region (struct page_mmap *mmap, void *uaddr, unsigned offset,
+                      size_t read_bytes, size_t zero_bytes, bool writable);
 void page_delete_mmap (struct page_mmap *mmap);
+void page_mmap_populate (struct page_mmap *mmap);
+bool page_mmap_sync (struct page_mmap *mmap);
+bool page_mmap_advise (struct page_mmap *mmap, int advice);
+bool page_is_behind_scan (struct page *page);
 struct page_mmap *page_get_mmap (struct thread *t, mapid_t id);
 
 #endif /* vm/page.h */
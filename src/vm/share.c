@@ -0,0 +1,1177 @@
+#include "vm/share.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/file.h"
+#include "threads/kstat.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "threads/vmalloc.h"
+#include "threads/workqueue.h"
+#include "userprog/pagedir.h"
+#include "userprog/procstat.h"
+#include "vm/swap.h"
+
+/* A frame holding a read-only page of a file, mapped by every page
+   that loads that same page of the file, such as the code of all the
+   processes running one executable. Or a frame of anonymous memory a
+   process forked, which it and its child map read-only and copy on
+   write. Or a frame holding a page of a shared memory segment, which
+   every process mapping the segment maps. */
+struct share
+  {
+    struct hash_elem hash_elem;   /* In SHARES. */
+    struct inode *inode;          /* File the page is read from, null
+                                     if copied on write or of SHM. */
+    struct shm *shm;              /* Segment the page is of, or null. */
+    off_t ofs;                    /* Offset of the page in INODE or
+                                     SHM. */
+    size_t zero_bytes;            /* Bytes zeroed at the end. */
+    struct frame *frame;          /* Frame holding the page. */
+    bool loaded;                  /* FRAME holds the data yet? */
+    struct list pages;            /* Pages mapping FRAME, the reverse
+                                     mapping used to evict it. */
+    unsigned kernel_pins;         /* share_shm_get()s not yet put,
+                                     which keep FRAME in memory. */
+    bool kernel_accessed;         /* Got since the clock last looked? */
+  };
+
+/* A shared memory segment, anonymous memory that the processes holding
+   it map at once, so that what one of them writes the others read at
+   the same time, or that the kernel reads and writes itself through
+   share_shm_get(), such as the data of a tmpfs file. A page of it in
+   memory is in a shared frame like those above, but one that stays
+   with the segment once nobody maps it, until the clock evicts it. Evicted pages go to a swap slot of
+   the segment's own, which is given up once the page is back. */
+struct shm
+  {
+    size_t ref_cnt;               /* Descriptors and mmaps of it. */
+    size_t page_cnt;              /* Number of PAGES. */
+    struct shm_page *pages;       /* Its pages, in order. */
+  };
+
+/* A page of a shared memory segment. */
+struct shm_page
+  {
+    struct share *share;          /* Frame holding it, or null. */
+    size_t swap_slot;             /* Slot holding it if not in a frame,
+                                     or SWAP_ERROR if all zeros yet. */
+  };
+
+/* Shared frames of files by inode and offset. */
+static struct hash shares;
+/* Lock guarding SHARES, struct share, struct shm and the SHARE of
+   frames. Taken after page locks and after frame_table_lock. */
+static struct lock share_lock;
+/* Broadcast when a shared frame is done loading. */
+static struct condition share_loaded;
+
+static hash_hash_func share_hash;
+static hash_less_func share_less;
+static struct share *shm_load (struct shm *, size_t idx,
+                               struct frame **spare);
+static void shm_page_free (struct shm_page *);
+
+/* Same-page merging. The merge work goes around the frame table
+   checksumming the frames of anonymous pages, and once a frame's
+   checksum stays the same from one round to the next, so that it is
+   unlikely to change soon, looks for another frame with that checksum
+   among the ones it has seen stable. If the two hold the same data,
+   the page in the first maps the second instead, copy-on-write as if
+   forked, and gives its frame back. */
+
+/* Frames the merge work scans a second, or 0 if it doesn't run. */
+size_t share_merge_pages;
+
+/* Ticks between the merge work's batches of frames. */
+#define MERGE_INTERVAL (TIMER_FREQ / 10)
+
+/* What the merge work knows of a frame. */
+struct merge_node
+  {
+    struct hash_elem hash_elem;   /* In MERGE_STABLE if LISTED. */
+    unsigned sum;                 /* Checksum when last scanned. */
+    bool listed;                  /* In MERGE_STABLE? */
+  };
+
+/* Merge nodes indexed by frame number. */
+static struct merge_node *merge_nodes;
+/* Merge nodes of frames found stable, by SUM. Only the merge work uses
+   it. */
+static struct hash merge_stable;
+
+/* Merge work, the frames it scans each time and the next frame to
+   scan. */
+static struct work merge_work;
+static size_t merge_batch;
+static size_t merge_next;
+
+static hash_hash_func merge_hash;
+static hash_less_func merge_less;
+static work_func merge_some;
+static void merge_scan (size_t no);
+static void merge_unlist (struct merge_node *);
+static void merge_list (struct merge_node *);
+static bool merge_pages (struct page *page, struct page *other);
+static bool share_new_cow (struct page *page);
+
+/* Statistics. */
+static struct kstat_counter stat_merge = KSTAT_COUNTER ("share.merge");
+static struct kstat_counter stat_merge_scan
+  = KSTAT_COUNTER ("share.merge.scan");
+
+/* Initializes the table of shared frames. */
+void
+share_init (void)
+{
+  hash_init (&shares, share_hash, share_less, NULL);
+  lock_init (&share_lock);
+  cond_init (&share_loaded);
+  kstat_register (&stat_merge);
+  kstat_register (&stat_merge_scan);
+}
+
+/* Starts merging pages, if share_merge_pages asks for it. Must be
+   called after frame_init() and workqueue_init(). */
+void
+share_merge_init (void)
+{
+  if (share_merge_pages == 0 || frame_count () == 0)
+    return;
+  merge_nodes = vcalloc (frame_count (), sizeof *merge_nodes);
+  if (merge_nodes == NULL
+      || !hash_init (&merge_stable, merge_hash, merge_less, NULL))
+    PANIC ("OOM when allocating the merge table!");
+  merge_batch = share_merge_pages * MERGE_INTERVAL / TIMER_FREQ;
+  if (merge_batch == 0)
+    merge_batch = 1;
+  work_init (&merge_work, merge_some, NULL, WORK_PRI_LOW);
+  work_queue_delayed (&merge_work, MERGE_INTERVAL);
+}
+
+/* Merge work, queued every MERGE_INTERVAL. Scans share_merge_pages
+   frames a second, a batch each time, going around the frame table. */
+static void
+merge_some (void *aux UNUSED)
+{
+  size_t i;
+
+  for (i = 0; i < merge_batch; i++)
+    {
+      merge_scan (merge_next);
+      merge_next = (merge_next + 1) % frame_count ();
+    }
+  work_queue_delayed (&merge_work, MERGE_INTERVAL);
+}
+
+/* Takes NODE out of MERGE_STABLE, if it is there. */
+static void
+merge_unlist (struct merge_node *node)
+{
+  if (node->listed)
+    hash_delete (&merge_stable, &node->hash_elem);
+  node->listed = false;
+}
+
+/* Lists NODE in MERGE_STABLE, as the frame standing for its data. */
+static void
+merge_list (struct merge_node *node)
+{
+  struct hash_elem *old = hash_replace (&merge_stable, &node->hash_elem);
+
+  if (old != NULL)
+    hash_entry (old, struct merge_node, hash_elem)->listed = false;
+  node->listed = true;
+}
+
+/* Scans frame number NO for merging, merging its page into another
+   frame if it has been stable since the last round. */
+static void
+merge_scan (size_t no)
+{
+  struct merge_node *node = &merge_nodes[no];
+  struct page *page = frame_try_lock (no);
+  unsigned sum;
+
+  kstat_inc (&stat_merge_scan);
+  if (page == NULL)
+    {
+      /* Free, or busy for now. */
+      merge_unlist (node);
+      return;
+    }
+  if (share_is_cow (page->frame))
+    {
+      /* A copy-on-write frame can't change, so it may stand for its
+         data at once. */
+      sum = hash_bytes (page->frame->kaddr, PGSIZE);
+      if (!node->listed || node->sum != sum)
+        {
+          merge_unlist (node);
+          node->sum = sum;
+          merge_list (node);
+        }
+    }
+  else if (page->frame->share != NULL || page->pinned
+           || page->evict_to != SWAP)
+    {
+      /* Not anonymous memory. */
+      merge_unlist (node);
+      node->sum = 0;
+    }
+  else if ((sum = hash_bytes (page->frame->kaddr, PGSIZE)) != node->sum)
+    {
+      /* Changed since the last round. */
+      merge_unlist (node);
+      node->sum = sum;
+    }
+  else if (!node->listed)
+    {
+      struct hash_elem *e = hash_find (&merge_stable, &node->hash_elem);
+      struct merge_node *match;
+      struct page *other;
+
+      /* Another frame with the same checksum may hold the same data. */
+      match = e != NULL ? hash_entry (e, struct merge_node, hash_elem) : NULL;
+      if (match == NULL)
+        merge_list (node);
+      else if ((other = frame_try_lock (match - merge_nodes)) != NULL)
+        {
+          if (merge_pages (page, other))
+            {
+              kstat_inc (&stat_merge);
+              node->sum = 0;
+            }
+          else
+            /* MATCH holds other data by now. */
+            merge_list (node);
+          lock_release (&other->lock);
+        }
+    }
+  lock_release (&page->lock);
+}
+
+/* Makes PAGE, an unpinned anonymous page in a frame of its own, map the
+   frame of OTHER instead if it holds the same data, and frees PAGE's
+   frame. OTHER is in a frame shared copy-on-write, or an unpinned
+   anonymous page in a frame of its own that becomes shared so. Returns
+   true if successful. Assumes the locks of both pages are acquired. */
+static bool
+merge_pages (struct page *page, struct page *other)
+{
+  struct frame *frame = other->frame, *old = page->frame;
+  uint32_t *pd = page->thread->pagedir;
+  bool private = frame->share == NULL;
+
+  ASSERT (lock_held_by_current_thread (&page->lock));
+  ASSERT (lock_held_by_current_thread (&other->lock));
+  ASSERT (old->share == NULL);
+
+  if (private && (other->pinned || other->evict_to != SWAP))
+    return false;
+
+  /* Write-protect the pages before comparing them, so that neither
+     can change under the comparison, or after it. A write meanwhile
+     faults and waits for the page lock. */
+  pagedir_set_writable (pd, page->uaddr, false);
+  if (private)
+    pagedir_set_writable (other->thread->pagedir, other->uaddr, false);
+  if (memcmp (old->kaddr, frame->kaddr, PGSIZE)
+      || (private && !share_new_cow (other)))
+    {
+      pagedir_set_writable (pd, page->uaddr, page->writable);
+      if (private)
+        pagedir_set_writable (other->thread->pagedir, other->uaddr,
+                              other->writable);
+      return false;
+    }
+
+  /* The data no longer changes where a swap slot keeps a copy. */
+  page_drop_swap_copy (page);
+  if (private)
+    page_drop_swap_copy (other);
+  pagedir_clear_page (pd, page->uaddr);
+  if (!pagedir_set_page (pd, page->uaddr, frame->kaddr, false))
+    {
+      /* OTHER stays shared alone until it copies on write. */
+      if (!pagedir_set_page (pd, page->uaddr, old->kaddr, page->writable))
+        PANIC ("Failed to map back a page that couldn't be merged!");
+      return false;
+    }
+  lock_acquire (&share_lock);
+  list_push_back (&frame->share->pages, &page->share_elem);
+  lock_release (&share_lock);
+  page->frame = frame;
+  frame_free (old);
+  return true;
+}
+
+/* Returns true if PAGE is read-only and loaded from a file, so every
+   page loading the same part of the file may share its frame. */
+bool
+share_can_share (struct page *page)
+{
+  return (page->location == FILE && page->evict_to == FILE
+          && !page->writable && page->mmap != NULL);
+}
+
+/* Returns the shared frame holding the page at OFS of INODE followed by
+   ZERO_BYTES zeros, or a null pointer if there is none. Assumes share_lock is acquired. */
+static struct share *
+share_lookup (struct inode *inode, off_t ofs, size_t zero_bytes)
+{
+  struct share key;
+  struct hash_elem *e;
+
+  key.inode = inode;
+  key.ofs = ofs;
+  key.zero_bytes = zero_bytes;
+  e = hash_find (&shares, &key.hash_elem);
+  return e != NULL ? hash_entry (e, struct share, hash_elem) : NULL;
+}
+
+/* Places PAGE, for which share_can_share() is true, in the shared frame
+   holding its part of the file, loading it into a new one if there is
+   none yet. Returns true on success and false on failure, like
+   page_in(), leaving PAGE pinned on success.
+   Assumes PAGE->lock is acquired by the current thread. */
+bool
+share_page_in (struct page *page)
+{
+  struct thread *t = thread_current ()->process;
+  struct inode *inode = file_get_inode (page->mmap->file);
+  struct frame *frame = NULL;
+  struct share *s;
+
+  ASSERT (lock_held_by_current_thread (&page->lock));
+  ASSERT (share_can_share (page));
+
+  lock_acquire (&share_lock);
+  while ((s = share_lookup (inode, page->start_byte, page->file_zero_bytes))
+          == NULL || !s->loaded)
+    {
+      bool success;
+
+      if (s != NULL)
+        {
+          /* Someone else is loading it. */
+          cond_wait (&share_loaded, &share_lock);
+          continue;
+        }
+      if (frame == NULL)
+        {
+          /* Don't allocate under share_lock, eviction takes it. Someone
+             may load the page meanwhile, so look again afterward. */
+          lock_release (&share_lock);
+          frame = frame_alloc (false);
+          lock_acquire (&share_lock);
+          continue;
+        }
+
+      /* Publish FRAME, pinned until loaded, and load it. */
+      s = malloc (sizeof *s);
+      if (s == NULL)
+        break;
+      s->inode = inode;
+      s->shm = NULL;
+      s->ofs = page->start_byte;
+      s->zero_bytes = page->file_zero_bytes;
+      s->frame = frame;
+      s->loaded = false;
+      s->kernel_pins = 0;
+      s->kernel_accessed = false;
+      list_init (&s->pages);
+      frame->share = s;
+      hash_insert (&shares, &s->hash_elem);
+      lock_release (&share_lock);
+
+      page->frame = frame;
+      success = page_file_in (page);
+
+      lock_acquire (&share_lock);
+      if (success)
+        {
+          s->loaded = true;
+          frame->pinned = false;
+          frame = NULL;
+        }
+      else
+        {
+          hash_delete (&shares, &s->hash_elem);
+          frame->share = NULL;
+          free (s);
+          s = NULL;
+        }
+      cond_broadcast (&share_loaded, &share_lock);
+      if (!success)
+        break;
+    }
+  if (s != NULL && s->loaded)
+    list_push_back (&s->pages, &page->share_elem);
+  lock_release (&share_lock);
+
+  /* Give back a frame someone else's load made unneeded. */
+  if (frame != NULL)
+    frame_free (frame);
+  if (s == NULL || !s->loaded)
+    {
+      page->location = CORRUPTED;
+      return false;
+    }
+
+  page->frame = s->frame;
+  page->pinned = true;
+  if (!pagedir_set_page (t->pagedir, page->uaddr, s->frame->kaddr, false))
+    {
+      page->location = FRAME;
+      share_page_release (page);
+      page->pinned = false;
+      return false;
+    }
+  page->location = FRAME;
+  return true;
+}
+
+/* Unmaps PAGE, which is in a shared frame, from it, freeing the frame if
+   PAGE was the last to map it, unless it holds a page of a shared
+   memory segment. PAGE can be paged in again from its file or
+   segment. Assumes PAGE->lock is acquired by the current thread. */
+void
+share_page_release (struct page *page)
+{
+  struct frame *frame = page->frame;
+  struct share *s;
+  bool shm, last;
+
+  ASSERT (lock_held_by_current_thread (&page->lock));
+  ASSERT (page->location == FRAME && frame->share != NULL);
+
+  lock_acquire (&share_lock);
+  s = frame->share;
+  shm = s->shm != NULL;
+  list_remove (&page->share_elem);
+  last = !shm && list_empty (&s->pages);
+  if (last)
+    {
+      /* Keep the clock off FRAME until frame_free() takes it. */
+      frame->pinned = true;
+      if (s->inode != NULL)
+        hash_delete (&shares, &s->hash_elem);
+      frame->share = NULL;
+      free (s);
+    }
+  lock_release (&share_lock);
+
+  pagedir_clear_page (page->thread->pagedir, page->uaddr);
+  page->location = shm ? SHM : FILE;
+  if (last)
+    frame_free (frame);
+}
+
+/* Returns true if any page mapping shared FRAME accessed it, also
+   clearing their accessed bits if CLEAR is true. A FRAME stopped
+   being shared counts as accessed, to keep the clock off it, but
+   one of a shared memory segment that nobody maps does not, unless the
+   kernel got it since the clock last looked, or still has it.
+   Assumes frame_table_lock is acquired. */
+bool
+share_accessed (struct frame *frame, bool clear)
+{
+  struct list_elem *e;
+  bool accessed = false;
+
+  lock_acquire (&share_lock);
+  if (frame->share == NULL || !frame->share->loaded)
+    accessed = true;
+  else if (list_empty (&frame->share->pages))
+    {
+      struct share *s = frame->share;
+
+      accessed = (s->shm == NULL || s->kernel_pins > 0
+                  || s->kernel_accessed);
+      if (clear)
+        s->kernel_accessed = false;
+    }
+  else
+    for (e = list_begin (&frame->share->pages);
+         e != list_end (&frame->share->pages); e = list_next (e))
+      {
+        struct page *p = list_entry (e, struct page, share_elem);
+
+        if (pagedir_is_accessed (p->thread->pagedir, p->uaddr))
+          {
+            accessed = true;
+            if (clear)
+              pagedir_set_accessed (p->thread->pagedir, p->uaddr, false);
+          }
+      }
+  lock_release (&share_lock);
+  return accessed;
+}
+
+/* Evicts shared FRAME by unmapping it from every page that maps it,
+   which can load it from the file again, if none of them is pinned or
+   busy and the kernel isn't using it. The caller then owns FRAME. Only
+   tries the page locks, since their owners may be waiting on
+   frame_table_lock while holding them, and sets *BUSY if one is
+   taken. A copy-on-write FRAME, or one of a
+   shared memory segment, must be written to swap first, so it instead
+   stays shared with all of the page locks held, for share_swap_out()
+   to finish the job once frame_table_lock is released. Pages of the
+   segment faulting meanwhile wait for that. Returns true if
+   successful.
+   Assumes frame_table_lock is acquired. */
+bool
+share_evict (struct frame *frame, bool *busy)
+{
+  struct share *s;
+  struct list_elem *e, *locked;
+  bool success = true;
+
+  lock_acquire (&share_lock);
+  s = frame->share;
+  if (s == NULL || !s->loaded || s->kernel_pins > 0
+      || (list_empty (&s->pages) && s->shm == NULL))
+    {
+      lock_release (&share_lock);
+      return false;
+    }
+  for (e = list_begin (&s->pages); e != list_end (&s->pages);
+       e = list_next (e))
+    {
+      struct page *p = list_entry (e, struct page, share_elem);
+
+      /* The current thread may be copying one of the pages. */
+      if (lock_held_by_current_thread (&p->lock)
+          || !lock_try_acquire (&p->lock))
+        {
+          *busy = true;
+          success = false;
+          break;
+        }
+      if (p->pinned)
+        {
+          lock_release (&p->lock);
+          success = false;
+          break;
+        }
+    }
+  if (success && s->inode == NULL)
+    {
+      if (s->shm != NULL)
+        s->loaded = false;
+      lock_release (&share_lock);
+      return true;
+    }
+
+  /* Unmap the pages, or just give the locks back. */
+  locked = e;
+  for (e = list_begin (&s->pages); e != locked; )
+    {
+      struct page *p = list_entry (e, struct page, share_elem);
+
+      e = list_next (e);
+      if (success)
+        {
+          pagedir_clear_page (p->thread->pagedir, p->uaddr);
+          p->location = FILE;
+        }
+      lock_release (&p->lock);
+    }
+  if (success)
+    {
+      hash_delete (&shares, &s->hash_elem);
+      frame->share = NULL;
+      free (s);
+    }
+  lock_release (&share_lock);
+  return success;
+}
+
+/* Writes copy-on-write FRAME, which share_evict() claimed, to a swap
+   slot shared by all of the pages mapping it, and releases their
+   locks. A FRAME of a shared memory segment goes to a slot of the
+   segment's instead, for its pages to fault in from. The caller then
+   owns FRAME if successful, and otherwise it stays shared. Returns
+   true if successful. */
+bool
+share_swap_out (struct frame *frame)
+{
+  struct share *s = frame->share;
+  struct shm *shm = s->shm;
+  struct list_elem *e;
+  size_t slot;
+
+  ASSERT (s != NULL && s->inode == NULL);
+
+  slot = swap_out (frame);
+  if (slot != SWAP_ERROR && shm == NULL)
+    swap_share (slot, list_size (&s->pages) - 1);
+
+  lock_acquire (&share_lock);
+  for (e = list_begin (&s->pages); e != list_end (&s->pages); )
+    {
+      struct page *p = list_entry (e, struct page, share_elem);
+
+      e = list_next (e);
+      if (slot != SWAP_ERROR)
+        {
+          pagedir_clear_page (p->thread->pagedir, p->uaddr);
+          p->swap_slot = shm != NULL ? SWAP_ERROR : slot;
+          p->location = shm != NULL ? SHM : SWAP;
+        }
+      lock_release (&p->lock);
+    }
+  if (shm != NULL)
+    {
+      struct shm_page *sp = &shm->pages[s->ofs / PGSIZE];
+
+      if (slot != SWAP_ERROR)
+        {
+          sp->share = NULL;
+          sp->swap_slot = slot;
+        }
+      else
+        s->loaded = true;
+      cond_broadcast (&share_loaded, &share_lock);
+    }
+  if (slot != SWAP_ERROR)
+    {
+      frame->share = NULL;
+      free (s);
+    }
+  lock_release (&share_lock);
+  return slot != SWAP_ERROR;
+}
+
+/* Returns true if FRAME is shared copy-on-write. Assumes the lock of a
+   page mapping FRAME is acquired, which keeps it that way. */
+bool
+share_is_cow (struct frame *frame)
+{
+  return (frame->share != NULL && frame->share->inode == NULL
+          && frame->share->shm == NULL);
+}
+
+/* Returns true if FRAME holds a page of a shared memory segment.
+   Assumes the lock of a page mapping FRAME is acquired, which keeps
+   it that way. */
+bool
+share_is_shm (struct frame *frame)
+{
+  return frame->share != NULL && frame->share->shm != NULL;
+}
+
+/* Returns true if shared FRAME holds a page of a file, which takes no
+   write to evict. Assumes frame_table_lock is acquired. */
+bool
+share_is_clean (struct frame *frame)
+{
+  bool clean;
+
+  lock_acquire (&share_lock);
+  clean = frame->share != NULL && frame->share->inode != NULL;
+  lock_release (&share_lock);
+  return clean;
+}
+
+/* Makes DST, a new page of the current thread, map the frame of SRC,
+   a page of the process it is forked from. Unless the frame is shared
+   already, it becomes shared copy-on-write, mapped read-only by both
+   until one of them writes it. Returns true if successful.
+   Assumes SRC->lock is acquired and SRC is in a frame. */
+bool
+share_fork (struct page *src, struct page *dst)
+{
+  struct frame *frame = src->frame;
+
+  ASSERT (lock_held_by_current_thread (&src->lock));
+  ASSERT (src->location == FRAME);
+
+  if (frame->share == NULL && !share_new_cow (src))
+    return false;
+  if (!pagedir_set_page (dst->thread->pagedir, dst->uaddr, frame->kaddr,
+                         false))
+    return false;
+
+  lock_acquire (&share_lock);
+  list_push_back (&frame->share->pages, &dst->share_elem);
+  lock_release (&share_lock);
+  dst->frame = frame;
+  dst->location = FRAME;
+  return true;
+}
+
+/* Makes the frame of PAGE, which is PAGE's alone, shared copy-on-write
+   with PAGE mapping it read-only. Returns true if successful.
+   Assumes PAGE->lock is acquired. */
+static bool
+share_new_cow (struct page *page)
+{
+  struct frame *frame = page->frame;
+  struct share *s;
+
+  ASSERT (lock_held_by_current_thread (&page->lock));
+  ASSERT (page->location == FRAME && frame->share == NULL);
+
+  s = malloc (sizeof *s);
+  if (s == NULL)
+    return false;
+  s->inode = NULL;
+  s->shm = NULL;
+  s->ofs = 0;
+  s->zero_bytes = 0;
+  s->frame = frame;
+  s->loaded = true;
+  s->kernel_pins = 0;
+  s->kernel_accessed = false;
+  list_init (&s->pages);
+  list_push_back (&s->pages, &page->share_elem);
+  pagedir_set_writable (page->thread->pagedir, page->uaddr, false);
+  frame_set_share (frame, s, NULL);
+  return true;
+}
+
+/* Tries to take the lock of the first page mapping FRAME, which is
+   shared copy-on-write and so stays that way while the lock is held.
+   Returns the page, settled in FRAME, or a null pointer if FRAME is
+   not copy-on-write or the lock is taken. Assumes frame_table_lock is
+   acquired. */
+struct page *
+share_try_lock (struct frame *frame)
+{
+  struct share *s;
+  struct page *page = NULL;
+
+  lock_acquire (&share_lock);
+  s = frame->share;
+  if (s != NULL && s->loaded && s->inode == NULL && s->shm == NULL
+      && !list_empty (&s->pages))
+    {
+      page = list_entry (list_front (&s->pages), struct page, share_elem);
+      if (!lock_try_acquire (&page->lock))
+        page = NULL;
+      else if (page->in_transit)
+        {
+          lock_release (&page->lock);
+          page = NULL;
+        }
+    }
+  lock_release (&share_lock);
+  return page;
+}
+
+/* Gives writable PAGE, in a copy-on-write frame, a writable frame of
+   its own, copying the shared one unless no other page maps it
+   anymore. Returns true if successful.
+   Assumes PAGE->lock is acquired by the current thread. */
+bool
+share_copy_on_write (struct page *page)
+{
+  struct thread *t = page->thread;
+  struct frame *shared = page->frame, *frame = NULL;
+  struct share *s = shared->share;
+  bool last;
+
+  ASSERT (lock_held_by_current_thread (&page->lock));
+  ASSERT (page->location == FRAME && page->writable);
+  ASSERT (share_is_cow (shared));
+
+  lock_acquire (&share_lock);
+  last = list_size (&s->pages) == 1;
+  lock_release (&share_lock);
+  if (last)
+    {
+      /* Only PAGE is left, none can join without its lock. */
+      frame_set_share (shared, NULL, page);
+      free (s);
+      pagedir_set_writable (t->pagedir, page->uaddr, true);
+      return true;
+    }
+
+  /* SHARED stays put meanwhile, since evicting it takes our lock. */
+  frame = frame_alloc (false);
+  palloc_copy_page (frame->kaddr, shared->kaddr);
+  frame->page = page;
+
+  lock_acquire (&share_lock);
+  list_remove (&page->share_elem);
+  last = list_empty (&s->pages);
+  if (last)
+    {
+      /* The others left while we copied. */
+      shared->pinned = true;
+      shared->share = NULL;
+      free (s);
+    }
+  lock_release (&share_lock);
+  if (last)
+    frame_free (shared);
+
+  page->frame = frame;
+  pagedir_clear_page (t->pagedir, page->uaddr);
+  if (!pagedir_set_page (t->pagedir, page->uaddr, frame->kaddr, true))
+    {
+      page->location = CORRUPTED;
+      frame_free (frame);
+      return false;
+    }
+  if (!page->pinned)
+    frame_unpin (frame);
+  return true;
+}
+
+/* Returns a new shared memory segment of PAGE_CNT pages of zeros, with
+   one reference to it, or a null pointer if memory is not
+   available. */
+struct shm *
+share_shm_create (size_t page_cnt)
+{
+  struct shm *shm = malloc (sizeof *shm);
+  size_t i;
+
+  if (shm == NULL)
+    return NULL;
+  shm->pages = malloc (page_cnt * sizeof *shm->pages);
+  if (shm->pages == NULL)
+    {
+      free (shm);
+      return NULL;
+    }
+  for (i = 0; i < page_cnt; i++)
+    {
+      shm->pages[i].share = NULL;
+      shm->pages[i].swap_slot = SWAP_ERROR;
+    }
+  shm->ref_cnt = 1;
+  shm->page_cnt = page_cnt;
+  return shm;
+}
+
+/* Adds a reference to SHM and returns it. */
+struct shm *
+share_shm_reopen (struct shm *shm)
+{
+  lock_acquire (&share_lock);
+  shm->ref_cnt++;
+  lock_release (&share_lock);
+  return shm;
+}
+
+/* Drops a reference to SHM. Dropping the last, once no page maps it
+   anymore, frees it along with its frames and swap slots. */
+void
+share_shm_close (struct shm *shm)
+{
+  bool last;
+  size_t i;
+
+  lock_acquire (&share_lock);
+  last = --shm->ref_cnt == 0;
+  lock_release (&share_lock);
+  if (!last)
+    return;
+
+  for (i = 0; i < shm->page_cnt; i++)
+    shm_page_free (&shm->pages[i]);
+  free (shm->pages);
+  free (shm);
+}
+
+/* Gives up the frame or swap slot holding SP, a page of a segment that
+   no page maps, leaving it all zeros. */
+static void
+shm_page_free (struct shm_page *sp)
+{
+  struct frame *frame = NULL;
+  struct share *s;
+
+  /* The clock may be writing the page out. */
+  lock_acquire (&share_lock);
+  while ((s = sp->share) != NULL && !s->loaded)
+    cond_wait (&share_loaded, &share_lock);
+  if (s != NULL)
+    {
+      ASSERT (list_empty (&s->pages) && s->kernel_pins == 0);
+      frame = s->frame;
+      /* Keep the clock off FRAME until frame_free() takes it. */
+      frame->pinned = true;
+      frame->share = NULL;
+      sp->share = NULL;
+      free (s);
+    }
+  lock_release (&share_lock);
+
+  if (frame != NULL)
+    frame_free (frame);
+  else if (sp->swap_slot != SWAP_ERROR)
+    swap_free (sp->swap_slot);
+  sp->swap_slot = SWAP_ERROR;
+}
+
+/* Changes the size of SHM, which no page maps, to PAGE_CNT pages, at
+   least 1, giving up the pages past its new end or adding pages of
+   zeros.  The caller must keep others from using SHM meanwhile, and
+   from using pages past PAGE_CNT after a call that fails.  Returns
+   false if memory is not available. */
+bool
+share_shm_resize (struct shm *shm, size_t page_cnt)
+{
+  struct shm_page *pages, *old_pages;
+  size_t i;
+
+  ASSERT (page_cnt > 0);
+
+  for (i = page_cnt; i < shm->page_cnt; i++)
+    shm_page_free (&shm->pages[i]);
+  pages = malloc (page_cnt * sizeof *pages);
+  if (pages == NULL)
+    {
+      if (page_cnt > shm->page_cnt)
+        return false;
+      /* Keep the array, just using less of it. */
+      lock_acquire (&share_lock);
+      shm->page_cnt = page_cnt;
+      lock_release (&share_lock);
+      return true;
+    }
+  for (i = shm->page_cnt; i < page_cnt; i++)
+    {
+      pages[i].share = NULL;
+      pages[i].swap_slot = SWAP_ERROR;
+    }
+
+  /* The clock finds a page being written out by its index in the
+     array, under share_lock. */
+  lock_acquire (&share_lock);
+  memcpy (pages, shm->pages,
+          (page_cnt < shm->page_cnt ? page_cnt : shm->page_cnt)
+          * sizeof *pages);
+  old_pages = shm->pages;
+  shm->pages = pages;
+  shm->page_cnt = page_cnt;
+  lock_release (&share_lock);
+  free (old_pages);
+  return true;
+}
+
+/* Returns the kernel address of page IDX of SHM, loading it into a
+   frame if need be, and keeps it there until share_shm_put(), for the
+   kernel to read and write it.  Returns a null pointer if memory is
+   not available. */
+void *
+share_shm_get (struct shm *shm, size_t idx)
+{
+  struct frame *frame;
+  struct share *s;
+  void *kaddr = NULL;
+
+  ASSERT (idx < shm->page_cnt);
+
+  lock_acquire (&share_lock);
+  s = shm_load (shm, idx, &frame);
+  if (s != NULL)
+    {
+      s->kernel_pins++;
+      s->kernel_accessed = true;
+      kaddr = s->frame->kaddr;
+    }
+  lock_release (&share_lock);
+  if (frame != NULL)
+    frame_free (frame);
+  return kaddr;
+}
+
+/* Lets the clock evict page IDX of SHM again, once for each
+   share_shm_get() of it. */
+void
+share_shm_put (struct shm *shm, size_t idx)
+{
+  struct share *s;
+
+  lock_acquire (&share_lock);
+  s = shm->pages[idx].share;
+  ASSERT (s != NULL && s->kernel_pins > 0);
+  s->kernel_pins--;
+  lock_release (&share_lock);
+}
+
+/* Returns the number of pages in SHM. */
+size_t
+share_shm_page_cnt (struct shm *shm)
+{
+  return shm->page_cnt;
+}
+
+/* Places PAGE, whose location is SHM, in the shared frame holding its
+   page of the segment its mmap maps, loading it into a new one from
+   the segment's swap slot, or zeroed, if there is none yet. Returns
+   true on success and false on failure, like page_in(), leaving PAGE
+   pinned on success.
+   Assumes PAGE->lock is acquired by the current thread. */
+bool
+share_shm_page_in (struct page *page)
+{
+  struct thread *t = thread_current ()->process;
+  struct frame *frame;
+  struct share *s;
+
+  ASSERT (lock_held_by_current_thread (&page->lock));
+  ASSERT (page->location == SHM);
+
+  lock_acquire (&share_lock);
+  s = shm_load (page->mmap->shm, page->start_byte / PGSIZE, &frame);
+  if (s != NULL)
+    list_push_back (&s->pages, &page->share_elem);
+  lock_release (&share_lock);
+
+  if (frame != NULL)
+    frame_free (frame);
+  if (s == NULL)
+    {
+      page->location = CORRUPTED;
+      return false;
+    }
+
+  page->frame = s->frame;
+  page->pinned = true;
+  page->location = FRAME;
+  if (!pagedir_set_page (t->pagedir, page->uaddr, s->frame->kaddr,
+                         page->writable))
+    {
+      share_page_release (page);
+      page->pinned = false;
+      return false;
+    }
+  return true;
+}
+
+/* Returns the shared frame holding page IDX of SHM, loading it into a
+   new one from the segment's swap slot, or zeroed, if there is none
+   yet, or a null pointer if memory is not available. Stores in *SPARE
+   a frame it allocated and didn't use, or a null pointer, for the
+   caller to free once it releases share_lock, which must be held and
+   is released meanwhile. */
+static struct share *
+shm_load (struct shm *shm, size_t idx, struct frame **spare)
+{
+  struct shm_page *sp = &shm->pages[idx];
+  struct frame *frame = NULL;
+  struct share *s;
+
+  ASSERT (lock_held_by_current_thread (&share_lock));
+
+  while ((s = sp->share) == NULL || !s->loaded)
+    {
+      bool success;
+
+      if (s != NULL)
+        {
+          /* Someone else is loading or evicting it. */
+          cond_wait (&share_loaded, &share_lock);
+          continue;
+        }
+      if (frame == NULL)
+        {
+          /* Don't allocate under share_lock, eviction takes it. */
+          lock_release (&share_lock);
+          frame = frame_alloc (false);
+          lock_acquire (&share_lock);
+          continue;
+        }
+
+      /* Claim the page for FRAME, pinned until loaded, and load it. */
+      s = malloc (sizeof *s);
+      if (s == NULL)
+        break;
+      s->inode = NULL;
+      s->shm = shm;
+      s->ofs = idx * PGSIZE;
+      s->zero_bytes = 0;
+      s->frame = frame;
+      s->loaded = false;
+      s->kernel_pins = 0;
+      s->kernel_accessed = false;
+      list_init (&s->pages);
+      sp->share = s;
+      lock_release (&share_lock);
+
+      if (sp->swap_slot != SWAP_ERROR)
+        {
+          success = swap_in (frame, sp->swap_slot);
+          if (success)
+            procstat_add (&procstat_current ()->swap_ins, 1);
+        }
+      else
+        {
+          palloc_zero_page (frame->kaddr);
+          success = true;
+        }
+      if (success)
+        frame_set_share (frame, s, NULL);
+
+      lock_acquire (&share_lock);
+      if (success)
+        {
+          sp->swap_slot = SWAP_ERROR;
+          s->loaded = true;
+          frame = NULL;
+        }
+      else
+        {
+          sp->share = NULL;
+          free (s);
+          s = NULL;
+        }
+      cond_broadcast (&share_loaded, &share_lock);
+      if (!success)
+        break;
+    }
+  *spare = frame;
+  return s;
+}
+
+/* Hash function for SHARES. */
+static unsigned
+share_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct share *s = hash_entry (e, struct share, hash_elem);
+  return (hash_bytes (&s->inode, sizeof s->inode) ^ hash_int (s->ofs)
+          ^ hash_int (s->zero_bytes));
+}
+
+/* Hash comparison function for SHARES. */
+static bool
+share_less (const struct hash_elem *a_, const struct hash_elem *b_,
+            void *aux UNUSED)
+{
+  const struct share *a = hash_entry (a_, struct share, hash_elem);
+  const struct share *b = hash_entry (b_, struct share, hash_elem);
+
+  if (a->inode != b->inode)
+    return a->inode < b->inode;
+  if (a->ofs != b->ofs)
+    return a->ofs < b->ofs;
+  return a->zero_bytes < b->zero_bytes;
+}
+
+/* Hash function for MERGE_STABLE. */
+static unsigned
+merge_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_entry (e, struct merge_node, hash_elem)->sum;
+}
+
+/* Hash comparison function for MERGE_STABLE. */
+static bool
+merge_less (const struct hash_elem *a, const struct hash_elem *b,
+            void *aux UNUSED)
+{
+  return (hash_entry (a, struct merge_node, hash_elem)->sum
+          < hash_entry (b, struct merge_node, hash_elem)->sum);
+}
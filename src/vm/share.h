@@ -0,0 +1,35 @@
+#ifndef VM_SHARE_H
+#define VM_SHARE_H
+#include <stdbool.h>
+#include <stddef.h>
+#include "vm/frame.h"
+#include "vm/page.h"
+
+struct shm;
+
+extern size_t share_merge_pages;
+
+void share_init (void);
+void share_merge_init (void);
+struct page *share_try_lock (struct frame *frame);
+bool share_can_share (struct page *page);
+bool share_page_in (struct page *page);
+void share_page_release (struct page *page);
+bool share_accessed (struct frame *frame, bool clear);
+bool share_evict (struct frame *frame, bool *busy);
+bool share_swap_out (struct frame *frame);
+bool share_is_cow (struct frame *frame);
+bool share_is_clean (struct frame *frame);
+bool share_fork (struct page *src, struct page *dst);
+bool share_copy_on_write (struct page *page);
+bool share_is_shm (struct frame *frame);
+struct shm *share_shm_create (size_t page_cnt);
+struct shm *share_shm_reopen (struct shm *);
+void share_shm_close (struct shm *);
+size_t share_shm_page_cnt (struct shm *);
+bool share_shm_resize (struct shm *, size_t page_cnt);
+void *share_shm_get (struct shm *, size_t idx);
+void share_shm_put (struct shm *, size_t idx);
+bool share_shm_page_in (struct page *page);
+
+#endif /* vm/share.h */
@@ -1,85 +1,501 @@
 #include "vm/swap.h"
+#include <inttypes.h>
+#include <lz.h>
 #include <stdio.h>
+#include <string.h>
+#include "threads/kstat.h"
 #include "threads/malloc.h"
+#include "threads/thread.h"
 #include "threads/vaddr.h"
 #include "threads/synch.h"
+#include "threads/vmalloc.h"
 
 #define SECTORS_PER_PAGE (PGSIZE / BLOCK_SECTOR_SIZE)
 
+/* Adjacent slots striped onto one device before moving on to the next,
+   as many as a process gets set aside, so a run of its slots takes
+   one device while the next process's takes another. */
+#define STRIPE_SLOTS SWAP_RESERVE
+
+/* Pages compressing to more than this many bytes aren't worth keeping
+   in the pool. */
+#define POOL_MAX_SIZE (PGSIZE / 2)
+/* Pool slots per page of memory the pool may take, enough for pages
+   compressed 8 to 1. */
+#define POOL_SLOTS_PER_PAGE 8
+
+/* Pages of memory the compressed pool may take up, set by the
+   -swap-pool kernel command line option. 0 turns the pool off. */
+size_t swap_pool_pages;
+
+/* A page in a slot of the compressed pool. */
+struct swap_pool_entry
+  {
+    void *data;                     /* Compressed page. */
+    size_t size;                    /* Bytes of DATA. */
+  };
+
 /* Swap table keeping track of free and allocated swap slots
    and the block deivce containing them. */
 static struct swap_table st;
 /* Lock guarding the swap table allocations and frees. */
 static struct lock swap_table_lock;
 
-/* Initializes the swap table st by loading its block device
-   and creating its allocation bitmap. */
+/* Scratch space for compressing pages, guarded by POOL_LOCK. */
+static struct lock pool_lock;
+static uint16_t pool_table[LZ_TABLE_SIZE];
+static uint8_t pool_buffer[POOL_MAX_SIZE];
+
+/* Pool statistics, guarded by swap_table_lock. */
+static unsigned long long pool_stored;       /* Pages stored. */
+static unsigned long long pool_stored_bytes; /* Bytes they took. */
+static unsigned long long pool_loaded;       /* Pages loaded back. */
+static unsigned long long pool_incompressible; /* Pages turned away as
+                                                  incompressible. */
+static unsigned long long pool_full;         /* Pages turned away for
+                                                lack of room. */
+
+/* Statistics. */
+static uint64_t read_used_slots (void);
+static struct kstat_counter stat_slots_used
+  = KSTAT_GAUGE ("swap.slots.used", read_used_slots);
+
+static struct block *slot_sector (size_t swap_slot, block_sector_t *sector);
+static size_t pool_store (struct frame **frames, size_t cnt);
+static size_t device_alloc (size_t cnt, struct thread *owner);
+static size_t device_scan (size_t cnt);
+static bool slot_allocated (size_t swap_slot);
+static void swap_release (size_t swap_slot, size_t cnt);
+
+/* Adds BLOCK to the devices swap is striped over, giving the first
+   one the swap role. Must be called before swap_init(). */
+void
+swap_add_device (struct block *block)
+{
+  if (st.device_cnt >= SWAP_DEVICE_MAX)
+    {
+      printf ("swap: ignoring %s, too many devices\n", block_name (block));
+      return;
+    }
+  printf ("swap: using %s\n", block_name (block));
+  if (st.device_cnt == 0)
+    block_set_role (BLOCK_SWAP, block);
+  st.devices[st.device_cnt++] = block;
+}
+
+/* Initializes the swap table st by sizing up its block devices
+   and creating its allocation bitmaps. Slots are striped over the
+   devices STRIPE_SLOTS at a time as far as the smallest one goes, and
+   the rest of the bigger ones follow. */
 void
 swap_init (void)
 {
+  size_t min_slots = SIZE_MAX;
   size_t slot_count;
+  size_t i;
 
   lock_init (&swap_table_lock);
-  st.block_device = block_get_role (BLOCK_SWAP);
-  if (st.block_device == NULL)
+  lock_init (&pool_lock);
+  if (st.device_cnt == 0)
     PANIC ("Swap block device does not exist!");
-  slot_count = block_size (st.block_device) / SECTORS_PER_PAGE;
+  st.device_slots = 0;
+  for (i = 0; i < st.device_cnt; i++)
+    {
+      size_t slots = block_size (st.devices[i]) / SECTORS_PER_PAGE;
+
+      st.device_slots += slots;
+      if (slots < min_slots)
+        min_slots = slots;
+    }
+  st.stripe_slots = (st.device_cnt > 1
+                     ? min_slots / STRIPE_SLOTS * STRIPE_SLOTS * st.device_cnt
+                     : 0);
+  st.pool_capacity = swap_pool_pages * PGSIZE;
+  slot_count = swap_pool_pages * POOL_SLOTS_PER_PAGE;
   lock_acquire (&swap_table_lock);
-  st.allocated_slots = bitmap_create (slot_count);
-  if (st.allocated_slots == NULL)
+  st.allocated_slots = bitmap_create (st.device_slots);
+  st.pool_slots = bitmap_create (slot_count);
+  st.pool = slot_count > 0 ? vcalloc (slot_count, sizeof *st.pool) : NULL;
+  st.refs = vmalloc ((st.device_slots + slot_count) * sizeof *st.refs);
+  if (st.allocated_slots == NULL || st.pool_slots == NULL
+      || (slot_count > 0 && st.pool == NULL)
+      || (st.device_slots + slot_count > 0 && st.refs == NULL))
     PANIC ("OOM when allocating swap table structures!");
   lock_release (&swap_table_lock);
+  kstat_register (&stat_slots_used);
 }
 
 /* Stores the page in FRAME from memory into the first available
    swap slot in the swap block device and returns its index. Returns
    SWAP_ERROR when no swap slots are available. */
 size_t
-swap_out (void *frame_)
+swap_out (void *frame)
+{
+  return swap_out_multiple ((struct frame **) &frame, 1, NULL);
+}
+
+/* Stores the pages in the CNT FRAMES, at most SWAP_CLUSTER, into a run
+   of CNT adjacent free swap slots, the page in FRAMES[I] going to the
+   I'th slot of the run, and returns the index of the first slot. The
+   compressed pool is tried first. Otherwise the run comes from the
+   slots set aside for OWNER, the process the pages belong to, if not
+   null, and the writes are all queued before waiting for any of them,
+   so the block layer merges them into one transfer. Returns SWAP_ERROR
+   when there is no such run. */
+size_t
+swap_out_multiple (struct frame **frames, size_t cnt, struct thread *owner)
 {
-  struct frame *frame = frame_;
+  struct block_request r[SWAP_CLUSTER];
   size_t swap_slot;
-  block_sector_t sector_begin, sector_offs;
+  size_t i;
+
+  ASSERT (cnt > 0 && cnt <= SWAP_CLUSTER);
+
+  swap_slot = pool_store (frames, cnt);
+  if (swap_slot != SWAP_ERROR)
+    return swap_slot;
 
-  /* Scan for the first free swap slot. */
   lock_acquire (&swap_table_lock);
-  swap_slot = bitmap_scan_and_flip (st.allocated_slots, 0, 1, false);
+  swap_slot = device_alloc (cnt, owner);
+  if (swap_slot != SWAP_ERROR)
+    for (i = 0; i < cnt; i++)
+      st.refs[swap_slot + i] = 1;
   lock_release (&swap_table_lock);
-  if (swap_slot == BITMAP_ERROR)
+  if (swap_slot == SWAP_ERROR)
     return SWAP_ERROR;
-  /* Loop over the frame and write it sector by sector to swap slot. */
-  sector_begin = swap_slot * SECTORS_PER_PAGE;
-  for (sector_offs = 0; sector_offs < SECTORS_PER_PAGE; sector_offs++)
-    block_write (st.block_device, sector_begin + sector_offs,
-                 ((uint8_t *) frame->kaddr) + sector_offs * BLOCK_SECTOR_SIZE);
+  /* Write each whole frame to its swap slot in one request. */
+  for (i = 0; i < cnt; i++)
+    {
+      block_sector_t sector;
+      struct block *block = slot_sector (swap_slot + i, &sector);
+
+      block_request_init (&r[i], sector, SECTORS_PER_PAGE, frames[i]->kaddr,
+                          true, NULL, NULL);
+      block_submit (block, &r[i]);
+    }
+  for (i = 0; i < cnt; i++)
+    block_wait (&r[i]);
+  return swap_slot;
+}
+
+/* Allocates a run of CNT free slots on the devices and returns the
+   first, or SWAP_ERROR if there is none. The run continues the slots
+   set aside for OWNER, if not null and they are still free. Otherwise
+   the search goes on from where the last one stopped, setting aside
+   SWAP_RESERVE slots for OWNER if it finds that many, rather than
+   starting over from the front, which fills first and would make every
+   search longer. The slots set aside stay free: they only steer where
+   OWNER's next pages go, so they cost nothing when it never uses them.
+   Assumes swap_table_lock is acquired. */
+static size_t
+device_alloc (size_t cnt, struct thread *owner)
+{
+  size_t swap_slot, end;
+
+  ASSERT (cnt <= SWAP_RESERVE);
+
+  if (owner != NULL && owner->swap_next + cnt <= owner->swap_end
+      && !bitmap_any (st.allocated_slots, owner->swap_next, cnt))
+    swap_slot = owner->swap_next;
+  else
+    {
+      swap_slot = BITMAP_ERROR;
+      if (owner != NULL)
+        {
+          swap_slot = device_scan (SWAP_RESERVE);
+          end = swap_slot + SWAP_RESERVE;
+        }
+      if (swap_slot == BITMAP_ERROR)
+        {
+          swap_slot = device_scan (cnt);
+          end = swap_slot + cnt;
+        }
+      if (swap_slot == BITMAP_ERROR)
+        return SWAP_ERROR;
+      if (owner != NULL)
+        owner->swap_end = end;
+      st.next_slot = end < st.device_slots ? end : 0;
+    }
+  bitmap_set_multiple (st.allocated_slots, swap_slot, cnt, true);
+  if (owner != NULL)
+    owner->swap_next = swap_slot + cnt;
+  return swap_slot;
+}
+
+/* Returns the first slot of a run of CNT free slots on the devices at or
+   after the next-fit cursor, wrapping around to the front, or
+   BITMAP_ERROR if there is none. Assumes swap_table_lock is acquired. */
+static size_t
+device_scan (size_t cnt)
+{
+  size_t swap_slot = bitmap_scan (st.allocated_slots, st.next_slot, cnt,
+                                  false);
+
+  if (swap_slot == BITMAP_ERROR && st.next_slot > 0)
+    swap_slot = bitmap_scan (st.allocated_slots, 0, cnt, false);
   return swap_slot;
 }
 
+/* Compresses the pages in the CNT FRAMES into a run of CNT adjacent
+   slots of the compressed pool, numbered after those of the block
+   devices, and returns the index of the first slot. Returns SWAP_ERROR,
+   storing none of them, if any of the pages doesn't compress well or
+   there is no room for them all. */
+static size_t
+pool_store (struct frame **frames, size_t cnt)
+{
+  void *data[SWAP_CLUSTER];
+  size_t size[SWAP_CLUSTER];
+  size_t total = 0, i, n;
+  size_t swap_slot = BITMAP_ERROR;
+
+  if (st.pool == NULL)
+    return SWAP_ERROR;
+
+  for (n = 0; n < cnt; n++)
+    {
+      lock_acquire (&pool_lock);
+      size[n] = lz_compress (frames[n]->kaddr, PGSIZE, pool_buffer,
+                             POOL_MAX_SIZE, pool_table);
+      data[n] = size[n] > 0 ? malloc (size[n]) : NULL;
+      if (data[n] != NULL)
+        memcpy (data[n], pool_buffer, size[n]);
+      lock_release (&pool_lock);
+      if (data[n] == NULL)
+        break;
+      total += size[n];
+    }
+
+  lock_acquire (&swap_table_lock);
+  if (n < cnt && size[n] == 0)
+    pool_incompressible += cnt;
+  else if (n < cnt || st.pool_bytes + total > st.pool_capacity
+           || ((swap_slot = bitmap_scan_and_flip (st.pool_slots, 0, cnt,
+                                                  false))
+               == BITMAP_ERROR))
+    pool_full += cnt;
+  else
+    {
+      for (i = 0; i < cnt; i++)
+        {
+          st.pool[swap_slot + i].data = data[i];
+          st.pool[swap_slot + i].size = size[i];
+          st.refs[st.device_slots + swap_slot + i] = 1;
+        }
+      st.pool_bytes += total;
+      pool_stored += cnt;
+      pool_stored_bytes += total;
+    }
+  lock_release (&swap_table_lock);
+
+  if (swap_slot == BITMAP_ERROR)
+    {
+      for (i = 0; i < n; i++)
+        free (data[i]);
+      return SWAP_ERROR;
+    }
+  return st.device_slots + swap_slot;
+}
+
 /* Loads swap slot at SWAP_SLOT into memory page mapped by FRAME.
    Returns true on success or false if SWAP_SLOT is invalid. */
 bool
-swap_in (void *frame_, size_t swap_slot)
+swap_in (void *frame, size_t swap_slot)
+{
+  return swap_in_multiple ((struct frame **) &frame, swap_slot, 1, false);
+}
+
+/* Loads the CNT adjacent swap slots starting at SWAP_SLOT, at most
+   SWAP_CLUSTER, into the memory pages mapped by FRAMES, slot I going to
+   FRAMES[I], and lets go of the slots. If KEEP is true, holds on to
+   the slots on the block device instead, as a copy of pages that an
+   unchanged page can go back to without a write, and lets go of the
+   pool's only, whose memory is better spent on other pages. Slots on
+   the block device are all read in one transfer, and slots in the
+   compressed pool are decompressed meanwhile. Returns true on success
+   or false if any of the slots is invalid. */
+bool
+swap_in_multiple (struct frame **frames, size_t swap_slot, size_t cnt,
+                  bool keep)
 {
-  struct frame *frame = frame_;
-  block_sector_t sector_begin, sector_offs;
+  struct block_request r[SWAP_CLUSTER];
+  size_t loaded = 0;
+  bool success = true;
+  size_t i;
+
+  ASSERT (cnt > 0 && cnt <= SWAP_CLUSTER);
+
+  /* Verify that the swap slots are actually occupied. */
+  lock_acquire (&swap_table_lock);
+  for (i = 0; i < cnt; i++)
+    success = success && slot_allocated (swap_slot + i);
+  lock_release (&swap_table_lock);
+  if (!success)
+    return false;
+  /* Read each whole swap slot on the devices into its frame in one
+     request. */
+  for (i = 0; i < cnt; i++)
+    if (swap_slot + i < st.device_slots)
+      {
+        block_sector_t sector;
+        struct block *block = slot_sector (swap_slot + i, &sector);
 
-  /* Verify that the swap slot is actually occupied. */
-  if (!bitmap_test (st.allocated_slots, swap_slot))
+        block_request_init (&r[i], sector, SECTORS_PER_PAGE,
+                            frames[i]->kaddr, false, NULL, NULL);
+        block_submit (block, &r[i]);
+      }
+  /* Our hold on the pool slots keeps their data around. */
+  for (i = 0; i < cnt; i++)
+    if (swap_slot + i >= st.device_slots)
+      {
+        struct swap_pool_entry *e = &st.pool[swap_slot + i
+                                             - st.device_slots];
+
+        success = success && lz_decompress (e->data, e->size,
+                                            frames[i]->kaddr, PGSIZE);
+        loaded++;
+      }
+  for (i = 0; i < cnt; i++)
+    if (swap_slot + i < st.device_slots)
+      block_wait (&r[i]);
+  if (!success)
     return false;
-  /* Read the swap slot sector by sector to the frame. */
-  sector_begin = swap_slot * SECTORS_PER_PAGE;
-  for (sector_offs = 0; sector_offs < SECTORS_PER_PAGE; sector_offs++)
-    block_read (st.block_device, sector_begin + sector_offs,
-                ((uint8_t *) frame->kaddr) + sector_offs * BLOCK_SECTOR_SIZE);
-  /* Free up the swap slot. */
-  bitmap_reset (st.allocated_slots, swap_slot);
+
+  lock_acquire (&swap_table_lock);
+  pool_loaded += loaded;
+  lock_release (&swap_table_lock);
+  if (!keep)
+    swap_release (swap_slot, cnt);
+  else
+    for (i = 0; i < cnt; i++)
+      if (!swap_on_device (swap_slot + i))
+        swap_release (swap_slot + i, 1);
   return true;
 }
 
-/* Frees up a swap slot in the swap table. */
+/* Returns the device holding SWAP_SLOT, a slot on the devices, and
+   sets *SECTOR to the first of its sectors there. */
+static struct block *
+slot_sector (size_t swap_slot, block_sector_t *sector)
+{
+  size_t striped, i;
+
+  ASSERT (swap_slot < st.device_slots);
+
+  if (swap_slot < st.stripe_slots)
+    {
+      size_t stripe = swap_slot / STRIPE_SLOTS;
+
+      *sector = ((stripe / st.device_cnt * STRIPE_SLOTS
+                  + swap_slot % STRIPE_SLOTS) * SECTORS_PER_PAGE);
+      return st.devices[stripe % st.device_cnt];
+    }
+  swap_slot -= st.stripe_slots;
+  striped = st.stripe_slots / st.device_cnt;
+  for (i = 0; ; i++)
+    {
+      size_t rest = block_size (st.devices[i]) / SECTORS_PER_PAGE - striped;
+
+      if (swap_slot < rest)
+        {
+          *sector = (striped + swap_slot) * SECTORS_PER_PAGE;
+          return st.devices[i];
+        }
+      swap_slot -= rest;
+    }
+}
+
+/* Returns true if SWAP_SLOT is a slot on a block device, rather than
+   in the compressed pool. */
+bool
+swap_on_device (size_t swap_slot)
+{
+  return swap_slot < st.device_slots;
+}
+
+/* Adds CNT more pages to those sharing the allocated SWAP_SLOT, as
+   when forking a process with pages in swap. Each of them must later
+   let go of it by swapping it in or calling swap_free(). */
+void
+swap_share (size_t swap_slot, size_t cnt)
+{
+  lock_acquire (&swap_table_lock);
+  ASSERT (slot_allocated (swap_slot));
+  st.refs[swap_slot] += cnt;
+  lock_release (&swap_table_lock);
+}
+
+/* Lets go of a swap slot, freeing it up in the swap table once no
+   page shares it. */
 void
 swap_free (size_t swap_slot)
 {
-  bitmap_reset (st.allocated_slots, swap_slot);
+  swap_release (swap_slot, 1);
+}
+
+/* Prints statistics of the compressed pool, if there is one. */
+void
+swap_print_stats (void)
+{
+  if (st.pool == NULL)
+    return;
+  printf ("Swap pool: %llu pages stored in %llu bytes, %llu loaded, "
+          "%llu incompressible, %llu turned away full, "
+          "%zu of %zu bytes in use\n",
+          pool_stored, pool_stored_bytes, pool_loaded, pool_incompressible,
+          pool_full, st.pool_bytes, st.pool_capacity);
 }
 
+/* Returns the number of swap slots in use, on the devices and in the
+   pool, for the swap.slots.used statistic. */
+static uint64_t
+read_used_slots (void)
+{
+  size_t cnt;
+
+  lock_acquire (&swap_table_lock);
+  cnt = (bitmap_count (st.allocated_slots, 0, st.device_slots, true)
+         + bitmap_count (st.pool_slots, 0, bitmap_size (st.pool_slots),
+                         true));
+  lock_release (&swap_table_lock);
+  return cnt;
+}
+
+/* Returns true if SWAP_SLOT, on a device or in the pool, is allocated.
+   Assumes swap_table_lock is acquired. */
+static bool
+slot_allocated (size_t swap_slot)
+{
+  if (swap_slot < st.device_slots)
+    return bitmap_test (st.allocated_slots, swap_slot);
+  swap_slot -= st.device_slots;
+  return (swap_slot < bitmap_size (st.pool_slots)
+          && bitmap_test (st.pool_slots, swap_slot));
+}
+
+/* Lets go of the CNT swap slots starting at SWAP_SLOT, freeing those no
+   page shares anymore. */
+static void
+swap_release (size_t swap_slot, size_t cnt)
+{
+  size_t i;
+
+  lock_acquire (&swap_table_lock);
+  for (i = swap_slot; i < swap_slot + cnt; i++)
+    {
+      ASSERT (st.refs[i] > 0);
+      if (--st.refs[i] > 0)
+        continue;
+      if (i < st.device_slots)
+        bitmap_reset (st.allocated_slots, i);
+      else
+        {
+          struct swap_pool_entry *e = &st.pool[i - st.device_slots];
+
+          free (e->data);
+          st.pool_bytes -= e->size;
+          bitmap_reset (st.pool_slots, i - st.device_slots);
+        }
+    }
+  lock_release (&swap_table_lock);
+}
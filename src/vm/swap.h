@@ -6,21 +6,60 @@
 #include "devices/block.h"
 #include "vm/frame.h"
 
-/* Swap Table keeps track of allocated swap slots on a block
-   device. */
+struct frame;
+struct swap_pool_entry;
+struct thread;
+
+/* Most block devices swap is striped over. */
+#define SWAP_DEVICE_MAX 8
+
+/* Swap Table keeps track of allocated swap slots on block devices,
+   and in a pool of compressed pages in memory tried first, whose slots
+   are numbered after the devices'. */
 struct swap_table
   {
-    struct block *block_device;     /* Block device where slots are stored. */
+    struct block *devices[SWAP_DEVICE_MAX]; /* Block devices where slots
+                                               are stored. */
+    size_t device_cnt;              /* Number of DEVICES. */
+    size_t device_slots;            /* Number of slots on all DEVICES. */
+    size_t stripe_slots;            /* Number of the first of them, those
+                                       striped over every device. */
     struct bitmap *allocated_slots; /* Bitmap of allocated/free swap slots. */
+    size_t next_slot;               /* Where the next search for free
+                                       slots on the devices starts. */
+    struct bitmap *pool_slots;      /* Bitmap of allocated/free pool slots. */
+    struct swap_pool_entry *pool;   /* Page in each pool slot, or null if
+                                       there is no pool. */
+    size_t pool_bytes;              /* Bytes the pool's pages take. */
+    size_t pool_capacity;           /* Most bytes they may take. */
+    unsigned *refs;                 /* Pages sharing each allocated slot. */
   };
 
+/* Pages of memory the compressed pool may take, 0 for none. */
+extern size_t swap_pool_pages;
+
 /* Identifies one swap slot useful for paging. */
 #define SWAP_ERROR SIZE_MAX
 
+/* Most pages swapped out together in one write. */
+#define SWAP_CLUSTER 8
+
+/* Slots set aside at a time for the pages a process swaps out, so
+   that its consecutive evictions land next to each other. */
+#define SWAP_RESERVE 32
+
 /* Swap Table paging functions. */
+void swap_add_device (struct block *);
 void swap_init (void);
 size_t swap_out (void *frame);
+size_t swap_out_multiple (struct frame **frames, size_t cnt,
+                          struct thread *owner);
 bool swap_in (void *frame, size_t slot_idx);
+bool swap_in_multiple (struct frame **frames, size_t slot_idx, size_t cnt,
+                       bool keep);
+bool swap_on_device (size_t swap_slot);
+void swap_share (size_t swap_slot, size_t cnt);
 void swap_free (size_t swap_slot);
+void swap_print_stats (void);
 
 #endif /* vm/swap.h */